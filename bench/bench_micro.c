@@ -0,0 +1,243 @@
+/**
+ * @file bench/bench_micro.c
+ * @brief Micro-benchmarks of the request path.
+ *
+ * Times request parsing, header delimiter scans, MIME type lookups, response head serialization
+ * and configuration lookups in a loop and prints one JSON object per benchmark, e.g.
+ * `{"bench":"parse_request","iterations":1048576,"ns_per_op":412.3}`. Every benchmark is run with
+ * a doubling number of iterations until a run takes at least `BENCH_MIN_TIME_NS`, so fast and slow
+ * operations are both timed over a meaningful interval.
+ *
+ * Must be run from the repository root, so `CONF_FILE` is found. Usage:
+ * `bin/bench/bench_micro [filter]`, where only the benchmarks whose name contains `filter` are run.
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "config.h"
+#include "http_parser.h"
+#include "mimetypes.h"
+#include "request.h"
+#include "response.h"
+
+/**
+ * @brief Defines the minimum duration (in nanoseconds) of a timed run of a benchmark.
+ */
+#ifndef BENCH_MIN_TIME_NS
+#define BENCH_MIN_TIME_NS 200000000L
+#endif
+
+/**
+ * @brief A request head as sent by a browser, parsed by the request benchmarks.
+ */
+const char *bench_request =
+    "GET /images/Starship.jpg HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/92.0.4515.131 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "If-None-Match: \"5f2b-60c8a1e0\"\r\n"
+    "\r\n";
+
+/**
+ * @brief Arena the request and response benchmarks allocate from, reset after every operation.
+ */
+arena *bench_arena = NULL;
+
+/**
+ * @brief Response serialized by the response head benchmark.
+ */
+response *bench_response = NULL;
+
+/**
+ * @brief Written by the benchmarks, so the compiler can't drop the benchmarked calls.
+ */
+volatile size_t bench_sink = 0;
+
+/**
+ * @brief Parses `bench_request` with `_parse_request()`, which copies the head into the arena.
+ */
+void bench_parse_request() {
+    reset_arena(bench_arena);
+    request *req = _initialize_request_from_arena(bench_arena);
+    bench_sink += _parse_request(bench_request, req);
+}
+
+/**
+ * @brief Parses `bench_request` with the incremental parser the workers use.
+ */
+void bench_parse_http_request() {
+    http_parser parser;
+    init_http_parser(&parser);
+    bench_sink += parse_http_request(&parser, bench_request, strlen(bench_request));
+}
+
+/**
+ * @brief A long header value, scanned by the delimiter benchmarks.
+ */
+const char *bench_header_value = "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like "
+                                 "Gecko) Chrome/92.0.4515.131 Safari/537.36";
+
+/**
+ * @brief Scans `bench_header_value` with the implementation chosen for the CPU.
+ */
+void bench_find_http_delimiter() {
+    bench_sink += find_http_delimiter(bench_header_value, strlen(bench_header_value), false);
+}
+
+/**
+ * @brief Scans `bench_header_value` one byte at a time, the baseline of the vectorized scans.
+ */
+void bench_find_http_delimiter_scalar() {
+    bench_sink +=
+        _find_http_delimiter_scalar(bench_header_value, strlen(bench_header_value), false);
+}
+
+/**
+ * @brief Looks up the MIME type of a URL with a common extension.
+ */
+void bench_get_mimetype_for_url() {
+    bench_sink += (size_t)get_mimetype_for_url("/images/Starship.jpg", NULL);
+}
+
+/**
+ * @brief Looks up the MIME type of a URL without a known extension, which falls back.
+ */
+void bench_get_mimetype_for_url_unknown() {
+    bench_sink += (size_t)get_mimetype_for_url("/downloads/archive.unknownext", NULL);
+}
+
+/**
+ * @brief Serializes the head of a typical `200` response, as `send_response_head()` does.
+ */
+void bench_serialize_response_head() {
+    GString *head = _serialize_response_head(bench_response);
+    bench_sink += head->len;
+    g_string_free(head, TRUE);
+}
+
+/**
+ * @brief Reads the current configuration snapshot, as every request does.
+ */
+void bench_get_server_config() {
+    bench_sink += get_server_config()->port;
+}
+
+/**
+ * @brief Reads a configuration key from the key file.
+ */
+void bench_get_config_int() {
+    bench_sink += get_config_int(PORT_CONF_KEY);
+}
+
+/**
+ * @brief Looks up the `cache-control` header of a URL.
+ */
+void bench_get_cache_control() {
+    bench_sink += (size_t)get_cache_control(get_server_config(), "/style.css", "text/css");
+}
+
+/**
+ * @brief Defines a benchmark, a name and the operation that is timed.
+ */
+typedef struct bench {
+    const char *name;
+    void (*run)();
+} bench;
+
+/**
+ * @brief The benchmarks, in the order they are run.
+ */
+const bench benches[] = {
+    {"parse_request", bench_parse_request},
+    {"parse_http_request", bench_parse_http_request},
+    {"find_http_delimiter", bench_find_http_delimiter},
+    {"find_http_delimiter_scalar", bench_find_http_delimiter_scalar},
+    {"get_mimetype_for_url", bench_get_mimetype_for_url},
+    {"get_mimetype_for_url_unknown", bench_get_mimetype_for_url_unknown},
+    {"serialize_response_head", bench_serialize_response_head},
+    {"get_server_config", bench_get_server_config},
+    {"get_config_int", bench_get_config_int},
+    {"get_cache_control", bench_get_cache_control},
+};
+
+/**
+ * @brief Gets the monotonic time in nanoseconds.
+ */
+long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Runs `b` with a doubling number of iterations until a run is long enough and prints the
+ * result of the last run.
+ */
+void run_bench(const bench *b) {
+    long long iterations = 1, elapsed = 0;
+
+    while (1) {
+        long long start = now_ns();
+        for (long long i = 0; i < iterations; i++)
+            b->run();
+        elapsed = now_ns() - start;
+
+        if (elapsed >= BENCH_MIN_TIME_NS)
+            break;
+        iterations *= 2;
+    }
+
+    printf("{\"bench\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.1f}\n", b->name, iterations,
+           (double)elapsed / iterations);
+    fflush(stdout);
+}
+
+/**
+ * @brief The main function of the micro-benchmarks.
+ */
+int main(int argc, char *argv[]) {
+    const char *filter = argc > 1 ? argv[1] : "";
+
+    if (load_config() == 0) {
+        fprintf(stderr, "Unable to load config file %s\n", CONF_FILE);
+        return EXIT_FAILURE;
+    }
+    if (create_mime_table() == 0 || (bench_arena = create_arena(0)) == NULL ||
+        (bench_response = create_response(-1)) == NULL) {
+        fprintf(stderr, "Unable to set up the benchmarks\n");
+        return EXIT_FAILURE;
+    }
+
+    bench_response->http_ver = "HTTP/1.1";
+    bench_response->status_code = "200 OK";
+    set_response_header(bench_response, "server", "ElServe/2.0");
+    set_response_header(bench_response, "content-type", "image/jpeg");
+    set_response_header(bench_response, "content-length", "184467");
+    set_response_header(bench_response, "etag", "\"5f2b-60c8a1e0\"");
+    set_response_header(bench_response, "last-modified", "Tue, 15 Jun 2021 12:00:00 GMT");
+    set_response_header(bench_response, "accept-ranges", "bytes");
+    set_response_header(bench_response, "connection", "keep-alive");
+
+    for (size_t b_no = 0; b_no < sizeof(benches) / sizeof(benches[0]); b_no++)
+        if (strstr(benches[b_no].name, filter) != NULL)
+            run_bench(&benches[b_no]);
+
+    close_response(bench_response);
+    destroy_arena(bench_arena);
+    destroy_mime_table();
+    unload_config();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,535 @@
+/**
+ * @file bench/loadgen.c
+ * @brief Closed-loop HTTP load generator.
+ *
+ * Opens `-c` connections to the server, split over `-t` threads that each run an epoll loop, and
+ * keeps exactly one request in flight on every connection for `-d` seconds. In `keepalive` mode
+ * the next request is sent on the same connection as soon as the response is read, in `close`
+ * mode every request opens a new connection and sends `Connection: close`. The URLs given on the
+ * command line are requested in turn.
+ *
+ * The latency of a request is measured from the moment it starts (the `connect()` for a new
+ * connection, the first `send()` otherwise) to the last byte of the response, and recorded in a
+ * per-thread `histogram` in microseconds. The result is printed as a single JSON object, e.g.
+ * `{"bench":"loadgen","mode":"keepalive",...,"rps":51234.5,"latency_us":{"p50":301,...}}`.
+ *
+ * Usage: `bin/bench/loadgen [-H host] [-p port] [-c connections] [-t threads] [-d seconds]
+ * [-m keepalive|close] [-w seconds] [url ...]`, `-w` waits for the server to accept connections.
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug Only `content-length` delimited responses are read, chunked responses count as errors.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+/**
+ * @brief Defines the max size of a response head read by the load generator.
+ */
+#ifndef LOADGEN_HEAD_SIZE
+#define LOADGEN_HEAD_SIZE 8192
+#endif
+
+/**
+ * @brief Defines the max number of URLs requested in turn.
+ */
+#ifndef LOADGEN_MAX_URLS
+#define LOADGEN_MAX_URLS 64
+#endif
+
+/**
+ * @brief Defines a connection of the load generator and the request in flight on it.
+ */
+typedef struct loadgen_conn {
+    int fd;
+    int url_no;
+    size_t sent;
+    char head[LOADGEN_HEAD_SIZE];
+    size_t head_len;
+    long long body_left;
+    bool close_after;
+    long long start_ns;
+} loadgen_conn;
+
+/**
+ * @brief Defines a thread of the load generator, its connections and its results.
+ */
+typedef struct loadgen_thread {
+    pthread_t thread;
+    int epoll_fd;
+    int n_conns;
+    loadgen_conn *conns;
+    histogram *latency;
+    unsigned long long requests;
+    unsigned long long errors;
+    unsigned long long non_2xx;
+    unsigned long long bytes;
+    unsigned long long connects;
+} loadgen_thread;
+
+/**
+ * @brief The options of the run, set from the command line.
+ */
+struct {
+    const char *host;
+    const char *port;
+    int n_conns;
+    int n_threads;
+    int duration;
+    int wait;
+    bool keepalive;
+    int n_urls;
+    const char *urls[LOADGEN_MAX_URLS];
+} opts = {"127.0.0.1", "8080", 16, 1, 10, 0, true, 0, {NULL}};
+
+/**
+ * @brief The request sent for every URL, formatted once before the run.
+ */
+char *request_bufs[LOADGEN_MAX_URLS];
+
+/**
+ * @brief The length of every request in `request_bufs`.
+ */
+size_t request_lens[LOADGEN_MAX_URLS];
+
+/**
+ * @brief The address of the server.
+ */
+struct sockaddr_storage server_addr;
+
+/**
+ * @brief The length of `server_addr`.
+ */
+socklen_t server_addr_len = 0;
+
+/**
+ * @brief Set by the main thread when the run is over.
+ */
+atomic_bool stopping = false;
+
+/**
+ * @brief Gets the monotonic time in nanoseconds.
+ */
+long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Prints the usage and exits.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-H host] [-p port] [-c connections] [-t threads] [-d seconds]\n"
+            "          [-m keepalive|close] [-w seconds] [url ...]\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Sends the rest of the request in flight on `c`. Returns `1` if the whole request is sent,
+ * `2` if the socket is full, `0` on failure.
+ */
+int send_request(loadgen_conn *c) {
+    while (c->sent < request_lens[c->url_no]) {
+        ssize_t n = send(c->fd, request_bufs[c->url_no] + c->sent,
+                         request_lens[c->url_no] - c->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 2;
+        if (n <= 0)
+            return 0;
+        c->sent += n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Prepares `c` for the next request, on the next URL.
+ */
+void next_request(loadgen_conn *c) {
+    c->url_no = (c->url_no + 1) % opts.n_urls;
+    c->sent = 0;
+    c->head_len = 0;
+    c->body_left = -1;
+    c->close_after = !opts.keepalive;
+    c->start_ns = now_ns();
+}
+
+/**
+ * @brief Opens a new connection for `c` and starts its next request. Returns `1` on success, `0`
+ * on failure.
+ */
+int open_conn(loadgen_thread *t, loadgen_conn *c) {
+    next_request(c);
+    if ((c->fd = socket(server_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) <
+        0)
+        return 0;
+
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (struct sockaddr *)&server_addr, server_addr_len) < 0 &&
+        errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return 0;
+    }
+
+    // The request is sent once the socket is writable, i.e. connected.
+    struct epoll_event ev = {.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+    if (epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        close(c->fd);
+        c->fd = -1;
+        return 0;
+    }
+
+    t->connects++;
+    return 1;
+}
+
+/**
+ * @brief Closes the connection of `c` and, unless the run is over, opens a new one.
+ */
+void reopen_conn(loadgen_thread *t, loadgen_conn *c) {
+    if (c->fd >= 0)
+        close(c->fd);
+    c->fd = -1;
+
+    // A server that refuses connections shouldn't turn the loop into a busy loop of errors.
+    while (!atomic_load(&stopping) && open_conn(t, c) == 0) {
+        t->errors++;
+        usleep(1000);
+    }
+}
+
+/**
+ * @brief Parses the response head in `c->head`. Returns `1` on success, `0` if it is malformed.
+ */
+int parse_response_head(loadgen_thread *t, loadgen_conn *c, const size_t head_len) {
+    if (head_len < 12 || strncmp(c->head, "HTTP/1.", 7) != 0)
+        return 0;
+
+    int status = atoi(c->head + 9);
+    if (status < 200 || status >= 300)
+        t->non_2xx++;
+
+    // Headers are matched case-insensitively on the `\r\n` that precedes them.
+    c->head[head_len - 1] = '\0';
+    const char *content_length = strcasestr(c->head, "\r\ncontent-length:");
+    const char *connection = strcasestr(c->head, "\r\nconnection:");
+    if (connection != NULL && strncasecmp(connection + 13 + strspn(connection + 13, " "), "close",
+                                          5) == 0)
+        c->close_after = true;
+
+    if (content_length != NULL)
+        c->body_left = atoll(content_length + 17);
+    else if (status == 204 || status == 304 || status < 200)
+        c->body_left = 0;
+    else
+        return 0;
+
+    return 1;
+}
+
+/**
+ * @brief Completes the request in flight on `c` and starts the next one.
+ */
+void complete_request(loadgen_thread *t, loadgen_conn *c) {
+    record_histogram_value(t->latency, (uint64_t)(now_ns() - c->start_ns) / 1000);
+    t->requests++;
+
+    if (atomic_load(&stopping))
+        return;
+
+    if (c->close_after) {
+        reopen_conn(t, c);
+        return;
+    }
+
+    next_request(c);
+    int result = send_request(c);
+    if (result == 0) {
+        t->errors++;
+        reopen_conn(t, c);
+    } else if (result == 2) {
+        struct epoll_event ev = {.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+        epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+/**
+ * @brief Reads the response to the request in flight on `c`. Returns `1` while the connection is
+ * usable, `0` if it failed.
+ */
+int read_response(loadgen_thread *t, loadgen_conn *c) {
+    char body[65536];
+
+    while (1) {
+        ssize_t n = 0;
+        if (c->body_left < 0) {
+            n = recv(c->fd, c->head + c->head_len, sizeof(c->head) - c->head_len - 1, 0);
+        } else if (c->body_left > 0) {
+            size_t len =
+                c->body_left < (long long)sizeof(body) ? (size_t)c->body_left : sizeof(body);
+            n = recv(c->fd, body, len, 0);
+        } else {
+            complete_request(t, c);
+            return 1;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (n <= 0)
+            return 0;
+        t->bytes += n;
+
+        if (c->body_left > 0) {
+            c->body_left -= n;
+            continue;
+        }
+
+        c->head_len += n;
+        c->head[c->head_len] = '\0';
+        char *head_end = strstr(c->head, "\r\n\r\n");
+        if (head_end == NULL) {
+            if (c->head_len == sizeof(c->head) - 1)
+                return 0;
+            continue;
+        }
+
+        size_t head_len = head_end - c->head + 4;
+        size_t extra = c->head_len - head_len;
+        if (parse_response_head(t, c, head_len) == 0 || (long long)extra > c->body_left)
+            return 0;
+        c->body_left -= extra;
+    }
+}
+
+/**
+ * @brief Runs the epoll loop of a thread until the run is over.
+ */
+void *run_thread(void *arg) {
+    loadgen_thread *t = arg;
+    struct epoll_event events[256];
+
+    for (int c_no = 0; c_no < t->n_conns; c_no++) {
+        t->conns[c_no].fd = -1;
+        t->conns[c_no].url_no = c_no % opts.n_urls;
+        reopen_conn(t, &t->conns[c_no]);
+    }
+
+    while (!atomic_load(&stopping)) {
+        int n_events = epoll_wait(t->epoll_fd, events, 256, 100);
+        for (int e_no = 0; e_no < n_events; e_no++) {
+            loadgen_conn *c = events[e_no].data.ptr;
+            if (atomic_load(&stopping))
+                break;
+
+            if (events[e_no].events & EPOLLOUT) {
+                int result = send_request(c);
+                if (result == 0) {
+                    t->errors++;
+                    reopen_conn(t, c);
+                    continue;
+                }
+                if (result == 1) {
+                    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+                    epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+                }
+            }
+
+            if (events[e_no].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) &&
+                read_response(t, c) == 0) {
+                t->errors++;
+                reopen_conn(t, c);
+            }
+        }
+    }
+
+    for (int c_no = 0; c_no < t->n_conns; c_no++)
+        if (t->conns[c_no].fd >= 0)
+            close(t->conns[c_no].fd);
+    return NULL;
+}
+
+/**
+ * @brief Resolves the server address and formats the requests. Returns `1` on success.
+ */
+int setup(void) {
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM}, *addrs = NULL;
+    if (getaddrinfo(opts.host, opts.port, &hints, &addrs) != 0 || addrs == NULL) {
+        fprintf(stderr, "Unable to resolve %s:%s\n", opts.host, opts.port);
+        return 0;
+    }
+    memcpy(&server_addr, addrs->ai_addr, addrs->ai_addrlen);
+    server_addr_len = addrs->ai_addrlen;
+    freeaddrinfo(addrs);
+
+    for (int u_no = 0; u_no < opts.n_urls; u_no++) {
+        int len = asprintf(&request_bufs[u_no],
+                           "GET %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: nanows-loadgen\r\n"
+                           "Accept: */*\r\n%s\r\n",
+                           opts.urls[u_no], opts.host, opts.port,
+                           opts.keepalive ? "" : "Connection: close\r\n");
+        if (len < 0)
+            return 0;
+        request_lens[u_no] = len;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Waits up to `opts.wait` seconds for the server to accept connections. Returns `1` once
+ * a connection is accepted.
+ */
+int wait_for_server(void) {
+    long long deadline = now_ns() + opts.wait * 1000000000LL;
+    do {
+        int fd = socket(server_addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int connected =
+            fd >= 0 && connect(fd, (struct sockaddr *)&server_addr, server_addr_len) == 0;
+        if (fd >= 0)
+            close(fd);
+        if (connected)
+            return 1;
+        usleep(50000);
+    } while (now_ns() < deadline);
+
+    fprintf(stderr, "Server %s:%s is not accepting connections\n", opts.host, opts.port);
+    return 0;
+}
+
+/**
+ * @brief The main function of the load generator.
+ */
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:c:t:d:m:w:")) != -1) {
+        switch (opt) {
+        case 'H':
+            opts.host = optarg;
+            break;
+        case 'p':
+            opts.port = optarg;
+            break;
+        case 'c':
+            opts.n_conns = atoi(optarg);
+            break;
+        case 't':
+            opts.n_threads = atoi(optarg);
+            break;
+        case 'd':
+            opts.duration = atoi(optarg);
+            break;
+        case 'm':
+            if (strcmp(optarg, "keepalive") != 0 && strcmp(optarg, "close") != 0)
+                usage(argv[0]);
+            opts.keepalive = strcmp(optarg, "keepalive") == 0;
+            break;
+        case 'w':
+            opts.wait = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    for (; optind < argc && opts.n_urls < LOADGEN_MAX_URLS; optind++)
+        opts.urls[opts.n_urls++] = argv[optind];
+    if (opts.n_urls == 0)
+        opts.urls[opts.n_urls++] = "/";
+    if (opts.n_conns < 1 || opts.n_threads < 1 || opts.duration < 1)
+        usage(argv[0]);
+    if (opts.n_threads > opts.n_conns)
+        opts.n_threads = opts.n_conns;
+
+    if (setup() == 0 || (opts.wait > 0 && wait_for_server() == 0))
+        return EXIT_FAILURE;
+
+    loadgen_thread *threads = calloc(opts.n_threads, sizeof(loadgen_thread));
+    loadgen_conn *conns = calloc(opts.n_conns, sizeof(loadgen_conn));
+    if (threads == NULL || conns == NULL) {
+        perror("Unable to allocate the load generator");
+        return EXIT_FAILURE;
+    }
+
+    // Connections are split evenly, the first threads get one more if they don't divide evenly.
+    long long start = now_ns();
+    for (int t_no = 0, c_no = 0; t_no < opts.n_threads; t_no++) {
+        loadgen_thread *t = &threads[t_no];
+        t->n_conns = opts.n_conns / opts.n_threads + (t_no < opts.n_conns % opts.n_threads);
+        t->conns = &conns[c_no];
+        c_no += t->n_conns;
+
+        if ((t->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+            (t->latency = create_histogram()) == NULL ||
+            pthread_create(&t->thread, NULL, run_thread, t) != 0) {
+            perror("Unable to start the load generator threads");
+            return EXIT_FAILURE;
+        }
+    }
+
+    sleep(opts.duration);
+    atomic_store(&stopping, true);
+
+    histogram *latency = create_histogram();
+    unsigned long long requests = 0, errors = 0, non_2xx = 0, bytes = 0, connects = 0;
+    for (int t_no = 0; t_no < opts.n_threads; t_no++) {
+        loadgen_thread *t = &threads[t_no];
+        pthread_join(t->thread, NULL);
+        merge_histogram(latency, t->latency);
+        requests += t->requests;
+        errors += t->errors;
+        non_2xx += t->non_2xx;
+        bytes += t->bytes;
+        connects += t->connects;
+        destroy_histogram(t->latency);
+        close(t->epoll_fd);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    printf("{\"bench\":\"loadgen\",\"mode\":\"%s\",\"connections\":%d,\"threads\":%d,"
+           "\"duration_s\":%.3f,\"urls\":%d,\"requests\":%llu,\"rps\":%.1f,\"bytes\":%llu,"
+           "\"mb_per_s\":%.2f,\"connects\":%llu,\"errors\":%llu,\"non_2xx\":%llu,"
+           "\"latency_us\":{\"min\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+           "\"p99_9\":%llu,\"p99_99\":%llu,\"max\":%llu}}\n",
+           opts.keepalive ? "keepalive" : "close", opts.n_conns, opts.n_threads, elapsed,
+           opts.n_urls, requests, requests / elapsed, bytes, bytes / elapsed / 1e6, connects,
+           errors, non_2xx, (unsigned long long)(latency->count > 0 ? latency->min : 0),
+           get_histogram_mean(latency),
+           (unsigned long long)get_histogram_percentile(latency, 50),
+           (unsigned long long)get_histogram_percentile(latency, 90),
+           (unsigned long long)get_histogram_percentile(latency, 99),
+           (unsigned long long)get_histogram_percentile(latency, 99.9),
+           (unsigned long long)get_histogram_percentile(latency, 99.99),
+           (unsigned long long)latency->max);
+
+    destroy_histogram(latency);
+    for (int u_no = 0; u_no < opts.n_urls; u_no++)
+        free(request_bufs[u_no]);
+    free(conns);
+    free(threads);
+    return errors > 0 && requests == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
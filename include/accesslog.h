@@ -0,0 +1,328 @@
+/**
+ * @file include/accesslog.h
+ * @brief Function Prototypes for the asynchronous access log.
+ *
+ * This file contains the access log structures and function prototypes to open, write to and close
+ * the access log. Every thread that logs requests gets a ring buffer of its own, which is only
+ * written by that thread and only read by a background flusher thread, so logging a request never
+ * takes a lock or makes a system call. The flusher writes the lines of all the ring buffers to the
+ * log file in batches with `writev()`.
+ *
+ * If a ring buffer is full, the entry is dropped and counted instead of blocking the request.
+ *
+ * Implemented in slib/accesslog.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _ACCESSLOG_H
+#define _ACCESSLOG_H 1
+
+/**
+ * @brief Defines the max length of a line in the access log, longer lines are truncated.
+ */
+#ifndef ACCESS_LOG_LINE_SIZE
+#define ACCESS_LOG_LINE_SIZE 1024
+#endif
+
+/**
+ * @brief Defines the default number of lines in a ring buffer (rounded up to a power of 2).
+ */
+#ifndef ACCESS_LOG_RING_SIZE
+#define ACCESS_LOG_RING_SIZE 1024
+#endif
+
+/**
+ * @brief Defines the interval (in milliseconds) at which the flusher thread writes the ring
+ * buffers to the log file.
+ */
+#ifndef ACCESS_LOG_FLUSH_INTERVAL
+#define ACCESS_LOG_FLUSH_INTERVAL 50
+#endif
+
+/**
+ * @brief Defines the access log path that logs to `stdout`.
+ */
+#ifndef ACCESS_LOG_STDOUT
+#define ACCESS_LOG_STDOUT "-"
+#endif
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/socket.h>
+
+/**
+ * @brief Defines the formats of the access log.
+ *
+ *     - `ACCESS_LOG_COMBINED`: NCSA combined log format, followed by the latency in microseconds.
+ *     - `ACCESS_LOG_JSON`: One JSON object per line.
+ */
+typedef enum access_log_format { ACCESS_LOG_COMBINED, ACCESS_LOG_JSON } access_log_format;
+
+/**
+ * @struct access_log_entry
+ * @brief Defines the fields of an access log entry.
+ *
+ * All the strings are borrowed and can be `NULL`.
+ *
+ * @property sockaddr_storage* access_log_entry::peer_addr
+ * @brief Address of the client.
+ *
+ * @property char* access_log_entry::method
+ * @brief Request method.
+ *
+ * @property char* access_log_entry::url
+ * @brief Request URL.
+ *
+ * @property char* access_log_entry::http_ver
+ * @brief Request HTTP version.
+ *
+ * @property char* access_log_entry::referer
+ * @brief Value of the `referer` request header.
+ *
+ * @property char* access_log_entry::user_agent
+ * @brief Value of the `user-agent` request header.
+ *
+ * @property int access_log_entry::status
+ * @brief Response status code.
+ *
+ * @property size_t access_log_entry::bytes
+ * @brief Number of response body bytes sent.
+ *
+ * @property long access_log_entry::latency_us
+ * @brief Time (in microseconds) taken to handle the request.
+ */
+typedef struct access_log_entry {
+    const struct sockaddr_storage *peer_addr;
+    const char *method;
+    const char *url;
+    const char *http_ver;
+    const char *referer;
+    const char *user_agent;
+    int status;
+    size_t bytes;
+    long latency_us;
+} access_log_entry;
+
+/**
+ * @struct access_log_slot
+ * @brief Defines a line in a ring buffer.
+ *
+ * @property size_t access_log_slot::len
+ * @brief Length of `line` in bytes.
+ *
+ * @property char access_log_slot::line
+ * @brief The formatted line, including the trailing `\n`.
+ */
+typedef struct access_log_slot {
+    size_t len;
+    char line[ACCESS_LOG_LINE_SIZE];
+} access_log_slot;
+
+/**
+ * @struct access_log_ring
+ * @brief Defines a single-producer, single-consumer ring buffer of access log lines.
+ *
+ * The owning thread writes lines at `head` and the flusher thread reads them at `tail`. Both
+ * indices only grow, the slot of an index is `index & (size - 1)`.
+ *
+ * @property size_t access_log_ring::head
+ * @brief Index of the next slot written by the owning thread.
+ *
+ * @property size_t access_log_ring::tail
+ * @brief Index of the next slot read by the flusher thread.
+ *
+ * @property unsigned long access_log_ring::dropped
+ * @brief Number of entries dropped because the ring buffer was full.
+ *
+ * @property unsigned long access_log_ring::n_requests
+ * @brief Number of requests seen by the owning thread, used for sampling.
+ *
+ * @property size_t access_log_ring::size
+ * @brief Number of slots, a power of 2.
+ *
+ * @property access_log_slot* access_log_ring::slots
+ * @brief The slots.
+ */
+typedef struct access_log_ring {
+    alignas(64) _Atomic size_t head;
+    alignas(64) _Atomic size_t tail;
+    alignas(64) atomic_ulong dropped;
+    unsigned long n_requests;
+    size_t size;
+    access_log_slot *slots;
+} access_log_ring;
+
+/**
+ * @struct access_log
+ * @brief Defines the access log.
+ *
+ * @see create_access_log
+ * @see log_access
+ * @see destroy_access_log
+ *
+ * @property int access_log::fd
+ * @brief File descriptor of the log file.
+ *
+ * @property access_log_format access_log::format
+ * @brief Format of the lines.
+ *
+ * @property unsigned int access_log::sample
+ * @brief Only 1 in `sample` requests of a thread is logged.
+ *
+ * @property access_log_ring* access_log::rings
+ * @brief Ring buffers, one per logging thread.
+ *
+ * @property int access_log::n_rings
+ * @brief Number of ring buffers in `rings`.
+ *
+ * @property int access_log::next_ring
+ * @brief Index of the ring buffer claimed by the next thread that logs.
+ *
+ * @property unsigned long access_log::generation
+ * @brief Number of times an access log was opened, including this one. Threads claim a new ring
+ * buffer when it changes.
+ *
+ * @property pthread_t access_log::flusher
+ * @brief Thread ID of the flusher thread.
+ *
+ * @property bool access_log::running
+ * @brief Set to `false` to make the flusher thread exit.
+ */
+typedef struct access_log {
+    int fd;
+    access_log_format format;
+    unsigned int sample;
+    access_log_ring *rings;
+    int n_rings;
+    atomic_int next_ring;
+    unsigned long generation;
+    pthread_t flusher;
+    atomic_bool running;
+} access_log;
+
+/**
+ * @brief Opens the access log and starts its flusher thread.
+ *
+ * `path` is opened in append mode, or `stdout` is used if `path` is `ACCESS_LOG_STDOUT`. `n_rings`
+ * ring buffers with `ring_size` lines each are allocated, one for each thread that logs requests
+ * (threads beyond `n_rings` drop all their entries).
+ *
+ * If the access log is opened successfully, the function returns `1`. If the access log is already
+ * open, the function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param path Path to the log file.
+ * @param format Format of the lines.
+ * @param sample Only 1 in `sample` requests is logged, every request is logged if less than `2`.
+ * @param n_rings Number of ring buffers (logging threads).
+ * @param ring_size Number of lines in a ring buffer, `ACCESS_LOG_RING_SIZE` if `0`.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_access_log(const char *, const access_log_format, const unsigned int, const int,
+                      const size_t);
+
+/**
+ * @brief Stops the flusher thread after writing all the buffered lines and closes the access log.
+ *
+ * All the threads that log requests must be stopped before calling this function. If the access log
+ * is not open, the function does nothing.
+ *
+ * @return void
+ */
+void destroy_access_log();
+
+/**
+ * @brief Checks if the access log is open.
+ *
+ * @return `true` if the access log is open, `false` otherwise.
+ */
+bool is_access_log_enabled();
+
+/**
+ * @brief Formats an entry into the calling thread's ring buffer without blocking.
+ *
+ * @param entry The entry to log.
+ * @return On success, returns `1`. If the entry was skipped by sampling, returns `2`. If the entry
+ * was dropped (the ring buffer is full or the access log is not open), returns `0`.
+ */
+int log_access(const access_log_entry *);
+
+/**
+ * @brief Gets the number of entries dropped because a ring buffer was full.
+ *
+ * @return The number of dropped entries.
+ */
+unsigned long get_access_log_dropped();
+
+/**
+ * @brief Parses the name of an access log format (`combined` or `json`).
+ *
+ * @param name The name of the format.
+ * @return The format, `ACCESS_LOG_COMBINED` if the name is unknown.
+ */
+access_log_format parse_access_log_format(const char *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Gets the calling thread's ring buffer, claiming one on the first call.
+ *
+ * @param log The access log.
+ * @return On success, returns a pointer to the ring buffer. If all the ring buffers are claimed,
+ * returns `NULL`.
+ */
+access_log_ring *_get_access_log_ring(access_log *);
+
+/**
+ * @private
+ * @brief Formats an entry into `line`.
+ *
+ * @param format The format of the line.
+ * @param entry The entry.
+ * @param line The buffer, `ACCESS_LOG_LINE_SIZE` bytes long.
+ * @return The length of the line, including the trailing `\n`.
+ */
+size_t _format_access_log_line(const access_log_format, const access_log_entry *, char *);
+
+/**
+ * @private
+ * @brief Appends `str` to `line` at `pos`, escaping quotes, backslashes and control characters.
+ *
+ * `-` is appended for `NULL` strings in the combined format. Nothing is appended past `cap`.
+ *
+ * @param line The buffer.
+ * @param pos The position to append at.
+ * @param cap The capacity of `line`.
+ * @param str The string to append.
+ * @param json Whether JSON escapes (`\u00XX`) are used instead of `\xXX`.
+ * @return The new position.
+ */
+size_t _append_access_log_str(char *, size_t, const size_t, const char *, const bool);
+
+/**
+ * @private
+ * @brief Writes all the buffered lines of all the ring buffers to the log file.
+ *
+ * @param log The access log.
+ * @return void
+ */
+void _flush_access_log(access_log *);
+
+/**
+ * @private
+ * @brief Main function of the flusher thread, passed to `pthread_create()`.
+ *
+ * @param log Pointer to the access log.
+ * @return Always returns `NULL`.
+ */
+void *_access_log_flusher(void *);
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file include/admission.h
+ * @brief Function Prototypes for the admission control of new connections.
+ *
+ * This file contains function prototypes to limit the number of open connections, in total and
+ * per client address. The workers ask `admit_connection()` for every connection they accept and
+ * answer the ones over a limit with a pre-built `503 Service Unavailable` right away, before any
+ * memory is allocated for them, so a surge of connections can't exhaust the server's memory or
+ * sockets.
+ *
+ * The total is an atomic counter. The connections per address are counted in a hash table
+ * protected by a mutex, which is only used if the per address limit is set.
+ *
+ * Implemented in slib/admission.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _ADMISSION_H
+#define _ADMISSION_H 1
+
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <glib.h>
+
+/**
+ * @struct admission_peer
+ * @brief Defines the number of open connections of a client address.
+ *
+ * @property unsigned char admission_peer::addr
+ * @brief The address as an IPv6 address, IPv4 addresses are IPv4-mapped. Used as the key of the
+ * hash table.
+ *
+ * @property int admission_peer::n_conns
+ * @brief Number of open connections from the address.
+ */
+typedef struct admission_peer {
+    unsigned char addr[16];
+    int n_conns;
+} admission_peer;
+
+/**
+ * @brief Sets up the admission control with the limits `max_conns` and `max_conns_per_ip`.
+ *
+ * If the admission control is set up successfully, the function returns `1`. If it is already
+ * set up, the function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param max_conns Max number of open connections, `0` for no limit.
+ * @param max_conns_per_ip Max number of open connections per client address, `0` for no limit.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_admission_control(const int, const int);
+
+/**
+ * @brief Frees the admission control. Must only be called once all the admitted connections are
+ * released.
+ *
+ * If `destroy_admission_control()` is called before `create_admission_control()`, it does
+ * nothing.
+ *
+ * @return void
+ */
+void destroy_admission_control();
+
+/**
+ * @brief Decides whether a new connection from `peer_addr` is admitted, and counts it if it is.
+ *
+ * Admitted connections must be released with `release_admitted_connection()` once they are
+ * closed. If the admission control is not set up, every connection is admitted.
+ *
+ * @param peer_addr Address of the client.
+ * @return `true` if the connection is admitted, `false` if it is over a limit.
+ */
+bool admit_connection(const struct sockaddr_storage *);
+
+/**
+ * @brief Releases a connection admitted by `admit_connection()`.
+ *
+ * @param peer_addr Address of the client, as passed to `admit_connection()`.
+ * @return void
+ */
+void release_admitted_connection(const struct sockaddr_storage *);
+
+/**
+ * @brief Gets the number of admitted connections that are not released yet.
+ *
+ * @return The number of open connections, `0` if the admission control is not set up.
+ */
+int get_admitted_connections();
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Stores the IPv4-mapped or IPv6 address of `peer_addr` in `addr`.
+ *
+ * @param peer_addr Address of the client.
+ * @param addr Buffer of 16 bytes the address is stored in.
+ * @return `1` if the address is an IPv4 or IPv6 address, `0` otherwise.
+ */
+int _get_admission_addr(const struct sockaddr_storage *, unsigned char *);
+
+/**
+ * @private
+ * @brief Hashes the address of an `admission_peer`, used by the hash table.
+ *
+ * @param key Pointer to `admission_peer::addr`.
+ * @return The hash of the address.
+ */
+guint _admission_addr_hash(gconstpointer);
+
+/**
+ * @private
+ * @brief Compares the addresses of two `admission_peer`s, used by the hash table.
+ *
+ * @param a Pointer to `admission_peer::addr`.
+ * @param b Pointer to `admission_peer::addr`.
+ * @return `TRUE` if the addresses are equal, `FALSE` otherwise.
+ */
+gboolean _admission_addr_equal(gconstpointer, gconstpointer);
+#endif
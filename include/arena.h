@@ -0,0 +1,176 @@
+/**
+ * @file include/arena.h
+ * @brief Function Prototypes for the bump (arena) allocator.
+ *
+ * This file contains the arena structure and function prototypes to create, allocate from, reset
+ * and destroy an arena. Memory is allocated by bumping an offset in a chunk, and all the memory
+ * allocated from an arena is released at once with `reset_arena()` or `destroy_arena()`. Each
+ * connection owns an arena, which backs the request and response of the current exchange.
+ *
+ * Arenas are not thread-safe, an arena must only be used by one thread at a time.
+ *
+ * Implemented in slib/arena.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H 1
+
+/**
+ * @brief Defines the default size (in bytes) of an arena chunk.
+ */
+#ifndef ARENA_CHUNK_SIZE
+#define ARENA_CHUNK_SIZE 16384
+#endif
+
+#include <stddef.h>
+
+/**
+ * @struct arena_chunk
+ * @brief Defines a chunk of memory allocations are bumped from.
+ *
+ * @property arena_chunk* arena_chunk::next
+ * @brief The previously filled chunk.
+ *
+ * @property size_t arena_chunk::size
+ * @brief Size of `data` in bytes.
+ *
+ * @property size_t arena_chunk::used
+ * @brief Number of bytes of `data` that are allocated.
+ *
+ * @property max_align_t arena_chunk::data
+ * @brief The memory of the chunk.
+ */
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} arena_chunk;
+
+/**
+ * @struct arena
+ * @brief Defines an arena structure.
+ *
+ * The first chunk is allocated together with the arena (right after the arena struct) and is kept
+ * by `reset_arena()`, so an arena whose allocations fit in one chunk never calls `malloc()` after
+ * it is created. The arena itself is allocated with `slab_alloc()`, from the slab cache of the
+ * creating thread.
+ *
+ * @see create_arena
+ * @see arena_alloc
+ * @see reset_arena
+ * @see destroy_arena
+ *
+ * @property arena_chunk* arena::chunk
+ * @brief The chunk allocations are currently bumped from.
+ *
+ * @property size_t arena::chunk_size
+ * @brief Size of the chunks allocated when the current chunk is full.
+ *
+ * @property arena_chunk* arena::first
+ * @brief The first chunk, allocated together with the arena.
+ */
+typedef struct arena {
+    arena_chunk *chunk;
+    size_t chunk_size;
+    arena_chunk *first;
+} arena;
+
+/**
+ * @brief Creates an arena with chunks of `chunk_size` bytes.
+ *
+ * @param chunk_size Size of a chunk in bytes, `ARENA_CHUNK_SIZE` is used if `0`.
+ * @return On success, pointer to the arena is returned. On failure, `NULL` is returned.
+ */
+arena *create_arena(size_t);
+
+/**
+ * @brief Gets the number of bytes `create_arena()` allocates for an arena with chunks of
+ * `chunk_size` bytes.
+ *
+ * @param chunk_size Size of a chunk in bytes, `ARENA_CHUNK_SIZE` is used if `0`.
+ * @return Size of the arena and its first chunk in bytes.
+ */
+size_t get_arena_size(size_t);
+
+/**
+ * @brief Allocates `size` bytes from the arena.
+ *
+ * The memory is aligned for any type (like `malloc()`) and is valid until the arena is reset or
+ * destroyed. Allocations larger than a chunk get a chunk of their own.
+ *
+ * @param a The arena.
+ * @param size Number of bytes to allocate.
+ * @return On success, pointer to the allocated memory is returned. On failure, `NULL` is returned.
+ */
+void *arena_alloc(arena *, size_t);
+
+/**
+ * @brief Duplicates the string `str` with memory allocated from the arena.
+ *
+ * @param a The arena.
+ * @param str The string to be duplicated.
+ * @return On success, pointer to the new string is returned. If `str` is `NULL` or on failure,
+ * `NULL` is returned.
+ */
+char *arena_strdup(arena *, const char *);
+
+/**
+ * @brief Duplicates at most `len` bytes of the string `str` with memory allocated from the arena.
+ * The new string is always `\0` terminated.
+ *
+ * @param a The arena.
+ * @param str The string to be duplicated.
+ * @param len Max number of bytes to duplicate.
+ * @return On success, pointer to the new string is returned. If `str` is `NULL` or on failure,
+ * `NULL` is returned.
+ */
+char *arena_strndup(arena *, const char *, size_t);
+
+/**
+ * @brief Releases all the memory allocated from the arena at once.
+ *
+ * All the chunks except the first one are freed, and the first one is reused for the next
+ * allocations.
+ *
+ * @param a The arena.
+ * @return void
+ */
+void reset_arena(arena *);
+
+/**
+ * @brief Frees the arena and all the memory allocated from it.
+ *
+ * If a `NULL` pointer is passed to this function, function does nothing.
+ *
+ * @param a The arena to be freed.
+ * @return void
+ */
+void destroy_arena(arena *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Allocates a new chunk of at least `size` bytes and makes it the current chunk.
+ *
+ * @param a The arena.
+ * @param size Min size of the chunk in bytes.
+ * @return On success, pointer to the new chunk is returned. On failure, `NULL` is returned.
+ */
+arena_chunk *_add_arena_chunk(arena *, size_t);
+
+/**
+ * @private
+ * @brief Gets the size of the arena struct, padded so the first chunk after it is aligned.
+ *
+ * @return The padded size in bytes.
+ */
+size_t _get_arena_struct_size();
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file include/autoindex.h
+ * @brief Function Prototypes for generating directory listings.
+ *
+ * This file contains the listing format definitions and function prototypes to generate the
+ * listing of a directory under the website root directory, served for URLs of directories without
+ * an index file when `autoindex` is enabled. Listings are generated once and kept in the file
+ * cache, so they are only generated again after the directory changes.
+ *
+ * Implemented in slib/autoindex.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _AUTOINDEX_H
+#define _AUTOINDEX_H 1
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib.h>
+
+#include "helpers.h"
+
+/**
+ * @brief Defines the formats of a directory listing.
+ *
+ *     - `AUTOINDEX_HTML`: An HTML page with a table of the entries, linking to each entry.
+ *     - `AUTOINDEX_JSON`: A JSON array with an object per entry, with the same fields as the
+ *       listings of nginx (`name`, `type`, `mtime` and `size` for files).
+ */
+typedef enum autoindex_format {
+    AUTOINDEX_HTML,
+    AUTOINDEX_JSON,
+} autoindex_format;
+
+/**
+ * @brief Parses the name of a listing format, `html` or `json` (case insensitive).
+ *
+ * @param name The name of the format, can be `NULL`.
+ * @return The format, `AUTOINDEX_HTML` for unknown names.
+ */
+autoindex_format parse_autoindex_format(const char *);
+
+/**
+ * @brief Gets the content type of listings in `format`.
+ *
+ * @param format The listing format.
+ * @return The content type, `text/html` or `application/json`.
+ */
+const char *get_autoindex_content_type(const autoindex_format);
+
+/**
+ * @brief Generates the listing of the directory `dir_fd` in `format`.
+ *
+ * Hidden entries (names starting with `.`) are not listed. Directories are listed before files,
+ * each group sorted by name. Symbolic links are listed with the `stat` info of the link itself, so
+ * generating a listing never follows a link out of the root directory. Names are HTML escaped and
+ * links are percent-encoded relative to `url_path`, so the listing is correct for any name.
+ *
+ * @param dir_fd File descriptor of the directory, opened for reading. It is not closed.
+ * @param url_path Canonical URL path of the directory, starting and ending with `/`, used in the
+ * title of HTML listings.
+ * @param format The listing format.
+ * @return On success, returns the listing, which must be freed with `g_string_free()`. On failure,
+ * returns `NULL` and sets `errno`.
+ */
+GString *format_directory_listing(const int, const char *, const autoindex_format);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @struct autoindex_entry
+ * @brief Defines an entry of a directory listing.
+ *
+ * @property char* autoindex_entry::name
+ * @brief Name of the entry.
+ *
+ * @property struct stat autoindex_entry::entry_stat
+ * @brief The `lstat` info of the entry.
+ */
+typedef struct autoindex_entry {
+    char *name;
+    struct stat entry_stat;
+} autoindex_entry;
+
+/**
+ * @private
+ * @brief Compares two listing entries, directories first and then by name.
+ *
+ * @param a Pointer to the first `autoindex_entry`.
+ * @param b Pointer to the second `autoindex_entry`.
+ * @return A negative value if `a` is listed first, a positive value if `b` is, `0` otherwise.
+ */
+gint _compare_autoindex_entries(gconstpointer, gconstpointer);
+
+/**
+ * @private
+ * @brief Appends `str` to `out` with the HTML special characters escaped.
+ *
+ * @param out The string to append to.
+ * @param str The string to be escaped.
+ * @return void
+ */
+void _append_html_escaped(GString *, const char *);
+
+/**
+ * @private
+ * @brief Appends `str` to `out` as a JSON string, including the quotes.
+ *
+ * @param out The string to append to.
+ * @param str The string to be escaped.
+ * @return void
+ */
+void _append_json_string(GString *, const char *);
+
+/**
+ * @private
+ * @brief Appends the listing of `entries` to `out` as an HTML page.
+ *
+ * @param out The string to append to.
+ * @param url_path Canonical URL path of the directory.
+ * @param entries Array of `autoindex_entry`, sorted.
+ * @return void
+ */
+void _format_html_listing(GString *, const char *, const GArray *);
+
+/**
+ * @private
+ * @brief Appends the listing of `entries` to `out` as a JSON array.
+ *
+ * @param out The string to append to.
+ * @param entries Array of `autoindex_entry`, sorted.
+ * @return void
+ */
+void _format_json_listing(GString *, const GArray *);
+#endif
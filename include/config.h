@@ -3,7 +3,8 @@
  * @brief Function Prototypes for the configuration manager.
  *
  * This file contains function prototypes for loading, retriving configurations from file defined by
- * `CONF_FILE` macro.
+ * `CONF_FILE` macro, and the typed configuration snapshot (`struct server_config`) read by the
+ * server on hot paths.
  *
  * Implemented in `slib/config.c`.
  *
@@ -57,8 +58,832 @@
 #define PAGE_CONF_KEY "default_page"
 #endif
 
+/**
+ * @brief Defines the default configuration key for number of worker threads.
+ *
+ * Each worker thread runs its own event loop. A value of `0` starts one worker per online CPU.
+ */
+#ifndef WORKERS_CONF_KEY
+#define WORKERS_CONF_KEY "worker_threads"
+#endif
+
+/**
+ * @brief Defines the default configuration key for idle timeout (in seconds) of persistent
+ * connections.
+ */
+#ifndef KEEPALIVE_TIMEOUT_CONF_KEY
+#define KEEPALIVE_TIMEOUT_CONF_KEY "keepalive_timeout"
+#endif
+
+/**
+ * @brief Defines the default configuration key for max number of requests served on a persistent
+ * connection.
+ */
+#ifndef KEEPALIVE_REQUESTS_CONF_KEY
+#define KEEPALIVE_REQUESTS_CONF_KEY "keepalive_requests"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max time (in seconds) a shutdown waits for
+ * the requests in flight.
+ */
+#ifndef SHUTDOWN_TIMEOUT_CONF_KEY
+#define SHUTDOWN_TIMEOUT_CONF_KEY "shutdown_timeout"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of open connections. New
+ * connections over the limit are answered with `503`, `0` disables the limit.
+ */
+#ifndef MAX_CONNECTIONS_CONF_KEY
+#define MAX_CONNECTIONS_CONF_KEY "max_connections"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of open connections from a
+ * single client address. New connections over the limit are answered with `503`, `0` disables
+ * the limit.
+ */
+#ifndef MAX_CONNECTIONS_PER_IP_CONF_KEY
+#define MAX_CONNECTIONS_PER_IP_CONF_KEY "max_connections_per_ip"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max time (in seconds) from the first byte
+ * of a request head until the head is complete.
+ */
+#ifndef REQUEST_HEAD_TIMEOUT_CONF_KEY
+#define REQUEST_HEAD_TIMEOUT_CONF_KEY "request_head_timeout"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max time (in seconds) from the end of a
+ * request head until its body is read.
+ */
+#ifndef REQUEST_BODY_TIMEOUT_CONF_KEY
+#define REQUEST_BODY_TIMEOUT_CONF_KEY "request_body_timeout"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max size (in bytes) of a request head.
+ * Receive buffers start at `REQ_BUF_SIZE` bytes and grow up to this size for larger heads.
+ */
+#ifndef MAX_REQUEST_HEAD_SIZE_CONF_KEY
+#define MAX_REQUEST_HEAD_SIZE_CONF_KEY "max_request_head_size"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max size (in bytes) of a request body.
+ */
+#ifndef MAX_REQUEST_BODY_SIZE_CONF_KEY
+#define MAX_REQUEST_BODY_SIZE_CONF_KEY "max_request_body_size"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the total size (in bytes) of the in-memory file
+ * cache. A value of `0` disables the file cache.
+ */
+#ifndef FILE_CACHE_SIZE_CONF_KEY
+#define FILE_CACHE_SIZE_CONF_KEY "file_cache_size"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max size (in bytes) of a single cached file.
+ */
+#ifndef FILE_CACHE_MAX_FILE_SIZE_CONF_KEY
+#define FILE_CACHE_MAX_FILE_SIZE_CONF_KEY "file_cache_max_file_size"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of cached files.
+ */
+#ifndef FILE_CACHE_MAX_ENTRIES_CONF_KEY
+#define FILE_CACHE_MAX_ENTRIES_CONF_KEY "file_cache_max_entries"
+#endif
+
+/**
+ * @brief Defines the default configuration key to map cached files with `mmap()` instead of
+ * reading them into memory, off by default since the files must not be edited in place (see
+ * `FILE_CACHE_MAP_FILES`).
+ */
+#ifndef FILE_CACHE_MMAP_CONF_KEY
+#define FILE_CACHE_MMAP_CONF_KEY "file_cache_mmap"
+#endif
+
+/**
+ * @brief Defines the default configuration key to advise the mappings of cached files to use huge
+ * pages.
+ */
+#ifndef FILE_CACHE_HUGE_PAGES_CONF_KEY
+#define FILE_CACHE_HUGE_PAGES_CONF_KEY "file_cache_huge_pages"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of files kept open by the file
+ * descriptor cache. A value of `0` disables the file descriptor cache.
+ */
+#ifndef FD_CACHE_ENTRIES_CONF_KEY
+#define FD_CACHE_ENTRIES_CONF_KEY "fd_cache_entries"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the time to live (in seconds) of an open file
+ * in the file descriptor cache.
+ */
+#ifndef FD_CACHE_TTL_CONF_KEY
+#define FD_CACHE_TTL_CONF_KEY "fd_cache_ttl"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max length of the queue of pending
+ * connections of a listening socket.
+ */
+#ifndef LISTEN_BACKLOG_CONF_KEY
+#define LISTEN_BACKLOG_CONF_KEY "listen_backlog"
+#endif
+
+/**
+ * @brief Defines the default configuration key to give every worker `SO_REUSEPORT` listening
+ * sockets of its own.
+ */
+#ifndef REUSE_PORT_CONF_KEY
+#define REUSE_PORT_CONF_KEY "reuse_port"
+#endif
+
+/**
+ * @brief Defines the default configuration key to pin the worker threads to CPUs.
+ */
+#ifndef PIN_WORKERS_CONF_KEY
+#define PIN_WORKERS_CONF_KEY "pin_workers"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the CPUs the worker threads are pinned to, a
+ * list of CPUs and CPU ranges (e.g. `0-3,8-11`).
+ */
+#ifndef WORKER_CPUS_CONF_KEY
+#define WORKER_CPUS_CONF_KEY "worker_cpus"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the event backend of the workers, `epoll` or
+ * `io_uring`.
+ */
+#ifndef EVENT_BACKEND_CONF_KEY
+#define EVENT_BACKEND_CONF_KEY "event_backend"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the `TCP_DEFER_ACCEPT` timeout (in seconds).
+ */
+#ifndef TCP_DEFER_ACCEPT_CONF_KEY
+#define TCP_DEFER_ACCEPT_CONF_KEY "tcp_defer_accept"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the `TCP_FASTOPEN` queue length.
+ */
+#ifndef TCP_FASTOPEN_CONF_KEY
+#define TCP_FASTOPEN_CONF_KEY "tcp_fastopen"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the access log path, `-` logs to `stdout`.
+ */
+#ifndef ACCESS_LOG_CONF_KEY
+#define ACCESS_LOG_CONF_KEY "access_log"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the access log format (`combined` or `json`).
+ */
+#ifndef ACCESS_LOG_FORMAT_CONF_KEY
+#define ACCESS_LOG_FORMAT_CONF_KEY "access_log_format"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the access log sampling rate (1 in N requests).
+ */
+#ifndef ACCESS_LOG_SAMPLE_CONF_KEY
+#define ACCESS_LOG_SAMPLE_CONF_KEY "access_log_sample"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the number of lines buffered per worker.
+ */
+#ifndef ACCESS_LOG_BUFFER_CONF_KEY
+#define ACCESS_LOG_BUFFER_CONF_KEY "access_log_buffer"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the `cache-control` rules.
+ *
+ * The value is a `;` separated list of `<pattern>=<cache-control value>` rules. A pattern starting
+ * with `/` matches URLs with that prefix, `*` matches everything, `<type>/\*` matches MIME types of
+ * that type and any other pattern matches a MIME type exactly. The first matching rule is used.
+ */
+#ifndef CACHE_CONTROL_CONF_KEY
+#define CACHE_CONTROL_CONF_KEY "cache_control"
+#endif
+
+/**
+ * @brief Defines the default configuration key for serving precompressed siblings of files (e.g.
+ * `style.css.br` for `style.css`) to clients that accept their coding.
+ */
+#ifndef PRECOMPRESSED_FILES_CONF_KEY
+#define PRECOMPRESSED_FILES_CONF_KEY "precompressed_files"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the gzip level of compressible cached files,
+ * `0` disables compression.
+ */
+#ifndef GZIP_LEVEL_CONF_KEY
+#define GZIP_LEVEL_CONF_KEY "gzip_level"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the index files of directories.
+ *
+ * The value is a list of file names separated by spaces or `,`. A URL of a directory (ending with
+ * `/`) is served as the first of its index files that exists. `/` is served as `PAGE_CONF_KEY`
+ * instead, unless it is empty.
+ */
+#ifndef INDEX_FILES_CONF_KEY
+#define INDEX_FILES_CONF_KEY "index_files"
+#endif
+
+/**
+ * @brief Defines the default configuration key for listing directories that have no index file,
+ * otherwise they are answered with `403`.
+ */
+#ifndef AUTOINDEX_CONF_KEY
+#define AUTOINDEX_CONF_KEY "autoindex"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the format of directory listings, `html` or
+ * `json`.
+ */
+#ifndef AUTOINDEX_FORMAT_CONF_KEY
+#define AUTOINDEX_FORMAT_CONF_KEY "autoindex_format"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the MIME types file that overrides the builtin
+ * MIME types.
+ */
+#ifndef MIME_TYPES_FILE_CONF_KEY
+#define MIME_TYPES_FILE_CONF_KEY "mime_types_file"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the URL path the metrics are served on in the
+ * Prometheus text format, empty disables the metrics.
+ *
+ * The metrics are served without authentication on the same listeners as the site, so they are
+ * disabled in the shipped configuration and should only be enabled where the path is restricted.
+ */
+#ifndef METRICS_PATH_CONF_KEY
+#define METRICS_PATH_CONF_KEY "metrics_path"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the routes of URL prefixes to upstream
+ * backends, empty serves every request from `SITE_DIR_CONF_KEY`.
+ */
+#ifndef PROXY_ROUTES_CONF_KEY
+#define PROXY_ROUTES_CONF_KEY "proxy_routes"
+#endif
+
+/**
+ * @brief Defines the default configuration key for how requests are balanced over the backends
+ * of a route, `round_robin` or `least_conn`.
+ */
+#ifndef PROXY_BALANCE_CONF_KEY
+#define PROXY_BALANCE_CONF_KEY "proxy_balance"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of idle keep-alive connections
+ * kept open per backend.
+ */
+#ifndef PROXY_POOL_SIZE_CONF_KEY
+#define PROXY_POOL_SIZE_CONF_KEY "proxy_pool_size"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the time (in seconds) between the health checks
+ * of the backends, `0` disables the health checks.
+ */
+#ifndef PROXY_HEALTH_INTERVAL_CONF_KEY
+#define PROXY_HEALTH_INTERVAL_CONF_KEY "proxy_health_interval"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max time (in seconds) to connect to a
+ * backend and for every send to or receive from it.
+ */
+#ifndef PROXY_TIMEOUT_CONF_KEY
+#define PROXY_TIMEOUT_CONF_KEY "proxy_timeout"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the port HTTPS is served on, `0` disables
+ * HTTPS.
+ */
+#ifndef TLS_PORT_CONF_KEY
+#define TLS_PORT_CONF_KEY "tls_port"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the PEM file of the certificate chain served on
+ * `TLS_PORT_CONF_KEY`.
+ */
+#ifndef TLS_CERTIFICATE_CONF_KEY
+#define TLS_CERTIFICATE_CONF_KEY "tls_certificate"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the PEM file of the private key of
+ * `TLS_CERTIFICATE_CONF_KEY`.
+ */
+#ifndef TLS_PRIVATE_KEY_CONF_KEY
+#define TLS_PRIVATE_KEY_CONF_KEY "tls_private_key"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of TLS sessions cached for
+ * resumption by session ID, `0` only resumes sessions from session tickets.
+ */
+#ifndef TLS_SESSION_CACHE_CONF_KEY
+#define TLS_SESSION_CACHE_CONF_KEY "tls_session_cache"
+#endif
+
+/**
+ * @brief Defines the default configuration key for whether TLS records are encrypted by the kernel
+ * (kTLS) when it supports the negotiated cipher.
+ *
+ * kTLS needs the `tls` kernel module and OpenSSL built with `enable-ktls`, and only sends are
+ * offloaded. Connections whose session couldn't be moved to the kernel fall back to reading files
+ * into the server and writing them with `SSL_write_ex()` instead of `sendfile()`.
+ */
+#ifndef TLS_KTLS_CONF_KEY
+#define TLS_KTLS_CONF_KEY "tls_ktls"
+#endif
+
+/**
+ * @brief Defines the default configuration key for whether HTTP/2 is served, selected with ALPN on
+ * HTTPS connections and with prior knowledge or an `Upgrade: h2c` request on HTTP connections.
+ */
+#ifndef HTTP2_CONF_KEY
+#define HTTP2_CONF_KEY "http2"
+#endif
+
+/**
+ * @brief Defines the default configuration key for the max number of concurrent streams of an
+ * HTTP/2 connection.
+ */
+#ifndef HTTP2_MAX_STREAMS_CONF_KEY
+#define HTTP2_MAX_STREAMS_CONF_KEY "http2_max_streams"
+#endif
+
+/**
+ * @brief Defines the default Server IP, used when `HOST_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_SERVER_HOST
+#define DEFAULT_SERVER_HOST "127.0.0.1"
+#endif
+
+/**
+ * @brief Defines the default Server Port, used when `PORT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_SERVER_PORT
+#define DEFAULT_SERVER_PORT 8080
+#endif
+
+/**
+ * @brief Defines the default website root directory, used when `SITE_DIR_CONF_KEY` is not set in
+ * the config file.
+ */
+#ifndef DEFAULT_SITE_DIR
+#define DEFAULT_SITE_DIR "site"
+#endif
+
+/**
+ * @brief Defines the default page served for `/`, used when `PAGE_CONF_KEY` is not set in the
+ * config file.
+ */
+#ifndef DEFAULT_PAGE
+#define DEFAULT_PAGE "/index.html"
+#endif
+
+/**
+ * @brief Defines the default index files of directories, used when `INDEX_FILES_CONF_KEY` is not
+ * set in the config file.
+ */
+#ifndef DEFAULT_INDEX_FILES
+#define DEFAULT_INDEX_FILES "index.html"
+#endif
+
+/**
+ * @brief Defines the highest CPU the workers can be pinned to with `WORKER_CPUS_CONF_KEY`, the
+ * last CPU of a `cpu_set_t`.
+ */
+#ifndef MAX_WORKER_CPU
+#define MAX_WORKER_CPU 1023
+#endif
+
+/**
+ * @brief Defines the idle timeout (in seconds) of persistent connections, used when
+ * `KEEPALIVE_TIMEOUT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_KEEPALIVE_TIMEOUT
+#define DEFAULT_KEEPALIVE_TIMEOUT 5
+#endif
+
+/**
+ * @brief Defines the max number of requests served on a persistent connection, used when
+ * `KEEPALIVE_REQUESTS_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_KEEPALIVE_REQUESTS
+#define DEFAULT_KEEPALIVE_REQUESTS 100
+#endif
+
+/**
+ * @brief Defines the max time (in seconds) a shutdown waits for the requests in flight, used when
+ * `SHUTDOWN_TIMEOUT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_SHUTDOWN_TIMEOUT
+#define DEFAULT_SHUTDOWN_TIMEOUT 10
+#endif
+
+/**
+ * @brief Defines the max time (in seconds) a request head may take to arrive, used when
+ * `REQUEST_HEAD_TIMEOUT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_REQUEST_HEAD_TIMEOUT
+#define DEFAULT_REQUEST_HEAD_TIMEOUT 10
+#endif
+
+/**
+ * @brief Defines the max time (in seconds) a request body may take to arrive, used when
+ * `REQUEST_BODY_TIMEOUT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_REQUEST_BODY_TIMEOUT
+#define DEFAULT_REQUEST_BODY_TIMEOUT 30
+#endif
+
+/**
+ * @brief Defines the max size (in bytes) of a request head, used when
+ * `MAX_REQUEST_HEAD_SIZE_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_MAX_REQUEST_HEAD_SIZE
+#define DEFAULT_MAX_REQUEST_HEAD_SIZE 32768
+#endif
+
+/**
+ * @brief Defines the max number of idle connections kept open per backend, used when
+ * `PROXY_POOL_SIZE_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_PROXY_POOL_SIZE
+#define DEFAULT_PROXY_POOL_SIZE 32
+#endif
+
+/**
+ * @brief Defines the time (in seconds) between the health checks of the backends, used when
+ * `PROXY_HEALTH_INTERVAL_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_PROXY_HEALTH_INTERVAL
+#define DEFAULT_PROXY_HEALTH_INTERVAL 5
+#endif
+
+/**
+ * @brief Defines the max time (in seconds) to connect to, send to or receive from a backend, used
+ * when `PROXY_TIMEOUT_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_PROXY_TIMEOUT
+#define DEFAULT_PROXY_TIMEOUT 30
+#endif
+
+/**
+ * @brief Defines the max number of TLS sessions cached for resumption by session ID, used when
+ * `TLS_SESSION_CACHE_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_TLS_SESSION_CACHE
+#define DEFAULT_TLS_SESSION_CACHE 20480
+#endif
+
+/**
+ * @brief Defines the max number of concurrent streams of an HTTP/2 connection, used when
+ * `HTTP2_MAX_STREAMS_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_HTTP2_MAX_STREAMS
+#define DEFAULT_HTTP2_MAX_STREAMS 100
+#endif
+
+/**
+ * @brief Defines the max size (in bytes) of a request body, used when
+ * `MAX_REQUEST_BODY_SIZE_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_MAX_REQUEST_BODY_SIZE
+#define DEFAULT_MAX_REQUEST_BODY_SIZE 1048576
+#endif
+
+/**
+ * @brief Defines the time to live (in seconds) of an open file in the file descriptor cache, used
+ * when `FD_CACHE_TTL_CONF_KEY` is not set in the config file.
+ */
+#ifndef DEFAULT_FD_CACHE_TTL
+#define DEFAULT_FD_CACHE_TTL 1
+#endif
+
+/**
+ * @brief Defines the max length of the queue of pending connections of a listening socket, used
+ * when `LISTEN_BACKLOG_CONF_KEY` is not set in the config file.
+ *
+ * For more Info about `backlog` parameter in `listen()` function, please refer to POSIX Sockets
+ * Docs.
+ */
+#ifndef DEFAULT_LISTEN_BACKLOG
+#define DEFAULT_LISTEN_BACKLOG 511
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
 #include <glib.h>
 
+/**
+ * @struct cache_control_rule
+ * @brief Defines a rule that selects the `cache-control` header for a URL or MIME type.
+ *
+ * @see CACHE_CONTROL_CONF_KEY
+ *
+ * @property char* cache_control_rule::pattern
+ * @brief The URL prefix (starting with `/`), MIME type or `*` the rule matches.
+ *
+ * @property char* cache_control_rule::value
+ * @brief Value of the `cache-control` header.
+ */
+typedef struct cache_control_rule {
+    char *pattern;
+    char *value;
+} cache_control_rule;
+
+/**
+ * @struct server_config
+ * @brief Defines the typed configuration snapshot.
+ *
+ * A snapshot is created from the config file by `load_config()` and `reload_config()` and is never
+ * modified afterwards, so it can be read by any number of threads without locking. Keys that are
+ * not set in the config file get their `DEFAULT_*` value (`0` for the worker and file cache
+ * settings).
+ *
+ * @see get_server_config
+ *
+ * @property char* server_config::host
+ * @brief Server IP, from `HOST_CONF_KEY`.
+ *
+ * @property int server_config::port
+ * @brief Server Port, from `PORT_CONF_KEY`.
+ *
+ * @property char* server_config::site_root_dir
+ * @brief Website root directory, from `SITE_DIR_CONF_KEY`.
+ *
+ * @property char* server_config::default_page
+ * @brief Page served for `/`, from `PAGE_CONF_KEY`.
+ *
+ * @property int server_config::worker_threads
+ * @brief Number of worker threads, from `WORKERS_CONF_KEY`.
+ *
+ * @property int server_config::keepalive_timeout
+ * @brief Idle timeout (in seconds) of persistent connections, from `KEEPALIVE_TIMEOUT_CONF_KEY`.
+ *
+ * @property int server_config::keepalive_requests
+ * @brief Max number of requests on a persistent connection, from `KEEPALIVE_REQUESTS_CONF_KEY`.
+ *
+ * @property int server_config::shutdown_timeout
+ * @brief Max time (in seconds) a shutdown waits for the requests in flight, from
+ * `SHUTDOWN_TIMEOUT_CONF_KEY`.
+ *
+ * @property int server_config::max_connections
+ * @brief Max number of open connections, from `MAX_CONNECTIONS_CONF_KEY`. `0` if there is no
+ * limit.
+ *
+ * @property int server_config::max_connections_per_ip
+ * @brief Max number of open connections per client address, from
+ * `MAX_CONNECTIONS_PER_IP_CONF_KEY`. `0` if there is no limit.
+ *
+ * @property int server_config::request_head_timeout
+ * @brief Max time (in seconds) a request head may take to arrive, from
+ * `REQUEST_HEAD_TIMEOUT_CONF_KEY`.
+ *
+ * @property int server_config::request_body_timeout
+ * @brief Max time (in seconds) a request body may take to arrive, from
+ * `REQUEST_BODY_TIMEOUT_CONF_KEY`.
+ *
+ * @property size_t server_config::max_request_head_size
+ * @brief Max size (in bytes) of a request head, from `MAX_REQUEST_HEAD_SIZE_CONF_KEY`.
+ *
+ * @property size_t server_config::max_request_body_size
+ * @brief Max size (in bytes) of a request body, from `MAX_REQUEST_BODY_SIZE_CONF_KEY`.
+ *
+ * @property size_t server_config::file_cache_size
+ * @brief Total size (in bytes) of the file cache, from `FILE_CACHE_SIZE_CONF_KEY`.
+ *
+ * @property size_t server_config::file_cache_max_file_size
+ * @brief Max size (in bytes) of a cached file, from `FILE_CACHE_MAX_FILE_SIZE_CONF_KEY`.
+ *
+ * @property unsigned int server_config::file_cache_max_entries
+ * @brief Max number of cached files, from `FILE_CACHE_MAX_ENTRIES_CONF_KEY`.
+ *
+ * @property bool server_config::file_cache_mmap
+ * @brief Whether cached files are mapped with `mmap()`, from `FILE_CACHE_MMAP_CONF_KEY`.
+ *
+ * @property bool server_config::file_cache_huge_pages
+ * @brief Whether the mappings of cached files are advised to use huge pages, from
+ * `FILE_CACHE_HUGE_PAGES_CONF_KEY`.
+ *
+ * @property unsigned int server_config::fd_cache_entries
+ * @brief Max number of files kept open, from `FD_CACHE_ENTRIES_CONF_KEY`.
+ *
+ * @property int server_config::fd_cache_ttl
+ * @brief Time to live (in seconds) of an open file, from `FD_CACHE_TTL_CONF_KEY`.
+ *
+ * @property int server_config::listen_backlog
+ * @brief Max length of the queue of pending connections, from `LISTEN_BACKLOG_CONF_KEY`.
+ *
+ * @property bool server_config::reuse_port
+ * @brief Whether every worker has `SO_REUSEPORT` listening sockets of its own, from
+ * `REUSE_PORT_CONF_KEY`.
+ *
+ * @property bool server_config::pin_workers
+ * @brief Whether the worker threads are pinned to CPUs, from `PIN_WORKERS_CONF_KEY`.
+ *
+ * @property int* server_config::worker_cpus
+ * @brief CPUs the worker threads are pinned to, in order, from `WORKER_CPUS_CONF_KEY`. `NULL` to
+ * pin them to all the online CPUs.
+ *
+ * @property unsigned int server_config::n_worker_cpus
+ * @brief Number of CPUs in `worker_cpus`.
+ *
+ * @property char* server_config::event_backend
+ * @brief Event backend of the workers, `epoll` or `io_uring`, from `EVENT_BACKEND_CONF_KEY`.
+ *
+ * @property int server_config::tcp_defer_accept
+ * @brief `TCP_DEFER_ACCEPT` timeout (in seconds), from `TCP_DEFER_ACCEPT_CONF_KEY`.
+ *
+ * @property int server_config::tcp_fastopen
+ * @brief `TCP_FASTOPEN` queue length, from `TCP_FASTOPEN_CONF_KEY`.
+ *
+ * @property char* server_config::access_log
+ * @brief Access log path, from `ACCESS_LOG_CONF_KEY`. Empty if requests are not logged.
+ *
+ * @property char* server_config::access_log_format
+ * @brief Access log format, from `ACCESS_LOG_FORMAT_CONF_KEY`.
+ *
+ * @property unsigned int server_config::access_log_sample
+ * @brief Only 1 in `access_log_sample` requests is logged, from `ACCESS_LOG_SAMPLE_CONF_KEY`.
+ *
+ * @property size_t server_config::access_log_buffer
+ * @brief Number of lines buffered per worker, from `ACCESS_LOG_BUFFER_CONF_KEY`.
+ *
+ * @property cache_control_rule* server_config::cache_control
+ * @brief Rules for the `cache-control` header, from `CACHE_CONTROL_CONF_KEY`.
+ *
+ * @property unsigned int server_config::n_cache_control
+ * @brief Number of rules in `cache_control`.
+ *
+ * @property bool server_config::precompressed_files
+ * @brief Whether precompressed siblings of files are served, from `PRECOMPRESSED_FILES_CONF_KEY`.
+ *
+ * @property int server_config::gzip_level
+ * @brief gzip level of compressible cached files, from `GZIP_LEVEL_CONF_KEY`. `0` if files are
+ * not compressed.
+ *
+ * @property char** server_config::index_files
+ * @brief Index files of directories, from `INDEX_FILES_CONF_KEY`.
+ *
+ * @property unsigned int server_config::n_index_files
+ * @brief Number of files in `index_files`.
+ *
+ * @property bool server_config::autoindex
+ * @brief Whether directories without an index file are listed, from `AUTOINDEX_CONF_KEY`.
+ *
+ * @property char* server_config::autoindex_format
+ * @brief Format of directory listings, from `AUTOINDEX_FORMAT_CONF_KEY`.
+ *
+ * @property char* server_config::mime_types_file
+ * @brief MIME types file loaded over the builtin MIME types, from `MIME_TYPES_FILE_CONF_KEY`.
+ * Empty if the builtin MIME types are used as is.
+ *
+ * @property char* server_config::metrics_path
+ * @brief URL path the metrics are served on, from `METRICS_PATH_CONF_KEY`. Empty if the metrics are
+ * disabled.
+ *
+ * @property char* server_config::proxy_routes
+ * @brief Routes of URL prefixes to upstream backends, from `PROXY_ROUTES_CONF_KEY`. Empty if
+ * requests are not proxied.
+ *
+ * @property char* server_config::proxy_balance
+ * @brief How requests are balanced over the backends of a route, from `PROXY_BALANCE_CONF_KEY`.
+ *
+ * @property int server_config::proxy_pool_size
+ * @brief Max number of idle connections kept open per backend, from `PROXY_POOL_SIZE_CONF_KEY`.
+ *
+ * @property int server_config::proxy_health_interval
+ * @brief Time (in seconds) between the health checks of the backends, from
+ * `PROXY_HEALTH_INTERVAL_CONF_KEY`. `0` if the backends are not checked.
+ *
+ * @property int server_config::proxy_timeout
+ * @brief Max time (in seconds) to connect to, send to or receive from a backend, from
+ * `PROXY_TIMEOUT_CONF_KEY`.
+ *
+ * @property int server_config::tls_port
+ * @brief Port HTTPS is served on, from `TLS_PORT_CONF_KEY`. `0` if HTTPS is disabled.
+ *
+ * @property char* server_config::tls_certificate
+ * @brief PEM file of the certificate chain, from `TLS_CERTIFICATE_CONF_KEY`.
+ *
+ * @property char* server_config::tls_private_key
+ * @brief PEM file of the private key, from `TLS_PRIVATE_KEY_CONF_KEY`.
+ *
+ * @property int server_config::tls_session_cache
+ * @brief Max number of TLS sessions cached for resumption by session ID, from
+ * `TLS_SESSION_CACHE_CONF_KEY`.
+ *
+ * @property bool server_config::tls_ktls
+ * @brief Whether TLS records are encrypted by the kernel if it can, from `TLS_KTLS_CONF_KEY`.
+ *
+ * @property bool server_config::http2
+ * @brief Whether HTTP/2 is served, from `HTTP2_CONF_KEY`.
+ *
+ * @property unsigned int server_config::http2_max_streams
+ * @brief Max number of concurrent streams of an HTTP/2 connection, from
+ * `HTTP2_MAX_STREAMS_CONF_KEY`.
+ *
+ * @property server_config* server_config::retired
+ * @brief Snapshot that was replaced by this one, freed by `unload_config()`.
+ */
+typedef struct server_config {
+    char *host;
+    int port;
+    char *site_root_dir;
+    char *default_page;
+    int worker_threads;
+    int keepalive_timeout;
+    int keepalive_requests;
+    int shutdown_timeout;
+    int max_connections;
+    int max_connections_per_ip;
+    int request_head_timeout;
+    int request_body_timeout;
+    size_t max_request_head_size;
+    size_t max_request_body_size;
+    size_t file_cache_size;
+    size_t file_cache_max_file_size;
+    unsigned int file_cache_max_entries;
+    bool file_cache_mmap;
+    bool file_cache_huge_pages;
+    unsigned int fd_cache_entries;
+    int fd_cache_ttl;
+    int listen_backlog;
+    bool reuse_port;
+    bool pin_workers;
+    int *worker_cpus;
+    unsigned int n_worker_cpus;
+    char *event_backend;
+    int tcp_defer_accept;
+    int tcp_fastopen;
+    char *access_log;
+    char *access_log_format;
+    unsigned int access_log_sample;
+    size_t access_log_buffer;
+    cache_control_rule *cache_control;
+    unsigned int n_cache_control;
+    bool precompressed_files;
+    int gzip_level;
+    char **index_files;
+    unsigned int n_index_files;
+    bool autoindex;
+    char *autoindex_format;
+    char *mime_types_file;
+    char *metrics_path;
+    char *proxy_routes;
+    char *proxy_balance;
+    int proxy_pool_size;
+    int proxy_health_interval;
+    int proxy_timeout;
+    int tls_port;
+    char *tls_certificate;
+    char *tls_private_key;
+    int tls_session_cache;
+    bool tls_ktls;
+    bool http2;
+    unsigned int http2_max_streams;
+    struct server_config *retired;
+} server_config;
+
 /**
  * @brief Loads and parses the configuration file and returns an int value to indicate success or
  * failure.
@@ -72,10 +897,35 @@
  * not `NULL`), the function returns `2` without performing any action. If the configuration file is
  * not loaded successfully, the function returns `0`.
  *
+ * The typed configuration snapshot returned by `get_server_config()` is created from the parsed
+ * config.
+ *
  * @return On success, returns a non-zero value. On failure, returns 0.
  */
 int load_config();
 
+/**
+ * @brief Loads the configuration file again and atomically replaces the configuration snapshot.
+ *
+ * Threads that already hold the previous snapshot can keep using it, replaced snapshots are only
+ * freed by `unload_config()`. If the configuration file can't be loaded, the current configuration
+ * is kept. This function must not be called concurrently with itself, `load_config()` or
+ * `unload_config()`.
+ *
+ * @return On success, returns `1`. If the config is not loaded yet or on failure, returns `0`.
+ */
+int reload_config();
+
+/**
+ * @brief Returns the current configuration snapshot.
+ *
+ * The snapshot is read with a single atomic load and must not be modified. It stays valid until
+ * `unload_config()` is called, even if it is replaced by `reload_config()` in the meantime.
+ *
+ * @return The current configuration snapshot, or `NULL` if the config is not loaded.
+ */
+const server_config *get_server_config();
+
 /**
  * @brief Returns the value for the corresponding configuration key.
  *
@@ -111,10 +961,104 @@ char *get_config_str(const char *);
 int get_config_int(const char *);
 
 /**
- * @brief Unloads configuration and frees memory allocated for configuration and any errors.
+ * @brief Unloads configuration and frees memory allocated for configuration, including all the
+ * configuration snapshots.
  *
  * @return void
  */
 void unload_config();
 
+/**
+ * @brief Gets the `cache-control` header value for a URL and its MIME type.
+ *
+ * @param cfg The configuration snapshot.
+ * @param url The URL path.
+ * @param mimetype The MIME type of the URL, can be `NULL`.
+ * @return The value of the first matching rule, or `NULL` if no rule matches.
+ */
+const char *get_cache_control(const server_config *, const char *, const char *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Creates a configuration snapshot from a parsed config file.
+ *
+ * @param key_file The parsed config file.
+ * @return On success, returns the new snapshot. On failure, returns `NULL`.
+ */
+server_config *_create_server_config(GKeyFile *);
+
+/**
+ * @private
+ * @brief Frees a configuration snapshot and all the snapshots it retired.
+ *
+ * @param cfg The snapshot to be freed.
+ * @return void
+ */
+void _free_server_config(server_config *);
+
+/**
+ * @private
+ * @brief Returns a newly allocated copy of the string value for `key`, or of `default_val` if the
+ * key is not set.
+ *
+ * @param key_file The parsed config file.
+ * @param key The configuration key.
+ * @param default_val The default value.
+ * @return A newly allocated string, or `NULL` on failure.
+ */
+char *_get_key_file_str(GKeyFile *, const char *, const char *);
+
+/**
+ * @private
+ * @brief Parses the `cache-control` rules (see `CACHE_CONTROL_CONF_KEY`) into `cfg`.
+ *
+ * Rules without a `=` are ignored.
+ *
+ * @param cfg The configuration snapshot.
+ * @param rules The rules.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _parse_cache_control_rules(server_config *, const char *);
+
+/**
+ * @private
+ * @brief Parses the index files (see `INDEX_FILES_CONF_KEY`) into `cfg`.
+ *
+ * Names containing `/` are ignored, so an index file is always in its directory.
+ *
+ * @param cfg The configuration snapshot.
+ * @param names The names of the index files.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _parse_index_files(server_config *, const char *);
+
+/**
+ * @private
+ * @brief Parses the CPUs of the workers (see `WORKER_CPUS_CONF_KEY`) into `cfg`.
+ *
+ * The list is separated by `,` or whitespace and each entry is a CPU or a range of CPUs (`N-M`).
+ * Invalid entries and CPUs over `MAX_WORKER_CPU` are ignored.
+ *
+ * @param cfg The configuration snapshot.
+ * @param cpus The list of CPUs.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _parse_worker_cpus(server_config *, const char *);
+
+/**
+ * @private
+ * @brief Returns the int value for `key`, or `default_val` if the key is not set or is not an
+ * integer.
+ *
+ * @param key_file The parsed config file.
+ * @param key The configuration key.
+ * @param default_val The default value.
+ * @return The value associated with the key or `default_val`.
+ */
+int _get_key_file_int(GKeyFile *, const char *, const int);
+
 #endif
@@ -0,0 +1,670 @@
+/**
+ * @file include/connection.h
+ * @brief Function Prototypes for managing client connections owned by a worker event loop.
+ *
+ * This file contains the connection structure and function prototypes to create, read from and
+ * close client connections. A connection is a small state machine driven by the worker event loop
+ * (defined in `include/worker.h`). Data is read from the non-blocking socket into the connection's
+ * receive buffer until a complete request head is available, after which the connection is handed
+ * to the request handler. The handler can then stream the request body with
+ * `read_connection_body()`.
+ *
+ * Responses are written without blocking either. What the socket doesn't take is queued on the
+ * connection (copied, held by reference or as a file range) and sent by the worker event loop once
+ * the socket is writable again, so a client that reads slowly only holds its own connection.
+ *
+ * Receive buffers start at `REQ_BUF_SIZE` bytes and only grow (up to `max_request_head_size`) for
+ * request heads that don't fit. Buffers are allocated from the worker's slab cache and a
+ * connection frees its buffer whenever it has no buffered data, so idle keep-alive connections
+ * don't hold a buffer.
+ *
+ * Implemented in slib/connection.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _CONNECTION_H
+#define _CONNECTION_H 1
+
+/**
+ * @brief Defines the timeout (in seconds) for sending a response to the client.
+ *
+ * A connection with queued output is closed once the client didn't read any of it for this long.
+ */
+#ifndef SEND_TIMEOUT
+#define SEND_TIMEOUT 30
+#endif
+
+/**
+ * @brief Defines the size of the chunks a queued file range is read in when it can't be sent with
+ * `sendfile()` (e.g. over TLS without kTLS), the size of a full TLS record.
+ */
+#ifndef CONN_OUTPUT_CHUNK_SIZE
+#define CONN_OUTPUT_CHUNK_SIZE 16384
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "arena.h"
+#include "config.h"
+#include "http2.h"
+#include "http_parser.h"
+#include "metrics.h"
+#include "request.h"
+#include "slab.h"
+#include "timerwheel.h"
+#include "tls.h"
+
+/**
+ * @brief Defines the states of a connection.
+ *
+ *     - `CONN_HANDSHAKING`: TLS handshake of an HTTPS connection is in progress.
+ *     - `CONN_READING`: Waiting for (more of) the request head.
+ *     - `CONN_HANDLING`: Request head is complete and the request is being handled.
+ *     - `CONN_WRITING`: The request is handled, the rest of its response waits for the socket to
+ *       be writable and the rest of its body is dropped as it arrives.
+ *     - `CONN_PROXYING`: The handler forwards the request to a backend (`connection::proxy`) and
+ *       is called again whenever the backend or the client is ready.
+ *     - `CONN_CLOSING`: Connection is done and must be closed by the event loop.
+ */
+typedef enum conn_state {
+    CONN_HANDSHAKING,
+    CONN_READING,
+    CONN_HANDLING,
+    CONN_WRITING,
+    CONN_PROXYING,
+    CONN_CLOSING
+} conn_state;
+
+/**
+ * @brief Defines the function signature of the callback that releases a buffer queued without
+ * copying it, see `write_connection_held()`.
+ */
+typedef void (*conn_output_release)(void *);
+
+/**
+ * @struct conn_output
+ * @brief Defines a part of a response queued on a connection because the socket didn't take it.
+ *
+ * A part is either a buffer or a range of a file. Buffers are copied into `buf`, unless they are
+ * held by reference until they are sent (e.g. the body of a file cache entry).
+ *
+ * @property conn_output* conn_output::next
+ * @brief Next part of the queue, `NULL` for the last one.
+ *
+ * @property int conn_output::file_fd
+ * @brief Duplicate of the descriptor of the file the part is sent from, `-1` for a buffer.
+ *
+ * @property off_t conn_output::offset
+ * @brief Offset in the file of the next byte to send.
+ *
+ * @property bool conn_output::is_read
+ * @brief Whether the file is read into chunks instead of being sent with `sendfile()`.
+ *
+ * @property const char* conn_output::data
+ * @brief Next byte of the buffer to send.
+ *
+ * @property size_t conn_output::len
+ * @brief Number of bytes left to send.
+ *
+ * @property conn_output_release conn_output::release
+ * @brief Called with `release_arg` once a held buffer is sent or dropped, `NULL` otherwise.
+ *
+ * @property void* conn_output::release_arg
+ * @brief The argument of `release`.
+ *
+ * @property char conn_output::buf
+ * @brief The copy of the buffer.
+ */
+typedef struct conn_output {
+    struct conn_output *next;
+    int file_fd;
+    off_t offset;
+    bool is_read;
+    const char *data;
+    size_t len;
+    conn_output_release release;
+    void *release_arg;
+    char buf[];
+} conn_output;
+
+/**
+ * @struct connection
+ * @brief Defines a client connection structure.
+ *
+ * This structure stores the state of a single client connection. Connections are owned by the
+ * worker that accepted them and are never shared between workers, so no locking is required.
+ *
+ * @see create_connection
+ * @see read_connection
+ * @see close_connection
+ *
+ * @property int connection::fd
+ * @brief The file descriptor of the accepted connection.
+ *
+ * @property conn_state connection::state
+ * @brief The current state of the connection.
+ *
+ * @property size_t connection::recv_len
+ * @brief Number of bytes currently stored in `recv_buf`.
+ *
+ * @property size_t connection::recv_size
+ * @brief Size of `recv_buf` (without the `\0` terminator), `0` if the connection has no buffer.
+ *
+ * @property size_t connection::recv_max
+ * @brief Size `recv_buf` can grow to, from `max_request_head_size` when the connection was
+ * created.
+ *
+ * @property size_t connection::head_len
+ * @brief Length of the complete request head at the start of `recv_buf`, including the empty line.
+ * Set to `0` while the request head is incomplete.
+ *
+ * @property unsigned int connection::n_requests
+ * @brief Number of requests handled on the connection.
+ *
+ * @property int connection::error_status
+ * @brief Status code of the error response the handler sends instead of handling a request (`400`
+ * for a malformed request head or an invalid body framing, `431` for a request head that doesn't
+ * fit in `recv_max` bytes). `0` if the request head is valid.
+ *
+ * @property sockaddr_storage connection::peer_addr
+ * @brief Address of the client, `AF_UNSPEC` if unknown.
+ *
+ * @property time_t connection::last_active
+ * @brief Monotonic time (in seconds) of the last read from, write to or request handled on the
+ * connection.
+ *
+ * @property time_t connection::head_started
+ * @brief Monotonic time (in seconds) the current request head started arriving at.
+ *
+ * @property time_t connection::body_started
+ * @brief Monotonic time (in seconds) the current request head was complete at, the body of the
+ * request must be read within `request_body_timeout` seconds from then.
+ *
+ * @property timer_wheel_timer connection::timer
+ * @brief Timer of the owning worker that closes the connection once it is idle or its request
+ * head takes too long.
+ *
+ * @property long long connection::accepted_ns
+ * @brief Monotonic time (in nanoseconds, see `get_metrics_time()`) the connection was created at.
+ *
+ * @property long long connection::parse_ns
+ * @brief Time (in nanoseconds) spent parsing the current request head so far, observed as
+ * `METRICS_PARSE` once the head is complete or malformed. Only measured if the metrics are
+ * enabled.
+ *
+ * @property arena* connection::arena
+ * @brief Arena for the request and response of the current exchange, reset after every request.
+ *
+ * @property http_parser connection::parser
+ * @brief Incremental parser of the request head at the start of `recv_buf`.
+ *
+ * @property http_body_parser connection::body
+ * @brief Parser of the body of the current request, in the `HTTP_BODY_DONE` state if the request
+ * has no body or it was read completely.
+ *
+ * @property size_t connection::body_pos
+ * @brief Offset in `recv_buf` of the first byte after the head that was not parsed as body yet.
+ *
+ * @property uint64_t connection::body_max
+ * @brief Max length (in bytes) of the body of the current request that is dropped, set by
+ * `discard_connection_body()`. `0` until the handler asks for the body to be dropped.
+ *
+ * @property bool connection::is_blocking
+ * @brief Whether the socket is in blocking mode, as last set by `set_connection_blocking()`.
+ *
+ * @property unsigned int connection::events
+ * @brief Events the connection is registered for with the worker's epoll instance.
+ *
+ * @property conn_output* connection::output
+ * @brief First part of the output the socket didn't take yet, `NULL` if there is none.
+ *
+ * @property conn_output* connection::output_tail
+ * @brief Last part of the queued output.
+ *
+ * @property conn_state connection::next_state
+ * @brief State the handler returned for the request whose response is still queued, the
+ * connection moves on once `output` is sent.
+ *
+ * @property uint64_t connection::uring_op
+ * @brief `user_data` of the io_uring operation in flight for the connection (see
+ * `include/worker.h`), `0` if there is none. The connection can't be freed before it completes.
+ *
+ * @property proxy_conn* connection::proxy
+ * @brief Backend connection of the proxied request being handled (see `include/proxy.h`), `NULL`
+ * if there is none.
+ *
+ * @property int connection::upstream_fd
+ * @brief Socket of `proxy` the connection is registered with the worker's epoll instance for, `-1`
+ * if there is none.
+ *
+ * @property http2_session* connection::http2
+ * @brief HTTP/2 session of the connection, `NULL` for HTTP/1.x connections. The requests of its
+ * streams are loaded into `recv_buf` one after the other with `load_connection_request()`.
+ *
+ * @property char* connection::recv_buf
+ * @brief Receive buffer for the request head and body, always `\0` terminated. `NULL` while the
+ * connection has no buffered data.
+ *
+ * @property connection* connection::prev
+ * @brief Previous connection in the owning worker's connection list.
+ *
+ * @property connection* connection::next
+ * @brief Next connection in the owning worker's connection list.
+ */
+typedef struct connection {
+    int fd;
+    conn_state state;
+    size_t recv_len;
+    size_t recv_size;
+    size_t recv_max;
+    size_t head_len;
+    unsigned int n_requests;
+    int error_status;
+    time_t last_active;
+    time_t head_started;
+    time_t body_started;
+    timer_wheel_timer timer;
+    long long accepted_ns;
+    long long parse_ns;
+    struct sockaddr_storage peer_addr;
+    arena *arena;
+    http_parser parser;
+    http_body_parser body;
+    size_t body_pos;
+    uint64_t body_max;
+    bool is_blocking;
+    unsigned int events;
+    conn_output *output;
+    conn_output *output_tail;
+    conn_state next_state;
+    uint64_t uring_op;
+    struct proxy_conn *proxy;
+    int upstream_fd;
+    http2_session *http2;
+    char *recv_buf;
+    struct connection *prev;
+    struct connection *next;
+} connection;
+
+/**
+ * @brief Defines the function signature of a connection handler.
+ *
+ * A connection handler is called by the worker event loop once a complete request head is
+ * available in `connection::recv_buf`. The socket is non-blocking, the response is written with
+ * `write_connection()` and its variants (see `include/response.h`) and whatever is left is sent
+ * by the event loop. The handler returns `CONN_READING` to keep the connection open for the next
+ * request or `CONN_CLOSING` to close it, once the response is sent. A handler that waits for a
+ * backend returns `CONN_PROXYING` and is called again once `connection::proxy` can go on.
+ */
+typedef conn_state (*conn_handler)(connection *);
+
+/**
+ * @brief Allocates a connection struct for an accepted socket, usually a non-blocking one.
+ *
+ * The socket keeps no timeouts of its own, the worker's timer wheel times the connection out. The
+ * receive buffer is only allocated once data arrives. The connection is allocated from the
+ * calling thread's slab cache, so it must be closed by that thread (or after it has exited).
+ *
+ * @param fd The file descriptor of the accepted connection.
+ * @return On success, pointer to a connection struct is returned. On failure, `NULL` is returned.
+ */
+connection *create_connection(const int);
+
+/**
+ * @brief Reads all available data from the connection into its receive buffer.
+ *
+ * Reads from the non-blocking socket until `recv()` would block, then parses the new data with
+ * `connection::parser`. If the receive buffer contains a complete request head (terminated by an
+ * empty line), `connection::head_len` is set, `connection::body` is initialized from the framing
+ * headers and the connection moves to `CONN_HANDLING`. A full buffer with an incomplete head is
+ * grown up to `connection::recv_max` bytes. If the request head is malformed, its body framing is
+ * invalid or the head doesn't fit in `connection::recv_max` bytes,
+ * `connection::error_status` is set and the connection moves to `CONN_HANDLING` as well, so the
+ * handler can send an error response. If the peer closed the connection before sending a complete
+ * request head or an error occurs, the connection moves to `CONN_CLOSING`. Otherwise it stays in
+ * `CONN_READING`.
+ *
+ * @param conn The connection to read from.
+ * @return The new state of the connection.
+ */
+conn_state read_connection(connection *);
+
+/**
+ * @brief Appends data received from the socket by the caller (e.g. into a buffer of an io_uring
+ * ring) to the receive buffer and parses it like `read_connection()`.
+ *
+ * All the data is kept, the buffer grows past `connection::recv_max` if the data after a complete
+ * request head doesn't fit. A head that is still incomplete once `connection::recv_max` bytes
+ * arrived sets `connection::error_status` to `431`.
+ *
+ * @param conn The connection, in `CONN_READING`.
+ * @param buf The received data.
+ * @param len Length of `buf`, `0` if the peer closed the connection.
+ * @return The new state of the connection.
+ */
+conn_state receive_connection_data(connection *, const char *, const size_t);
+
+/**
+ * @brief Reads the next part of the request body, without copying it.
+ *
+ * Body bytes already in the receive buffer are returned first, then the space after the request
+ * head is reused to receive the rest of the body, so the request keeps pointing to a valid head.
+ * The chunk framing of a `chunked` body is skipped. The socket is never waited for: once the
+ * received bytes are used up, `-1` is returned with `errno` set to `EAGAIN` and the caller reads
+ * again after the worker saw the socket readable.
+ *
+ * Reading fails once the body took more than `request_body_timeout` seconds since the head was
+ * complete, the worker's timer closes the connection at that point as well.
+ *
+ * @param conn The connection, in `CONN_HANDLING` or `CONN_WRITING`.
+ * @param data Set to the body bytes in the receive buffer, valid until the next call.
+ * @return The number of bytes at `data`, `0` once the body is complete (or if the request has no
+ * body) and `-1` if the rest of the body hasn't arrived yet (`errno` is `EAGAIN`), the body is
+ * malformed or the connection failed before it was complete.
+ */
+ssize_t read_connection_body(connection *, const char **);
+
+/**
+ * @brief Drops the received part of the request body and marks the rest to be dropped as it
+ * arrives, so the next request on the connection can be found.
+ *
+ * The handler doesn't wait for the rest of the body, the worker drops it once the request is
+ * handled (calling this function again whenever the socket is readable) and reads the next request
+ * after it. A `Content-Length` body longer than `max_len` is not read at all.
+ *
+ * @param conn The connection, in `CONN_HANDLING` or `CONN_WRITING`.
+ * @param max_len Max length (in bytes) of the body.
+ * @return On success, returns `1`, whether the body is complete or not
+ * (`connection::body` tells). If the request has no body left, returns `2`. If the body is longer
+ * than `max_len` or couldn't be read, returns `0`.
+ */
+int discard_connection_body(connection *, const uint64_t);
+
+/**
+ * @brief Discards the handled request head and moves to the next request on the connection.
+ *
+ * The request head and body are removed from the receive buffer and `connection::arena` is reset,
+ * which releases the request and response of the handled exchange. Pipelined requests may already
+ * be in the buffer, if another complete or malformed request head is found the connection moves
+ * to `CONN_HANDLING` (with `connection::error_status` set if it is malformed), otherwise it moves
+ * to `CONN_READING` to wait for more data and the empty buffer is freed. If the body
+ * wasn't read completely, the next request can't be found and the connection moves to
+ * `CONN_CLOSING`.
+ *
+ * @param conn The connection.
+ * @return The new state of the connection.
+ */
+conn_state next_connection_request(connection *);
+
+/**
+ * @brief Loads a complete request received on another transport (e.g. an HTTP/2 stream) into the
+ * receive buffer, as if it had been read from the socket.
+ *
+ * The buffer must hold the request head and its whole body, the buffer grows to fit it. The head
+ * is parsed like a head read with `read_connection()` and `connection::error_status` is set to
+ * `400` if it is malformed.
+ *
+ * @param conn The connection, without buffered data.
+ * @param buf The request head and body.
+ * @param len Length of `buf`.
+ * @return `CONN_HANDLING`, or `CONN_CLOSING` if the buffer couldn't be allocated.
+ */
+conn_state load_connection_request(connection *, const char *, const size_t);
+
+/**
+ * @brief Writes the buffers to the non-blocking socket and queues the bytes it didn't take.
+ *
+ * Nothing is written while earlier output is still queued, it would be sent out of order. The
+ * queued bytes are copied, and sent by `flush_connection()`. The bytes written are counted as
+ * `METRICS_BYTES_SENT`.
+ *
+ * @param conn The connection.
+ * @param iov The buffers.
+ * @param iov_len Number of buffers in `iov`.
+ * @param flags Flags of the first send, e.g. `MSG_MORE` if more output follows.
+ * @return On success, returns the total length of the buffers. If the connection failed, returns
+ * `-1`.
+ */
+ssize_t write_connection(connection *, const struct iovec *, const int, const int);
+
+/**
+ * @brief Writes the buffers like `write_connection()`, but queues the rest of the last buffer
+ * without copying it.
+ *
+ * The last buffer must stay valid until `release(arg)` is called, which happens once it is sent,
+ * when the connection is closed or if the write fails.
+ *
+ * @param conn The connection.
+ * @param iov The buffers.
+ * @param iov_len Number of buffers in `iov`, at least `1`.
+ * @param flags Flags of the first send.
+ * @param release Releases the last buffer.
+ * @param arg The argument of `release`.
+ * @return On success, returns the total length of the buffers. If the connection failed, returns
+ * `-1`.
+ */
+ssize_t write_connection_held(connection *, const struct iovec *, const int, const int,
+                              conn_output_release, void *);
+
+/**
+ * @brief Writes `count` bytes of a file, from `offset`, after the output queued before.
+ *
+ * Plain sockets (and kTLS ones) are written with `sendfile()`, the others from chunks of
+ * `CONN_OUTPUT_CHUNK_SIZE` bytes read with `pread()`. If the socket doesn't take the whole range,
+ * the rest is queued with a duplicate of `file_fd`, so the caller can close it.
+ *
+ * @param conn The connection.
+ * @param file_fd The file.
+ * @param offset Offset of the first byte to send.
+ * @param count Number of bytes to send.
+ * @return On success, returns `count`. If the connection failed or the file couldn't be read,
+ * returns `-1`.
+ */
+ssize_t write_connection_file(connection *, const int, off_t, const size_t);
+
+/**
+ * @brief Sends the queued output until the socket would block.
+ *
+ * `connection::last_active` is updated whenever some of it is sent.
+ *
+ * @param conn The connection.
+ * @return If all the output is sent, returns `1`. If the socket would block, returns `2`. If the
+ * connection failed, returns `0`.
+ */
+int flush_connection(connection *);
+
+/**
+ * @brief Sets the connection the calling thread handles a request of, so the responses sent to its
+ * socket are written with `write_connection()`.
+ *
+ * @param conn The connection, `NULL` once the request is handled.
+ * @return void
+ */
+void set_active_connection(connection *);
+
+/**
+ * @brief Returns the connection of `fd` set with `set_active_connection()` by the calling thread.
+ *
+ * HTTP/2 connections are not returned, their responses are framed by their session.
+ *
+ * @param fd The file descriptor of the connection.
+ * @return The connection, or `NULL` if the calling thread handles no request of an HTTP/1.x
+ * connection of `fd`.
+ */
+connection *get_active_connection(const int);
+
+/**
+ * @brief Switches the connection socket between blocking and non-blocking mode.
+ *
+ * If the socket is switched, the function returns `1`. If the socket is already in the mode, the
+ * function returns `2` without any system call. On failure, returns `0`.
+ *
+ * @param conn The connection.
+ * @param blocking `1` to switch to blocking mode, `0` to switch to non-blocking mode.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int set_connection_blocking(connection *, const int);
+
+/**
+ * @brief Closes the connection socket and frees the connection struct and its arena.
+ *
+ * The TLS session of the socket, if any, is ended first and the output still queued is dropped.
+ * Closing the socket also removes it from any epoll instance. If a `NULL` pointer is passed to
+ * this function, function does nothing.
+ *
+ * @param conn The connection to be closed and freed.
+ * @return void
+ */
+void close_connection(connection *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Returns the current monotonic time in seconds.
+ *
+ * @return Current monotonic time in seconds.
+ */
+time_t _connection_now();
+
+/**
+ * @private
+ * @brief Parses the data in the receive buffer that was not parsed yet and updates
+ * `connection::head_len`.
+ *
+ * @param conn The connection.
+ * @return The result of `parse_http_request()`.
+ */
+http_parse_result _find_request_head(connection *);
+
+/**
+ * @private
+ * @brief Reads from the non-blocking socket into the receive buffer until `recv()` would block or
+ * the buffer is full.
+ *
+ * @param conn The connection, with a receive buffer.
+ * @param peer_closed Set to `true` if the peer closed the connection.
+ * @return On success, returns `1`. If an error occurs, returns `0`.
+ */
+int _recv_connection(connection *, bool *);
+
+/**
+ * @private
+ * @brief Allocates a receive buffer of `REQ_BUF_SIZE` bytes from the slab cache of the calling
+ * thread.
+ *
+ * @param conn The connection, without a receive buffer.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _acquire_recv_buf(connection *);
+
+/**
+ * @private
+ * @brief Frees the receive buffer, back to the slab pool it was allocated from.
+ *
+ * @param conn The connection.
+ * @return void
+ */
+void _release_recv_buf(connection *);
+
+/**
+ * @private
+ * @brief Doubles the size of the receive buffer, up to `connection::recv_max` bytes.
+ *
+ * @param conn The connection, with a receive buffer.
+ * @return On success, returns `1`. If the buffer is already `connection::recv_max` bytes or on
+ * failure, returns `0`.
+ */
+int _grow_recv_buf(connection *);
+
+/**
+ * @private
+ * @brief Writes the buffers to the socket once, without blocking.
+ *
+ * @param conn The connection.
+ * @param iov The buffers.
+ * @param iov_len Number of buffers in `iov`.
+ * @param flags Flags of the send.
+ * @return The number of bytes written (`0` if the socket would block), or `-1` if the connection
+ * failed.
+ */
+ssize_t _send_connection_iov(connection *, const struct iovec *, int, const int);
+
+/**
+ * @private
+ * @brief Sends a queued buffer until it is sent or the socket would block.
+ *
+ * @param conn The connection.
+ * @param output The buffer, at the head of the queue.
+ * @param flags Flags of the send.
+ * @return If the buffer is sent, returns `1`. If the socket would block, returns `2`. If the
+ * connection failed, returns `0`.
+ */
+int _send_connection_buffer(connection *, conn_output *, const int);
+
+/**
+ * @private
+ * @brief Sends a file range with `sendfile()` until it is sent or the socket would block.
+ *
+ * @param conn The connection.
+ * @param file_fd The file.
+ * @param offset Offset of the next byte to send, moved past the bytes sent.
+ * @param len Number of bytes left to send, reduced by the bytes sent.
+ * @return If the range is sent, returns `1`. If the socket would block, returns `2`. If the
+ * connection failed or `sendfile()` can't send the file (`errno` is `EINVAL` or `ENOSYS`), returns
+ * `0`.
+ */
+int _send_connection_file(connection *, const int, off_t *, size_t *);
+
+/**
+ * @private
+ * @brief Reads the next chunk of a queued file range into a buffer queued in front of it, the
+ * last chunk replaces the range.
+ *
+ * OpenSSL must be retried with the same bytes after a write would block, so a chunk is read only
+ * once and stays queued until it is sent.
+ *
+ * @param conn The connection.
+ * @param output The file range, at the head of the queue.
+ * @return On success, returns `1`. If the file couldn't be read, returns `0`.
+ */
+int _read_connection_file(connection *, conn_output *);
+
+/**
+ * @private
+ * @brief Allocates a queue part from the slab cache of the calling thread.
+ *
+ * @param buf_size Size of `conn_output::buf`, `0` for a held buffer or a file range.
+ * @return On success, pointer to the part is returned. On failure, `NULL` is returned.
+ */
+conn_output *_create_connection_output(const size_t);
+
+/**
+ * @private
+ * @brief Appends a part to the output queue of the connection.
+ *
+ * @param conn The connection.
+ * @param output The part.
+ * @return void
+ */
+void _queue_connection_output(connection *, conn_output *);
+
+/**
+ * @private
+ * @brief Releases what a part refers to (its held buffer or its file) and frees it.
+ *
+ * @param output The part.
+ * @return void
+ */
+void _free_connection_output(conn_output *);
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file include/encoding.h
+ * @brief Function Prototypes for negotiating and applying content codings.
+ *
+ * This file contains the content coding definitions and function prototypes to parse the
+ * `Accept-Encoding` request header, select the coding of a response, find precompressed siblings
+ * of a file (e.g. `style.css.br` for `style.css`) and compress response bodies with gzip.
+ *
+ * Implemented in slib/encoding.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _ENCODING_H
+#define _ENCODING_H 1
+
+/**
+ * @brief Defines the default gzip compression level, used when the level is out of range.
+ */
+#ifndef DEFAULT_GZIP_LEVEL
+#define DEFAULT_GZIP_LEVEL 6
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Defines the content codings, each one is a bit so a set of codings can be stored in an
+ * `unsigned int`.
+ *
+ *     - `CONTENT_ENCODING_IDENTITY`: No coding, the file is sent as is.
+ *     - `CONTENT_ENCODING_GZIP`: gzip, from a `.gz` sibling or compressed by the server.
+ *     - `CONTENT_ENCODING_BR`: Brotli, from a `.br` sibling.
+ *     - `CONTENT_ENCODING_ZSTD`: Zstandard, from a `.zst` sibling.
+ */
+typedef enum content_encoding {
+    CONTENT_ENCODING_IDENTITY = 0,
+    CONTENT_ENCODING_GZIP = 1 << 0,
+    CONTENT_ENCODING_BR = 1 << 1,
+    CONTENT_ENCODING_ZSTD = 1 << 2,
+} content_encoding;
+
+/**
+ * @brief Parses the value of an `Accept-Encoding` request header.
+ *
+ * Codings with a `q` value of `0` are not accepted. `*` accepts all the codings that are not
+ * listed explicitly. Unknown codings are ignored.
+ *
+ * @param accept_encoding The header value, can be `NULL`.
+ * @return The set of accepted codings.
+ */
+unsigned int parse_accept_encoding(const char *);
+
+/**
+ * @brief Selects the coding of a response from the accepted and available codings.
+ *
+ * Codings are preferred in the order Brotli, Zstandard, gzip, which is also the order of their
+ * compression ratio for text. The client's `q` values are not used to order the codings.
+ *
+ * @param accepted The set of codings accepted by the client.
+ * @param available The set of codings the file is available in.
+ * @return The selected coding, `CONTENT_ENCODING_IDENTITY` if none is both accepted and available.
+ */
+content_encoding select_content_encoding(const unsigned int, const unsigned int);
+
+/**
+ * @brief Gets the name of a coding, used as the value of the `content-encoding` header.
+ *
+ * @param encoding The coding.
+ * @return The name of the coding, `NULL` for `CONTENT_ENCODING_IDENTITY`.
+ */
+const char *get_content_encoding_name(const content_encoding);
+
+/**
+ * @brief Gets the file name suffix of the precompressed siblings of a coding (e.g. `.br`).
+ *
+ * @param encoding The coding.
+ * @return The suffix, `NULL` for `CONTENT_ENCODING_IDENTITY`.
+ */
+const char *get_content_encoding_suffix(const content_encoding);
+
+/**
+ * @brief Gets the coding of a precompressed file from the suffix of its path.
+ *
+ * @param path Path of the file.
+ * @return The coding, `CONTENT_ENCODING_IDENTITY` if the path doesn't end with a known suffix.
+ */
+content_encoding get_precompressed_file_encoding(const char *);
+
+/**
+ * @brief Finds the precompressed siblings of a file, i.e. regular files named `path` followed by
+ * the suffix of a coding.
+ *
+ * @param path Path of the file.
+ * @return The set of codings a sibling exists for.
+ */
+unsigned int find_precompressed_files(const char *);
+
+/**
+ * @brief Checks if responses of a MIME type are worth compressing.
+ *
+ * Text types (`text/\*`), JavaScript, JSON, XML, SVG, WebAssembly and icons are compressible.
+ * Other images, audio, video, fonts and archives are already compressed.
+ *
+ * @param mimetype The MIME type, without parameters.
+ * @return `true` if the MIME type is compressible, `false` otherwise.
+ */
+bool is_mimetype_compressible(const char *);
+
+/**
+ * @brief Compresses `buf` into a newly allocated gzip stream.
+ *
+ * @param buf The buffer to be compressed.
+ * @param buf_size The number of bytes of `buf` to be compressed.
+ * @param level The compression level, `1` to `9`, `DEFAULT_GZIP_LEVEL` if out of range.
+ * @param compressed_size Pointer to store the size of the compressed buffer in.
+ * @return On success, returns the compressed buffer, which must be freed with `free()`. On failure,
+ * returns `NULL`.
+ */
+char *compress_gzip(const char *, const size_t, int, size_t *);
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file include/fdcache.h
+ * @brief Function Prototypes for the open file descriptor cache of the website root directory.
+ *
+ * This file contains the cache entry structure and function prototypes to resolve URLs to paths
+ * under the website root directory and to open them. The root directory is opened once and every
+ * file is opened relative to it with `openat2()` and `RESOLVE_BENEATH`, so neither `..` nor a
+ * symbolic link can lead a request out of the root directory. Opened files are kept open along
+ * with their `stat` info for a few seconds, so the files that aren't in the in-memory file cache
+ * are served without resolving their path or calling `fstat()` again.
+ *
+ * Entries are only invalidated when their time to live expires, a file that is replaced or changed
+ * is served from the old file descriptor and `stat` info until then.
+ *
+ * Implemented in slib/fdcache.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _FDCACHE_H
+#define _FDCACHE_H 1
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+/**
+ * @struct fd_cache_entry
+ * @brief Defines an open file, which may be cached.
+ *
+ * Entries are reference counted. The cache holds one reference for as long as the entry is
+ * cached, and every `open_fd_cache_entry()` returns an additional reference that must be released
+ * with `release_fd_cache_entry()`. Entries that aren't cached are closed and freed once they are
+ * released. The file descriptor is shared by all the users of the entry, so the file must only be
+ * read at an offset (e.g. with `pread()` or `sendfile()`).
+ *
+ * @property char* fd_cache_entry::path
+ * @brief Path of the file relative to the root directory, used as the key of the cache.
+ *
+ * @property int fd_cache_entry::fd
+ * @brief File descriptor of the file, opened for reading.
+ *
+ * @property struct stat fd_cache_entry::file_stat
+ * @brief The `stat` info of the file when it was opened.
+ *
+ * @property long fd_cache_entry::expires_at
+ * @brief Monotonic time (in seconds) the entry expires at.
+ *
+ * @property atomic_int fd_cache_entry::refs
+ * @brief Reference count of the entry.
+ */
+typedef struct fd_cache_entry {
+    char *path;
+    int fd;
+    struct stat file_stat;
+    long expires_at;
+    atomic_int refs;
+} fd_cache_entry;
+
+/**
+ * @brief Opens the website root directory `root_dir` and creates the cache of the files under it.
+ *
+ * The root directory stays open until `destroy_fd_cache()`, even if `max_entries` is `0` and no
+ * file is cached. If the cache is full, expired entries are removed, and if none has expired, new
+ * files are opened without caching them.
+ *
+ * If the cache is created successfully, the function returns `1`. If the cache is already created,
+ * the function returns `2` without performing any action. On failure (e.g. `root_dir` is not a
+ * directory), returns `0`.
+ *
+ * @param root_dir The website root directory.
+ * @param max_entries Max number of cached files, `0` to not cache files.
+ * @param ttl Time to live (in seconds) of a cache entry.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_fd_cache(const char *, const unsigned int, const int);
+
+/**
+ * @brief Releases the cache's reference to all the entries and closes the root directory.
+ *
+ * If `destroy_fd_cache()` is called before `create_fd_cache()`, it does nothing.
+ *
+ * @return void
+ */
+void destroy_fd_cache();
+
+/**
+ * @brief Removes all the entries from the cache.
+ *
+ * @return void
+ */
+void clear_fd_cache();
+
+/**
+ * @brief Resolves the URL path `url` to a canonical path relative to the root directory.
+ *
+ * Empty segments and `.` segments are removed and every `..` segment removes the segment before it,
+ * so `/a//b/./../c` resolves to `a/c`. The resolved path never starts or ends with `/`, the root
+ * directory itself resolves to an empty path.
+ *
+ * @param url The URL path, starting with `/`.
+ * @param rel_path Buffer the resolved path is stored in.
+ * @param size Size of `rel_path`.
+ * @return On success, returns `1`. If a `..` segment leads out of the root directory or the
+ * resolved path doesn't fit in `rel_path`, returns `0`.
+ */
+int resolve_site_path(const char *, char *, const size_t);
+
+/**
+ * @brief Opens the regular file `rel_path` under the website root directory `root_dir`.
+ *
+ * Cached entries that haven't expired are returned without touching the filesystem. Otherwise,
+ * the file is opened relative to the root directory with `openat2()` and `RESOLVE_BENEATH`, which
+ * falls back to `openat()` on kernels without `openat2()`, and the time it takes is observed as
+ * `METRICS_FILE_OPEN`. Files are only cached if `root_dir` is the directory the cache was created
+ * for; other directories (e.g. after a config reload) are opened for every file.
+ *
+ * @param root_dir The website root directory, usually `server_config::site_root_dir`.
+ * @param rel_path Path of the file, resolved by `resolve_site_path()`.
+ * @return On success, returns the entry, which must be released with `release_fd_cache_entry()`.
+ * On failure, returns `NULL` and sets `errno`. Directories fail with `EISDIR`, other files that
+ * aren't regular files with `ENOENT` and paths that lead out of the root directory with `EXDEV`.
+ */
+fd_cache_entry *open_fd_cache_entry(const char *, const char *);
+
+/**
+ * @brief Opens the directory `rel_path` under the website root directory `root_dir` for reading
+ * its entries.
+ *
+ * The directory is opened like the files of `open_fd_cache_entry()`, without leaving the root
+ * directory, but it is never cached.
+ *
+ * @param root_dir The website root directory, usually `server_config::site_root_dir`.
+ * @param rel_path Path of the directory, resolved by `resolve_site_path()`. An empty path opens
+ * the root directory.
+ * @param dir_stat Buffer the `fstat()` of the directory is stored in.
+ * @return On success, returns the file descriptor of the directory, which must be closed by the
+ * caller. On failure, returns `-1` and sets `errno`. Paths that aren't directories fail with
+ * `ENOTDIR`.
+ */
+int open_site_directory(const char *, const char *, struct stat *);
+
+/**
+ * @brief Releases a reference to the entry returned by `open_fd_cache_entry()`.
+ *
+ * The file is closed and the entry freed once it is removed from the cache (or was never cached)
+ * and its last reference is released.
+ *
+ * @param entry The entry to be released.
+ * @return void
+ */
+void release_fd_cache_entry(fd_cache_entry *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Looks up the cache entry for `rel_path`, removing it if it has expired.
+ *
+ * @param rel_path Path of the file relative to the root directory.
+ * @return On a hit, returns a new reference to the entry. On a miss, returns `NULL`.
+ */
+fd_cache_entry *_get_fd_cache_entry(const char *);
+
+/**
+ * @private
+ * @brief Adds `entry` to the cache, removing the expired entries if the cache is full.
+ *
+ * If an entry for the same path was added in the meantime, it is replaced.
+ *
+ * @param entry The entry, which gets the cache's reference if it is added.
+ * @return void
+ */
+void _add_fd_cache_entry(fd_cache_entry *);
+
+/**
+ * @private
+ * @brief Removes the expired entries from the cache. Must be called with the write lock held.
+ *
+ * @param now The current monotonic time (in seconds).
+ * @return void
+ */
+void _remove_expired_fd_cache_entries(const long);
+
+/**
+ * @private
+ * @brief Opens `rel_path` relative to the directory `dir_fd`, without leaving the directory.
+ *
+ * The file is opened with `O_NONBLOCK`, so a FIFO doesn't block the calling worker until a writer
+ * opens it. The caller checks the type of the file.
+ *
+ * @param dir_fd File descriptor of the directory.
+ * @param rel_path Path of the file relative to the directory.
+ * @return On success, returns the file descriptor. On failure, returns `-1` and sets `errno`.
+ */
+int _open_beneath(const int, const char *);
+
+/**
+ * @private
+ * @brief Opens and `fstat()`s the regular file `rel_path` relative to `dir_fd` into a new entry
+ * that isn't cached.
+ *
+ * @param dir_fd File descriptor of the directory.
+ * @param rel_path Path of the file relative to the directory.
+ * @return On success, returns the entry with one reference. On failure, returns `NULL` and sets
+ * `errno`.
+ */
+fd_cache_entry *_create_fd_cache_entry(const int, const char *);
+
+/**
+ * @private
+ * @brief Gets the monotonic time in seconds, the clock entries expire with.
+ *
+ * @return The monotonic time in seconds.
+ */
+long _fd_cache_now();
+#endif
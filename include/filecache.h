@@ -0,0 +1,429 @@
+/**
+ * @file include/filecache.h
+ * @brief Function Prototypes for the in-memory static file cache.
+ *
+ * This file contains the cache entry structure and function prototypes to create, query, fill and
+ * destroy a size-bounded cache of whole files. Each entry holds the file body and the
+ * pre-serialized response headers for it, so a cache hit is served from memory with a single
+ * `sendmsg()` call and without touching the filesystem. Compressible files can also hold a gzip
+ * compressed copy, which is compressed once when the file is cached.
+ *
+ * Implemented in slib/filecache.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _FILECACHE_H
+#define _FILECACHE_H 1
+
+/**
+ * @brief Defines the interval (in seconds) after which a cache entry is validated with `stat()`,
+ * used only when `inotify` is not available.
+ */
+#ifndef FILE_CACHE_CHECK_INTERVAL
+#define FILE_CACHE_CHECK_INTERVAL 1
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <glib.h>
+
+#include "encoding.h"
+#include "helpers.h"
+#include "response.h"
+
+/**
+ * @brief Defines the flags of how cached file bodies are held in memory.
+ *
+ *     - `FILE_CACHE_MAP_FILES`: Bodies are mapped from the files with `mmap()` (`MAP_SHARED`,
+ *       `MAP_POPULATE`) instead of being read into buffers of their own, so all the workers and the
+ *       page cache share one copy of every file. The files must not be edited in place: reading
+ *       the mapping of a truncated file (OpenSSL without kTLS, HTTP/2 frames, gzip copies) raises
+ *       `SIGBUS`, which kills the server, and queued responses hold their entries past the
+ *       invalidation. An edited file is also served with the `ETag` and `Content-Length` of its
+ *       old contents until it is invalidated.
+ *     - `FILE_CACHE_MAP_HUGE_PAGES`: Mappings are advised with `MADV_HUGEPAGE`, so a file of at
+ *       least a huge page can be mapped with huge pages if the filesystem supports them.
+ */
+typedef enum file_cache_map_flag {
+    FILE_CACHE_MAP_FILES = 1,
+    FILE_CACHE_MAP_HUGE_PAGES = 2,
+} file_cache_map_flag;
+
+/**
+ * @struct file_cache_entry
+ * @brief Defines a file cache entry.
+ *
+ * Entries are reference counted. The cache holds one reference for as long as the entry is
+ * cached, and every successful `get_file_cache_entry()` or `add_file_cache_entry()` returns an
+ * additional reference that must be released with `release_file_cache_entry()`. Therefore, an
+ * entry that is evicted while it is being sent stays valid until it is released.
+ *
+ * @property char* file_cache_entry::path
+ * @brief Path of the cached file, used as the key of the cache.
+ *
+ * @property char* file_cache_entry::headers
+ * @brief Pre-serialized response headers (e.g. `content-type`, `content-length`, `etag`),
+ * formatted as `<key>: <value>\r\n` lines.
+ *
+ * @property size_t file_cache_entry::headers_len
+ * @brief Length of `headers`.
+ *
+ * @property char* file_cache_entry::body
+ * @brief Contents of the cached file.
+ *
+ * @property bool file_cache_entry::is_mapped
+ * @brief Whether `body` is a mapping of the file (see `FILE_CACHE_MAP_FILES`), unmapped with
+ * `munmap()` instead of freed.
+ *
+ * @property size_t file_cache_entry::body_len
+ * @brief Length of `body`.
+ *
+ * @property struct stat file_cache_entry::file_stat
+ * @brief The `stat` info of the file when it was cached.
+ *
+ * @property unsigned int file_cache_entry::encodings
+ * @brief Set of codings (`content_encoding`) the file had precompressed siblings for when it was
+ * cached. The siblings are cached as entries of their own.
+ *
+ * @property file_cache_entry* file_cache_entry::gzip
+ * @brief gzip compressed copy of the file, with its own headers, body and entity tag. `NULL` if the
+ * file isn't compressed. It isn't in the hash table and is freed with the entry, so a reference
+ * to the entry keeps it valid.
+ *
+ * @property char file_cache_entry::etag
+ * @brief Entity tag of the cached file, formatted by `format_etag()`.
+ *
+ * @property char file_cache_entry::last_modified
+ * @brief Modification time of the cached file, formatted by `format_http_date()`.
+ *
+ * @property atomic_int file_cache_entry::refs
+ * @brief Reference count of the entry.
+ *
+ * @property atomic_bool file_cache_entry::referenced
+ * @brief Set on every hit and cleared by the CLOCK eviction hand.
+ *
+ * @property atomic_long file_cache_entry::checked_at
+ * @brief Monotonic time (in seconds) of the last `stat()` validation.
+ *
+ * @property file_cache_entry* file_cache_entry::prev
+ * @brief Previous entry in the CLOCK ring.
+ *
+ * @property file_cache_entry* file_cache_entry::next
+ * @brief Next entry in the CLOCK ring.
+ */
+typedef struct file_cache_entry {
+    char *path;
+    char *headers;
+    size_t headers_len;
+    char *body;
+    bool is_mapped;
+    size_t body_len;
+    struct stat file_stat;
+    unsigned int encodings;
+    struct file_cache_entry *gzip;
+    char etag[ETAG_BUF_SIZE];
+    char last_modified[HTTP_DATE_BUF_SIZE];
+    atomic_int refs;
+    atomic_bool referenced;
+    atomic_long checked_at;
+    struct file_cache_entry *prev;
+    struct file_cache_entry *next;
+} file_cache_entry;
+
+/**
+ * @brief Creates the file cache for files under `root_dir`.
+ *
+ * The cache holds at most `max_entries` files and `max_size` bytes of file bodies, files larger
+ * than `max_file_size` bytes are never cached. When the cache is full, entries are evicted with the
+ * CLOCK algorithm (an approximation of LRU that doesn't need a lock to record a hit).
+ *
+ * Entries are invalidated by an `inotify` watch on `root_dir` and all of its sub-directories, run
+ * on a background thread. If `inotify` is not available, entries are validated with `stat()` at
+ * most once every `FILE_CACHE_CHECK_INTERVAL` seconds instead.
+ *
+ * File bodies are read into memory, or mapped from the files if `map_flags` has
+ * `FILE_CACHE_MAP_FILES`.
+ *
+ * If the cache is created successfully, the function returns `1`. If the cache is already created,
+ * the function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param root_dir The directory the cached files are in.
+ * @param max_size Max total size (in bytes) of cached file bodies.
+ * @param max_file_size Max size (in bytes) of a single cached file.
+ * @param max_entries Max number of cached files.
+ * @param map_flags Set of `file_cache_map_flag` flags, `0` to read the files into memory.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_file_cache(const char *, const size_t, const size_t, const unsigned int,
+                      const unsigned int);
+
+/**
+ * @brief Destroys the file cache, stops the `inotify` thread and releases the cache's reference
+ * to all the entries.
+ *
+ * If `destroy_file_cache()` is called before `create_file_cache()`, it does nothing.
+ *
+ * @return void
+ */
+void destroy_file_cache();
+
+/**
+ * @brief Removes all the entries from the file cache.
+ *
+ * @return void
+ */
+void clear_file_cache();
+
+/**
+ * @brief Returns `1` if a file with the given size can be cached, `0` otherwise.
+ *
+ * @param size Size of the file in bytes.
+ * @return `1` if the cache is created and the file is not too large, `0` otherwise.
+ */
+int is_file_cacheable(const off_t);
+
+/**
+ * @brief Looks up the cache entry for `path`.
+ *
+ * On a hit, the entry is marked as recently used and a new reference to it is returned.
+ *
+ * @param path Path of the file.
+ * @return On a hit, returns the entry, which must be released with `release_file_cache_entry()`.
+ * On a miss, returns `NULL`.
+ */
+file_cache_entry *get_file_cache_entry(const char *);
+
+/**
+ * @brief Reads (or maps, see `FILE_CACHE_MAP_FILES`) the file `file_fd` into memory and adds it to
+ * the cache as `path`.
+ *
+ * The response headers set in `res` are serialized with `serialize_response_headers()` and stored
+ * with the entry, along with `content-length`, `etag` and `last-modified` headers. Connection
+ * specific headers (e.g. `connection`) must not be set in `res`, since the stored headers are sent
+ * for every hit. Entries are evicted until the new entry fits in the cache.
+ *
+ * If `gzip_level` is not `0` and the file has no gzip sibling, the file is compressed with
+ * `compress_gzip()` and the compressed copy is stored in `file_cache_entry::gzip` if it is smaller
+ * than the file. Its headers add `content-encoding: gzip` and its entity tag ends with `-gz`.
+ *
+ * @param path Path of the file, used as the key of the cache.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param file_stat The `stat` info of the file.
+ * @param res Response with the headers to be cached.
+ * @param encodings Set of codings the file has precompressed siblings for.
+ * @param gzip_level gzip compression level of the compressed copy, `0` to not compress the file.
+ * @return On success, returns the new entry, which must be released with
+ * `release_file_cache_entry()`. If the file can't be cached, returns `NULL`.
+ */
+file_cache_entry *add_file_cache_entry(const char *, const int, const struct stat *,
+                                       const response *, const unsigned int, const int);
+
+/**
+ * @brief Copies the generated response body `body` into the cache as `path`, e.g. a directory
+ * listing.
+ *
+ * The entry is cached like a file by `add_file_cache_entry()`, but its entity tag is derived from
+ * `body` instead of `file_stat`, since the body can change without `file_stat` changing.
+ * `file_stat` is the `stat` info of the file the body is generated from (e.g. the directory),
+ * which the entry is validated against if `inotify` is not available. The `last-modified` header
+ * is formatted from its `st_mtime`.
+ *
+ * @param path Key of the entry in the cache.
+ * @param body The response body.
+ * @param body_len Length of `body`.
+ * @param file_stat The `stat` info the body is generated from.
+ * @param res Response with the headers to be cached.
+ * @param gzip_level gzip compression level of the compressed copy, `0` to not compress the body.
+ * @return On success, returns the new entry, which must be released with
+ * `release_file_cache_entry()`. If the body can't be cached, returns `NULL`.
+ */
+file_cache_entry *add_file_cache_buffer(const char *, const char *, const size_t,
+                                        const struct stat *, const response *, const int);
+
+/**
+ * @brief Gets the set of codings `entry` can be sent in, the codings of its precompressed siblings
+ * and gzip if it has a compressed copy.
+ *
+ * @param entry The entry.
+ * @return The set of codings, not including `CONTENT_ENCODING_IDENTITY`.
+ */
+unsigned int get_file_cache_entry_encodings(const file_cache_entry *);
+
+/**
+ * @brief Gets the entry to be sent for `entry` in the coding `encoding`.
+ *
+ * For `CONTENT_ENCODING_IDENTITY` the entry itself is returned, for gzip its compressed copy if it
+ * has one. Otherwise, the entry of the precompressed sibling (`file_cache_entry::path` followed by
+ * the suffix of the coding) is looked up with `get_file_cache_entry()`.
+ *
+ * @param entry The entry of the uncompressed file.
+ * @param encoding The coding, usually selected by `select_content_encoding()`.
+ * @return A new reference to the entry to be sent, which must be released with
+ * `release_file_cache_entry()`. If the sibling is not cached, returns `NULL`.
+ */
+file_cache_entry *get_file_cache_entry_variant(file_cache_entry *, const content_encoding);
+
+/**
+ * @brief Releases a reference to the entry returned by `get_file_cache_entry()` or
+ * `add_file_cache_entry()`.
+ *
+ * The entry is freed once it is evicted and its last reference is released.
+ *
+ * @param entry The entry to be released.
+ * @return void
+ */
+void release_file_cache_entry(file_cache_entry *);
+
+/**
+ * @brief Removes the cache entry for `path`, if there is one.
+ *
+ * @param path Path of the file.
+ * @return void
+ */
+void invalidate_file_cache_entry(const char *);
+
+/**
+ * @brief Sends the cached response for `entry` to the client with a single `sendmsg()` call.
+ *
+ * The response is sent as `status_line`, the cached headers, `headers` and the cached body.
+ * `headers` holds the connection specific headers and must end with the empty line that terminates
+ * the response head. The time the send takes is observed as `METRICS_SEND`. On the connection a
+ * worker handles a request of, the part of the body the socket doesn't take is queued without
+ * copying it, with a reference to `entry` that is released once the body is sent.
+ *
+ * @param conn_fd The file descriptor of the connection.
+ * @param entry The cache entry.
+ * @param status_line The response start line, including the trailing `\r\n`.
+ * @param headers Connection specific headers followed by an empty line.
+ * @param with_body Whether the body is sent, `false` for responses to `HEAD` requests.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`.
+ */
+ssize_t send_file_cache_entry(const int, const file_cache_entry *, const char *, const char *,
+                              const bool);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Releases the reference to a cache entry whose body was queued on a connection, passed to
+ * `write_connection_held()`.
+ *
+ * @param entry The entry.
+ * @return void
+ */
+void _release_file_cache_body(void *);
+
+/**
+ * @private
+ * @brief Removes `entry` from the hash table and the CLOCK ring and releases the cache's reference.
+ * Must be called with the cache write lock held.
+ *
+ * @param entry The entry to be removed.
+ * @return void
+ */
+void _remove_file_cache_entry(file_cache_entry *);
+
+/**
+ * @private
+ * @brief Maps `body_len` bytes of `file_fd` into `file_cache_entry::body`, with the advice of
+ * `_file_cache_map_flags`.
+ *
+ * @param entry The entry, with `body_len` set.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @return `1` if the file is mapped, `0` otherwise.
+ */
+int _map_file_cache_entry(file_cache_entry *, const int);
+
+/**
+ * @private
+ * @brief Serializes the headers of `entry`, creates its gzip compressed copy and adds it to the
+ * cache, replacing the entry with the same path.
+ *
+ * @param entry The new entry, with its path, body and validators set.
+ * @param res Response with the headers to be cached.
+ * @param gzip_level gzip compression level of the compressed copy, `0` to not compress the body.
+ * @return Returns `entry`, with a reference for the caller.
+ */
+file_cache_entry *_insert_file_cache_entry(file_cache_entry *, const response *, const int);
+
+/**
+ * @private
+ * @brief Creates the gzip compressed copy of `entry`.
+ *
+ * @param entry The entry, with its body and validators set.
+ * @param headers The serialized response headers shared by both copies.
+ * @param headers_len The length of `headers`.
+ * @param level The gzip compression level.
+ * @return On success, returns the compressed copy. If the file can't be compressed or doesn't get
+ * smaller, returns `NULL`.
+ */
+file_cache_entry *_compress_file_cache_entry(const file_cache_entry *, const char *, const size_t,
+                                             const int);
+
+/**
+ * @private
+ * @brief Returns the number of bytes `entry` takes up in the cache, its body and the body of its
+ * compressed copy.
+ *
+ * @param entry The entry.
+ * @return The size of the entry in bytes.
+ */
+size_t _get_file_cache_entry_size(const file_cache_entry *);
+
+/**
+ * @private
+ * @brief Evicts entries with the CLOCK algorithm until `size` more bytes and one more entry fit in
+ * the cache. Must be called with the cache write lock held.
+ *
+ * @param size Size (in bytes) of the entry to be added.
+ * @return void
+ */
+void _evict_file_cache_entries(const size_t);
+
+/**
+ * @private
+ * @brief Validates `entry` against the file on disk with `stat()`, used when `inotify` is not
+ * available.
+ *
+ * @param entry The entry to be validated.
+ * @return `1` if the cached file is unchanged, `0` otherwise.
+ */
+int _validate_file_cache_entry(file_cache_entry *);
+
+/**
+ * @private
+ * @brief Returns the current monotonic time in seconds.
+ *
+ * @return Current monotonic time in seconds.
+ */
+long _file_cache_now();
+
+/**
+ * @private
+ * @brief Adds `inotify` watches for `dir_path` and all its sub-directories.
+ *
+ * @param dir_path The directory to be watched.
+ * @return void
+ */
+void _add_file_cache_watch(const char *);
+
+/**
+ * @private
+ * @brief Loop of the `inotify` thread, invalidates entries for the files that changed and the
+ * listings of their directories (cached as the directory path followed by `/`).
+ *
+ * @param arg Unused.
+ * @return Always returns `NULL`.
+ */
+void *_file_cache_watch_loop(void *);
+#endif
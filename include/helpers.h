@@ -15,6 +15,24 @@
 #ifndef _HELPERS_H
 #define _HELPERS_H 1
 
+/**
+ * @brief Defines the max size of an entity tag formatted by `format_etag()`, including the quotes
+ * and the terminating `\0`.
+ */
+#ifndef ETAG_BUF_SIZE
+#define ETAG_BUF_SIZE 64
+#endif
+
+/**
+ * @brief Defines the max size of a date formatted by `format_http_date()`, including the
+ * terminating `\0`.
+ */
+#ifndef HTTP_DATE_BUF_SIZE
+#define HTTP_DATE_BUF_SIZE 32
+#endif
+
+#include <sys/stat.h>
+#include <time.h>
 #include <glib.h>
 
 /**
@@ -51,4 +69,36 @@ char *trim(char *);
  * @return void
  */
 void free_gerror(GError **);
+
+/**
+ * @brief Formats a strong entity tag for a file from its inode, size and modification time.
+ *
+ * The entity tag is formatted as `"<inode>-<size>-<mtime>"` with each value in hex. `etag` must be
+ * able to hold at least `ETAG_BUF_SIZE` bytes.
+ *
+ * @param file_stat The `stat` info of the file.
+ * @param etag Pointer to a string where the entity tag should be written.
+ * @return Returns `etag`.
+ */
+char *format_etag(const struct stat *, char *);
+
+/**
+ * @brief Formats a time as an HTTP date (IMF-fixdate, e.g. `Sun, 06 Nov 1994 08:49:37 GMT`).
+ *
+ * `date` must be able to hold at least `HTTP_DATE_BUF_SIZE` bytes.
+ *
+ * @param t The time.
+ * @param date Pointer to a string where the date should be written.
+ * @return Returns `date`.
+ */
+char *format_http_date(const time_t, char *);
+
+/**
+ * @brief Parses an HTTP date in any of the formats allowed by RFC 7231 (IMF-fixdate, RFC 850 and
+ * asctime).
+ *
+ * @param date The date.
+ * @return On success, returns the parsed time. On failure, returns `-1`.
+ */
+time_t parse_http_date(const char *);
 #endif
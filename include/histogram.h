@@ -0,0 +1,156 @@
+/**
+ * @file include/histogram.h
+ * @brief Function Prototypes for the log-linear latency histogram.
+ *
+ * This file contains the histogram structure and function prototypes to record values, merge
+ * histograms and read percentiles. The layout follows HdrHistogram: values below
+ * `2^HISTOGRAM_PRECISION_BITS` get a bucket each, larger values share buckets whose width doubles
+ * with every power of two, so a recorded value is off by less than `2^-(HISTOGRAM_PRECISION_BITS -
+ * 1)` of itself (under 1.6% by default) over the whole 64-bit range, in a fixed amount of memory.
+ *
+ * Histograms are not thread-safe, each thread records into its own histogram and the histograms
+ * are merged with `merge_histogram()`.
+ *
+ * Implemented in slib/histogram.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H 1
+
+/**
+ * @brief Defines the number of bits of a value kept exactly, the precision of the histogram.
+ */
+#ifndef HISTOGRAM_PRECISION_BITS
+#define HISTOGRAM_PRECISION_BITS 7
+#endif
+
+/**
+ * @brief Defines the number of buckets of a histogram: `2^HISTOGRAM_PRECISION_BITS` exact buckets,
+ * followed by `2^(HISTOGRAM_PRECISION_BITS - 1)` buckets for every larger power of two.
+ */
+#define HISTOGRAM_N_BUCKETS                                                                        \
+    ((1 << HISTOGRAM_PRECISION_BITS) +                                                             \
+     (64 - HISTOGRAM_PRECISION_BITS) * (1 << (HISTOGRAM_PRECISION_BITS - 1)))
+
+#include <stdint.h>
+
+/**
+ * @struct histogram
+ * @brief Defines a histogram structure.
+ *
+ * @see create_histogram
+ * @see record_histogram_value
+ * @see merge_histogram
+ * @see get_histogram_percentile
+ * @see destroy_histogram
+ *
+ * @property uint64_t histogram::count
+ * @brief Number of values recorded.
+ *
+ * @property uint64_t histogram::min
+ * @brief Smallest value recorded, `UINT64_MAX` if no value was recorded.
+ *
+ * @property uint64_t histogram::max
+ * @brief Largest value recorded, `0` if no value was recorded.
+ *
+ * @property double histogram::sum
+ * @brief Sum of the values recorded, used for the mean.
+ *
+ * @property uint64_t histogram::counts
+ * @brief Number of values recorded in each bucket.
+ */
+typedef struct histogram {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t counts[HISTOGRAM_N_BUCKETS];
+} histogram;
+
+/**
+ * @brief Creates an empty histogram.
+ *
+ * @return On success, pointer to the histogram is returned. On failure, `NULL` is returned.
+ */
+histogram *create_histogram();
+
+/**
+ * @brief Records `value` in the histogram.
+ *
+ * @param h The histogram.
+ * @param value The value, e.g. a latency in microseconds.
+ * @return void
+ */
+void record_histogram_value(histogram *, const uint64_t);
+
+/**
+ * @brief Adds all the values recorded in `src` to `dst`.
+ *
+ * @param dst The histogram the values are added to.
+ * @param src The histogram the values are read from, not modified.
+ * @return void
+ */
+void merge_histogram(histogram *, const histogram *);
+
+/**
+ * @brief Gets the value at `percentile` of the recorded values.
+ *
+ * Like HdrHistogram, the highest value of the bucket the percentile falls in is returned, capped
+ * at `histogram::max`, so the result is never lower than the exact percentile.
+ *
+ * @param h The histogram.
+ * @param percentile The percentile, from `0` to `100` (e.g. `99.9`).
+ * @return The value at the percentile, `0` if no value was recorded.
+ */
+uint64_t get_histogram_percentile(const histogram *, const double);
+
+/**
+ * @brief Gets the mean of the recorded values.
+ *
+ * @param h The histogram.
+ * @return The mean, `0` if no value was recorded.
+ */
+double get_histogram_mean(const histogram *);
+
+/**
+ * @brief Removes all the recorded values from the histogram.
+ *
+ * @param h The histogram.
+ * @return void
+ */
+void reset_histogram(histogram *);
+
+/**
+ * @brief Frees the histogram.
+ *
+ * @param h The histogram, can be `NULL`.
+ * @return void
+ */
+void destroy_histogram(histogram *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Gets the index of the bucket `value` is recorded in.
+ *
+ * @param value The value.
+ * @return The index of the bucket, less than `HISTOGRAM_N_BUCKETS`.
+ */
+int _get_histogram_bucket(const uint64_t);
+
+/**
+ * @private
+ * @brief Gets the highest value recorded in the bucket `bucket`.
+ *
+ * @param bucket The index of the bucket.
+ * @return The highest value of the bucket.
+ */
+uint64_t _get_histogram_bucket_value(const int);
+#endif
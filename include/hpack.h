@@ -0,0 +1,345 @@
+/**
+ * @file include/hpack.h
+ * @brief Function Prototypes for the HPACK header compression of HTTP/2 (RFC 7541).
+ *
+ * This file contains the header table structure and function prototypes to decode the header
+ * blocks received from a client and to encode the header blocks of responses. A header is either
+ * an index into the static table (61 common headers defined by the RFC) and the dynamic table, or
+ * a literal name and value, which can be added to the dynamic table so that later blocks refer to
+ * it by index. Literal strings may be Huffman coded with the static code of the RFC.
+ *
+ * Every HTTP/2 connection has a table for each direction. The decoding table must see every header
+ * block the client sent in order, even the ones of refused streams, or the indexes of the later
+ * blocks are off.
+ *
+ * Implemented in slib/hpack.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _HPACK_H
+#define _HPACK_H 1
+
+/**
+ * @brief Defines the size (in bytes) of a dynamic table until the peer sets another one with
+ * `SETTINGS_HEADER_TABLE_SIZE`.
+ */
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+
+/**
+ * @brief Defines the number of bytes an entry takes in the dynamic table on top of its name and
+ * value.
+ */
+#define HPACK_ENTRY_OVERHEAD 32
+
+/**
+ * @brief Defines the number of entries of the static table.
+ */
+#define HPACK_STATIC_TABLE_LEN 61
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+/**
+ * @brief Defines how a literal header is encoded.
+ *
+ *     - `HPACK_INDEX`: The header is added to the dynamic table, later blocks send its index.
+ *     - `HPACK_NO_INDEX`: The header is not added to the dynamic table.
+ *     - `HPACK_NEVER_INDEX`: The header is not added, and intermediaries must not add it either
+ *       (e.g. for `set-cookie`).
+ */
+typedef enum hpack_indexing {
+    HPACK_INDEX,
+    HPACK_NO_INDEX,
+    HPACK_NEVER_INDEX
+} hpack_indexing;
+
+/**
+ * @struct hpack_entry
+ * @brief Defines an entry of the static or the dynamic table.
+ *
+ * @property const char* hpack_entry::name
+ * @brief The header name, `\0` terminated.
+ *
+ * @property size_t hpack_entry::name_len
+ * @brief Length of `name`.
+ *
+ * @property const char* hpack_entry::value
+ * @brief The header value, `\0` terminated. Stored in the same allocation as `name` for dynamic
+ * entries.
+ *
+ * @property size_t hpack_entry::value_len
+ * @brief Length of `value`.
+ */
+typedef struct hpack_entry {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} hpack_entry;
+
+/**
+ * @struct hpack_table
+ * @brief Defines the dynamic table of one direction of a connection.
+ *
+ * Entries are kept in a ring buffer, the newest entry has the index `HPACK_STATIC_TABLE_LEN + 1`
+ * and the oldest entries are evicted first.
+ *
+ * @see init_hpack_table
+ * @see decode_hpack_block
+ * @see encode_hpack_header
+ *
+ * @property hpack_entry* hpack_table::entries
+ * @brief The ring buffer of entries.
+ *
+ * @property unsigned int hpack_table::cap
+ * @brief Number of slots in `entries`.
+ *
+ * @property unsigned int hpack_table::first
+ * @brief Slot of the newest entry.
+ *
+ * @property unsigned int hpack_table::len
+ * @brief Number of entries in the table.
+ *
+ * @property size_t hpack_table::size
+ * @brief Size of the entries (in bytes), as defined by RFC 7541, section 4.1.
+ *
+ * @property size_t hpack_table::max_size
+ * @brief Size the entries are evicted at.
+ *
+ * @property size_t hpack_table::limit
+ * @brief Largest `max_size` allowed by the `SETTINGS_HEADER_TABLE_SIZE` of the decoding peer.
+ *
+ * @property bool hpack_table::size_changed
+ * @brief Whether the encoder must send the new `max_size` at the start of the next block.
+ */
+typedef struct hpack_table {
+    hpack_entry *entries;
+    unsigned int cap;
+    unsigned int first;
+    unsigned int len;
+    size_t size;
+    size_t max_size;
+    size_t limit;
+    bool size_changed;
+} hpack_table;
+
+/**
+ * @brief Defines the function signature of the callback receiving the decoded headers.
+ *
+ * The name and value are `\0` terminated and only valid during the call.
+ */
+typedef void (*hpack_header_cb)(void *, const char *, const size_t, const char *, const size_t);
+
+/**
+ * @brief Initializes an empty dynamic table of `max_size` bytes.
+ *
+ * @param table The table.
+ * @param max_size Size of the table (and its limit) in bytes.
+ * @return void
+ */
+void init_hpack_table(hpack_table *, const size_t);
+
+/**
+ * @brief Frees the entries of a dynamic table.
+ *
+ * @param table The table.
+ * @return void
+ */
+void free_hpack_table(hpack_table *);
+
+/**
+ * @brief Sets the limit of an encoding table to the `SETTINGS_HEADER_TABLE_SIZE` of the peer.
+ *
+ * The table shrinks if it is larger than `limit`, then the new size is sent at the start of the
+ * next block (see `begin_hpack_block()`). A larger limit isn't used, the table keeps its size.
+ *
+ * @param table The table.
+ * @param limit The new limit in bytes.
+ * @return void
+ */
+void set_hpack_table_limit(hpack_table *, const size_t);
+
+/**
+ * @brief Gets the entry at `index` of the static table (`1` to `HPACK_STATIC_TABLE_LEN`) or of the
+ * dynamic table (from `HPACK_STATIC_TABLE_LEN + 1` on).
+ *
+ * @param table The dynamic table.
+ * @param index The index.
+ * @return The entry, `NULL` if there is no entry at `index`.
+ */
+const hpack_entry *get_hpack_entry(const hpack_table *, const size_t);
+
+/**
+ * @brief Adds a header to the start of the dynamic table, evicting the oldest entries as needed.
+ *
+ * A header larger than the table empties it and isn't added (RFC 7541, section 4.4).
+ *
+ * @param table The table.
+ * @param name The header name.
+ * @param name_len Length of `name`.
+ * @param value The header value.
+ * @param value_len Length of `value`.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int add_hpack_entry(hpack_table *, const char *, const size_t, const char *, const size_t);
+
+/**
+ * @brief Finds a header in the static and the dynamic table.
+ *
+ * @param table The dynamic table.
+ * @param name The header name.
+ * @param name_len Length of `name`.
+ * @param value The header value.
+ * @param value_len Length of `value`.
+ * @param value_matched Set to `true` if the entry found has the value as well.
+ * @return The index of an entry with the name and value, or else of an entry with the name. `0` if
+ * no entry has the name.
+ */
+size_t find_hpack_entry(const hpack_table *, const char *, const size_t, const char *,
+                        const size_t, bool *);
+
+/**
+ * @brief Decodes a complete header block and passes every header to `callback`, in order.
+ *
+ * The entries added by the block are added to `table`, and dynamic table size updates are applied
+ * if they don't exceed `hpack_table::limit`.
+ *
+ * @param table The decoding table.
+ * @param buf The header block.
+ * @param len Length of `buf`.
+ * @param callback Called for every header.
+ * @param arg Passed to `callback`.
+ * @return On success, returns `1`. If the block is malformed (a compression error), returns `0`,
+ * the table can't be used anymore.
+ */
+int decode_hpack_block(hpack_table *, const unsigned char *, const size_t, hpack_header_cb,
+                       void *);
+
+/**
+ * @brief Starts a header block in `out`, with the new size of the table if it changed.
+ *
+ * @param table The encoding table.
+ * @param out The buffer the block is appended to.
+ * @return void
+ */
+void begin_hpack_block(hpack_table *, GString *);
+
+/**
+ * @brief Appends a header to the block in `out`.
+ *
+ * A header of the static or the dynamic table is encoded as its index, any other header as a
+ * literal, with an indexed name if there is one. Literal strings are Huffman coded if that makes
+ * them shorter.
+ *
+ * @param table The encoding table.
+ * @param out The buffer the block is appended to.
+ * @param name The header name, in lowercase.
+ * @param name_len Length of `name`.
+ * @param value The header value.
+ * @param value_len Length of `value`.
+ * @param indexing Whether a literal header is added to the dynamic table.
+ * @return void
+ */
+void encode_hpack_header(hpack_table *, GString *, const char *, const size_t, const char *,
+                         const size_t, const hpack_indexing);
+
+/**
+ * @brief Decodes the Huffman coded string `buf` and appends it to `out`.
+ *
+ * @param out The buffer the string is appended to.
+ * @param buf The Huffman coded string.
+ * @param len Length of `buf`.
+ * @return On success, returns `1`. If the code or its padding is invalid, returns `0`.
+ */
+int decode_hpack_huffman(GString *, const unsigned char *, const size_t);
+
+/**
+ * @brief Huffman codes the string `str` and appends it to `out`.
+ *
+ * @param out The buffer the code is appended to.
+ * @param str The string.
+ * @param len Length of `str`.
+ * @return void
+ */
+void encode_hpack_huffman(GString *, const char *, const size_t);
+
+/**
+ * @brief Gets the length of the Huffman code of `str`.
+ *
+ * @param str The string.
+ * @param len Length of `str`.
+ * @return The number of bytes `encode_hpack_huffman()` appends.
+ */
+size_t get_hpack_huffman_len(const char *, const size_t);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Decodes an integer with a prefix of `prefix_bits` bits at `*pos` of `buf`, and moves
+ * `*pos` after it.
+ *
+ * @param buf The header block.
+ * @param len Length of `buf`.
+ * @param pos Offset of the integer, moved past it.
+ * @param prefix_bits Number of bits of the integer in its first byte.
+ * @param value Set to the integer.
+ * @return On success, returns `1`. If the integer is truncated or too large, returns `0`.
+ */
+int _decode_hpack_int(const unsigned char *, const size_t, size_t *, const int, uint64_t *);
+
+/**
+ * @private
+ * @brief Appends an integer with a prefix of `prefix_bits` bits to `out`, the bits of the first
+ * byte above the prefix are set to `flags`.
+ *
+ * @param out The buffer the integer is appended to.
+ * @param flags Bits of the first byte above the prefix.
+ * @param prefix_bits Number of bits of the integer in its first byte.
+ * @param value The integer.
+ * @return void
+ */
+void _encode_hpack_int(GString *, const unsigned char, const int, uint64_t);
+
+/**
+ * @private
+ * @brief Decodes a string literal at `*pos` of `buf` into `out`, and moves `*pos` after it.
+ *
+ * @param buf The header block.
+ * @param len Length of `buf`.
+ * @param pos Offset of the string, moved past it.
+ * @param out Set to the string.
+ * @return On success, returns `1`. If the string is truncated or its Huffman code is invalid,
+ * returns `0`.
+ */
+int _decode_hpack_string(const unsigned char *, const size_t, size_t *, GString *);
+
+/**
+ * @private
+ * @brief Appends the string literal `str` to `out`, Huffman coded if that is shorter.
+ *
+ * @param out The buffer the string is appended to.
+ * @param str The string.
+ * @param len Length of `str`.
+ * @return void
+ */
+void _encode_hpack_string(GString *, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Evicts the oldest entries until the table is at most `max_size` bytes.
+ *
+ * @param table The table.
+ * @param max_size Size of the table in bytes.
+ * @return void
+ */
+void _evict_hpack_entries(hpack_table *, const size_t);
+#endif
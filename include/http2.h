@@ -0,0 +1,959 @@
+/**
+ * @file include/http2.h
+ * @brief Function Prototypes for the HTTP/2 sessions of client connections (RFC 9113).
+ *
+ * This file contains the session and stream structures and function prototypes to read the frames
+ * of an HTTP/2 connection and to answer its streams. The request handler stays the one of HTTP/1.1:
+ * the headers and body of a complete stream are turned into an HTTP/1.1 request head (with the
+ * version `HTTP/2.0`) and body, so the worker loads them into the connection's receive buffer and
+ * the handler parses them as usual. While the handler runs, the stream is the active stream of its
+ * thread, and the response it sends to the connection socket (see `send_http2()`) is turned back
+ * into a `HEADERS` frame and `DATA` frames of the stream.
+ *
+ * Streams are handled one at a time, the most urgent one first. The urgency is taken from the
+ * `priority` header and `PRIORITY_UPDATE` frames (RFC 9218), the dependency tree of RFC 7540 is
+ * deprecated and its `PRIORITY` frames are ignored. `DATA` frames are sent within the flow control
+ * windows of the client. The part of a response body the windows (or the socket) don't take is
+ * parked on its stream, the handler returns right away and the worker sends the rest from its event
+ * loop once the client opens the windows. Received `DATA` frames are held to the server's windows,
+ * which are only credited back for the bodies still being received.
+ *
+ * Implemented in slib/http2.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _HTTP2_H
+#define _HTTP2_H 1
+
+/**
+ * @brief Defines the connection preface every HTTP/2 client starts with.
+ */
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+/**
+ * @brief Defines the length of `HTTP2_PREFACE`.
+ */
+#define HTTP2_PREFACE_LEN 24
+
+/**
+ * @brief Defines the length of a frame header.
+ */
+#define HTTP2_FRAME_HEAD_LEN 9
+
+/**
+ * @brief Defines the max size of a frame payload, the initial `SETTINGS_MAX_FRAME_SIZE`. The server
+ * doesn't accept larger frames.
+ */
+#define HTTP2_MAX_FRAME_SIZE 16384
+
+/**
+ * @brief Defines the initial size (in bytes) of a flow control window.
+ */
+#define HTTP2_DEFAULT_WINDOW 65535
+
+/**
+ * @brief Defines the urgency of a stream without a `priority` header (RFC 9218, section 4.1).
+ */
+#define HTTP2_DEFAULT_URGENCY 3
+
+/**
+ * @brief Defines the size (in bytes) of the receive buffer of a session, large enough for a frame
+ * of `HTTP2_MAX_FRAME_SIZE` bytes.
+ */
+#ifndef HTTP2_RECV_BUF_SIZE
+#define HTTP2_RECV_BUF_SIZE 32768
+#endif
+
+/**
+ * @brief Defines the number of queued bytes a response is sent at, smaller frames are coalesced.
+ */
+#ifndef HTTP2_SEND_BUF_SIZE
+#define HTTP2_SEND_BUF_SIZE 65536
+#endif
+
+/**
+ * @brief Defines the flag ending a stream, of `DATA` and `HEADERS` frames.
+ */
+#define HTTP2_FLAG_END_STREAM 0x1
+
+/**
+ * @brief Defines the flag of `SETTINGS` and `PING` frames acknowledging the peer's one.
+ */
+#define HTTP2_FLAG_ACK 0x1
+
+/**
+ * @brief Defines the flag ending a header block, of `HEADERS` and `CONTINUATION` frames.
+ */
+#define HTTP2_FLAG_END_HEADERS 0x4
+
+/**
+ * @brief Defines the flag of `DATA` and `HEADERS` frames with padding.
+ */
+#define HTTP2_FLAG_PADDED 0x8
+
+/**
+ * @brief Defines the flag of `HEADERS` frames with a (deprecated) stream dependency and weight.
+ */
+#define HTTP2_FLAG_PRIORITY 0x20
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "hpack.h"
+#include "http_parser.h"
+#include "tls.h"
+
+/**
+ * @brief Defines the frame types (RFC 9113, section 6 and RFC 9218, section 7.1).
+ */
+typedef enum http2_frame_type {
+    HTTP2_DATA = 0x0,
+    HTTP2_HEADERS = 0x1,
+    HTTP2_PRIORITY = 0x2,
+    HTTP2_RST_STREAM = 0x3,
+    HTTP2_SETTINGS = 0x4,
+    HTTP2_PUSH_PROMISE = 0x5,
+    HTTP2_PING = 0x6,
+    HTTP2_GOAWAY = 0x7,
+    HTTP2_WINDOW_UPDATE = 0x8,
+    HTTP2_CONTINUATION = 0x9,
+    HTTP2_PRIORITY_UPDATE = 0x10
+} http2_frame_type;
+
+/**
+ * @brief Defines the error codes of `RST_STREAM` and `GOAWAY` frames (RFC 9113, section 7).
+ */
+typedef enum http2_error_code {
+    HTTP2_NO_ERROR = 0x0,
+    HTTP2_PROTOCOL_ERROR = 0x1,
+    HTTP2_INTERNAL_ERROR = 0x2,
+    HTTP2_FLOW_CONTROL_ERROR = 0x3,
+    HTTP2_STREAM_CLOSED = 0x5,
+    HTTP2_FRAME_SIZE_ERROR = 0x6,
+    HTTP2_REFUSED_STREAM = 0x7,
+    HTTP2_COMPRESSION_ERROR = 0x9,
+    HTTP2_ENHANCE_YOUR_CALM = 0xb
+} http2_error_code;
+
+/**
+ * @brief Defines the settings of `SETTINGS` frames (RFC 9113, section 6.5.2).
+ */
+typedef enum http2_setting {
+    HTTP2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    HTTP2_SETTINGS_ENABLE_PUSH = 0x2,
+    HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    HTTP2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    HTTP2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+    HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+} http2_setting;
+
+/**
+ * @struct http2_data
+ * @brief Defines a part of a response body that waits for the flow control windows of the client
+ * (or for the socket), parked on its stream.
+ *
+ * @property int http2_data::file_fd
+ * @brief Duplicate of the descriptor of the file the bytes are read from, `-1` if they are in
+ * `buf`.
+ *
+ * @property off_t http2_data::offset
+ * @brief Offset in the file of the next byte.
+ *
+ * @property size_t http2_data::pos
+ * @brief Offset in `buf` of the next byte.
+ *
+ * @property size_t http2_data::len
+ * @brief Number of bytes left.
+ *
+ * @property http2_data* http2_data::next
+ * @brief Next part of the body.
+ *
+ * @property char http2_data::buf
+ * @brief The bytes, if they are not read from a file.
+ */
+typedef struct http2_data {
+    int file_fd;
+    off_t offset;
+    size_t pos;
+    size_t len;
+    struct http2_data *next;
+    char buf[];
+} http2_data;
+
+/**
+ * @struct http2_stream
+ * @brief Defines a stream of a session, from its `HEADERS` frame until its response is sent.
+ *
+ * @property uint32_t http2_stream::id
+ * @brief The stream identifier.
+ *
+ * @property int http2_stream::urgency
+ * @brief Urgency of the stream, `0` (most urgent) to `7`.
+ *
+ * @property bool http2_stream::is_head
+ * @brief Whether the request method is `HEAD`, so the response has no body.
+ *
+ * @property bool http2_stream::is_ready
+ * @brief Whether the request is complete and can be handled.
+ *
+ * @property bool http2_stream::is_remote_closed
+ * @brief Whether the client ended the stream.
+ *
+ * @property bool http2_stream::is_reset
+ * @brief Whether the stream was reset, nothing more is sent on it.
+ *
+ * @property bool http2_stream::is_ended
+ * @brief Whether the response is complete and the stream was ended.
+ *
+ * @property bool http2_stream::is_finished
+ * @brief Whether the handler is done with the stream, it ends once its parked body is sent.
+ *
+ * @property int http2_stream::error_status
+ * @brief Status code of the error response the handler sends instead of handling the request
+ * (`413` for a body larger than `max_request_body_size`, `431` for a request head larger than
+ * `max_request_head_size`). `0` if the request is valid.
+ *
+ * @property int64_t http2_stream::send_window
+ * @brief Flow control window of the client for the stream.
+ *
+ * @property int64_t http2_stream::recv_window
+ * @brief Flow control window of the server for the stream.
+ *
+ * @property int64_t http2_stream::remaining
+ * @brief Number of response body bytes left, from `Content-Length`. `-1` if the body ends with
+ * the response.
+ *
+ * @property GString* http2_stream::request
+ * @brief The HTTP/1.1 request head (and body, once the request is complete).
+ *
+ * @property GString* http2_stream::body
+ * @brief The request body while it is received, `NULL` before the first `DATA` frame.
+ *
+ * @property GString* http2_stream::response_head
+ * @brief The HTTP/1.1 response head sent by the handler so far, `NULL` once it was sent.
+ *
+ * @property http2_data* http2_stream::pending
+ * @brief The parked part of the response body, `NULL` if none.
+ *
+ * @property http2_data* http2_stream::pending_tail
+ * @brief Last part of `pending`.
+ *
+ * @property size_t http2_stream::pending_len
+ * @brief Number of bytes in `pending`.
+ *
+ * @property http2_stream* http2_stream::next
+ * @brief Next stream of the session.
+ */
+typedef struct http2_stream {
+    uint32_t id;
+    int urgency;
+    bool is_head;
+    bool is_ready;
+    bool is_remote_closed;
+    bool is_reset;
+    bool is_ended;
+    bool is_finished;
+    int error_status;
+    int64_t send_window;
+    int64_t recv_window;
+    int64_t remaining;
+    GString *request;
+    GString *body;
+    GString *response_head;
+    http2_data *pending;
+    http2_data *pending_tail;
+    size_t pending_len;
+    struct http2_stream *next;
+} http2_stream;
+
+/**
+ * @struct http2_session
+ * @brief Defines the HTTP/2 session of a connection.
+ *
+ * @see create_http2_session
+ * @see read_http2_session
+ * @see next_http2_stream
+ *
+ * @property int http2_session::fd
+ * @brief The connection socket.
+ *
+ * @property unsigned int http2_session::max_streams
+ * @brief Max number of concurrent streams, newer ones are refused.
+ *
+ * @property size_t http2_session::max_head_size
+ * @brief Max size (in bytes) of a request head.
+ *
+ * @property size_t http2_session::max_body_size
+ * @brief Max size (in bytes) of a request body.
+ *
+ * @property hpack_table http2_session::decoder
+ * @brief Header table of the client's header blocks.
+ *
+ * @property hpack_table http2_session::encoder
+ * @brief Header table of the response header blocks.
+ *
+ * @property size_t http2_session::preface_len
+ * @brief Number of bytes of `HTTP2_PREFACE` received so far.
+ *
+ * @property bool http2_session::has_settings
+ * @brief Whether the client's first `SETTINGS` frame was received.
+ *
+ * @property bool http2_session::is_goaway
+ * @brief Whether a `GOAWAY` frame was sent or received, no new streams are started.
+ *
+ * @property bool http2_session::is_broken
+ * @brief Whether the session failed (or the client closed it), the connection must be closed.
+ *
+ * @property uint32_t http2_session::last_stream_id
+ * @brief Highest stream identifier the client started.
+ *
+ * @property uint32_t http2_session::continuation_id
+ * @brief Stream whose header block continues in `CONTINUATION` frames, `0` if none.
+ *
+ * @property uint8_t http2_session::continuation_flags
+ * @brief Flags of the `HEADERS` frame continued in `CONTINUATION` frames.
+ *
+ * @property GString* http2_session::header_block
+ * @brief The header block continued in `CONTINUATION` frames.
+ *
+ * @property int64_t http2_session::send_window
+ * @brief Flow control window of the client for the connection.
+ *
+ * @property int64_t http2_session::recv_window
+ * @brief Flow control window of the server for the connection.
+ *
+ * @property uint32_t http2_session::initial_window
+ * @brief Initial flow control window of new streams, from `SETTINGS_INITIAL_WINDOW_SIZE`.
+ *
+ * @property uint32_t http2_session::max_frame_size
+ * @brief Max size of a frame sent to the client, from `SETTINGS_MAX_FRAME_SIZE`.
+ *
+ * @property unsigned int http2_session::n_streams
+ * @brief Number of streams in `streams`.
+ *
+ * @property http2_stream* http2_session::streams
+ * @brief The streams started and not answered yet.
+ *
+ * @property http2_stream* http2_session::active
+ * @brief The stream being handled, `NULL` between `finish_http2_stream()` and
+ * `begin_http2_stream()`.
+ *
+ * @property GString* http2_session::out
+ * @brief Frames queued to be sent.
+ *
+ * @property uint64_t http2_session::n_data
+ * @brief Number of response body bytes queued as `DATA` frames, to tell whether the responses go
+ * on (control frames, e.g. `PING` acknowledgements, don't count).
+ *
+ * @property size_t http2_session::in_len
+ * @brief Number of bytes in `in`.
+ *
+ * @property unsigned char http2_session::in
+ * @brief Receive buffer of the frames that are not complete yet.
+ */
+typedef struct http2_session {
+    int fd;
+    unsigned int max_streams;
+    size_t max_head_size;
+    size_t max_body_size;
+    hpack_table decoder;
+    hpack_table encoder;
+    size_t preface_len;
+    bool has_settings;
+    bool is_goaway;
+    bool is_broken;
+    uint32_t last_stream_id;
+    uint32_t continuation_id;
+    uint8_t continuation_flags;
+    GString *header_block;
+    int64_t send_window;
+    int64_t recv_window;
+    uint32_t initial_window;
+    uint32_t max_frame_size;
+    unsigned int n_streams;
+    http2_stream *streams;
+    http2_stream *active;
+    GString *out;
+    uint64_t n_data;
+    size_t in_len;
+    unsigned char in[HTTP2_RECV_BUF_SIZE];
+} http2_session;
+
+/**
+ * @struct http2_header_block
+ * @brief Defines the state of a header block being decoded into the request of a stream.
+ *
+ * @property http2_session* http2_header_block::session
+ * @brief The session.
+ *
+ * @property http2_stream* http2_header_block::stream
+ * @brief The stream the headers are added to, `NULL` if the headers are only decoded (e.g. for
+ * refused streams and trailers).
+ *
+ * @property GString* http2_header_block::method
+ * @brief The `:method` pseudo-header, `NULL` if it wasn't received.
+ *
+ * @property GString* http2_header_block::path
+ * @brief The `:path` pseudo-header, `NULL` if it wasn't received.
+ *
+ * @property GString* http2_header_block::authority
+ * @brief The `:authority` pseudo-header, `NULL` if it wasn't received.
+ *
+ * @property GString* http2_header_block::cookie
+ * @brief The `cookie` headers, joined with `; `. `NULL` if none was received.
+ *
+ * @property bool http2_header_block::has_scheme
+ * @brief Whether the `:scheme` pseudo-header was received.
+ *
+ * @property bool http2_header_block::has_regular
+ * @brief Whether a regular header was received, no pseudo-header can follow.
+ *
+ * @property bool http2_header_block::is_malformed
+ * @brief Whether the request is malformed (RFC 9113, section 8.1.1), the stream is reset.
+ */
+typedef struct http2_header_block {
+    http2_session *session;
+    http2_stream *stream;
+    GString *method;
+    GString *path;
+    GString *authority;
+    GString *cookie;
+    bool has_scheme;
+    bool has_regular;
+    bool is_malformed;
+} http2_header_block;
+
+/**
+ * @brief Creates the session of the connection socket `fd`.
+ *
+ * @param fd The connection socket.
+ * @param max_streams Max number of concurrent streams.
+ * @param max_head_size Max size (in bytes) of a request head.
+ * @param max_body_size Max size (in bytes) of a request body.
+ * @return On success, pointer to the session is returned. On failure, `NULL` is returned.
+ */
+http2_session *create_http2_session(const int, const unsigned int, const size_t, const size_t);
+
+/**
+ * @brief Queues the server's `SETTINGS` frame, the first frame of the session.
+ *
+ * A session upgraded from HTTP/1.1 gets the client's settings from its `HTTP2-Settings` header,
+ * and the `101 Switching Protocols` response is queued before the `SETTINGS` frame once they are
+ * valid.
+ *
+ * @param session The session.
+ * @param upgrade_settings The base64url `SETTINGS` payload of the `HTTP2-Settings` header, `NULL`
+ * if the session didn't start with an upgrade.
+ * @return On success, returns `1`. If `upgrade_settings` is invalid, returns `0`.
+ */
+int start_http2_session(http2_session *, const char *);
+
+/**
+ * @brief Starts stream `1` of a session upgraded from HTTP/1.1, for the request that asked for the
+ * upgrade.
+ *
+ * The request was already received over HTTP/1.1, so the stream is ready as soon as the client's
+ * `SETTINGS` frame arrived and the response is sent with its settings.
+ *
+ * @param session The session.
+ * @param request The HTTP/1.1 request head (the request has no body).
+ * @param len Length of `request`.
+ * @param is_head Whether the request method is `HEAD`.
+ * @return The stream, `NULL` on failure.
+ */
+http2_stream *open_http2_upgrade_stream(http2_session *, const char *, const size_t, const bool);
+
+/**
+ * @brief Reads all available frames from the non-blocking socket and processes them.
+ *
+ * Frames answering the client (e.g. `SETTINGS` acknowledgements) are queued, see
+ * `flush_http2_session()`. Reading stops once `HTTP2_SEND_BUF_SIZE` bytes are queued, a client
+ * that doesn't read the answers isn't read either.
+ *
+ * @param session The session.
+ * @return If the session can go on, returns `1`. If the client closed the connection or it failed,
+ * returns `0`.
+ */
+int read_http2_session(http2_session *);
+
+/**
+ * @brief Processes `len` bytes of frames received from the client.
+ *
+ * @param session The session.
+ * @param buf The received bytes.
+ * @param len Length of `buf`.
+ * @return If the session can go on, returns `1`. On a connection error, returns `0`, a `GOAWAY`
+ * frame is queued.
+ */
+int receive_http2_data(http2_session *, const char *, size_t);
+
+/**
+ * @brief Gets the complete stream to handle next, the one with the lowest urgency and then the
+ * lowest identifier.
+ *
+ * @param session The session.
+ * @return The stream, `NULL` if no stream is ready (or the client's settings didn't arrive yet).
+ */
+http2_stream *next_http2_stream(http2_session *);
+
+/**
+ * @brief Makes `stream` the active stream of the calling thread, responses sent to the session
+ * socket are sent on it.
+ *
+ * @param session The session.
+ * @param stream The stream.
+ * @return void
+ */
+void begin_http2_stream(http2_session *, http2_stream *);
+
+/**
+ * @brief Keeps the active stream open after the handler returned, while it waits for something
+ * else than the client (e.g. the backend of a proxied request). The stream is no longer the active
+ * stream of the calling thread, but the session keeps it: the next streams aren't started and the
+ * client's frames can't close it before `finish_http2_stream()`.
+ *
+ * @param session The session.
+ * @return void
+ */
+void pause_http2_stream(http2_session *);
+
+/**
+ * @brief Makes the stream paused with `pause_http2_stream()` the active stream of the calling
+ * thread again, so the handler can go on with its response.
+ *
+ * @param session The session.
+ * @return void
+ */
+void continue_http2_stream(http2_session *);
+
+/**
+ * @brief Ends the active stream and frees it, or leaves it to `flush_http2_session()` if some of
+ * its body is parked.
+ *
+ * A response without a `Content-Length` ends here (or after its parked body). A response that is
+ * incomplete (a missing head or fewer body bytes than its `Content-Length`) resets the stream
+ * instead. The frames are only queued.
+ *
+ * @param session The session.
+ * @param stream The active stream.
+ * @return If the session can go on, returns `1`. If the session failed, returns `0`.
+ */
+int finish_http2_stream(http2_session *, http2_stream *);
+
+/**
+ * @brief Queues a `GOAWAY` frame, no new streams are started and the session is done once the
+ * started ones are answered.
+ *
+ * @param session The session.
+ * @return void
+ */
+void shutdown_http2_session(http2_session *);
+
+/**
+ * @brief Checks if the session is done, so the connection can be closed.
+ *
+ * @param session The session.
+ * @return `true` if the session failed or is shut down without streams left, `false` otherwise.
+ */
+bool is_http2_session_done(const http2_session *);
+
+/**
+ * @brief Sends the queued frames and the parked response bodies as far as the socket and the flow
+ * control windows of the client allow, without blocking.
+ *
+ * Called by the worker after every event of the connection. Streams whose handler is done end once
+ * their parked body is sent, a paused stream only goes on with it.
+ *
+ * @param session The session.
+ * @return If everything that can be sent was sent, returns `1` (parked bodies may still wait for
+ * the windows). If the socket doesn't take more, returns `2`. On failure, returns `0` and the
+ * session is broken.
+ */
+int flush_http2_session(http2_session *);
+
+/**
+ * @brief Checks if the session has frames or parked response bodies that weren't sent yet.
+ *
+ * @param session The session.
+ * @return `true` if some of the output waits for the socket or the client's windows, `false`
+ * otherwise.
+ */
+bool has_http2_output(const http2_session *);
+
+/**
+ * @brief Checks if the active stream takes more of its response body without parking it: nothing
+ * of its body is parked and less than `HTTP2_SEND_BUF_SIZE` bytes are queued, or the stream was
+ * reset and the next send fails anyway.
+ *
+ * A handler that relays a body (e.g. from a backend) only reads more of it once this is `true`.
+ *
+ * @param session The session.
+ * @return `true` if the body can go on, `false` if it must wait for the client.
+ */
+bool can_send_http2(const http2_session *);
+
+/**
+ * @brief Frees the session and its streams. The socket is not closed.
+ *
+ * If a `NULL` pointer is passed to this function, function does nothing.
+ *
+ * @param session The session.
+ * @return void
+ */
+void destroy_http2_session(http2_session *);
+
+/**
+ * @brief Checks if `fd` is the socket of the session of the active stream of the calling thread.
+ *
+ * @param fd The connection socket.
+ * @return `true` if data sent to `fd` must go through `send_http2()`, `false` otherwise.
+ */
+bool has_http2_stream(const int);
+
+/**
+ * @brief Sends `len` bytes of the HTTP/1.1 response of the active stream of `fd`, as the frames of
+ * the stream. Never blocks: body bytes the client's flow control windows (or the socket) don't take
+ * are copied and parked on the stream.
+ *
+ * @param fd The connection socket.
+ * @param buf The next bytes of the response.
+ * @param len Length of `buf`.
+ * @return The number of bytes of `buf` sent, `-1` on error with `errno` set.
+ */
+ssize_t send_http2(const int, const void *, const size_t);
+
+/**
+ * @brief Sends `count` bytes of a file at `offset` as response body bytes of the active stream of
+ * `fd`. Never blocks: the range the windows (or the socket) don't take is parked with a duplicate
+ * of `file_fd`, so the file isn't read into memory ahead of the client.
+ *
+ * @param fd The connection socket.
+ * @param file_fd The file.
+ * @param offset Offset in the file of the first byte.
+ * @param count Number of bytes to send.
+ * @return The number of bytes sent (or parked), `-1` on error with `errno` set.
+ */
+ssize_t send_http2_file(const int, const int, const off_t, const size_t);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Processes the complete frames in the receive buffer, and keeps the incomplete one.
+ *
+ * @param session The session.
+ * @return If the session can go on, returns `1`. On a connection error, returns `0`.
+ */
+int _process_http2_frames(http2_session *);
+
+/**
+ * @private
+ * @brief Processes a frame.
+ *
+ * @param session The session.
+ * @param type The frame type.
+ * @param flags The frame flags.
+ * @param stream_id The stream identifier.
+ * @param payload The frame payload.
+ * @param len Length of `payload`.
+ * @return If the session can go on, returns `1`. On a connection error, returns `0`.
+ */
+int _process_http2_frame(http2_session *, const uint8_t, const uint8_t, const uint32_t,
+                         const unsigned char *, const size_t);
+
+/**
+ * @private
+ * @brief Processes a `DATA` frame, the body bytes are added to the request of the stream.
+ *
+ * @param session The session.
+ * @param flags The frame flags.
+ * @param stream_id The stream identifier.
+ * @param payload The frame payload.
+ * @param len Length of `payload`.
+ * @return If the session can go on, returns `1`. On a connection error, returns `0`.
+ */
+int _process_http2_data(http2_session *, const uint8_t, const uint32_t, const unsigned char *,
+                        const size_t);
+
+/**
+ * @private
+ * @brief Processes a complete header block, which starts a stream or holds its trailers.
+ *
+ * @param session The session.
+ * @param flags Flags of the `HEADERS` frame.
+ * @param stream_id The stream identifier.
+ * @param block The header block.
+ * @param len Length of `block`.
+ * @return If the session can go on, returns `1`. On a connection error, returns `0`.
+ */
+int _process_http2_headers(http2_session *, const uint8_t, const uint32_t, const unsigned char *,
+                           const size_t);
+
+/**
+ * @private
+ * @brief Processes the payload of a `SETTINGS` frame (or of the `HTTP2-Settings` header).
+ *
+ * @param session The session.
+ * @param payload The settings.
+ * @param len Length of `payload`, a multiple of 6.
+ * @return `HTTP2_NO_ERROR` if the settings are valid, the error code of the connection error
+ * otherwise.
+ */
+http2_error_code _apply_http2_settings(http2_session *, const unsigned char *, const size_t);
+
+/**
+ * @private
+ * @brief Adds a decoded header to the request of a stream, passed to `decode_hpack_block()`.
+ *
+ * @param arg The `http2_header_block` of the header block.
+ * @param name The header name.
+ * @param name_len Length of `name`.
+ * @param value The header value.
+ * @param value_len Length of `value`.
+ * @return void
+ */
+void _add_http2_header(void *, const char *, const size_t, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Parses the urgency of a `priority` header or `PRIORITY_UPDATE` frame.
+ *
+ * @param value The priority field value (e.g. `u=1, i`).
+ * @param len Length of `value`.
+ * @return The urgency, `HTTP2_DEFAULT_URGENCY` if the value doesn't set it.
+ */
+int _parse_http2_urgency(const char *, const size_t);
+
+/**
+ * @private
+ * @brief Adds the framing of the body to the request of a stream whose client ended it, the stream
+ * is ready to be handled.
+ *
+ * @param stream The stream.
+ * @return void
+ */
+void _complete_http2_request(http2_stream *);
+
+/**
+ * @private
+ * @brief Finds a started stream by its identifier.
+ *
+ * @param session The session.
+ * @param stream_id The stream identifier.
+ * @return The stream, `NULL` if it isn't started or was already answered.
+ */
+http2_stream *_find_http2_stream(const http2_session *, const uint32_t);
+
+/**
+ * @private
+ * @brief Creates a stream and adds it to the session.
+ *
+ * @param session The session.
+ * @param stream_id The stream identifier.
+ * @return The stream, `NULL` on failure.
+ */
+http2_stream *_add_http2_stream(http2_session *, const uint32_t);
+
+/**
+ * @private
+ * @brief Removes a stream from the session and frees it.
+ *
+ * @param session The session.
+ * @param stream The stream.
+ * @return void
+ */
+void _remove_http2_stream(http2_session *, http2_stream *);
+
+/**
+ * @private
+ * @brief Queues a frame.
+ *
+ * @param session The session.
+ * @param type The frame type.
+ * @param flags The frame flags.
+ * @param stream_id The stream identifier.
+ * @param payload The frame payload.
+ * @param len Length of `payload`.
+ * @return void
+ */
+void _queue_http2_frame(http2_session *, const uint8_t, const uint8_t, const uint32_t,
+                        const void *, const size_t);
+
+/**
+ * @private
+ * @brief Queues a `RST_STREAM` frame and forgets the stream, or marks it reset if it is the active
+ * stream.
+ *
+ * @param session The session.
+ * @param stream_id The stream identifier.
+ * @param error The error code.
+ * @return void
+ */
+void _reset_http2_stream(http2_session *, const uint32_t, const http2_error_code);
+
+/**
+ * @private
+ * @brief Queues a `GOAWAY` frame for a connection error, the session is broken.
+ *
+ * @param session The session.
+ * @param error The error code.
+ * @return Always returns `0`, the result of the frame processing.
+ */
+int _fail_http2_session(http2_session *, const http2_error_code);
+
+/**
+ * @private
+ * @brief Queues a `WINDOW_UPDATE` frame.
+ *
+ * @param session The session.
+ * @param stream_id The stream identifier, `0` for the connection.
+ * @param increment The window size increment.
+ * @return void
+ */
+void _queue_http2_window_update(http2_session *, const uint32_t, const uint32_t);
+
+/**
+ * @private
+ * @brief Sends as much of the queued frames as the socket takes without blocking.
+ *
+ * @param session The session.
+ * @return On success, returns `1` (the rest stays queued). On failure, returns `0` and the session
+ * is broken.
+ */
+int _send_http2_out(http2_session *);
+
+/**
+ * @private
+ * @brief Gets the length of the next `DATA` frame of a stream, within the flow control windows of
+ * the client and the max frame size. The queued frames are sent first if they grew to
+ * `HTTP2_SEND_BUF_SIZE` bytes.
+ *
+ * @param session The session.
+ * @param stream The stream.
+ * @param len Number of body bytes to send.
+ * @return The frame length, `0` if the windows are exhausted or the socket doesn't take the queued
+ * frames.
+ */
+size_t _next_http2_frame_len(http2_session *, const http2_stream *, const size_t);
+
+/**
+ * @private
+ * @brief Queues a `DATA` frame of a stream and charges it to the client's windows. The frame ends
+ * the stream if it completes the `Content-Length` of the response.
+ *
+ * @param session The session.
+ * @param stream The stream.
+ * @param buf The body bytes.
+ * @param len Length of `buf`, within the windows.
+ * @return void
+ */
+void _queue_http2_data(http2_session *, http2_stream *, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Parks the rest of a response body on its stream, to be sent by `flush_http2_session()`.
+ *
+ * @param stream The stream.
+ * @param buf The body bytes, copied. `NULL` if they are read from `file_fd`.
+ * @param file_fd The file the bytes are read from, duplicated. Ignored if `buf` isn't `NULL`.
+ * @param offset Offset in the file of the first byte.
+ * @param len Number of bytes.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _park_http2_data(http2_stream *, const char *, const int, const off_t, const size_t);
+
+/**
+ * @private
+ * @brief Sends the parked body of a stream as far as the windows and the socket allow, and ends the
+ * stream once the body is sent and the handler is done with it.
+ *
+ * @param session The session.
+ * @param stream The stream, which may be freed.
+ * @return `1` if some of the body was queued or the stream ended, `0` otherwise.
+ */
+int _resume_http2_stream(http2_session *, http2_stream *);
+
+/**
+ * @private
+ * @brief Queues the end (or the reset) of a stream whose handler is done and whose body is sent,
+ * and frees it.
+ *
+ * @param session The session.
+ * @param stream The stream.
+ * @return void
+ */
+void _end_http2_stream(http2_session *, http2_stream *);
+
+/**
+ * @private
+ * @brief Takes the next bytes of the HTTP/1.1 response head of the active stream, and queues the
+ * `HEADERS` frame once the head is complete.
+ *
+ * @param session The session.
+ * @param stream The active stream.
+ * @param buf The next bytes of the response.
+ * @param len Length of `buf`.
+ * @return The number of bytes of `buf` in the head, `0` if the head is malformed.
+ */
+size_t _send_http2_response_head(http2_session *, http2_stream *, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Queues the response body bytes of the active stream as `DATA` frames, and parks the ones
+ * the windows (or the socket) don't take.
+ *
+ * @param session The session.
+ * @param stream The active stream.
+ * @param buf The next bytes of the response body, `NULL` if they are read from `file_fd`.
+ * @param file_fd The file the bytes are read from. Ignored if `buf` isn't `NULL`.
+ * @param offset Offset in the file of the first byte.
+ * @param len Number of bytes.
+ * @return On success, returns `1`. If the session failed, the stream was reset or the file couldn't
+ * be read, returns `0`.
+ */
+int _send_http2_response_body(http2_session *, http2_stream *, const char *, const int, off_t,
+                              size_t);
+
+/**
+ * @private
+ * @brief Queues a header block as a `HEADERS` frame followed by as many `CONTINUATION` frames as
+ * needed.
+ *
+ * @param session The session.
+ * @param stream_id The stream identifier.
+ * @param block The header block.
+ * @param end_stream Whether the stream ends with the headers.
+ * @return void
+ */
+void _queue_http2_headers(http2_session *, const uint32_t, const GString *, const bool);
+
+/**
+ * @private
+ * @brief Gets the indexing of a response header, stable headers are added to the dynamic table so
+ * the next responses send them as a single byte.
+ *
+ * @param name The header name, in lowercase.
+ * @return The indexing of the header.
+ */
+hpack_indexing _get_http2_indexing(const char *);
+
+/**
+ * @private
+ * @brief Checks if `name` is a connection-specific header, which HTTP/2 doesn't have.
+ *
+ * @param name The header name, in lowercase.
+ * @param len Length of `name`.
+ * @return `true` if the header is connection-specific, `false` otherwise.
+ */
+bool _is_http2_hop_header(const char *, const size_t);
+#endif
@@ -0,0 +1,475 @@
+/**
+ * @file include/http_parser.h
+ * @brief Function Prototypes for the incremental HTTP/1.x request head parser.
+ *
+ * This file contains the parser structure and function prototypes to parse a request head that
+ * may arrive split across several `recv()` calls. The parser doesn't allocate or copy anything,
+ * the request line and headers are stored as views (offset and length) into the caller's buffer.
+ * The parser is re-entrant, all of its state is stored in `struct http_parser`. The same parser
+ * reads the response heads of upstream backends when it is initialized with
+ * `init_http_response_parser()`.
+ *
+ * Request bodies are framed with `struct http_body_parser`, which finds the body bytes of a
+ * `Content-Length` or `chunked` body in the buffer, so they can be used in place.
+ *
+ * Request targets, header values and reason phrases are scanned for their delimiters 16 or 32 bytes
+ * at a time with SSE4.2, AVX2 or NEON, whichever the CPU supports (checked once at load time). The
+ * headers the server looks up itself are recognized while parsing, their indexes are stored in an
+ * array indexed by `enum http_known_header`, so looking them up doesn't compare any strings.
+ *
+ * Implemented in slib/http_parser.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _HTTP_PARSER_H
+#define _HTTP_PARSER_H 1
+
+/**
+ * @brief Defines the max number of headers in a request head.
+ */
+#ifndef HTTP_MAX_HEADERS
+#define HTTP_MAX_HEADERS 64
+#endif
+
+/**
+ * @brief Defines the max length of a chunk size line (including chunk extensions) or of the
+ * trailer section of a `chunked` request body.
+ */
+#ifndef HTTP_MAX_CHUNK_LINE
+#define HTTP_MAX_CHUNK_LINE 4096
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Defines the headers recognized by the parser, see `http_parser::known_headers`.
+ *
+ * `HTTP_KNOWN_HEADERS` is the number of known headers, it is not a header.
+ */
+typedef enum http_known_header {
+    HTTP_HEADER_HOST,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_IF_MODIFIED_SINCE,
+    HTTP_HEADER_IF_RANGE,
+    HTTP_HEADER_RANGE,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_UPGRADE,
+    HTTP_HEADER_REFERER,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_KNOWN_HEADERS
+} http_known_header;
+
+/**
+ * @brief Defines the implementations of the delimiter scan, see `find_http_delimiter()`.
+ *
+ *     - `HTTP_SCAN_SCALAR`: One byte at a time, available everywhere.
+ *     - `HTTP_SCAN_SSE42`: 16 bytes at a time with the SSE4.2 string instructions (x86-64).
+ *     - `HTTP_SCAN_AVX2`: 32 bytes at a time with AVX2 (x86-64).
+ *     - `HTTP_SCAN_NEON`: 16 bytes at a time with NEON (AArch64).
+ */
+typedef enum http_scan_isa {
+    HTTP_SCAN_SCALAR,
+    HTTP_SCAN_SSE42,
+    HTTP_SCAN_AVX2,
+    HTTP_SCAN_NEON
+} http_scan_isa;
+
+/**
+ * @brief Defines the results of `parse_http_request()`.
+ *
+ *     - `HTTP_PARSE_OK`: The request head is complete and was parsed successfully.
+ *     - `HTTP_PARSE_INCOMPLETE`: The buffer holds only a part of the request head.
+ *     - `HTTP_PARSE_ERROR`: The request head is malformed.
+ */
+typedef enum http_parse_result {
+    HTTP_PARSE_OK,
+    HTTP_PARSE_INCOMPLETE,
+    HTTP_PARSE_ERROR
+} http_parse_result;
+
+/**
+ * @brief Defines the states of the parser.
+ *
+ *     - `HTTP_PARSER_REQUEST_LINE`: Waiting for the request line.
+ *     - `HTTP_PARSER_STATUS_LINE`: Waiting for the status line of a response head.
+ *     - `HTTP_PARSER_HEADERS`: Waiting for a header line or the empty line ending the head.
+ *     - `HTTP_PARSER_DONE`: The request head is complete.
+ *     - `HTTP_PARSER_FAILED`: The request head is malformed.
+ */
+typedef enum http_parser_state {
+    HTTP_PARSER_REQUEST_LINE,
+    HTTP_PARSER_STATUS_LINE,
+    HTTP_PARSER_HEADERS,
+    HTTP_PARSER_DONE,
+    HTTP_PARSER_FAILED
+} http_parser_state;
+
+/**
+ * @struct http_view
+ * @brief Defines a view of a string stored in the parsed buffer.
+ *
+ * @property size_t http_view::off
+ * @brief Offset of the string in the buffer.
+ *
+ * @property size_t http_view::len
+ * @brief Length of the string.
+ */
+typedef struct http_view {
+    size_t off;
+    size_t len;
+} http_view;
+
+/**
+ * @struct http_header
+ * @brief Defines a parsed header, its value doesn't include the surrounding whitespace.
+ *
+ * @property http_view http_header::key
+ * @brief The header name.
+ *
+ * @property http_view http_header::value
+ * @brief The header value.
+ */
+typedef struct http_header {
+    http_view key;
+    http_view value;
+} http_header;
+
+/**
+ * @struct http_parser
+ * @brief Defines the parser structure.
+ *
+ * @see init_http_parser
+ * @see parse_http_request
+ *
+ * @property http_parser_state http_parser::state
+ * @brief The current state of the parser.
+ *
+ * @property size_t http_parser::pos
+ * @brief Offset of the first line in the buffer that is not parsed yet.
+ *
+ * @property size_t http_parser::head_len
+ * @brief Length of the request head, including the empty line. Set once the head is complete.
+ *
+ * @property http_view http_parser::method
+ * @brief The HTTP method of the request.
+ *
+ * @property http_view http_parser::url
+ * @brief The request target.
+ *
+ * @property http_view http_parser::version
+ * @brief The HTTP version of the request. (e.g. `HTTP/1.1`)
+ *
+ * @property int http_parser::status
+ * @brief The status code of a response head, `0` for a request head.
+ *
+ * @property http_view http_parser::reason
+ * @brief The reason phrase of a response head, may be empty.
+ *
+ * @property unsigned int http_parser::n_headers
+ * @brief Number of parsed headers.
+ *
+ * @property http_header http_parser::headers
+ * @brief The parsed headers, in the order they were received.
+ *
+ * @property short http_parser::known_headers
+ * @brief Index of the first header with each known name in `headers`, `-1` if it wasn't received.
+ */
+typedef struct http_parser {
+    http_parser_state state;
+    size_t pos;
+    size_t head_len;
+    http_view method;
+    http_view url;
+    http_view version;
+    int status;
+    http_view reason;
+    unsigned int n_headers;
+    http_header headers[HTTP_MAX_HEADERS];
+    short known_headers[HTTP_KNOWN_HEADERS];
+} http_parser;
+
+/**
+ * @brief Defines the states of the body parser.
+ *
+ *     - `HTTP_BODY_DATA`: Waiting for body bytes, `http_body_parser::remaining` are left in the
+ *       body or the current chunk.
+ *     - `HTTP_BODY_CHUNK_SIZE`: Waiting for the hex digits of a chunk size.
+ *     - `HTTP_BODY_CHUNK_EXT`: Skipping the chunk extensions up to the end of the chunk size line.
+ *     - `HTTP_BODY_CHUNK_SIZE_LF`: Waiting for the `\n` ending the chunk size line.
+ *     - `HTTP_BODY_CHUNK_DATA_CR`: Waiting for the line terminator after the chunk data.
+ *     - `HTTP_BODY_CHUNK_DATA_LF`: Waiting for the `\n` after the chunk data.
+ *     - `HTTP_BODY_TRAILER`: Waiting for a trailer field or the empty line ending the body.
+ *     - `HTTP_BODY_TRAILER_LINE`: Skipping a trailer field.
+ *     - `HTTP_BODY_TRAILER_LF`: Waiting for the `\n` of the empty line ending the body.
+ *     - `HTTP_BODY_DONE`: The body is complete.
+ *     - `HTTP_BODY_FAILED`: The body is malformed.
+ */
+typedef enum http_body_state {
+    HTTP_BODY_DATA,
+    HTTP_BODY_CHUNK_SIZE,
+    HTTP_BODY_CHUNK_EXT,
+    HTTP_BODY_CHUNK_SIZE_LF,
+    HTTP_BODY_CHUNK_DATA_CR,
+    HTTP_BODY_CHUNK_DATA_LF,
+    HTTP_BODY_TRAILER,
+    HTTP_BODY_TRAILER_LINE,
+    HTTP_BODY_TRAILER_LF,
+    HTTP_BODY_DONE,
+    HTTP_BODY_FAILED
+} http_body_state;
+
+/**
+ * @struct http_body_parser
+ * @brief Defines the body parser structure.
+ *
+ * @see init_http_body_parser
+ * @see parse_http_body
+ *
+ * @property http_body_state http_body_parser::state
+ * @brief The current state of the parser.
+ *
+ * @property bool http_body_parser::chunked
+ * @brief Whether the body has the `chunked` transfer coding, `false` for `Content-Length` bodies.
+ *
+ * @property uint64_t http_body_parser::remaining
+ * @brief Number of body bytes left in the body (`Content-Length`) or the current chunk.
+ *
+ * @property uint64_t http_body_parser::body_len
+ * @brief Number of body bytes parsed so far, without the chunk framing.
+ *
+ * @property size_t http_body_parser::line_len
+ * @brief Length of the current chunk size line or of the trailer section so far.
+ *
+ * @property unsigned int http_body_parser::n_digits
+ * @brief Number of hex digits of the current chunk size.
+ */
+typedef struct http_body_parser {
+    http_body_state state;
+    bool chunked;
+    uint64_t remaining;
+    uint64_t body_len;
+    size_t line_len;
+    unsigned int n_digits;
+} http_body_parser;
+
+/**
+ * @brief Initializes (or resets) the parser to parse a new request head.
+ *
+ * @param parser The parser.
+ * @return void
+ */
+void init_http_parser(http_parser *);
+
+/**
+ * @brief Initializes (or resets) the parser to parse a new response head.
+ *
+ * `parse_http_request()` then expects a status line instead of a request line, and sets
+ * `http_parser::version`, `http_parser::status` and `http_parser::reason` from it.
+ *
+ * @param parser The parser.
+ * @return void
+ */
+void init_http_response_parser(http_parser *);
+
+/**
+ * @brief Parses the request head in the first `len` bytes of `buf`.
+ *
+ * The parser is incremental: when more data is appended to `buf`, call the function again with
+ * the same parser and the new length. Only the lines that were not complete in the previous call
+ * are parsed again. `buf` may be moved between calls (e.g. by `realloc()`), since the parser only
+ * stores offsets into it, but the bytes already parsed must not change.
+ *
+ * Empty lines before the request line are ignored. Lines can be terminated by `\r\n` or `\n`.
+ * Requests with an invalid request line, folded header lines, header names containing
+ * whitespace, control characters or more than `HTTP_MAX_HEADERS` headers are rejected.
+ *
+ * @param parser The parser.
+ * @param buf The buffer containing (a part of) the request head.
+ * @param len Number of bytes in `buf`.
+ * @return `HTTP_PARSE_OK` if the request head is complete, `HTTP_PARSE_INCOMPLETE` if more data
+ * is needed, `HTTP_PARSE_ERROR` if the request head is malformed.
+ */
+http_parse_result parse_http_request(http_parser *, const char *, const size_t);
+
+/**
+ * @brief Finds a header of the parsed request or response head by its name (case insensitive).
+ *
+ * @param parser The parser holding the complete head.
+ * @param buf The buffer the head was parsed from.
+ * @param key The header name.
+ * @param from Index of the first header searched, to find repeated headers.
+ * @return The index of the header, or `-1` if no header from `from` on has the name `key`.
+ */
+int find_http_header(const http_parser *, const char *, const char *, const unsigned int);
+
+/**
+ * @brief Finds the first header of the parsed request or response head with a known name.
+ *
+ * Unlike `find_http_header()`, no header names are compared, the index was stored by the parser.
+ * Repeated headers are found by calling `find_http_header()` from the returned index plus one.
+ *
+ * @param parser The parser holding the complete head.
+ * @param id The known header.
+ * @return The index of the header, or `-1` if the head has no such header.
+ */
+int find_known_http_header(const http_parser *, const http_known_header);
+
+/**
+ * @brief Gets the known header with the name `key` (case insensitive).
+ *
+ * @param key The header name, not `\0` terminated.
+ * @param key_len The length of `key`.
+ * @return The known header, or `HTTP_KNOWN_HEADERS` if `key` is not a known header name.
+ */
+http_known_header get_http_known_header(const char *, const size_t);
+
+/**
+ * @brief Finds the first byte in `buf` that ends a request target or a field value.
+ *
+ * The scan stops at control characters (except `\t`), `DEL` and, if `stop_at_space` is `true`, at
+ * spaces and `\t` too. Bytes above `0x7f` never stop it (obs-text). The implementation chosen by
+ * `get_http_scan_isa()` is used.
+ *
+ * @param buf The bytes to scan.
+ * @param len Number of bytes in `buf`.
+ * @param stop_at_space Whether spaces and `\t` end the scan (request targets).
+ * @return The offset of the first delimiter, or `len` if `buf` has none.
+ */
+size_t find_http_delimiter(const char *, const size_t, const bool);
+
+/**
+ * @brief Gets the implementation used by `find_http_delimiter()`.
+ *
+ * The widest implementation supported by the CPU is chosen when the library is loaded.
+ *
+ * @return The implementation.
+ */
+http_scan_isa get_http_scan_isa();
+
+/**
+ * @brief Sets the implementation used by `find_http_delimiter()`, for tests and benchmarks.
+ *
+ * Must not be called while other threads are parsing.
+ *
+ * @param isa The implementation.
+ * @return `1` if the CPU (and the build) supports `isa`, `0` otherwise and nothing is changed.
+ */
+int set_http_scan_isa(const http_scan_isa);
+
+/**
+ * @brief Initializes the body parser from the framing headers of a parsed request head.
+ *
+ * A request with `Transfer-Encoding: chunked` has a `chunked` body, a request with
+ * `Content-Length` has a body of that length and any other request has no body. Requests with
+ * both headers, a transfer coding other than a final `chunked` or an invalid or ambiguous
+ * `Content-Length` are rejected, since a proxy in front of the server could frame them
+ * differently (RFC 9112, section 6.3).
+ *
+ * @param body The body parser.
+ * @param parser The parser holding the complete request head.
+ * @param buf The buffer the request head was parsed from.
+ * @return `1` if the framing of the body is valid, `0` otherwise.
+ */
+int init_http_body_parser(http_body_parser *, const http_parser *, const char *);
+
+/**
+ * @brief Finds the next body bytes in the first `len` bytes of `buf`.
+ *
+ * Framing bytes (chunk sizes, extensions, line terminators and trailers) are skipped until body
+ * bytes are found or `buf` is exhausted. `data` is set to the view of the body bytes found, which
+ * can be used in place, and `consumed` to the number of bytes of `buf` the parser is done with,
+ * including `data`. The parser keeps the state of partial framing, so the next call starts with the
+ * byte after `consumed`.
+ *
+ * @param body The body parser.
+ * @param buf The buffer containing (a part of) the body.
+ * @param len Number of bytes in `buf`.
+ * @param consumed Set to the number of bytes of `buf` that were parsed.
+ * @param data Set to the view of the body bytes found in `buf`, with a length of `0` if none.
+ * @return `HTTP_PARSE_OK` if the body is complete, `HTTP_PARSE_INCOMPLETE` if the body continues
+ * after `consumed`, `HTTP_PARSE_ERROR` if the body is malformed.
+ */
+http_parse_result parse_http_body(http_body_parser *, const char *, const size_t, size_t *,
+                                  http_view *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Parses the request line `<method> SP <url> SP HTTP/<digit>.<digit>`.
+ *
+ * @param parser The parser.
+ * @param buf The buffer.
+ * @param start Offset of the line in the buffer.
+ * @param end Offset of the end of the line, excluding the line terminator.
+ * @return `1` if the request line is valid, `0` otherwise.
+ */
+int _parse_http_request_line(http_parser *, const char *, const size_t, const size_t);
+
+/**
+ * @private
+ * @brief Parses the status line `HTTP/<digit>.<digit> SP <3 digits> SP <reason>`.
+ *
+ * @param parser The parser.
+ * @param buf The buffer.
+ * @param start Offset of the line in the buffer.
+ * @param end Offset of the end of the line, excluding the line terminator.
+ * @return `1` if the status line is valid, `0` otherwise.
+ */
+int _parse_http_status_line(http_parser *, const char *, const size_t, const size_t);
+
+/**
+ * @private
+ * @brief Parses the header line `<name>: <value>` and adds it to the parser's headers.
+ *
+ * @param parser The parser.
+ * @param buf The buffer.
+ * @param start Offset of the line in the buffer.
+ * @param end Offset of the end of the line, excluding the line terminator.
+ * @return `1` if the header line is valid, `0` otherwise.
+ */
+int _parse_http_header_line(http_parser *, const char *, const size_t, const size_t);
+
+/**
+ * @private
+ * @brief Checks if `c` is allowed in a token (e.g. a method or a header name), as defined in
+ * RFC 7230.
+ *
+ * @param c The character.
+ * @return `1` if `c` is a token character, `0` otherwise.
+ */
+int _is_http_token_char(const unsigned char);
+
+/**
+ * @private
+ * @brief Scans `buf` for a delimiter one byte at a time, see `find_http_delimiter()`.
+ *
+ * Also finishes the tails shorter than a vector of the vectorized scans.
+ *
+ * @param buf The bytes to scan.
+ * @param len Number of bytes in `buf`.
+ * @param stop_at_space Whether spaces and `\t` end the scan.
+ * @return The offset of the first delimiter, or `len` if `buf` has none.
+ */
+size_t _find_http_delimiter_scalar(const char *, const size_t, const bool);
+
+/**
+ * @private
+ * @brief Parses one framing byte of a `chunked` body.
+ *
+ * @param body The body parser, not in the `HTTP_BODY_DATA` state.
+ * @param c The byte.
+ * @return `1` if the byte is valid, `0` otherwise.
+ */
+int _parse_http_chunk_byte(http_body_parser *, const char);
+#endif
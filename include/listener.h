@@ -0,0 +1,132 @@
+/**
+ * @file include/listener.h
+ * @brief Function Prototypes for creating listening sockets.
+ *
+ * This file contains the listener options structure and function prototypes to resolve the
+ * server's listen addresses (IPv4 and IPv6), create non-blocking listening sockets with the
+ * configured socket options and steer connections of `SO_REUSEPORT` groups to the worker running
+ * on the CPU that received them.
+ *
+ * Implemented in slib/listener.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _LISTENER_H
+#define _LISTENER_H 1
+
+/**
+ * @brief Defines the host value that listens on all IPv4 and IPv6 addresses.
+ */
+#ifndef LISTEN_ANY_HOST
+#define LISTEN_ANY_HOST "*"
+#endif
+
+#include <stdbool.h>
+
+#include <netdb.h>
+
+/**
+ * @struct listen_options
+ * @brief Defines the options of a listening socket.
+ *
+ * @see create_listen_socket
+ *
+ * @property int listen_options::backlog
+ * @brief Max length of the queue of pending connections, passed to `listen()`.
+ *
+ * @property bool listen_options::reuse_port
+ * @brief Sets `SO_REUSEPORT`, so several sockets can be bound to the same address and the kernel
+ * balances new connections between them.
+ *
+ * @property bool listen_options::v6_only
+ * @brief Sets `IPV6_V6ONLY` on IPv6 sockets. Without it, an IPv6 socket bound to `::` accepts IPv4
+ * connections as well (dual-stack).
+ *
+ * @property int listen_options::defer_accept
+ * @brief Time (in seconds) passed to `TCP_DEFER_ACCEPT`, a connection is only accepted once data
+ * arrives. `0` disables it.
+ *
+ * @property int listen_options::fastopen
+ * @brief Max number of pending TCP Fast Open requests, passed to `TCP_FASTOPEN`. `0` disables it.
+ */
+typedef struct listen_options {
+    int backlog;
+    bool reuse_port;
+    bool v6_only;
+    int defer_accept;
+    int fastopen;
+} listen_options;
+
+/**
+ * @brief Resolves the addresses to listen on for `host` and `port` with `getaddrinfo()`.
+ *
+ * `host` can be a numeric IPv4 or IPv6 address or a host name. If `host` is `LISTEN_ANY_HOST` or
+ * empty, the IPv4 and IPv6 wildcard addresses are returned. The returned list must be freed with
+ * `freeaddrinfo()`.
+ *
+ * @param host The host to listen on.
+ * @param port The port to listen on.
+ * @return On success, returns a list of addresses. On failure, returns `NULL`.
+ */
+struct addrinfo *resolve_listen_addresses(const char *, const int);
+
+/**
+ * @brief Checks if the list of addresses contains both IPv4 and IPv6 addresses.
+ *
+ * IPv6 sockets must be `IPV6_V6ONLY` in this case, or their wildcard addresses conflict with the
+ * IPv4 ones.
+ *
+ * @param addrs List of addresses returned by `resolve_listen_addresses()`.
+ * @return `true` if both families are present, `false` otherwise.
+ */
+bool has_mixed_address_families(const struct addrinfo *);
+
+/**
+ * @brief Creates a non-blocking socket listening on `addr` with the given options.
+ *
+ * `SO_REUSEADDR` is always set. `TCP_DEFER_ACCEPT` and `TCP_FASTOPEN` are set only if enabled in
+ * `opts`, failing to set them is not an error.
+ *
+ * @param addr The address to listen on.
+ * @param opts The socket options.
+ * @return On success, returns the file descriptor of the socket. On failure, returns `-1`.
+ */
+int create_listen_socket(const struct addrinfo *, const listen_options *);
+
+/**
+ * @brief Gets the port a listening socket is bound to, e.g. after binding to port `0`.
+ *
+ * @param listen_fd The listening socket.
+ * @return On success, returns the port. On failure, returns `-1`.
+ */
+int get_listen_port(const int);
+
+/**
+ * @brief Sets `SO_INCOMING_CPU` on a listening socket of a `SO_REUSEPORT` group.
+ *
+ * The kernel prefers the socket of the group whose CPU matches the CPU that received the
+ * connection.
+ *
+ * @param listen_fd The listening socket.
+ * @param cpu The CPU of the worker accepting from the socket.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int set_incoming_cpu(const int, const int);
+
+/**
+ * @brief Attaches a classic BPF program to a `SO_REUSEPORT` group that selects the socket by the
+ * CPU that received the connection.
+ *
+ * The program returns `<cpu> % n_sockets`, which is the index of the socket in the group (sockets
+ * are indexed in the order they were bound). Therefore, the n-th socket must be accepted from by
+ * the worker pinned to CPU n. Attaching the program to one socket attaches it to the whole group.
+ *
+ * @param listen_fd One of the listening sockets of the group.
+ * @param n_sockets Number of sockets in the group.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int attach_reuseport_cpu_steering(const int, const int);
+#endif
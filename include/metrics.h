@@ -0,0 +1,282 @@
+/**
+ * @file include/metrics.h
+ * @brief Function Prototypes for the server metrics.
+ *
+ * This file contains the metrics structures and function prototypes to count connections,
+ * requests and bytes, observe the latency of the stages of a request in histograms and format
+ * everything in the Prometheus text format. Every thread that records metrics gets a shard of its
+ * own, which is only written by that thread, so recording a metric never takes a lock or even a
+ * locked instruction. The shards are summed up when the metrics are formatted.
+ *
+ * Threads beyond the number of shards share an overflow shard, which is updated with atomic
+ * read-modify-write instructions instead.
+ *
+ * Implemented in slib/metrics.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H 1
+
+/**
+ * @brief Defines the number of buckets of a stage histogram, without the `+Inf` bucket.
+ */
+#define METRICS_N_BUCKETS 20
+
+/**
+ * @brief Defines the number of response status codes counted separately, all the others are
+ * counted as `other`.
+ */
+#define METRICS_N_STATUSES 14
+
+/**
+ * @brief Defines the `content-type` of the formatted metrics.
+ */
+#ifndef METRICS_CONTENT_TYPE
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+#endif
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+/**
+ * @brief Defines the counters.
+ *
+ *     - `METRICS_CONNECTIONS_ACCEPTED`: Connections accepted from the listening sockets.
+ *     - `METRICS_CONNECTIONS_REJECTED`: Accepted connections that were refused with `503`.
+ *     - `METRICS_CONNECTIONS_CLOSED`: Connections closed after they were served.
+ *     - `METRICS_BYTES_SENT`: Response bytes (heads and bodies) sent to clients.
+ */
+typedef enum metrics_counter {
+    METRICS_CONNECTIONS_ACCEPTED,
+    METRICS_CONNECTIONS_REJECTED,
+    METRICS_CONNECTIONS_CLOSED,
+    METRICS_BYTES_SENT,
+    METRICS_N_COUNTERS,
+} metrics_counter;
+
+/**
+ * @brief Defines the stages of a request whose latency is observed.
+ *
+ *     - `METRICS_ACCEPT_TO_FIRST_BYTE`: From accepting a connection to sending the first byte of
+ *       its first response.
+ *     - `METRICS_PARSE`: Parsing a request head, summed over the reads it arrived in.
+ *     - `METRICS_FILE_OPEN`: Opening and `fstat()`ing a file that isn't served from the file cache
+ *       or the file descriptor cache.
+ *     - `METRICS_SEND`: Sending a response, from the first byte of the head to the last byte of
+ *       the body.
+ */
+typedef enum metrics_stage {
+    METRICS_ACCEPT_TO_FIRST_BYTE,
+    METRICS_PARSE,
+    METRICS_FILE_OPEN,
+    METRICS_SEND,
+    METRICS_N_STAGES,
+} metrics_stage;
+
+/**
+ * @struct metrics_histogram
+ * @brief Defines a Prometheus histogram of a stage, with the buckets of `_metrics_bucket_bounds`.
+ *
+ * @property atomic_uint_fast64_t metrics_histogram::buckets
+ * @brief Number of observations in each bucket (not cumulative), the last one is `+Inf`.
+ *
+ * @property atomic_uint_fast64_t metrics_histogram::sum_ns
+ * @brief Sum of the observations in nanoseconds.
+ */
+typedef struct metrics_histogram {
+    atomic_uint_fast64_t buckets[METRICS_N_BUCKETS + 1];
+    atomic_uint_fast64_t sum_ns;
+} metrics_histogram;
+
+/**
+ * @struct metrics_shard
+ * @brief Defines the metrics recorded by a thread.
+ *
+ * Shards are aligned to a cache line, so threads never write to the same cache line.
+ *
+ * @property bool metrics_shard::shared
+ * @brief Whether the shard is the overflow shard shared by several threads.
+ *
+ * @property atomic_uint_fast64_t metrics_shard::counters
+ * @brief The counters, indexed by `metrics_counter`.
+ *
+ * @property atomic_uint_fast64_t metrics_shard::statuses
+ * @brief Number of responses with each status code of `_metrics_statuses`, the last one counts
+ * the other status codes.
+ *
+ * @property metrics_histogram metrics_shard::stages
+ * @brief The histograms, indexed by `metrics_stage`.
+ *
+ * @property long long metrics_shard::send_start_ns
+ * @brief Time the thread last started sending a response, see `start_metrics_send()`.
+ */
+typedef struct metrics_shard {
+    alignas(64) bool shared;
+    atomic_uint_fast64_t counters[METRICS_N_COUNTERS];
+    atomic_uint_fast64_t statuses[METRICS_N_STATUSES + 1];
+    metrics_histogram stages[METRICS_N_STAGES];
+    long long send_start_ns;
+} metrics_shard;
+
+/**
+ * @struct metrics
+ * @brief Defines the metrics of the server.
+ *
+ * @see create_metrics
+ * @see destroy_metrics
+ *
+ * @property int metrics::n_shards
+ * @brief Number of shards claimed by a single thread, the overflow shard follows them.
+ *
+ * @property metrics_shard* metrics::shards
+ * @brief `n_shards + 1` shards.
+ *
+ * @property atomic_int metrics::next_shard
+ * @brief Index of the next shard to be claimed by a thread.
+ *
+ * @property unsigned long metrics::generation
+ * @brief Value of `_metrics_generation` when the metrics were created.
+ */
+typedef struct metrics {
+    int n_shards;
+    metrics_shard *shards;
+    atomic_int next_shard;
+    unsigned long generation;
+} metrics;
+
+/**
+ * @brief Creates the metrics with `n_shards` shards, one for every thread that records metrics.
+ *
+ * @param n_shards Number of shards (e.g. the number of workers).
+ * @return On success, returns `1`. If the metrics are already created, returns `2`. On failure,
+ * returns `0`.
+ */
+int create_metrics(const int);
+
+/**
+ * @brief Frees the metrics. Must only be called once no other thread records metrics.
+ *
+ * @return void
+ */
+void destroy_metrics();
+
+/**
+ * @brief Checks if the metrics are created.
+ *
+ * @return `true` if the metrics are created, `false` otherwise.
+ */
+bool is_metrics_enabled();
+
+/**
+ * @brief Adds `value` to a counter. Does nothing if the metrics are not created.
+ *
+ * @param counter The counter.
+ * @param value The value to be added.
+ * @return void
+ */
+void add_metrics_counter(const metrics_counter, const uint64_t);
+
+/**
+ * @brief Counts a response with the status code `status`. Does nothing if the metrics are not
+ * created.
+ *
+ * @param status The status code of the response.
+ * @return void
+ */
+void count_metrics_status(const int);
+
+/**
+ * @brief Observes the latency of a stage. Does nothing if the metrics are not created.
+ *
+ * @param stage The stage.
+ * @param ns The latency in nanoseconds, negative values are observed as `0`.
+ * @return void
+ */
+void observe_metrics_stage(const metrics_stage, const long long);
+
+/**
+ * @brief Gets the monotonic time in nanoseconds, the clock all the stages are measured with.
+ *
+ * @return The monotonic time in nanoseconds.
+ */
+long long get_metrics_time();
+
+/**
+ * @brief Marks the start of sending a response on the calling thread.
+ *
+ * The time is kept in the thread's shard, so the caller of the send functions can use it with
+ * `get_metrics_send_start()` (e.g. for `METRICS_ACCEPT_TO_FIRST_BYTE`).
+ *
+ * @return The current time in nanoseconds, `0` if the metrics are not created.
+ */
+long long start_metrics_send();
+
+/**
+ * @brief Observes the latency of sending a response started with `start_metrics_send()`.
+ *
+ * The bytes are counted by the send functions themselves, see `METRICS_BYTES_SENT`.
+ *
+ * @param start The value returned by `start_metrics_send()`.
+ * @return void
+ */
+void end_metrics_send(const long long);
+
+/**
+ * @brief Gets the time the calling thread last started sending a response.
+ *
+ * @return The time in nanoseconds, `0` if the metrics are not created or no response was sent.
+ */
+long long get_metrics_send_start();
+
+/**
+ * @brief Formats the sum of all the shards in the Prometheus text format.
+ *
+ * @return The formatted metrics, which must be freed with `g_string_free()`. If the metrics are
+ * not created, returns `NULL`.
+ */
+GString *format_metrics();
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Gets the shard of the calling thread, claiming one if the thread has none yet.
+ *
+ * @param m The metrics.
+ * @return The shard of the thread, the overflow shard if all the other shards are claimed.
+ */
+metrics_shard *_get_metrics_shard(metrics *);
+
+/**
+ * @private
+ * @brief Adds `value` to a value of `shard`.
+ *
+ * The shard's owner thread is its only writer, so the value is updated with a relaxed load and
+ * store. The values of the overflow shard are updated with `atomic_fetch_add()`.
+ *
+ * @param shard The shard.
+ * @param value The value of the shard to be updated.
+ * @param delta The value to be added.
+ * @return void
+ */
+void _add_metrics_value(const metrics_shard *, atomic_uint_fast64_t *, const uint64_t);
+
+/**
+ * @private
+ * @brief Sums a value over all the shards.
+ *
+ * @param m The metrics.
+ * @param offset Offset of the value in `metrics_shard`.
+ * @return The sum.
+ */
+uint64_t _sum_metrics_value(const metrics *, const size_t);
+#endif
@@ -5,6 +5,12 @@
  * This file contains function prototypes to load MIME types for different file extensions from
  * etc/mimetypes.conf and retrive MIME type for different file type or url.
  *
+ * The MIME types in etc/mimetypes.conf are compiled into the server: `make` generates
+ * `include/mimetypes_table.h` (with scripts/gen_mimetypes.sh) from it, which holds a sorted table of
+ * the file extensions, their MIME types and the precomputed `content-type` header lines. Lookups
+ * binary search this table, so they don't hash or allocate and work without loading anything.
+ * `create_mime_table()` loads a MIME types file at runtime as an override of the builtin table.
+ *
  * Implemented in slib/mimetypes.c
  *
  * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
@@ -39,26 +45,76 @@
 #include <glib.h>
 
 /**
- * @brief Loads MIME types from `MIME_CONF_FILE` and stores them in a hash table.
+ * @struct mime_type
+ * @brief Defines a MIME type for a file extension.
+ *
+ * @property char* mime_type::ext
+ * @brief The lowercase file extension with a leading '.' (or `DEFAULT_MIMETYPE_KEY`).
+ *
+ * @property char* mime_type::mimetype
+ * @brief The MIME type.
+ *
+ * @property char* mime_type::header
+ * @brief The precomputed `content-type` header line (terminated by `\r\n`).
+ */
+typedef struct mime_type {
+    const char *ext;
+    const char *mimetype;
+    const char *header;
+} mime_type;
+
+/**
+ * @brief Loads MIME types from `MIME_CONF_FILE` as an override of the builtin MIME types.
+ *
+ * Same as `create_mime_table_from_file(MIME_CONF_FILE)`.
+ *
+ * @see create_mime_table_from_file()
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_mime_table();
+
+/**
+ * @brief Loads MIME types from `mime_file_path` and stores them in a hash table, which overrides
+ * the builtin MIME types.
  *
- * MIME types are stored in `MIME_CONF_FILE` as a series of records. Each record is a key-value pair
+ * MIME types are stored in the file as a series of records. Each record is a key-value pair
  * in the format `<file extension starting with '.'>=<mime type>`. If the line starts with a '#', it
  * is considered a comment. Each line is parsed to extract the key and value and stored in a hash
  * table. If the MIME type already exists in the hash table, the value is overwritten. Hash tables
  * provided by `glib` are used to store MIME types. `g_hash_table_new_full()` is used to create the
- * hash table.
+ * hash table. Extensions are matched case-insensitively, and extensions missing from the file are
+ * still looked up in the builtin table.
  *
  * If the MIME types are  loaded successfully, the function returns `1` and the MIME types are
  * stored in the `_mime_htab` variable. If the MIME types are already loaded (i.e. `_mime_htab` is
  * not `NULL`), the function returns `2` without performing any action. If the MIME types are not
  * loaded successfully, the function returns `0`.
  *
+ * This function must be called before the MIME types are looked up by other threads, use
+ * `reload_mime_table_from_file()` to replace the MIME types afterwards.
+ *
+ * @param mime_file_path Path to the MIME types file.
  * @return On success, returns a non-zero value. On failure, returns 0.
  */
-int create_mime_table();
+int create_mime_table_from_file(const char *);
 
 /**
- * @brief Destroys the MIME types hash table and releases memory allocated for it.
+ * @brief Loads MIME types from `mime_file_path` and replaces the current hash table with them,
+ * while other threads may be looking up MIME types.
+ *
+ * The new hash table is published with an atomic pointer store. Readers may still use the MIME
+ * types of the old hash table, so it is kept until `destroy_mime_table()`. If the file can't be
+ * loaded, the current MIME types are kept.
+ *
+ * @param mime_file_path Path to the MIME types file, `NULL` to only use the builtin MIME types.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int reload_mime_table_from_file(const char *);
+
+/**
+ * @brief Destroys the MIME types hash table, and the ones replaced by
+ * `reload_mime_table_from_file()`, and releases memory allocated for them. The builtin MIME types
+ * are used afterwards.
  *
  * @return void
  */
@@ -67,9 +123,10 @@ void destroy_mime_table();
 /**
  * @brief Gets the MIME type for the given file extension.
  *
- * If the MIME type is found in the hash table, the value is copied into `mimetype` and the same is
- * returned. If the MIME type is not found in the hash table, default MIME type (defined by
- * `DEFAULT_MIMETYPE_KEY`) is copied into `mimetype` and the same is returned.
+ * If the MIME type is found in the hash table or the builtin table, the value is copied into
+ * `mimetype` and the same is returned. If the MIME type is not found, default MIME type (defined by
+ * `DEFAULT_MIMETYPE_KEY`) is copied into `mimetype` and the same is returned. The returned string
+ * is valid until `destroy_mime_table()` is called.
  *
  * `mimetype` can be `NULL`, in this case, the function simply returns the MIME type.
  *
@@ -94,10 +151,31 @@ const char *get_mimetype_for_ext(const char *, char *);
  */
 const char *get_mimetype_for_url(const char *, char *);
 
+/**
+ * @brief Gets the precomputed `content-type` header line for the given URL.
+ *
+ * Similar to `get_mimetype_for_url()`, except it returns the whole header line (e.g.
+ * `content-type: text/html\r\n`), which can be copied into a response head as is.
+ *
+ * @see get_mimetype_for_url()
+ * @param url The URL path.
+ * @return On success, returns a pointer to the header line. On failure, returns `NULL`.
+ */
+const char *get_mimetype_header_for_url(const char *);
+
 // ==============================
 // Internal Helper Functions
 // ==============================
 
+/**
+ * @private
+ * @brief Loads MIME types from `mime_file_path` into a new hash table.
+ *
+ * @param mime_file_path Path to the MIME types file.
+ * @return On success, returns the hash table. On failure, returns `NULL`.
+ */
+GHashTable *_load_mime_table(const char *);
+
 /**
  * @private
  * @brief Extracts the file extension from the given URL path.
@@ -110,8 +188,28 @@ char *_get_ext_for_url(const char *);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given key, called automatically by
- * `g_hash_table_destroy()`.
+ * @brief Looks up the MIME type for the given file extension, in the hash table first and then in
+ * the builtin table. If it is not found, the default MIME type is returned.
+ *
+ * @param ext The file extension with a leading '.', can be `NULL`.
+ * @return On success, returns a pointer to the MIME type. On failure, returns `NULL`.
+ */
+const mime_type *_find_mime_type(const char *);
+
+/**
+ * @private
+ * @brief Looks up the MIME type for the given file extension in the builtin table with a
+ * case-insensitive binary search.
+ *
+ * @param ext The file extension with a leading '.'.
+ * @return If found, returns a pointer to the MIME type. Otherwise, returns `NULL`.
+ */
+const mime_type *_find_builtin_mime_type(const char *);
+
+/**
+ * @private
+ * @brief Called automatically by `g_hash_table_destroy()` for the given key. Keys are owned by
+ * their values (`mime_type::ext`), so nothing is released here.
  *
  * @param data Pointer to key in the hash table.
  * @return void
@@ -120,8 +218,8 @@ void _mime_htab_key_destroy(gpointer);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given value, called automatically by
- * `g_hash_table_destroy()`.
+ * @brief Releases the memory allocated for the given value (a `mime_type`), called automatically
+ * by `g_hash_table_destroy()`.
  *
  * @param data Pointer to value in the hash table.
  * @return void
@@ -0,0 +1,270 @@
+/**
+ * @file include/nanows_uring.h
+ * @brief Function Prototypes for a minimal io_uring ring of a worker event loop.
+ *
+ * This file contains the ring structure and function prototypes to queue operations on an io_uring
+ * instance and reap their completions, with the raw system calls (the server doesn't depend on
+ * liburing). Operations are queued in the submission ring without any system call and are
+ * submitted together by the `io_uring_enter()` call that waits for the next completions, so a
+ * worker submits and waits with a single system call per loop iteration.
+ *
+ * Receives pick their buffer from a ring of provided buffers when the data arrives, so idle
+ * connections with a receive in flight don't hold a buffer. A buffer is handed back with
+ * `recycle_uring_buffer()` once its data was copied out.
+ *
+ * Rings are not thread-safe, each worker owns one.
+ *
+ * Implemented in slib/nanows_uring.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _NANOWS_URING_H
+#define _NANOWS_URING_H 1
+
+/**
+ * @brief Defines the ID of the group of provided buffers receives select from.
+ */
+#define URING_BUF_GROUP 0
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <linux/io_uring.h>
+
+/**
+ * @struct uring
+ * @brief Defines an io_uring instance with its mapped submission and completion rings.
+ *
+ * @see create_uring
+ * @see submit_uring
+ * @see peek_uring_cqe
+ *
+ * @property int uring::fd
+ * @brief File descriptor of the io_uring instance.
+ *
+ * @property unsigned int uring::features
+ * @brief The `IORING_FEAT_*` flags of the kernel.
+ *
+ * @property unsigned int* uring::sq_head
+ * @brief Head of the submission ring, moved by the kernel as it consumes entries.
+ *
+ * @property unsigned int* uring::sq_tail
+ * @brief Tail of the submission ring, published by `submit_uring()`.
+ *
+ * @property unsigned int uring::sq_mask
+ * @brief Mask of the indexes of the submission ring.
+ *
+ * @property unsigned int uring::sq_entries
+ * @brief Number of entries of the submission ring.
+ *
+ * @property unsigned int uring::sqe_tail
+ * @brief Tail of the entries queued so far, ahead of `sq_tail` until they are submitted.
+ *
+ * @property io_uring_sqe* uring::sqes
+ * @brief The submission queue entries.
+ *
+ * @property unsigned int* uring::cq_head
+ * @brief Head of the completion ring, moved by `advance_uring_cq()`.
+ *
+ * @property unsigned int* uring::cq_tail
+ * @brief Tail of the completion ring, moved by the kernel as it posts completions.
+ *
+ * @property unsigned int uring::cq_mask
+ * @brief Mask of the indexes of the completion ring.
+ *
+ * @property io_uring_cqe* uring::cqes
+ * @brief The completion queue entries.
+ *
+ * @property void* uring::rings
+ * @brief Mapping of the submission and the completion ring (`IORING_FEAT_SINGLE_MMAP`).
+ *
+ * @property size_t uring::rings_size
+ * @brief Size of `rings`.
+ *
+ * @property size_t uring::sqes_size
+ * @brief Size of the mapping of `sqes`.
+ *
+ * @property io_uring_buf_ring* uring::buf_ring
+ * @brief Ring of the provided buffers, `NULL` until `register_uring_buffers()` is called.
+ *
+ * @property char* uring::bufs
+ * @brief Memory of the provided buffers, buffer `n` starts at `n * buf_size`.
+ *
+ * @property unsigned int uring::n_bufs
+ * @brief Number of provided buffers, a power of 2.
+ *
+ * @property unsigned int uring::buf_size
+ * @brief Size of a provided buffer.
+ *
+ * @property unsigned short uring::buf_tail
+ * @brief Tail of the buffer ring, moved as buffers are handed back.
+ */
+typedef struct uring {
+    int fd;
+    unsigned int features;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sqe_tail;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *rings;
+    size_t rings_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring *buf_ring;
+    char *bufs;
+    unsigned int n_bufs;
+    unsigned int buf_size;
+    unsigned short buf_tail;
+} uring;
+
+/**
+ * @brief Creates an io_uring instance with `entries` submission entries and maps its rings.
+ *
+ * The kernel must be able to wait with a timeout (`IORING_FEAT_EXT_ARG`, Linux 5.11) and to poll
+ * sockets internally (`IORING_FEAT_FAST_POLL`), or the ring isn't created.
+ *
+ * @param entries Number of submission entries, rounded up to a power of 2 by the kernel.
+ * @return Pointer to the ring, `NULL` on failure or if the kernel lacks io_uring or its features.
+ */
+uring *create_uring(const unsigned int);
+
+/**
+ * @brief Registers `n_bufs` provided buffers of `buf_size` bytes that receives select from.
+ *
+ * Needs Linux 5.19 (`IORING_REGISTER_PBUF_RING`).
+ *
+ * If the buffers are registered, the function returns `1`. If the ring already has buffers, the
+ * function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param ring The ring.
+ * @param n_bufs Number of buffers, a power of 2 up to 32768.
+ * @param buf_size Size of a buffer in bytes.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int register_uring_buffers(uring *, const unsigned int, const unsigned int);
+
+/**
+ * @brief Gets an empty submission entry, submitting the queued entries first if the ring is full.
+ *
+ * @param ring The ring.
+ * @return Pointer to the entry, `NULL` if the ring is still full.
+ */
+struct io_uring_sqe *get_uring_sqe(uring *);
+
+/**
+ * @brief Queues a multishot accept on the listening socket `fd`, which completes for every
+ * connection accepted until it fails or is cancelled.
+ *
+ * A completion without `IORING_CQE_F_MORE` ends the accept, it must be queued again.
+ *
+ * @param ring The ring.
+ * @param fd The listening socket.
+ * @param flags `SOCK_*` flags of the accepted sockets, as for `accept4()`.
+ * @param user_data Passed back in the completions.
+ * @return On success, returns `1`. If the submission ring is full, returns `0`.
+ */
+int queue_uring_accept(uring *, const int, const int, const uint64_t);
+
+/**
+ * @brief Queues a receive on `fd` into a provided buffer of `URING_BUF_GROUP`.
+ *
+ * The buffer is picked when the data arrives, its ID is in the `flags` of the completion (see
+ * `get_uring_buffer()`). The completion's result is `-ENOBUFS` if no buffer was free.
+ *
+ * @param ring The ring, with its buffers registered.
+ * @param fd The socket.
+ * @param user_data Passed back in the completion.
+ * @return On success, returns `1`. If the submission ring is full, returns `0`.
+ */
+int queue_uring_recv(uring *, const int, const uint64_t);
+
+/**
+ * @brief Queues a one-shot poll of `fd` for `events`.
+ *
+ * @param ring The ring.
+ * @param fd The file descriptor.
+ * @param events The `POLL*` events to wait for.
+ * @param user_data Passed back in the completion, whose result is the events that happened.
+ * @return On success, returns `1`. If the submission ring is full, returns `0`.
+ */
+int queue_uring_poll(uring *, const int, const unsigned int, const uint64_t);
+
+/**
+ * @brief Queues the cancellation of the operation queued with `user_data`.
+ *
+ * The cancelled operation completes with `-ECANCELED` (unless it completed already). The
+ * cancellation completes as well, with a `user_data` of `0`.
+ *
+ * @param ring The ring.
+ * @param user_data The `user_data` of the operation.
+ * @return On success, returns `1`. If the submission ring is full, returns `0`.
+ */
+int queue_uring_cancel(uring *, const uint64_t);
+
+/**
+ * @brief Submits the queued entries and waits for `wait_nr` completions, for at most `timeout`
+ * milliseconds.
+ *
+ * @param ring The ring.
+ * @param wait_nr Number of completions to wait for, `0` to only submit.
+ * @param timeout Max time (in milliseconds) to wait, `-1` to wait until the completions arrive.
+ * @return The number of entries submitted, also if the wait timed out. On failure, returns `-1`
+ * and sets `errno` (`EINTR` if the wait was interrupted by a signal).
+ */
+int submit_uring(uring *, const unsigned int, const int);
+
+/**
+ * @brief Gets the oldest completion that wasn't seen yet, without waiting.
+ *
+ * @param ring The ring.
+ * @return Pointer to the completion, `NULL` if there is none. Only valid until
+ * `advance_uring_cq()` is called.
+ */
+struct io_uring_cqe *peek_uring_cqe(uring *);
+
+/**
+ * @brief Marks the completion returned by `peek_uring_cqe()` as seen, the kernel can reuse its
+ * entry.
+ *
+ * @param ring The ring.
+ * @return void
+ */
+void advance_uring_cq(uring *);
+
+/**
+ * @brief Gets the provided buffer a completion of `queue_uring_recv()` received into.
+ *
+ * @param ring The ring.
+ * @param flags The `flags` of the completion.
+ * @param bid Set to the ID of the buffer, to hand it back with `recycle_uring_buffer()`.
+ * @return Pointer to the buffer, `NULL` if the completion has no buffer.
+ */
+char *get_uring_buffer(const uring *, const unsigned int, unsigned int *);
+
+/**
+ * @brief Hands the provided buffer `bid` back to the kernel, for the next receives.
+ *
+ * @param ring The ring.
+ * @param bid ID of the buffer.
+ * @return void
+ */
+void recycle_uring_buffer(uring *, const unsigned int);
+
+/**
+ * @brief Unmaps the rings and buffers, closes the io_uring instance and frees the ring.
+ *
+ * Operations still in flight are cancelled by the kernel, their completions are never seen.
+ *
+ * @param ring The ring, may be `NULL`.
+ * @return void
+ */
+void destroy_uring(uring *);
+#endif
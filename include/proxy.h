@@ -0,0 +1,691 @@
+/**
+ * @file include/proxy.h
+ * @brief Function Prototypes for proxying requests to upstream HTTP backends.
+ *
+ * This file contains the proxy structures and function prototypes to forward the requests of a
+ * URL prefix to a group of upstream HTTP/1.1 backends, configured with `proxy_routes` (e.g.
+ * `/api/=127.0.0.1:9000,127.0.0.1:9001;/app/=[::1]:9002`). Requests that match no route are
+ * served from `site_root_dir` as before.
+ *
+ * Every route balances its requests over its backends, either in turn (`round_robin`) or to the
+ * backend with the fewest requests in flight (`least_conn`). Connections to a backend are kept
+ * alive and pooled after a response, so most requests don't pay for a new TCP connection. A health
+ * check thread connects to every backend every `proxy_health_interval` seconds, backends that
+ * refuse the connection (or a request's connection) are skipped until a check succeeds.
+ *
+ * A proxied request never blocks its worker. The backend socket is non-blocking and registered
+ * with the worker's event loop: the request handler forwards as much as the backend and the client
+ * take, returns `CONN_PROXYING` and is called again once the socket it waits for is ready (see
+ * `proxy_conn::waits_client`). A backend that makes no progress for `proxy_timeout` seconds is
+ * given up on, the request is answered with `504` if no response head arrived yet.
+ *
+ * Request bodies are streamed to the backend as they arrive. Response bodies are relayed with
+ * `splice()` through a pipe, from the backend socket to the client socket, so they are never
+ * buffered in full or copied to user space (only `chunked` bodies go through a small buffer, to
+ * find their end). The backend is only read from once the client took what was relayed before.
+ *
+ * Hop-by-hop headers are not forwarded in either direction, neither are the headers the client or
+ * the backend name in their `Connection` header (RFC 9110, section 7.6.1).
+ *
+ * Routes and backends are set up once by `create_proxy()`, a config reload doesn't change them.
+ *
+ * Implemented in slib/proxy.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _PROXY_H
+#define _PROXY_H 1
+
+/**
+ * @brief Defines the size of the buffer the response head of a backend is received in. Backends
+ * with larger response heads are answered with `502`.
+ */
+#ifndef PROXY_BUF_SIZE
+#define PROXY_BUF_SIZE 8192
+#endif
+
+/**
+ * @brief Defines the max number of bytes moved by a single `splice()` call, the default capacity
+ * of a pipe.
+ */
+#ifndef PROXY_SPLICE_SIZE
+#define PROXY_SPLICE_SIZE 65536
+#endif
+
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "connection.h"
+#include "http_parser.h"
+#include "request.h"
+#include "response.h"
+
+/**
+ * @brief Defines how the requests of a route are balanced over its backends.
+ *
+ *     - `PROXY_ROUND_ROBIN`: The backends take the requests in turn.
+ *     - `PROXY_LEAST_CONN`: The backend with the fewest requests in flight takes the request.
+ */
+typedef enum proxy_balance { PROXY_ROUND_ROBIN, PROXY_LEAST_CONN } proxy_balance;
+
+/**
+ * @brief Defines the states of a proxied request.
+ *
+ *     - `PROXY_CONNECTING`: The connection to the backend is being established.
+ *     - `PROXY_SENDING`: The request head and body are being sent to the backend.
+ *     - `PROXY_RECEIVING`: Waiting for (more of) the response head.
+ *     - `PROXY_RELAYING`: The response is being relayed to the client.
+ *     - `PROXY_DONE`: The response was relayed, or relaying it failed.
+ */
+typedef enum proxy_state {
+    PROXY_CONNECTING,
+    PROXY_SENDING,
+    PROXY_RECEIVING,
+    PROXY_RELAYING,
+    PROXY_DONE
+} proxy_state;
+
+/**
+ * @struct proxy_backend
+ * @brief Defines an upstream backend and its pool of idle connections.
+ *
+ * Backends are shared by all the routes that list them.
+ *
+ * @property char* proxy_backend::name
+ * @brief The backend as configured (e.g. `127.0.0.1:9000`).
+ *
+ * @property addrinfo* proxy_backend::addrs
+ * @brief The resolved addresses of the backend, only the first one is connected to.
+ *
+ * @property atomic_int proxy_backend::n_active
+ * @brief Number of requests in flight to the backend.
+ *
+ * @property atomic_bool proxy_backend::is_healthy
+ * @brief Whether the backend accepted its last connection.
+ *
+ * @property pthread_mutex_t proxy_backend::lock
+ * @brief Mutex protecting `idle_fds` and `n_idle`.
+ *
+ * @property int* proxy_backend::idle_fds
+ * @brief Idle keep-alive connections to the backend, the most recently used one last.
+ *
+ * @property int proxy_backend::n_idle
+ * @brief Number of connections in `idle_fds`.
+ */
+typedef struct proxy_backend {
+    char *name;
+    struct addrinfo *addrs;
+    atomic_int n_active;
+    atomic_bool is_healthy;
+    pthread_mutex_t lock;
+    int *idle_fds;
+    int n_idle;
+} proxy_backend;
+
+/**
+ * @struct proxy_route
+ * @brief Defines a route of a URL prefix to a group of backends.
+ *
+ * @property char* proxy_route::prefix
+ * @brief The URL prefix (e.g. `/api/`).
+ *
+ * @property size_t proxy_route::prefix_len
+ * @brief Length of `prefix`.
+ *
+ * @property proxy_backend** proxy_route::backends
+ * @brief The backends of the route.
+ *
+ * @property unsigned int proxy_route::n_backends
+ * @brief Number of backends in `backends`.
+ *
+ * @property atomic_uint proxy_route::next_backend
+ * @brief Index of the backend the next request starts looking from.
+ */
+typedef struct proxy_route {
+    char *prefix;
+    size_t prefix_len;
+    proxy_backend **backends;
+    unsigned int n_backends;
+    atomic_uint next_backend;
+} proxy_route;
+
+/**
+ * @struct proxy_conn
+ * @brief Defines a proxied request and its connection to a backend.
+ *
+ * @see open_proxy_request
+ * @see forward_proxy_request
+ * @see relay_proxy_response
+ * @see close_proxy_conn
+ *
+ * @property int proxy_conn::fd
+ * @brief The non-blocking socket connected to the backend, `-1` if there is none.
+ *
+ * @property proxy_backend* proxy_conn::backend
+ * @brief The backend.
+ *
+ * @property proxy_route* proxy_conn::route
+ * @brief The route of the request.
+ *
+ * @property connection* proxy_conn::conn
+ * @brief The client connection.
+ *
+ * @property request* proxy_conn::req
+ * @brief The request, parsed from `connection::recv_buf`.
+ *
+ * @property proxy_state proxy_conn::state
+ * @brief The current state of the request.
+ *
+ * @property bool proxy_conn::waits_client
+ * @brief Whether the request waits for the client socket (the rest of the request body, or room
+ * for more of the response) instead of the backend socket.
+ *
+ * @property unsigned int proxy_conn::events
+ * @brief Events the request waits for on the socket, `POLLIN` or `POLLOUT`.
+ *
+ * @property time_t proxy_conn::expires_at
+ * @brief Monotonic time (in seconds) the backend is given up on at, unless it makes progress
+ * before.
+ *
+ * @property bool proxy_conn::is_timed_out
+ * @brief Set by the worker once `expires_at` passed while the request waited for the backend.
+ *
+ * @property unsigned int proxy_conn::n_attempts
+ * @brief Number of connections to a backend opened for the request so far.
+ *
+ * @property uint64_t proxy_conn::max_body_size
+ * @brief Max size (in bytes) of the request body.
+ *
+ * @property uint64_t proxy_conn::body_len
+ * @brief Number of bytes of the request body read so far.
+ *
+ * @property bool proxy_conn::has_request_body
+ * @brief Whether the request has a body.
+ *
+ * @property bool proxy_conn::is_body_read
+ * @brief Whether the request body was read completely, or there is none.
+ *
+ * @property GString* proxy_conn::out
+ * @brief Bytes of the request the backend didn't take yet.
+ *
+ * @property bool proxy_conn::is_reused
+ * @brief Whether the connection was taken from the pool of the backend.
+ *
+ * @property bool proxy_conn::keep_alive
+ * @brief Whether the backend keeps the connection open after the response.
+ *
+ * @property bool proxy_conn::has_body
+ * @brief Whether the response has a body, `false` for `HEAD` requests, `204` and `304`.
+ *
+ * @property bool proxy_conn::until_close
+ * @brief Whether the response body ends when the backend closes the connection, the client
+ * connection must be closed after it.
+ *
+ * @property bool proxy_conn::dechunk
+ * @brief Whether the chunk framing of the response body is removed for an HTTP/1.0 client, which
+ * then reads the body until the client connection is closed, or for an HTTP/2 client, whose
+ * stream frames the body.
+ *
+ * @property bool proxy_conn::is_complete
+ * @brief Whether the response was relayed completely, without extra bytes after it.
+ *
+ * @property http_parser proxy_conn::parser
+ * @brief The parser of the response head, its views point into `buf` until the body is relayed.
+ *
+ * @property http_body_parser proxy_conn::body
+ * @brief The body parser of the response.
+ *
+ * @property response* proxy_conn::res
+ * @brief The response to the client, set by the caller before `relay_proxy_response()`.
+ *
+ * @property bool proxy_conn::is_head_sent
+ * @brief Whether the response head was sent to the client.
+ *
+ * @property uint64_t proxy_conn::body_left
+ * @brief Number of bytes of a response body that isn't `chunked` left to relay, `UINT64_MAX` if it
+ * ends when the backend closes the connection.
+ *
+ * @property size_t proxy_conn::pos
+ * @brief Offset of the first byte of `buf` that is not relayed yet.
+ *
+ * @property size_t proxy_conn::n_sent
+ * @brief Number of bytes sent to the client so far.
+ *
+ * @property int* proxy_conn::pipe_fds
+ * @brief The pipe the response body is spliced through, `NULL` while the request has none.
+ *
+ * @property size_t proxy_conn::pipe_len
+ * @brief Number of bytes in the pipe the client socket didn't take yet.
+ *
+ * @property long long proxy_conn::send_start
+ * @brief Value of `start_metrics_send()` when the response head was sent.
+ *
+ * @property conn_state proxy_conn::next_state
+ * @brief State of the client connection once the response is relayed, kept for the handler.
+ *
+ * @property timespec proxy_conn::start
+ * @brief Monotonic time the request started being handled at, kept for the handler.
+ *
+ * @property size_t proxy_conn::recv_len
+ * @brief Number of bytes received in `buf`.
+ *
+ * @property char proxy_conn::buf
+ * @brief Buffer the response head (and the start of the body) is received in.
+ */
+typedef struct proxy_conn {
+    int fd;
+    proxy_backend *backend;
+    proxy_route *route;
+    connection *conn;
+    request *req;
+    proxy_state state;
+    bool waits_client;
+    unsigned int events;
+    time_t expires_at;
+    bool is_timed_out;
+    unsigned int n_attempts;
+    uint64_t max_body_size;
+    uint64_t body_len;
+    bool has_request_body;
+    bool is_body_read;
+    GString *out;
+    bool is_reused;
+    bool keep_alive;
+    bool has_body;
+    bool until_close;
+    bool dechunk;
+    bool is_complete;
+    http_parser parser;
+    http_body_parser body;
+    response *res;
+    bool is_head_sent;
+    uint64_t body_left;
+    size_t pos;
+    size_t n_sent;
+    int *pipe_fds;
+    size_t pipe_len;
+    long long send_start;
+    conn_state next_state;
+    struct timespec start;
+    size_t recv_len;
+    char buf[PROXY_BUF_SIZE];
+} proxy_conn;
+
+/**
+ * @brief Sets up the routes of `routes` and starts the health checks of their backends.
+ *
+ * `routes` is a list of `<prefix>=<backend>[,<backend>...]` separated by `;`. A backend is
+ * `<host>:<port>`, IPv6 addresses are enclosed in `[]`. If the proxy is set up successfully, the
+ * function returns `1`. If it is already set up, the function returns `2` without performing any
+ * action. On failure (e.g. a backend that can't be resolved), returns `0`.
+ *
+ * @param routes The routes, empty for none.
+ * @param balance `round_robin` or `least_conn`.
+ * @param pool_size Max number of idle connections kept per backend.
+ * @param health_interval Time (in seconds) between the health checks, `0` for none.
+ * @param timeout Max time (in seconds) a backend may take to connect, or to take or send more of a
+ * request or response.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_proxy(const char *, const char *, const int, const int, const int);
+
+/**
+ * @brief Stops the health checks, closes the pooled connections and frees the routes. Must only
+ * be called once no request is proxied anymore.
+ *
+ * If `destroy_proxy()` is called before `create_proxy()`, it does nothing.
+ *
+ * @return void
+ */
+void destroy_proxy();
+
+/**
+ * @brief Finds the route of `url`, the one with the longest prefix of `url`.
+ *
+ * @param url The request target.
+ * @return The route, or `NULL` if `url` matches no route or the proxy is not set up.
+ */
+proxy_route *find_proxy_route(const char *);
+
+/**
+ * @brief Starts proxying the request `req` to a backend of `route`.
+ *
+ * A backend is picked with the balancing of the route, skipping unhealthy ones, and a pooled
+ * connection to it is used if there is one. Otherwise a non-blocking connection to it is started,
+ * `forward_proxy_request()` goes on once it is established.
+ *
+ * The request is allocated from `connection::arena` and must be closed with
+ * `close_proxy_conn()`.
+ *
+ * @param route The route of the request.
+ * @param conn The client connection, in `CONN_HANDLING`.
+ * @param req The request, kept until the request is closed.
+ * @param max_body_size Max size (in bytes) of the request body.
+ * @param status Set to the status the client must be answered with on failure: `413` if the body
+ * is too large, `500` if no memory is left and `502` if no backend can be connected to.
+ * @return On success, returns the proxied request. On failure, returns `NULL`.
+ */
+proxy_conn *open_proxy_request(proxy_route *, connection *, request *, const uint64_t, int *);
+
+/**
+ * @brief Forwards the request to the backend and receives the response head, as far as the sockets
+ * allow without blocking.
+ *
+ * The request head is forwarded without the hop-by-hop headers and the headers named in the
+ * client's `Connection` header, with `x-forwarded-for` and `x-forwarded-proto` added, and the
+ * request body is streamed from the client connection with `read_connection_body()`. A backend
+ * that can't be connected to is marked down and the next one is tried. A request without a body
+ * that finds a pooled connection closed by the backend is retried on a new connection. Interim
+ * (`1xx`) responses are skipped.
+ *
+ * @param upstream The proxied request.
+ * @param status Set to the status the client must be answered with on failure: `400` if the
+ * request body couldn't be read, `413` if it is too large, `502` if no backend answered and `504`
+ * if the backend timed out.
+ * @return Returns `1` once the response head is parsed (`proxy_conn::parser`), `2` if the request
+ * must wait for the socket `proxy_conn::waits_client` and `proxy_conn::events` tell and `0` on
+ * failure.
+ */
+int forward_proxy_request(proxy_conn *, int *);
+
+/**
+ * @brief Relays the response of the backend to the client, as far as the sockets allow without
+ * blocking.
+ *
+ * The head is sent with the status line of `proxy_conn::res` (`response::http_ver` and
+ * `response::status_code`), the headers of the backend without the hop-by-hop ones and the ones
+ * named in its `Connection` header, and the headers set in `proxy_conn::res` (e.g. `connection`).
+ * The body is relayed with `splice()` if its length is known up front, `chunked` bodies are
+ * relayed through `proxy_conn::buf` as they are (or without their framing if
+ * `proxy_conn::dechunk` is set). Whatever the client socket doesn't take is queued on the
+ * connection (or parked on the HTTP/2 stream), the backend is read again once it is sent.
+ *
+ * @param upstream The proxied request, whose response head was received by
+ * `forward_proxy_request()`.
+ * @return Returns `1` once the response was relayed (`proxy_conn::n_sent` bytes), `2` if the
+ * request must wait for the socket `proxy_conn::waits_client` and `proxy_conn::events` tell and
+ * `0` if the client or the backend failed (or timed out) before the response was complete.
+ */
+int relay_proxy_response(proxy_conn *);
+
+/**
+ * @brief Frees the buffers of the request and gives the connection back to the pool of its
+ * backend if the response was complete and the backend keeps it alive, closes it otherwise.
+ *
+ * The caller removes the socket from its event loop first. If a `NULL` pointer is passed to this
+ * function, function does nothing.
+ *
+ * @param upstream The proxied request.
+ * @return void
+ */
+void close_proxy_conn(proxy_conn *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Parses a `<prefix>=<backends>` route and adds it (and its new backends) to the proxy.
+ *
+ * @param route The route.
+ * @return `1` if the route is valid and its backends were resolved, `0` otherwise.
+ */
+int _parse_proxy_route(char *);
+
+/**
+ * @private
+ * @brief Finds the backend `name`, resolving and adding it if it is new.
+ *
+ * @param name The backend, `<host>:<port>`.
+ * @return The backend, or `NULL` if it is invalid or can't be resolved.
+ */
+proxy_backend *_get_proxy_backend(const char *);
+
+/**
+ * @private
+ * @brief Picks a healthy backend of `route` with the balancing of the proxy.
+ *
+ * @param route The route.
+ * @return The backend, or `NULL` if no backend of the route is healthy.
+ */
+proxy_backend *_pick_proxy_backend(proxy_route *);
+
+/**
+ * @private
+ * @brief Takes an idle connection from the pool of `backend`. Connections closed by the backend
+ * while they were idle are closed and skipped.
+ *
+ * @param backend The backend.
+ * @return The socket, or `-1` if the pool has no usable connection.
+ */
+int _take_proxy_conn(proxy_backend *);
+
+/**
+ * @private
+ * @brief Starts a new non-blocking connection to `backend`.
+ *
+ * @param backend The backend.
+ * @return The socket, connected or still connecting, or `-1` if the backend can't be connected to.
+ */
+int _connect_proxy_backend(proxy_backend *);
+
+/**
+ * @private
+ * @brief Checks if the connection started by `_connect_proxy_backend()` is established.
+ *
+ * @param backend The backend.
+ * @param fd The socket.
+ * @return `1` if the connection is established, `2` if it is still in progress and `0` if it
+ * failed.
+ */
+int _check_proxy_connect(proxy_backend *, const int);
+
+/**
+ * @private
+ * @brief Opens a connection for the request to the next backend that can be connected to, and
+ * queues the request head on it.
+ *
+ * @param upstream The proxied request, without a connection.
+ * @return `1` if a connection was opened, `0` if no backend is left to try.
+ */
+int _open_proxy_backend(proxy_conn *);
+
+/**
+ * @private
+ * @brief Gives the connection of the request back to the pool of its backend or closes it, see
+ * `close_proxy_conn()`.
+ *
+ * @param upstream The proxied request.
+ * @return void
+ */
+void _close_proxy_backend(proxy_conn *);
+
+/**
+ * @private
+ * @brief Queues the request head in `proxy_conn::out`.
+ *
+ * @param upstream The proxied request.
+ * @return void
+ */
+void _queue_proxy_request_head(proxy_conn *);
+
+/**
+ * @private
+ * @brief Sends the request head and streams the request body to the backend.
+ *
+ * @param upstream The proxied request.
+ * @param status Set to `400` if the request body couldn't be read, `413` if it is too large.
+ * @return `1` once the request was sent, `2` if it waits for a socket and `0` on failure.
+ */
+int _send_proxy_request(proxy_conn *, int *);
+
+/**
+ * @private
+ * @brief Sends `proxy_conn::out` to the backend.
+ *
+ * @param upstream The proxied request.
+ * @return `1` if everything was sent, `2` if the socket didn't take all of it and `0` on failure.
+ */
+int _send_proxy_out(proxy_conn *);
+
+/**
+ * @private
+ * @brief Receives and parses the response head, skipping interim responses, and finds out how
+ * the response body is framed.
+ *
+ * @param upstream The proxied request.
+ * @return `1` once a valid response head was received, `2` if it waits for the backend and `0`
+ * otherwise.
+ */
+int _read_proxy_response_head(proxy_conn *);
+
+/**
+ * @private
+ * @brief Sends the response head to the client, with the body bytes received with it.
+ *
+ * @param upstream The proxied request.
+ * @return `1` if the head was sent (or queued), `0` otherwise.
+ */
+int _send_proxy_response_head(proxy_conn *);
+
+/**
+ * @private
+ * @brief Relays the rest of a response body that isn't `chunked`, `proxy_conn::body_left` bytes
+ * or everything until the backend closes the connection, with `splice()`.
+ *
+ * Falls back to `recv()` and `send_response()` through `proxy_conn::buf` if `splice()` is not
+ * supported, if the client's TLS records are encrypted in user space or if the client is an
+ * HTTP/2 stream.
+ *
+ * @param upstream The proxied request.
+ * @return `1` once the body was relayed, `2` if it waits for a socket and `0` if the client or the
+ * backend failed.
+ */
+int _splice_proxy_body(proxy_conn *);
+
+/**
+ * @private
+ * @brief Relays the rest of a `chunked` response body through `proxy_conn::buf`, with its framing
+ * unless `proxy_conn::dechunk` is set.
+ *
+ * @param upstream The proxied request.
+ * @return `1` once the body was relayed, `2` if it waits for a socket and `0` if the client or the
+ * backend failed or the body is malformed.
+ */
+int _relay_proxy_chunks(proxy_conn *);
+
+/**
+ * @private
+ * @brief Checks if the client took what was relayed so far, so more of the response can be read
+ * from the backend.
+ *
+ * @param upstream The proxied request.
+ * @return `true` if nothing is queued for the client, `false` otherwise.
+ */
+bool _can_relay_proxy(const proxy_conn *);
+
+/**
+ * @private
+ * @brief Makes the request wait for the client or the backend socket.
+ *
+ * @param upstream The proxied request.
+ * @param waits_client Whether the request waits for the client socket.
+ * @param events `POLLIN` or `POLLOUT`.
+ * @return `2`.
+ */
+int _wait_proxy(proxy_conn *, const bool, const unsigned int);
+
+/**
+ * @private
+ * @brief Checks if the header `key` of the response head has the token `token` in its
+ * comma-separated value (case insensitive).
+ *
+ * @param upstream The proxied request holding the response head.
+ * @param key The header name.
+ * @param token The token, not necessarily `\0` terminated.
+ * @param token_len Length of the token.
+ * @return `true` if a `key` header has the token, `false` otherwise.
+ */
+bool _has_proxy_header_token(const proxy_conn *, const char *, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Checks if the request header `key` is named in a `Connection` header of the request, it
+ * is meant for the proxy only.
+ *
+ * @param req The request.
+ * @param key The header name.
+ * @return `true` if the header is named, `false` otherwise.
+ */
+bool _is_proxy_connection_option(const request *, const char *);
+
+/**
+ * @private
+ * @brief Checks if the comma-separated header value `value` has the token `token` (case
+ * insensitive).
+ *
+ * @param value The header value.
+ * @param value_len Length of the value.
+ * @param token The token.
+ * @param token_len Length of the token.
+ * @return `true` if the value has the token, `false` otherwise.
+ */
+bool _has_header_token(const char *, const size_t, const char *, const size_t);
+
+/**
+ * @private
+ * @brief Checks if the header `key` is a hop-by-hop header, which is not forwarded.
+ *
+ * @param key The header name, not necessarily `\0` terminated.
+ * @param key_len Length of the header name.
+ * @return `true` if the header is hop-by-hop, `false` otherwise.
+ */
+bool _is_hop_by_hop_header(const char *, const size_t);
+
+/**
+ * @private
+ * @brief Takes the pipe of the calling thread for a request to splice its response body through,
+ * creating a new one if the thread has none.
+ *
+ * @return The pipe (`[0]` is the read end), or `NULL` if it can't be created.
+ */
+int *_take_proxy_pipe();
+
+/**
+ * @private
+ * @brief Gives the pipe of the request back to the calling thread if it is empty and the thread
+ * has none, frees it otherwise.
+ *
+ * @param upstream The proxied request.
+ * @return void
+ */
+void _put_proxy_pipe(proxy_conn *);
+
+/**
+ * @private
+ * @brief Closes and frees the pipe of a thread, called when the thread exits.
+ *
+ * @param pipe_fds The pipe.
+ * @return void
+ */
+void _free_proxy_pipe(void *);
+
+/**
+ * @private
+ * @brief Connects to every backend every `_proxy_health_interval` seconds and marks the ones that
+ * refuse the connection as unhealthy, until `destroy_proxy()` is called.
+ *
+ * @param arg Unused.
+ * @return `NULL`.
+ */
+void *_check_proxy_backends(void *);
+#endif
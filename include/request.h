@@ -23,14 +23,68 @@
 #define REQ_BUF_SIZE 8192
 #endif
 
-#include <glib.h>
+/**
+ * @brief Defines the max number of ranges in a `Range` request header. Requests with more ranges
+ * are answered with the whole file.
+ */
+#ifndef REQ_MAX_RANGES
+#define REQ_MAX_RANGES 16
+#endif
+
+/**
+ * @brief Defines the value returned by `parse_request_ranges()` if none of the requested ranges
+ * overlap the file.
+ */
+#ifndef REQ_RANGE_NOT_SATISFIABLE
+#define REQ_RANGE_NOT_SATISFIABLE -1
+#endif
+
+#include <stdbool.h>
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "http_parser.h"
+
+/**
+ * @struct request_header
+ * @brief Defines a request header, both strings point into the request buffer.
+ *
+ * @property const char* request_header::key
+ * @brief The header name.
+ *
+ * @property const char* request_header::value
+ * @brief The header value.
+ */
+typedef struct request_header {
+    const char *key;
+    const char *value;
+} request_header;
+
+/**
+ * @struct byte_range
+ * @brief Defines a range of bytes of a file, both offsets are inclusive.
+ *
+ * @property off_t byte_range::first
+ * @brief Offset of the first byte of the range.
+ *
+ * @property off_t byte_range::last
+ * @brief Offset of the last byte of the range.
+ */
+typedef struct byte_range {
+    off_t first;
+    off_t last;
+} byte_range;
 
 /**
  * @struct request
  * @brief Defines a request structure.
  *
  * This structure defines a request structure. It is used to store the connection file descriptor,
- * HTTP Method, URL, HTTP Version, and the request headers.
+ * HTTP Method, URL, HTTP Version, and the request headers. All the strings point into the request
+ * buffer, no memory is allocated for them. The request struct itself is allocated from an arena,
+ * either the arena of the connection it was received on or an arena owned by the request.
  *
  * @see get_request
  * @see parse_request
@@ -49,15 +103,35 @@
  * @property char* request::http_ver
  * @brief The HTTP version of the request. (e.g. `HTTP/1.1`)
  *
- * @property GHashTable* request::header_htab
- * @brief The hash table of the request headers.
+ * @property char* request::buf
+ * @brief Copy of the request head owned by the request, `NULL` if the request was parsed in place.
+ *
+ * @property arena* request::arena
+ * @brief The arena the request (and a response created from it) is allocated from.
+ *
+ * @property bool request::owns_arena
+ * @brief `true` if `arena` was created for the request and is destroyed with it.
+ *
+ * @property unsigned int request::n_headers
+ * @brief Number of request headers.
+ *
+ * @property request_header request::headers
+ * @brief The request headers, in the order they were received.
+ *
+ * @property const char* request::known_headers
+ * @brief Value of the first header with each known name, `NULL` if it wasn't received.
  */
 typedef struct request {
     int conn_fd;
     char *http_method;
     char *url;
     char *http_ver;
-    GHashTable *header_htab;
+    char *buf;
+    arena *arena;
+    bool owns_arena;
+    unsigned int n_headers;
+    request_header headers[HTTP_MAX_HEADERS];
+    const char *known_headers[HTTP_KNOWN_HEADERS];
 } request;
 
 /**
@@ -69,6 +143,11 @@ typedef struct request {
  * descriptor returned from `accept` must be passed to this function and not the file descriptor
  * used to accept the connection, i.e. file descriptor passed to `accept`.
  *
+ * The connection is read until the request head is complete (checked with `parse_http_request()`),
+ * the peer closes it or `REQ_BUF_SIZE` bytes are read, so a request head split across several TCP
+ * segments is received completely. Request bodies are not read. The workers don't use this
+ * function, they read requests with `read_connection()`.
+ *
  * For, more info about `accept()`, see POSIX socket function docs.
  *
  * @param conn_fd The file descriptor of the accepted connection, i.e the file descriptor returned
@@ -98,12 +177,31 @@ request *get_request(const int);
  */
 request *parse_request(const char *, const int);
 
+/**
+ * @brief Creates the request struct from a request head already parsed by `parse_http_request()`.
+ *
+ * No copy of the request head is made. The request line and header strings are `\0` terminated in
+ * place, which overwrites the separators (e.g. the `:` after a header name) in `req_buf`.
+ * Therefore, `req_buf` must not be parsed again and must outlive the returned request.
+ *
+ * The request struct is allocated from `a`, so it is released when `a` is reset and
+ * `close_request()` doesn't free any memory. If `a` is `NULL`, the request creates its own arena.
+ *
+ * @param req_buf The buffer containing the request head.
+ * @param parser The parser that parsed `req_buf`, in the `HTTP_PARSER_DONE` state.
+ * @param conn_fd The file descriptor of the accepted connection.
+ * @param a The arena the request is allocated from, can be `NULL`.
+ * @return On success, pointer to a request struct is returned. On failure, `NULL` is returned.
+ */
+request *parse_request_in_place(char *, const http_parser *, const int, arena *);
+
 /**
  * @brief Gets the value of a request header for a given key.
  *
- * If `header_key` is found in header table, the value is copied into `header_val` and the same is
- * returned. If the key is not found or an error occurs, `NULL` is returned and `header_val` is
- * not modified.
+ * Header names are compared case-insensitively. If `header_key` is found in the request headers,
+ * the value is copied into `header_val` and the same is returned. If the key is not found or an error occurs, `NULL` is returned and `header_val` is
+ * not modified. Known headers (see `enum http_known_header`) are not searched for, their values
+ * were stored when the request was parsed.
  *
  * `header_val` can be `NULL`, in which case, the function simply returns the value.
  *
@@ -114,6 +212,63 @@ request *parse_request(const char *, const int);
  */
 const char *get_request_header(const request *, const char *, char *);
 
+/**
+ * @brief Gets the value of the first request header with a known name, without comparing names.
+ *
+ * @param req The request struct.
+ * @param id The known header.
+ * @return The header value, or `NULL` if the request has no such header.
+ */
+const char *get_known_request_header(const request *, const http_known_header);
+
+/**
+ * @brief Evaluates the conditional request headers against the current validators of a file.
+ *
+ * If `If-None-Match` is present, the request is not modified if one of its entity tags (or `*`)
+ * matches `etag`, compared weakly (a `W/` prefix is ignored). Otherwise, if `If-Modified-Since` is
+ * present and a valid date, the request is not modified if `mtime` is not later than that date.
+ *
+ * @param req The request struct.
+ * @param etag The entity tag of the file, including the quotes.
+ * @param mtime The modification time of the file.
+ * @return `1` if a `304 Not Modified` response should be sent, `0` otherwise.
+ */
+int is_request_not_modified(const request *, const char *, const time_t);
+
+/**
+ * @brief Evaluates the `If-Range` request header against the current validators of a file.
+ *
+ * An `If-Range` entity tag must match `etag` exactly (weak tags never match), and an `If-Range`
+ * date must be equal to `mtime`. If the check fails, the `Range` header must be ignored and the
+ * whole file sent.
+ *
+ * @param req The request struct.
+ * @param etag The entity tag of the file, including the quotes.
+ * @param mtime The modification time of the file.
+ * @return `1` if `If-Range` is absent or matches the file, `0` otherwise.
+ */
+int is_request_range_fresh(const request *, const char *, const time_t);
+
+/**
+ * @brief Parses the `Range` request header for a file of `file_size` bytes.
+ *
+ * Only `bytes` ranges are supported, either `first-last`, `first-` or `-suffix_length`. Ranges
+ * that end past the file are truncated and ranges that start past the file are skipped. The
+ * remaining ranges are sorted and overlapping or adjacent ranges are merged, so at most one part is
+ * sent per byte (RFC 7233, section 4.1).
+ *
+ * If the header is absent, is malformed, uses another unit or has more than `max_ranges` ranges,
+ * the header is ignored and `0` is returned.
+ *
+ * @param req The request struct.
+ * @param file_size The size of the file in bytes.
+ * @param ranges Array of at least `max_ranges` ranges the parsed ranges are stored in.
+ * @param max_ranges Max number of ranges, usually `REQ_MAX_RANGES`.
+ * @return The number of ranges stored in `ranges`, `0` if the whole file should be sent, or
+ * `REQ_RANGE_NOT_SATISFIABLE` if no range overlaps the file.
+ */
+int parse_request_ranges(const request *, const off_t, byte_range *, const int);
+
 /**
  * @brief Closes the request connection and frees the request struct.
  *
@@ -136,20 +291,33 @@ void close_request(request *);
 
 /**
  * @private
- * @brief Allocates memory for a request struct and initializes it to default values.
+ * @brief Allocates memory for a request struct from a newly created arena owned by the request and
+ * initializes it to default values.
  *
  * Default values are:
  *     - conn_fd = -1
  *     - http_method = `NULL`
  *     - url = `NULL`
  *     - http_ver = `NULL`
- *     - header_htab = pointer to a newly allocated `GHashTable`
+ *     - buf = `NULL`
+ *     - n_headers = `0`
+ *     - known_headers = all `NULL`
  *
  * @return On success, pointer to a newly allocated request struct is returned. On failure, `NULL`
  * is returned.
  */
 request *_initialize_request();
 
+/**
+ * @private
+ * @brief Same as `_initialize_request()`, but allocates the request struct from `a`.
+ *
+ * @param a The arena the request is allocated from. If `NULL`, a new arena owned by the request is
+ * created.
+ * @return On success, pointer to the request struct is returned. On failure, `NULL` is returned.
+ */
+request *_initialize_request_from_arena(arena *);
+
 /**
  * @private
  * @brief Helper function to parse the request buffer and populate the request struct.
@@ -174,7 +342,7 @@ request *_initialize_request();
  *     - http_method = `GET`
  *     - url = `/index.html`
  *     - http_ver = `HTTP/1.1`
- *     - header_htab = `GHashTable` containing the following key-value pairs:
+ *     - headers = array containing the following key-value pairs:
  *         - `Host`: `localhost`
  *         - `Accept`: `text/html`
  *         - `Accept-Encoding`: `gzip`
@@ -185,19 +353,35 @@ request *_initialize_request();
  *         - `Upgrade-Insecure-Requests`: `1`
  *         - `Cache-Control`: `max-age=0`
  *
+ * The request head is copied once into `request::buf` and parsed in place with
+ * `parse_http_request()`.
+ *
  * @param req_buf The buffer containing the request data (read using `recv()`).
  * @param req The request struct to store the parsed request data.
- * @return On success, `1` is returned. On failure, `0` is returned.
+ * @return On success, `1` is returned. On failure (e.g. incomplete or malformed request head), `0`
+ * is returned.
  */
 int _parse_request(const char *, request *);
 
+/**
+ * @private
+ * @brief Points the request line and header strings of `req` to the views of `parser` in `buf`,
+ * `\0` terminating them in place.
+ *
+ * @param req The request struct.
+ * @param buf The parsed buffer.
+ * @param parser The parser, in the `HTTP_PARSER_DONE` state.
+ * @return On success, `1` is returned. On failure, `0` is returned.
+ */
+int _set_request_views(request *, char *, const http_parser *);
+
 /**
  * @private
  * @brief Helper function to free the request struct.
  *
- * This function frees the memory allocated for the request struct. This includes freeing the
- * memory allocated for GHashTable using `g_hash_table_destroy()` and freeing the memory allocated
- * to `http_method`, `url`, `http_ver` using `free()`. Once the request struct is freed, `req`
+ * If the request owns its arena, the arena is destroyed, which frees the request struct and the
+ * copy of the request head in `request::buf`. Otherwise nothing is freed, the memory is released
+ * when the arena is reset. Once the request struct is freed, `req`
  * parameter is set to `NULL`. If a `NULL` pointer is passed to this function, function does
  * nothing.
  *
@@ -208,21 +392,24 @@ void _free_request(request *);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given key, called automatically by
- * `g_hash_table_destroy()`.
- *
- * @param data Pointer to key in the hash table.
- * @return void
+ * @brief Parses a single range of a `Range` header (e.g. `0-499`, `500-` or `-500`).
+ *
+ * @param spec The range, not `\0` terminated.
+ * @param spec_len The length of `spec`.
+ * @param file_size The size of the file in bytes.
+ * @param range The range struct to store the range in, truncated to the file.
+ * @return If the range overlaps the file, returns `1`. If the range is valid but doesn't overlap
+ * the file, returns `2`. If the range is malformed, returns `0`.
  */
-void _req_header_htab_key_destroy(gpointer);
+int _parse_byte_range(const char *, const size_t, const off_t, byte_range *);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given value, called automatically by
- * `g_hash_table_destroy()`.
+ * @brief Compares two ranges by their first byte, passed to `qsort()`.
  *
- * @param data Pointer to value in the hash table.
- * @return void
+ * @param a Pointer to the first range.
+ * @param b Pointer to the second range.
+ * @return A negative value, `0` or a positive value if `a` starts before, with or after `b`.
  */
-void _req_header_htab_value_destroy(gpointer);
+int _compare_byte_ranges(const void *, const void *);
 #endif
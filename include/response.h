@@ -13,9 +13,9 @@
  *
  * @bug Respose headers cannot be modified or removed as of now. This is a known issue and will be
  * fixed in the future.
- * @bug `send_response_head()`: Function doesn't return error code.
  * @bug `send_response_file()`: No easy way to confirm that the file was sent sucessfully. Known
- * issue and will be fixed in the future.
+ * issue and will be fixed in the future. Use `send_response_fd()`, which sends an exact byte
+ * count, instead.
  */
 
 #ifndef _RESPONSE_H
@@ -28,6 +28,14 @@
 #define RES_BUF_SIZE 8192
 #endif
 
+/**
+ * @brief Defines the max size of a file body that is read into memory and sent together with the
+ * response head in a single `writev()`-style call. Larger bodies are sent using `sendfile()`.
+ */
+#ifndef RES_SMALL_BODY_SIZE
+#define RES_SMALL_BODY_SIZE 16384
+#endif
+
 /**
  * @brief Defines the max size of buffer for individual response headers.
  */
@@ -35,17 +43,75 @@
 #define RES_HEADER_BUF_SIZE 1024
 #endif
 
+/**
+ * @brief Defines the max number of headers in a response.
+ */
+#ifndef RES_MAX_HEADERS
+#define RES_MAX_HEADERS 32
+#endif
+
+#include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <glib.h>
 
+#include "arena.h"
+#include "connection.h"
+#include "http2.h"
+#include "metrics.h"
 #include "request.h"
+#include "tls.h"
+
+/**
+ * @struct response_header
+ * @brief Defines a response header, both strings are allocated from the response's arena.
+ *
+ * @property char* response_header::key
+ * @brief The header name.
+ *
+ * @property char* response_header::value
+ * @brief The header value.
+ */
+typedef struct response_header {
+    char *key;
+    char *value;
+} response_header;
+
+/**
+ * @struct error_response
+ * @brief Defines a pre-built error response, the status line and HTML body of an error status.
+ *
+ * @see get_error_response
+ * @see send_error_response
+ *
+ * @property int error_response::status
+ * @brief The status code. (e.g. `404`)
+ *
+ * @property const char* error_response::status_code
+ * @brief The status code and reason phrase, in the format of `response::status_code`.
+ *
+ * @property const char* error_response::body
+ * @brief The HTML body of the response.
+ *
+ * @property size_t error_response::body_len
+ * @brief The length of `body` in bytes.
+ */
+typedef struct error_response {
+    int status;
+    const char *status_code;
+    const char *body;
+    size_t body_len;
+} error_response;
 
 /**
  * @struct response
  * @brief Defines a rresponse structure.
  *
  * This structure defines a response structure. It is used to store the connection file descriptor,
- * HTTP Version, Status Code, and the response headers.
+ * HTTP Version, Status Code, and the response headers. The response struct and the strings it
+ * copies are allocated from an arena, either the arena of the request it was created from or an
+ * arena owned by the response.
  *
  * @see create_response
  * @see create_response_from_request
@@ -57,36 +123,44 @@
  * @see close_response
  *
  * @property int response::conn_fd
- * @brief The file descriptor of the connection that will be used to send the response.
+ * @brief The file descriptor of the connection that will be used to send the response. The
+ * response doesn't own the file descriptor and never closes it.
  *
- * @property char* response::http_ver
+ * @property const char* response::http_ver
  * @brief The HTTP version of the response. (e.g. `HTTP/1.1`)
  *
- * @property char* response::status_code
- * @brief The status code of the response. (e.g. `200 OK`)
+ * @property const char* response::status_code
+ * @brief The status code of the response. (e.g. `200 OK`) The string is not copied, it must
+ * outlive the response (e.g. a string literal).
+ *
+ * @property arena* response::arena
+ * @brief The arena the response is allocated from.
+ *
+ * @property bool response::owns_arena
+ * @brief `true` if `arena` was created for the response and is destroyed with it.
+ *
+ * @property unsigned int response::n_headers
+ * @brief Number of response headers.
  *
- * @property GHashTable* response::header_htab
- * @brief The hash table of the response headers.
+ * @property response_header response::headers
+ * @brief The response headers, serialized in the order they were set.
  */
 typedef struct response {
     int conn_fd;
-    char *http_ver;
-    char *status_code;
-    GHashTable *header_htab;
+    const char *http_ver;
+    const char *status_code;
+    arena *arena;
+    bool owns_arena;
+    unsigned int n_headers;
+    response_header headers[RES_MAX_HEADERS];
 } response;
 
 /**
- * @brief Creates a response struct, duplicates `conn_fd` and returns a pointer to the response
- * struct.
- *
- * This function allocates memory for a response struct by calling `_initialize_response`,
- * duplicates `conn_fd` using `dup()` and returns a pointer to the response struct. `conn_fd` is
- * duplicated to prevent from user closing the original connection file descriptor and leaving the
- * response struct in an invalid state. (e.g. `conn_fd` is closed, but the response struct is still
- * in use by the user, this causes errors when the user tries to send the response back to the
- * client).
+ * @brief Creates a response struct for `conn_fd` and returns a pointer to the response struct.
  *
- * For, more info about `dup()`, see docs/man pages for `unistd.h`.
+ * This function allocates memory for a response struct by calling `_initialize_response` and
+ * returns a pointer to the response struct. `conn_fd` is not duplicated, it must stay open until
+ * the response is sent, which is the case for connections owned by a worker.
  *
  * @param conn_fd The file descriptor of the connection that will be used to send the response.
  * @return On success, a pointer to the response struct is returned. On failure, `NULL` is returned.
@@ -101,10 +175,14 @@ response *create_response(const int);
  *
  * This function is similar to `create_response()`, and uses `create_response()` internally, except
  * that it takes a request struct as an argument and also copies `http_ver` from the request struct.
- * `http_ver` is a freshly allocated string and is independent of `request:http_ver`. It is adviced
- * to use `create_response_from_request()` instead of `create_response()` if you are using a request
+ * `http_ver` is a fresh copy and is independent of `request:http_ver`. It is adviced to use
+ * `create_response_from_request()` instead of `create_response()` if you are using a request
  * struct.
  *
+ * If the request is allocated from a connection's arena, the response is allocated from the same
+ * arena, so the whole exchange is released with a single `reset_arena()`. If `req` is `NULL`, an
+ * empty response without a connection is created.
+ *
  * @param req The request struct that will be used to create the response.
  * @return On success, a pointer to the response struct is returned. On failure, `NULL` is returned.
  *
@@ -115,9 +193,9 @@ response *create_response_from_request(const request *);
 /**
  * @brief Gets the value of the response header for the given key.
  *
- * If `header_key` is found in header table, the value is copied into `header_val` and the same
- * is returned. If the key is not found or an error occurs, `NULL` is returned and `header_val` is
- * not modified.
+ * Header names are compared case-insensitively. If `header_key` is found in the response headers,
+ * the value is copied into `header_val` and the same is returned. If the key is not found or an
+ * error occurs, `NULL` is returned and `header_val` is not modified.
  *
  * `header_val` can be `NULL`, in which case, the function simply returns the value.
  *
@@ -131,30 +209,32 @@ const char *get_response_header(const response *, const char *, char *);
 /**
  * @brief Sets the value of the response header for the given key.
  *
- * If `header_key` is not found in header table, `header_key` is added to the header table with
- * value `header_val`. If `header_key` is found in header table, `NULL` is returned and value in
- * header table is not modified. If an error occurs, `NULL` is returned and header table is not
- * modified.
+ * If `header_key` is not found in the response headers, `header_key` is added to the headers with
+ * value `header_val`. If `header_key` is found, or `RES_MAX_HEADERS` headers are already set,
+ * `NULL` is returned and the headers are not modified. If an error occurs, `NULL` is returned and
+ * the headers are not modified.
  *
- * `header_key` and `header_val` are duplicated using `strdup()` before storing in header table,
- * this is done to prevent from user freeing the original values and leaving dandling pointers in
- * the header table. The freshly allocated strings are freed interally and the user should not free
- * them.
+ * `header_key` and `header_val` are copied into the response's arena before storing them, this is
+ * done to prevent from user freeing the original values and leaving dandling pointers in the
+ * headers. The copies are released with the arena and the user should not free them.
  *
  * @param res The response struct.
  * @param header_key The key for the header.
  * @param header_val Header value to be set.
  * @return On success, returns `header_val` that was stored. On failure, returns `NULL`.
  */
-const char *set_response_header(const response *, const char *, const char *);
+const char *set_response_header(response *, const char *, const char *);
 
 /**
  * @brief Sends the response head (Start line and headers) to the client.
  *
- * This function sends the response  start line, followed by the all the response headers set in
- * header table for the response `res` and an  empty line to separate the response head from the
- * response body. This function must be called before sending the response body (i.e.,
- * `send_response_file()` or `send_response()`).)
+ * This function serializes the response start line, followed by the all the response headers set
+ * in header table for the response `res` and an empty line into one buffer using
+ * `_serialize_response_head()`, and sends it with a single `send()` call. This function must be
+ * called before sending the response body (i.e., `send_response_file()` or `send_response()`).
+ *
+ * Use `send_response_with_body()` or `send_response_with_fd()` to send the head and the body
+ * together, so small responses leave in one packet.
  *
  * @param res The response struct.
  * @return Returns the number of bytes sent. If an error occurs, returns the number of bytes that
@@ -162,14 +242,145 @@ const char *set_response_header(const response *, const char *, const char *);
  */
 ssize_t send_response_head(const response *);
 
+/**
+ * @brief Serializes all the response headers set in header table for the response `res` and
+ * appends them to `buf`.
+ *
+ * Each header is formatted as `<key>: <value>\r\n`. Neither the start line nor the empty line that
+ * terminates the response head is added.
+ *
+ * @param res The response struct.
+ * @param buf The buffer the headers are appended to.
+ * @return Returns the number of bytes appended to `buf`.
+ */
+size_t serialize_response_headers(const response *, GString *);
+
+/**
+ * @brief Sends the response head followed by `buf_size` bytes of `buf` as response body in a
+ * single `sendmsg()` call. The time the send takes is observed as `METRICS_SEND`.
+ *
+ * @param res The response struct.
+ * @param buf The buffer to be sent as response body, can be `NULL` if `buf_size` is `0`.
+ * @param buf_size The number of bytes of body to be sent.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`. If an error occurs while sending the body, returns the number of body bytes that were sent
+ * before the error occurred.
+ */
+ssize_t send_response_with_body(const response *, const char *, size_t);
+
+/**
+ * @brief Sends the response head followed by `count` bytes starting at `offset` from `file_fd` as
+ * response body.
+ *
+ * If the body is at most `RES_SMALL_BODY_SIZE` bytes, it is read into memory and sent together
+ * with the head in a single `sendmsg()` call, which fits small responses in one packet. Otherwise
+ * the head is sent with `MSG_MORE` and the body with `send_response_fd()`, so the kernel merges the
+ * head with the first bytes of the file. The time the send takes is observed as `METRICS_SEND`.
+ *
+ * @param res The response struct.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param offset The offset in the file to start sending from.
+ * @param count The number of bytes of body to be sent.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`. If an error occurs while sending the body, returns the number of body bytes that were sent
+ * before the error occurred.
+ */
+ssize_t send_response_with_fd(const response *, const int, off_t, size_t);
+
+/**
+ * @brief Gets the length of a `multipart/byteranges` body with a part for each range of a file.
+ *
+ * Used to set the `content-length` header before sending the body with
+ * `send_response_with_ranges()`.
+ *
+ * @param ranges The ranges of the file, sorted and not overlapping.
+ * @param n_ranges The number of ranges.
+ * @param file_size The size of the file in bytes.
+ * @param content_type The content type of the file.
+ * @param boundary The boundary that separates the parts.
+ * @return The length of the body in bytes.
+ */
+size_t get_multipart_ranges_length(const byte_range *, const int, const off_t, const char *,
+                                   const char *);
+
+/**
+ * @brief Sends the response head followed by a `multipart/byteranges` body with a part for each
+ * range of `file_fd`.
+ *
+ * Every part starts with a `content-type` and a `content-range` header, the bytes of the range
+ * are sent with `send_response_fd()`, so they are copied to the socket by the kernel. The head and
+ * the part headers are sent with `MSG_MORE`, so the kernel merges them with the file bytes. The
+ * time the send takes is observed as `METRICS_SEND`.
+ *
+ * @param res The response struct, with `content-type` and `content-length` already set.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param ranges The ranges of the file, sorted and not overlapping.
+ * @param n_ranges The number of ranges.
+ * @param file_size The size of the file in bytes.
+ * @param content_type The content type of the file.
+ * @param boundary The boundary that separates the parts.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`. If an error occurs while sending the body, returns the number of body bytes that were sent
+ * before the error occurred.
+ */
+ssize_t send_response_with_ranges(const response *, const int, const byte_range *, const int,
+                                  const off_t, const char *, const char *);
+
+/**
+ * @brief Gets the pre-built error response for the status code `status`.
+ *
+ * Error responses exist for `400`, `403`, `404`, `405`, `413`, `431`, `500`, `502`, `503` and
+ * `504`. The bodies are string literals, so sending an error response never formats or allocates
+ * its body.
+ *
+ * @param status The status code.
+ * @return The error response for `status`, or the `500` one if `status` has no error response.
+ */
+const error_response *get_error_response(const int);
+
+/**
+ * @brief Sends the pre-built error response for `status` with its head and body in a single
+ * `sendmsg()` call.
+ *
+ * The status code, `content-type` and `content-length` headers are set on `res`, other headers
+ * (e.g. `connection`) must be set by the caller. For responses to `HEAD` requests, set `head_only`
+ * to send the head without the body.
+ *
+ * @param res The response struct.
+ * @param status The status code, looked up with `get_error_response()`.
+ * @param head_only Whether only the head is sent.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`.
+ */
+ssize_t send_error_response(response *, const int, const bool);
+
+/**
+ * @brief Sends the pre-built error response for `status` with `connection: close` to `conn_fd`
+ * without creating a response struct.
+ *
+ * Used when no memory is left to create a connection or a response (e.g. to answer `503` to a
+ * connection that can't be accepted), so the head is formatted on the stack. The response is sent
+ * with `MSG_DONTWAIT`, so the caller never blocks on a slow client.
+ *
+ * @param conn_fd The file descriptor of the connection.
+ * @param status The status code, looked up with `get_error_response()`.
+ * @return Returns the number of body bytes sent. If the head couldn't be sent completely, returns
+ * `-1`.
+ */
+ssize_t send_raw_error_response(const int, const int);
+
 /**
  * @brief Sends data in a `FILE` stream to the client as response body.
  *
- * This function sends the response body from the `FILE` stream `file` to the client. The file
- * is read using (`fread()` as chunks of size `RES_BUF_SIZE` and sent to the client. If the number
- * of bytes read from the file doesn't match the number of bytes sent to the client, it is
- * considered an error and the function returns total number of bytes that were sent before the
- * error occurred.
+ * This function sends the response body from the current position of the `FILE` stream `file` to
+ * the end of the file. The file is read using `fread()` as chunks of size `RES_BUF_SIZE` and sent
+ * to the client. If the number of bytes read from the file doesn't match the number of bytes sent
+ * to the client, it is considered an error and the function returns total number of bytes that
+ * were sent before the error occurred.
+ *
+ * The server sends files with `send_response_fd()` (`sendfile()`) and cached files from the file
+ * cache, whose entries are mapped once with `FILE_CACHE_MAP_FILES`, so this function isn't on the
+ * request path.
  *
  * The function doesn't send response head (Start line and headers) to the client, it is assumed
  * that the client has already received the response head. The file stream is assumed to be
@@ -186,6 +397,32 @@ ssize_t send_response_head(const response *);
  */
 ssize_t send_response_file(const response *, FILE *);
 
+/**
+ * @brief Sends `count` bytes starting at `offset` from the file descriptor `file_fd` to the client
+ * as response body.
+ *
+ * The file is sent using `sendfile()`, so the data is copied from the page cache to the socket by
+ * the kernel without passing through user space. If `sendfile()` is not supported for the file
+ * descriptor (e.g. `EINVAL` or `ENOSYS`), the remaining bytes are sent with
+ * `_send_response_fd_fallback()`, which reads the file with `pread()` in chunks of size
+ * `RES_BUF_SIZE`. So is the whole file on TLS connections whose records are not encrypted by the
+ * kernel. On the connection a worker handles a request of (see `set_active_connection()`), the
+ * range is written with `write_connection_file()` instead, which queues what the socket doesn't
+ * take, and on an HTTP/2 stream with `send_http2_file()`, which parks what the client's flow
+ * control windows don't take.
+ *
+ * Like `send_response_file()`, this function doesn't send the response head and doesn't close
+ * `file_fd`. The file offset of `file_fd` is not modified.
+ *
+ * @param res The response struct.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param offset The offset in the file to start sending from.
+ * @param count The number of bytes to be sent.
+ * @return Returns the number of bytes sent. If an error occurs, returns the number of bytes that
+ * were sent before the error occurred.
+ */
+ssize_t send_response_fd(const response *, const int, off_t, size_t);
+
 /**
  * @brief Sends first `buf_size` bytes in `buf` to the client as response body.
  *
@@ -201,12 +438,11 @@ ssize_t send_response_file(const response *, FILE *);
 ssize_t send_response(const response *, const char *, ssize_t);
 
 /**
- * @brief Closes the response connection and frees the response struct.
+ * @brief Frees the response struct.
  *
- * All response connections needed to be closed after sending the response. Even if the response
- * connection is closed, the browser will still wait for resquest connection to be closed.
- * Therefore, this function, along with `close_request`, must be called to complete the
- * request-response cycle. This function calls `_free_response` to free the request struct.
+ * The connection file descriptor is not owned by the response and is not closed. This function,
+ * along with `close_request`, must be called to complete the request-response cycle. This function
+ * calls `_free_response` to free the response struct.
  *
  * @param req The response to be closed and freed.
  * @return void
@@ -222,13 +458,14 @@ void close_response(response *);
 
 /**
  * @private
- * @brief Allocates memory for a response struct and initializes it to default values.
+ * @brief Allocates memory for a response struct from a newly created arena owned by the response
+ * and initializes it to default values.
  *
  * Default values are:
  *     - conn_fd = -1
  *     - http_ver = `NULL`
  *     - status_code = `NULL`
- *     - header_htab = pointer to a newly allocated `GHashTable`
+ *     - n_headers = `0`
  *
  * @return On success, pointer to a newly allocated request struct is returned. On failure, `NULL`
  * is returned.
@@ -237,35 +474,124 @@ response *_initialize_response();
 
 /**
  * @private
- * @brief Helper function to free the response struct.
+ * @brief Same as `_initialize_response()`, but allocates the response struct from `a`.
  *
- * This function frees the memory allocated for the response struct. This includes freeing the
- * memory allocated for GHashTable using `g_hash_table_destroy()` and freeing the memory allocated
- * to `http_ver` and `status_code` using `free()`. Once the request struct is freed, `res` parameter
- * is set to `NULL`. If a `NULL` pointer is passed to this function, function does nothing.
+ * @param a The arena the response is allocated from. If `NULL`, a new arena owned by the response
+ * is created.
+ * @return On success, pointer to the response struct is returned. On failure, `NULL` is returned.
+ */
+response *_initialize_response_from_arena(arena *);
+
+/**
+ * @private
+ * @brief Serializes the response start line, headers and the empty line that ends the response
+ * head into a newly allocated `GString`.
  *
- * @param res The response struct to be freed and set to `NULL`.
- * @return void
+ * @param res The response struct.
+ * @return On success, returns the serialized head which must be freed with `g_string_free()`. If
+ * `http_ver` or `status_code` is not set, returns `NULL`.
  */
-void _free_response(response *);
+GString *_serialize_response_head(const response *);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given key, called automatically by
- * `g_hash_table_destroy()`.
+ * @brief Sends the response head followed by `buf_size` bytes of `buf`, without observing
+ * `METRICS_SEND`.
  *
- * @param data Pointer to key in the hash table.
- * @return void
+ * @see send_response_with_body
+ */
+ssize_t _send_response_with_body(const response *, const char *, size_t);
+
+/**
+ * @private
+ * @brief Sends the response head followed by `count` bytes starting at `offset` from `file_fd`,
+ * without observing `METRICS_SEND`.
+ *
+ * @see send_response_with_fd
  */
-void _res_header_htab_key_destroy(gpointer);
+ssize_t _send_response_with_fd(const response *, const int, off_t, size_t);
 
 /**
  * @private
- * @brief Releases the memory allocated for the given value, called automatically by
- * `g_hash_table_destroy()`.
+ * @brief Sends the response head followed by a `multipart/byteranges` body, without observing
+ * `METRICS_SEND`.
  *
- * @param data Pointer to value in the hash table.
+ * @see send_response_with_ranges
+ */
+ssize_t _send_response_with_ranges(const response *, const int, const byte_range *, const int,
+                                   const off_t, const char *, const char *);
+
+/**
+ * @private
+ * @brief Sends all the buffers in `iov` with `sendmsg()`, retrying on partial sends.
+ *
+ * `MSG_NOSIGNAL` is always added to `flags`, so a closed connection returns an error instead of
+ * raising `SIGPIPE`. `iov` is modified while sending. On TLS connections without kTLS and on
+ * HTTP/2 streams, every buffer is sent with `_send_conn()` instead. On the connection a worker
+ * handles a request of, the buffers are written with `write_connection()`, which returns `-1` if
+ * the connection failed.
+ *
+ * @param conn_fd The file descriptor of the connection.
+ * @param iov The buffers to be sent.
+ * @param iov_len The number of buffers in `iov`.
+ * @param flags Flags passed to `sendmsg()` (e.g. `MSG_MORE`).
+ * @return Returns the number of bytes sent. If an error occurs, returns the number of bytes that
+ * were sent before the error occurred.
+ */
+ssize_t _send_iov(const int, struct iovec *, int, const int);
+
+/**
+ * @private
+ * @brief Sends `count` bytes starting at `offset` from `file_fd` using a `pread()` and
+ * `_send_conn()` loop, used when `sendfile()` is not available.
+ *
+ * @param res The response struct.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param offset The offset in the file to start sending from.
+ * @param count The number of bytes to be sent.
+ * @return Returns the number of bytes sent. If an error occurs, returns the number of bytes that
+ * were sent before the error occurred.
+ */
+ssize_t _send_response_fd_fallback(const response *, const int, off_t, size_t);
+
+/**
+ * @private
+ * @brief Sends a buffer on the connection, on the active HTTP/2 stream if `conn_fd` has one and
+ * with `send_tls()` otherwise.
+ *
+ * @param conn_fd The file descriptor of the connection.
+ * @param buf The buffer to be sent.
+ * @param len Length of `buf`.
+ * @param flags Flags passed to `send()`, unused on HTTP/2 streams.
+ * @return The number of bytes sent, `-1` on failure.
+ */
+ssize_t _send_conn(const int, const void *, const size_t, const int);
+
+/**
+ * @private
+ * @brief Formats the delimiter and headers of a part of a `multipart/byteranges` body into `buf`.
+ *
+ * @param buf The buffer, `RES_HEADER_BUF_SIZE` bytes long.
+ * @param range The range of the part.
+ * @param file_size The size of the file in bytes.
+ * @param content_type The content type of the file.
+ * @param boundary The boundary that separates the parts.
+ * @return The length of the formatted headers.
+ */
+size_t _format_range_part_head(char *, const byte_range *, const off_t, const char *,
+                               const char *);
+
+/**
+ * @private
+ * @brief Helper function to free the response struct.
+ *
+ * If the response owns its arena, the arena is destroyed, which frees the response struct and its
+ * headers. Otherwise nothing is freed, the memory is released when the arena is reset. Once the
+ * response struct is freed, `res` parameter is set to `NULL`. If a `NULL` pointer is passed to
+ * this function, function does nothing.
+ *
+ * @param res The response struct to be freed and set to `NULL`.
  * @return void
  */
-void _res_header_htab_value_destroy(gpointer);
+void _free_response(response *);
 #endif
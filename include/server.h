@@ -13,19 +13,22 @@
 #ifndef _SERVER_H
 #define _SERVER_H 1
 
+#include <signal.h>
+
+#include "accesslog.h"
+#include "admission.h"
+#include "autoindex.h"
 #include "config.h"
+#include "encoding.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "listener.h"
+#include "metrics.h"
 #include "mimetypes.h"
+#include "proxy.h"
 #include "request.h"
 #include "response.h"
-
-/**
- * @brief Defines the maximum legnth for the queue of pending connnections, passed to `listen()`
- * function.
- *
- * For more Info about `backlog` parameter in `listen()` function, please refer to POSIX Sockets
- * Docs.
- */
-#define BACKLOG 16
+#include "worker.h"
 
 /**
  * @brief Defines the value for value for `Server` response header.
@@ -45,27 +48,49 @@
 #define FILE_PATH_BUF_SIZE 1024
 
 /**
- * @brief Loads the config, sets up the server and starts the main loop.
+ * @brief Defines the first file descriptor of the listening sockets passed to the server by
+ * systemd socket activation or by a previous server process (`SD_LISTEN_FDS_START`).
+ */
+#define LISTEN_FDS_START 3
+
+/**
+ * @brief Defines the environment variable a new server process started by `SIGUSR2` gets the pid
+ * of the process that started it in.
+ */
+#define PARENT_PID_ENV "NANOWS_PARENT_PID"
+
+/**
+ * @brief Loads the config, sets up the server and starts the worker threads.
  *
  * This function is the entry point for the server. It loads the config, sets up the server socket
- * and enters the main loop. This function never returns unless an error occurs or signalled by
- * OS. The server main loop runs on main thread and creates a new thread for each connection.
- * Requests are handled by the `handle_request()` function on the newly created thread.
+ * and starts a fixed pool of worker threads (configured by `WORKERS_CONF_KEY`). Each worker runs its
+ * own event loop, accepts connections and calls `handle_request()` once a request is received.
+ * Connections over `MAX_CONNECTIONS_CONF_KEY` or `MAX_CONNECTIONS_PER_IP_CONF_KEY` are answered
+ * with `503` as soon as they are accepted (see `admit_connection()`); the limits need a restart
+ * to change.
+ *
+ * Sending `SIGHUP` to the server reloads the config file and the MIME types file without a
+ * restart, `SIGUSR2` starts a new server process that takes over the listening sockets (see
+ * `_wait_for_signals()`). On `SIGINT`, `SIGTERM` or `SIGTSTP`, the workers stop accepting
+ * connections and finish the requests in flight for up to `SHUTDOWN_TIMEOUT_CONF_KEY` seconds.
  *
- * @return Never returns unless an error occurs or signalled by OS.
+ * @param argv The `NULL` terminated arguments of the program, the new server processes are started
+ * with them. They must stay valid while the server runs.
+ * @return Returns once the server is shut down by a signal. On failure, exits with exit code -1.
  * @see handle_request()
+ * @see start_workers()
  */
-void start_server();
+void start_server(char *[]);
 
 /**
  * @brief Stops the server and free all the resources.
  *
  * This function should be called when the server is no longer needed. It stops the server, closes
- * the server socket, unloads config and mime types hash table and frees all the resources.
+ * the worker threads and the server socket, unloads config and mime types hash table and frees all
+ * the resources.
  *
  * This function must be called before the program exits to ensure all the resources are freed.
- * Recommended to call this function from `atexit()` function and as signal handler using `signal()`
- * function.
+ * Recommended to call this function from `atexit()` function.
  *
  * If `stop_server()` is called before `start_server()`, it does nothing.
  *
@@ -74,43 +99,480 @@ void start_server();
 void stop_server();
 
 /**
- * @brief Sets up the server's POSIX socket.
+ * @brief Sets up the server's POSIX sockets.
  *
- * Creates a TCP socket and binds it to the host and port specified in the config file. On success,
- * it sets `tcp_socket` file descriptor to the socket created and returns. On failure, it exits
- * with exit code -1.
+ * Creates non-blocking TCP sockets listening on every address (IPv4 and IPv6) the host specified in
+ * the config file resolves to. If `REUSE_PORT_CONF_KEY` is set, `n_workers` `SO_REUSEPORT` sockets
+ * are created per address, one for each worker. If `PIN_WORKERS_CONF_KEY` is set as well, the
+ * sockets are steered to the worker pinned to the CPU that received the connection with
+ * `SO_INCOMING_CPU` and a BPF program. If `TLS_PORT_CONF_KEY` is set, sockets serving HTTPS are
+ * created on that port the same way and registered with `add_tls_listen_fd()`. On success, it sets
+ * `listen_fds` to the sockets created and returns. On failure, it exits with exit code -1.
  *
- * @param
+ * If the server is started with `LISTEN_FDS` and `LISTEN_PID` (by systemd socket activation or by
+ * a previous server process, see `_spawn_new_server()`), the inherited sockets are used instead
+ * and the host and port in the config file are ignored.
+ *
+ * @param n_workers The number of worker threads.
  * @return void
  */
-void setup_socket();
+void setup_socket(const int);
 
 /**
  * @brief Handles the client requests.
  *
- * This function is called by the main loop on a new thread for each connection. It handles the
- * client requests and sends the response back to the client. The file descriptor for the client
- * is passed as an pointer to the function by `pthread_create()`. The thread is detached after it
- * is created. So, the resources must be freed before the thread exits.
+ * This function is called by a worker event loop for each connection with a complete request head
+ * at the start of `connection::recv_buf`. It parses the request and sends the response back to the
+ * client. The connection socket is non-blocking and owned by the worker, so it must not be closed
+ * here; the response is queued on the connection for whatever the socket doesn't take.
  *
- * If any error occurs, returns a non-zero value. On success, returns 0. This return value is
- * currently unused.
+ * Every response carries a `content-length` header, so the connection can be reused for the next
+ * request. Whether the connection is kept open is decided by `_keep_connection_alive()`.
  *
- * @param new_conn_fd Pointer to the file descriptor of the new connection.
- * @return void
+ * Only `GET` and `HEAD` requests are served, responses to `HEAD` requests have no body. Errors are
+ * answered with the pre-built responses of `get_error_response()`: `400` for malformed requests,
+ * `404` for missing files, `403` for unreadable ones, `405` for other methods, `413` for request
+ * bodies longer than `max_request_body_size`, `431` for request heads longer than
+ * `max_request_head_size` and `500` for other failures. Request bodies are read and dropped with
+ * `discard_connection_body()`. The connection is closed after `400`, `413` and `431`, since the
+ * next request can't be found.
+ *
+ * URLs are resolved by `resolve_site_path()`, so a URL whose `..` segments lead out of the website
+ * root directory is answered with `400`. Files are opened with `open_fd_cache_entry()`, which never
+ * leaves the root directory (e.g. through a symbolic link) and keeps the files open for
+ * `fd_cache_ttl` seconds (see `FD_CACHE_ENTRIES_CONF_KEY`).
+ *
+ * URLs ending with `/` are served as the first of the directory's `index_files` that exists (see
+ * `INDEX_FILES_CONF_KEY`), directories without one are listed by `_send_directory_listing()` if
+ * `autoindex` is set and answered with `403` otherwise. URLs of directories without the trailing
+ * `/` are redirected to it with `301`, so relative links of the index file resolve correctly.
+ *
+ * If the file cache is enabled (see `FILE_CACHE_SIZE_CONF_KEY`), a cached file is sent from memory
+ * without touching the filesystem. Files small enough to be cached are added to the cache on a
+ * miss.
+ *
+ * If the metrics are enabled (see `METRICS_PATH_CONF_KEY`), requests for the metrics path are
+ * answered by `_send_metrics()` instead of a file.
+ *
+ * Requests whose URL matches a route of `proxy_routes` (see `PROXY_ROUTES_CONF_KEY`) are forwarded
+ * to an upstream backend by `_proxy_request()`, with any method and their body. The handler
+ * returns `CONN_PROXYING` while the request waits for its backend or the client, and the worker
+ * calls it again (with `connection::proxy` set) once it can go on.
+ *
+ * @param conn The connection with a complete request head.
+ * @return `CONN_READING` to keep the connection open for the next request, `CONN_CLOSING` to close
+ * it, `CONN_PROXYING` if a proxied request waits for a socket.
  */
-void *handle_request(void *);
+conn_state handle_request(connection *);
 
 /**
- * @brief Closes file stream, requests and response objects and free memory allocated for them.
+ * @brief Releases the opened file, closes requests and response objects and free memory allocated
+ * for them.
  *
- * If `file` or `req` or `resp` is `NULL`, then no action is taken. This helps in cases where
+ * If `file`, `req` or `resp` is `NULL`, then no action is taken for it. This helps in cases where
  * only one or two of the objects are allocated and needed to be freed.
  *
- * @param file File stream to be closed.
- * @param req Request object to be closed.
+ * @param file The opened file, released with `release_fd_cache_entry()`.
+ * @param req Request object to be freed, the connection socket is left open.
  * @param res Response object to be closed.
  * @return void
  */
-void clean_request(FILE *, request *, response *);
+void clean_request(fd_cache_entry *, request *, response *);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Decides whether the connection should be kept open after responding to `req`.
+ *
+ * `HTTP/1.1` connections are persistent unless the client sends `Connection: close`, `HTTP/1.0`
+ * connections are persistent only if the client sends `Connection: keep-alive`. A connection is
+ * never kept open after `keepalive_requests` requests, or once the server is shutting down.
+ *
+ * @param conn The connection.
+ * @param req The request being handled.
+ * @return `1` if the connection should be kept open, `0` otherwise.
+ */
+int _keep_connection_alive(const connection *, const request *);
+
+/**
+ * @private
+ * @brief Sends the cached file `entry` as the response to `req` with a single `sendmsg()` call.
+ *
+ * @param conn The connection.
+ * @param req The request being handled.
+ * @param entry The file cache entry.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_cached_file(const connection *, const request *, const file_cache_entry *,
+                             conn_state);
+
+/**
+ * @private
+ * @brief Sends a `304 Not Modified` response with the validators of the file and no body.
+ *
+ * @param conn The connection.
+ * @param req The request being handled.
+ * @param etag The entity tag of the file.
+ * @param last_modified The modification time of the file, formatted by `format_http_date()`.
+ * @param cache_control The value of the `cache-control` header, or `NULL` to omit it.
+ * @param vary Whether the `vary: accept-encoding` header is sent.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_not_modified(const connection *, const request *, const char *, const char *,
+                              const char *, const bool, conn_state);
+
+/**
+ * @private
+ * @brief Sends the cached file `entry` as the response to `req`, or a `304 Not Modified` response
+ * if the client's copy is still valid, and logs the request.
+ *
+ * @param conn The connection.
+ * @param req The request being handled.
+ * @param entry The file cache entry, the uncompressed file or one of its codings.
+ * @param cache_control The value of the `cache-control` header of a `304` response, or `NULL`.
+ * @param vary Whether a `304` response has the `vary: accept-encoding` header.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _serve_cached_file(const connection *, const request *, const file_cache_entry *,
+                              const char *, const bool, conn_state, const struct timespec *);
+
+/**
+ * @private
+ * @brief Sends the cached directory listing `listing`, or its gzip compressed copy if the client
+ * accepts it, with `_serve_cached_file()`.
+ *
+ * @param conn The connection.
+ * @param req The request for the directory.
+ * @param listing The file cache entry of the listing.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _serve_directory_listing(const connection *, const request *, file_cache_entry *,
+                                    conn_state, const struct timespec *);
+
+/**
+ * @private
+ * @brief Answers a request for a directory that has no index file.
+ *
+ * If `autoindex` is set, the directory is listed with `format_directory_listing()` in
+ * `autoindex_format`. The listing is added to the file cache as `listing_path` and served with
+ * `_serve_directory_listing()`, so it is only generated again once the directory changes.
+ * Listings that can't be cached are sent without validators. Otherwise, the request is answered
+ * with `403`, or with `404` if the directory doesn't exist.
+ *
+ * @param conn The connection.
+ * @param req The request for the directory.
+ * @param rel_path Path of the directory, resolved by `resolve_site_path()`.
+ * @param listing_path Key of the listing in the file cache, the path of the directory followed by
+ * `/`.
+ * @param use_cache Whether the listing can be added to the file cache.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_directory_listing(const connection *, const request *, const char *,
+                                   const char *, const bool, conn_state, const struct timespec *);
+
+/**
+ * @private
+ * @brief Sends a `301 Moved Permanently` response redirecting a URL of a directory to its canonical
+ * URL ending with `/`, and logs the request.
+ *
+ * @param conn The connection.
+ * @param req The request for the directory.
+ * @param rel_path Path of the directory, resolved by `resolve_site_path()`.
+ * @param next_state The state of the connection after the response.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_directory_redirect(const connection *, const request *, const char *, conn_state,
+                                    const struct timespec *);
+
+/**
+ * @private
+ * @brief Finds the first index file (see `INDEX_FILES_CONF_KEY`) of the directory `rel_path` that
+ * exists, looking it up in the file cache before opening it with `open_fd_cache_entry()`.
+ *
+ * @param cfg The configuration snapshot of the request.
+ * @param url URL path of the directory, ending with `/`.
+ * @param rel_path Buffer of `FILE_PATH_BUF_SIZE` bytes with the path of the directory, replaced
+ * with the path of the index file if one is found.
+ * @param file_path Buffer of `FILE_PATH_BUF_SIZE` bytes, set to the path of the index file
+ * (including `site_root_dir`) if one is found.
+ * @param index_url Buffer of `FILE_PATH_BUF_SIZE` bytes, set to the URL path of the index file if
+ * one is found.
+ * @return `1` if an index file is found, `0` otherwise.
+ */
+int _resolve_directory_index(const server_config *, const char *, char *, char *, char *);
+
+/**
+ * @private
+ * @brief Maps the `errno` of a failed open of a file or directory under the website root
+ * directory to the status code of the error response.
+ *
+ * @param err The `errno` value.
+ * @return `403` for `EACCES`, `404` for paths that don't exist or lead out of the root directory,
+ * `500` otherwise.
+ */
+int _get_open_error_status(const int);
+
+/**
+ * @private
+ * @brief Opens the precompressed sibling of `rel_path` for `encoding` with `open_fd_cache_entry()`.
+ *
+ * @param root_dir The website root directory.
+ * @param rel_path Path of the uncompressed file, relative to `root_dir`.
+ * @param encoding The coding of the sibling.
+ * @param sibling_path Buffer of `FILE_PATH_BUF_SIZE` bytes the path of the sibling (including
+ * `root_dir`) is stored in.
+ * @return On success, returns the opened sibling. If the sibling doesn't exist or isn't a regular
+ * file, returns `NULL`.
+ */
+fd_cache_entry *_open_precompressed_file(const char *, const char *, const content_encoding,
+                                         char *);
+
+/**
+ * @private
+ * @brief Sends the pre-built error response for `status` with `send_error_response()` and logs the
+ * request.
+ *
+ * If no response can be allocated, the error is sent with `send_raw_error_response()` and the
+ * connection is closed.
+ *
+ * @param conn The connection.
+ * @param req The request being handled, or `NULL` if the request head couldn't be parsed.
+ * @param status The status code of the error.
+ * @param next_state The state of the connection after the response.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_error(const connection *, const request *, const int, conn_state,
+                       const struct timespec *);
+
+/**
+ * @private
+ * @brief Sends the metrics formatted by `format_metrics()` and logs the request.
+ *
+ * The response has `cache-control: no-store`, so scrapers always get the current values. Responses
+ * to `HEAD` requests have the headers of the metrics without the body.
+ *
+ * @param conn The connection.
+ * @param req The request for the metrics path.
+ * @param next_state The state of the connection after the response.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent, `CONN_CLOSING` otherwise.
+ */
+conn_state _send_metrics(const connection *, const request *, conn_state,
+                         const struct timespec *);
+
+/**
+ * @private
+ * @brief Starts forwarding the request to a backend of `route`, see `_continue_proxy_request()`.
+ *
+ * @param conn The connection.
+ * @param req The request.
+ * @param route The route of the request, returned by `find_proxy_route()`.
+ * @param next_state The state of the connection after the response.
+ * @param start Monotonic time the request handling started at.
+ * @return `CONN_PROXYING` while the request waits for a socket, `next_state` once the response was
+ * relayed, `CONN_CLOSING` otherwise.
+ */
+conn_state _proxy_request(connection *, request *, proxy_route *, conn_state,
+                          const struct timespec *);
+
+/**
+ * @private
+ * @brief Forwards the request of `connection::proxy` to its backend and relays the response to
+ * the client, as far as the sockets allow without blocking.
+ *
+ * The status line of the backend is sent with the HTTP version of the client, followed by the
+ * headers of the backend and the `connection` headers for `next_state`. If no backend answered,
+ * the client gets `502 Bad Gateway` (`504 Gateway Timeout` if it took too long, or `413` for a
+ * body over `max_request_body_size`). Responses whose body ends when the backend closes the
+ * connection close the client connection as well. The worker closes `connection::proxy` once the
+ * handler returns another state than `CONN_PROXYING`.
+ *
+ * @param conn The connection, with `connection::proxy` set.
+ * @return `CONN_PROXYING` while the request waits for a socket, `next_state` of the request once
+ * the response was relayed, `CONN_CLOSING` otherwise.
+ */
+conn_state _continue_proxy_request(connection *);
+
+/**
+ * @private
+ * @brief Answers a request that couldn't be proxied with `status`, dropping the request body if
+ * the backend failed so the next request can be found.
+ *
+ * @param conn The connection.
+ * @param req The request.
+ * @param status The status code.
+ * @param next_state The state of the connection after the response.
+ * @param start Monotonic time the request handling started at.
+ * @return `next_state` if the response was sent and the body dropped, `CONN_CLOSING` otherwise.
+ */
+conn_state _fail_proxy_request(connection *, const request *, const int, const conn_state,
+                               const struct timespec *);
+
+/**
+ * @private
+ * @brief Sends the ranges of a file parsed by `parse_request_ranges()` as a `206 Partial Content`
+ * response, or a `416 Range Not Satisfiable` response if no range overlaps the file.
+ *
+ * A single range is sent as the response body, several ranges are sent as a
+ * `multipart/byteranges` body. The bytes of the ranges are sent with `sendfile()`.
+ *
+ * @param conn The connection.
+ * @param res The response, with the headers common to all the responses for the file set.
+ * @param file_fd The file descriptor of the file, opened for reading.
+ * @param file_size The size of the file in bytes.
+ * @param mimetype The content type of the file.
+ * @param ranges The ranges returned by `parse_request_ranges()`.
+ * @param n_ranges The value returned by `parse_request_ranges()`.
+ * @param next_state The state of the connection after the response, as decided by
+ * `_keep_connection_alive()`.
+ * @return On success, returns the number of body bytes sent. If the response couldn't be sent
+ * completely, returns `-1`.
+ */
+ssize_t _send_file_ranges(const connection *, response *, const int, const off_t, const char *,
+                          const byte_range *, const int, const conn_state);
+
+/**
+ * @private
+ * @brief Sets the `connection` and `keep-alive` response headers for `next_state`.
+ *
+ * @param conn The connection.
+ * @param res The response.
+ * @param next_state The state of the connection after the response.
+ * @return void
+ */
+void _set_connection_headers(const connection *, response *, const conn_state);
+
+/**
+ * @private
+ * @brief Counts the response status in the metrics and writes an entry for the request to the
+ * access log, if it is open.
+ *
+ * @param conn The connection the request was received on.
+ * @param req The request, or `NULL` if the request head couldn't be parsed.
+ * @param status The response status code.
+ * @param bytes Number of response body bytes sent.
+ * @param start Monotonic time at which handling the request started.
+ * @return void
+ */
+void _log_request(const connection *, const request *, const int, const size_t,
+                  const struct timespec *);
+
+/**
+ * @private
+ * @brief Formats the value of the `keep-alive` response header for the connection.
+ *
+ * @param conn The connection.
+ * @param buf Pointer to a string of at least `RES_HEADER_BUF_SIZE` bytes.
+ * @return Returns `buf`.
+ */
+char *_format_keep_alive(const connection *, char *);
+
+/**
+ * @private
+ * @brief Waits for the server signals on the calling thread and handles them until the server is
+ * asked to shut down.
+ *
+ *     - `SIGHUP`: Reloads the config with `_reload_server()`.
+ *     - `SIGUSR2`: Starts a new server process with `_spawn_new_server()`, e.g. after the binary is
+ *       upgraded. Once it is running, it sends `SIGTERM` to this process.
+ *     - `SIGCHLD`: Reaps a new server process that failed to start.
+ *     - `SIGINT`, `SIGTERM` and `SIGTSTP`: Returns, so the server is shut down.
+ *
+ * @param signal_set Signal set containing the signals, blocked in all the server threads.
+ * @return The signal the server is shut down by.
+ */
+int _wait_for_signals(const sigset_t *);
+
+/**
+ * @private
+ * @brief Reloads the config file with `reload_config()` and the MIME types file with
+ * `reload_mime_table_from_file()`.
+ *
+ * The new configuration snapshot is picked up by the next request. The file cache is cleared,
+ * since its entries hold headers (e.g. `cache-control`) and listings of the old configuration. `default_page`,
+ * `site_root_dir`, `keepalive_requests` and `shutdown_timeout` are applied to new requests, the
+ * other settings (e.g. host, port, worker threads, keep-alive timeout and file cache limits) need a
+ * restart, which `SIGUSR2` does without closing the listening sockets. If `site_root_dir` is
+ * changed, the file cache is bypassed until the server is restarted.
+ *
+ * @return void
+ */
+void _reload_server();
+
+/**
+ * @private
+ * @brief Sets `listen_fds` to the sockets passed with `LISTEN_FDS` if `LISTEN_PID` is this
+ * process.
+ *
+ * The sockets start at `LISTEN_FDS_START`. They are used as `n_workers` `SO_REUSEPORT` groups if
+ * `REUSE_PORT_CONF_KEY` is set and there is a group for every worker, otherwise they are shared by
+ * all the workers. The sockets named `https` in `LISTEN_FDNAMES` serve HTTPS.
+ *
+ * @param n_workers The number of worker threads.
+ * @return `1` if the inherited sockets are used, `0` if there are none.
+ */
+int _inherit_listen_fds(const int);
+
+/**
+ * @private
+ * @brief Starts a new server process from the same binary, which inherits the listening sockets.
+ *
+ * The sockets are passed as `LISTEN_FDS` starting at `LISTEN_FDS_START`, named `http` or `https`
+ * in `LISTEN_FDNAMES`, and the pid of this process as `PARENT_PID_ENV`. The new process is started
+ * with the arguments saved by `start_server()` and loads the config file again.
+ *
+ * The environment, the binary's path and the copies of the sockets are prepared before forking,
+ * the child only moves the sockets in place with `dup2()` and calls `execve()`.
+ *
+ * @return On success, returns the pid of the new process. On failure, returns `-1`.
+ */
+pid_t _spawn_new_server();
+
+/**
+ * @private
+ * @brief Finds the binary `execvp()` would run for `name`, looking it up in `PATH` if it has no
+ * slash.
+ *
+ * @param name The name the server was started as (`argv[0]`).
+ * @return The path of the binary, to be freed with `free()`. `NULL` if it isn't found.
+ */
+char *_find_server_binary(const char *);
+
+/**
+ * @private
+ * @brief Writes `LISTEN_PID=<pid>` to `buf` without `snprintf()`, so it is safe to call in a
+ * forked child of a multithreaded process.
+ *
+ * @param buf The buffer, at least 32 bytes.
+ * @param pid The pid to write.
+ * @return void
+ */
+void _format_listen_pid(char *, pid_t);
+
+/**
+ * @private
+ * @brief Sends `SIGTERM` to the server process that started this one with `_spawn_new_server()`,
+ * so it finishes its requests in flight and exits.
+ *
+ * @return void
+ */
+void _take_over_from_parent();
 #endif
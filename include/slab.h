@@ -0,0 +1,252 @@
+/**
+ * @file include/slab.h
+ * @brief Function Prototypes for the per-worker slab allocator.
+ *
+ * This file contains the slab pool and slab cache structures and function prototypes to create and
+ * destroy a worker's slab cache and to allocate from it. A slab cache holds a pool of fixed size
+ * objects for every size class it is created with (e.g. connections, receive buffers and
+ * connection arenas). Objects are carved out of slabs mapped with `mmap()` and bound to the
+ * worker's NUMA node, and freed objects are kept on the pool's free list for the next allocation,
+ * so the hot allocations of a worker never take a lock and never leave its node.
+ *
+ * A thread allocates from the cache set with `set_thread_slab_cache()`. Threads without a cache,
+ * and sizes larger than its largest size class, fall back to `malloc()`, so `slab_alloc()` can be
+ * used wherever `malloc()` is.
+ *
+ * Implemented in slib/slab.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H 1
+
+/**
+ * @brief Defines the size (in bytes) of the slabs objects are carved out of.
+ */
+#ifndef SLAB_SIZE
+#define SLAB_SIZE 262144
+#endif
+
+/**
+ * @brief Defines the max number of size classes of a slab cache.
+ */
+#ifndef SLAB_CACHE_MAX_POOLS
+#define SLAB_CACHE_MAX_POOLS 8
+#endif
+
+/**
+ * @brief Defines the max number of NUMA nodes slabs can be bound to.
+ */
+#ifndef SLAB_MAX_NUMA_NODES
+#define SLAB_MAX_NUMA_NODES 1024
+#endif
+
+#include <stddef.h>
+
+struct slab_pool;
+
+/**
+ * @struct slab_header
+ * @brief Defines the header in front of every object returned by `slab_alloc()`.
+ *
+ * The header is 16 bytes, so the object after it keeps the alignment of the slot (or of
+ * `malloc()`).
+ *
+ * @property slab_pool* slab_header::pool
+ * @brief Pool the object belongs to, `NULL` if it was allocated with `malloc()`.
+ *
+ * @property size_t slab_header::size
+ * @brief Usable size of an allocated object.
+ *
+ * @property slab_header* slab_header::next
+ * @brief Next object of the free list, for a free object.
+ */
+typedef struct slab_header {
+    struct slab_pool *pool;
+    union {
+        size_t size;
+        struct slab_header *next;
+    };
+} slab_header;
+
+/**
+ * @struct slab
+ * @brief Defines a slab, the header at the start of every mapping of a pool.
+ *
+ * @property slab* slab::next
+ * @brief The previously mapped slab of the pool.
+ *
+ * @property size_t slab::size
+ * @brief Size of the mapping in bytes.
+ */
+typedef struct slab {
+    struct slab *next;
+    size_t size;
+} slab;
+
+/**
+ * @struct slab_pool
+ * @brief Defines a pool of objects of one size class.
+ *
+ * A pool is owned by one thread: objects must be allocated and freed by that thread, or after it
+ * has exited.
+ *
+ * @property size_t slab_pool::obj_size
+ * @brief Usable size of an object in bytes.
+ *
+ * @property size_t slab_pool::slot_size
+ * @brief Size of an object and its header in bytes.
+ *
+ * @property int slab_pool::numa_node
+ * @brief NUMA node the slabs are bound to, `-1` if they are not bound.
+ *
+ * @property slab_header* slab_pool::free_list
+ * @brief Head of the list of free objects.
+ *
+ * @property slab* slab_pool::slabs
+ * @brief The most recently mapped slab.
+ *
+ * @property size_t slab_pool::n_objects
+ * @brief Number of objects in all the slabs.
+ *
+ * @property size_t slab_pool::n_free
+ * @brief Number of objects on the free list.
+ */
+typedef struct slab_pool {
+    size_t obj_size;
+    size_t slot_size;
+    int numa_node;
+    slab_header *free_list;
+    slab *slabs;
+    size_t n_objects;
+    size_t n_free;
+} slab_pool;
+
+/**
+ * @struct slab_cache
+ * @brief Defines a slab cache, the pools of a worker sorted by size class.
+ *
+ * @property slab_pool* slab_cache::pools
+ * @brief The pools, from the smallest size class to the largest.
+ *
+ * @property int slab_cache::n_pools
+ * @brief Number of pools in `pools`.
+ *
+ * @property int slab_cache::numa_node
+ * @brief NUMA node the slabs are bound to, `-1` if they are not bound.
+ */
+typedef struct slab_cache {
+    slab_pool pools[SLAB_CACHE_MAX_POOLS];
+    int n_pools;
+    int numa_node;
+} slab_cache;
+
+/**
+ * @brief Creates a slab cache with a pool for each of the `n_sizes` object sizes in `sizes`.
+ *
+ * No memory is mapped until the first allocation of a size class. Slabs are bound to `numa_node`
+ * with `mbind()` (`MPOL_PREFERRED`, so allocations still succeed when the node is full) before
+ * they are touched. If the kernel doesn't support NUMA policies, the slabs are placed on the node
+ * of the thread that first touches them, which is the worker's node if it is pinned.
+ *
+ * @param sizes Object sizes in bytes, in any order. Sizes after the first `SLAB_CACHE_MAX_POOLS`
+ * are ignored.
+ * @param n_sizes Number of sizes in `sizes`.
+ * @param numa_node NUMA node of the slabs, `-1` to not bind them.
+ * @return On success, returns the cache. On failure, returns `NULL`.
+ */
+slab_cache *create_slab_cache(const size_t *, const int, const int);
+
+/**
+ * @brief Unmaps all the slabs of the cache and frees it.
+ *
+ * All the objects allocated from the cache must be freed before, or never be used again. If a
+ * `NULL` pointer is passed to this function, function does nothing.
+ *
+ * @param cache The cache to be destroyed.
+ * @return void
+ */
+void destroy_slab_cache(slab_cache *);
+
+/**
+ * @brief Sets the slab cache `slab_alloc()` allocates from on the calling thread.
+ *
+ * @param cache The cache, owned by the calling thread, or `NULL` to allocate with `malloc()`.
+ * @return void
+ */
+void set_thread_slab_cache(slab_cache *);
+
+/**
+ * @brief Allocates `size` bytes from the smallest size class of the calling thread's slab cache
+ * that fits them.
+ *
+ * The memory is aligned like `malloc()`'s. If the thread has no cache or `size` is larger than
+ * all its size classes, the memory is allocated with `malloc()`.
+ *
+ * @param size Number of bytes to allocate.
+ * @return On success, pointer to the allocated memory is returned. On failure, `NULL` is returned.
+ */
+void *slab_alloc(const size_t);
+
+/**
+ * @brief Resizes the memory `ptr` allocated by `slab_alloc()` to `size` bytes, like `realloc()`.
+ *
+ * Memory that is already large enough is returned as is. Otherwise, new memory is allocated with
+ * `slab_alloc()`, the contents are copied and `ptr` is freed.
+ *
+ * @param ptr The memory to be resized, or `NULL` to allocate new memory.
+ * @param size New size in bytes.
+ * @return On success, pointer to the resized memory is returned. On failure, `NULL` is returned
+ * and `ptr` is left unchanged.
+ */
+void *slab_realloc(void *, const size_t);
+
+/**
+ * @brief Frees the memory `ptr` allocated by `slab_alloc()` or `slab_realloc()`.
+ *
+ * Objects of a slab pool go back to the free list of their pool, so they must be freed by the
+ * thread that owns the pool or after it has exited. If a `NULL` pointer is passed to this
+ * function, function does nothing.
+ *
+ * @param ptr The memory to be freed.
+ * @return void
+ */
+void slab_free(void *);
+
+/**
+ * @brief Gets the NUMA node of `cpu` from `/sys/devices/system/cpu`.
+ *
+ * @param cpu The CPU.
+ * @return The NUMA node of the CPU. If it isn't known (e.g. the kernel is built without NUMA),
+ * returns `-1`.
+ */
+int get_cpu_numa_node(const int);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Maps a new slab for `pool` and adds its objects to the free list.
+ *
+ * @param pool The pool.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _add_slab(slab_pool *);
+
+/**
+ * @private
+ * @brief Sets the memory policy of `len` bytes at `addr` to prefer `numa_node`, with the `mbind`
+ * system call.
+ *
+ * @param addr Start of the mapping.
+ * @param len Length of the mapping in bytes.
+ * @param numa_node The NUMA node.
+ * @return `1` if the policy is set, `0` otherwise.
+ */
+int _bind_numa_node(void *, const size_t, const int);
+#endif
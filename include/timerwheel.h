@@ -0,0 +1,149 @@
+/**
+ * @file include/timerwheel.h
+ * @brief Function Prototypes for the timer wheel of the connection timeouts.
+ *
+ * This file contains the timer wheel structure and function prototypes to schedule, cancel and
+ * expire timers with a resolution of one second. Timers are embedded in the structure they time
+ * out (e.g. a connection) and are linked into the slot of the second they expire at, so scheduling
+ * and cancelling a timer take constant time and expiring only looks at the slots of the seconds
+ * that passed, instead of every timer.
+ *
+ * Timers further away than the number of slots share a slot with earlier ones and are skipped
+ * until their second comes. Timer wheels are not thread-safe, each worker owns one.
+ *
+ * Implemented in slib/timerwheel.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _TIMERWHEEL_H
+#define _TIMERWHEEL_H 1
+
+/**
+ * @brief Defines the default number of slots (seconds) of a timer wheel.
+ */
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS 64
+#endif
+
+#include <stdbool.h>
+
+/**
+ * @struct timer_wheel_timer
+ * @brief Defines a timer, embedded in the structure it times out.
+ *
+ * @property long timer_wheel_timer::expires_at
+ * @brief Time (in seconds) the timer expires at.
+ *
+ * @property bool timer_wheel_timer::is_scheduled
+ * @brief Whether the timer is linked into a slot of a timer wheel.
+ *
+ * @property timer_wheel_timer* timer_wheel_timer::prev
+ * @brief Previous timer in the slot.
+ *
+ * @property timer_wheel_timer* timer_wheel_timer::next
+ * @brief Next timer in the slot.
+ */
+typedef struct timer_wheel_timer {
+    long expires_at;
+    bool is_scheduled;
+    struct timer_wheel_timer *prev;
+    struct timer_wheel_timer *next;
+} timer_wheel_timer;
+
+/**
+ * @struct timer_wheel
+ * @brief Defines a timer wheel structure.
+ *
+ * @see create_timer_wheel
+ * @see schedule_timer
+ * @see expire_timer
+ *
+ * @property unsigned int timer_wheel::mask
+ * @brief Number of slots minus one, the number of slots is a power of two.
+ *
+ * @property long timer_wheel::now
+ * @brief The earliest second whose slot may still have expired timers.
+ *
+ * @property unsigned int timer_wheel::n_timers
+ * @brief Number of scheduled timers.
+ *
+ * @property timer_wheel_timer** timer_wheel::slots
+ * @brief The first timer of every slot.
+ */
+typedef struct timer_wheel {
+    unsigned int mask;
+    long now;
+    unsigned int n_timers;
+    timer_wheel_timer **slots;
+} timer_wheel;
+
+/**
+ * @brief Creates a timer wheel with at least `n_slots` slots, starting at the second `now`.
+ *
+ * @param n_slots Number of slots, rounded up to a power of two.
+ * @param now The current time (in seconds).
+ * @return On success, returns a pointer to the timer wheel. On failure, returns `NULL`.
+ */
+timer_wheel *create_timer_wheel(const unsigned int, const long);
+
+/**
+ * @brief Frees the timer wheel. The timers still scheduled are not touched.
+ *
+ * If a `NULL` pointer is passed to this function, function does nothing.
+ *
+ * @param wheel The timer wheel.
+ * @return void
+ */
+void destroy_timer_wheel(timer_wheel *);
+
+/**
+ * @brief Schedules `timer` to expire at the second `expires_at`, rescheduling it if it is
+ * already scheduled.
+ *
+ * Timers scheduled in the past expire with the next `expire_timer()`.
+ *
+ * @param wheel The timer wheel.
+ * @param timer The timer.
+ * @param expires_at Time (in seconds) the timer expires at.
+ * @return void
+ */
+void schedule_timer(timer_wheel *, timer_wheel_timer *, const long);
+
+/**
+ * @brief Cancels `timer`. If the timer is not scheduled, does nothing.
+ *
+ * @param wheel The timer wheel the timer is scheduled in.
+ * @param timer The timer.
+ * @return void
+ */
+void cancel_timer(timer_wheel *, timer_wheel_timer *);
+
+/**
+ * @brief Removes a timer that expired at or before the second `now` from the wheel.
+ *
+ * Called in a loop until it returns `NULL` to expire all the timers. The timer returned is no
+ * longer scheduled, so it may be scheduled again or freed.
+ *
+ * @param wheel The timer wheel.
+ * @param now The current time (in seconds).
+ * @return An expired timer, or `NULL` if none is left.
+ */
+timer_wheel_timer *expire_timer(timer_wheel *, const long);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Unlinks a scheduled timer from its slot.
+ *
+ * @param wheel The timer wheel.
+ * @param timer The timer, which must be scheduled.
+ * @return void
+ */
+void _unlink_timer(timer_wheel *, timer_wheel_timer *);
+#endif
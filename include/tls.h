@@ -0,0 +1,239 @@
+/**
+ * @file include/tls.h
+ * @brief Function Prototypes for the TLS sessions of HTTPS connections.
+ *
+ * This file contains function prototypes to set up the server's TLS context, to run the handshake
+ * of a new connection from the worker event loops and to send and receive over its TLS session.
+ * Sessions are kept in a table indexed by the socket, so the modules that only know a connection
+ * by its file descriptor (e.g. responses) send through the right session. Sockets without a session
+ * are passed to the plain system calls.
+ *
+ * Sessions are resumed from session tickets, or by session ID from a cache shared by the workers.
+ * ALPN selects `h2` if HTTP/2 is enabled and the client offers it, `http/1.1` otherwise. If kernel
+ * TLS (kTLS) is enabled and the
+ * kernel supports the negotiated cipher, records are encrypted by the kernel after the handshake,
+ * so `sendfile()`, `splice()` and `sendmsg()` keep working on the socket as they are and files are
+ * still sent without copying them to user space.
+ *
+ * Implemented in slib/tls.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _TLS_H
+#define _TLS_H 1
+
+/**
+ * @brief Defines the max number of file descriptors a TLS session can be kept for, the session
+ * table holds a slot for every descriptor up to the open file limit or this value.
+ */
+#ifndef TLS_MAX_FDS
+#define TLS_MAX_FDS 1048576
+#endif
+
+/**
+ * @brief Defines the max number of sockets HTTPS is served on.
+ */
+#ifndef TLS_MAX_LISTEN_FDS
+#define TLS_MAX_LISTEN_FDS 1024
+#endif
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <openssl/ssl.h>
+
+/**
+ * @brief Defines the results of a step of a TLS handshake.
+ *
+ *     - `TLS_HANDSHAKE_DONE`: Handshake is complete, data can be sent and received.
+ *     - `TLS_HANDSHAKE_WANT_READ`: Handshake continues once the socket is readable.
+ *     - `TLS_HANDSHAKE_WANT_WRITE`: Handshake continues once the socket is writable.
+ *     - `TLS_HANDSHAKE_ERROR`: Handshake failed, the connection must be closed.
+ */
+typedef enum tls_handshake_result {
+    TLS_HANDSHAKE_DONE,
+    TLS_HANDSHAKE_WANT_READ,
+    TLS_HANDSHAKE_WANT_WRITE,
+    TLS_HANDSHAKE_ERROR
+} tls_handshake_result;
+
+/**
+ * @brief Sets up the TLS context with the PEM certificate chain `cert_file` and the PEM private
+ * key `key_file`.
+ *
+ * Up to `session_cache` sessions are cached for resumption by session ID, session tickets are
+ * always accepted. If `ktls` is `true`, records are encrypted by the kernel when it can. If `http2`
+ * is `true`, ALPN prefers `h2` to `http/1.1`.
+ *
+ * If the TLS context is set up successfully, the function returns `1`. If it is already set up,
+ * the function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param cert_file PEM file of the certificate chain.
+ * @param key_file PEM file of the private key.
+ * @param session_cache Max number of cached sessions, `0` disables the cache.
+ * @param ktls Whether to use kernel TLS.
+ * @param http2 Whether to select `h2` with ALPN.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int create_tls(const char *, const char *, const int, const bool, const bool);
+
+/**
+ * @brief Frees the TLS context and forgets the sockets registered by `add_tls_listen_fd()`. Must
+ * only be called once all the TLS sessions are ended.
+ *
+ * If `destroy_tls()` is called before `create_tls()`, it only forgets the registered sockets.
+ *
+ * @return void
+ */
+void destroy_tls();
+
+/**
+ * @brief Checks if the TLS context is set up.
+ *
+ * @return `true` after `create_tls()` succeeded, `false` otherwise.
+ */
+bool is_tls_enabled();
+
+/**
+ * @brief Registers `listen_fd` as a listening socket HTTPS is served on. Must be called before the
+ * workers are started.
+ *
+ * @param listen_fd The listening socket.
+ * @return On success, returns 1. If `TLS_MAX_LISTEN_FDS` sockets are registered, returns 0.
+ */
+int add_tls_listen_fd(const int);
+
+/**
+ * @brief Checks if `listen_fd` was registered by `add_tls_listen_fd()`.
+ *
+ * @param listen_fd The listening socket.
+ * @return `true` if the connections accepted from it speak TLS, `false` otherwise.
+ */
+bool is_tls_listen_fd(const int);
+
+/**
+ * @brief Creates the TLS session of the non-blocking socket `fd` of a new connection.
+ *
+ * The handshake is run by calling `continue_tls_handshake()` whenever the socket is ready, the
+ * session must be ended with `end_tls_session()` before the socket is closed.
+ *
+ * @param fd The connection socket.
+ * @return On success, returns 1. On failure, returns 0.
+ */
+int start_tls_session(const int);
+
+/**
+ * @brief Runs the handshake of the TLS session of `fd` as far as it gets without blocking.
+ *
+ * @param fd The connection socket.
+ * @return The result of the step, see `tls_handshake_result`.
+ */
+tls_handshake_result continue_tls_handshake(const int);
+
+/**
+ * @brief Checks if `fd` has a TLS session.
+ *
+ * @param fd The connection socket.
+ * @return `true` if the connection speaks TLS, `false` otherwise.
+ */
+bool has_tls_session(const int);
+
+/**
+ * @brief Checks if data written to `fd` with `send()`, `sendmsg()`, `sendfile()` or `splice()`
+ * reaches the client as it should.
+ *
+ * @param fd The connection socket.
+ * @return `true` if `fd` has no TLS session or its records are encrypted by the kernel, `false` if
+ * data must be sent with `send_tls()`.
+ */
+bool can_send_plaintext(const int);
+
+/**
+ * @brief Checks whether ALPN selected `protocol` for the TLS session of `fd`.
+ *
+ * @param fd The connection socket.
+ * @param protocol The protocol name (e.g. `h2`).
+ * @return `true` if the session of `fd` negotiated `protocol`, `false` otherwise.
+ */
+bool has_tls_alpn(const int, const char *);
+
+/**
+ * @brief Receives up to `len` bytes from `fd`, like `recv()`, decrypting them if `fd` has a TLS
+ * session.
+ *
+ * @param fd The connection socket.
+ * @param buf Buffer the data is stored in.
+ * @param len Size of `buf`.
+ * @return The number of bytes received, `0` if the client closed the connection and `-1` on error
+ * with `errno` set (`EAGAIN` if no data is available yet).
+ */
+ssize_t recv_tls(const int, void *, const size_t);
+
+/**
+ * @brief Sends `len` bytes of `buf` to `fd`, like `send()`, encrypting them if `fd` has a TLS
+ * session.
+ *
+ * Sessions encrypted in user space write the whole buffer unless sending fails, `flags` are only
+ * used by plain sockets and kTLS.
+ *
+ * @param fd The connection socket.
+ * @param buf Data to send.
+ * @param len Size of `buf`.
+ * @param flags Flags of `send()`.
+ * @return The number of bytes sent, `-1` on error with `errno` set.
+ */
+ssize_t send_tls(const int, const void *, const size_t, const int);
+
+/**
+ * @brief Sends a close notification over the TLS session of `fd`, if the handshake finished, and
+ * frees the session. The socket itself is not closed.
+ *
+ * If `fd` has no TLS session, it does nothing.
+ *
+ * @param fd The connection socket.
+ * @return void
+ */
+void end_tls_session(const int);
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Gets the TLS session of `fd`.
+ *
+ * @param fd The connection socket.
+ * @return The session, `NULL` if `fd` has none.
+ */
+SSL *_get_tls_session(const int);
+
+/**
+ * @private
+ * @brief Selects `h2` or `http/1.1` from the protocols offered by the client with ALPN, passed to
+ * `SSL_CTX_set_alpn_select_cb()`.
+ *
+ * @param ssl The TLS session.
+ * @param out The selected protocol.
+ * @param out_len Length of the selected protocol.
+ * @param in Protocols offered by the client, in the wire format.
+ * @param in_len Length of `in`.
+ * @param arg Unused.
+ * @return `SSL_TLSEXT_ERR_OK` if a protocol is selected, `SSL_TLSEXT_ERR_NOACK` otherwise.
+ */
+int _select_tls_alpn(SSL *, const unsigned char **, unsigned char *, const unsigned char *,
+                     unsigned int, void *);
+
+/**
+ * @private
+ * @brief Turns the result `ret` of `SSL_read_ex()` or `SSL_write_ex()` into the result of a
+ * `recv()` or `send()`.
+ *
+ * @param ssl The TLS session.
+ * @param ret The value returned by OpenSSL.
+ * @return `0` if the client closed the session, `-1` with `errno` set otherwise.
+ */
+ssize_t _get_tls_io_error(SSL *, const int);
+#endif
@@ -0,0 +1,695 @@
+/**
+ * @file include/worker.h
+ * @brief Function Prototypes for the worker thread pool and per-worker event loops.
+ *
+ * This file contains the worker structure and function prototypes to start, wait for and stop a
+ * fixed pool of worker threads. Each worker owns an epoll instance, accepts connections from the
+ * shared listening sockets (or from listening sockets of its own, with `SO_REUSEPORT`) and drives
+ * the state machines of the connections it accepted.
+ *
+ * Implemented in slib/worker.c
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#ifndef _WORKER_H
+#define _WORKER_H 1
+
+/**
+ * @brief Defines the max number of events returned by a single `epoll_wait()` call.
+ */
+#ifndef MAX_EVENTS
+#define MAX_EVENTS 256
+#endif
+
+/**
+ * @brief Defines the number of submission entries of the io_uring ring of a worker.
+ */
+#ifndef URING_ENTRIES
+#define URING_ENTRIES 256
+#endif
+
+/**
+ * @brief Defines the number of provided receive buffers of the io_uring ring of a worker, a power
+ * of 2.
+ */
+#ifndef URING_BUFS
+#define URING_BUFS 256
+#endif
+
+/**
+ * @brief Defines the size (in bytes) of a provided receive buffer of the io_uring ring of a worker.
+ */
+#ifndef URING_BUF_SIZE
+#define URING_BUF_SIZE 4096
+#endif
+
+/**
+ * @brief Defines the mask of the bits of the `user_data` of an io_uring operation that hold its
+ * `worker_op`, the other bits are the pointer it refers to.
+ */
+#define WORKER_OP_MASK 3
+
+/**
+ * @brief Defines the bit of the `user_data` of an io_uring operation (and of the `data.ptr` of an
+ * epoll event) that marks an operation on the backend socket of a connection's proxied request.
+ * Only set on connections, which are 16-byte aligned.
+ */
+#define WORKER_OP_UPSTREAM 4
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "admission.h"
+#include "connection.h"
+#include "proxy.h"
+#include "response.h"
+#include "timerwheel.h"
+#include "nanows_uring.h"
+
+/**
+ * @brief Defines the operations a worker of the io_uring backend queues, stored in the low bits of
+ * the `user_data` of the operation (see `WORKER_OP_MASK`). A `user_data` of `0` is a cancellation.
+ *
+ *     - `WORKER_OP_RECV`: Receive of a plain connection into a provided buffer.
+ *     - `WORKER_OP_POLL`: Poll of a connection that is read through its TLS or HTTP/2 session, or
+ *       of the backend socket of its proxied request (with `WORKER_OP_UPSTREAM`).
+ *     - `WORKER_OP_ACCEPT`: Multishot accept of one of `worker::listen_fds`.
+ *     - `WORKER_OP_WAKE`: Poll of `worker::wake_fd`.
+ */
+typedef enum worker_op {
+    WORKER_OP_RECV,
+    WORKER_OP_POLL,
+    WORKER_OP_ACCEPT,
+    WORKER_OP_WAKE
+} worker_op;
+
+/**
+ * @struct worker
+ * @brief Defines a worker structure.
+ *
+ * @property int worker::id
+ * @brief Index of the worker in the worker pool.
+ *
+ * @property pthread_t worker::tid
+ * @brief Thread ID of the worker thread.
+ *
+ * @property int worker::epoll_fd
+ * @brief File descriptor of the worker's epoll instance, `-1` if the worker uses io_uring.
+ *
+ * @property uring* worker::ring
+ * @brief io_uring ring of the worker, `NULL` if the worker uses epoll.
+ *
+ * @property int* worker::listen_fds
+ * @brief File descriptors of the listening sockets the worker accepts connections from.
+ *
+ * @property int worker::n_listen_fds
+ * @brief Number of file descriptors in `listen_fds`.
+ *
+ * @property int worker::cpu
+ * @brief CPU the worker thread is pinned to, `-1` if it is not pinned.
+ *
+ * @property int worker::wake_fd
+ * @brief `eventfd` used to wake up the worker's event loop, e.g. when stopping the worker.
+ *
+ * @property conn_handler worker::handler
+ * @brief Handler called for every connection with a complete request head.
+ *
+ * @property int worker::idle_timeout
+ * @brief Time (in seconds) after which an idle connection is closed.
+ *
+ * @property connection* worker::conns
+ * @brief Head of the list of connections owned by the worker.
+ *
+ * @property connection* worker::closing
+ * @brief Head of the list of removed connections whose io_uring operation is still in flight,
+ * they are freed once it completes.
+ *
+ * @property timer_wheel* worker::timers
+ * @brief Timer wheel of the timeouts of the worker's connections.
+ *
+ * @property bool worker::draining
+ * @brief Whether the worker stopped accepting connections and exits once its connections are
+ * closed, see `drain_workers()`.
+ *
+ * @property bool worker::joined
+ * @brief Whether the worker thread has exited and was joined by `drain_workers()`.
+ *
+ * @property slab_cache* worker::slabs
+ * @brief Slab cache the worker allocates its connections, receive buffers and connection arenas
+ * from, on the NUMA node of its CPU. Created by the worker thread and destroyed by
+ * `stop_workers()`.
+ */
+typedef struct worker {
+    int id;
+    pthread_t tid;
+    int epoll_fd;
+    uring *ring;
+    const int *listen_fds;
+    int n_listen_fds;
+    int cpu;
+    int wake_fd;
+    conn_handler handler;
+    int idle_timeout;
+    connection *conns;
+    connection *closing;
+    timer_wheel *timers;
+    bool draining;
+    bool joined;
+    slab_cache *slabs;
+} worker;
+
+/**
+ * @brief Gets the number of workers `start_workers()` starts for `n_workers` workers.
+ *
+ * @param n_workers The number of worker threads, one per online CPU if less than `1`.
+ * @return The number of worker threads.
+ */
+int get_worker_count(int);
+
+/**
+ * @brief Gets the CPU worker `id` is pinned to if the workers are pinned to CPUs.
+ *
+ * Workers are pinned to the CPUs of `worker_cpus` in order (see `WORKER_CPUS_CONF_KEY`), or to
+ * the online CPUs if it is not set, wrapping around if there are more workers than CPUs.
+ *
+ * @param id Index of the worker in the worker pool.
+ * @return The CPU of the worker.
+ */
+int get_worker_cpu(const int);
+
+/**
+ * @brief Starts a pool of `n_workers` worker threads accepting connections from `listen_fds`.
+ *
+ * `listen_fds` must be non-blocking listening sockets. If `per_worker` is `false`, all the workers
+ * accept from the same `n_listen_fds` sockets, which are registered with every worker's epoll
+ * instance using `EPOLLEXCLUSIVE`, so a new connection wakes up only one worker. If `per_worker` is
+ * `true`, `listen_fds` holds `n_listen_fds` sockets for each worker (the sockets of the first
+ * worker, then the ones of the second worker and so on), and each worker only accepts from its own
+ * sockets. `listen_fds` must stay valid until the workers are stopped.
+ *
+ * If `n_workers` is less than `1`, one worker per online CPU is started. If `pin_cpus` is `true`,
+ * worker `n` is pinned to CPU `get_worker_cpu(n)`. Connections without any activity for
+ * `idle_timeout` seconds, and connections whose request head doesn't arrive within
+ * `request_head_timeout` seconds, are closed. Every new connection must be admitted by
+ * `admit_connection()`.
+ *
+ * If `use_uring` is `true`, every worker gets an io_uring ring instead of an epoll instance (see
+ * `_uring_worker_loop()`). A worker whose ring can't be set up (e.g. on a kernel older than 5.19)
+ * uses epoll.
+ *
+ * If the workers are started successfully, the function returns `1`. If the workers are already
+ * started, the function returns `2` without performing any action. On failure, returns `0`.
+ *
+ * @param listen_fds The file descriptors of the listening sockets.
+ * @param n_listen_fds The number of listening sockets per worker.
+ * @param per_worker Whether each worker has listening sockets of its own.
+ * @param n_workers The number of worker threads.
+ * @param pin_cpus Whether to pin the worker threads to CPUs.
+ * @param use_uring Whether the workers use io_uring instead of epoll.
+ * @param idle_timeout Idle timeout (in seconds) for connections.
+ * @param handler The connection handler.
+ * @return On success, returns a non-zero value. On failure, returns 0.
+ */
+int start_workers(const int *, const int, const bool, int, const bool, const bool, const int,
+                  conn_handler);
+
+/**
+ * @brief Blocks until all the worker threads have exited.
+ *
+ * @return void
+ */
+void wait_workers();
+
+/**
+ * @brief Stops accepting connections and waits up to `timeout` seconds for the workers to finish
+ * the requests they are handling.
+ *
+ * Every worker stops waiting for its listening sockets and closes its idle
+ * connections. The other connections are served until their current request is answered, which
+ * closes the connection since `is_worker_draining()` is `true`, and the worker exits once it has
+ * no connections left. The listening sockets stay open, so connections that are not accepted yet
+ * wait in the backlog (e.g. for a new server process sharing the sockets).
+ *
+ * Workers that are still running after `timeout` seconds are stopped by `stop_workers()`.
+ *
+ * @param timeout Max time (in seconds) to wait for the workers.
+ * @return `1` if all the workers exited in time, `0` otherwise.
+ */
+int drain_workers(const int);
+
+/**
+ * @brief Checks if the workers are draining, in which case responses must close their connection.
+ *
+ * @return `true` after `drain_workers()` was called, `false` otherwise.
+ */
+bool is_worker_draining();
+
+/**
+ * @brief Stops all the worker threads, closes their connections and frees the worker pool.
+ *
+ * If `stop_workers()` is called before `start_workers()`, it does nothing.
+ *
+ * @return void
+ */
+void stop_workers();
+
+// ==============================
+// Internal Helper Functions
+// ==============================
+
+/**
+ * @private
+ * @brief Event loop of a worker thread, passed to `pthread_create()`.
+ *
+ * @param w Pointer to the worker struct.
+ * @return Always returns `NULL`.
+ */
+void *_worker_loop(void *);
+
+/**
+ * @private
+ * @brief Event loop of a worker thread with an io_uring ring, passed to `pthread_create()`.
+ *
+ * The listening sockets are accepted from with multishot accepts. Plain HTTP/1.x connections keep
+ * a receive into a provided buffer queued while they wait for a request, the data is handed to
+ * the connection with `receive_connection_data()`, so a request costs no system call besides the
+ * ones of its response. Connections that are read through a TLS or HTTP/2 session, or wait to
+ * write their queued output, are polled instead, and handled like epoll events by
+ * `_handle_connection_event()`. The operations queued while handling completions are submitted by
+ * the call that waits for the next completions.
+ *
+ * @param w Pointer to the worker struct.
+ * @return Always returns `NULL`.
+ */
+void *_uring_worker_loop(void *);
+
+/**
+ * @private
+ * @brief Creates the worker's slab cache and makes it the cache of the calling worker thread.
+ *
+ * Called by the worker thread itself, after it is pinned, so the cache and its slabs are on the
+ * NUMA node of its CPU even if the kernel doesn't support NUMA policies. If the cache can't be
+ * created, the worker allocates with `malloc()`.
+ *
+ * @param w The worker.
+ * @return void
+ */
+void _create_worker_slab_cache(worker *);
+
+/**
+ * @private
+ * @brief Creates the worker's epoll instance and registers its listening sockets and its
+ * `worker::wake_fd`.
+ *
+ * @param w The worker.
+ * @param per_worker Whether the worker has listening sockets of its own.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _register_epoll_fds(worker *, const bool);
+
+/**
+ * @private
+ * @brief Accepts all pending connections on the listening socket and registers them with the
+ * worker's epoll instance.
+ *
+ * Connections that are not admitted by `admit_connection()` or can't be allocated are answered
+ * with `503 Service Unavailable` and closed. Connections accepted from a socket registered with
+ * `add_tls_listen_fd()` get a TLS session and start in `CONN_HANDSHAKING` state, the ones that
+ * are refused are closed without a response.
+ *
+ * @param w The worker.
+ * @param listen_fd The listening socket.
+ * @return void
+ */
+void _accept_connections(worker *, const int);
+
+/**
+ * @private
+ * @brief Admits an accepted socket, creates its connection and adds it to the worker.
+ *
+ * Connections that are not admitted or can't be allocated are answered and closed like in
+ * `_accept_connections()`.
+ *
+ * @param w The worker.
+ * @param conn_fd The accepted socket.
+ * @param peer_addr Address of the client.
+ * @param is_tls Whether the socket was accepted from a socket registered with
+ * `add_tls_listen_fd()`.
+ * @return void
+ */
+void _add_connection(worker *, const int, const struct sockaddr_storage *, const bool);
+
+/**
+ * @private
+ * @brief Queues the multishot accept of one of the worker's listening sockets on its ring.
+ *
+ * Connections are accepted in non-blocking mode, like the ones of the epoll backend.
+ *
+ * @param w The worker, with a ring.
+ * @param listen_fd The listening socket, in `worker::listen_fds`.
+ * @return On success, returns `1`. If the submission ring is full, returns `0`.
+ */
+int _queue_uring_accept(worker *, const int *);
+
+/**
+ * @private
+ * @brief Handles a completion of the worker's ring.
+ *
+ * @param w The worker.
+ * @param user_data The `user_data` of the completed operation.
+ * @param res The result of the operation.
+ * @param flags The `IORING_CQE_F_*` flags of the completion.
+ * @return void
+ */
+void _handle_uring_completion(worker *, const uint64_t, const int, const unsigned int);
+
+/**
+ * @private
+ * @brief Removes the listening sockets from the worker's epoll instance (or cancels their accepts
+ * on its ring) and closes its idle
+ * connections (including the ones still in their TLS handshake), when the workers start draining.
+ * HTTP/2 connections are sent a `GOAWAY` frame, they are closed once their streams are answered.
+ *
+ * @param w The worker.
+ * @return void
+ */
+void _start_draining(worker *);
+
+/**
+ * @private
+ * @brief Checks if an epoll event belongs to one of the worker's listening sockets.
+ *
+ * @param w The worker.
+ * @param ptr The `data.ptr` of the epoll event.
+ * @return On match, returns a pointer to the listening socket. Otherwise, returns `NULL`.
+ */
+const int *_find_listen_fd(const worker *, const void *);
+
+/**
+ * @private
+ * @brief Handles an epoll event for one of the worker's connections.
+ *
+ * Continues the TLS handshake of connections in `CONN_HANDSHAKING` state with
+ * `_handshake_connection()`, finishes the requests of connections in `CONN_WRITING` state
+ * with `_finish_connection_request()` and goes on with the proxied requests of connections in
+ * `CONN_PROXYING` state with `_continue_proxy()`. Reads from the connection and, once the request
+ * head is complete, handles it with `_handle_connection_request()`. Connections that switched to
+ * HTTP/2 are handled by `_handle_http2_event()` instead.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @param events The epoll (or poll) events reported for the connection.
+ * @return void
+ */
+void _handle_connection_event(worker *, connection *, const unsigned int);
+
+/**
+ * @private
+ * @brief Calls the worker's handler for a connection with a complete request head.
+ *
+ * The connection is the active connection of the thread while the handler runs (see
+ * `set_active_connection()`), so the response is written without blocking. The handler is called
+ * again for every pipelined request that is already buffered. If some of the response is still
+ * queued, or the rest of the request body is still to be dropped, the connection moves to
+ * `CONN_WRITING` and waits for the socket. Otherwise, if the handler keeps the connection open, it
+ * waits for the next request. If the handler waits for the backend of a proxied request, the
+ * connection moves to `CONN_PROXYING` and waits for the socket the request waits for.
+ *
+ * @param w The worker.
+ * @param conn The connection, in `CONN_HANDLING` state (or in `CONN_READING` or `CONN_CLOSING`
+ * state after its output was sent).
+ * @return void
+ */
+void _handle_connection_request(worker *, connection *);
+
+/**
+ * @private
+ * @brief Handles an event (or a completion) of the backend socket of a connection's proxied
+ * request with `_continue_proxy()`.
+ *
+ * A connection whose proxied request was already closed (e.g. an io_uring operation that
+ * completed after it was cancelled) waits for its client again.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _handle_upstream_event(worker *, connection *);
+
+/**
+ * @private
+ * @brief Calls the worker's handler again for the proxied request of a connection, once the socket
+ * it waits for is ready or its backend timed out.
+ *
+ * The output queued on a plain connection is sent first, the handler only relays more of the
+ * response once the client took it. The streams of an HTTP/2 connection are served by
+ * `_serve_http2_streams()`, which goes on with the paused stream of the request.
+ *
+ * @param w The worker.
+ * @param conn The connection, with `connection::proxy` set.
+ * @return void
+ */
+void _continue_proxy(worker *, connection *);
+
+/**
+ * @private
+ * @brief Removes the backend socket of a connection's proxied request from the worker's event
+ * loop, then closes the request with `close_proxy_conn()`.
+ *
+ * If a `NULL` pointer is set in `connection::proxy`, function does nothing.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _release_proxy(worker *, connection *);
+
+/**
+ * @private
+ * @brief Registers the backend socket `fd` of a connection with the worker's epoll instance for
+ * `events`, replacing the socket registered before (`connection::upstream_fd`).
+ *
+ * @param w The worker, with an epoll instance.
+ * @param conn The connection.
+ * @param fd The backend socket, `-1` to only remove the registered one.
+ * @param events The epoll events.
+ * @return On success, returns `1`. On failure, returns `0`.
+ */
+int _watch_upstream(worker *, connection *, const int, const unsigned int);
+
+/**
+ * @private
+ * @brief Sends the queued output of a connection in `CONN_WRITING` state and drops the part of the
+ * request body that arrived, once its socket is ready.
+ *
+ * The body is dropped with `discard_connection_body()`, up to the length the handler allowed
+ * (`connection::body_max`). If either of them is still pending, the connection waits again. Once
+ * both are done, the connection moves on as the handler decided: it is removed, or its next request
+ * is handled with `_handle_connection_request()`. Connections whose output can't be sent or whose
+ * body can't be read are removed.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _finish_connection_request(worker *, connection *);
+
+/**
+ * @private
+ * @brief Checks whether the rest of the request body of a connection in `CONN_WRITING` state is
+ * still to be dropped.
+ *
+ * The body of a request after which the connection is closed is never read.
+ *
+ * @param conn The connection.
+ * @return `true` if the body isn't complete and the connection is kept open, `false` otherwise.
+ */
+bool _is_body_pending(const connection *);
+
+/**
+ * @private
+ * @brief Runs the TLS handshake of a connection in `CONN_HANDSHAKING` state as far as it gets
+ * without blocking.
+ *
+ * While the handshake waits for the client, the connection waits for the direction it waits
+ * for. Once the handshake is done, the connection moves to `CONN_READING` and gets an HTTP/2
+ * session if ALPN selected `h2`. Connections whose handshake fails are removed.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return `1` if the handshake is done, `0` if it is still in progress or failed.
+ */
+int _handshake_connection(worker *, connection *);
+
+/**
+ * @private
+ * @brief Reads the frames of an HTTP/2 connection, then serves its complete streams with
+ * `_serve_http2_streams()`.
+ *
+ * The frames only move `connection::last_active` while no response waits for the client, so a
+ * client that stops reading (or opening its windows) can't keep the connection with `PING` or
+ * `SETTINGS` frames.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _handle_http2_event(worker *, connection *);
+
+/**
+ * @private
+ * @brief Calls the worker's handler for every complete stream of an HTTP/2 connection, most urgent
+ * first, then sends what the socket takes without blocking.
+ *
+ * The request of a stream is loaded into the receive buffer with `load_connection_request()`, so
+ * the handler serves it like an HTTP/1.1 request while its response is sent on the stream. Then
+ * the queued frames and the parked bodies are sent with `flush_http2_session()`, and the
+ * connection waits for the socket to be writable (if it didn't take everything) or for the next
+ * frames. It is removed if its session is done. While some output waits, the connection times out
+ * `SEND_TIMEOUT` seconds after the client last read some of it.
+ *
+ * A stream whose handler waits for the backend of a proxied request is paused (see
+ * `pause_http2_stream()`) and goes on first the next time, no other stream starts before it ends.
+ * The client's frames aren't read while the request waits for its backend, for `proxy_timeout`
+ * seconds at most.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _serve_http2_streams(worker *, connection *);
+
+/**
+ * @private
+ * @brief Calls the worker's handler for a stream of an HTTP/2 connection, then ends the stream, or
+ * pauses it while its proxied request waits for a socket.
+ *
+ * A paused stream that was reset by the client meanwhile isn't handled anymore, its proxied request
+ * is closed.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @param stream The active stream of the session.
+ * @param is_loaded Whether the request of the stream is loaded into the receive buffer.
+ * @return void
+ */
+void _handle_http2_stream(worker *, connection *, http2_stream *, const bool);
+
+/**
+ * @private
+ * @brief Switches a plain connection to HTTP/2, if its request head is the preface of a client
+ * with prior knowledge or an `Upgrade: h2c` request (RFC 7540, section 3.2).
+ *
+ * An upgrade request is answered with `101 Switching Protocols` (queued with the server's
+ * `SETTINGS`) and handled on stream 1 by `_serve_http2_streams()` once the client's `SETTINGS`
+ * arrived. Only complete request heads without a body are upgraded, and only if HTTP/2 is enabled.
+ *
+ * @param w The worker.
+ * @param conn The connection, in `CONN_HANDLING` state.
+ * @return `1` if the connection switched to HTTP/2 (or failed to and is in `CONN_CLOSING` state),
+ * `0` if the request is handled as HTTP/1.x.
+ */
+int _upgrade_http2_connection(worker *, connection *);
+
+/**
+ * @private
+ * @brief Creates the HTTP/2 session of a connection, with the limits of the server config, and
+ * disables Nagle's algorithm on its socket.
+ *
+ * @param conn The connection.
+ * @return On success, pointer to the session is returned. On failure, `NULL` is returned.
+ */
+http2_session *_create_http2_session(const connection *);
+
+/**
+ * @private
+ * @brief Schedules the timer of the connection, after it was accepted or read from.
+ *
+ * The connection times out `worker::idle_timeout` seconds after `connection::last_active`. While
+ * a request head is partially received, it times out `request_head_timeout` seconds after
+ * `connection::head_started` at the latest. A connection in `CONN_WRITING` state times out
+ * `SEND_TIMEOUT` seconds after the client last read some of its output, or `request_body_timeout`
+ * seconds after `connection::body_started` if the rest of the body is pending (whichever is
+ * earlier). So does a connection whose proxied request waits for the client, while one that waits
+ * for its backend times out at `proxy_conn::expires_at`.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _schedule_connection_timer(worker *, connection *);
+
+/**
+ * @private
+ * @brief Schedules the timer of a connection that waits for the client, and queues the receive
+ * or poll of the connection if the worker has a ring.
+ *
+ * With epoll, the connection is registered for `EPOLLOUT` instead of `EPOLLIN` while it waits to
+ * write (`connection::events` keeps the registered events). A connection in `CONN_WRITING` state
+ * waits for `EPOLLOUT` while output is queued and for `EPOLLIN` while the rest of its request body
+ * is to be dropped, but isn't woken up by `EPOLLRDHUP`: a client that half-closed the connection
+ * still reads the response. Connections whose operation can't be queued (or whose registration
+ * can't be changed) are removed.
+ *
+ * A connection with a proxied request waits for either the client or the backend socket, never
+ * for both: while the backend socket is registered (or polled on the ring), the client is
+ * registered without events, so only an error or a hang-up is reported for it.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @param wants_write Whether the connection waits until it can write a TLS handshake. Ignored in
+ * `CONN_WRITING` state.
+ * @return void
+ */
+void _wait_connection(worker *, connection *, const bool);
+
+/**
+ * @private
+ * @brief Closes all connections of the worker whose timer has expired.
+ *
+ * A proxied request whose backend timed out isn't closed, it is marked with
+ * `proxy_conn::is_timed_out` and continued, so the client can be answered with `504`.
+ *
+ * @param w The worker.
+ * @return void
+ */
+void _expire_connections(worker *);
+
+/**
+ * @private
+ * @brief Removes the connection from the worker's connection list and timer wheel, releases its
+ * admission and its proxied request, then closes and frees it.
+ *
+ * A connection with an io_uring operation in flight moves to `worker::closing` in `CONN_CLOSING`
+ * state instead, the operation is cancelled and the connection is freed once it completes.
+ *
+ * @param w The worker.
+ * @param conn The connection.
+ * @return void
+ */
+void _remove_connection(worker *, connection *);
+
+/**
+ * @private
+ * @brief Adds the connection to the start of a connection list of the worker.
+ *
+ * @param list The head of the list.
+ * @param conn The connection.
+ * @return void
+ */
+void _link_connection(connection **, connection *);
+
+/**
+ * @private
+ * @brief Removes the connection from a connection list of the worker.
+ *
+ * @param list The head of the list.
+ * @param conn The connection, in the list.
+ * @return void
+ */
+void _unlink_connection(connection **, connection *);
+#endif
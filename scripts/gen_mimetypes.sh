@@ -0,0 +1,84 @@
+#!/bin/sh
+# Generates the builtin MIME type table (include/mimetypes_table.h) from a MIME types file.
+#
+# Usage: scripts/gen_mimetypes.sh etc/mimetypes.conf > include/mimetypes_table.h
+#
+# Each line of the MIME types file is "<.ext>=<mime type>", lines starting with '#' are comments
+# and the "*" key is the default MIME type. Extensions are lowercased and sorted, so the table can
+# be searched with a case-insensitive binary search.
+
+set -e
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <mimetypes.conf>" >&2
+    exit 1
+fi
+
+MIME_FILE="$1"
+
+cat <<HEADER
+/**
+ * @file include/mimetypes_table.h
+ * @brief Builtin MIME type table, generated by scripts/gen_mimetypes.sh from ${MIME_FILE}.
+ *
+ * Do not edit this file, edit ${MIME_FILE} and rebuild instead. Only included by slib/mimetypes.c.
+ */
+
+#ifndef _MIMETYPES_TABLE_H
+#define _MIMETYPES_TABLE_H 1
+
+HEADER
+
+# Strip comments, blank lines and whitespace, then escape the values for C string literals.
+sed -e 's/^[[:space:]]*//' -e 's/[[:space:]]*$//' -e '/^#/d' -e '/^$/d' "$MIME_FILE" |
+    awk -F '=' '
+        NF < 2 || $1 == "" || $2 == "" { next }
+        {
+            key = tolower($1)
+            value = substr($0, index($0, "=") + 1)
+            gsub(/\\/, "\\\\", value)
+            gsub(/"/, "\\\"", value)
+            if (key == "*")
+                default_value = value
+            else if (!(key in seen)) {
+                seen[key] = 1
+                print key "\t" value
+            }
+        }
+        END {
+            if (default_value != "")
+                print "*\t" default_value
+        }' |
+    LC_ALL=C sort -t "$(printf '\t')" -k 1,1 |
+    awk -F '\t' '
+        $1 == "*" { default_value = $2; next }
+        {
+            n++
+            lines[n] = sprintf("    {\"%s\", \"%s\", \"content-type: %s\\r\\n\"},", $1, $2, $2)
+        }
+        END {
+            if (default_value == "")
+                default_value = "application/octet-stream"
+            print "/**"
+            print " * @brief Defines the builtin default MIME type, used for unknown file extensions."
+            print " */"
+            printf "#define BUILTIN_DEFAULT_MIMETYPE \"%s\"\n\n", default_value
+            print "/**"
+            print " * @private"
+            print " * @brief Builtin MIME types, sorted by file extension."
+            print " */"
+            print "static const mime_type _builtin_mime_types[] = {"
+            for (i = 1; i <= n; i++)
+                print lines[i]
+            print "};"
+            print ""
+            print "/**"
+            print " * @private"
+            print " * @brief Builtin default MIME type and its header."
+            print " */"
+            printf "static const mime_type _builtin_default_mime_type = {\"*\", \"%s\", \"content-type: %s\\r\\n\"};\n", default_value, default_value
+        }'
+
+cat <<FOOTER
+#endif
+FOOTER
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Runs the micro-benchmarks, then the load generator against bin/nanows serving site/.
+#
+# Usage: scripts/run_bench.sh (or `make bench`), from the repository root.
+#
+# Every result is printed as one JSON object per line, so runs can be compared by a script. The
+# runs are configured with environment variables:
+#     BENCH_OUT          also append the results to this file
+#     BENCH_MICRO        set to 0 to skip the micro-benchmarks and only run the load generator
+#     BENCH_FILTER       only run the micro-benchmarks whose name contains this string
+#     BENCH_DURATION     seconds every load generator run lasts (default 10)
+#     BENCH_CONNECTIONS  concurrent connections (default 64)
+#     BENCH_THREADS      load generator threads (default 2)
+#     BENCH_MODES        load generator modes to run (default "keepalive close")
+#     BENCH_URLS         URLs requested in turn (default: the pages and assets of site/)
+#     BENCH_BACKENDS     event backends the server is run with in turn (default "epoll io_uring"),
+#                        set as event_backend in etc/nanows.conf, which is restored afterwards
+
+set -e
+
+BENCH_MICRO="${BENCH_MICRO:-1}"
+BENCH_DURATION="${BENCH_DURATION:-10}"
+BENCH_CONNECTIONS="${BENCH_CONNECTIONS:-64}"
+BENCH_THREADS="${BENCH_THREADS:-2}"
+BENCH_MODES="${BENCH_MODES:-keepalive close}"
+BENCH_URLS="${BENCH_URLS:-/ /style.css /script.js /images/favicon.ico /images/Starship.jpg}"
+BENCH_BACKENDS="${BENCH_BACKENDS:-epoll io_uring}"
+
+HOST=$(sed -n 's/^server_host=//p' etc/nanows.conf)
+PORT=$(sed -n 's/^server_port=//p' etc/nanows.conf)
+if [ -z "$HOST" ] || [ "$HOST" = "*" ]; then
+    HOST=127.0.0.1
+fi
+
+export LD_LIBRARY_PATH="lib${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+
+emit() {
+    while read -r line; do
+        echo "$line"
+        if [ -n "$BENCH_OUT" ]; then
+            echo "$line" >> "$BENCH_OUT"
+        fi
+    done
+}
+
+if [ "$BENCH_MICRO" != 0 ]; then
+    bin/bench/bench_micro "$BENCH_FILTER" | emit
+fi
+
+CONF_BACKUP=$(mktemp)
+cp etc/nanows.conf "$CONF_BACKUP"
+SERVER_PID=
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2> /dev/null
+        wait "$SERVER_PID" 2> /dev/null || true
+    fi
+    SERVER_PID=
+}
+trap 'stop_server; cp "$CONF_BACKUP" etc/nanows.conf; rm -f "$CONF_BACKUP"' EXIT
+
+# The load generator results are tagged with the backend, so the backends can be compared.
+for backend in $BENCH_BACKENDS; do
+    sed "s/^event_backend=.*/event_backend=$backend/" "$CONF_BACKUP" > etc/nanows.conf
+    bin/nanows > /dev/null &
+    SERVER_PID=$!
+
+    for mode in $BENCH_MODES; do
+        # shellcheck disable=SC2086
+        bin/bench/loadgen -H "$HOST" -p "$PORT" -c "$BENCH_CONNECTIONS" -t "$BENCH_THREADS" \
+            -d "$BENCH_DURATION" -m "$mode" -w 5 $BENCH_URLS |
+            sed "s/^{/{\"backend\":\"$backend\",/" | emit
+    done
+    stop_server
+done
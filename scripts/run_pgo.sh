@@ -0,0 +1,30 @@
+#!/bin/sh
+# Builds a profile-guided release of bin/nanows (`make release` with PGO).
+#
+# Usage: scripts/run_pgo.sh (or `make release-pgo`), from the repository root.
+#
+# An instrumented release build serves the load generator runs of scripts/run_bench.sh (both event
+# backends, keep-alive and new connections, the pages and assets of site/), the profiles the server
+# processes write are merged with llvm-profdata and the release is built again with them. The
+# training runs are configured with the BENCH_* variables of scripts/run_bench.sh, BENCH_DURATION
+# defaults to 5 seconds. Other variables:
+#     LLVM_PROFDATA   llvm-profdata of the clang release used (e.g. llvm-profdata-17)
+#     RELEASE_STATIC  set to 1 to link the trained binary statically
+
+set -e
+
+PGO_DIR=pgo
+LLVM_PROFDATA="${LLVM_PROFDATA:-llvm-profdata}"
+
+rm -rf "$PGO_DIR"
+mkdir -p "$PGO_DIR"
+
+make compile bin/bench/loadgen
+make release PGO=generate
+
+# Every server process writes a profile of its own (%p), they are merged afterwards.
+LLVM_PROFILE_FILE="$PGO_DIR/nanows-%p.profraw" BENCH_MICRO=0 \
+    BENCH_DURATION="${BENCH_DURATION:-5}" sh scripts/run_bench.sh > /dev/null
+"$LLVM_PROFDATA" merge -output="$PGO_DIR/nanows.profdata" "$PGO_DIR"/*.profraw
+
+make release PGO=use
@@ -0,0 +1,352 @@
+/**
+ * @file slib/accesslog.c
+ * @brief Functions for the asynchronous access log.
+ *
+ * Implements functions defined in `include/accesslog.h`. Used by the server to log every request
+ * without serializing the workers on a shared lock (like the one of `stdout`).
+ *
+ * Each ring buffer has a single producer (the thread that claimed it) and a single consumer (the
+ * flusher thread), therefore `head` and `tail` are plain atomics: the producer publishes a line
+ * with a release store of `head`, and the flusher frees the slots with a release store of `tail`
+ * once the lines are written.
+ *
+ * @see typedef struct access_log
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "accesslog.h"
+
+/**
+ * @private
+ * @brief The access log, `NULL` if it is not open.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Atomic(access_log *) _access_log = NULL;
+
+/**
+ * @private
+ * @brief Incremented every time the access log is opened, so threads claim a new ring buffer.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_ulong _access_log_generation = 0;
+
+/**
+ * @private
+ * @brief Ring buffer claimed by the calling thread.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local access_log_ring *_thread_ring = NULL;
+
+/**
+ * @private
+ * @brief Value of `_access_log_generation` when the calling thread claimed `_thread_ring`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local unsigned long _thread_ring_generation = 0;
+
+int create_access_log(const char *path, const access_log_format format, const unsigned int sample,
+                      const int n_rings, const size_t ring_size) {
+    if (atomic_load(&_access_log) != NULL)
+        return 2;
+
+    if (path == NULL || n_rings < 1)
+        return 0;
+
+    access_log *log = calloc(1, sizeof(access_log));
+    if (log == NULL)
+        return 0;
+
+    log->fd = strcmp(path, ACCESS_LOG_STDOUT) == 0
+                  ? dup(STDOUT_FILENO)
+                  : open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log->fd < 0) {
+        free(log);
+        return 0;
+    }
+
+    size_t size = 1;
+    while (size < (ring_size > 0 ? ring_size : ACCESS_LOG_RING_SIZE))
+        size <<= 1;
+
+    log->format = format;
+    log->sample = sample > 1 ? sample : 1;
+    log->n_rings = n_rings;
+    if ((log->rings = aligned_alloc(alignof(access_log_ring), n_rings * sizeof(access_log_ring))) ==
+        NULL) {
+        close(log->fd);
+        free(log);
+        return 0;
+    }
+
+    for (int r_no = 0; r_no < n_rings; r_no++) {
+        access_log_ring *ring = &log->rings[r_no];
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->dropped, 0);
+        ring->n_requests = 0;
+        ring->size = size;
+        if ((ring->slots = malloc(size * sizeof(access_log_slot))) == NULL) {
+            log->n_rings = r_no;
+            break;
+        }
+    }
+    atomic_init(&log->next_ring, 0);
+    atomic_init(&log->running, true);
+
+    if (log->n_rings < n_rings ||
+        pthread_create(&log->flusher, NULL, _access_log_flusher, log) != 0) {
+        for (int r_no = 0; r_no < log->n_rings; r_no++)
+            free(log->rings[r_no].slots);
+        free(log->rings);
+        close(log->fd);
+        free(log);
+        return 0;
+    }
+
+    log->generation = atomic_fetch_add(&_access_log_generation, 1) + 1;
+    atomic_store_explicit(&_access_log, log, memory_order_release);
+    return 1;
+}
+
+void destroy_access_log() {
+    access_log *log = atomic_exchange(&_access_log, NULL);
+    if (log == NULL)
+        return;
+
+    atomic_store(&log->running, false);
+    pthread_join(log->flusher, NULL);
+    _flush_access_log(log);
+
+    for (int r_no = 0; r_no < log->n_rings; r_no++)
+        free(log->rings[r_no].slots);
+    free(log->rings);
+    close(log->fd);
+    free(log);
+}
+
+bool is_access_log_enabled() {
+    return atomic_load_explicit(&_access_log, memory_order_acquire) != NULL;
+}
+
+int log_access(const access_log_entry *entry) {
+    access_log *log = atomic_load_explicit(&_access_log, memory_order_acquire);
+    if (log == NULL)
+        return 0;
+
+    access_log_ring *ring = NULL;
+    if ((ring = _get_access_log_ring(log)) == NULL)
+        return 0;
+
+    if (ring->n_requests++ % log->sample != 0)
+        return 2;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ring->size) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    access_log_slot *slot = &ring->slots[head & (ring->size - 1)];
+    slot->len = _format_access_log_line(log->format, entry, slot->line);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+unsigned long get_access_log_dropped() {
+    access_log *log = atomic_load_explicit(&_access_log, memory_order_acquire);
+    if (log == NULL)
+        return 0;
+
+    unsigned long dropped = 0;
+    for (int r_no = 0; r_no < log->n_rings; r_no++)
+        dropped += atomic_load_explicit(&log->rings[r_no].dropped, memory_order_relaxed);
+    return dropped;
+}
+
+access_log_format parse_access_log_format(const char *name) {
+    if (name != NULL && strcmp(name, "json") == 0)
+        return ACCESS_LOG_JSON;
+    return ACCESS_LOG_COMBINED;
+}
+
+access_log_ring *_get_access_log_ring(access_log *log) {
+    if (_thread_ring_generation != log->generation) {
+        int r_no = atomic_fetch_add(&log->next_ring, 1);
+        _thread_ring = r_no < log->n_rings ? &log->rings[r_no] : NULL;
+        _thread_ring_generation = log->generation;
+    }
+
+    return _thread_ring;
+}
+
+size_t _format_access_log_line(const access_log_format format, const access_log_entry *entry,
+                               char *line) {
+    // The last byte is reserved for the '\n', so truncated lines are still terminated.
+    const size_t cap = ACCESS_LOG_LINE_SIZE - 1;
+    size_t pos = 0;
+
+    char addr[INET6_ADDRSTRLEN] = "-";
+    if (entry->peer_addr != NULL && entry->peer_addr->ss_family == AF_INET)
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)entry->peer_addr)->sin_addr, addr,
+                  sizeof(addr));
+    else if (entry->peer_addr != NULL && entry->peer_addr->ss_family == AF_INET6)
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)entry->peer_addr)->sin6_addr, addr,
+                  sizeof(addr));
+
+    // Formatting the time is the most expensive part, it changes once a second.
+    static _Thread_local time_t cached_sec = -1;
+    static _Thread_local access_log_format cached_format = ACCESS_LOG_COMBINED;
+    static _Thread_local char cached_time[32];
+    time_t now = time(NULL);
+    if (now != cached_sec || format != cached_format) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(cached_time, sizeof(cached_time),
+                 format == ACCESS_LOG_JSON ? "%Y-%m-%dT%H:%M:%S%z" : "%d/%b/%Y:%H:%M:%S %z", &tm);
+        cached_sec = now;
+        cached_format = format;
+    }
+
+#define _APPEND_FMT(...)                                                                           \
+    do {                                                                                           \
+        int n = snprintf(line + pos, ACCESS_LOG_LINE_SIZE - pos, __VA_ARGS__);                     \
+        pos = n < 0 ? pos : (pos + n < cap ? pos + n : cap);                                       \
+    } while (0)
+
+    bool json = format == ACCESS_LOG_JSON;
+    if (json) {
+        _APPEND_FMT("{\"time\":\"%s\",\"remote_addr\":\"%s\",\"method\":\"", cached_time, addr);
+        pos = _append_access_log_str(line, pos, cap, entry->method, json);
+        _APPEND_FMT("\",\"url\":\"");
+        pos = _append_access_log_str(line, pos, cap, entry->url, json);
+        _APPEND_FMT("\",\"protocol\":\"");
+        pos = _append_access_log_str(line, pos, cap, entry->http_ver, json);
+        _APPEND_FMT("\",\"status\":%d,\"bytes\":%zu,\"latency_us\":%ld,\"referer\":\"",
+                    entry->status, entry->bytes, entry->latency_us);
+        pos = _append_access_log_str(line, pos, cap, entry->referer, json);
+        _APPEND_FMT("\",\"user_agent\":\"");
+        pos = _append_access_log_str(line, pos, cap, entry->user_agent, json);
+        _APPEND_FMT("\"}");
+    } else {
+        _APPEND_FMT("%s - - [%s] \"", addr, cached_time);
+        pos = _append_access_log_str(line, pos, cap, entry->method, json);
+        _APPEND_FMT(" ");
+        pos = _append_access_log_str(line, pos, cap, entry->url, json);
+        _APPEND_FMT(" ");
+        pos = _append_access_log_str(line, pos, cap, entry->http_ver, json);
+        _APPEND_FMT("\" %d %zu \"", entry->status, entry->bytes);
+        pos = _append_access_log_str(line, pos, cap, entry->referer, json);
+        _APPEND_FMT("\" \"");
+        pos = _append_access_log_str(line, pos, cap, entry->user_agent, json);
+        _APPEND_FMT("\" %ld", entry->latency_us);
+    }
+#undef _APPEND_FMT
+
+    line[pos++] = '\n';
+    return pos;
+}
+
+size_t _append_access_log_str(char *line, size_t pos, const size_t cap, const char *str,
+                              const bool json) {
+    if (str == NULL)
+        str = json ? "" : "-";
+
+    for (; *str != '\0' && pos < cap; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            if (pos + 2 > cap)
+                break;
+            line[pos++] = '\\';
+            line[pos++] = c;
+        } else if (c < ' ' || c == 0x7f) {
+            if (pos + (json ? 6 : 4) > cap)
+                break;
+            pos += sprintf(line + pos, json ? "\\u%04x" : "\\x%02x", c);
+        } else {
+            line[pos++] = c;
+        }
+    }
+
+    return pos;
+}
+
+void _flush_access_log(access_log *log) {
+    struct iovec iov[IOV_MAX];
+    size_t tails[log->n_rings], heads[log->n_rings];
+    int iov_len = 0;
+
+    // Collect the buffered lines of every ring, up to IOV_MAX lines per writev().
+    do {
+        iov_len = 0;
+        for (int r_no = 0; r_no < log->n_rings; r_no++) {
+            access_log_ring *ring = &log->rings[r_no];
+            tails[r_no] = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            heads[r_no] = tails[r_no];
+
+            size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            while (heads[r_no] != head && iov_len < IOV_MAX) {
+                access_log_slot *slot = &ring->slots[heads[r_no] & (ring->size - 1)];
+                iov[iov_len++] = (struct iovec){.iov_base = slot->line, .iov_len = slot->len};
+                heads[r_no]++;
+            }
+        }
+
+        struct iovec *next = iov;
+        int next_len = iov_len;
+        while (next_len > 0) {
+            ssize_t written = writev(log->fd, next, next_len);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+
+            while (next_len > 0 && (size_t)written >= next->iov_len) {
+                written -= next->iov_len;
+                next++;
+                next_len--;
+            }
+            if (next_len > 0) {
+                next->iov_base = (char *)next->iov_base + written;
+                next->iov_len -= written;
+            }
+        }
+
+        // The slots are only reused once their lines are written (or failed to be written).
+        for (int r_no = 0; r_no < log->n_rings; r_no++)
+            atomic_store_explicit(&log->rings[r_no].tail, heads[r_no], memory_order_release);
+    } while (iov_len == IOV_MAX);
+}
+
+void *_access_log_flusher(void *arg) {
+    access_log *log = (access_log *)arg;
+    struct timespec interval = {.tv_sec = 0, .tv_nsec = ACCESS_LOG_FLUSH_INTERVAL * 1000000L};
+
+    while (atomic_load(&log->running)) {
+        _flush_access_log(log);
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
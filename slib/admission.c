@@ -0,0 +1,173 @@
+/**
+ * @file slib/admission.c
+ * @brief Functions for the admission control of new connections.
+ *
+ * Implements functions defined in `include/admission.h`. Used by the workers to count the open
+ * connections and to refuse the ones over the configured limits.
+ *
+ * @see typedef struct admission_peer
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+
+#include "admission.h"
+
+/**
+ * @private
+ * @brief Whether the admission control is set up.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+bool _admission_enabled = false;
+
+/**
+ * @private
+ * @brief Limits of the admission control, set by `create_admission_control()`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+int _admission_max_conns = 0;
+int _admission_max_conns_per_ip = 0;
+
+/**
+ * @private
+ * @brief Number of admitted connections that are not released yet.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_int _admission_n_conns = 0;
+
+/**
+ * @private
+ * @brief Hash table of the client addresses with open connections, keyed by
+ * `admission_peer::addr`. `NULL` if there is no per address limit.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+GHashTable *_admission_peers = NULL;
+
+/**
+ * @private
+ * @brief Mutex protecting `_admission_peers`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+pthread_mutex_t _admission_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int create_admission_control(const int max_conns, const int max_conns_per_ip) {
+    if (_admission_enabled)
+        return 2;
+
+    if (max_conns_per_ip > 0 &&
+        (_admission_peers = g_hash_table_new_full(_admission_addr_hash, _admission_addr_equal, NULL,
+                                                  free)) == NULL)
+        return 0;
+
+    _admission_max_conns = max_conns > 0 ? max_conns : 0;
+    _admission_max_conns_per_ip = max_conns_per_ip > 0 ? max_conns_per_ip : 0;
+    atomic_store(&_admission_n_conns, 0);
+    _admission_enabled = true;
+    return 1;
+}
+
+void destroy_admission_control() {
+    if (!_admission_enabled)
+        return;
+
+    if (_admission_peers != NULL)
+        g_hash_table_destroy(_admission_peers);
+    _admission_peers = NULL;
+    _admission_max_conns = _admission_max_conns_per_ip = 0;
+    _admission_enabled = false;
+}
+
+bool admit_connection(const struct sockaddr_storage *peer_addr) {
+    if (!_admission_enabled)
+        return true;
+
+    // The counter is raised first, so workers admitting at the same time can't overshoot it.
+    int n_conns = atomic_fetch_add_explicit(&_admission_n_conns, 1, memory_order_relaxed);
+    if (_admission_max_conns > 0 && n_conns >= _admission_max_conns) {
+        atomic_fetch_sub_explicit(&_admission_n_conns, 1, memory_order_relaxed);
+        return false;
+    }
+
+    unsigned char addr[16];
+    if (_admission_peers == NULL || !_get_admission_addr(peer_addr, addr))
+        return true;
+
+    bool is_admitted = true;
+    pthread_mutex_lock(&_admission_lock);
+    admission_peer *peer = g_hash_table_lookup(_admission_peers, addr);
+    if (peer == NULL && (peer = calloc(1, sizeof(admission_peer))) != NULL) {
+        memcpy(peer->addr, addr, sizeof(addr));
+        g_hash_table_insert(_admission_peers, peer->addr, peer);
+    }
+    if (peer == NULL || peer->n_conns >= _admission_max_conns_per_ip)
+        is_admitted = false;
+    else
+        peer->n_conns++;
+    pthread_mutex_unlock(&_admission_lock);
+
+    if (!is_admitted)
+        atomic_fetch_sub_explicit(&_admission_n_conns, 1, memory_order_relaxed);
+    return is_admitted;
+}
+
+void release_admitted_connection(const struct sockaddr_storage *peer_addr) {
+    if (!_admission_enabled)
+        return;
+
+    atomic_fetch_sub_explicit(&_admission_n_conns, 1, memory_order_relaxed);
+
+    unsigned char addr[16];
+    if (_admission_peers == NULL || !_get_admission_addr(peer_addr, addr))
+        return;
+
+    pthread_mutex_lock(&_admission_lock);
+    admission_peer *peer = g_hash_table_lookup(_admission_peers, addr);
+    if (peer != NULL && --peer->n_conns <= 0)
+        g_hash_table_remove(_admission_peers, addr);
+    pthread_mutex_unlock(&_admission_lock);
+}
+
+int get_admitted_connections() {
+    return atomic_load_explicit(&_admission_n_conns, memory_order_relaxed);
+}
+
+int _get_admission_addr(const struct sockaddr_storage *peer_addr, unsigned char *addr) {
+    if (peer_addr->ss_family == AF_INET6) {
+        memcpy(addr, &((const struct sockaddr_in6 *)peer_addr)->sin6_addr, 16);
+        return 1;
+    }
+    if (peer_addr->ss_family == AF_INET) {
+        memset(addr, 0, 10);
+        addr[10] = addr[11] = 0xff;
+        memcpy(addr + 12, &((const struct sockaddr_in *)peer_addr)->sin_addr, 4);
+        return 1;
+    }
+
+    return 0;
+}
+
+guint _admission_addr_hash(gconstpointer key) {
+    // FNV-1a
+    const unsigned char *addr = key;
+    guint hash = 2166136261u;
+    for (int byte_no = 0; byte_no < 16; byte_no++)
+        hash = (hash ^ addr[byte_no]) * 16777619u;
+    return hash;
+}
+
+gboolean _admission_addr_equal(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, 16) == 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file slib/arena.c
+ * @brief Functions for the bump (arena) allocator.
+ *
+ * Implements functions defined in `include/arena.h`. Used to allocate the request and response
+ * data of an exchange from the connection's arena and release it with a single reset.
+ *
+ * @see typedef struct arena
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "slab.h"
+
+arena *create_arena(size_t chunk_size) {
+    if (chunk_size == 0)
+        chunk_size = ARENA_CHUNK_SIZE;
+
+    // The arena and its first chunk come from the thread's slab cache, so a worker reuses the
+    // arenas of closed connections.
+    size_t arena_size = _get_arena_struct_size();
+    arena *a = slab_alloc(get_arena_size(chunk_size));
+    if (a == NULL)
+        return NULL;
+
+    a->first = (arena_chunk *)((char *)a + arena_size);
+    a->first->next = NULL;
+    a->first->size = chunk_size;
+    a->first->used = 0;
+    a->chunk = a->first;
+    a->chunk_size = chunk_size;
+
+    return a;
+}
+
+size_t get_arena_size(size_t chunk_size) {
+    if (chunk_size == 0)
+        chunk_size = ARENA_CHUNK_SIZE;
+
+    return _get_arena_struct_size() + sizeof(arena_chunk) + chunk_size;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+    if (a == NULL || size > SIZE_MAX - alignof(max_align_t))
+        return NULL;
+
+    // Every allocation is rounded up, so the next one stays aligned.
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    arena_chunk *chunk = a->chunk;
+    if (chunk->size - chunk->used < size && (chunk = _add_arena_chunk(a, size)) == NULL)
+        return NULL;
+
+    void *ptr = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char *arena_strdup(arena *a, const char *str) {
+    if (str == NULL)
+        return NULL;
+
+    return arena_strndup(a, str, strlen(str));
+}
+
+char *arena_strndup(arena *a, const char *str, size_t len) {
+    if (str == NULL)
+        return NULL;
+
+    len = strnlen(str, len);
+    char *dup = arena_alloc(a, len + 1);
+    if (dup == NULL)
+        return NULL;
+
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+void reset_arena(arena *a) {
+    if (a == NULL)
+        return;
+
+    arena_chunk *chunk = a->chunk, *next = NULL;
+    while (chunk != a->first) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    a->chunk = a->first;
+    a->first->used = 0;
+}
+
+void destroy_arena(arena *a) {
+    if (a == NULL)
+        return;
+
+    reset_arena(a);
+    slab_free(a);
+    a = NULL;
+}
+
+arena_chunk *_add_arena_chunk(arena *a, size_t size) {
+    if (size < a->chunk_size)
+        size = a->chunk_size;
+
+    arena_chunk *chunk = malloc(sizeof(arena_chunk) + size);
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->next = a->chunk;
+    chunk->size = size;
+    chunk->used = 0;
+    a->chunk = chunk;
+
+    return chunk;
+}
+
+size_t _get_arena_struct_size() {
+    // The arena struct is padded, so the first chunk that follows it is aligned.
+    return (sizeof(arena) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
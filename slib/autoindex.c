@@ -0,0 +1,195 @@
+/**
+ * @file slib/autoindex.c
+ * @brief Functions for generating directory listings.
+ *
+ * Implements functions defined in `include/autoindex.h`. Used by the server to list directories
+ * that have no index file when `autoindex` is enabled.
+ *
+ * The entries are read with `readdir()` and `fstatat()` relative to the opened directory, so the
+ * listing is generated without resolving any path again.
+ *
+ * @see enum autoindex_format
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "autoindex.h"
+
+autoindex_format parse_autoindex_format(const char *name) {
+    if (name != NULL && strcasecmp(name, "json") == 0)
+        return AUTOINDEX_JSON;
+    return AUTOINDEX_HTML;
+}
+
+const char *get_autoindex_content_type(const autoindex_format format) {
+    return format == AUTOINDEX_JSON ? "application/json" : "text/html";
+}
+
+GString *format_directory_listing(const int dir_fd, const char *url_path,
+                                  const autoindex_format format) {
+    if (url_path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // fdopendir() takes over the descriptor, so the caller's descriptor is duplicated.
+    int list_fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    DIR *dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if (dir == NULL) {
+        int saved_errno = errno;
+        if (list_fd >= 0)
+            close(list_fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    // The duplicate shares the offset with `dir_fd`, which may have been listed before.
+    rewinddir(dir);
+
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(autoindex_entry));
+    struct dirent *dirent = NULL;
+    while ((dirent = readdir(dir)) != NULL) {
+        if (dirent->d_name[0] == '.')
+            continue;
+
+        autoindex_entry entry;
+        if (fstatat(dir_fd, dirent->d_name, &entry.entry_stat, AT_SYMLINK_NOFOLLOW) < 0)
+            continue;
+        entry.name = g_strdup(dirent->d_name);
+        g_array_append_val(entries, entry);
+    }
+    closedir(dir);
+
+    g_array_sort(entries, _compare_autoindex_entries);
+
+    GString *listing = g_string_sized_new(256 + entries->len * 128);
+    if (format == AUTOINDEX_JSON)
+        _format_json_listing(listing, entries);
+    else
+        _format_html_listing(listing, url_path, entries);
+
+    for (guint i = 0; i < entries->len; i++)
+        g_free(g_array_index(entries, autoindex_entry, i).name);
+    g_array_free(entries, TRUE);
+
+    return listing;
+}
+
+gint _compare_autoindex_entries(gconstpointer a, gconstpointer b) {
+    const autoindex_entry *entry_a = a, *entry_b = b;
+    bool is_dir_a = S_ISDIR(entry_a->entry_stat.st_mode);
+    bool is_dir_b = S_ISDIR(entry_b->entry_stat.st_mode);
+    if (is_dir_a != is_dir_b)
+        return is_dir_a ? -1 : 1;
+
+    return strcmp(entry_a->name, entry_b->name);
+}
+
+void _append_html_escaped(GString *out, const char *str) {
+    for (; *str != '\0'; str++) {
+        switch (*str) {
+        case '&':
+            g_string_append(out, "&amp;");
+            break;
+        case '<':
+            g_string_append(out, "&lt;");
+            break;
+        case '>':
+            g_string_append(out, "&gt;");
+            break;
+        case '"':
+            g_string_append(out, "&quot;");
+            break;
+        case '\'':
+            g_string_append(out, "&#39;");
+            break;
+        default:
+            g_string_append_c(out, *str);
+        }
+    }
+}
+
+void _append_json_string(GString *out, const char *str) {
+    g_string_append_c(out, '"');
+    for (; *str != '\0'; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            g_string_append_printf(out, "\\%c", c);
+        else if (c < 0x20)
+            g_string_append_printf(out, "\\u%04x", c);
+        else
+            g_string_append_c(out, c);
+    }
+    g_string_append_c(out, '"');
+}
+
+void _format_html_listing(GString *out, const char *url_path, const GArray *entries) {
+    char date[HTTP_DATE_BUF_SIZE];
+
+    g_string_append(out, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n"
+                         "<title>Index of ");
+    _append_html_escaped(out, url_path);
+    g_string_append(out, "</title>\n</head>\n<body>\n<h1>Index of ");
+    _append_html_escaped(out, url_path);
+    g_string_append(out, "</h1>\n<table>\n"
+                         "<tr><th>Name</th><th>Last modified</th><th>Size</th></tr>\n");
+
+    if (strcmp(url_path, "/") != 0)
+        g_string_append(out, "<tr><td><a href=\"../\">../</a></td><td></td><td>-</td></tr>\n");
+
+    for (guint i = 0; i < entries->len; i++) {
+        const autoindex_entry *entry = &g_array_index(entries, autoindex_entry, i);
+        bool is_dir = S_ISDIR(entry->entry_stat.st_mode);
+
+        // Reserved characters (e.g. `?`, `#`) are escaped, so every name links to itself.
+        char *href = g_uri_escape_string(entry->name, NULL, TRUE);
+        g_string_append(out, "<tr><td><a href=\"");
+        _append_html_escaped(out, href);
+        g_string_append(out, is_dir ? "/\">" : "\">");
+        _append_html_escaped(out, entry->name);
+        g_string_append_printf(out, "%s</a></td><td>%s</td><td>", is_dir ? "/" : "",
+                               format_http_date(entry->entry_stat.st_mtime, date));
+        if (is_dir)
+            g_string_append(out, "-");
+        else
+            g_string_append_printf(out, "%lld", (long long)entry->entry_stat.st_size);
+        g_string_append(out, "</td></tr>\n");
+        g_free(href);
+    }
+
+    g_string_append(out, "</table>\n</body>\n</html>\n");
+}
+
+void _format_json_listing(GString *out, const GArray *entries) {
+    char date[HTTP_DATE_BUF_SIZE];
+
+    g_string_append_c(out, '[');
+    for (guint i = 0; i < entries->len; i++) {
+        const autoindex_entry *entry = &g_array_index(entries, autoindex_entry, i);
+        bool is_dir = S_ISDIR(entry->entry_stat.st_mode);
+
+        g_string_append(out, i == 0 ? "\n{\"name\":" : ",\n{\"name\":");
+        _append_json_string(out, entry->name);
+        g_string_append_printf(out, ",\"type\":\"%s\",\"mtime\":\"%s\"",
+                               is_dir ? "directory" : "file",
+                               format_http_date(entry->entry_stat.st_mtime, date));
+        if (!is_dir)
+            g_string_append_printf(out, ",\"size\":%lld", (long long)entry->entry_stat.st_size);
+        g_string_append_c(out, '}');
+    }
+    g_string_append(out, entries->len > 0 ? "\n]\n" : "]\n");
+}
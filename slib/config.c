@@ -11,6 +11,10 @@
  * available in glib library. Not all the configurations are implemented yet but the goal is to
  * have most settings configured through the config file defined by `CONF_FILE` macro.
  *
+ * The server doesn't look up keys on hot paths. `load_config()` and `reload_config()` create a typed,
+ * immutable snapshot (`struct server_config`) of the config, which is published with an atomic
+ * pointer store and read with `get_server_config()` without locking.
+ *
  * Keys for few configuration options are defined in `include/config.h` and can be used as keys
  * to retrive the configuration values. These macros can be changed by defining them before
  * `#include "config.h"`. In which case, the keys for the corresponding configuration options need to
@@ -22,8 +26,12 @@
  */
 
 #include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 #include "config.h"
 #include "helpers.h"
@@ -38,16 +46,17 @@ GKeyFile *config = NULL;
 
 /**
  * @private
- * @brief GError object to store the error.
+ * @brief The current configuration snapshot, `NULL` if the config is not loaded.
  *
  * This is a private object and should not be accessed directly.
  */
-GError *error = NULL;
+_Atomic(server_config *) _server_config = NULL;
 
 int load_config() {
     if (config != NULL)
         return 2;
 
+    GError *error = NULL;
     config = g_key_file_new();
     if (!g_key_file_load_from_file(config, CONF_FILE, 0, &error)) {
         printf("%s\n", error->message);
@@ -55,13 +64,51 @@ int load_config() {
         return 0;
     }
 
+    server_config *cfg = _create_server_config(config);
+    if (cfg == NULL)
+        return 0;
+    atomic_store_explicit(&_server_config, cfg, memory_order_release);
+
+    return 1;
+}
+
+int reload_config() {
+    if (config == NULL)
+        return 0;
+
+    GError *error = NULL;
+    GKeyFile *key_file = g_key_file_new();
+    if (!g_key_file_load_from_file(key_file, CONF_FILE, 0, &error)) {
+        printf("%s\n", error->message);
+        free_gerror(&error);
+        g_key_file_free(key_file);
+        return 0;
+    }
+
+    server_config *cfg = _create_server_config(key_file);
+    if (cfg == NULL) {
+        g_key_file_free(key_file);
+        return 0;
+    }
+
+    // Readers may still hold the old snapshot, so it is kept until the config is unloaded.
+    cfg->retired = atomic_load_explicit(&_server_config, memory_order_relaxed);
+    atomic_store_explicit(&_server_config, cfg, memory_order_release);
+
+    g_key_file_free(config);
+    config = key_file;
     return 1;
 }
 
+const server_config *get_server_config() {
+    return atomic_load_explicit(&_server_config, memory_order_acquire);
+}
+
 char *get_config(const char *key) {
     if (config == NULL)
         return NULL;
 
+    GError *error = NULL;
     char *value = g_key_file_get_value(config, GROUP_NAME, key, &error);
     if (value == NULL) {
         printf("%s\n", error->message);
@@ -77,6 +124,7 @@ char *get_config_str(const char *key) {
     if (config == NULL)
         return NULL;
 
+    GError *error = NULL;
     char *value = g_key_file_get_string(config, GROUP_NAME, key, &error);
     if (value == NULL) {
         printf("%s\n", error->message);
@@ -92,8 +140,7 @@ int get_config_int(const char *key) {
     if (config == NULL)
         return INT_MIN;
 
-    if (error != NULL)
-        free_gerror(&error);
+    GError *error = NULL;
     int value = g_key_file_get_integer(config, GROUP_NAME, key, &error);
     if (error != NULL) {
         printf("%s\n", error->message);
@@ -111,6 +158,295 @@ void unload_config() {
     g_key_file_free(config);
     config = NULL;
 
-    if (error != NULL)
+    _free_server_config(atomic_exchange(&_server_config, NULL));
+}
+
+server_config *_create_server_config(GKeyFile *key_file) {
+    server_config *cfg = calloc(1, sizeof(server_config));
+    if (cfg == NULL)
+        return NULL;
+
+    cfg->host = _get_key_file_str(key_file, HOST_CONF_KEY, DEFAULT_SERVER_HOST);
+    cfg->port = _get_key_file_int(key_file, PORT_CONF_KEY, DEFAULT_SERVER_PORT);
+    cfg->site_root_dir = _get_key_file_str(key_file, SITE_DIR_CONF_KEY, DEFAULT_SITE_DIR);
+    cfg->default_page = _get_key_file_str(key_file, PAGE_CONF_KEY, DEFAULT_PAGE);
+    cfg->worker_threads = _get_key_file_int(key_file, WORKERS_CONF_KEY, 0);
+    cfg->keepalive_timeout =
+        _get_key_file_int(key_file, KEEPALIVE_TIMEOUT_CONF_KEY, DEFAULT_KEEPALIVE_TIMEOUT);
+    cfg->keepalive_requests =
+        _get_key_file_int(key_file, KEEPALIVE_REQUESTS_CONF_KEY, DEFAULT_KEEPALIVE_REQUESTS);
+
+    int value = 0;
+    if ((value = _get_key_file_int(key_file, SHUTDOWN_TIMEOUT_CONF_KEY,
+                                   DEFAULT_SHUTDOWN_TIMEOUT)) >= 0)
+        cfg->shutdown_timeout = value;
+    if ((value = _get_key_file_int(key_file, MAX_CONNECTIONS_CONF_KEY, 0)) > 0)
+        cfg->max_connections = value;
+    if ((value = _get_key_file_int(key_file, MAX_CONNECTIONS_PER_IP_CONF_KEY, 0)) > 0)
+        cfg->max_connections_per_ip = value;
+    cfg->request_head_timeout = DEFAULT_REQUEST_HEAD_TIMEOUT;
+    if ((value = _get_key_file_int(key_file, REQUEST_HEAD_TIMEOUT_CONF_KEY,
+                                   DEFAULT_REQUEST_HEAD_TIMEOUT)) > 0)
+        cfg->request_head_timeout = value;
+    cfg->request_body_timeout = DEFAULT_REQUEST_BODY_TIMEOUT;
+    if ((value = _get_key_file_int(key_file, REQUEST_BODY_TIMEOUT_CONF_KEY,
+                                   DEFAULT_REQUEST_BODY_TIMEOUT)) > 0)
+        cfg->request_body_timeout = value;
+    if ((value = _get_key_file_int(key_file, MAX_REQUEST_HEAD_SIZE_CONF_KEY,
+                                   DEFAULT_MAX_REQUEST_HEAD_SIZE)) > 0)
+        cfg->max_request_head_size = value;
+    if ((value = _get_key_file_int(key_file, MAX_REQUEST_BODY_SIZE_CONF_KEY,
+                                   DEFAULT_MAX_REQUEST_BODY_SIZE)) >= 0)
+        cfg->max_request_body_size = value;
+    if ((value = _get_key_file_int(key_file, FILE_CACHE_SIZE_CONF_KEY, 0)) > 0)
+        cfg->file_cache_size = value;
+    if ((value = _get_key_file_int(key_file, FILE_CACHE_MAX_FILE_SIZE_CONF_KEY, 0)) > 0)
+        cfg->file_cache_max_file_size = value;
+    if ((value = _get_key_file_int(key_file, FILE_CACHE_MAX_ENTRIES_CONF_KEY, 0)) > 0)
+        cfg->file_cache_max_entries = value;
+    cfg->file_cache_mmap = _get_key_file_int(key_file, FILE_CACHE_MMAP_CONF_KEY, 0) > 0;
+    cfg->file_cache_huge_pages = _get_key_file_int(key_file, FILE_CACHE_HUGE_PAGES_CONF_KEY, 0) > 0;
+    if ((value = _get_key_file_int(key_file, FD_CACHE_ENTRIES_CONF_KEY, 0)) > 0)
+        cfg->fd_cache_entries = value;
+    cfg->fd_cache_ttl = DEFAULT_FD_CACHE_TTL;
+    if ((value = _get_key_file_int(key_file, FD_CACHE_TTL_CONF_KEY, DEFAULT_FD_CACHE_TTL)) > 0)
+        cfg->fd_cache_ttl = value;
+    cfg->listen_backlog =
+        _get_key_file_int(key_file, LISTEN_BACKLOG_CONF_KEY, DEFAULT_LISTEN_BACKLOG);
+    cfg->reuse_port = _get_key_file_int(key_file, REUSE_PORT_CONF_KEY, 0) > 0;
+    cfg->pin_workers = _get_key_file_int(key_file, PIN_WORKERS_CONF_KEY, 0) > 0;
+    cfg->worker_cpus = NULL;
+    cfg->n_worker_cpus = 0;
+    cfg->event_backend = _get_key_file_str(key_file, EVENT_BACKEND_CONF_KEY, "epoll");
+    cfg->tcp_defer_accept = _get_key_file_int(key_file, TCP_DEFER_ACCEPT_CONF_KEY, 0);
+    cfg->tcp_fastopen = _get_key_file_int(key_file, TCP_FASTOPEN_CONF_KEY, 0);
+    cfg->access_log = _get_key_file_str(key_file, ACCESS_LOG_CONF_KEY, "");
+    cfg->access_log_format = _get_key_file_str(key_file, ACCESS_LOG_FORMAT_CONF_KEY, "combined");
+    if ((value = _get_key_file_int(key_file, ACCESS_LOG_SAMPLE_CONF_KEY, 1)) > 0)
+        cfg->access_log_sample = value;
+    if ((value = _get_key_file_int(key_file, ACCESS_LOG_BUFFER_CONF_KEY, 0)) > 0)
+        cfg->access_log_buffer = value;
+    cfg->precompressed_files = _get_key_file_int(key_file, PRECOMPRESSED_FILES_CONF_KEY, 0) > 0;
+    if ((value = _get_key_file_int(key_file, GZIP_LEVEL_CONF_KEY, 0)) > 0)
+        cfg->gzip_level = value < 9 ? value : 9;
+    cfg->autoindex = _get_key_file_int(key_file, AUTOINDEX_CONF_KEY, 0) > 0;
+    cfg->autoindex_format = _get_key_file_str(key_file, AUTOINDEX_FORMAT_CONF_KEY, "html");
+    cfg->mime_types_file = _get_key_file_str(key_file, MIME_TYPES_FILE_CONF_KEY, "");
+    cfg->metrics_path = _get_key_file_str(key_file, METRICS_PATH_CONF_KEY, "");
+    cfg->proxy_routes = _get_key_file_str(key_file, PROXY_ROUTES_CONF_KEY, "");
+    cfg->proxy_balance = _get_key_file_str(key_file, PROXY_BALANCE_CONF_KEY, "round_robin");
+    cfg->proxy_pool_size = DEFAULT_PROXY_POOL_SIZE;
+    if ((value = _get_key_file_int(key_file, PROXY_POOL_SIZE_CONF_KEY,
+                                   DEFAULT_PROXY_POOL_SIZE)) >= 0)
+        cfg->proxy_pool_size = value;
+    cfg->proxy_health_interval = DEFAULT_PROXY_HEALTH_INTERVAL;
+    if ((value = _get_key_file_int(key_file, PROXY_HEALTH_INTERVAL_CONF_KEY,
+                                   DEFAULT_PROXY_HEALTH_INTERVAL)) >= 0)
+        cfg->proxy_health_interval = value;
+    cfg->proxy_timeout = DEFAULT_PROXY_TIMEOUT;
+    if ((value = _get_key_file_int(key_file, PROXY_TIMEOUT_CONF_KEY, DEFAULT_PROXY_TIMEOUT)) > 0)
+        cfg->proxy_timeout = value;
+    if ((value = _get_key_file_int(key_file, TLS_PORT_CONF_KEY, 0)) > 0)
+        cfg->tls_port = value;
+    cfg->tls_certificate = _get_key_file_str(key_file, TLS_CERTIFICATE_CONF_KEY, "");
+    cfg->tls_private_key = _get_key_file_str(key_file, TLS_PRIVATE_KEY_CONF_KEY, "");
+    cfg->tls_session_cache = DEFAULT_TLS_SESSION_CACHE;
+    if ((value = _get_key_file_int(key_file, TLS_SESSION_CACHE_CONF_KEY,
+                                   DEFAULT_TLS_SESSION_CACHE)) >= 0)
+        cfg->tls_session_cache = value;
+    cfg->tls_ktls = _get_key_file_int(key_file, TLS_KTLS_CONF_KEY, 1) > 0;
+    cfg->http2 = _get_key_file_int(key_file, HTTP2_CONF_KEY, 1) > 0;
+    cfg->http2_max_streams = DEFAULT_HTTP2_MAX_STREAMS;
+    if ((value = _get_key_file_int(key_file, HTTP2_MAX_STREAMS_CONF_KEY,
+                                   DEFAULT_HTTP2_MAX_STREAMS)) > 0)
+        cfg->http2_max_streams = value;
+
+    char *cache_control = _get_key_file_str(key_file, CACHE_CONTROL_CONF_KEY, "");
+    int parsed = cache_control != NULL && _parse_cache_control_rules(cfg, cache_control);
+    free(cache_control);
+
+    char *index_files = _get_key_file_str(key_file, INDEX_FILES_CONF_KEY, DEFAULT_INDEX_FILES);
+    parsed = parsed && index_files != NULL && _parse_index_files(cfg, index_files);
+    free(index_files);
+
+    char *worker_cpus = _get_key_file_str(key_file, WORKER_CPUS_CONF_KEY, "");
+    parsed = parsed && worker_cpus != NULL && _parse_worker_cpus(cfg, worker_cpus);
+    free(worker_cpus);
+
+    if (cfg->host == NULL || cfg->site_root_dir == NULL || cfg->default_page == NULL ||
+        cfg->access_log == NULL || cfg->access_log_format == NULL ||
+        cfg->mime_types_file == NULL || cfg->metrics_path == NULL || cfg->proxy_routes == NULL ||
+        cfg->proxy_balance == NULL || cfg->tls_certificate == NULL ||
+        cfg->tls_private_key == NULL || cfg->event_backend == NULL ||
+        cfg->autoindex_format == NULL || !parsed) {
+        _free_server_config(cfg);
+        return NULL;
+    }
+
+    return cfg;
+}
+
+void _free_server_config(server_config *cfg) {
+    server_config *retired = NULL;
+    while (cfg != NULL) {
+        retired = cfg->retired;
+        free(cfg->host);
+        free(cfg->site_root_dir);
+        free(cfg->default_page);
+        free(cfg->access_log);
+        free(cfg->access_log_format);
+        free(cfg->mime_types_file);
+        free(cfg->metrics_path);
+        free(cfg->proxy_routes);
+        free(cfg->proxy_balance);
+        free(cfg->tls_certificate);
+        free(cfg->tls_private_key);
+        free(cfg->event_backend);
+        free(cfg->autoindex_format);
+        for (unsigned int i_no = 0; i_no < cfg->n_index_files; i_no++)
+            free(cfg->index_files[i_no]);
+        free(cfg->index_files);
+        free(cfg->worker_cpus);
+        for (unsigned int r_no = 0; r_no < cfg->n_cache_control; r_no++) {
+            free(cfg->cache_control[r_no].pattern);
+            free(cfg->cache_control[r_no].value);
+        }
+        free(cfg->cache_control);
+        free(cfg);
+        cfg = retired;
+    }
+}
+
+const char *get_cache_control(const server_config *cfg, const char *url, const char *mimetype) {
+    for (unsigned int r_no = 0; r_no < cfg->n_cache_control; r_no++) {
+        const char *pattern = cfg->cache_control[r_no].pattern;
+        size_t pattern_len = strlen(pattern);
+
+        if ((pattern[0] == '/' && strncmp(url, pattern, pattern_len) == 0) ||
+            strcmp(pattern, "*") == 0)
+            return cfg->cache_control[r_no].value;
+        if (pattern[0] == '/' || mimetype == NULL)
+            continue;
+
+        // "<type>/*" matches every subtype, the '*' is left out of the comparison.
+        if (pattern_len > 2 && strcmp(pattern + pattern_len - 2, "/*") == 0
+                ? strncasecmp(mimetype, pattern, pattern_len - 1) == 0
+                : strcasecmp(mimetype, pattern) == 0)
+            return cfg->cache_control[r_no].value;
+    }
+
+    return NULL;
+}
+
+char *_get_key_file_str(GKeyFile *key_file, const char *key, const char *default_val) {
+    char *value = g_key_file_get_string(key_file, GROUP_NAME, key, NULL);
+    if (value == NULL)
+        return strdup(default_val);
+
+    return value;
+}
+
+int _get_key_file_int(GKeyFile *key_file, const char *key, const int default_val) {
+    GError *error = NULL;
+    int value = g_key_file_get_integer(key_file, GROUP_NAME, key, &error);
+    if (error != NULL) {
         free_gerror(&error);
+        return default_val;
+    }
+
+    return value;
+}
+
+int _parse_cache_control_rules(server_config *cfg, const char *rules) {
+    char *rules_copy = strdup(rules), *save_ptr = NULL;
+    if (rules_copy == NULL)
+        return 0;
+
+    for (char *rule = strtok_r(rules_copy, ";", &save_ptr); rule != NULL;
+         rule = strtok_r(NULL, ";", &save_ptr)) {
+        char *sep = strchr(rule, '=');
+        if (sep == NULL)
+            continue;
+        *sep = '\0';
+
+        char *pattern = trim(rule), *value = trim(sep + 1);
+        if (pattern[0] == '\0' || value[0] == '\0')
+            continue;
+
+        cache_control_rule *rules_new =
+            realloc(cfg->cache_control, (cfg->n_cache_control + 1) * sizeof(cache_control_rule));
+        if (rules_new == NULL) {
+            free(rules_copy);
+            return 0;
+        }
+        cfg->cache_control = rules_new;
+        cfg->cache_control[cfg->n_cache_control].pattern = strdup(pattern);
+        cfg->cache_control[cfg->n_cache_control].value = strdup(value);
+        cfg->n_cache_control++;
+    }
+
+    free(rules_copy);
+    return 1;
+}
+
+int _parse_index_files(server_config *cfg, const char *names) {
+    char *names_copy = strdup(names), *save_ptr = NULL;
+    if (names_copy == NULL)
+        return 0;
+
+    for (char *name = strtok_r(names_copy, " \t,", &save_ptr); name != NULL;
+         name = strtok_r(NULL, " \t,", &save_ptr)) {
+        if (strchr(name, '/') != NULL || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        char **files_new = realloc(cfg->index_files, (cfg->n_index_files + 1) * sizeof(char *));
+        if (files_new == NULL || (files_new[cfg->n_index_files] = strdup(name)) == NULL) {
+            if (files_new != NULL)
+                cfg->index_files = files_new;
+            free(names_copy);
+            return 0;
+        }
+        cfg->index_files = files_new;
+        cfg->n_index_files++;
+    }
+
+    free(names_copy);
+    return 1;
+}
+
+int _parse_worker_cpus(server_config *cfg, const char *cpus) {
+    char *cpus_copy = strdup(cpus), *save_ptr = NULL;
+    if (cpus_copy == NULL)
+        return 0;
+
+    for (char *range = strtok_r(cpus_copy, " \t,", &save_ptr); range != NULL;
+         range = strtok_r(NULL, " \t,", &save_ptr)) {
+        char *end = NULL;
+        long first = strtol(range, &end, 10), last = first;
+        if (end == range || first < 0)
+            continue;
+        if (*end == '-') {
+            char *last_str = end + 1;
+            last = strtol(last_str, &end, 10);
+            if (end == last_str || last < first)
+                continue;
+        }
+        if (*end != '\0' || first > MAX_WORKER_CPU)
+            continue;
+        if (last > MAX_WORKER_CPU)
+            last = MAX_WORKER_CPU;
+
+        int *cpus_new =
+            realloc(cfg->worker_cpus, (cfg->n_worker_cpus + last - first + 1) * sizeof(int));
+        if (cpus_new == NULL) {
+            free(cpus_copy);
+            return 0;
+        }
+        cfg->worker_cpus = cpus_new;
+        for (long cpu = first; cpu <= last; cpu++)
+            cfg->worker_cpus[cfg->n_worker_cpus++] = (int)cpu;
+    }
+
+    free(cpus_copy);
+    return 1;
 }
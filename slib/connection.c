@@ -0,0 +1,709 @@
+/**
+ * @file slib/connection.c
+ * @brief Functions for managing client connections owned by a worker event loop.
+ *
+ * Implements functions defined in `include/connection.h`. Used to create, read from and close
+ * client connections.
+ *
+ * Connections are accepted as non-blocking sockets, so reading never blocks a worker (with the
+ * io_uring backend, the worker's ring receives and the data is handed over with
+ * `receive_connection_data()`). The request head is accumulated in `connection::recv_buf` across
+ * as many `recv()` calls as needed and is parsed incrementally as it arrives, which makes requests
+ * split across TCP segments safe to parse. After a request is handled, its head and body are
+ * discarded from the buffer and any pipelined request that arrived in the same `recv()` is handled
+ * next.
+ *
+ * Responses are written to the non-blocking socket as well. The bytes it doesn't take are queued
+ * on the connection: buffers are copied (or held, like the body of a file cache entry), file
+ * ranges keep a duplicate of the file descriptor and only their offset. The worker sends the queue
+ * with `flush_connection()` whenever the socket is writable again and moves on to the next request
+ * once it is empty.
+ *
+ * Connections and receive buffers are allocated from the slab cache of the worker (see
+ * `include/slab.h`), connections are owned by a single worker so the pools never need a lock.
+ *
+ * @see typedef struct connection
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+/**
+ * @private
+ * @brief Connection the calling thread handles a request of, see `set_active_connection()`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local connection *_active_connection = NULL;
+
+connection *create_connection(const int fd) {
+    connection *conn = slab_alloc(sizeof(connection));
+    if (conn == NULL)
+        return NULL;
+
+    if ((conn->arena = create_arena(ARENA_CHUNK_SIZE)) == NULL) {
+        slab_free(conn);
+        return NULL;
+    }
+
+    const server_config *cfg = get_server_config();
+    size_t max_head_size = cfg != NULL ? cfg->max_request_head_size : DEFAULT_MAX_REQUEST_HEAD_SIZE;
+
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->recv_len = 0;
+    conn->recv_size = 0;
+    conn->recv_max = max_head_size > REQ_BUF_SIZE ? max_head_size : REQ_BUF_SIZE;
+    conn->head_len = 0;
+    conn->n_requests = 0;
+    conn->error_status = 0;
+    conn->last_active = conn->head_started = conn->body_started = _connection_now();
+    conn->timer = (timer_wheel_timer){0};
+    conn->accepted_ns = get_metrics_time();
+    conn->parse_ns = 0;
+    conn->peer_addr.ss_family = AF_UNSPEC;
+    init_http_parser(&conn->parser);
+    conn->body = (http_body_parser){.state = HTTP_BODY_DONE};
+    conn->body_pos = 0;
+    conn->body_max = 0;
+    conn->is_blocking = fd >= 0 && (fcntl(fd, F_GETFL, 0) & O_NONBLOCK) == 0;
+    conn->events = 0;
+    conn->output = conn->output_tail = NULL;
+    conn->next_state = CONN_READING;
+    conn->uring_op = 0;
+    conn->proxy = NULL;
+    conn->upstream_fd = -1;
+    conn->http2 = NULL;
+    conn->recv_buf = NULL;
+    conn->prev = NULL;
+    conn->next = NULL;
+
+    return conn;
+}
+
+conn_state read_connection(connection *conn) {
+    bool peer_closed = false;
+    http_parse_result result = HTTP_PARSE_INCOMPLETE;
+
+    if (conn->recv_buf == NULL) {
+        if (!_acquire_recv_buf(conn))
+            return conn->state = CONN_CLOSING;
+        conn->head_started = _connection_now();
+    }
+
+    while (1) {
+        if (!_recv_connection(conn, &peer_closed))
+            return conn->state = CONN_CLOSING;
+
+        // A full buffer with an incomplete head is grown and read into again.
+        result = _find_request_head(conn);
+        if (result != HTTP_PARSE_INCOMPLETE || peer_closed || conn->recv_len < conn->recv_size ||
+            !_grow_recv_buf(conn))
+            break;
+    }
+
+    // A half-closed peer can still receive the response to a complete request.
+    if (result == HTTP_PARSE_OK)
+        return conn->state = CONN_HANDLING;
+    if (result == HTTP_PARSE_ERROR) {
+        conn->error_status = 400;
+        return conn->state = CONN_HANDLING;
+    }
+
+    if (peer_closed)
+        return conn->state = CONN_CLOSING;
+    if (conn->recv_len == conn->recv_size) {
+        conn->error_status = 431;
+        return conn->state = CONN_HANDLING;
+    }
+
+    return conn->state = CONN_READING;
+}
+
+conn_state receive_connection_data(connection *conn, const char *buf, const size_t len) {
+    if (conn->recv_buf == NULL) {
+        if (len == 0 || !_acquire_recv_buf(conn))
+            return conn->state = CONN_CLOSING;
+        conn->head_started = _connection_now();
+    }
+
+    // The data can't be left in the socket for later, so a buffer that can't grow is replaced by
+    // one of its own that fits.
+    while (conn->recv_len + len > conn->recv_size && _grow_recv_buf(conn))
+        ;
+    if (conn->recv_len + len > conn->recv_size) {
+        char *recv_buf = slab_realloc(conn->recv_buf, conn->recv_len + len + 1);
+        if (recv_buf == NULL)
+            return conn->state = CONN_CLOSING;
+        conn->recv_buf = recv_buf;
+        conn->recv_size = conn->recv_len + len;
+    }
+
+    if (len > 0) {
+        memcpy(conn->recv_buf + conn->recv_len, buf, len);
+        conn->recv_buf[conn->recv_len += len] = '\0';
+        conn->last_active = _connection_now();
+    }
+
+    http_parse_result result = _find_request_head(conn);
+    if (result == HTTP_PARSE_OK)
+        return conn->state = CONN_HANDLING;
+    if (result == HTTP_PARSE_ERROR) {
+        conn->error_status = 400;
+        return conn->state = CONN_HANDLING;
+    }
+
+    if (len == 0)
+        return conn->state = CONN_CLOSING;
+    if (conn->recv_len >= conn->recv_max) {
+        conn->error_status = 431;
+        return conn->state = CONN_HANDLING;
+    }
+
+    return conn->state = CONN_READING;
+}
+
+ssize_t read_connection_body(connection *conn, const char **data) {
+    size_t consumed = 0;
+    http_view view;
+
+    while (conn->body.state != HTTP_BODY_DONE) {
+        if (conn->body_pos == conn->recv_len) {
+            // All the data after the head was parsed, so the space after the head is reused.
+            conn->recv_len = conn->body_pos = conn->head_len;
+            if (conn->recv_len == conn->recv_size) {
+                errno = ENOBUFS;
+                return -1;
+            }
+
+            const server_config *cfg = get_server_config();
+            int timeout = cfg != NULL ? cfg->request_body_timeout : DEFAULT_REQUEST_BODY_TIMEOUT;
+            if (_connection_now() - conn->body_started >= timeout) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+
+            // A socket without data returns `EAGAIN`, the caller waits for it through the worker.
+            ssize_t recv_size = recv_tls(conn->fd, conn->recv_buf + conn->recv_len,
+                                         conn->recv_size - conn->recv_len);
+            if (recv_size < 0 && errno == EINTR)
+                continue;
+            if (recv_size < 0 && errno == EWOULDBLOCK)
+                errno = EAGAIN;
+            if (recv_size <= 0) {
+                if (recv_size == 0)
+                    errno = ECONNRESET;
+                return -1;
+            }
+
+            conn->recv_len += recv_size;
+            conn->recv_buf[conn->recv_len] = '\0';
+            conn->last_active = _connection_now();
+        }
+
+        const char *buf = conn->recv_buf + conn->body_pos;
+        http_parse_result result =
+            parse_http_body(&conn->body, buf, conn->recv_len - conn->body_pos, &consumed, &view);
+        conn->body_pos += consumed;
+        if (result == HTTP_PARSE_ERROR) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (view.len > 0) {
+            *data = buf + view.off;
+            return view.len;
+        }
+    }
+
+    return 0;
+}
+
+int discard_connection_body(connection *conn, const uint64_t max_len) {
+    if (conn->body.state == HTTP_BODY_DONE)
+        return 2;
+    if (!conn->body.chunked && conn->body.remaining > max_len)
+        return 0;
+
+    const char *data = NULL;
+    ssize_t data_len = 0;
+    conn->body_max = max_len;
+    while ((data_len = read_connection_body(conn, &data)) > 0)
+        if (conn->body.body_len > max_len)
+            return 0;
+
+    // The rest of the body is dropped by the worker as it arrives.
+    return data_len == 0 || errno == EAGAIN;
+}
+
+conn_state next_connection_request(connection *conn) {
+    conn->n_requests++;
+    conn->last_active = conn->head_started = _connection_now();
+    reset_arena(conn->arena);
+    conn->body_max = 0;
+
+    // The end of a body that wasn't read completely is unknown, so is the next request.
+    if (conn->body.state != HTTP_BODY_DONE)
+        return conn->state = CONN_CLOSING;
+
+    memmove(conn->recv_buf, conn->recv_buf + conn->body_pos, conn->recv_len - conn->body_pos + 1);
+    conn->recv_len -= conn->body_pos;
+    conn->head_len = conn->body_pos = 0;
+    conn->error_status = 0;
+    init_http_parser(&conn->parser);
+
+    if (conn->recv_len == 0) {
+        _release_recv_buf(conn);
+        return conn->state = CONN_READING;
+    }
+
+    http_parse_result result = _find_request_head(conn);
+    if (result == HTTP_PARSE_OK)
+        return conn->state = CONN_HANDLING;
+    if (result == HTTP_PARSE_ERROR) {
+        conn->error_status = 400;
+        return conn->state = CONN_HANDLING;
+    }
+
+    return conn->state = CONN_READING;
+}
+
+conn_state load_connection_request(connection *conn, const char *buf, const size_t len) {
+    if (conn->recv_buf == NULL && !_acquire_recv_buf(conn))
+        return conn->state = CONN_CLOSING;
+
+    // Requests larger than a receive buffer get a buffer of their own, it is freed once released.
+    if (len > conn->recv_size) {
+        char *recv_buf = slab_realloc(conn->recv_buf, len + 1);
+        if (recv_buf == NULL)
+            return conn->state = CONN_CLOSING;
+        conn->recv_buf = recv_buf;
+        conn->recv_size = len;
+    }
+
+    memcpy(conn->recv_buf, buf, len);
+    conn->recv_buf[conn->recv_len = len] = '\0';
+    conn->head_len = conn->body_pos = 0;
+    conn->error_status = 0;
+    conn->head_started = conn->last_active;
+    init_http_parser(&conn->parser);
+
+    if (_find_request_head(conn) != HTTP_PARSE_OK)
+        conn->error_status = 400;
+    return conn->state = CONN_HANDLING;
+}
+
+ssize_t write_connection(connection *conn, const struct iovec *iov, const int iov_len,
+                         const int flags) {
+    return write_connection_held(conn, iov, iov_len, flags, NULL, NULL);
+}
+
+ssize_t write_connection_held(connection *conn, const struct iovec *iov, const int iov_len,
+                              const int flags, conn_output_release release, void *arg) {
+    size_t total_len = 0, sent = 0;
+    for (int iov_no = 0; iov_no < iov_len; iov_no++)
+        total_len += iov[iov_no].iov_len;
+
+    // Nothing is sent before the output queued earlier.
+    ssize_t send_size = 0;
+    if (conn->output == NULL && total_len > 0 &&
+        (send_size = _send_connection_iov(conn, iov, iov_len, flags)) < 0) {
+        if (release != NULL)
+            release(arg);
+        return -1;
+    }
+    sent = send_size;
+
+    // The rest is copied into a single part, except for the held buffer, which is queued as it is.
+    size_t held_len = release != NULL ? iov[iov_len - 1].iov_len : 0;
+    size_t copy_end = total_len - held_len;
+    conn_output *copy = NULL, *held = NULL;
+    if (sent < copy_end && (copy = _create_connection_output(copy_end - sent)) == NULL)
+        goto fail;
+    if (sent < total_len && held_len > 0 && (held = _create_connection_output(0)) == NULL)
+        goto fail;
+
+    if (copy != NULL) {
+        size_t pos = 0, skip = sent;
+        for (int iov_no = 0; iov_no < iov_len && pos < copy->len; iov_no++) {
+            size_t len = iov[iov_no].iov_len;
+            if (skip >= len) {
+                skip -= len;
+                continue;
+            }
+            memcpy(copy->buf + pos, (const char *)iov[iov_no].iov_base + skip, len - skip);
+            pos += len - skip;
+            skip = 0;
+        }
+        _queue_connection_output(conn, copy);
+    }
+
+    if (held != NULL) {
+        size_t held_sent = sent > copy_end ? sent - copy_end : 0;
+        held->data = (const char *)iov[iov_len - 1].iov_base + held_sent;
+        held->len = held_len - held_sent;
+        held->release = release;
+        held->release_arg = arg;
+        _queue_connection_output(conn, held);
+    } else if (release != NULL) {
+        release(arg);
+    }
+    return total_len;
+
+fail:
+    slab_free(copy);
+    if (release != NULL)
+        release(arg);
+    return -1;
+}
+
+ssize_t write_connection_file(connection *conn, const int file_fd, off_t offset,
+                              const size_t count) {
+    size_t len = count;
+    int result = 0;
+
+    // A file that fits in the socket buffer is sent without duplicating its descriptor.
+    if (conn->output == NULL && can_send_plaintext(conn->fd) &&
+        (result = _send_connection_file(conn, file_fd, &offset, &len)) == 0 && errno != EINVAL &&
+        errno != ENOSYS)
+        return -1;
+    if (len == 0)
+        return count;
+
+    conn_output *output = _create_connection_output(0);
+    if (output == NULL)
+        return -1;
+    if ((output->file_fd = fcntl(file_fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        slab_free(output);
+        return -1;
+    }
+    output->offset = offset;
+    output->len = len;
+    _queue_connection_output(conn, output);
+
+    // A socket that would block already is left to the event loop.
+    if (result != 2 && flush_connection(conn) == 0)
+        return -1;
+    return count;
+}
+
+int flush_connection(connection *conn) {
+    conn_output *output = NULL;
+
+    while ((output = conn->output) != NULL) {
+        // The end of the response is sent without waiting for more, the rest is corked.
+        int flags = output->next != NULL ? MSG_MORE : 0;
+        int result = 1;
+        if (output->file_fd < 0) {
+            result = _send_connection_buffer(conn, output, flags);
+        } else if (output->len > 0 && !output->is_read && can_send_plaintext(conn->fd)) {
+            result = _send_connection_file(conn, output->file_fd, &output->offset, &output->len);
+            if (result == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                output->is_read = true;
+                continue;
+            }
+        } else if (output->len > 0) {
+            if (!_read_connection_file(conn, output))
+                return 0;
+            continue;
+        }
+
+        if (result != 1)
+            return result;
+        conn->output = output->next;
+        if (conn->output == NULL)
+            conn->output_tail = NULL;
+        _free_connection_output(output);
+    }
+
+    return 1;
+}
+
+void set_active_connection(connection *conn) { _active_connection = conn; }
+
+connection *get_active_connection(const int fd) {
+    connection *conn = _active_connection;
+    return conn != NULL && conn->fd == fd && conn->http2 == NULL ? conn : NULL;
+}
+
+int set_connection_blocking(connection *conn, const int blocking) {
+    if (conn->is_blocking == (blocking != 0))
+        return 2;
+
+    int flags = fcntl(conn->fd, F_GETFL, 0);
+    if (flags < 0)
+        return 0;
+
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    if (fcntl(conn->fd, F_SETFL, flags) < 0)
+        return 0;
+
+    conn->is_blocking = blocking != 0;
+    return 1;
+}
+
+void close_connection(connection *conn) {
+    if (conn == NULL)
+        return;
+
+    destroy_http2_session(conn->http2);
+    conn->http2 = NULL;
+    conn_output *output = NULL;
+    while ((output = conn->output) != NULL) {
+        conn->output = output->next;
+        _free_connection_output(output);
+    }
+    if (conn->fd != -1) {
+        end_tls_session(conn->fd);
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    add_metrics_counter(METRICS_CONNECTIONS_CLOSED, 1);
+
+    _release_recv_buf(conn);
+    destroy_arena(conn->arena);
+    slab_free(conn);
+    conn = NULL;
+}
+
+time_t _connection_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+http_parse_result _find_request_head(connection *conn) {
+    long long start = is_metrics_enabled() ? get_metrics_time() : 0;
+    http_parse_result result = parse_http_request(&conn->parser, conn->recv_buf, conn->recv_len);
+    conn->head_len = (result == HTTP_PARSE_OK) ? conn->parser.head_len : 0;
+    conn->body_pos = conn->head_len;
+    if (result == HTTP_PARSE_OK)
+        conn->body_started = conn->last_active;
+
+    // A body whose framing can't be trusted makes the head as unusable as a malformed one.
+    if (result == HTTP_PARSE_OK &&
+        !init_http_body_parser(&conn->body, &conn->parser, conn->recv_buf)) {
+        conn->head_len = conn->body_pos = 0;
+        result = HTTP_PARSE_ERROR;
+    }
+
+    if (start != 0) {
+        conn->parse_ns += get_metrics_time() - start;
+        if (result != HTTP_PARSE_INCOMPLETE) {
+            observe_metrics_stage(METRICS_PARSE, conn->parse_ns);
+            conn->parse_ns = 0;
+        }
+    }
+    return result;
+}
+
+int _recv_connection(connection *conn, bool *peer_closed) {
+    ssize_t recv_size = 0;
+
+    while (conn->recv_len < conn->recv_size) {
+        recv_size =
+            recv_tls(conn->fd, conn->recv_buf + conn->recv_len, conn->recv_size - conn->recv_len);
+        if (recv_size == 0) {
+            *peer_closed = true;
+            break;
+        }
+        if (recv_size < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return 0;
+        }
+
+        conn->recv_len += recv_size;
+        conn->last_active = _connection_now();
+    }
+
+    conn->recv_buf[conn->recv_len] = '\0';
+    return 1;
+}
+
+int _acquire_recv_buf(connection *conn) {
+    if ((conn->recv_buf = slab_alloc(REQ_BUF_SIZE + 1)) == NULL)
+        return 0;
+
+    conn->recv_size = REQ_BUF_SIZE;
+    conn->recv_len = 0;
+    conn->recv_buf[0] = '\0';
+    return 1;
+}
+
+void _release_recv_buf(connection *conn) {
+    if (conn->recv_buf == NULL)
+        return;
+
+    slab_free(conn->recv_buf);
+    conn->recv_buf = NULL;
+    conn->recv_size = 0;
+    conn->recv_len = 0;
+}
+
+int _grow_recv_buf(connection *conn) {
+    if (conn->recv_size >= conn->recv_max)
+        return 0;
+
+    size_t size = conn->recv_size * 2 < conn->recv_max ? conn->recv_size * 2 : conn->recv_max;
+    char *buf = slab_realloc(conn->recv_buf, size + 1);
+    if (buf == NULL)
+        return 0;
+
+    conn->recv_buf = buf;
+    conn->recv_size = size;
+    return 1;
+}
+
+ssize_t _send_connection_iov(connection *conn, const struct iovec *iov, int iov_len,
+                             const int flags) {
+    ssize_t total_size = 0, send_size = 0;
+
+    // Without kTLS, OpenSSL encrypts the buffers one at a time.
+    if (!can_send_plaintext(conn->fd)) {
+        for (; iov_len > 0; iov++, iov_len--) {
+            if (iov->iov_len == 0)
+                continue;
+            if ((send_size = send_tls(conn->fd, iov->iov_base, iov->iov_len, flags)) < 0)
+                break;
+            total_size += send_size;
+            if ((size_t)send_size != iov->iov_len)
+                break;
+        }
+    } else {
+        struct msghdr msg = {.msg_iov = (struct iovec *)iov, .msg_iovlen = iov_len};
+        while ((send_size = sendmsg(conn->fd, &msg, flags | MSG_NOSIGNAL | MSG_DONTWAIT)) < 0 &&
+               errno == EINTR)
+            ;
+        if (send_size > 0)
+            total_size = send_size;
+    }
+
+    if (send_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        return -1;
+    if (total_size > 0) {
+        add_metrics_counter(METRICS_BYTES_SENT, total_size);
+        conn->last_active = _connection_now();
+    }
+    return total_size;
+}
+
+int _send_connection_buffer(connection *conn, conn_output *output, const int flags) {
+    while (output->len > 0) {
+        ssize_t send_size =
+            send_tls(conn->fd, output->data, output->len, flags | MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (send_size < 0 && errno == EINTR)
+            continue;
+        if (send_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 2;
+        if (send_size <= 0)
+            return 0;
+
+        output->data += send_size;
+        output->len -= send_size;
+        add_metrics_counter(METRICS_BYTES_SENT, send_size);
+        conn->last_active = _connection_now();
+    }
+
+    return 1;
+}
+
+int _send_connection_file(connection *conn, const int file_fd, off_t *offset, size_t *len) {
+    while (*len > 0) {
+        ssize_t send_size = sendfile(conn->fd, file_fd, offset, *len);
+        if (send_size < 0 && errno == EINTR)
+            continue;
+        if (send_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 2;
+
+        // A file that got shorter can't complete the response.
+        if (send_size <= 0) {
+            if (send_size == 0)
+                errno = EIO;
+            return 0;
+        }
+
+        *len -= send_size;
+        add_metrics_counter(METRICS_BYTES_SENT, send_size);
+        conn->last_active = _connection_now();
+    }
+
+    return 1;
+}
+
+int _read_connection_file(connection *conn, conn_output *output) {
+    size_t chunk_size = output->len < CONN_OUTPUT_CHUNK_SIZE ? output->len : CONN_OUTPUT_CHUNK_SIZE;
+    conn_output *chunk = _create_connection_output(chunk_size);
+    if (chunk == NULL)
+        return 0;
+
+    size_t read_len = 0;
+    while (read_len < chunk_size) {
+        ssize_t read_size =
+            pread(output->file_fd, chunk->buf + read_len, chunk_size - read_len, output->offset);
+        if (read_size < 0 && errno == EINTR)
+            continue;
+        if (read_size <= 0) {
+            slab_free(chunk);
+            return 0;
+        }
+        read_len += read_size;
+        output->offset += read_size;
+    }
+    output->len -= chunk_size;
+
+    // The last chunk takes the place of the range, so it isn't sent as if more followed.
+    chunk->next = output->len > 0 ? output : output->next;
+    conn->output = chunk;
+    if (output->len == 0) {
+        if (conn->output_tail == output)
+            conn->output_tail = chunk;
+        _free_connection_output(output);
+    }
+    return 1;
+}
+
+conn_output *_create_connection_output(const size_t buf_size) {
+    conn_output *output = slab_alloc(sizeof(conn_output) + buf_size);
+    if (output == NULL)
+        return NULL;
+
+    output->next = NULL;
+    output->file_fd = -1;
+    output->offset = 0;
+    output->is_read = false;
+    output->data = output->buf;
+    output->len = buf_size;
+    output->release = NULL;
+    output->release_arg = NULL;
+    return output;
+}
+
+void _queue_connection_output(connection *conn, conn_output *output) {
+    if (conn->output_tail != NULL)
+        conn->output_tail->next = output;
+    else
+        conn->output = output;
+    conn->output_tail = output;
+}
+
+void _free_connection_output(conn_output *output) {
+    if (output->release != NULL)
+        output->release(output->release_arg);
+    if (output->file_fd >= 0)
+        close(output->file_fd);
+    slab_free(output);
+}
@@ -0,0 +1,204 @@
+/**
+ * @file slib/encoding.c
+ * @brief Functions for negotiating and applying content codings.
+ *
+ * Implements functions defined in `include/encoding.h`. Used by the server to serve precompressed
+ * siblings of files and by the file cache to keep a gzip compressed copy of compressible files.
+ *
+ * Files are only compressed when they are cached, so every file is compressed once and
+ * compression never runs on the request path of a cache hit. Other codings (Brotli, Zstandard) are
+ * only served from precompressed siblings.
+ *
+ * @see enum content_encoding
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "encoding.h"
+
+/**
+ * @private
+ * @brief Codings in the order they are preferred by `select_content_encoding()`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const content_encoding _content_encodings[] = {CONTENT_ENCODING_BR, CONTENT_ENCODING_ZSTD,
+                                               CONTENT_ENCODING_GZIP};
+
+unsigned int parse_accept_encoding(const char *accept_encoding) {
+    unsigned int accepted = 0, rejected = 0;
+    bool accept_any = false;
+    if (accept_encoding == NULL)
+        return 0;
+
+    const char *coding = accept_encoding;
+    while (*coding != '\0') {
+        while (*coding == ' ' || *coding == '\t' || *coding == ',')
+            coding++;
+        if (*coding == '\0')
+            break;
+
+        size_t coding_len = strcspn(coding, " \t;,");
+        const char *coding_end = coding + strcspn(coding, ",");
+
+        // A q value of 0 (e.g. "gzip;q=0" or "gzip; q=0.000") rejects the coding.
+        bool is_rejected = false;
+        const char *q = strstr(coding, "q=");
+        if (q != NULL && q < coding_end)
+            is_rejected = strtod(q + 2, NULL) <= 0;
+
+        unsigned int encoding = CONTENT_ENCODING_IDENTITY;
+        if (coding_len == 1 && coding[0] == '*')
+            accept_any = !is_rejected;
+        else if ((coding_len == 4 && strncasecmp(coding, "gzip", 4) == 0) ||
+                 (coding_len == 6 && strncasecmp(coding, "x-gzip", 6) == 0))
+            encoding = CONTENT_ENCODING_GZIP;
+        else if (coding_len == 2 && strncasecmp(coding, "br", 2) == 0)
+            encoding = CONTENT_ENCODING_BR;
+        else if (coding_len == 4 && strncasecmp(coding, "zstd", 4) == 0)
+            encoding = CONTENT_ENCODING_ZSTD;
+
+        if (is_rejected)
+            rejected |= encoding;
+        else
+            accepted |= encoding;
+
+        coding = coding_end;
+    }
+
+    if (accept_any)
+        accepted |= CONTENT_ENCODING_GZIP | CONTENT_ENCODING_BR | CONTENT_ENCODING_ZSTD;
+    return accepted & ~rejected;
+}
+
+content_encoding select_content_encoding(const unsigned int accepted,
+                                         const unsigned int available) {
+    for (size_t enc_no = 0; enc_no < sizeof(_content_encodings) / sizeof(_content_encodings[0]);
+         enc_no++)
+        if (accepted & available & _content_encodings[enc_no])
+            return _content_encodings[enc_no];
+
+    return CONTENT_ENCODING_IDENTITY;
+}
+
+const char *get_content_encoding_name(const content_encoding encoding) {
+    switch (encoding) {
+    case CONTENT_ENCODING_GZIP:
+        return "gzip";
+    case CONTENT_ENCODING_BR:
+        return "br";
+    case CONTENT_ENCODING_ZSTD:
+        return "zstd";
+    default:
+        return NULL;
+    }
+}
+
+const char *get_content_encoding_suffix(const content_encoding encoding) {
+    switch (encoding) {
+    case CONTENT_ENCODING_GZIP:
+        return ".gz";
+    case CONTENT_ENCODING_BR:
+        return ".br";
+    case CONTENT_ENCODING_ZSTD:
+        return ".zst";
+    default:
+        return NULL;
+    }
+}
+
+content_encoding get_precompressed_file_encoding(const char *path) {
+    size_t path_len = path != NULL ? strlen(path) : 0;
+
+    for (size_t enc_no = 0; enc_no < sizeof(_content_encodings) / sizeof(_content_encodings[0]);
+         enc_no++) {
+        const char *suffix = get_content_encoding_suffix(_content_encodings[enc_no]);
+        size_t suffix_len = strlen(suffix);
+        if (path_len > suffix_len && strcmp(path + path_len - suffix_len, suffix) == 0)
+            return _content_encodings[enc_no];
+    }
+
+    return CONTENT_ENCODING_IDENTITY;
+}
+
+unsigned int find_precompressed_files(const char *path) {
+    char sibling_path[4096];
+    struct stat file_stat;
+    unsigned int available = 0;
+
+    for (size_t enc_no = 0; enc_no < sizeof(_content_encodings) / sizeof(_content_encodings[0]);
+         enc_no++) {
+        const char *suffix = get_content_encoding_suffix(_content_encodings[enc_no]);
+        if (snprintf(sibling_path, sizeof(sibling_path), "%s%s", path, suffix) >=
+            (int)sizeof(sibling_path))
+            continue;
+        if (stat(sibling_path, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+            available |= _content_encodings[enc_no];
+    }
+
+    return available;
+}
+
+bool is_mimetype_compressible(const char *mimetype) {
+    if (mimetype == NULL)
+        return false;
+
+    if (strncasecmp(mimetype, "text/", 5) == 0)
+        return true;
+
+    const char *subtype = strchr(mimetype, '/');
+    if (subtype == NULL)
+        return false;
+    size_t subtype_len = strlen(subtype);
+    if ((subtype_len > 5 && strcasecmp(subtype + subtype_len - 5, "+json") == 0) ||
+        (subtype_len > 4 && strcasecmp(subtype + subtype_len - 4, "+xml") == 0))
+        return true;
+
+    return strcasecmp(mimetype, "application/javascript") == 0 ||
+           strcasecmp(mimetype, "application/json") == 0 ||
+           strcasecmp(mimetype, "application/xml") == 0 ||
+           strcasecmp(mimetype, "application/wasm") == 0 ||
+           strcasecmp(mimetype, "image/x-icon") == 0 ||
+           strcasecmp(mimetype, "image/vnd.microsoft.icon") == 0;
+}
+
+char *compress_gzip(const char *buf, const size_t buf_size, int level, size_t *compressed_size) {
+    if (level < 1 || level > 9)
+        level = DEFAULT_GZIP_LEVEL;
+
+    z_stream stream = {0};
+    // 16 + MAX_WBITS writes a gzip header and trailer instead of a zlib one.
+    if (deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+
+    size_t bound = deflateBound(&stream, buf_size);
+    char *compressed = malloc(bound);
+    if (compressed == NULL) {
+        deflateEnd(&stream);
+        return NULL;
+    }
+
+    stream.next_in = (Bytef *)buf;
+    stream.avail_in = buf_size;
+    stream.next_out = (Bytef *)compressed;
+    stream.avail_out = bound;
+
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        deflateEnd(&stream);
+        free(compressed);
+        return NULL;
+    }
+
+    *compressed_size = stream.total_out;
+    deflateEnd(&stream);
+    return compressed;
+}
@@ -0,0 +1,380 @@
+/**
+ * @file slib/fdcache.c
+ * @brief Functions for the open file descriptor cache of the website root directory.
+ *
+ * Implements functions defined in `include/fdcache.h`. Used to resolve request URLs to files under
+ * the website root directory and to keep the opened files open for the next requests.
+ *
+ * Cache entries are stored in a hash table keyed by the resolved path, protected by a read-write
+ * lock. Lookups only take the read lock, expired entries are removed with the write lock when they
+ * are looked up, or when a new entry doesn't fit in the cache.
+ *
+ * @see typedef struct fd_cache_entry
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/openat2.h>
+
+#include "fdcache.h"
+#include "metrics.h"
+
+/**
+ * @private
+ * @brief Hash table of cache entries, keyed by `fd_cache_entry::path`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+GHashTable *_fd_cache_htab = NULL;
+
+/**
+ * @private
+ * @brief Read-write lock protecting `_fd_cache_htab` and `_fd_cache_swept_at`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+pthread_rwlock_t _fd_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @private
+ * @brief Website root directory the cache was created for, `NULL` if the cache is not created.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+char *_fd_cache_root = NULL;
+
+/**
+ * @private
+ * @brief File descriptor of `_fd_cache_root`, opened with `O_PATH`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int _fd_cache_root_fd = -1;
+
+/**
+ * @private
+ * @brief Limits of the cache, set by `create_fd_cache()`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+unsigned int _fd_cache_max_entries = 0;
+int _fd_cache_ttl = 0;
+
+/**
+ * @private
+ * @brief Monotonic time (in seconds) the expired entries were last removed, so a full cache is
+ * swept at most once a second.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+long _fd_cache_swept_at = 0;
+
+/**
+ * @private
+ * @brief Set once `openat2()` failed with `ENOSYS`, so it isn't tried for every file.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_bool _fd_cache_no_openat2 = false;
+
+int create_fd_cache(const char *root_dir, const unsigned int max_entries, const int ttl) {
+    if (_fd_cache_root != NULL)
+        return 2;
+
+    if (root_dir == NULL || ttl < 1)
+        return 0;
+
+    if ((_fd_cache_root_fd = open(root_dir, O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return 0;
+
+    if ((_fd_cache_htab = g_hash_table_new(g_str_hash, g_str_equal)) == NULL ||
+        (_fd_cache_root = strdup(root_dir)) == NULL) {
+        if (_fd_cache_htab != NULL)
+            g_hash_table_destroy(_fd_cache_htab);
+        _fd_cache_htab = NULL;
+        close(_fd_cache_root_fd);
+        _fd_cache_root_fd = -1;
+        return 0;
+    }
+
+    _fd_cache_max_entries = max_entries;
+    _fd_cache_ttl = ttl;
+    _fd_cache_swept_at = 0;
+    return 1;
+}
+
+void destroy_fd_cache() {
+    if (_fd_cache_root == NULL)
+        return;
+
+    clear_fd_cache();
+
+    pthread_rwlock_wrlock(&_fd_cache_lock);
+    g_hash_table_destroy(_fd_cache_htab);
+    _fd_cache_htab = NULL;
+    pthread_rwlock_unlock(&_fd_cache_lock);
+
+    close(_fd_cache_root_fd);
+    _fd_cache_root_fd = -1;
+    free(_fd_cache_root);
+    _fd_cache_root = NULL;
+}
+
+void clear_fd_cache() {
+    if (_fd_cache_htab == NULL)
+        return;
+
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    pthread_rwlock_wrlock(&_fd_cache_lock);
+    g_hash_table_iter_init(&iter, _fd_cache_htab);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_hash_table_iter_remove(&iter);
+        release_fd_cache_entry(value);
+    }
+    pthread_rwlock_unlock(&_fd_cache_lock);
+}
+
+int resolve_site_path(const char *url, char *rel_path, const size_t size) {
+    if (url == NULL || rel_path == NULL || size == 0)
+        return 0;
+
+    size_t len = 0;
+    const char *seg = url;
+    while (*seg != '\0') {
+        while (*seg == '/')
+            seg++;
+        const char *end = strchrnul(seg, '/');
+        size_t seg_len = end - seg;
+
+        if (seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+            if (len == 0)
+                return 0;
+            char *slash = memrchr(rel_path, '/', len);
+            len = slash != NULL ? (size_t)(slash - rel_path) : 0;
+        } else if (seg_len > 0 && !(seg_len == 1 && seg[0] == '.')) {
+            if (len + (len > 0) + seg_len >= size)
+                return 0;
+            if (len > 0)
+                rel_path[len++] = '/';
+            memcpy(rel_path + len, seg, seg_len);
+            len += seg_len;
+        }
+
+        seg = end;
+    }
+
+    rel_path[len] = '\0';
+    return 1;
+}
+
+fd_cache_entry *open_fd_cache_entry(const char *root_dir, const char *rel_path) {
+    if (root_dir == NULL || rel_path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    bool is_root = _fd_cache_root != NULL && strcmp(root_dir, _fd_cache_root) == 0;
+    fd_cache_entry *entry = NULL;
+    if (is_root && (entry = _get_fd_cache_entry(rel_path)) != NULL)
+        return entry;
+
+    long long open_start = is_metrics_enabled() ? get_metrics_time() : 0;
+    int dir_fd = is_root ? _fd_cache_root_fd : open(root_dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+        entry = _create_fd_cache_entry(dir_fd, rel_path);
+    int saved_errno = errno;
+    if (!is_root && dir_fd >= 0)
+        close(dir_fd);
+    if (open_start != 0)
+        observe_metrics_stage(METRICS_FILE_OPEN, get_metrics_time() - open_start);
+
+    if (entry != NULL && is_root && _fd_cache_max_entries > 0)
+        _add_fd_cache_entry(entry);
+
+    errno = saved_errno;
+    return entry;
+}
+
+int open_site_directory(const char *root_dir, const char *rel_path, struct stat *dir_stat) {
+    if (root_dir == NULL || rel_path == NULL || dir_stat == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool is_root = _fd_cache_root != NULL && strcmp(root_dir, _fd_cache_root) == 0;
+    int root_fd = is_root ? _fd_cache_root_fd : open(root_dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+        return -1;
+
+    // The root directory itself resolves to an empty path, which can't be opened.
+    int dir_fd = _open_beneath(root_fd, rel_path[0] != '\0' ? rel_path : ".");
+    int saved_errno = errno;
+    if (!is_root)
+        close(root_fd);
+    if (dir_fd < 0) {
+        errno = saved_errno;
+        return -1;
+    }
+
+    saved_errno = 0;
+    if (fstat(dir_fd, dir_stat) < 0)
+        saved_errno = errno;
+    else if (!S_ISDIR(dir_stat->st_mode))
+        saved_errno = ENOTDIR;
+
+    if (saved_errno != 0) {
+        close(dir_fd);
+        errno = saved_errno;
+        return -1;
+    }
+    return dir_fd;
+}
+
+void release_fd_cache_entry(fd_cache_entry *entry) {
+    if (entry == NULL || atomic_fetch_sub(&entry->refs, 1) != 1)
+        return;
+
+    close(entry->fd);
+    free(entry->path);
+    free(entry);
+}
+
+fd_cache_entry *_get_fd_cache_entry(const char *rel_path) {
+    if (_fd_cache_htab == NULL)
+        return NULL;
+
+    long now = _fd_cache_now();
+    pthread_rwlock_rdlock(&_fd_cache_lock);
+    fd_cache_entry *entry = g_hash_table_lookup(_fd_cache_htab, rel_path);
+    bool is_expired = entry != NULL && now >= entry->expires_at;
+    if (entry != NULL && !is_expired)
+        atomic_fetch_add(&entry->refs, 1);
+    pthread_rwlock_unlock(&_fd_cache_lock);
+
+    if (!is_expired)
+        return entry;
+
+    // Another thread may have replaced the entry since the read lock was released.
+    pthread_rwlock_wrlock(&_fd_cache_lock);
+    if ((entry = g_hash_table_lookup(_fd_cache_htab, rel_path)) != NULL &&
+        now >= entry->expires_at) {
+        g_hash_table_remove(_fd_cache_htab, rel_path);
+        release_fd_cache_entry(entry);
+    }
+    pthread_rwlock_unlock(&_fd_cache_lock);
+    return NULL;
+}
+
+void _add_fd_cache_entry(fd_cache_entry *entry) {
+    long now = _fd_cache_now();
+
+    pthread_rwlock_wrlock(&_fd_cache_lock);
+    fd_cache_entry *old_entry = g_hash_table_lookup(_fd_cache_htab, entry->path);
+    if (old_entry != NULL) {
+        g_hash_table_remove(_fd_cache_htab, old_entry->path);
+        release_fd_cache_entry(old_entry);
+    } else if (g_hash_table_size(_fd_cache_htab) >= _fd_cache_max_entries &&
+               _fd_cache_swept_at != now) {
+        _remove_expired_fd_cache_entries(now);
+        _fd_cache_swept_at = now;
+    }
+
+    if (g_hash_table_size(_fd_cache_htab) < _fd_cache_max_entries) {
+        atomic_fetch_add(&entry->refs, 1);
+        g_hash_table_insert(_fd_cache_htab, entry->path, entry);
+    }
+    pthread_rwlock_unlock(&_fd_cache_lock);
+}
+
+void _remove_expired_fd_cache_entries(const long now) {
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, _fd_cache_htab);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (now < ((fd_cache_entry *)value)->expires_at)
+            continue;
+
+        g_hash_table_iter_remove(&iter);
+        release_fd_cache_entry(value);
+    }
+}
+
+int _open_beneath(const int dir_fd, const char *rel_path) {
+    // Opening a FIFO would wait for a writer, the callers check the type of what was opened.
+#ifdef SYS_openat2
+    if (!atomic_load_explicit(&_fd_cache_no_openat2, memory_order_relaxed)) {
+        struct open_how how = {.flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC,
+                               .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS};
+        int file_fd = syscall(SYS_openat2, dir_fd, rel_path, &how, sizeof(how));
+        if (file_fd >= 0 || errno != ENOSYS)
+            return file_fd;
+        atomic_store_explicit(&_fd_cache_no_openat2, true, memory_order_relaxed);
+    }
+#endif
+
+    // Resolved paths have no `..` segments, only symbolic links can lead out of the directory.
+    if (rel_path[0] == '/') {
+        errno = EXDEV;
+        return -1;
+    }
+    return openat(dir_fd, rel_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+fd_cache_entry *_create_fd_cache_entry(const int dir_fd, const char *rel_path) {
+    struct stat file_stat;
+    int file_fd = -1;
+
+    if ((file_fd = _open_beneath(dir_fd, rel_path)) < 0)
+        return NULL;
+
+    int saved_errno = 0;
+    if (fstat(file_fd, &file_stat) < 0)
+        saved_errno = errno;
+    else if (S_ISDIR(file_stat.st_mode))
+        saved_errno = EISDIR;
+    else if (!S_ISREG(file_stat.st_mode))
+        saved_errno = ENOENT;
+    else if (fcntl(file_fd, F_SETFL, fcntl(file_fd, F_GETFL) & ~O_NONBLOCK) < 0)
+        saved_errno = errno;
+
+    if (saved_errno != 0) {
+        close(file_fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    fd_cache_entry *entry = calloc(1, sizeof(fd_cache_entry));
+    if (entry == NULL || (entry->path = strdup(rel_path)) == NULL) {
+        free(entry);
+        close(file_fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    entry->fd = file_fd;
+    entry->file_stat = file_stat;
+    entry->expires_at = _fd_cache_now() + _fd_cache_ttl;
+    atomic_init(&entry->refs, 1);
+    return entry;
+}
+
+long _fd_cache_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
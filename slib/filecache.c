@@ -0,0 +1,611 @@
+/**
+ * @file slib/filecache.c
+ * @brief Functions for the in-memory static file cache.
+ *
+ * Implements functions defined in `include/filecache.h`. Used to cache whole files along with
+ * their pre-serialized response headers.
+ *
+ * Cache entries are stored in a hash table keyed by file path, protected by a read-write lock.
+ * Lookups only take the read lock, so workers serving hits never wait for each other. Hits are
+ * recorded by setting `file_cache_entry::referenced`, which the CLOCK eviction hand clears on its
+ * way around the ring of entries; an entry whose bit is already clear when the hand reaches it is
+ * evicted.
+ *
+ * Entries are invalidated by an `inotify` thread watching the cached directory tree, so a hit never
+ * needs to `stat()` the file. If `inotify` can't be initialized, entries are validated with
+ * `stat()` once every `FILE_CACHE_CHECK_INTERVAL` seconds instead.
+ *
+ * @see typedef struct file_cache_entry
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "filecache.h"
+
+/**
+ * @private
+ * @brief Hash table of cache entries, keyed by `file_cache_entry::path`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+GHashTable *_file_cache_htab = NULL;
+
+/**
+ * @private
+ * @brief Read-write lock protecting `_file_cache_htab`, the CLOCK ring and `_file_cache_size`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+pthread_rwlock_t _file_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @private
+ * @brief Current position of the CLOCK eviction hand, `NULL` if the cache is empty.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+file_cache_entry *_file_cache_hand = NULL;
+
+/**
+ * @private
+ * @brief Total size (in bytes) of the cached file bodies.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+size_t _file_cache_size = 0;
+
+/**
+ * @private
+ * @brief Limits of the cache, set by `create_file_cache()`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+size_t _file_cache_max_size = 0, _file_cache_max_file_size = 0;
+unsigned int _file_cache_max_entries = 0;
+
+/**
+ * @private
+ * @brief Set of `file_cache_map_flag` flags of the cache, set by `create_file_cache()`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+unsigned int _file_cache_map_flags = 0;
+
+/**
+ * @private
+ * @brief `inotify` instance watching the cached directory tree, `-1` if `inotify` is not used.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int _file_cache_inotify_fd = -1;
+
+/**
+ * @private
+ * @brief `eventfd` used to stop the `inotify` thread.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int _file_cache_wake_fd = -1;
+
+/**
+ * @private
+ * @brief Thread ID of the `inotify` thread.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+pthread_t _file_cache_watch_tid;
+
+/**
+ * @private
+ * @brief Hash table mapping `inotify` watch descriptors to directory paths. Only used by the
+ * `inotify` thread once it is started.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+GHashTable *_file_cache_watch_htab = NULL;
+
+int create_file_cache(const char *root_dir, const size_t max_size, const size_t max_file_size,
+                      const unsigned int max_entries, const unsigned int map_flags) {
+    if (_file_cache_htab != NULL)
+        return 2;
+
+    if (root_dir == NULL || max_size == 0 || max_entries == 0)
+        return 0;
+
+    if ((_file_cache_htab = g_hash_table_new(g_str_hash, g_str_equal)) == NULL)
+        return 0;
+
+    _file_cache_size = 0;
+    _file_cache_max_size = max_size;
+    _file_cache_max_file_size = max_file_size;
+    _file_cache_max_entries = max_entries;
+    _file_cache_map_flags = map_flags;
+
+    if ((_file_cache_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        perror("Unable to initialize inotify, falling back to stat() validation");
+        return 1;
+    }
+
+    _file_cache_watch_htab = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+    _add_file_cache_watch(root_dir);
+
+    if ((_file_cache_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+        pthread_create(&_file_cache_watch_tid, NULL, _file_cache_watch_loop, NULL) != 0) {
+        perror("Unable to start inotify thread, falling back to stat() validation");
+        if (_file_cache_wake_fd != -1)
+            close(_file_cache_wake_fd);
+        _file_cache_wake_fd = -1;
+        close(_file_cache_inotify_fd);
+        _file_cache_inotify_fd = -1;
+        g_hash_table_destroy(_file_cache_watch_htab);
+        _file_cache_watch_htab = NULL;
+    }
+
+    return 1;
+}
+
+void destroy_file_cache() {
+    if (_file_cache_htab == NULL)
+        return;
+
+    if (_file_cache_inotify_fd != -1) {
+        uint64_t one = 1;
+        write(_file_cache_wake_fd, &one, sizeof(one));
+        pthread_join(_file_cache_watch_tid, NULL);
+
+        close(_file_cache_wake_fd);
+        close(_file_cache_inotify_fd);
+        _file_cache_wake_fd = -1;
+        _file_cache_inotify_fd = -1;
+        g_hash_table_destroy(_file_cache_watch_htab);
+        _file_cache_watch_htab = NULL;
+    }
+
+    clear_file_cache();
+
+    pthread_rwlock_wrlock(&_file_cache_lock);
+    g_hash_table_destroy(_file_cache_htab);
+    _file_cache_htab = NULL;
+    pthread_rwlock_unlock(&_file_cache_lock);
+}
+
+void clear_file_cache() {
+    if (_file_cache_htab == NULL)
+        return;
+
+    pthread_rwlock_wrlock(&_file_cache_lock);
+    while (_file_cache_hand != NULL)
+        _remove_file_cache_entry(_file_cache_hand);
+    pthread_rwlock_unlock(&_file_cache_lock);
+}
+
+int is_file_cacheable(const off_t size) {
+    return _file_cache_htab != NULL && (size_t)size <= _file_cache_max_file_size &&
+           (size_t)size <= _file_cache_max_size;
+}
+
+file_cache_entry *get_file_cache_entry(const char *path) {
+    if (_file_cache_htab == NULL || path == NULL)
+        return NULL;
+
+    pthread_rwlock_rdlock(&_file_cache_lock);
+    file_cache_entry *entry = g_hash_table_lookup(_file_cache_htab, path);
+    if (entry != NULL) {
+        atomic_fetch_add(&entry->refs, 1);
+        atomic_store(&entry->referenced, true);
+    }
+    pthread_rwlock_unlock(&_file_cache_lock);
+
+    if (entry != NULL && _file_cache_inotify_fd == -1 && !_validate_file_cache_entry(entry)) {
+        invalidate_file_cache_entry(path);
+        release_file_cache_entry(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+file_cache_entry *add_file_cache_entry(const char *path, const int file_fd,
+                                       const struct stat *file_stat, const response *res,
+                                       const unsigned int encodings, const int gzip_level) {
+    if (path == NULL || file_stat == NULL || res == NULL || !is_file_cacheable(file_stat->st_size))
+        return NULL;
+
+    file_cache_entry *entry = calloc(1, sizeof(file_cache_entry));
+    if (entry == NULL)
+        return NULL;
+
+    entry->body_len = file_stat->st_size;
+    if (!_map_file_cache_entry(entry, file_fd)) {
+        if ((entry->body = malloc(entry->body_len + 1)) == NULL) {
+            free(entry);
+            return NULL;
+        }
+
+        size_t read_len = 0;
+        ssize_t read_size = 0;
+        while (read_len < entry->body_len) {
+            if ((read_size = pread(file_fd, entry->body + read_len, entry->body_len - read_len,
+                                   read_len)) <= 0) {
+                free(entry->body);
+                free(entry);
+                return NULL;
+            }
+            read_len += read_size;
+        }
+    }
+
+    entry->path = strdup(path);
+    entry->file_stat = *file_stat;
+    entry->encodings = encodings;
+    format_etag(file_stat, entry->etag);
+    format_http_date(file_stat->st_mtime, entry->last_modified);
+
+    return _insert_file_cache_entry(entry, res, gzip_level);
+}
+
+file_cache_entry *add_file_cache_buffer(const char *path, const char *body, const size_t body_len,
+                                        const struct stat *file_stat, const response *res,
+                                        const int gzip_level) {
+    if (path == NULL || body == NULL || file_stat == NULL || res == NULL ||
+        !is_file_cacheable(body_len))
+        return NULL;
+
+    file_cache_entry *entry = calloc(1, sizeof(file_cache_entry));
+    if (entry == NULL || (entry->body = malloc(body_len + 1)) == NULL) {
+        free(entry);
+        return NULL;
+    }
+    memcpy(entry->body, body, body_len);
+    entry->body_len = body_len;
+
+    // The buffer isn't a file, so its entity tag is derived from its contents (FNV-1a).
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < body_len; i++)
+        hash = (hash ^ (unsigned char)body[i]) * 0x100000001b3ULL;
+
+    entry->path = strdup(path);
+    entry->file_stat = *file_stat;
+    snprintf(entry->etag, sizeof(entry->etag), "\"%zx-%llx\"", body_len, hash);
+    format_http_date(file_stat->st_mtime, entry->last_modified);
+
+    return _insert_file_cache_entry(entry, res, gzip_level);
+}
+
+unsigned int get_file_cache_entry_encodings(const file_cache_entry *entry) {
+    return entry->encodings | (entry->gzip != NULL ? CONTENT_ENCODING_GZIP : 0);
+}
+
+file_cache_entry *get_file_cache_entry_variant(file_cache_entry *entry,
+                                               const content_encoding encoding) {
+    if (encoding == CONTENT_ENCODING_IDENTITY ||
+        (encoding == CONTENT_ENCODING_GZIP && entry->gzip != NULL)) {
+        file_cache_entry *variant = encoding == CONTENT_ENCODING_IDENTITY ? entry : entry->gzip;
+        atomic_fetch_add(&variant->refs, 1);
+        return variant;
+    }
+
+    char variant_path[PATH_MAX];
+    const char *suffix = get_content_encoding_suffix(encoding);
+    if (suffix == NULL || snprintf(variant_path, sizeof(variant_path), "%s%s", entry->path,
+                                   suffix) >= (int)sizeof(variant_path))
+        return NULL;
+
+    return get_file_cache_entry(variant_path);
+}
+
+void release_file_cache_entry(file_cache_entry *entry) {
+    if (entry == NULL)
+        return;
+
+    if (atomic_fetch_sub(&entry->refs, 1) != 1)
+        return;
+
+    release_file_cache_entry(entry->gzip);
+    free(entry->path);
+    g_free(entry->headers);
+    if (entry->is_mapped)
+        munmap(entry->body, entry->body_len);
+    else
+        free(entry->body);
+    free(entry);
+}
+
+void invalidate_file_cache_entry(const char *path) {
+    if (_file_cache_htab == NULL || path == NULL)
+        return;
+
+    pthread_rwlock_wrlock(&_file_cache_lock);
+    file_cache_entry *entry = g_hash_table_lookup(_file_cache_htab, path);
+    if (entry != NULL)
+        _remove_file_cache_entry(entry);
+    pthread_rwlock_unlock(&_file_cache_lock);
+}
+
+ssize_t send_file_cache_entry(const int conn_fd, const file_cache_entry *entry,
+                              const char *status_line, const char *headers,
+                              const bool with_body) {
+    struct iovec iov[4] = {{.iov_base = (void *)status_line, .iov_len = strlen(status_line)},
+                           {.iov_base = entry->headers, .iov_len = entry->headers_len},
+                           {.iov_base = (void *)headers, .iov_len = strlen(headers)},
+                           {.iov_base = entry->body, .iov_len = entry->body_len}};
+    ssize_t head_size = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+    int iov_len = with_body && entry->body_len > 0 ? 4 : 3;
+
+    // The body the socket doesn't take is queued without a copy, the entry is kept until it's sent.
+    long long send_start = start_metrics_send();
+    connection *conn = get_active_connection(conn_fd);
+    ssize_t total_buf_size = 0;
+    if (conn != NULL && iov_len == 4) {
+        file_cache_entry *held = (file_cache_entry *)entry;
+        atomic_fetch_add(&held->refs, 1);
+        total_buf_size =
+            write_connection_held(conn, iov, iov_len, 0, _release_file_cache_body, held);
+    } else {
+        total_buf_size = _send_iov(conn_fd, iov, iov_len, 0);
+    }
+    end_metrics_send(send_start);
+    return total_buf_size < head_size ? -1 : total_buf_size - head_size;
+}
+
+void _release_file_cache_body(void *entry) { release_file_cache_entry(entry); }
+
+void _remove_file_cache_entry(file_cache_entry *entry) {
+    g_hash_table_remove(_file_cache_htab, entry->path);
+
+    if (entry->next == entry) {
+        _file_cache_hand = NULL;
+    } else {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        if (_file_cache_hand == entry)
+            _file_cache_hand = entry->next;
+    }
+    entry->prev = entry->next = NULL;
+    _file_cache_size -= _get_file_cache_entry_size(entry);
+
+    release_file_cache_entry(entry);
+}
+
+int _map_file_cache_entry(file_cache_entry *entry, const int file_fd) {
+    // Empty files can't be mapped, they are read into an empty buffer instead.
+    if (!(_file_cache_map_flags & FILE_CACHE_MAP_FILES) || entry->body_len == 0)
+        return 0;
+
+    // Huge pages have to be advised before the mapping is populated.
+    bool huge_pages = _file_cache_map_flags & FILE_CACHE_MAP_HUGE_PAGES;
+    int flags = MAP_SHARED | (huge_pages ? 0 : MAP_POPULATE);
+    void *body = mmap(NULL, entry->body_len, PROT_READ, flags, file_fd, 0);
+    if (body == MAP_FAILED)
+        return 0;
+
+    if (huge_pages) {
+        madvise(body, entry->body_len, MADV_HUGEPAGE);
+#ifdef MADV_POPULATE_READ
+        madvise(body, entry->body_len, MADV_POPULATE_READ);
+#endif
+    }
+    madvise(body, entry->body_len, MADV_WILLNEED);
+
+    entry->body = body;
+    entry->is_mapped = true;
+    return 1;
+}
+
+file_cache_entry *_insert_file_cache_entry(file_cache_entry *entry, const response *res,
+                                           const int gzip_level) {
+    GString *headers = g_string_sized_new(RES_HEADER_BUF_SIZE);
+    size_t res_headers_len = serialize_response_headers(res, headers);
+
+    // Files with a gzip sibling are served from the sibling instead.
+    if (gzip_level > 0 && !(entry->encodings & CONTENT_ENCODING_GZIP))
+        entry->gzip = _compress_file_cache_entry(entry, headers->str, res_headers_len, gzip_level);
+
+    g_string_append_printf(headers, "content-length: %zu\r\netag: %s\r\nlast-modified: %s\r\n",
+                           entry->body_len, entry->etag, entry->last_modified);
+    entry->headers_len = headers->len;
+    entry->headers = g_string_free(headers, FALSE);
+
+    // One reference is held by the cache and the other is returned to the caller.
+    atomic_init(&entry->refs, 2);
+    atomic_init(&entry->referenced, false);
+    atomic_init(&entry->checked_at, _file_cache_now());
+
+    pthread_rwlock_wrlock(&_file_cache_lock);
+    file_cache_entry *old_entry = g_hash_table_lookup(_file_cache_htab, entry->path);
+    if (old_entry != NULL)
+        _remove_file_cache_entry(old_entry);
+    _evict_file_cache_entries(_get_file_cache_entry_size(entry));
+
+    g_hash_table_insert(_file_cache_htab, entry->path, entry);
+    if (_file_cache_hand == NULL) {
+        entry->prev = entry->next = entry;
+        _file_cache_hand = entry;
+    } else {
+        // New entries are added right behind the hand, so they get a full turn before eviction.
+        entry->next = _file_cache_hand;
+        entry->prev = _file_cache_hand->prev;
+        _file_cache_hand->prev->next = entry;
+        _file_cache_hand->prev = entry;
+    }
+    _file_cache_size += _get_file_cache_entry_size(entry);
+    pthread_rwlock_unlock(&_file_cache_lock);
+
+    return entry;
+}
+
+file_cache_entry *_compress_file_cache_entry(const file_cache_entry *entry, const char *headers,
+                                             const size_t headers_len, const int level) {
+    file_cache_entry *gzip = calloc(1, sizeof(file_cache_entry));
+    if (gzip == NULL)
+        return NULL;
+
+    gzip->body = compress_gzip(entry->body, entry->body_len, level, &gzip->body_len);
+    if (gzip->body == NULL || gzip->body_len >= entry->body_len) {
+        free(gzip->body);
+        free(gzip);
+        return NULL;
+    }
+
+    // The compressed copy is a different representation, so it needs its own entity tag.
+    gzip->file_stat = entry->file_stat;
+    snprintf(gzip->etag, sizeof(gzip->etag), "%.*s-gz\"", (int)strlen(entry->etag) - 1,
+             entry->etag);
+    strcpy(gzip->last_modified, entry->last_modified);
+
+    GString *gzip_headers = g_string_sized_new(headers_len + RES_HEADER_BUF_SIZE);
+    g_string_append_len(gzip_headers, headers, headers_len);
+    g_string_append_printf(gzip_headers,
+                           "content-encoding: gzip\r\ncontent-length: %zu\r\netag: %s\r\n"
+                           "last-modified: %s\r\n",
+                           gzip->body_len, gzip->etag, gzip->last_modified);
+    gzip->headers_len = gzip_headers->len;
+    gzip->headers = g_string_free(gzip_headers, FALSE);
+
+    // The only reference is held by the uncompressed entry.
+    atomic_init(&gzip->refs, 1);
+    return gzip;
+}
+
+size_t _get_file_cache_entry_size(const file_cache_entry *entry) {
+    return entry->body_len + (entry->gzip != NULL ? entry->gzip->body_len : 0);
+}
+
+void _evict_file_cache_entries(const size_t size) {
+    while (_file_cache_hand != NULL &&
+           (_file_cache_size + size > _file_cache_max_size ||
+            g_hash_table_size(_file_cache_htab) + 1 > _file_cache_max_entries)) {
+        file_cache_entry *entry = _file_cache_hand;
+
+        // Recently used entries get a second chance.
+        if (atomic_exchange(&entry->referenced, false))
+            _file_cache_hand = entry->next;
+        else
+            _remove_file_cache_entry(entry);
+    }
+}
+
+int _validate_file_cache_entry(file_cache_entry *entry) {
+    long now = _file_cache_now();
+    if (now - atomic_load(&entry->checked_at) < FILE_CACHE_CHECK_INTERVAL)
+        return 1;
+    atomic_store(&entry->checked_at, now);
+
+    struct stat file_stat;
+    if (stat(entry->path, &file_stat) < 0)
+        return 0;
+
+    return file_stat.st_ino == entry->file_stat.st_ino &&
+           file_stat.st_size == entry->file_stat.st_size &&
+           file_stat.st_mtim.tv_sec == entry->file_stat.st_mtim.tv_sec &&
+           file_stat.st_mtim.tv_nsec == entry->file_stat.st_mtim.tv_nsec;
+}
+
+long _file_cache_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+void _add_file_cache_watch(const char *dir_path) {
+    int wd = inotify_add_watch(_file_cache_inotify_fd, dir_path,
+                               IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                   IN_ONLYDIR);
+    if (wd < 0)
+        return;
+    g_hash_table_insert(_file_cache_watch_htab, GINT_TO_POINTER(wd), strdup(dir_path));
+
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL)
+        return;
+
+    struct dirent *dir_entry = NULL;
+    while ((dir_entry = readdir(dir)) != NULL) {
+        if (dir_entry->d_type != DT_DIR || strcmp(dir_entry->d_name, ".") == 0 ||
+            strcmp(dir_entry->d_name, "..") == 0)
+            continue;
+
+        char *sub_dir_path = g_strdup_printf("%s/%s", dir_path, dir_entry->d_name);
+        _add_file_cache_watch(sub_dir_path);
+        g_free(sub_dir_path);
+    }
+
+    closedir(dir);
+}
+
+void *_file_cache_watch_loop(void *arg) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {{.fd = _file_cache_inotify_fd, .events = POLLIN},
+                            {.fd = _file_cache_wake_fd, .events = POLLIN}};
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+
+        ssize_t buf_size = 0;
+        while ((buf_size = read(_file_cache_inotify_fd, buf, sizeof(buf))) > 0) {
+            for (char *ptr = buf; ptr < buf + buf_size;) {
+                struct inotify_event *event = (struct inotify_event *)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                // Events were lost or a directory was moved, so any entry may be stale.
+                if ((event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) ||
+                    ((event->mask & IN_ISDIR) && (event->mask & (IN_MOVED_FROM | IN_MOVED_TO)))) {
+                    clear_file_cache();
+                }
+
+                const char *dir_path =
+                    g_hash_table_lookup(_file_cache_watch_htab, GINT_TO_POINTER(event->wd));
+                if (event->mask & IN_IGNORED) {
+                    g_hash_table_remove(_file_cache_watch_htab, GINT_TO_POINTER(event->wd));
+                    continue;
+                }
+                if (dir_path == NULL || event->len == 0)
+                    continue;
+
+                // Any change in a directory changes its listing, cached with a trailing `/`.
+                char *listing_path = g_strdup_printf("%s/", dir_path);
+                invalidate_file_cache_entry(listing_path);
+                g_free(listing_path);
+
+                char *path = g_strdup_printf("%s/%s", dir_path, event->name);
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                    _add_file_cache_watch(path);
+                else
+                    invalidate_file_cache_entry(path);
+
+                // The entry of the uncompressed file records which siblings exist.
+                content_encoding encoding = get_precompressed_file_encoding(path);
+                if (encoding != CONTENT_ENCODING_IDENTITY) {
+                    path[strlen(path) - strlen(get_content_encoding_suffix(encoding))] = '\0';
+                    invalidate_file_cache_entry(path);
+                }
+                g_free(path);
+            }
+        }
+    }
+
+    return NULL;
+}
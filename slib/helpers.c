@@ -9,7 +9,10 @@
  * @bug No known bugs.
  */
 
+#define _GNU_SOURCE
+
 #include <ctype.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "helpers.h"
@@ -22,8 +25,9 @@ char *ltrim(char *s) {
 
 char *rtrim(char *s) {
     char *back = s + strlen(s);
-    while (isspace(*--back));
-    *(back + 1) = '\0';
+    while (back > s && isspace(*(back - 1)))
+        back--;
+    *back = '\0';
     return s;
 }
 
@@ -33,3 +37,33 @@ void free_gerror(GError **error) {
     g_error_free(*error);
     *error = NULL;
 }
+
+char *format_etag(const struct stat *file_stat, char *etag) {
+    snprintf(etag, ETAG_BUF_SIZE, "\"%llx-%llx-%llx\"", (unsigned long long)file_stat->st_ino,
+             (unsigned long long)file_stat->st_size, (unsigned long long)file_stat->st_mtime);
+    return etag;
+}
+
+char *format_http_date(const time_t t, char *date) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(date, HTTP_DATE_BUF_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return date;
+}
+
+time_t parse_http_date(const char *date) {
+    const char *formats[] = {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT",
+                             "%a %b %e %H:%M:%S %Y"};
+
+    if (date == NULL)
+        return -1;
+
+    for (int f_no = 0; f_no < sizeof(formats) / sizeof(formats[0]); f_no++) {
+        struct tm tm = {0};
+        const char *end = strptime(date, formats[f_no], &tm);
+        if (end != NULL && *end == '\0')
+            return timegm(&tm);
+    }
+
+    return -1;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file slib/histogram.c
+ * @brief Functions for the log-linear latency histogram.
+ *
+ * Implements functions defined in `include/histogram.h`. Used by the load generator to record
+ * request latencies and report percentiles without keeping every sample.
+ *
+ * A value `v` with its highest set bit at position `m >= HISTOGRAM_PRECISION_BITS` is shifted
+ * right by `m - HISTOGRAM_PRECISION_BITS + 1`, which keeps its top `HISTOGRAM_PRECISION_BITS`
+ * bits. The shift selects the group of buckets and the kept bits select the bucket in the group.
+ *
+ * @see typedef struct histogram
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+histogram *create_histogram() {
+    histogram *h = malloc(sizeof(histogram));
+    if (h == NULL)
+        return NULL;
+
+    reset_histogram(h);
+    return h;
+}
+
+void record_histogram_value(histogram *h, const uint64_t value) {
+    h->counts[_get_histogram_bucket(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+}
+
+void merge_histogram(histogram *dst, const histogram *src) {
+    for (int bucket = 0; bucket < HISTOGRAM_N_BUCKETS; bucket++)
+        dst->counts[bucket] += src->counts[bucket];
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t get_histogram_percentile(const histogram *h, const double percentile) {
+    if (h->count == 0)
+        return 0;
+
+    // Rank of the value at the percentile, at least the first value.
+    double rank = percentile / 100.0 * (double)h->count;
+    uint64_t target = rank < 1 ? 1 : (uint64_t)rank;
+    if ((double)target < rank)
+        target++;
+    if (target > h->count)
+        target = h->count;
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_N_BUCKETS; bucket++) {
+        seen += h->counts[bucket];
+        if (seen >= target) {
+            uint64_t value = _get_histogram_bucket_value(bucket);
+            return value < h->max ? value : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+double get_histogram_mean(const histogram *h) {
+    return h->count > 0 ? h->sum / (double)h->count : 0;
+}
+
+void reset_histogram(histogram *h) {
+    memset(h->counts, 0, sizeof(h->counts));
+    h->count = 0;
+    h->min = UINT64_MAX;
+    h->max = 0;
+    h->sum = 0;
+}
+
+void destroy_histogram(histogram *h) {
+    free(h);
+}
+
+int _get_histogram_bucket(const uint64_t value) {
+    const int exact = 1 << HISTOGRAM_PRECISION_BITS, half = exact >> 1;
+    if (value < (uint64_t)exact)
+        return (int)value;
+
+    int shift = 64 - __builtin_clzll(value) - HISTOGRAM_PRECISION_BITS;
+    return exact + (shift - 1) * half + (int)(value >> shift) - half;
+}
+
+uint64_t _get_histogram_bucket_value(const int bucket) {
+    const int exact = 1 << HISTOGRAM_PRECISION_BITS, half = exact >> 1;
+    if (bucket < exact)
+        return (uint64_t)bucket;
+
+    int shift = (bucket - exact) / half + 1;
+    uint64_t kept = (uint64_t)((bucket - exact) % half + half);
+    return ((kept + 1) << shift) - 1;
+}
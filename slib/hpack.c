@@ -0,0 +1,507 @@
+/**
+ * @file slib/hpack.c
+ * @brief Functions for the HPACK header compression of HTTP/2 (RFC 7541).
+ *
+ * Implements functions defined in `include/hpack.h`. Used by the HTTP/2 sessions to decode the
+ * request headers and to encode the response headers.
+ *
+ * The Huffman code of the RFC is canonical: the codes of a length are consecutive and follow the
+ * shorter ones. Therefore, it is decoded bit by bit from the number of codes of every length and
+ * the symbols sorted by their code, without a decoding tree.
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+/**
+ * @private
+ * @brief Defines an entry of `_hpack_static_table`.
+ */
+#define _STATIC_ENTRY(name, value) {name, sizeof(name) - 1, value, sizeof(value) - 1}
+
+/**
+ * @private
+ * @brief The static table (RFC 7541, appendix A), `_hpack_static_table[0]` has the index `1`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const hpack_entry _hpack_static_table[HPACK_STATIC_TABLE_LEN] = {
+    _STATIC_ENTRY(":authority", ""),
+    _STATIC_ENTRY(":method", "GET"),
+    _STATIC_ENTRY(":method", "POST"),
+    _STATIC_ENTRY(":path", "/"),
+    _STATIC_ENTRY(":path", "/index.html"),
+    _STATIC_ENTRY(":scheme", "http"),
+    _STATIC_ENTRY(":scheme", "https"),
+    _STATIC_ENTRY(":status", "200"),
+    _STATIC_ENTRY(":status", "204"),
+    _STATIC_ENTRY(":status", "206"),
+    _STATIC_ENTRY(":status", "304"),
+    _STATIC_ENTRY(":status", "400"),
+    _STATIC_ENTRY(":status", "404"),
+    _STATIC_ENTRY(":status", "500"),
+    _STATIC_ENTRY("accept-charset", ""),
+    _STATIC_ENTRY("accept-encoding", "gzip, deflate"),
+    _STATIC_ENTRY("accept-language", ""),
+    _STATIC_ENTRY("accept-ranges", ""),
+    _STATIC_ENTRY("accept", ""),
+    _STATIC_ENTRY("access-control-allow-origin", ""),
+    _STATIC_ENTRY("age", ""),
+    _STATIC_ENTRY("allow", ""),
+    _STATIC_ENTRY("authorization", ""),
+    _STATIC_ENTRY("cache-control", ""),
+    _STATIC_ENTRY("content-disposition", ""),
+    _STATIC_ENTRY("content-encoding", ""),
+    _STATIC_ENTRY("content-language", ""),
+    _STATIC_ENTRY("content-length", ""),
+    _STATIC_ENTRY("content-location", ""),
+    _STATIC_ENTRY("content-range", ""),
+    _STATIC_ENTRY("content-type", ""),
+    _STATIC_ENTRY("cookie", ""),
+    _STATIC_ENTRY("date", ""),
+    _STATIC_ENTRY("etag", ""),
+    _STATIC_ENTRY("expect", ""),
+    _STATIC_ENTRY("expires", ""),
+    _STATIC_ENTRY("from", ""),
+    _STATIC_ENTRY("host", ""),
+    _STATIC_ENTRY("if-match", ""),
+    _STATIC_ENTRY("if-modified-since", ""),
+    _STATIC_ENTRY("if-none-match", ""),
+    _STATIC_ENTRY("if-range", ""),
+    _STATIC_ENTRY("if-unmodified-since", ""),
+    _STATIC_ENTRY("last-modified", ""),
+    _STATIC_ENTRY("link", ""),
+    _STATIC_ENTRY("location", ""),
+    _STATIC_ENTRY("max-forwards", ""),
+    _STATIC_ENTRY("proxy-authenticate", ""),
+    _STATIC_ENTRY("proxy-authorization", ""),
+    _STATIC_ENTRY("range", ""),
+    _STATIC_ENTRY("referer", ""),
+    _STATIC_ENTRY("refresh", ""),
+    _STATIC_ENTRY("retry-after", ""),
+    _STATIC_ENTRY("server", ""),
+    _STATIC_ENTRY("set-cookie", ""),
+    _STATIC_ENTRY("strict-transport-security", ""),
+    _STATIC_ENTRY("transfer-encoding", ""),
+    _STATIC_ENTRY("user-agent", ""),
+    _STATIC_ENTRY("vary", ""),
+    _STATIC_ENTRY("via", ""),
+    _STATIC_ENTRY("www-authenticate", ""),
+};
+
+/**
+ * @private
+ * @brief Huffman codes of the bytes (RFC 7541, appendix B), right-aligned.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const uint32_t _hpack_huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+/**
+ * @private
+ * @brief Lengths (in bits) of `_hpack_huffman_codes`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const uint8_t _hpack_huffman_lens[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+/**
+ * @private
+ * @brief Number of Huffman codes of every length (in bits), with the end of string code.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const uint16_t _hpack_huffman_counts[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+
+/**
+ * @private
+ * @brief Symbols sorted by their Huffman code, `256` is the end of string.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const uint16_t _hpack_huffman_symbols[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+    52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+    110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+    119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+    43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+    179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+    163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+    158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+    144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+    212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+    2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+    256,
+};
+
+void init_hpack_table(hpack_table *table, const size_t max_size) {
+    *table = (hpack_table){.max_size = max_size, .limit = max_size};
+}
+
+void free_hpack_table(hpack_table *table) {
+    _evict_hpack_entries(table, 0);
+    free(table->entries);
+    table->entries = NULL;
+    table->cap = table->first = 0;
+}
+
+void set_hpack_table_limit(hpack_table *table, const size_t limit) {
+    table->limit = limit;
+    if (table->max_size <= limit)
+        return;
+
+    table->max_size = limit;
+    table->size_changed = true;
+    _evict_hpack_entries(table, limit);
+}
+
+const hpack_entry *get_hpack_entry(const hpack_table *table, const size_t index) {
+    if (index == 0)
+        return NULL;
+    if (index <= HPACK_STATIC_TABLE_LEN)
+        return &_hpack_static_table[index - 1];
+    if (index - HPACK_STATIC_TABLE_LEN > table->len)
+        return NULL;
+
+    return &table->entries[(table->first + index - HPACK_STATIC_TABLE_LEN - 1) % table->cap];
+}
+
+int add_hpack_entry(hpack_table *table, const char *name, const size_t name_len, const char *value,
+                    const size_t value_len) {
+    size_t entry_size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    if (entry_size > table->max_size) {
+        _evict_hpack_entries(table, 0);
+        return 1;
+    }
+    _evict_hpack_entries(table, table->max_size - entry_size);
+
+    if (table->len == table->cap) {
+        unsigned int cap = table->cap > 0 ? table->cap * 2 : 16;
+        hpack_entry *entries = malloc(cap * sizeof(hpack_entry));
+        if (entries == NULL)
+            return 0;
+
+        for (unsigned int entry_no = 0; entry_no < table->len; entry_no++)
+            entries[entry_no] = table->entries[(table->first + entry_no) % table->cap];
+        free(table->entries);
+        table->entries = entries;
+        table->cap = cap;
+        table->first = 0;
+    }
+
+    // The name and the value are stored in one allocation.
+    char *str = malloc(name_len + value_len + 2);
+    if (str == NULL)
+        return 0;
+    memcpy(str, name, name_len);
+    str[name_len] = '\0';
+    memcpy(str + name_len + 1, value, value_len);
+    str[name_len + 1 + value_len] = '\0';
+
+    table->first = (table->first + table->cap - 1) % table->cap;
+    table->entries[table->first] = (hpack_entry){str, name_len, str + name_len + 1, value_len};
+    table->len++;
+    table->size += entry_size;
+    return 1;
+}
+
+size_t find_hpack_entry(const hpack_table *table, const char *name, const size_t name_len,
+                        const char *value, const size_t value_len, bool *value_matched) {
+    size_t name_index = 0;
+
+    *value_matched = false;
+    for (size_t index = 1; index <= HPACK_STATIC_TABLE_LEN + table->len; index++) {
+        const hpack_entry *entry = get_hpack_entry(table, index);
+        if (entry->name_len != name_len || memcmp(entry->name, name, name_len) != 0)
+            continue;
+
+        if (entry->value_len == value_len && memcmp(entry->value, value, value_len) == 0) {
+            *value_matched = true;
+            return index;
+        }
+        if (name_index == 0)
+            name_index = index;
+    }
+
+    return name_index;
+}
+
+int decode_hpack_block(hpack_table *table, const unsigned char *buf, const size_t len,
+                       hpack_header_cb callback, void *arg) {
+    GString *name = g_string_sized_new(64), *value = g_string_sized_new(256);
+    const hpack_entry *entry = NULL;
+    bool has_headers = false;
+    size_t pos = 0;
+    int ok = 1;
+
+    while (ok && pos < len) {
+        unsigned char type = buf[pos];
+        uint64_t index = 0;
+
+        if (type & 0x80) {
+            ok = _decode_hpack_int(buf, len, &pos, 7, &index) &&
+                 (entry = get_hpack_entry(table, index)) != NULL;
+            if (ok)
+                callback(arg, entry->name, entry->name_len, entry->value, entry->value_len);
+            has_headers = true;
+            continue;
+        }
+
+        // Table size updates are only allowed before the first header of a block.
+        if ((type & 0xe0) == 0x20) {
+            ok = !has_headers && _decode_hpack_int(buf, len, &pos, 5, &index) &&
+                 index <= table->limit;
+            if (ok) {
+                table->max_size = index;
+                _evict_hpack_entries(table, index);
+            }
+            continue;
+        }
+
+        // The name is copied, adding the header may evict the entry it came from.
+        bool is_indexed = (type & 0xc0) == 0x40;
+        ok = _decode_hpack_int(buf, len, &pos, is_indexed ? 6 : 4, &index);
+        if (ok && index > 0 && (ok = (entry = get_hpack_entry(table, index)) != NULL)) {
+            g_string_truncate(name, 0);
+            g_string_append_len(name, entry->name, entry->name_len);
+        } else if (ok) {
+            ok = _decode_hpack_string(buf, len, &pos, name);
+        }
+        if (!ok || !(ok = _decode_hpack_string(buf, len, &pos, value)))
+            break;
+
+        callback(arg, name->str, name->len, value->str, value->len);
+        if (is_indexed)
+            ok = add_hpack_entry(table, name->str, name->len, value->str, value->len);
+        has_headers = true;
+    }
+
+    g_string_free(name, TRUE);
+    g_string_free(value, TRUE);
+    return ok;
+}
+
+void begin_hpack_block(hpack_table *table, GString *out) {
+    if (!table->size_changed)
+        return;
+
+    _encode_hpack_int(out, 0x20, 5, table->max_size);
+    table->size_changed = false;
+}
+
+void encode_hpack_header(hpack_table *table, GString *out, const char *name, const size_t name_len,
+                         const char *value, const size_t value_len, const hpack_indexing indexing) {
+    bool value_matched = false;
+    size_t index = find_hpack_entry(table, name, name_len, value, value_len, &value_matched);
+    if (value_matched) {
+        _encode_hpack_int(out, 0x80, 7, index);
+        return;
+    }
+
+    if (indexing == HPACK_INDEX)
+        _encode_hpack_int(out, 0x40, 6, index);
+    else
+        _encode_hpack_int(out, indexing == HPACK_NEVER_INDEX ? 0x10 : 0x00, 4, index);
+    if (index == 0)
+        _encode_hpack_string(out, name, name_len);
+    _encode_hpack_string(out, value, value_len);
+
+    if (indexing == HPACK_INDEX)
+        add_hpack_entry(table, name, name_len, value, value_len);
+}
+
+int decode_hpack_huffman(GString *out, const unsigned char *buf, const size_t len) {
+    int code = 0, first = 0, index = 0, code_len = 0;
+    bool all_ones = true;
+
+    for (size_t byte_no = 0; byte_no < len; byte_no++) {
+        for (int bit_no = 7; bit_no >= 0; bit_no--) {
+            int bit = (buf[byte_no] >> bit_no) & 1;
+            code |= bit;
+            all_ones = all_ones && bit;
+
+            // The codes of every length follow the last code of the previous length, shifted.
+            int count = _hpack_huffman_counts[++code_len];
+            if (code - first < count) {
+                int symbol = _hpack_huffman_symbols[index + code - first];
+                if (symbol == 256)
+                    return 0;
+                g_string_append_c(out, (char)symbol);
+                code = first = index = code_len = 0;
+                all_ones = true;
+                continue;
+            }
+            if (code_len == 30)
+                return 0;
+
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+    }
+
+    // The padding is the start of the end of string code, shorter than a byte.
+    return code_len < 8 && all_ones;
+}
+
+void encode_hpack_huffman(GString *out, const char *str, const size_t len) {
+    uint64_t bits = 0;
+    int n_bits = 0;
+
+    for (size_t char_no = 0; char_no < len; char_no++) {
+        unsigned char c = str[char_no];
+        bits = (bits << _hpack_huffman_lens[c]) | _hpack_huffman_codes[c];
+        n_bits += _hpack_huffman_lens[c];
+        while (n_bits >= 8) {
+            n_bits -= 8;
+            g_string_append_c(out, (char)(bits >> n_bits));
+        }
+    }
+
+    if (n_bits > 0)
+        g_string_append_c(out, (char)((bits << (8 - n_bits)) | (0xff >> n_bits)));
+}
+
+size_t get_hpack_huffman_len(const char *str, const size_t len) {
+    size_t n_bits = 0;
+    for (size_t char_no = 0; char_no < len; char_no++)
+        n_bits += _hpack_huffman_lens[(unsigned char)str[char_no]];
+
+    return (n_bits + 7) / 8;
+}
+
+int _decode_hpack_int(const unsigned char *buf, const size_t len, size_t *pos,
+                      const int prefix_bits, uint64_t *value) {
+    if (*pos >= len)
+        return 0;
+
+    unsigned int max_prefix = (1 << prefix_bits) - 1;
+    *value = buf[(*pos)++] & max_prefix;
+    if (*value < max_prefix)
+        return 1;
+
+    // No field of a header block needs more than 32 bits.
+    for (int shift = 0; shift <= 28 && *pos < len; shift += 7) {
+        unsigned char byte = buf[(*pos)++];
+        *value += (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return *value <= UINT32_MAX;
+    }
+
+    return 0;
+}
+
+void _encode_hpack_int(GString *out, const unsigned char flags, const int prefix_bits,
+                       uint64_t value) {
+    unsigned int max_prefix = (1 << prefix_bits) - 1;
+    if (value < max_prefix) {
+        g_string_append_c(out, (char)(flags | value));
+        return;
+    }
+
+    g_string_append_c(out, (char)(flags | max_prefix));
+    for (value -= max_prefix; value >= 0x80; value >>= 7)
+        g_string_append_c(out, (char)((value & 0x7f) | 0x80));
+    g_string_append_c(out, (char)value);
+}
+
+int _decode_hpack_string(const unsigned char *buf, const size_t len, size_t *pos, GString *out) {
+    uint64_t str_len = 0;
+    bool is_huffman = *pos < len && (buf[*pos] & 0x80);
+    if (!_decode_hpack_int(buf, len, pos, 7, &str_len) || str_len > len - *pos)
+        return 0;
+
+    g_string_truncate(out, 0);
+    if (is_huffman && !decode_hpack_huffman(out, buf + *pos, str_len))
+        return 0;
+    if (!is_huffman)
+        g_string_append_len(out, (const char *)buf + *pos, str_len);
+
+    *pos += str_len;
+    return 1;
+}
+
+void _encode_hpack_string(GString *out, const char *str, const size_t len) {
+    size_t huffman_len = get_hpack_huffman_len(str, len);
+    if (huffman_len < len) {
+        _encode_hpack_int(out, 0x80, 7, huffman_len);
+        encode_hpack_huffman(out, str, len);
+        return;
+    }
+
+    _encode_hpack_int(out, 0x00, 7, len);
+    g_string_append_len(out, str, len);
+}
+
+void _evict_hpack_entries(hpack_table *table, const size_t max_size) {
+    while (table->len > 0 && table->size > max_size) {
+        hpack_entry *entry = &table->entries[(table->first + table->len - 1) % table->cap];
+        table->size -= entry->name_len + entry->value_len + HPACK_ENTRY_OVERHEAD;
+        free((char *)entry->name);
+        table->len--;
+    }
+}
@@ -0,0 +1,1172 @@
+/**
+ * @file slib/http2.c
+ * @brief Functions for the HTTP/2 sessions of client connections (RFC 9113).
+ *
+ * Implements functions defined in `include/http2.h`. Used by the workers to read the frames of
+ * HTTP/2 connections and to hand their streams to the request handler, and by responses to send
+ * on the active stream.
+ *
+ * Frames are read from the non-blocking socket by the worker event loop. Once a stream is
+ * complete, the worker runs the handler, the response is queued as frames and sent whenever
+ * `HTTP2_SEND_BUF_SIZE` bytes are queued. The socket is never waited for: the part of a body that
+ * the client's flow control windows (or the socket) don't take is parked on the stream, and
+ * `flush_http2_session()` goes on with it from the event loop once a `WINDOW_UPDATE` arrives or
+ * the socket is writable. The frames of the client are never read while a handler runs. A stream
+ * whose handler waits for something else (e.g. a backend) is paused, the client's frames are read
+ * meanwhile and the streams they start are handled after it.
+ *
+ * A session is owned by the worker of its connection, only the active stream is thread-local.
+ *
+ * @see typedef struct http2_session
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http2.h"
+
+/**
+ * @private
+ * @brief Reads the 32-bit big-endian integer at `p`.
+ */
+#define _READ_U32(p)                                                                               \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (p)[3])
+
+/**
+ * @private
+ * @brief Defines the largest flow control window (RFC 9113, section 6.9.1).
+ */
+#define _MAX_WINDOW 0x7fffffff
+
+/**
+ * @private
+ * @brief Session of the stream the calling thread is handling, `NULL` if it handles none.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local http2_session *_http2_active_session = NULL;
+
+/**
+ * @private
+ * @brief Digits of base64url (RFC 4648, section 5), used by the `HTTP2-Settings` header.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const char _http2_base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/**
+ * @private
+ * @brief Response headers whose values rarely change, they are added to the dynamic table.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const char *_http2_indexed_headers[] = {
+    "server",         "content-type", "cache-control", "vary", "accept-ranges", "content-encoding",
+    "x-content-type-options", "strict-transport-security", "access-control-allow-origin", NULL};
+
+http2_session *create_http2_session(const int fd, const unsigned int max_streams,
+                                    const size_t max_head_size, const size_t max_body_size) {
+    http2_session *session = calloc(1, sizeof(http2_session));
+    if (session == NULL)
+        return NULL;
+
+    session->fd = fd;
+    session->max_streams = max_streams;
+    session->max_head_size = max_head_size;
+    session->max_body_size = max_body_size;
+    init_hpack_table(&session->decoder, HPACK_DEFAULT_TABLE_SIZE);
+    init_hpack_table(&session->encoder, HPACK_DEFAULT_TABLE_SIZE);
+    session->header_block = g_string_new(NULL);
+    session->send_window = HTTP2_DEFAULT_WINDOW;
+    session->recv_window = HTTP2_DEFAULT_WINDOW;
+    session->initial_window = HTTP2_DEFAULT_WINDOW;
+    session->max_frame_size = HTTP2_MAX_FRAME_SIZE;
+    session->out = g_string_sized_new(1024);
+    return session;
+}
+
+int start_http2_session(http2_session *session, const char *upgrade_settings) {
+    if (upgrade_settings != NULL) {
+        unsigned char payload[192];
+        size_t payload_len = 0;
+        uint32_t bits = 0;
+        int n_bits = 0;
+
+        for (const char *c = upgrade_settings; *c != '\0' && *c != '='; c++) {
+            const char *digit = strchr(_http2_base64url, *c);
+            if (digit == NULL || payload_len == sizeof(payload))
+                return 0;
+
+            bits = (bits << 6) | (digit - _http2_base64url);
+            if ((n_bits += 6) >= 8) {
+                n_bits -= 8;
+                payload[payload_len++] = bits >> n_bits;
+            }
+        }
+
+        if (payload_len % 6 != 0 ||
+            _apply_http2_settings(session, payload, payload_len) != HTTP2_NO_ERROR)
+            return 0;
+
+        // The client reads the server's preface right after the end of the HTTP/1.1 response.
+        const char switching[] = "HTTP/1.1 101 Switching Protocols\r\nconnection: Upgrade\r\n"
+                                 "upgrade: h2c\r\n\r\n";
+        g_string_append_len(session->out, switching, sizeof(switching) - 1);
+    }
+
+    // Push is a client setting, the server only limits the streams and request heads.
+    uint32_t max_head_size = session->max_head_size < UINT32_MAX ? session->max_head_size
+                                                                 : UINT32_MAX;
+    const unsigned char settings[] = {
+        0, HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, session->max_streams >> 24,
+        session->max_streams >> 16, session->max_streams >> 8, session->max_streams,
+        0, HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, max_head_size >> 24, max_head_size >> 16,
+        max_head_size >> 8, max_head_size};
+    _queue_http2_frame(session, HTTP2_SETTINGS, 0, 0, settings, sizeof(settings));
+    return 1;
+}
+
+http2_stream *open_http2_upgrade_stream(http2_session *session, const char *request,
+                                        const size_t len, const bool is_head) {
+    http2_stream *stream = _add_http2_stream(session, 1);
+    if (stream == NULL)
+        return NULL;
+
+    // The request was read over HTTP/1.1, the stream is half-closed from the start.
+    session->last_stream_id = 1;
+    g_string_append_len(stream->request, request, len);
+    stream->is_head = is_head;
+    stream->is_remote_closed = stream->is_ready = true;
+    return stream;
+}
+
+int read_http2_session(http2_session *session) {
+    while (!session->is_broken) {
+        // Frames are answered (e.g. `PING`), a client that doesn't read the answers isn't read.
+        if (session->out->len >= HTTP2_SEND_BUF_SIZE)
+            return 1;
+
+        ssize_t recv_size = recv_tls(session->fd, session->in + session->in_len,
+                                     sizeof(session->in) - session->in_len);
+        if (recv_size < 0 && errno == EINTR)
+            continue;
+        if (recv_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (recv_size <= 0) {
+            session->is_broken = true;
+            return 0;
+        }
+
+        session->in_len += recv_size;
+        if (!_process_http2_frames(session))
+            return 0;
+    }
+
+    return 0;
+}
+
+int receive_http2_data(http2_session *session, const char *buf, size_t len) {
+    while (len > 0 && !session->is_broken) {
+        size_t copy_len = sizeof(session->in) - session->in_len;
+        copy_len = copy_len < len ? copy_len : len;
+        memcpy(session->in + session->in_len, buf, copy_len);
+        session->in_len += copy_len;
+        buf += copy_len;
+        len -= copy_len;
+
+        if (!_process_http2_frames(session))
+            return 0;
+    }
+
+    return !session->is_broken;
+}
+
+http2_stream *next_http2_stream(http2_session *session) {
+    http2_stream *next = NULL;
+    if (session->is_broken || !session->has_settings)
+        return NULL;
+
+    for (http2_stream *stream = session->streams; stream != NULL; stream = stream->next)
+        if (stream->is_ready && (next == NULL || stream->urgency < next->urgency ||
+                                 (stream->urgency == next->urgency && stream->id < next->id)))
+            next = stream;
+
+    return next;
+}
+
+void begin_http2_stream(http2_session *session, http2_stream *stream) {
+    stream->is_ready = false;
+    stream->response_head = g_string_sized_new(512);
+    session->active = stream;
+    _http2_active_session = session;
+}
+
+void pause_http2_stream(http2_session *session) {
+    if (_http2_active_session == session)
+        _http2_active_session = NULL;
+}
+
+void continue_http2_stream(http2_session *session) { _http2_active_session = session; }
+
+int finish_http2_stream(http2_session *session, http2_stream *stream) {
+    session->active = NULL;
+    _http2_active_session = NULL;
+
+    // A parked body is sent before the stream ends, the stream is left to the session until then.
+    stream->is_finished = true;
+    if (stream->pending == NULL || stream->is_reset || session->is_broken)
+        _end_http2_stream(session, stream);
+    return !session->is_broken;
+}
+
+void _end_http2_stream(http2_session *session, http2_stream *stream) {
+    unsigned char error[4] = {0, 0, 0, HTTP2_INTERNAL_ERROR};
+
+    // A response cut short must not look complete to the client.
+    if (!session->is_broken && !stream->is_reset && !stream->is_ended) {
+        if (stream->response_head != NULL || stream->remaining > 0)
+            _queue_http2_frame(session, HTTP2_RST_STREAM, 0, stream->id, error, sizeof(error));
+        else
+            _queue_http2_frame(session, HTTP2_DATA, HTTP2_FLAG_END_STREAM, stream->id, NULL, 0);
+        stream->is_ended = stream->response_head == NULL && stream->remaining <= 0;
+    }
+
+    // The rest of a request answered early (e.g. with 413) isn't needed anymore.
+    if (!session->is_broken && !stream->is_reset && stream->is_ended &&
+        !stream->is_remote_closed) {
+        error[3] = HTTP2_NO_ERROR;
+        _queue_http2_frame(session, HTTP2_RST_STREAM, 0, stream->id, error, sizeof(error));
+    }
+
+    _remove_http2_stream(session, stream);
+}
+
+void shutdown_http2_session(http2_session *session) {
+    if (session->is_broken)
+        return;
+
+    const unsigned char payload[8] = {session->last_stream_id >> 24, session->last_stream_id >> 16,
+                                      session->last_stream_id >> 8, session->last_stream_id, 0,
+                                      0, 0, HTTP2_NO_ERROR};
+    _queue_http2_frame(session, HTTP2_GOAWAY, 0, 0, payload, sizeof(payload));
+    session->is_goaway = true;
+}
+
+bool is_http2_session_done(const http2_session *session) {
+    return session->is_broken || (session->is_goaway && session->n_streams == 0);
+}
+
+int flush_http2_session(http2_session *session) {
+    bool is_resumed = true;
+
+    while (_send_http2_out(session)) {
+        if (session->out->len > 0)
+            return 2;
+        if (!is_resumed)
+            return 1;
+
+        // Parked bodies go on once the queue is sent, as far as their windows allow.
+        is_resumed = false;
+        http2_stream *stream = session->streams, *next = NULL;
+        for (; stream != NULL && !session->is_broken; stream = next) {
+            next = stream->next;
+            if (stream->pending != NULL && !stream->is_reset &&
+                _resume_http2_stream(session, stream))
+                is_resumed = true;
+        }
+    }
+
+    return 0;
+}
+
+bool has_http2_output(const http2_session *session) {
+    if (session->out->len > 0)
+        return true;
+
+    for (http2_stream *stream = session->streams; stream != NULL; stream = stream->next)
+        if (stream->pending != NULL)
+            return true;
+
+    return false;
+}
+
+bool can_send_http2(const http2_session *session) {
+    // A reset stream or a broken session takes anything, the handler learns from its next send.
+    const http2_stream *stream = session->active;
+    return stream != NULL && (stream->is_reset || session->is_broken ||
+                              (stream->pending == NULL && session->out->len < HTTP2_SEND_BUF_SIZE));
+}
+
+void destroy_http2_session(http2_session *session) {
+    if (session == NULL)
+        return;
+
+    if (_http2_active_session == session)
+        _http2_active_session = NULL;
+    while (session->streams != NULL)
+        _remove_http2_stream(session, session->streams);
+
+    free_hpack_table(&session->decoder);
+    free_hpack_table(&session->encoder);
+    g_string_free(session->header_block, TRUE);
+    g_string_free(session->out, TRUE);
+    free(session);
+}
+
+bool has_http2_stream(const int fd) {
+    return _http2_active_session != NULL && _http2_active_session->fd == fd;
+}
+
+ssize_t send_http2(const int fd, const void *buf, const size_t len) {
+    if (!has_http2_stream(fd)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    http2_session *session = _http2_active_session;
+    http2_stream *stream = session->active;
+    size_t sent = 0, head_len = 0;
+
+    while (sent < len) {
+        if (session->is_broken || stream->is_reset) {
+            errno = EPIPE;
+            return sent > 0 ? (ssize_t)sent : -1;
+        }
+
+        if (stream->response_head == NULL) {
+            if (_send_http2_response_body(session, stream, (const char *)buf + sent, -1, 0,
+                                          len - sent))
+                sent = len;
+        } else if ((head_len = _send_http2_response_head(session, stream,
+                                                         (const char *)buf + sent,
+                                                         len - sent)) == 0) {
+            _reset_http2_stream(session, stream->id, HTTP2_INTERNAL_ERROR);
+        } else {
+            sent += head_len;
+        }
+    }
+
+    return sent;
+}
+
+ssize_t send_http2_file(const int fd, const int file_fd, const off_t offset, const size_t count) {
+    if (!has_http2_stream(fd)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // The head is sent before the body, from a buffer.
+    http2_session *session = _http2_active_session;
+    http2_stream *stream = session->active;
+    if (stream->response_head != NULL ||
+        !_send_http2_response_body(session, stream, NULL, file_fd, offset, count)) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    return count;
+}
+
+int _process_http2_frames(http2_session *session) {
+    size_t pos = 0;
+
+    // The preface may arrive in pieces, like any other bytes.
+    if (session->preface_len < HTTP2_PREFACE_LEN) {
+        pos = HTTP2_PREFACE_LEN - session->preface_len;
+        pos = pos < session->in_len ? pos : session->in_len;
+        if (memcmp(session->in, HTTP2_PREFACE + session->preface_len, pos) != 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        session->preface_len += pos;
+    }
+
+    while (session->in_len - pos >= HTTP2_FRAME_HEAD_LEN) {
+        const unsigned char *head = session->in + pos;
+        size_t len = ((size_t)head[0] << 16) | (head[1] << 8) | head[2];
+        if (len > HTTP2_MAX_FRAME_SIZE)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+        if (session->in_len - pos - HTTP2_FRAME_HEAD_LEN < len)
+            break;
+
+        if (!_process_http2_frame(session, head[3], head[4], _READ_U32(head + 5) & _MAX_WINDOW,
+                                  head + HTTP2_FRAME_HEAD_LEN, len))
+            return 0;
+        pos += HTTP2_FRAME_HEAD_LEN + len;
+    }
+
+    memmove(session->in, session->in + pos, session->in_len - pos);
+    session->in_len -= pos;
+    return 1;
+}
+
+int _process_http2_frame(http2_session *session, const uint8_t type, const uint8_t flags,
+                         const uint32_t stream_id, const unsigned char *payload, const size_t len) {
+    http2_stream *stream = NULL;
+    http2_error_code error = HTTP2_NO_ERROR;
+    uint32_t increment = 0;
+    size_t off = 0, pad_len = 0;
+
+    // The client starts with its settings, and nothing can come between the frames of a block.
+    if (!session->has_settings && (type != HTTP2_SETTINGS || (flags & HTTP2_FLAG_ACK)))
+        return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+    if (session->continuation_id != 0 &&
+        (type != HTTP2_CONTINUATION || stream_id != session->continuation_id))
+        return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+
+    switch (type) {
+    case HTTP2_DATA:
+        return _process_http2_data(session, flags, stream_id, payload, len);
+
+    case HTTP2_HEADERS:
+        if (flags & HTTP2_FLAG_PADDED)
+            pad_len = len > 0 ? payload[off++] : len + 1;
+        if (flags & HTTP2_FLAG_PRIORITY)
+            off += 5;
+        if (stream_id == 0 || off + pad_len > len)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (flags & HTTP2_FLAG_END_HEADERS)
+            return _process_http2_headers(session, flags, stream_id, payload + off,
+                                          len - off - pad_len);
+
+        g_string_truncate(session->header_block, 0);
+        g_string_append_len(session->header_block, (const char *)payload + off,
+                            len - off - pad_len);
+        session->continuation_id = stream_id;
+        session->continuation_flags = flags;
+        return 1;
+
+    case HTTP2_CONTINUATION:
+        if (session->continuation_id == 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+
+        // A block is bounded like a request head, however it is split.
+        g_string_append_len(session->header_block, (const char *)payload, len);
+        if (session->header_block->len > session->max_head_size + HTTP2_MAX_FRAME_SIZE)
+            return _fail_http2_session(session, HTTP2_ENHANCE_YOUR_CALM);
+        if (!(flags & HTTP2_FLAG_END_HEADERS))
+            return 1;
+
+        session->continuation_id = 0;
+        return _process_http2_headers(session, session->continuation_flags, stream_id,
+                                      (const unsigned char *)session->header_block->str,
+                                      session->header_block->len);
+
+    case HTTP2_PRIORITY:
+        if (stream_id == 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (len != 5)
+            _reset_http2_stream(session, stream_id, HTTP2_FRAME_SIZE_ERROR);
+        return 1;
+
+    case HTTP2_RST_STREAM:
+        if (stream_id == 0 || stream_id > session->last_stream_id)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (len != 4)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+
+        if ((stream = _find_http2_stream(session, stream_id)) == session->active && stream != NULL)
+            stream->is_reset = true;
+        else if (stream != NULL)
+            _remove_http2_stream(session, stream);
+        return 1;
+
+    case HTTP2_SETTINGS:
+        if (stream_id != 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (flags & HTTP2_FLAG_ACK)
+            return len == 0 ? 1 : _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+        if (len % 6 != 0)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+        if ((error = _apply_http2_settings(session, payload, len)) != HTTP2_NO_ERROR)
+            return _fail_http2_session(session, error);
+
+        session->has_settings = true;
+        _queue_http2_frame(session, HTTP2_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+        return 1;
+
+    case HTTP2_PING:
+        if (stream_id != 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (len != 8)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+        if (!(flags & HTTP2_FLAG_ACK))
+            _queue_http2_frame(session, HTTP2_PING, HTTP2_FLAG_ACK, 0, payload, len);
+        return 1;
+
+    case HTTP2_GOAWAY:
+        if (stream_id != 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (len < 8)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+        session->is_goaway = true;
+        return 1;
+
+    case HTTP2_WINDOW_UPDATE:
+        if (len != 4)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+
+        increment = _READ_U32(payload) & _MAX_WINDOW;
+        if (stream_id == 0) {
+            if (increment == 0)
+                return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+            if ((session->send_window += increment) > _MAX_WINDOW)
+                return _fail_http2_session(session, HTTP2_FLOW_CONTROL_ERROR);
+            return 1;
+        }
+
+        // Updates of streams that were already answered are expected, they are ignored.
+        if (stream_id > session->last_stream_id)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if ((stream = _find_http2_stream(session, stream_id)) == NULL)
+            return 1;
+        if (increment == 0)
+            _reset_http2_stream(session, stream_id, HTTP2_PROTOCOL_ERROR);
+        else if ((stream->send_window += increment) > _MAX_WINDOW)
+            _reset_http2_stream(session, stream_id, HTTP2_FLOW_CONTROL_ERROR);
+        return 1;
+
+    case HTTP2_PRIORITY_UPDATE:
+        if (stream_id != 0)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        if (len < 4)
+            return _fail_http2_session(session, HTTP2_FRAME_SIZE_ERROR);
+
+        if ((stream = _find_http2_stream(session, _READ_U32(payload) & _MAX_WINDOW)) != NULL)
+            stream->urgency = _parse_http2_urgency((const char *)payload + 4, len - 4);
+        return 1;
+
+    case HTTP2_PUSH_PROMISE:
+        return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+
+    default:
+        // Frames of unknown types are ignored (RFC 9113, section 4.1).
+        return 1;
+    }
+}
+
+int _process_http2_data(http2_session *session, const uint8_t flags, const uint32_t stream_id,
+                        const unsigned char *payload, const size_t len) {
+    size_t off = 0, pad_len = 0;
+    if (flags & HTTP2_FLAG_PADDED)
+        pad_len = len > 0 ? payload[off++] : len + 1;
+    if (stream_id == 0 || off + pad_len > len)
+        return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+
+    // The whole frame counts against the windows (RFC 9113, section 6.9.1). The connection's
+    // window is credited back once half of it is used, not for every frame.
+    if ((int64_t)len > session->recv_window)
+        return _fail_http2_session(session, HTTP2_FLOW_CONTROL_ERROR);
+    if ((session->recv_window -= len) <= HTTP2_DEFAULT_WINDOW / 2) {
+        _queue_http2_window_update(session, 0, HTTP2_DEFAULT_WINDOW - session->recv_window);
+        session->recv_window = HTTP2_DEFAULT_WINDOW;
+    }
+
+    http2_stream *stream = _find_http2_stream(session, stream_id);
+    if (stream == NULL || stream->is_remote_closed) {
+        if (stream_id > session->last_stream_id)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        _reset_http2_stream(session, stream_id, HTTP2_STREAM_CLOSED);
+        return 1;
+    }
+    if ((int64_t)len > stream->recv_window) {
+        _reset_http2_stream(session, stream_id, HTTP2_FLOW_CONTROL_ERROR);
+        return 1;
+    }
+    stream->recv_window -= len;
+
+    // A body that is too large is answered right away, the rest of it is dropped.
+    size_t data_len = len - off - pad_len;
+    bool is_open = !stream->is_ready && session->active != stream;
+    if (is_open) {
+        if (stream->body == NULL)
+            stream->body = g_string_sized_new(data_len);
+        if (stream->body->len + data_len > session->max_body_size) {
+            stream->error_status = 413;
+            _complete_http2_request(stream);
+        } else {
+            g_string_append_len(stream->body, (const char *)payload + off, data_len);
+        }
+    }
+
+    // Only a body that is still received is credited back, the rest of a body that isn't needed
+    // anymore can't be more than a window.
+    if (flags & HTTP2_FLAG_END_STREAM) {
+        stream->is_remote_closed = true;
+        if (is_open)
+            _complete_http2_request(stream);
+    } else if (is_open && !stream->is_ready && stream->recv_window <= HTTP2_DEFAULT_WINDOW / 2) {
+        _queue_http2_window_update(session, stream_id, HTTP2_DEFAULT_WINDOW - stream->recv_window);
+        stream->recv_window = HTTP2_DEFAULT_WINDOW;
+    }
+
+    return 1;
+}
+
+int _process_http2_headers(http2_session *session, const uint8_t flags, const uint32_t stream_id,
+                           const unsigned char *block, const size_t len) {
+    http2_header_block headers = {.session = session};
+    http2_stream *stream = _find_http2_stream(session, stream_id);
+    bool is_new = stream == NULL;
+
+    // Streams over the limit are refused, but their headers are decoded to keep the table in sync.
+    if (is_new) {
+        if ((stream_id & 1) == 0 || stream_id <= session->last_stream_id)
+            return _fail_http2_session(session, HTTP2_PROTOCOL_ERROR);
+        session->last_stream_id = stream_id;
+        if (!session->is_goaway && session->n_streams < session->max_streams)
+            stream = _add_http2_stream(session, stream_id);
+        headers.stream = stream;
+    }
+
+    int decoded = decode_hpack_block(&session->decoder, block, len, _add_http2_header, &headers);
+    bool is_valid = decoded && headers.method != NULL && headers.path != NULL &&
+                    headers.has_scheme && !headers.is_malformed;
+    if (is_new && stream != NULL && is_valid) {
+        GString *line = g_string_sized_new(headers.path->len + 64);
+        g_string_append_printf(line, "%s %s HTTP/2.0\r\n", headers.method->str, headers.path->str);
+        if (headers.authority != NULL)
+            g_string_append_printf(line, "host: %s\r\n", headers.authority->str);
+        g_string_prepend(stream->request, line->str);
+        g_string_free(line, TRUE);
+        if (headers.cookie != NULL)
+            g_string_append_printf(stream->request, "cookie: %s\r\n", headers.cookie->str);
+
+        stream->is_head = strcmp(headers.method->str, "HEAD") == 0;
+        if (stream->request->len > session->max_head_size)
+            stream->error_status = 431;
+    }
+
+    if (headers.method != NULL)
+        g_string_free(headers.method, TRUE);
+    if (headers.path != NULL)
+        g_string_free(headers.path, TRUE);
+    if (headers.authority != NULL)
+        g_string_free(headers.authority, TRUE);
+    if (headers.cookie != NULL)
+        g_string_free(headers.cookie, TRUE);
+
+    if (!decoded)
+        return _fail_http2_session(session, HTTP2_COMPRESSION_ERROR);
+
+    if (!is_new) {
+        // Trailers end the stream, they are not passed to the handler.
+        if (stream->is_remote_closed)
+            _reset_http2_stream(session, stream_id, HTTP2_STREAM_CLOSED);
+        else if (!(flags & HTTP2_FLAG_END_STREAM))
+            _reset_http2_stream(session, stream_id, HTTP2_PROTOCOL_ERROR);
+        else if (!stream->is_ready && session->active != stream)
+            _complete_http2_request(stream);
+        stream->is_remote_closed = true;
+        return 1;
+    }
+
+    if (stream == NULL) {
+        if (!session->is_goaway)
+            _reset_http2_stream(session, stream_id, HTTP2_REFUSED_STREAM);
+        return 1;
+    }
+    if (!is_valid) {
+        _reset_http2_stream(session, stream_id, HTTP2_PROTOCOL_ERROR);
+        return 1;
+    }
+
+    if (flags & HTTP2_FLAG_END_STREAM) {
+        stream->is_remote_closed = true;
+        _complete_http2_request(stream);
+    }
+    return 1;
+}
+
+http2_error_code _apply_http2_settings(http2_session *session, const unsigned char *payload,
+                                       const size_t len) {
+    for (size_t pos = 0; pos + 6 <= len; pos += 6) {
+        uint32_t value = _READ_U32(payload + pos + 2);
+
+        switch ((payload[pos] << 8) | payload[pos + 1]) {
+        case HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+            set_hpack_table_limit(&session->encoder, value);
+            break;
+        case HTTP2_SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return HTTP2_PROTOCOL_ERROR;
+            break;
+        case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+            // The windows of the started streams move by the difference (RFC 9113, 6.9.2).
+            if (value > _MAX_WINDOW)
+                return HTTP2_FLOW_CONTROL_ERROR;
+            for (http2_stream *stream = session->streams; stream != NULL; stream = stream->next)
+                if ((stream->send_window += (int64_t)value - session->initial_window) >
+                    _MAX_WINDOW)
+                    return HTTP2_FLOW_CONTROL_ERROR;
+            session->initial_window = value;
+            break;
+        case HTTP2_SETTINGS_MAX_FRAME_SIZE:
+            if (value < HTTP2_MAX_FRAME_SIZE || value > 0xffffff)
+                return HTTP2_PROTOCOL_ERROR;
+            session->max_frame_size = value;
+            break;
+        default:
+            // Unknown settings and the limits the server doesn't need are ignored.
+            break;
+        }
+    }
+
+    return HTTP2_NO_ERROR;
+}
+
+void _add_http2_header(void *arg, const char *name, const size_t name_len, const char *value,
+                       const size_t value_len) {
+    http2_header_block *headers = (http2_header_block *)arg;
+    http2_stream *stream = headers->stream;
+    if (stream == NULL || headers->is_malformed)
+        return;
+
+    // Values with line breaks would split the HTTP/1.1 request head, names must be lowercase.
+    bool is_valid = name_len > 0 && memchr(value, '\r', value_len) == NULL &&
+                    memchr(value, '\n', value_len) == NULL && strlen(value) == value_len;
+    for (size_t char_no = name[0] == ':'; is_valid && char_no < name_len; char_no++)
+        is_valid = name[char_no] > ' ' && name[char_no] < 0x7f && name[char_no] != ':' &&
+                   (name[char_no] < 'A' || name[char_no] > 'Z');
+
+    if (is_valid && name[0] == ':') {
+        GString **pseudo = NULL;
+        if (strcmp(name, ":method") == 0)
+            pseudo = &headers->method;
+        else if (strcmp(name, ":path") == 0)
+            pseudo = &headers->path;
+        else if (strcmp(name, ":authority") == 0)
+            pseudo = &headers->authority;
+
+        if (strcmp(name, ":scheme") == 0) {
+            is_valid = !headers->has_scheme && !headers->has_regular;
+            headers->has_scheme = true;
+        } else if ((is_valid = pseudo != NULL && *pseudo == NULL && !headers->has_regular &&
+                               value_len > 0)) {
+            *pseudo = g_string_new_len(value, value_len);
+        }
+        headers->is_malformed = !is_valid;
+        return;
+    }
+
+    headers->has_regular = true;
+    if (!is_valid || _is_http2_hop_header(name, name_len) ||
+        (strcmp(name, "te") == 0 && strcmp(value, "trailers") != 0)) {
+        headers->is_malformed = true;
+        return;
+    }
+
+    // The body is framed by the `DATA` frames, the request gets the `Content-Length` of their sum.
+    if (strcmp(name, "te") == 0 || strcmp(name, "content-length") == 0 ||
+        (strcmp(name, "host") == 0 && headers->authority != NULL))
+        return;
+    if (strcmp(name, "priority") == 0)
+        stream->urgency = _parse_http2_urgency(value, value_len);
+
+    // Headers past the limit are dropped, the request is answered with 431.
+    if (stream->request->len + name_len + value_len + 4 > headers->session->max_head_size) {
+        stream->error_status = 431;
+        return;
+    }
+
+    if (strcmp(name, "cookie") == 0) {
+        if (headers->cookie == NULL)
+            headers->cookie = g_string_new_len(value, value_len);
+        else
+            g_string_append_printf(headers->cookie, "; %s", value);
+        return;
+    }
+
+    g_string_append_len(stream->request, name, name_len);
+    g_string_append_len(stream->request, ": ", 2);
+    g_string_append_len(stream->request, value, value_len);
+    g_string_append_len(stream->request, "\r\n", 2);
+}
+
+int _parse_http2_urgency(const char *value, const size_t len) {
+    for (size_t pos = 0; pos + 3 <= len; pos++) {
+        bool at_start = pos == 0 || value[pos - 1] == ',' || value[pos - 1] == ' ';
+        bool at_end = pos + 3 == len || value[pos + 3] == ',' || value[pos + 3] == ' ' ||
+                      value[pos + 3] == ';';
+        if (at_start && at_end && value[pos] == 'u' && value[pos + 1] == '=' &&
+            value[pos + 2] >= '0' && value[pos + 2] <= '7')
+            return value[pos + 2] - '0';
+    }
+
+    return HTTP2_DEFAULT_URGENCY;
+}
+
+void _complete_http2_request(http2_stream *stream) {
+    size_t body_len = stream->body != NULL && stream->error_status == 0 ? stream->body->len : 0;
+
+    if (stream->body != NULL)
+        g_string_append_printf(stream->request, "content-length: %zu\r\n", body_len);
+    g_string_append_len(stream->request, "\r\n", 2);
+    if (body_len > 0)
+        g_string_append_len(stream->request, stream->body->str, body_len);
+
+    if (stream->body != NULL)
+        g_string_free(stream->body, TRUE);
+    stream->body = NULL;
+    stream->is_ready = true;
+}
+
+http2_stream *_find_http2_stream(const http2_session *session, const uint32_t stream_id) {
+    for (http2_stream *stream = session->streams; stream != NULL; stream = stream->next)
+        if (stream->id == stream_id)
+            return stream;
+
+    return NULL;
+}
+
+http2_stream *_add_http2_stream(http2_session *session, const uint32_t stream_id) {
+    http2_stream *stream = calloc(1, sizeof(http2_stream));
+    if (stream == NULL)
+        return NULL;
+
+    stream->id = stream_id;
+    stream->urgency = HTTP2_DEFAULT_URGENCY;
+    stream->send_window = session->initial_window;
+    stream->recv_window = HTTP2_DEFAULT_WINDOW;
+    stream->remaining = -1;
+    stream->request = g_string_sized_new(512);
+    stream->next = session->streams;
+    session->streams = stream;
+    session->n_streams++;
+    return stream;
+}
+
+void _remove_http2_stream(http2_session *session, http2_stream *stream) {
+    http2_stream **link = &session->streams;
+    while (*link != NULL && *link != stream)
+        link = &(*link)->next;
+    if (*link == NULL)
+        return;
+
+    *link = stream->next;
+    session->n_streams--;
+    if (session->active == stream)
+        session->active = NULL;
+
+    g_string_free(stream->request, TRUE);
+    if (stream->body != NULL)
+        g_string_free(stream->body, TRUE);
+    if (stream->response_head != NULL)
+        g_string_free(stream->response_head, TRUE);
+    for (http2_data *data = stream->pending, *next = NULL; data != NULL; data = next) {
+        next = data->next;
+        if (data->file_fd >= 0)
+            close(data->file_fd);
+        free(data);
+    }
+    free(stream);
+}
+
+void _queue_http2_frame(http2_session *session, const uint8_t type, const uint8_t flags,
+                        const uint32_t stream_id, const void *payload, const size_t len) {
+    const char head[HTTP2_FRAME_HEAD_LEN] = {len >> 16,        len >> 8,         len,
+                                             type,             flags,            stream_id >> 24,
+                                             stream_id >> 16, stream_id >> 8, stream_id};
+    g_string_append_len(session->out, head, sizeof(head));
+    if (len > 0)
+        g_string_append_len(session->out, payload, len);
+}
+
+void _reset_http2_stream(http2_session *session, const uint32_t stream_id,
+                         const http2_error_code error) {
+    const unsigned char payload[4] = {0, 0, 0, error};
+    _queue_http2_frame(session, HTTP2_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+
+    http2_stream *stream = _find_http2_stream(session, stream_id);
+    if (stream != NULL && stream == session->active)
+        stream->is_reset = true;
+    else if (stream != NULL)
+        _remove_http2_stream(session, stream);
+}
+
+int _fail_http2_session(http2_session *session, const http2_error_code error) {
+    if (session->is_broken)
+        return 0;
+
+    const unsigned char payload[8] = {session->last_stream_id >> 24, session->last_stream_id >> 16,
+                                      session->last_stream_id >> 8, session->last_stream_id, 0,
+                                      0, 0, error};
+    _queue_http2_frame(session, HTTP2_GOAWAY, 0, 0, payload, sizeof(payload));
+    session->is_goaway = session->is_broken = true;
+    return 0;
+}
+
+void _queue_http2_window_update(http2_session *session, const uint32_t stream_id,
+                                const uint32_t increment) {
+    const unsigned char payload[4] = {increment >> 24, increment >> 16, increment >> 8, increment};
+    _queue_http2_frame(session, HTTP2_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+int _send_http2_out(http2_session *session) {
+    size_t sent = 0;
+
+    while (sent < session->out->len && !session->is_broken) {
+        ssize_t send_size = send_tls(session->fd, session->out->str + sent,
+                                     session->out->len - sent, MSG_NOSIGNAL);
+        if (send_size < 0 && errno == EINTR)
+            continue;
+        if (send_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (send_size <= 0)
+            session->is_broken = true;
+        else
+            sent += send_size;
+    }
+
+    g_string_erase(session->out, 0, sent);
+    return !session->is_broken;
+}
+
+size_t _next_http2_frame_len(http2_session *session, const http2_stream *stream,
+                             const size_t len) {
+    if (session->out->len >= HTTP2_SEND_BUF_SIZE &&
+        (!_send_http2_out(session) || session->out->len >= HTTP2_SEND_BUF_SIZE))
+        return 0;
+
+    int64_t window = stream->send_window < session->send_window ? stream->send_window
+                                                                : session->send_window;
+    if (window <= 0)
+        return 0;
+
+    size_t frame_len = len < (size_t)window ? len : (size_t)window;
+    return frame_len < session->max_frame_size ? frame_len : session->max_frame_size;
+}
+
+void _queue_http2_data(http2_session *session, http2_stream *stream, const char *buf,
+                       const size_t len) {
+    if (stream->remaining > 0)
+        stream->remaining -= len;
+    stream->is_ended = stream->remaining == 0;
+    _queue_http2_frame(session, HTTP2_DATA, stream->is_ended ? HTTP2_FLAG_END_STREAM : 0,
+                       stream->id, buf, len);
+
+    stream->send_window -= len;
+    session->send_window -= len;
+    session->n_data += len;
+}
+
+int _park_http2_data(http2_stream *stream, const char *buf, const int file_fd, const off_t offset,
+                     const size_t len) {
+    http2_data *data = malloc(sizeof(http2_data) + (buf != NULL ? len : 0));
+    if (data == NULL)
+        return 0;
+
+    // The handler closes its file once the response is sent.
+    data->file_fd = buf != NULL ? -1 : fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+    if (buf == NULL && data->file_fd < 0) {
+        free(data);
+        return 0;
+    }
+    if (buf != NULL)
+        memcpy(data->buf, buf, len);
+    data->offset = offset;
+    data->pos = 0;
+    data->len = len;
+    data->next = NULL;
+
+    if (stream->pending_tail != NULL)
+        stream->pending_tail->next = data;
+    else
+        stream->pending = data;
+    stream->pending_tail = data;
+    stream->pending_len += len;
+    return 1;
+}
+
+int _resume_http2_stream(http2_session *session, http2_stream *stream) {
+    char file_buf[HTTP2_MAX_FRAME_SIZE];
+    http2_data *data = NULL;
+    size_t frame_len = 0;
+    int is_resumed = 0;
+
+    while ((data = stream->pending) != NULL &&
+           (frame_len = _next_http2_frame_len(session, stream, data->len)) > 0) {
+        const char *buf = data->buf + data->pos;
+        if (data->file_fd >= 0) {
+            ssize_t read_size = pread(data->file_fd, file_buf,
+                                      frame_len < sizeof(file_buf) ? frame_len : sizeof(file_buf),
+                                      data->offset);
+            if (read_size <= 0) {
+                _reset_http2_stream(session, stream->id, HTTP2_INTERNAL_ERROR);
+                return 1;
+            }
+            buf = file_buf;
+            frame_len = read_size;
+            data->offset += frame_len;
+        }
+
+        _queue_http2_data(session, stream, buf, frame_len);
+        data->pos += frame_len;
+        data->len -= frame_len;
+        stream->pending_len -= frame_len;
+        is_resumed = 1;
+        if (data->len > 0)
+            continue;
+
+        if ((stream->pending = data->next) == NULL)
+            stream->pending_tail = NULL;
+        if (data->file_fd >= 0)
+            close(data->file_fd);
+        free(data);
+    }
+
+    // A paused stream ends once its handler is done.
+    if (stream->pending != NULL || !stream->is_finished || session->is_broken)
+        return is_resumed;
+    _end_http2_stream(session, stream);
+    return 1;
+}
+
+size_t _send_http2_response_head(http2_session *session, http2_stream *stream, const char *buf,
+                                 const size_t len) {
+    GString *head = stream->response_head;
+    size_t old_len = head->len;
+    g_string_append_len(head, buf, len);
+
+    // The end of the head may be split across sends.
+    const char *end = strstr(head->str + (old_len > 3 ? old_len - 3 : 0), "\r\n\r\n");
+    if (end == NULL)
+        return head->len <= session->max_head_size + HTTP2_MAX_FRAME_SIZE ? len : 0;
+
+    size_t head_len = end + 4 - head->str;
+    g_string_truncate(head, head_len);
+
+    http_parser parser;
+    init_http_response_parser(&parser);
+    if (parse_http_request(&parser, head->str, head->len) != HTTP_PARSE_OK)
+        return 0;
+
+    char status[8];
+    snprintf(status, sizeof(status), "%03d", parser.status);
+    bool is_interim = parser.status < 200;
+    int64_t content_length = -1;
+
+    GString *block = g_string_sized_new(256), *name = g_string_sized_new(64);
+    begin_hpack_block(&session->encoder, block);
+    encode_hpack_header(&session->encoder, block, ":status", 7, status, 3, HPACK_INDEX);
+    for (unsigned int h_no = 0; h_no < parser.n_headers; h_no++) {
+        http_view key = parser.headers[h_no].key, value = parser.headers[h_no].value;
+
+        g_string_truncate(name, 0);
+        for (size_t char_no = 0; char_no < key.len; char_no++) {
+            char c = head->str[key.off + char_no];
+            g_string_append_c(name, c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+        }
+        if (_is_http2_hop_header(name->str, name->len))
+            continue;
+        if (strcmp(name->str, "content-length") == 0)
+            content_length = strtoll(head->str + value.off, NULL, 10);
+
+        encode_hpack_header(&session->encoder, block, name->str, name->len,
+                            head->str + value.off, value.len, _get_http2_indexing(name->str));
+    }
+
+    // Interim responses are followed by the final one, which can end the stream right away.
+    if (!is_interim) {
+        bool has_body = !stream->is_head && parser.status != 204 && parser.status != 304;
+        stream->remaining = has_body ? content_length : 0;
+    }
+    stream->is_ended = !is_interim && stream->remaining == 0;
+    _queue_http2_headers(session, stream->id, block, stream->is_ended);
+
+    g_string_free(block, TRUE);
+    g_string_free(name, TRUE);
+    g_string_truncate(head, 0);
+    if (!is_interim) {
+        g_string_free(head, TRUE);
+        stream->response_head = NULL;
+    }
+    return head_len - old_len;
+}
+
+int _send_http2_response_body(http2_session *session, http2_stream *stream, const char *buf,
+                              const int file_fd, off_t offset, size_t len) {
+    char file_buf[HTTP2_MAX_FRAME_SIZE];
+    size_t frame_len = 0;
+
+    // Bytes past the end of the body are dropped, like HTTP/1.1 would have sent them unframed.
+    int64_t left = stream->remaining - (int64_t)stream->pending_len;
+    if (stream->is_ended)
+        return 1;
+    if (stream->remaining >= 0 && (int64_t)len > left)
+        len = left > 0 ? left : 0;
+
+    // Once some of the body is parked, the rest follows it.
+    while (len > 0 && stream->pending == NULL && !stream->is_reset &&
+           (frame_len = _next_http2_frame_len(session, stream, len)) > 0) {
+        if (buf == NULL) {
+            ssize_t read_size = pread(file_fd, file_buf,
+                                      frame_len < sizeof(file_buf) ? frame_len : sizeof(file_buf),
+                                      offset);
+            if (read_size <= 0) {
+                _reset_http2_stream(session, stream->id, HTTP2_INTERNAL_ERROR);
+                return 0;
+            }
+            frame_len = read_size;
+        }
+
+        _queue_http2_data(session, stream, buf != NULL ? buf : file_buf, frame_len);
+        if (buf != NULL)
+            buf += frame_len;
+        else
+            offset += frame_len;
+        len -= frame_len;
+    }
+
+    if (session->is_broken || stream->is_reset)
+        return 0;
+    if (len > 0 && !_park_http2_data(stream, buf, file_fd, offset, len)) {
+        _reset_http2_stream(session, stream->id, HTTP2_INTERNAL_ERROR);
+        return 0;
+    }
+    return 1;
+}
+
+void _queue_http2_headers(http2_session *session, const uint32_t stream_id, const GString *block,
+                          const bool end_stream) {
+    size_t pos = 0;
+
+    do {
+        size_t frame_len = block->len - pos;
+        frame_len = frame_len < session->max_frame_size ? frame_len : session->max_frame_size;
+        uint8_t flags = (pos + frame_len == block->len ? HTTP2_FLAG_END_HEADERS : 0) |
+                        (pos == 0 && end_stream ? HTTP2_FLAG_END_STREAM : 0);
+        _queue_http2_frame(session, pos == 0 ? HTTP2_HEADERS : HTTP2_CONTINUATION, flags,
+                           stream_id, block->str + pos, frame_len);
+        pos += frame_len;
+    } while (pos < block->len);
+}
+
+hpack_indexing _get_http2_indexing(const char *name) {
+    if (strcmp(name, "set-cookie") == 0)
+        return HPACK_NEVER_INDEX;
+
+    for (int h_no = 0; _http2_indexed_headers[h_no] != NULL; h_no++)
+        if (strcmp(name, _http2_indexed_headers[h_no]) == 0)
+            return HPACK_INDEX;
+
+    return HPACK_NO_INDEX;
+}
+
+bool _is_http2_hop_header(const char *name, const size_t len) {
+    const char *hop_headers[] = {"connection", "keep-alive", "proxy-connection",
+                                 "transfer-encoding", "upgrade"};
+
+    for (size_t h_no = 0; h_no < sizeof(hop_headers) / sizeof(hop_headers[0]); h_no++)
+        if (strlen(hop_headers[h_no]) == len && memcmp(name, hop_headers[h_no], len) == 0)
+            return true;
+
+    return false;
+}
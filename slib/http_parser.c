@@ -0,0 +1,531 @@
+/**
+ * @file slib/http_parser.c
+ * @brief Functions for incrementally parsing HTTP/1.x request and response heads.
+ *
+ * Implements functions defined in `include/http_parser.h`. Used to parse request heads in place,
+ * without allocating memory or modifying the buffer.
+ *
+ * The parser works a line at a time. A line is parsed only once it is complete, therefore a
+ * request head split across several `recv()` calls is parsed as if it arrived at once, and a
+ * partial line is never mistaken for a malformed one.
+ *
+ * The body parser works a byte at a time on the chunk framing and skips over body bytes, which are
+ * returned as views into the buffer instead of being copied out.
+ *
+ * Lines are found with `memchr()`, which the C library already vectorizes. Inside a line, request
+ * targets, header values and reason phrases are checked with `find_http_delimiter()`. Its SIMD
+ * implementations are compiled with `target` attributes, so the library builds without extra flags
+ * and the CPU is only asked at load time which of them it can run.
+ *
+ * @see typedef struct http_parser
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "http_parser.h"
+
+/**
+ * @brief Names of the known headers, indexed by `enum http_known_header`.
+ */
+static const struct {
+    const char *name;
+    size_t len;
+} _http_known_header_names[HTTP_KNOWN_HEADERS] = {
+    [HTTP_HEADER_HOST] = {"Host", 4},
+    [HTTP_HEADER_CONNECTION] = {"Connection", 10},
+    [HTTP_HEADER_ACCEPT_ENCODING] = {"Accept-Encoding", 15},
+    [HTTP_HEADER_IF_NONE_MATCH] = {"If-None-Match", 13},
+    [HTTP_HEADER_IF_MODIFIED_SINCE] = {"If-Modified-Since", 17},
+    [HTTP_HEADER_IF_RANGE] = {"If-Range", 8},
+    [HTTP_HEADER_RANGE] = {"Range", 5},
+    [HTTP_HEADER_CONTENT_LENGTH] = {"Content-Length", 14},
+    [HTTP_HEADER_TRANSFER_ENCODING] = {"Transfer-Encoding", 17},
+    [HTTP_HEADER_UPGRADE] = {"Upgrade", 7},
+    [HTTP_HEADER_REFERER] = {"Referer", 7},
+    [HTTP_HEADER_USER_AGENT] = {"User-Agent", 10},
+};
+
+/**
+ * @brief Token characters (RFC 7230, section 3.2.6), looked up instead of searched for.
+ */
+static const unsigned char _http_token_chars[256] = {
+    ['0' ... '9'] = 1, ['A' ... 'Z'] = 1, ['a' ... 'z'] = 1, ['!'] = 1, ['#'] = 1, ['$'] = 1,
+    ['%'] = 1,         ['&'] = 1,         ['\''] = 1,        ['*'] = 1, ['+'] = 1, ['-'] = 1,
+    ['.'] = 1,         ['^'] = 1,         ['_'] = 1,         ['`'] = 1, ['|'] = 1, ['~'] = 1,
+};
+
+static size_t (*_http_delimiter_scan)(const char *, const size_t,
+                                      const bool) = _find_http_delimiter_scalar;
+static http_scan_isa _http_scan_isa = HTTP_SCAN_SCALAR;
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static size_t
+_find_http_delimiter_sse42(const char *buf, const size_t len, const bool stop_at_space) {
+    // PCMPESTRI matches every byte against up to 8 ranges at once: CTL except HTAB, and DEL.
+    const __m128i ranges = stop_at_space
+                               ? _mm_setr_epi8(0x00, 0x20, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               0, 0, 0)
+                               : _mm_setr_epi8(0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f, 0, 0, 0, 0, 0,
+                                               0, 0, 0, 0, 0);
+    const int ranges_len = stop_at_space ? 4 : 6;
+
+    size_t pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + pos));
+        int idx = _mm_cmpestri(ranges, ranges_len, chunk, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return pos + idx;
+    }
+
+    return pos + _find_http_delimiter_scalar(buf + pos, len - pos, stop_at_space);
+}
+
+__attribute__((target("avx2"))) static size_t
+_find_http_delimiter_avx2(const char *buf, const size_t len, const bool stop_at_space) {
+    const __m256i limit = _mm256_set1_epi8(stop_at_space ? 0x20 : 0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+
+    size_t pos = 0;
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(buf + pos));
+        // There is no unsigned compare, `min(c, limit) == c` is `c <= limit`.
+        __m256i below = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, limit), chunk);
+        if (!stop_at_space)
+            below = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, tab), below);
+        __m256i stop = _mm256_or_si256(below, _mm256_cmpeq_epi8(chunk, del));
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(stop);
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    return pos + _find_http_delimiter_scalar(buf + pos, len - pos, stop_at_space);
+}
+#elif defined(__aarch64__)
+static size_t _find_http_delimiter_neon(const char *buf, const size_t len,
+                                        const bool stop_at_space) {
+    const uint8x16_t limit = vdupq_n_u8(stop_at_space ? 0x20 : 0x1f);
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+
+    size_t pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)(buf + pos));
+        uint8x16_t stop = vcleq_u8(chunk, limit);
+        if (!stop_at_space)
+            stop = vbicq_u8(stop, vceqq_u8(chunk, tab));
+        stop = vorrq_u8(stop, vceqq_u8(chunk, del));
+
+        // NEON has no movemask, narrowing leaves 4 bits per byte in a 64-bit mask.
+        uint64_t mask =
+            vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+        if (mask != 0)
+            return pos + (__builtin_ctzll(mask) >> 2);
+    }
+
+    return pos + _find_http_delimiter_scalar(buf + pos, len - pos, stop_at_space);
+}
+#endif
+
+/**
+ * @brief Chooses the widest scan the CPU supports when the library is loaded.
+ */
+__attribute__((constructor)) static void _init_http_scan_isa() {
+    if (!set_http_scan_isa(HTTP_SCAN_AVX2) && !set_http_scan_isa(HTTP_SCAN_SSE42))
+        set_http_scan_isa(HTTP_SCAN_NEON);
+}
+
+void init_http_parser(http_parser *parser) {
+    parser->state = HTTP_PARSER_REQUEST_LINE;
+    parser->pos = 0;
+    parser->head_len = 0;
+    parser->method = parser->url = parser->version = parser->reason = (http_view){0, 0};
+    parser->status = 0;
+    parser->n_headers = 0;
+    for (int id = 0; id < HTTP_KNOWN_HEADERS; id++)
+        parser->known_headers[id] = -1;
+}
+
+void init_http_response_parser(http_parser *parser) {
+    init_http_parser(parser);
+    parser->state = HTTP_PARSER_STATUS_LINE;
+}
+
+http_parse_result parse_http_request(http_parser *parser, const char *buf, const size_t len) {
+    if (parser->state == HTTP_PARSER_DONE)
+        return HTTP_PARSE_OK;
+    if (parser->state == HTTP_PARSER_FAILED)
+        return HTTP_PARSE_ERROR;
+
+    const char *line_end = NULL;
+    while (parser->pos < len &&
+           (line_end = memchr(buf + parser->pos, '\n', len - parser->pos)) != NULL) {
+        size_t start = parser->pos;
+        size_t end = line_end - buf;
+        parser->pos = end + 1;
+        if (end > start && buf[end - 1] == '\r')
+            end--;
+
+        if (parser->state == HTTP_PARSER_REQUEST_LINE || parser->state == HTTP_PARSER_STATUS_LINE) {
+            // Empty lines before the request line are ignored (RFC 7230, section 3.5).
+            if (end == start && parser->state == HTTP_PARSER_REQUEST_LINE)
+                continue;
+            if (parser->state == HTTP_PARSER_STATUS_LINE
+                    ? !_parse_http_status_line(parser, buf, start, end)
+                    : !_parse_http_request_line(parser, buf, start, end)) {
+                parser->state = HTTP_PARSER_FAILED;
+                return HTTP_PARSE_ERROR;
+            }
+            parser->state = HTTP_PARSER_HEADERS;
+        } else if (end == start) {
+            parser->head_len = parser->pos;
+            parser->state = HTTP_PARSER_DONE;
+            return HTTP_PARSE_OK;
+        } else if (!_parse_http_header_line(parser, buf, start, end)) {
+            parser->state = HTTP_PARSER_FAILED;
+            return HTTP_PARSE_ERROR;
+        }
+    }
+
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+int find_http_header(const http_parser *parser, const char *buf, const char *key,
+                     const unsigned int from) {
+    size_t key_len = strlen(key);
+    for (unsigned int h_no = from; h_no < parser->n_headers; h_no++) {
+        const http_view *header_key = &parser->headers[h_no].key;
+        if (header_key->len == key_len && strncasecmp(buf + header_key->off, key, key_len) == 0)
+            return h_no;
+    }
+
+    return -1;
+}
+
+int find_known_http_header(const http_parser *parser, const http_known_header id) {
+    return id < HTTP_KNOWN_HEADERS ? parser->known_headers[id] : -1;
+}
+
+http_known_header get_http_known_header(const char *key, const size_t key_len) {
+    // Most names are told apart by their length, so few of them are compared.
+    for (int id = 0; id < HTTP_KNOWN_HEADERS; id++) {
+        if (_http_known_header_names[id].len == key_len &&
+            strncasecmp(key, _http_known_header_names[id].name, key_len) == 0)
+            return id;
+    }
+
+    return HTTP_KNOWN_HEADERS;
+}
+
+size_t find_http_delimiter(const char *buf, const size_t len, const bool stop_at_space) {
+    return _http_delimiter_scan(buf, len, stop_at_space);
+}
+
+http_scan_isa get_http_scan_isa() {
+    return _http_scan_isa;
+}
+
+int set_http_scan_isa(const http_scan_isa isa) {
+    size_t (*scan)(const char *, const size_t, const bool) = NULL;
+
+    switch (isa) {
+    case HTTP_SCAN_SCALAR:
+        scan = _find_http_delimiter_scalar;
+        break;
+#if defined(__x86_64__)
+    case HTTP_SCAN_SSE42:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2"))
+            scan = _find_http_delimiter_sse42;
+        break;
+    case HTTP_SCAN_AVX2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            scan = _find_http_delimiter_avx2;
+        break;
+#elif defined(__aarch64__)
+    case HTTP_SCAN_NEON:
+        scan = _find_http_delimiter_neon;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    if (scan == NULL)
+        return 0;
+    _http_delimiter_scan = scan;
+    _http_scan_isa = isa;
+    return 1;
+}
+
+int init_http_body_parser(http_body_parser *body, const http_parser *parser, const char *buf) {
+    *body = (http_body_parser){.state = HTTP_BODY_DONE};
+
+    int te_no = find_known_http_header(parser, HTTP_HEADER_TRANSFER_ENCODING);
+    int cl_no = find_known_http_header(parser, HTTP_HEADER_CONTENT_LENGTH);
+    if (te_no >= 0) {
+        if (cl_no >= 0) {
+            body->state = HTTP_BODY_FAILED;
+            return 0;
+        }
+
+        // Only the last transfer coding frames the body, it must be chunked.
+        int next_no = te_no;
+        while ((next_no = find_http_header(parser, buf, "Transfer-Encoding", next_no + 1)) >= 0)
+            te_no = next_no;
+        const http_view *value = &parser->headers[te_no].value;
+        const char *end = buf + value->off + value->len;
+        if (value->len < 7 || strncasecmp(end - 7, "chunked", 7) != 0 ||
+            (value->len > 7 && strchr(", \t", end[-8]) == NULL)) {
+            body->state = HTTP_BODY_FAILED;
+            return 0;
+        }
+
+        body->chunked = true;
+        body->state = HTTP_BODY_CHUNK_SIZE;
+        return 1;
+    }
+
+    // Repeated Content-Length headers must all have the same value.
+    for (int first_no = cl_no; cl_no >= 0;
+         cl_no = find_http_header(parser, buf, "Content-Length", cl_no + 1)) {
+        const http_view *value = &parser->headers[cl_no].value;
+        uint64_t length = 0;
+        for (size_t pos = value->off; pos < value->off + value->len; pos++) {
+            if (buf[pos] < '0' || buf[pos] > '9' || length > (UINT64_MAX - 9) / 10) {
+                body->state = HTTP_BODY_FAILED;
+                return 0;
+            }
+            length = length * 10 + (buf[pos] - '0');
+        }
+
+        if (value->len == 0 || (cl_no != first_no && body->remaining != length)) {
+            body->state = HTTP_BODY_FAILED;
+            return 0;
+        }
+        body->remaining = length;
+        body->state = length > 0 ? HTTP_BODY_DATA : HTTP_BODY_DONE;
+    }
+
+    return 1;
+}
+
+http_parse_result parse_http_body(http_body_parser *body, const char *buf, const size_t len,
+                                  size_t *consumed, http_view *data) {
+    size_t pos = 0;
+    *data = (http_view){0, 0};
+
+    while (pos < len && body->state != HTTP_BODY_DONE && body->state != HTTP_BODY_FAILED) {
+        if (body->state == HTTP_BODY_DATA) {
+            size_t data_len = len - pos < body->remaining ? len - pos : body->remaining;
+            *data = (http_view){pos, data_len};
+            pos += data_len;
+            body->remaining -= data_len;
+            body->body_len += data_len;
+            if (body->remaining == 0)
+                body->state = body->chunked ? HTTP_BODY_CHUNK_DATA_CR : HTTP_BODY_DONE;
+            break;
+        }
+
+        if (!_parse_http_chunk_byte(body, buf[pos++]))
+            body->state = HTTP_BODY_FAILED;
+    }
+
+    *consumed = pos;
+    if (body->state == HTTP_BODY_FAILED)
+        return HTTP_PARSE_ERROR;
+    return body->state == HTTP_BODY_DONE ? HTTP_PARSE_OK : HTTP_PARSE_INCOMPLETE;
+}
+
+int _parse_http_request_line(http_parser *parser, const char *buf, const size_t start,
+                             const size_t end) {
+    size_t pos = start;
+
+    parser->method.off = pos;
+    while (pos < end && _is_http_token_char(buf[pos]))
+        pos++;
+    parser->method.len = pos - start;
+    if (parser->method.len == 0 || pos == end || buf[pos] != ' ')
+        return 0;
+
+    parser->url.off = ++pos;
+    pos += find_http_delimiter(buf + pos, end - pos, true);
+    parser->url.len = pos - parser->url.off;
+    if (parser->url.len == 0 || pos == end || buf[pos] != ' ')
+        return 0;
+
+    parser->version.off = ++pos;
+    parser->version.len = end - pos;
+    const char *version = buf + pos;
+    return parser->version.len == 8 && strncmp(version, "HTTP/", 5) == 0 && version[5] >= '0' &&
+           version[5] <= '9' && version[6] == '.' && version[7] >= '0' && version[7] <= '9';
+}
+
+int _parse_http_status_line(http_parser *parser, const char *buf, const size_t start,
+                            const size_t end) {
+    const char *line = buf + start;
+    if (end - start < 12 || strncmp(line, "HTTP/", 5) != 0 || line[5] < '0' || line[5] > '9' ||
+        line[6] != '.' || line[7] < '0' || line[7] > '9' || line[8] != ' ')
+        return 0;
+    parser->version = (http_view){start, 8};
+
+    parser->status = 0;
+    for (int d_no = 9; d_no < 12; d_no++) {
+        if (line[d_no] < '0' || line[d_no] > '9')
+            return 0;
+        parser->status = parser->status * 10 + (line[d_no] - '0');
+    }
+    if (parser->status < 100 || (end - start > 12 && line[12] != ' '))
+        return 0;
+
+    // The reason phrase is optional, but the space before it is not always sent.
+    size_t reason_off = end - start > 12 ? start + 13 : end;
+    if (find_http_delimiter(buf + reason_off, end - reason_off, false) != end - reason_off)
+        return 0;
+    parser->reason = (http_view){reason_off, end - reason_off};
+    return 1;
+}
+
+int _parse_http_header_line(http_parser *parser, const char *buf, const size_t start,
+                            const size_t end) {
+    if (parser->n_headers == HTTP_MAX_HEADERS)
+        return 0;
+
+    // Header names can't be empty or contain whitespace, this also rejects folded lines.
+    size_t pos = start;
+    while (pos < end && _is_http_token_char(buf[pos]))
+        pos++;
+    if (pos == start || pos == end || buf[pos] != ':')
+        return 0;
+
+    http_header *header = &parser->headers[parser->n_headers];
+    header->key = (http_view){start, pos - start};
+
+    pos++;
+    while (pos < end && (buf[pos] == ' ' || buf[pos] == '\t'))
+        pos++;
+    size_t value_end = end;
+    while (value_end > pos && (buf[value_end - 1] == ' ' || buf[value_end - 1] == '\t'))
+        value_end--;
+
+    if (find_http_delimiter(buf + pos, value_end - pos, false) != value_end - pos)
+        return 0;
+
+    header->value = (http_view){pos, value_end - pos};
+    http_known_header id = get_http_known_header(buf + start, header->key.len);
+    if (id < HTTP_KNOWN_HEADERS && parser->known_headers[id] < 0)
+        parser->known_headers[id] = parser->n_headers;
+    parser->n_headers++;
+    return 1;
+}
+
+int _is_http_token_char(const unsigned char c) {
+    return _http_token_chars[c];
+}
+
+size_t _find_http_delimiter_scalar(const char *buf, const size_t len, const bool stop_at_space) {
+    const unsigned char limit = stop_at_space ? ' ' : ' ' - 1;
+    for (size_t pos = 0; pos < len; pos++) {
+        unsigned char c = buf[pos];
+        if ((c <= limit && (stop_at_space || c != '\t')) || c == 0x7f)
+            return pos;
+    }
+
+    return len;
+}
+
+int _parse_http_chunk_byte(http_body_parser *body, const char c) {
+    int digit = -1;
+
+    switch (body->state) {
+    case HTTP_BODY_CHUNK_SIZE:
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            digit = (c | 0x20) - 'a' + 10;
+
+        if (digit >= 0) {
+            // Sizes that would overflow are rejected, no client sends a chunk that large.
+            if (body->remaining > (UINT64_MAX >> 4))
+                return 0;
+            body->remaining = (body->remaining << 4) | digit;
+            body->n_digits++;
+            return 1;
+        }
+        if (body->n_digits == 0)
+            return 0;
+        if (c == ';' || c == ' ' || c == '\t') {
+            body->state = HTTP_BODY_CHUNK_EXT;
+            return 1;
+        }
+        if (c == '\r') {
+            body->state = HTTP_BODY_CHUNK_SIZE_LF;
+            return 1;
+        }
+        if (c != '\n')
+            return 0;
+        break;
+    case HTTP_BODY_CHUNK_EXT:
+        if (++body->line_len > HTTP_MAX_CHUNK_LINE)
+            return 0;
+        if (c != '\n')
+            return 1;
+        break;
+    case HTTP_BODY_CHUNK_SIZE_LF:
+        if (c != '\n')
+            return 0;
+        break;
+    case HTTP_BODY_CHUNK_DATA_CR:
+        if (c == '\r')
+            body->state = HTTP_BODY_CHUNK_DATA_LF;
+        else if (c == '\n')
+            body->state = HTTP_BODY_CHUNK_SIZE;
+        else
+            return 0;
+        return 1;
+    case HTTP_BODY_CHUNK_DATA_LF:
+        if (c != '\n')
+            return 0;
+        body->state = HTTP_BODY_CHUNK_SIZE;
+        return 1;
+    case HTTP_BODY_TRAILER:
+        if (c == '\r')
+            body->state = HTTP_BODY_TRAILER_LF;
+        else if (c == '\n')
+            body->state = HTTP_BODY_DONE;
+        else
+            body->state = HTTP_BODY_TRAILER_LINE;
+        return ++body->line_len <= HTTP_MAX_CHUNK_LINE;
+    case HTTP_BODY_TRAILER_LINE:
+        if (c == '\n')
+            body->state = HTTP_BODY_TRAILER;
+        return ++body->line_len <= HTTP_MAX_CHUNK_LINE;
+    case HTTP_BODY_TRAILER_LF:
+        if (c != '\n')
+            return 0;
+        body->state = HTTP_BODY_DONE;
+        return 1;
+    default:
+        return 0;
+    }
+
+    // The chunk size line is complete, the chunk of size 0 is followed by the trailers.
+    body->line_len = 0;
+    body->n_digits = 0;
+    body->state = body->remaining > 0 ? HTTP_BODY_DATA : HTTP_BODY_TRAILER;
+    return 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file slib/listener.c
+ * @brief Functions for creating listening sockets.
+ *
+ * Implements functions defined in `include/listener.h`. Used by the server to create its listening
+ * sockets.
+ *
+ * By default, all the workers accept connections from a shared listening socket per address. With
+ * `SO_REUSEPORT`, every worker gets a socket of its own per address instead, so each socket has its
+ * own accept queue and the kernel balances connections between the workers without any of them
+ * contending for a shared queue.
+ *
+ * @see typedef struct listen_options
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "listener.h"
+
+struct addrinfo *resolve_listen_addresses(const char *host, const int port) {
+    struct addrinfo hints = {0}, *addrs = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+    if (host != NULL && (host[0] == '\0' || strcmp(host, LISTEN_ANY_HOST) == 0))
+        host = NULL;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+
+    int err = 0;
+    if ((err = getaddrinfo(host, service, &hints, &addrs)) != 0) {
+        printf("Unable to resolve listen address %s: %s\n", host != NULL ? host : LISTEN_ANY_HOST,
+               gai_strerror(err));
+        return NULL;
+    }
+
+    return addrs;
+}
+
+bool has_mixed_address_families(const struct addrinfo *addrs) {
+    bool has_v4 = false, has_v6 = false;
+
+    for (const struct addrinfo *addr = addrs; addr != NULL; addr = addr->ai_next) {
+        has_v4 |= addr->ai_family == AF_INET;
+        has_v6 |= addr->ai_family == AF_INET6;
+    }
+
+    return has_v4 && has_v6;
+}
+
+int create_listen_socket(const struct addrinfo *addr, const listen_options *opts) {
+    int listen_fd = -1, on = 1;
+
+    if ((listen_fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                            addr->ai_protocol)) < 0)
+        return -1;
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (opts->reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+
+    if (addr->ai_family == AF_INET6) {
+        int v6_only = opts->v6_only;
+        setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only));
+    }
+
+    // Both options are only optimizations, the socket works without them.
+    if (opts->defer_accept > 0)
+        setsockopt(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opts->defer_accept,
+                   sizeof(opts->defer_accept));
+    if (opts->fastopen > 0)
+        setsockopt(listen_fd, IPPROTO_TCP, TCP_FASTOPEN, &opts->fastopen, sizeof(opts->fastopen));
+
+    if (bind(listen_fd, addr->ai_addr, addr->ai_addrlen) < 0 ||
+        listen(listen_fd, opts->backlog) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+int get_listen_port(const int listen_fd) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+
+    if (getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) < 0)
+        return -1;
+
+    if (addr.ss_family == AF_INET)
+        return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+    if (addr.ss_family == AF_INET6)
+        return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    return -1;
+}
+
+int set_incoming_cpu(const int listen_fd, const int cpu) {
+    return setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+}
+
+int attach_reuseport_cpu_steering(const int listen_fd, const int n_sockets) {
+    if (n_sockets < 1)
+        return 0;
+
+    struct sock_filter code[] = {
+        // A = cpu that received the packet
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+        // A = A % n_sockets
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, n_sockets},
+        // return A
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+
+    return setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
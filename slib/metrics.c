@@ -0,0 +1,318 @@
+/**
+ * @file slib/metrics.c
+ * @brief Functions for the server metrics.
+ *
+ * Implements functions defined in `include/metrics.h`. Used by the workers, the request handler
+ * and the response send functions to record what the server does, and by the `/metrics` endpoint
+ * (see `METRICS_PATH_CONF_KEY`) to expose it.
+ *
+ * A thread claims a shard the first time it records a metric, like the ring buffers of the
+ * access log. Shards are never handed back, so a thread keeps its shard until the metrics are
+ * destroyed.
+ *
+ * @see typedef struct metrics
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+/**
+ * @private
+ * @brief The metrics, `NULL` if they are not created.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Atomic(metrics *) _metrics = NULL;
+
+/**
+ * @private
+ * @brief Incremented every time the metrics are created, so threads claim a new shard.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_ulong _metrics_generation = 0;
+
+/**
+ * @private
+ * @brief Shard claimed by the calling thread.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local metrics_shard *_thread_shard = NULL;
+
+/**
+ * @private
+ * @brief Value of `_metrics_generation` when the calling thread claimed `_thread_shard`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+_Thread_local unsigned long _thread_shard_generation = 0;
+
+/**
+ * @private
+ * @brief Upper bounds (in nanoseconds) of the histogram buckets, from 5 microseconds to 10
+ * seconds.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const long long _metrics_bucket_bounds[METRICS_N_BUCKETS] = {
+    5000,      10000,     25000,     50000,      100000,     250000,     500000,
+    1000000,   2500000,   5000000,   10000000,   25000000,   50000000,   100000000,
+    250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000};
+
+/**
+ * @private
+ * @brief Values of the `le` label of the histogram buckets, `_metrics_bucket_bounds` in seconds.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const char *_metrics_bucket_labels[METRICS_N_BUCKETS] = {
+    "5e-06", "1e-05", "2.5e-05", "5e-05", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005",
+    "0.01",  "0.025", "0.05",    "0.1",   "0.25",   "0.5",     "1",      "2.5",   "5",      "10"};
+
+/**
+ * @private
+ * @brief Status codes counted separately, the ones the server sends.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const int _metrics_statuses[METRICS_N_STATUSES] = {200, 206, 304, 400, 403, 404, 405,
+                                                   413, 416, 431, 500, 502, 503, 504};
+
+/**
+ * @private
+ * @brief Names and help texts of the counters, indexed by `metrics_counter`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const char *_metrics_counter_names[METRICS_N_COUNTERS][2] = {
+    {"nanows_connections_accepted_total", "Connections accepted from the listening sockets."},
+    {"nanows_connections_rejected_total", "Accepted connections refused with 503."},
+    {"nanows_connections_closed_total", "Connections closed after they were served."},
+    {"nanows_sent_bytes_total", "Response bytes (heads and bodies) sent to clients."},
+};
+
+/**
+ * @private
+ * @brief Names and help texts of the stage histograms, indexed by `metrics_stage`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const char *_metrics_stage_names[METRICS_N_STAGES][2] = {
+    {"nanows_accept_to_first_byte_seconds",
+     "Time from accepting a connection to the first byte of its first response."},
+    {"nanows_request_parse_seconds", "Time spent parsing a request head."},
+    {"nanows_file_open_seconds", "Time spent opening a file that isn't cached."},
+    {"nanows_response_send_seconds", "Time spent sending a response."},
+};
+
+int create_metrics(const int n_shards) {
+    if (atomic_load(&_metrics) != NULL)
+        return 2;
+
+    if (n_shards < 1)
+        return 0;
+
+    metrics *m = malloc(sizeof(metrics));
+    if (m == NULL)
+        return 0;
+
+    if ((m->shards = aligned_alloc(alignof(metrics_shard),
+                                   (n_shards + 1) * sizeof(metrics_shard))) == NULL) {
+        free(m);
+        return 0;
+    }
+
+    // All the values are zero, so the shards are initialized like static atomics.
+    memset(m->shards, 0, (n_shards + 1) * sizeof(metrics_shard));
+    m->shards[n_shards].shared = true;
+    m->n_shards = n_shards;
+    atomic_init(&m->next_shard, 0);
+
+    m->generation = atomic_fetch_add(&_metrics_generation, 1) + 1;
+    atomic_store_explicit(&_metrics, m, memory_order_release);
+    return 1;
+}
+
+void destroy_metrics() {
+    metrics *m = atomic_exchange(&_metrics, NULL);
+    if (m == NULL)
+        return;
+
+    free(m->shards);
+    free(m);
+}
+
+bool is_metrics_enabled() {
+    return atomic_load_explicit(&_metrics, memory_order_acquire) != NULL;
+}
+
+void add_metrics_counter(const metrics_counter counter, const uint64_t value) {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return;
+
+    metrics_shard *shard = _get_metrics_shard(m);
+    _add_metrics_value(shard, &shard->counters[counter], value);
+}
+
+void count_metrics_status(const int status) {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return;
+
+    int s_no = 0;
+    while (s_no < METRICS_N_STATUSES && _metrics_statuses[s_no] != status)
+        s_no++;
+
+    metrics_shard *shard = _get_metrics_shard(m);
+    _add_metrics_value(shard, &shard->statuses[s_no], 1);
+}
+
+void observe_metrics_stage(const metrics_stage stage, const long long ns) {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return;
+
+    uint64_t value = ns > 0 ? ns : 0;
+    int b_no = 0;
+    while (b_no < METRICS_N_BUCKETS && (long long)value > _metrics_bucket_bounds[b_no])
+        b_no++;
+
+    metrics_shard *shard = _get_metrics_shard(m);
+    _add_metrics_value(shard, &shard->stages[stage].buckets[b_no], 1);
+    _add_metrics_value(shard, &shard->stages[stage].sum_ns, value);
+}
+
+long long get_metrics_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+long long start_metrics_send() {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return 0;
+
+    metrics_shard *shard = _get_metrics_shard(m);
+    long long now = get_metrics_time();
+    if (!shard->shared)
+        shard->send_start_ns = now;
+    return now;
+}
+
+void end_metrics_send(const long long start) {
+    if (start == 0)
+        return;
+
+    observe_metrics_stage(METRICS_SEND, get_metrics_time() - start);
+}
+
+long long get_metrics_send_start() {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return 0;
+
+    metrics_shard *shard = _get_metrics_shard(m);
+    return shard->shared ? 0 : shard->send_start_ns;
+}
+
+GString *format_metrics() {
+    metrics *m = atomic_load_explicit(&_metrics, memory_order_acquire);
+    if (m == NULL)
+        return NULL;
+
+    GString *buf = g_string_sized_new(8192);
+    uint64_t counters[METRICS_N_COUNTERS];
+    for (int c_no = 0; c_no < METRICS_N_COUNTERS; c_no++) {
+        counters[c_no] = _sum_metrics_value(m, offsetof(metrics_shard, counters[c_no]));
+        g_string_append_printf(buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                               _metrics_counter_names[c_no][0], _metrics_counter_names[c_no][1],
+                               _metrics_counter_names[c_no][0], _metrics_counter_names[c_no][0],
+                               (unsigned long long)counters[c_no]);
+    }
+
+    // The counters are read one after the other, so the difference can be off for a moment.
+    uint64_t closed = counters[METRICS_CONNECTIONS_REJECTED] + counters[METRICS_CONNECTIONS_CLOSED];
+    uint64_t active = counters[METRICS_CONNECTIONS_ACCEPTED] > closed
+                          ? counters[METRICS_CONNECTIONS_ACCEPTED] - closed
+                          : 0;
+    g_string_append_printf(buf,
+                           "# HELP nanows_connections_active Connections currently open.\n"
+                           "# TYPE nanows_connections_active gauge\n"
+                           "nanows_connections_active %llu\n",
+                           (unsigned long long)active);
+
+    g_string_append(buf, "# HELP nanows_requests_total Responses sent, by status code.\n"
+                         "# TYPE nanows_requests_total counter\n");
+    for (int s_no = 0; s_no <= METRICS_N_STATUSES; s_no++) {
+        uint64_t count = _sum_metrics_value(m, offsetof(metrics_shard, statuses[s_no]));
+        if (s_no < METRICS_N_STATUSES)
+            g_string_append_printf(buf, "nanows_requests_total{status=\"%d\"} %llu\n",
+                                   _metrics_statuses[s_no], (unsigned long long)count);
+        else
+            g_string_append_printf(buf, "nanows_requests_total{status=\"other\"} %llu\n",
+                                   (unsigned long long)count);
+    }
+
+    for (int st_no = 0; st_no < METRICS_N_STAGES; st_no++) {
+        const char *name = _metrics_stage_names[st_no][0];
+        g_string_append_printf(buf, "# HELP %s %s\n# TYPE %s histogram\n", name,
+                               _metrics_stage_names[st_no][1], name);
+
+        // Prometheus buckets are cumulative, the shards count every bucket on its own.
+        uint64_t count = 0;
+        for (int b_no = 0; b_no <= METRICS_N_BUCKETS; b_no++) {
+            count += _sum_metrics_value(m, offsetof(metrics_shard, stages[st_no].buckets[b_no]));
+            g_string_append_printf(buf, "%s_bucket{le=\"%s\"} %llu\n", name,
+                                   b_no < METRICS_N_BUCKETS ? _metrics_bucket_labels[b_no]
+                                                            : "+Inf",
+                                   (unsigned long long)count);
+        }
+
+        uint64_t sum_ns = _sum_metrics_value(m, offsetof(metrics_shard, stages[st_no].sum_ns));
+        g_string_append_printf(buf, "%s_sum %.9f\n%s_count %llu\n", name, sum_ns / 1e9, name,
+                               (unsigned long long)count);
+    }
+
+    return buf;
+}
+
+metrics_shard *_get_metrics_shard(metrics *m) {
+    if (_thread_shard_generation != m->generation) {
+        int s_no = atomic_fetch_add(&m->next_shard, 1);
+        _thread_shard = &m->shards[s_no < m->n_shards ? s_no : m->n_shards];
+        _thread_shard_generation = m->generation;
+    }
+
+    return _thread_shard;
+}
+
+void _add_metrics_value(const metrics_shard *shard, atomic_uint_fast64_t *value,
+                        const uint64_t delta) {
+    if (shard->shared) {
+        atomic_fetch_add_explicit(value, delta, memory_order_relaxed);
+        return;
+    }
+
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta,
+                          memory_order_relaxed);
+}
+
+uint64_t _sum_metrics_value(const metrics *m, const size_t offset) {
+    uint64_t sum = 0;
+    for (int s_no = 0; s_no <= m->n_shards; s_no++) {
+        atomic_uint_fast64_t *value = (atomic_uint_fast64_t *)((char *)&m->shards[s_no] + offset);
+        sum += atomic_load_explicit(value, memory_order_relaxed);
+    }
+    return sum;
+}
@@ -5,9 +5,12 @@
  * Implements functions defined in `include/mimetypes.h`. Used to load and retrive MIME types for
  * file types.
  *
- * MIME types in `mimetypes.h` are defined as a hash table. The hash table is loaded from the file
- * defined by `MIME_CONF_FILE` macro (defined in `include/mimetypes/h`). MIME types file can be
- * changed by defining `CONF_FILE` macro before `#include "mimetypes.h"`.
+ * The MIME types of etc/mimetypes.conf are compiled in as a sorted table (`_builtin_mime_types` in
+ * the generated `include/mimetypes_table.h`), which is searched with a case-insensitive binary
+ * search. An override hash table can be loaded at runtime from the file defined by `MIME_CONF_FILE`
+ * macro (defined in `include/mimetypes/h`) or any other file, and replaced while the server runs
+ * with `reload_mime_table_from_file()`. MIME types file can be changed by defining `CONF_FILE`
+ * macro before `#include "mimetypes.h"`.
  *
  * `MIME_CONF_FILE` can be expected to be a file where each line is a key-value pair with the format
  * <file extension starting with '.'>=<mime type>. If the line starts with a '#', it is considered a
@@ -26,87 +29,122 @@
  * @bug No known bugs.
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "helpers.h"
 #include "mimetypes.h"
+#include "mimetypes_table.h"
 
 /**
  * @private
- * @brief Hash table for MIME types.
+ * @brief Hash table for MIME types loaded at runtime, which override the builtin MIME types.
+ *
+ * Keys are lowercase file extensions and values are `mime_type` structures. This is a private
+ * object and should not be accessed directly.
+ */
+_Atomic(GHashTable *) _mime_htab = NULL;
+
+/**
+ * @private
+ * @brief Hash tables replaced by `reload_mime_table_from_file()`, freed by `destroy_mime_table()`.
  *
  * This is a private object and should not be accessed directly.
  */
-GHashTable *_mime_htab = NULL;
+GSList *_retired_mime_htabs = NULL;
 
 int create_mime_table() {
-    if (_mime_htab != NULL)
-        return 2;
-
-    FILE *mime_file = NULL;
-    char *buf = calloc(MIME_BUF_SIZE, sizeof(char));
+    return create_mime_table_from_file(MIME_CONF_FILE);
+}
 
-    if ((_mime_htab = g_hash_table_new_full(g_str_hash, g_str_equal, _mime_htab_key_destroy,
-                                            _mime_htab_value_destroy)) == NULL)
-        return 0;
+int create_mime_table_from_file(const char *mime_file_path) {
+    if (atomic_load(&_mime_htab) != NULL)
+        return 2;
 
-    if ((mime_file = fopen(MIME_CONF_FILE, "r")) == NULL)
+    GHashTable *mime_htab = NULL;
+    if ((mime_htab = _load_mime_table(mime_file_path)) == NULL)
         return 0;
 
-    while (fgets(buf, MIME_BUF_SIZE, mime_file) != NULL) {
-        buf = trim(buf);
-        if (buf[0] == '#')
-            continue;
+    atomic_store_explicit(&_mime_htab, mime_htab, memory_order_release);
+    return 1;
+}
 
-        char *key = strdup(strtok(buf, "="));
-        char *value = strdup(strtok(NULL, "\n"));
-        g_hash_table_insert(_mime_htab, key, value);
-    }
+int reload_mime_table_from_file(const char *mime_file_path) {
+    GHashTable *mime_htab = NULL;
+    if (mime_file_path != NULL && (mime_htab = _load_mime_table(mime_file_path)) == NULL)
+        return 0;
 
-    if (mime_file != NULL)
-        fclose(mime_file);
-    free(buf);
+    // Readers may still use the MIME types of the old table, so it is kept until it is destroyed.
+    GHashTable *old_htab = atomic_exchange(&_mime_htab, mime_htab);
+    if (old_htab != NULL)
+        _retired_mime_htabs = g_slist_prepend(_retired_mime_htabs, old_htab);
     return 1;
 }
 
 void destroy_mime_table() {
-    if (_mime_htab == NULL)
-        return;
+    GHashTable *mime_htab = atomic_exchange(&_mime_htab, NULL);
+    if (mime_htab != NULL)
+        g_hash_table_destroy(mime_htab);
 
-    g_hash_table_destroy(_mime_htab);
-    _mime_htab = NULL;
+    g_slist_free_full(_retired_mime_htabs, (GDestroyNotify)g_hash_table_destroy);
+    _retired_mime_htabs = NULL;
 }
 
 const char *get_mimetype_for_ext(const char *ext, char *mimetype) {
-    // TODO: create errno with message "Mime table not found. Call create_mime_table()"
-    if (_mime_htab == NULL)
-        return NULL;
-
     // TODO: create errno with message "mimetype is NULL."
     // if(mimetype == NULL) return NULL;
 
-    const char *_minetype = NULL;
-    if ((_minetype = g_hash_table_lookup(_mime_htab, ext)) != NULL) {
-        if (mimetype != NULL)
-            strcpy(mimetype, _minetype);
-        return _minetype;
-    }
-
-    if ((_minetype = g_hash_table_lookup(_mime_htab, DEFAULT_MIMETYPE_KEY)) != NULL) {
-        if (mimetype != NULL)
-            strcpy(mimetype, _minetype);
-        return _minetype;
-    }
+    const mime_type *type = NULL;
+    if ((type = _find_mime_type(ext)) == NULL)
+        return NULL;
 
-    return NULL;
+    if (mimetype != NULL)
+        strcpy(mimetype, type->mimetype);
+    return type->mimetype;
 }
 
 const char *get_mimetype_for_url(const char *url, char *mimetype) {
     return get_mimetype_for_ext(_get_ext_for_url(url), mimetype);
-    return NULL;
+}
+
+const char *get_mimetype_header_for_url(const char *url) {
+    const mime_type *type = _find_mime_type(_get_ext_for_url(url));
+    return type != NULL ? type->header : NULL;
+}
+
+GHashTable *_load_mime_table(const char *mime_file_path) {
+    FILE *mime_file = NULL;
+    if ((mime_file = fopen(mime_file_path, "r")) == NULL)
+        return NULL;
+
+    GHashTable *mime_htab = NULL;
+    if ((mime_htab = g_hash_table_new_full(g_str_hash, g_str_equal, _mime_htab_key_destroy,
+                                           _mime_htab_value_destroy)) == NULL) {
+        fclose(mime_file);
+        return NULL;
+    }
+
+    char line[MIME_BUF_SIZE];
+    while (fgets(line, MIME_BUF_SIZE, mime_file) != NULL) {
+        char *buf = trim(line);
+        char *sep = strchr(buf, '=');
+        if (buf[0] == '#' || sep == NULL || sep == buf || sep[1] == '\0')
+            continue;
+        *sep = '\0';
+
+        mime_type *type = malloc(sizeof(mime_type));
+        type->ext = g_ascii_strdown(buf, -1);
+        type->mimetype = strdup(sep + 1);
+        type->header = g_strdup_printf("content-type: %s\r\n", sep + 1);
+        g_hash_table_replace(mime_htab, (char *)type->ext, type);
+    }
+
+    fclose(mime_file);
+    return mime_htab;
 }
 
 char *_get_ext_for_url(const char *url) {
@@ -116,12 +154,55 @@ char *_get_ext_for_url(const char *url) {
     return dot;
 }
 
+const mime_type *_find_mime_type(const char *ext) {
+    const mime_type *type = NULL;
+    GHashTable *mime_htab = atomic_load_explicit(&_mime_htab, memory_order_acquire);
+
+    if (mime_htab != NULL) {
+        char key[MIME_BUF_SIZE];
+        if (ext != NULL && strlen(ext) < sizeof(key)) {
+            for (size_t i = 0; (key[i] = g_ascii_tolower(ext[i])) != '\0'; i++)
+                ;
+            if ((type = g_hash_table_lookup(mime_htab, key)) != NULL)
+                return type;
+        }
+    }
+
+    if (ext != NULL && (type = _find_builtin_mime_type(ext)) != NULL)
+        return type;
+
+    if (mime_htab != NULL && (type = g_hash_table_lookup(mime_htab, DEFAULT_MIMETYPE_KEY)) != NULL)
+        return type;
+
+    return &_builtin_default_mime_type;
+}
+
+const mime_type *_find_builtin_mime_type(const char *ext) {
+    size_t low = 0, high = sizeof(_builtin_mime_types) / sizeof(_builtin_mime_types[0]);
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcasecmp(ext, _builtin_mime_types[mid].ext);
+        if (cmp == 0)
+            return &_builtin_mime_types[mid];
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    return NULL;
+}
+
 void _mime_htab_key_destroy(gpointer data) {
-    free(data);
-    data = NULL;
+    // The key is owned by the value, it is freed by _mime_htab_value_destroy().
 }
 
 void _mime_htab_value_destroy(gpointer data) {
-    free(data);
+    mime_type *type = data;
+    g_free((char *)type->ext);
+    free((char *)type->mimetype);
+    g_free((char *)type->header);
+    free(type);
     data = NULL;
 }
@@ -0,0 +1,252 @@
+/**
+ * @file slib/nanows_uring.c
+ * @brief Functions for a minimal io_uring ring of a worker event loop.
+ *
+ * Implements functions defined in `include/nanows_uring.h`. Used by the workers of the io_uring
+ * backend to accept connections, receive requests and wait for sockets without a system call per
+ * operation.
+ *
+ * The module isn't named `uring`, its object `lib/liburing.so` would be linked as `-luring` and
+ * shadow the system liburing.
+ *
+ * The rings are shared with the kernel: the kernel only reads the submission tail and the
+ * completion head this thread publishes (with release stores), and this thread only reads the
+ * entries the kernel published (with acquire loads).
+ *
+ * @see typedef struct uring
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nanows_uring.h"
+
+uring *create_uring(const unsigned int entries) {
+    struct io_uring_params params = {0};
+    uring *ring = calloc(1, sizeof(uring));
+    if (ring == NULL)
+        return NULL;
+
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+        free(ring);
+        return NULL;
+    }
+
+    unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_FAST_POLL;
+    ring->features = params.features;
+    if ((ring->features & required) != required) {
+        close(ring->fd);
+        free(ring);
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    // With `IORING_FEAT_SINGLE_MMAP` both rings are in the same mapping.
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->rings != MAP_FAILED)
+            munmap(ring->rings, ring->rings_size);
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    char *rings = ring->rings;
+    ring->sq_head = (unsigned int *)(rings + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(rings + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int *)(rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned int *)(rings + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    // Entry `n` of the submission ring always refers to submission entry `n`.
+    unsigned int *array = (unsigned int *)(rings + params.sq_off.array);
+    for (unsigned int e_no = 0; e_no < ring->sq_entries; e_no++)
+        array[e_no] = e_no;
+
+    return ring;
+}
+
+int register_uring_buffers(uring *ring, const unsigned int n_bufs, const unsigned int buf_size) {
+    if (ring->buf_ring != NULL)
+        return 2;
+    if (n_bufs == 0 || (n_bufs & (n_bufs - 1)) != 0 || n_bufs > 32768)
+        return 0;
+
+    // The buffer ring must be page aligned, which an anonymous mapping is.
+    size_t ring_size = n_bufs * sizeof(struct io_uring_buf);
+    struct io_uring_buf_ring *buf_ring =
+        mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring == MAP_FAILED)
+        return 0;
+
+    char *bufs = malloc((size_t)n_bufs * buf_size);
+    struct io_uring_buf_reg reg = {.ring_addr = (uint64_t)(uintptr_t)buf_ring,
+                                   .ring_entries = n_bufs,
+                                   .bgid = URING_BUF_GROUP};
+    if (bufs == NULL ||
+        syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        free(bufs);
+        munmap(buf_ring, ring_size);
+        return 0;
+    }
+
+    ring->buf_ring = buf_ring;
+    ring->bufs = bufs;
+    ring->n_bufs = n_bufs;
+    ring->buf_size = buf_size;
+    ring->buf_tail = 0;
+    for (unsigned int bid = 0; bid < n_bufs; bid++)
+        recycle_uring_buffer(ring, bid);
+
+    return 1;
+}
+
+struct io_uring_sqe *get_uring_sqe(uring *ring) {
+    if (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries &&
+        (submit_uring(ring, 0, 0) < 0 ||
+         ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries))
+        return NULL;
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail++ & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int queue_uring_accept(uring *ring, const int fd, const int flags, const uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_uring_sqe(ring);
+    if (sqe == NULL)
+        return 0;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = flags;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    return 1;
+}
+
+int queue_uring_recv(uring *ring, const int fd, const uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_uring_sqe(ring);
+    if (sqe == NULL)
+        return 0;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = ring->buf_size;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+    return 1;
+}
+
+int queue_uring_poll(uring *ring, const int fd, const unsigned int events,
+                     const uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_uring_sqe(ring);
+    if (sqe == NULL)
+        return 0;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return 1;
+}
+
+int queue_uring_cancel(uring *ring, const uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_uring_sqe(ring);
+    if (sqe == NULL)
+        return 0;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = 0;
+    return 1;
+}
+
+int submit_uring(uring *ring, const unsigned int wait_nr, const int timeout) {
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    // Entries the kernel didn't consume in an earlier call are submitted again.
+    unsigned int to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts = {.tv_sec = timeout / 1000, .tv_nsec = timeout % 1000 * 1000000};
+    struct io_uring_getevents_arg arg = {.sigmask_sz = _NSIG / 8};
+    if (wait_nr > 0 && timeout >= 0) {
+        flags |= IORING_ENTER_EXT_ARG;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    int submitted = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, flags,
+                            (flags & IORING_ENTER_EXT_ARG) ? (void *)&arg : NULL,
+                            (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : _NSIG / 8);
+    if (submitted < 0 && errno == ETIME)
+        return to_submit;
+    return submitted;
+}
+
+struct io_uring_cqe *peek_uring_cqe(uring *ring) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void advance_uring_cq(uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+char *get_uring_buffer(const uring *ring, const unsigned int flags, unsigned int *bid) {
+    if (!(flags & IORING_CQE_F_BUFFER) || ring->bufs == NULL)
+        return NULL;
+
+    *bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    return ring->bufs + (size_t)*bid * ring->buf_size;
+}
+
+void recycle_uring_buffer(uring *ring, const unsigned int bid) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->n_bufs - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * ring->buf_size);
+    buf->len = ring->buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&ring->buf_ring->tail, ++ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+void destroy_uring(uring *ring) {
+    if (ring == NULL)
+        return;
+
+    // Closing the instance cancels the operations still in flight.
+    close(ring->fd);
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->rings, ring->rings_size);
+    if (ring->buf_ring != NULL)
+        munmap(ring->buf_ring, ring->n_bufs * sizeof(struct io_uring_buf));
+    free(ring->bufs);
+    free(ring);
+}
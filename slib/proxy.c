@@ -0,0 +1,993 @@
+/**
+ * @file slib/proxy.c
+ * @brief Functions for proxying requests to upstream HTTP backends.
+ *
+ * Implements functions defined in `include/proxy.h`. Used by the request handler to forward the
+ * requests of the proxied URL prefixes to their backends and to relay the responses back, as far
+ * as the sockets allow without blocking the worker.
+ *
+ * @see typedef struct proxy_conn
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "proxy.h"
+
+/**
+ * @private
+ * @brief Whether the proxy is set up.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+bool _proxy_enabled = false;
+
+/**
+ * @private
+ * @brief The routes, in the order they were configured.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+proxy_route *_proxy_routes = NULL;
+
+/**
+ * @private
+ * @brief Number of routes in `_proxy_routes`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+unsigned int _proxy_n_routes = 0;
+
+/**
+ * @private
+ * @brief The backends of all the routes, every backend is listed once.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+proxy_backend **_proxy_backends = NULL;
+
+/**
+ * @private
+ * @brief Number of backends in `_proxy_backends`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+unsigned int _proxy_n_backends = 0;
+
+/**
+ * @private
+ * @brief Settings of the proxy, set by `create_proxy()`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+proxy_balance _proxy_balance = PROXY_ROUND_ROBIN;
+int _proxy_pool_size = 0;
+int _proxy_health_interval = 0;
+int _proxy_timeout = 0;
+
+/**
+ * @private
+ * @brief The health check thread, running if `_proxy_health_running` is `true`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+pthread_t _proxy_health_thread;
+bool _proxy_health_running = false;
+
+/**
+ * @private
+ * @brief Set by `destroy_proxy()` to stop the health check thread, protected by
+ * `_proxy_health_lock` and signalled with `_proxy_health_cond`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+bool _proxy_stopping = false;
+pthread_mutex_t _proxy_health_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t _proxy_health_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @private
+ * @brief Key of the pipe every thread splices the response bodies through.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+pthread_key_t _proxy_pipe_key;
+
+int create_proxy(const char *routes, const char *balance, const int pool_size,
+                 const int health_interval, const int timeout) {
+    if (_proxy_enabled)
+        return 2;
+
+    if (pthread_key_create(&_proxy_pipe_key, _free_proxy_pipe) != 0)
+        return 0;
+
+    _proxy_balance = strcmp(balance, "least_conn") == 0 ? PROXY_LEAST_CONN : PROXY_ROUND_ROBIN;
+    _proxy_pool_size = pool_size > 0 ? pool_size : 0;
+    _proxy_health_interval = health_interval > 0 ? health_interval : 0;
+    _proxy_timeout = timeout > 0 ? timeout : 1;
+    _proxy_stopping = false;
+    _proxy_enabled = true;
+
+    // On failure, destroy_proxy() frees the routes parsed so far.
+    char *routes_copy = strdup(routes), *save_ptr = NULL;
+    int parsed = routes_copy != NULL;
+    for (char *route = parsed ? strtok_r(routes_copy, ";", &save_ptr) : NULL;
+         route != NULL && parsed; route = strtok_r(NULL, ";", &save_ptr))
+        parsed = _parse_proxy_route(route);
+    free(routes_copy);
+
+    if (parsed && _proxy_health_interval > 0 && _proxy_n_backends > 0) {
+        if (pthread_create(&_proxy_health_thread, NULL, _check_proxy_backends, NULL) == 0)
+            _proxy_health_running = true;
+        else
+            parsed = 0;
+    }
+
+    if (!parsed) {
+        destroy_proxy();
+        return 0;
+    }
+    return 1;
+}
+
+void destroy_proxy() {
+    if (!_proxy_enabled)
+        return;
+
+    if (_proxy_health_running) {
+        pthread_mutex_lock(&_proxy_health_lock);
+        _proxy_stopping = true;
+        pthread_cond_signal(&_proxy_health_cond);
+        pthread_mutex_unlock(&_proxy_health_lock);
+        pthread_join(_proxy_health_thread, NULL);
+        _proxy_health_running = false;
+    }
+
+    for (unsigned int r_no = 0; r_no < _proxy_n_routes; r_no++) {
+        free(_proxy_routes[r_no].prefix);
+        free(_proxy_routes[r_no].backends);
+    }
+    free(_proxy_routes);
+    _proxy_routes = NULL;
+    _proxy_n_routes = 0;
+
+    for (unsigned int b_no = 0; b_no < _proxy_n_backends; b_no++) {
+        proxy_backend *backend = _proxy_backends[b_no];
+        for (int fd_no = 0; fd_no < backend->n_idle; fd_no++)
+            close(backend->idle_fds[fd_no]);
+        freeaddrinfo(backend->addrs);
+        pthread_mutex_destroy(&backend->lock);
+        free(backend->idle_fds);
+        free(backend->name);
+        free(backend);
+    }
+    free(_proxy_backends);
+    _proxy_backends = NULL;
+    _proxy_n_backends = 0;
+
+    // The workers already exited, their pipes were closed with them.
+    pthread_key_delete(_proxy_pipe_key);
+    _proxy_enabled = false;
+}
+
+proxy_route *find_proxy_route(const char *url) {
+    if (!_proxy_enabled)
+        return NULL;
+
+    proxy_route *found = NULL;
+    for (unsigned int r_no = 0; r_no < _proxy_n_routes; r_no++) {
+        proxy_route *route = &_proxy_routes[r_no];
+        if (strncmp(url, route->prefix, route->prefix_len) == 0 &&
+            (found == NULL || route->prefix_len > found->prefix_len))
+            found = route;
+    }
+
+    return found;
+}
+
+proxy_conn *open_proxy_request(proxy_route *route, connection *conn, request *req,
+                               const uint64_t max_body_size, int *status) {
+    // Content-Length bodies over the limit are refused before a backend is bothered.
+    if (conn->body.state != HTTP_BODY_DONE && !conn->body.chunked &&
+        conn->body.remaining > max_body_size) {
+        *status = 413;
+        return NULL;
+    }
+
+    proxy_conn *upstream = arena_alloc(conn->arena, sizeof(proxy_conn));
+    if (upstream == NULL) {
+        *status = 500;
+        return NULL;
+    }
+
+    // The buffer is left as it is, only its received part is ever read.
+    memset(upstream, 0, offsetof(proxy_conn, buf));
+    upstream->fd = -1;
+    upstream->route = route;
+    upstream->conn = conn;
+    upstream->req = req;
+    upstream->max_body_size = max_body_size;
+    upstream->has_request_body = conn->body.state != HTTP_BODY_DONE;
+    upstream->is_body_read = !upstream->has_request_body;
+    upstream->out = g_string_sized_new(REQ_BUF_SIZE);
+    upstream->next_state = CONN_CLOSING;
+
+    *status = 502;
+    if (!_open_proxy_backend(upstream)) {
+        close_proxy_conn(upstream);
+        return NULL;
+    }
+    return upstream;
+}
+
+int forward_proxy_request(proxy_conn *upstream, int *status) {
+    int result = 1;
+
+    while (result == 1 && upstream->state < PROXY_RELAYING) {
+        proxy_state state = upstream->state;
+        *status = 502;
+        if (state == PROXY_CONNECTING) {
+            if ((result = _check_proxy_connect(upstream->backend, upstream->fd)) == 1) {
+                int nodelay = 1;
+                setsockopt(upstream->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                upstream->expires_at = _connection_now() + _proxy_timeout;
+                upstream->state = PROXY_SENDING;
+            } else if (result == 2) {
+                result = _wait_proxy(upstream, false, POLLOUT);
+            }
+        } else if (state == PROXY_SENDING) {
+            result = _send_proxy_request(upstream, status);
+        } else {
+            result = _read_proxy_response_head(upstream);
+        }
+
+        // A backend that doesn't make progress in time is given up on.
+        if (result == 2 && !upstream->waits_client && upstream->is_timed_out) {
+            *status = 504;
+            result = 0;
+        }
+        if (result != 0)
+            continue;
+
+        // A backend that can't be connected to is skipped until a health check reaches it again,
+        // the next one is tried. A pooled connection the backend closed in the meantime is
+        // retried, unless the request body is already gone.
+        bool retry = state == PROXY_CONNECTING ||
+                     (upstream->is_reused && !upstream->has_request_body &&
+                      upstream->recv_len == 0 && *status == 502);
+        if (state == PROXY_CONNECTING && _proxy_health_interval > 0 &&
+            atomic_exchange(&upstream->backend->is_healthy, false))
+            printf("Upstream %s is down\n", upstream->backend->name);
+        upstream->keep_alive = false;
+        _close_proxy_backend(upstream);
+        if (retry && _open_proxy_backend(upstream))
+            result = 1;
+    }
+
+    return result;
+}
+
+int relay_proxy_response(proxy_conn *upstream) {
+    if (upstream->state == PROXY_DONE)
+        return 1;
+    if (!upstream->is_head_sent && !_send_proxy_response_head(upstream)) {
+        upstream->state = PROXY_DONE;
+        return 0;
+    }
+
+    int result = 1;
+    if (upstream->has_body)
+        result = upstream->body.chunked ? _relay_proxy_chunks(upstream)
+                                        : _splice_proxy_body(upstream);
+    if (result == 2 && !upstream->waits_client && upstream->is_timed_out)
+        result = 0;
+    if (result == 2)
+        return 2;
+
+    if (result == 0)
+        upstream->is_complete = false;
+    end_metrics_send(upstream->send_start);
+    upstream->state = PROXY_DONE;
+    return result;
+}
+
+void close_proxy_conn(proxy_conn *upstream) {
+    if (upstream == NULL)
+        return;
+
+    _close_proxy_backend(upstream);
+    if (upstream->out != NULL) {
+        g_string_free(upstream->out, TRUE);
+        upstream->out = NULL;
+    }
+    if (upstream->pipe_fds != NULL)
+        _put_proxy_pipe(upstream);
+    if (upstream->res != NULL) {
+        close_response(upstream->res);
+        upstream->res = NULL;
+    }
+}
+
+int _parse_proxy_route(char *route) {
+    char *backends = strchr(route, '='), *save_ptr = NULL;
+    if (route[0] != '/' || backends == NULL)
+        return 0;
+    *backends++ = '\0';
+
+    proxy_route *routes = realloc(_proxy_routes, (_proxy_n_routes + 1) * sizeof(proxy_route));
+    if (routes == NULL)
+        return 0;
+    _proxy_routes = routes;
+
+    proxy_route *new_route = &_proxy_routes[_proxy_n_routes];
+    memset(new_route, 0, sizeof(proxy_route));
+    atomic_init(&new_route->next_backend, 0);
+    if ((new_route->prefix = strdup(route)) == NULL)
+        return 0;
+    new_route->prefix_len = strlen(new_route->prefix);
+    _proxy_n_routes++;
+
+    for (char *name = strtok_r(backends, ",", &save_ptr); name != NULL;
+         name = strtok_r(NULL, ",", &save_ptr)) {
+        proxy_backend *backend = _get_proxy_backend(name + strspn(name, " \t"));
+        proxy_backend **route_backends =
+            backend != NULL ? realloc(new_route->backends,
+                                      (new_route->n_backends + 1) * sizeof(proxy_backend *))
+                            : NULL;
+        if (route_backends == NULL)
+            return 0;
+
+        new_route->backends = route_backends;
+        new_route->backends[new_route->n_backends++] = backend;
+    }
+
+    return new_route->n_backends > 0;
+}
+
+proxy_backend *_get_proxy_backend(const char *name) {
+    for (unsigned int b_no = 0; b_no < _proxy_n_backends; b_no++)
+        if (strcmp(_proxy_backends[b_no]->name, name) == 0)
+            return _proxy_backends[b_no];
+
+    // IPv6 addresses are enclosed in [], e.g. [::1]:9000.
+    const char *port = strrchr(name, ':'), *host_start = name;
+    if (port == NULL || port == name || port[1] == '\0')
+        return NULL;
+    size_t host_len = port - name;
+    if (name[0] == '[') {
+        if (host_len < 3 || port[-1] != ']')
+            return NULL;
+        host_start++;
+        host_len -= 2;
+    }
+
+    char host[NI_MAXHOST];
+    if (host_len >= sizeof(host))
+        return NULL;
+    memcpy(host, host_start, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM}, *addrs = NULL;
+    int error = getaddrinfo(host, port + 1, &hints, &addrs);
+    if (error != 0) {
+        printf("Unable to resolve upstream %s: %s\n", name, gai_strerror(error));
+        return NULL;
+    }
+
+    proxy_backend *backend = calloc(1, sizeof(proxy_backend));
+    proxy_backend **backends =
+        realloc(_proxy_backends, (_proxy_n_backends + 1) * sizeof(proxy_backend *));
+    if (backends != NULL)
+        _proxy_backends = backends;
+    if (backend == NULL || backends == NULL || (backend->name = strdup(name)) == NULL ||
+        (backend->idle_fds = malloc((_proxy_pool_size + 1) * sizeof(int))) == NULL) {
+        if (backend != NULL)
+            free(backend->name);
+        free(backend);
+        freeaddrinfo(addrs);
+        return NULL;
+    }
+
+    backend->addrs = addrs;
+    atomic_init(&backend->n_active, 0);
+    atomic_init(&backend->is_healthy, true);
+    pthread_mutex_init(&backend->lock, NULL);
+    _proxy_backends[_proxy_n_backends++] = backend;
+    return backend;
+}
+
+proxy_backend *_pick_proxy_backend(proxy_route *route) {
+    unsigned int start =
+        atomic_fetch_add_explicit(&route->next_backend, 1, memory_order_relaxed);
+
+    // The search starts after the backend picked last, so least_conn ties take turns as well.
+    proxy_backend *picked = NULL;
+    for (unsigned int b_no = 0; b_no < route->n_backends; b_no++) {
+        proxy_backend *backend = route->backends[(start + b_no) % route->n_backends];
+        if (!atomic_load_explicit(&backend->is_healthy, memory_order_relaxed))
+            continue;
+        if (_proxy_balance == PROXY_ROUND_ROBIN)
+            return backend;
+        if (picked == NULL ||
+            atomic_load_explicit(&backend->n_active, memory_order_relaxed) <
+                atomic_load_explicit(&picked->n_active, memory_order_relaxed))
+            picked = backend;
+    }
+
+    return picked;
+}
+
+int _take_proxy_conn(proxy_backend *backend) {
+    int fd = -1;
+    char byte;
+
+    pthread_mutex_lock(&backend->lock);
+    while (fd < 0 && backend->n_idle > 0) {
+        fd = backend->idle_fds[--backend->n_idle];
+
+        // An idle connection has nothing to read, unless the backend closed it.
+        if (recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+            (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&backend->lock);
+
+    return fd;
+}
+
+int _connect_proxy_backend(proxy_backend *backend) {
+    const struct addrinfo *addr = backend->addrs;
+    int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    addr->ai_protocol);
+    if (fd < 0)
+        return -1;
+
+    // The connection is established in the background, `_check_proxy_connect()` tells when.
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) != 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int _check_proxy_connect(proxy_backend *backend, const int fd) {
+    // Connecting again returns the outcome of the connection in progress.
+    const struct addrinfo *addr = backend->addrs;
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0 || errno == EISCONN)
+        return 1;
+    return errno == EALREADY || errno == EINPROGRESS ? 2 : 0;
+}
+
+int _open_proxy_backend(proxy_conn *upstream) {
+    proxy_route *route = upstream->route;
+
+    while (upstream->n_attempts++ <= route->n_backends) {
+        proxy_backend *backend = _pick_proxy_backend(route);
+        if (backend == NULL)
+            return 0;
+
+        upstream->is_reused = (upstream->fd = _take_proxy_conn(backend)) >= 0;
+        if (!upstream->is_reused && (upstream->fd = _connect_proxy_backend(backend)) < 0) {
+            if (_proxy_health_interval > 0 && atomic_exchange(&backend->is_healthy, false))
+                printf("Upstream %s is down\n", backend->name);
+            continue;
+        }
+        atomic_fetch_add_explicit(&backend->n_active, 1, memory_order_relaxed);
+
+        upstream->backend = backend;
+        upstream->state = upstream->is_reused ? PROXY_SENDING : PROXY_CONNECTING;
+        upstream->waits_client = upstream->is_timed_out = false;
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+        upstream->keep_alive = upstream->has_body = upstream->until_close = false;
+        upstream->dechunk = upstream->is_complete = false;
+        upstream->recv_len = 0;
+        init_http_response_parser(&upstream->parser);
+        g_string_truncate(upstream->out, 0);
+        _queue_proxy_request_head(upstream);
+        return 1;
+    }
+
+    return 0;
+}
+
+void _close_proxy_backend(proxy_conn *upstream) {
+    if (upstream->fd < 0)
+        return;
+
+    proxy_backend *backend = upstream->backend;
+    atomic_fetch_sub_explicit(&backend->n_active, 1, memory_order_relaxed);
+
+    bool is_pooled = false;
+    if (upstream->keep_alive && upstream->is_complete) {
+        pthread_mutex_lock(&backend->lock);
+        if (backend->n_idle < _proxy_pool_size) {
+            backend->idle_fds[backend->n_idle++] = upstream->fd;
+            is_pooled = true;
+        }
+        pthread_mutex_unlock(&backend->lock);
+    }
+
+    if (!is_pooled)
+        close(upstream->fd);
+    upstream->fd = -1;
+}
+
+void _queue_proxy_request_head(proxy_conn *upstream) {
+    const connection *conn = upstream->conn;
+    const request *req = upstream->req;
+    char addr[INET6_ADDRSTRLEN] = "";
+    if (conn->peer_addr.ss_family == AF_INET)
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)&conn->peer_addr)->sin_addr, addr,
+                  sizeof(addr));
+    else if (conn->peer_addr.ss_family == AF_INET6)
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)&conn->peer_addr)->sin6_addr, addr,
+                  sizeof(addr));
+
+    // The body is framed again, so the framing headers of the client are not forwarded.
+    const char *forwarded_for = NULL;
+    GString *head = upstream->out;
+    g_string_append_printf(head, "%s %s HTTP/1.1\r\n", req->http_method, req->url);
+    for (unsigned int h_no = 0; h_no < req->n_headers; h_no++) {
+        const request_header *header = &req->headers[h_no];
+        if (strcasecmp(header->key, "X-Forwarded-For") == 0 && forwarded_for == NULL)
+            forwarded_for = header->value;
+        if (_is_hop_by_hop_header(header->key, strlen(header->key)) ||
+            strcasecmp(header->key, "Content-Length") == 0 ||
+            strcasecmp(header->key, "Transfer-Encoding") == 0 ||
+            strcasecmp(header->key, "X-Forwarded-For") == 0 ||
+            strcasecmp(header->key, "X-Forwarded-Proto") == 0 ||
+            _is_proxy_connection_option(req, header->key))
+            continue;
+        g_string_append_printf(head, "%s: %s\r\n", header->key, header->value);
+    }
+    g_string_append_printf(head, "x-forwarded-for: %s%s%s\r\nx-forwarded-proto: %s\r\n",
+                           forwarded_for != NULL ? forwarded_for : "",
+                           forwarded_for != NULL ? ", " : "", addr,
+                           has_tls_session(conn->fd) ? "https" : "http");
+
+    if (upstream->has_request_body && conn->body.chunked)
+        g_string_append(head, "transfer-encoding: chunked\r\n");
+    else if (upstream->has_request_body)
+        g_string_append_printf(head, "content-length: %llu\r\n",
+                               (unsigned long long)(conn->body.body_len + conn->body.remaining));
+    g_string_append(head, "connection: keep-alive\r\n\r\n");
+}
+
+int _send_proxy_request(proxy_conn *upstream, int *status) {
+    connection *conn = upstream->conn;
+    bool is_chunked = upstream->has_request_body && conn->body.chunked;
+
+    for (;;) {
+        // The body parts already received leave with the bytes before them, the body is read
+        // again once the backend took them.
+        bool waits_body = false;
+        while (!upstream->is_body_read && upstream->out->len < PROXY_BUF_SIZE) {
+            const char *data = NULL;
+            ssize_t data_len = read_connection_body(conn, &data);
+            if (data_len < 0 && errno == EAGAIN) {
+                waits_body = true;
+                break;
+            }
+            if (data_len < 0) {
+                *status = 400;
+                return 0;
+            }
+            if (data_len == 0) {
+                upstream->is_body_read = true;
+                if (is_chunked)
+                    g_string_append_len(upstream->out, "0\r\n\r\n", 5);
+                break;
+            }
+            if ((upstream->body_len += data_len) > upstream->max_body_size) {
+                *status = 413;
+                return 0;
+            }
+
+            if (is_chunked)
+                g_string_append_printf(upstream->out, "%zx\r\n", (size_t)data_len);
+            g_string_append_len(upstream->out, data, data_len);
+            if (is_chunked)
+                g_string_append_len(upstream->out, "\r\n", 2);
+        }
+
+        int result = _send_proxy_out(upstream);
+        if (result != 1)
+            return result == 2 ? _wait_proxy(upstream, false, POLLOUT) : 0;
+        if (upstream->is_body_read) {
+            upstream->state = PROXY_RECEIVING;
+            return 1;
+        }
+        if (waits_body)
+            return _wait_proxy(upstream, true, POLLIN);
+    }
+}
+
+int _send_proxy_out(proxy_conn *upstream) {
+    while (upstream->out->len > 0) {
+        ssize_t send_size =
+            send(upstream->fd, upstream->out->str, upstream->out->len, MSG_NOSIGNAL);
+        if (send_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 2;
+        if (send_size <= 0)
+            return 0;
+        g_string_erase(upstream->out, 0, send_size);
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+    }
+
+    return 1;
+}
+
+int _read_proxy_response_head(proxy_conn *upstream) {
+    const request *req = upstream->req;
+    http_parser *parser = &upstream->parser;
+
+    for (;;) {
+        http_parse_result result = parse_http_request(parser, upstream->buf, upstream->recv_len);
+        if (result == HTTP_PARSE_ERROR)
+            return 0;
+
+        if (result == HTTP_PARSE_OK) {
+            if (parser->status >= 200)
+                break;
+            // Upgrades are not forwarded, interim responses are dropped before the final one.
+            if (parser->status == 101)
+                return 0;
+            upstream->recv_len -= parser->head_len;
+            memmove(upstream->buf, upstream->buf + parser->head_len, upstream->recv_len);
+            init_http_response_parser(parser);
+            continue;
+        }
+
+        if (upstream->recv_len == sizeof(upstream->buf))
+            return 0;
+        ssize_t recv_size = recv(upstream->fd, upstream->buf + upstream->recv_len,
+                                 sizeof(upstream->buf) - upstream->recv_len, 0);
+        if (recv_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return _wait_proxy(upstream, false, POLLIN);
+        if (recv_size <= 0)
+            return 0;
+        upstream->recv_len += recv_size;
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+    }
+
+    upstream->state = PROXY_RELAYING;
+    upstream->keep_alive = strncmp(upstream->buf + parser->version.off, "HTTP/1.1", 8) == 0
+                               ? !_has_proxy_header_token(upstream, "Connection", "close", 5)
+                               : _has_proxy_header_token(upstream, "Connection", "keep-alive", 10);
+    upstream->has_body =
+        strcmp(req->http_method, "HEAD") != 0 && parser->status != 204 && parser->status != 304;
+    if (!upstream->has_body) {
+        upstream->body = (http_body_parser){.state = HTTP_BODY_DONE};
+        return 1;
+    }
+    if (!init_http_body_parser(&upstream->body, parser, upstream->buf))
+        return 0;
+
+    // Without framing headers, the body ends when the backend closes the connection.
+    if (!upstream->body.chunked &&
+        find_known_http_header(parser, HTTP_HEADER_CONTENT_LENGTH) < 0) {
+        upstream->until_close = true;
+        upstream->keep_alive = false;
+    }
+
+    // An upgraded HTTP/2 stream keeps the version of its HTTP/1.1 request line, so the client
+    // connection decides.
+    upstream->dechunk = upstream->body.chunked && (upstream->conn->http2 != NULL ||
+                                                   strcmp(req->http_ver, "HTTP/1.1") != 0);
+    return 1;
+}
+
+int _send_proxy_response_head(proxy_conn *upstream) {
+    const http_parser *parser = &upstream->parser;
+    const response *res = upstream->res;
+    GString *head = g_string_sized_new(RES_HEADER_BUF_SIZE);
+    g_string_append_printf(head, "%s %s\r\n", res->http_ver, res->status_code);
+    for (unsigned int h_no = 0; h_no < parser->n_headers; h_no++) {
+        const http_header *header = &parser->headers[h_no];
+        const char *key = upstream->buf + header->key.off;
+        bool is_length = header->key.len == 14 && strncasecmp(key, "Content-Length", 14) == 0;
+        bool is_encoding = header->key.len == 17 && strncasecmp(key, "Transfer-Encoding", 17) == 0;
+
+        // The framing headers describe the relayed body, even if the backend names them.
+        if (_is_hop_by_hop_header(key, header->key.len) || (upstream->dechunk && is_encoding) ||
+            (!is_length && !is_encoding &&
+             _has_proxy_header_token(upstream, "Connection", key, header->key.len)))
+            continue;
+
+        g_string_append_len(head, key, header->key.len);
+        g_string_append_len(head, ": ", 2);
+        g_string_append_len(head, upstream->buf + header->value.off, header->value.len);
+        g_string_append_len(head, "\r\n", 2);
+    }
+    serialize_response_headers(res, head);
+    g_string_append_len(head, "\r\n", 2);
+
+    // Body bytes received with the head leave with it, at most the length of the body.
+    size_t pos = parser->head_len, head_body = 0;
+    if (upstream->has_body && !upstream->body.chunked) {
+        head_body = upstream->recv_len - pos;
+        if (!upstream->until_close && head_body > upstream->body.remaining)
+            head_body = upstream->body.remaining;
+        g_string_append_len(head, upstream->buf + pos, head_body);
+        upstream->body_left =
+            upstream->until_close ? UINT64_MAX : upstream->body.remaining - head_body;
+        pos += head_body;
+    }
+    upstream->pos = pos;
+    upstream->is_complete = !upstream->has_body && pos == upstream->recv_len;
+
+    upstream->send_start = start_metrics_send();
+    upstream->is_head_sent = true;
+    bool is_sent = send_response(res, head->str, head->len) == (ssize_t)head->len;
+    upstream->n_sent = is_sent ? head->len : 0;
+    g_string_free(head, TRUE);
+    return is_sent;
+}
+
+int _splice_proxy_body(proxy_conn *upstream) {
+    connection *conn = upstream->conn;
+    const response *res = upstream->res;
+
+    // Spliced bytes bypass OpenSSL and the HTTP/2 framing, so these connections get them through
+    // the buffer.
+    bool can_splice = conn->http2 == NULL && can_send_plaintext(conn->fd);
+
+    for (;;) {
+        // The bytes the client socket didn't take go first, the pipe is given back once it's empty.
+        while (upstream->pipe_len > 0) {
+            ssize_t out_size = splice(upstream->pipe_fds[0], NULL, conn->fd, NULL,
+                                      upstream->pipe_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (out_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return _wait_proxy(upstream, true, POLLOUT);
+            if (out_size <= 0)
+                return 0;
+            upstream->pipe_len -= out_size;
+            upstream->n_sent += out_size;
+            add_metrics_counter(METRICS_BYTES_SENT, out_size);
+            conn->last_active = _connection_now();
+        }
+        if (upstream->pipe_fds != NULL)
+            _put_proxy_pipe(upstream);
+
+        if (upstream->body_left == 0) {
+            upstream->is_complete = upstream->pos == upstream->recv_len;
+            return 1;
+        }
+        if (!_can_relay_proxy(upstream))
+            return _wait_proxy(upstream, true, POLLOUT);
+
+        size_t chunk_len = upstream->body_left < PROXY_SPLICE_SIZE ? upstream->body_left
+                                                                    : PROXY_SPLICE_SIZE;
+        ssize_t in_size = 0;
+        if (can_splice && (upstream->pipe_fds = _take_proxy_pipe()) != NULL) {
+            in_size = splice(upstream->fd, NULL, upstream->pipe_fds[1], NULL, chunk_len,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            upstream->pipe_len = in_size > 0 ? in_size : 0;
+        } else {
+            // Without a pipe, the body goes through the buffer, past the bytes of the head.
+            in_size = recv(upstream->fd, upstream->buf,
+                           chunk_len < PROXY_BUF_SIZE ? chunk_len : PROXY_BUF_SIZE, 0);
+            if (in_size > 0 && send_response(res, upstream->buf, in_size) != in_size)
+                return 0;
+            upstream->n_sent += in_size > 0 ? in_size : 0;
+        }
+
+        if (in_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return _wait_proxy(upstream, false, POLLIN);
+
+        // A body that ends with the connection is complete once the backend closes it.
+        if (in_size == 0 && upstream->until_close) {
+            upstream->body_left = 0;
+            continue;
+        }
+        if (in_size <= 0)
+            return 0;
+
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+        if (!upstream->until_close)
+            upstream->body_left -= in_size;
+    }
+}
+
+int _relay_proxy_chunks(proxy_conn *upstream) {
+    const response *res = upstream->res;
+
+    for (;;) {
+        // Only the framing is parsed, the bytes are relayed as they are.
+        http_parse_result result = HTTP_PARSE_INCOMPLETE;
+        size_t pos = upstream->pos, end = pos, consumed = 0;
+        http_view data;
+        while (end < upstream->recv_len && result == HTTP_PARSE_INCOMPLETE) {
+            result = parse_http_body(&upstream->body, upstream->buf + end,
+                                     upstream->recv_len - end, &consumed, &data);
+            if (upstream->dechunk && data.len > 0) {
+                if (send_response(res, upstream->buf + end + data.off, data.len) !=
+                    (ssize_t)data.len)
+                    return 0;
+                upstream->n_sent += data.len;
+            }
+            end += consumed;
+        }
+        if (result == HTTP_PARSE_ERROR)
+            return 0;
+
+        if (!upstream->dechunk && end > pos) {
+            if (send_response(res, upstream->buf + pos, end - pos) != (ssize_t)(end - pos))
+                return 0;
+            upstream->n_sent += end - pos;
+        }
+        upstream->pos = end;
+        if (result == HTTP_PARSE_OK) {
+            upstream->is_complete = end == upstream->recv_len;
+            return 1;
+        }
+
+        if (!_can_relay_proxy(upstream))
+            return _wait_proxy(upstream, true, POLLOUT);
+        ssize_t recv_size = recv(upstream->fd, upstream->buf, sizeof(upstream->buf), 0);
+        if (recv_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return _wait_proxy(upstream, false, POLLIN);
+        if (recv_size <= 0)
+            return 0;
+        upstream->recv_len = recv_size;
+        upstream->pos = 0;
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+    }
+}
+
+bool _can_relay_proxy(const proxy_conn *upstream) {
+    const connection *conn = upstream->conn;
+    return conn->http2 != NULL ? can_send_http2(conn->http2) : conn->output == NULL;
+}
+
+int _wait_proxy(proxy_conn *upstream, const bool waits_client, const unsigned int events) {
+    // The backend gets its whole timeout again after the request waited for the client.
+    if (upstream->waits_client && !waits_client)
+        upstream->expires_at = _connection_now() + _proxy_timeout;
+    upstream->waits_client = waits_client;
+    upstream->events = events;
+    return 2;
+}
+
+bool _has_proxy_header_token(const proxy_conn *upstream, const char *key, const char *token,
+                             const size_t token_len) {
+    for (int h_no = find_http_header(&upstream->parser, upstream->buf, key, 0); h_no >= 0;
+         h_no = find_http_header(&upstream->parser, upstream->buf, key, h_no + 1)) {
+        const http_view *value = &upstream->parser.headers[h_no].value;
+        if (_has_header_token(upstream->buf + value->off, value->len, token, token_len))
+            return true;
+    }
+
+    return false;
+}
+
+bool _is_proxy_connection_option(const request *req, const char *key) {
+    size_t key_len = strlen(key);
+    for (unsigned int h_no = 0; h_no < req->n_headers; h_no++) {
+        const request_header *header = &req->headers[h_no];
+        if (strcasecmp(header->key, "Connection") == 0 &&
+            _has_header_token(header->value, strlen(header->value), key, key_len))
+            return true;
+    }
+
+    return false;
+}
+
+bool _has_header_token(const char *value, const size_t value_len, const char *token,
+                       const size_t token_len) {
+    const char *pos = value, *end = value + value_len;
+    while (pos < end) {
+        while (pos < end && strchr(", \t", *pos) != NULL)
+            pos++;
+        const char *token_end = pos;
+        while (token_end < end && strchr(", \t", *token_end) == NULL)
+            token_end++;
+        if ((size_t)(token_end - pos) == token_len && strncasecmp(pos, token, token_len) == 0)
+            return true;
+        pos = token_end;
+    }
+
+    return false;
+}
+
+bool _is_hop_by_hop_header(const char *key, const size_t key_len) {
+    // Expect isn't forwarded, the body is streamed to the backend without waiting for a 100.
+    const char *hop_by_hop[] = {"Connection", "Keep-Alive", "Proxy-Connection", "TE",
+                                "Trailer",    "Upgrade",    "Expect"};
+    for (size_t h_no = 0; h_no < sizeof(hop_by_hop) / sizeof(hop_by_hop[0]); h_no++)
+        if (strlen(hop_by_hop[h_no]) == key_len && strncasecmp(key, hop_by_hop[h_no], key_len) == 0)
+            return true;
+
+    return false;
+}
+
+int *_take_proxy_pipe() {
+    // Every request with bytes in flight holds a pipe of its own, a thread keeps one spare.
+    int *pipe_fds = pthread_getspecific(_proxy_pipe_key);
+    if (pipe_fds != NULL) {
+        pthread_setspecific(_proxy_pipe_key, NULL);
+        return pipe_fds;
+    }
+
+    if ((pipe_fds = malloc(2 * sizeof(int))) == NULL)
+        return NULL;
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        free(pipe_fds);
+        return NULL;
+    }
+
+    return pipe_fds;
+}
+
+void _put_proxy_pipe(proxy_conn *upstream) {
+    // Bytes left in the pipe would leak into another response, it is freed instead.
+    if (upstream->pipe_len > 0 || pthread_getspecific(_proxy_pipe_key) != NULL ||
+        pthread_setspecific(_proxy_pipe_key, upstream->pipe_fds) != 0)
+        _free_proxy_pipe(upstream->pipe_fds);
+    upstream->pipe_fds = NULL;
+    upstream->pipe_len = 0;
+}
+
+void _free_proxy_pipe(void *pipe_fds) {
+    close(((int *)pipe_fds)[0]);
+    close(((int *)pipe_fds)[1]);
+    free(pipe_fds);
+}
+
+void *_check_proxy_backends(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&_proxy_health_lock);
+    while (!_proxy_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += _proxy_health_interval;
+        while (!_proxy_stopping &&
+               pthread_cond_timedwait(&_proxy_health_cond, &_proxy_health_lock, &deadline) !=
+                   ETIMEDOUT)
+            ;
+        if (_proxy_stopping)
+            break;
+        pthread_mutex_unlock(&_proxy_health_lock);
+
+        for (unsigned int b_no = 0; b_no < _proxy_n_backends; b_no++) {
+            proxy_backend *backend = _proxy_backends[b_no];
+            int fd = _connect_proxy_backend(backend);
+            struct pollfd poll_fd = {.fd = fd, .events = POLLOUT};
+            bool is_healthy = fd >= 0 && (_check_proxy_connect(backend, fd) == 1 ||
+                                          (poll(&poll_fd, 1, _proxy_timeout * 1000) == 1 &&
+                                           _check_proxy_connect(backend, fd) == 1));
+            if (fd >= 0)
+                close(fd);
+            if (atomic_exchange(&backend->is_healthy, is_healthy) != is_healthy)
+                printf("Upstream %s is %s\n", backend->name, is_healthy ? "up" : "down");
+        }
+
+        pthread_mutex_lock(&_proxy_health_lock);
+    }
+    pthread_mutex_unlock(&_proxy_health_lock);
+
+    return NULL;
+}
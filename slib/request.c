@@ -10,6 +10,9 @@
  * file descriptor. `struct request` can be used to created a response (defined in
  * `include/response.h`) to send the response back to the client.
  *
+ * Request heads are parsed by the incremental parser (defined in `include/http_parser.h`), the
+ * request line and header strings point into the request buffer and are never copied.
+ *
  * Max size of a request is defined by `REQ_BUF_SIZE` macro (defined in `include/request.h`). This
  * value can be changed by defining `REQ_BUF_SIZE` before `#include "request.h"`.
  *
@@ -21,18 +24,41 @@
  * @bug No known bugs.
  */
 
+#define _GNU_SOURCE
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "helpers.h"
 #include "request.h"
 
 request *get_request(const int conn_fd) {
-    char req_buf[REQ_BUF_SIZE];
-    if (recv(conn_fd, req_buf, REQ_BUF_SIZE, 0) < 0)
+    char req_buf[REQ_BUF_SIZE + 1];
+    size_t req_len = 0;
+    ssize_t recv_size = 0;
+    http_parser parser;
+
+    // The request head can arrive in several segments, it is read until the empty line ending it.
+    init_http_parser(&parser);
+    while (req_len < REQ_BUF_SIZE) {
+        if ((recv_size = recv(conn_fd, req_buf + req_len, REQ_BUF_SIZE - req_len, 0)) < 0 &&
+            errno == EINTR)
+            continue;
+        if (recv_size <= 0)
+            break;
+
+        req_len += recv_size;
+        if (parse_http_request(&parser, req_buf, req_len) != HTTP_PARSE_INCOMPLETE)
+            break;
+    }
+    if (recv_size < 0 && req_len == 0)
         return NULL;
+    req_buf[req_len] = '\0';
 
     return parse_request(req_buf, conn_fd);
 }
@@ -43,8 +69,30 @@ request *parse_request(const char *req_buf, const int conn_fd) {
         return NULL;
 
     req->conn_fd = conn_fd;
-    if (_parse_request(req_buf, req) == 0)
+    if (_parse_request(req_buf, req) == 0) {
+        req->conn_fd = -1;
+        _free_request(req);
+        return NULL;
+    }
+
+    return req;
+}
+
+request *parse_request_in_place(char *req_buf, const http_parser *parser, const int conn_fd,
+                                arena *a) {
+    if (req_buf == NULL || parser == NULL)
+        return NULL;
+
+    request *req = _initialize_request_from_arena(a);
+    if (req == NULL)
+        return NULL;
+
+    req->conn_fd = conn_fd;
+    if (_set_request_views(req, req_buf, parser) == 0) {
+        req->conn_fd = -1;
+        _free_request(req);
         return NULL;
+    }
 
     return req;
 }
@@ -61,29 +109,160 @@ const char *get_request_header(const request *req, const char *header_key, char
     if (req == NULL || header_key == NULL)
         return NULL;
 
-    const char *_header_val = NULL;
-    if ((_header_val = g_hash_table_lookup(req->header_htab, header_key)) != NULL) {
-        if (header_val != NULL)
-            strcpy(header_val, _header_val);
-        return _header_val;
+    size_t key_len = strlen(header_key);
+    http_known_header id = get_http_known_header(header_key, key_len);
+    if (id < HTTP_KNOWN_HEADERS) {
+        const char *value = req->known_headers[id];
+        if (value != NULL && header_val != NULL)
+            strcpy(header_val, value);
+        return value;
+    }
+
+    for (unsigned int i = 0; i < req->n_headers; i++) {
+        if (strcasecmp(req->headers[i].key, header_key) == 0) {
+            if (header_val != NULL)
+                strcpy(header_val, req->headers[i].value);
+            return req->headers[i].value;
+        }
     }
 
     return NULL;
 }
 
+const char *get_known_request_header(const request *req, const http_known_header id) {
+    if (req == NULL || id >= HTTP_KNOWN_HEADERS)
+        return NULL;
+
+    return req->known_headers[id];
+}
+
+int is_request_not_modified(const request *req, const char *etag, const time_t mtime) {
+    const char *if_none_match = get_known_request_header(req, HTTP_HEADER_IF_NONE_MATCH);
+    if (if_none_match != NULL) {
+        size_t etag_len = strlen(etag);
+        const char *tag = if_none_match;
+
+        while (*tag != '\0') {
+            while (*tag == ' ' || *tag == '\t' || *tag == ',')
+                tag++;
+            if (*tag == '\0')
+                break;
+
+            const char *tag_end = strchr(tag, ',');
+            size_t tag_len = tag_end != NULL ? (size_t)(tag_end - tag) : strlen(tag);
+            while (tag_len > 0 && (tag[tag_len - 1] == ' ' || tag[tag_len - 1] == '\t'))
+                tag_len--;
+
+            if (tag_len == 1 && tag[0] == '*')
+                return 1;
+            if (tag_len > 2 && strncmp(tag, "W/", 2) == 0) {
+                tag += 2;
+                tag_len -= 2;
+            }
+            if (tag_len == etag_len && strncmp(tag, etag, etag_len) == 0)
+                return 1;
+
+            tag += tag_len;
+        }
+
+        // If-Modified-Since is ignored if If-None-Match is present (RFC 7232, section 3.3).
+        return 0;
+    }
+
+    time_t since = parse_http_date(get_known_request_header(req, HTTP_HEADER_IF_MODIFIED_SINCE));
+    return since != -1 && mtime <= since;
+}
+
+int is_request_range_fresh(const request *req, const char *etag, const time_t mtime) {
+    const char *if_range = get_known_request_header(req, HTTP_HEADER_IF_RANGE);
+    if (if_range == NULL)
+        return 1;
+
+    // Entity tags are compared strongly, a weak tag never matches (RFC 7233, section 3.2).
+    if (if_range[0] == '"' || strncmp(if_range, "W/", 2) == 0)
+        return strcmp(if_range, etag) == 0;
+
+    time_t date = parse_http_date(if_range);
+    return date != -1 && date == mtime;
+}
+
+int parse_request_ranges(const request *req, const off_t file_size, byte_range *ranges,
+                         const int max_ranges) {
+    const char *range = get_known_request_header(req, HTTP_HEADER_RANGE);
+    if (range == NULL || strncasecmp(range, "bytes=", 6) != 0)
+        return 0;
+
+    int n_ranges = 0, n_specs = 0;
+    const char *spec = range + 6;
+    while (*spec != '\0') {
+        while (*spec == ' ' || *spec == '\t' || *spec == ',')
+            spec++;
+        if (*spec == '\0')
+            break;
+
+        const char *spec_end = strchr(spec, ',');
+        size_t spec_len = spec_end != NULL ? (size_t)(spec_end - spec) : strlen(spec);
+        while (spec_len > 0 && (spec[spec_len - 1] == ' ' || spec[spec_len - 1] == '\t'))
+            spec_len--;
+
+        if (++n_specs > max_ranges)
+            return 0;
+
+        int ret = _parse_byte_range(spec, spec_len, file_size, &ranges[n_ranges]);
+        if (ret == 0)
+            return 0;
+        if (ret == 1)
+            n_ranges++;
+
+        spec += spec_len;
+    }
+
+    if (n_specs == 0)
+        return 0;
+    if (n_ranges == 0)
+        return REQ_RANGE_NOT_SATISFIABLE;
+
+    // Merge overlapping and adjacent ranges, so no byte is sent twice.
+    qsort(ranges, n_ranges, sizeof(byte_range), _compare_byte_ranges);
+    int n_merged = 0;
+    for (int range_no = 1; range_no < n_ranges; range_no++) {
+        if (ranges[range_no].first <= ranges[n_merged].last + 1) {
+            if (ranges[range_no].last > ranges[n_merged].last)
+                ranges[n_merged].last = ranges[range_no].last;
+        } else {
+            ranges[++n_merged] = ranges[range_no];
+        }
+    }
+
+    return n_merged + 1;
+}
+
 request *_initialize_request() {
-    request *req = malloc(sizeof(request));
-    if (req == NULL)
+    return _initialize_request_from_arena(NULL);
+}
+
+request *_initialize_request_from_arena(arena *a) {
+    bool owns_arena = (a == NULL);
+    if (owns_arena && (a = create_arena(sizeof(request) + REQ_BUF_SIZE)) == NULL)
         return NULL;
 
+    request *req = arena_alloc(a, sizeof(request));
+    if (req == NULL) {
+        if (owns_arena)
+            destroy_arena(a);
+        return NULL;
+    }
+
+    req->arena = a;
+    req->owns_arena = owns_arena;
     req->conn_fd = -1;
     req->http_method = NULL;
     req->url = NULL;
     req->http_ver = NULL;
-    if ((req->header_htab =
-             g_hash_table_new_full(g_str_hash, g_str_equal, _req_header_htab_key_destroy,
-                                   _req_header_htab_value_destroy)) == NULL)
-        return NULL;
+    req->buf = NULL;
+    req->n_headers = 0;
+    for (int id = 0; id < HTTP_KNOWN_HEADERS; id++)
+        req->known_headers[id] = NULL;
 
     return req;
 }
@@ -94,22 +273,42 @@ int _parse_request(const char *req_buf, request *req) {
     if (req == NULL)
         return 0;
 
-    char *req_buff = strdup(req_buf);
+    http_parser parser;
+    init_http_parser(&parser);
+    size_t req_len = strlen(req_buf);
+    if (parse_http_request(&parser, req_buf, req_len) != HTTP_PARSE_OK)
+        return 0;
+
+    if ((req->buf = arena_strndup(req->arena, req_buf, parser.head_len)) == NULL)
+        return 0;
+
+    return _set_request_views(req, req->buf, &parser);
+}
 
-    req->http_method = strdup(strtok(req_buff, " "));
-    req->url = strdup(strtok(NULL, " "));
-    req->http_ver = strdup(strtok(NULL, "\r"));
+int _set_request_views(request *req, char *buf, const http_parser *parser) {
+    if (parser->state != HTTP_PARSER_DONE)
+        return 0;
 
-    char *header_key, *header_val;
-    char *key, *value;
+    // Every view is followed by a separator inside the request head, so it can be overwritten.
+    req->http_method = buf + parser->method.off;
+    req->http_method[parser->method.len] = '\0';
+    req->url = buf + parser->url.off;
+    req->url[parser->url.len] = '\0';
+    req->http_ver = buf + parser->version.off;
+    req->http_ver[parser->version.len] = '\0';
 
-    while ((header_key = strtok(NULL, ":")) != NULL && (header_val = strtok(NULL, "\r")) != NULL) {
-        key = strdup(header_key + 1);
-        value = strdup(header_val + 1);
-        g_hash_table_insert(req->header_htab, key, value);
+    req->n_headers = parser->n_headers;
+    for (unsigned int i = 0; i < parser->n_headers; i++) {
+        buf[parser->headers[i].key.off + parser->headers[i].key.len] = '\0';
+        buf[parser->headers[i].value.off + parser->headers[i].value.len] = '\0';
+        req->headers[i].key = buf + parser->headers[i].key.off;
+        req->headers[i].value = buf + parser->headers[i].value.off;
+    }
+    for (int id = 0; id < HTTP_KNOWN_HEADERS; id++) {
+        int h_no = parser->known_headers[id];
+        req->known_headers[id] = h_no >= 0 ? req->headers[h_no].value : NULL;
     }
 
-    free(req_buff);
     return 1;
 }
 
@@ -117,36 +316,61 @@ void _free_request(request *req) {
     if (req == NULL)
         return;
 
-    if (req->header_htab != NULL) {
-        g_hash_table_destroy(req->header_htab);
-        req->header_htab = NULL;
-    }
+    // The request struct and its buffer are allocated from the arena.
+    if (req->owns_arena)
+        destroy_arena(req->arena);
+    req = NULL;
+}
 
-    if (req->http_method != NULL) {
-        free(req->http_method);
-        req->http_method = NULL;
-    }
+int _parse_byte_range(const char *spec, const size_t spec_len, const off_t file_size,
+                      byte_range *range) {
+    const char *dash = memchr(spec, '-', spec_len);
+    if (dash == NULL)
+        return 0;
 
-    if (req->url != NULL) {
-        free(req->url);
-        req->url = NULL;
+    char *end = NULL;
+    const char *spec_end = spec + spec_len;
+    if (dash == spec) {
+        // Suffix range, the last `<n>` bytes of the file.
+        if (dash + 1 == spec_end || dash[1] < '0' || dash[1] > '9')
+            return 0;
+        long long suffix_len = strtoll(dash + 1, &end, 10);
+        if (end != spec_end)
+            return 0;
+        if (suffix_len == 0 || file_size == 0)
+            return 2;
+
+        range->first = suffix_len < file_size ? file_size - suffix_len : 0;
+        range->last = file_size - 1;
+        return 1;
     }
 
-    if (req->http_ver != NULL) {
-        free(req->http_ver);
-        req->http_ver = NULL;
+    if (spec[0] < '0' || spec[0] > '9')
+        return 0;
+    long long first = strtoll(spec, &end, 10);
+    if (end != dash)
+        return 0;
+
+    long long last = file_size - 1;
+    if (dash + 1 != spec_end) {
+        if (dash[1] < '0' || dash[1] > '9')
+            return 0;
+        last = strtoll(dash + 1, &end, 10);
+        if (end != spec_end || last < first)
+            return 0;
     }
 
-    free(req);
-    req = NULL;
-}
+    if (first >= file_size)
+        return 2;
 
-void _req_header_htab_key_destroy(gpointer data) {
-    free(data);
-    data = NULL;
+    range->first = first;
+    range->last = last < file_size ? last : file_size - 1;
+    return 1;
 }
 
-void _req_header_htab_value_destroy(gpointer data) {
-    free(data);
-    data = NULL;
+int _compare_byte_ranges(const void *a, const void *b) {
+    const byte_range *range_a = a, *range_b = b;
+    if (range_a->first != range_b->first)
+        return range_a->first < range_b->first ? -1 : 1;
+    return 0;
 }
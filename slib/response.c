@@ -22,28 +22,70 @@
  * @bug No known bugs.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "response.h"
 
+/**
+ * @private
+ * @brief Defines the HTML body of an error response, `line` is the status code and reason phrase.
+ */
+#define _ERROR_BODY(line)                                                                          \
+    "<html><head><title>" line "</title></head><body><h1>" line "</h1></body></html>\n"
+
+/**
+ * @private
+ * @brief Defines a row of `_error_responses`.
+ */
+#define _ERROR_RESPONSE(status, reason)                                                            \
+    {status, #status " " reason, _ERROR_BODY(#status " " reason),                                  \
+     sizeof(_ERROR_BODY(#status " " reason)) - 1}
+
+/**
+ * @private
+ * @brief Pre-built error responses, the last one is the fallback of `get_error_response()`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const error_response _error_responses[] = {
+    _ERROR_RESPONSE(400, "Bad Request"),
+    _ERROR_RESPONSE(403, "Forbidden"),
+    _ERROR_RESPONSE(404, "Not Found"),
+    _ERROR_RESPONSE(405, "Method Not Allowed"),
+    _ERROR_RESPONSE(413, "Content Too Large"),
+    _ERROR_RESPONSE(431, "Request Header Fields Too Large"),
+    _ERROR_RESPONSE(502, "Bad Gateway"),
+    _ERROR_RESPONSE(503, "Service Unavailable"),
+    _ERROR_RESPONSE(504, "Gateway Timeout"),
+    _ERROR_RESPONSE(500, "Internal Server Error"),
+};
+
 response *create_response(const int conn_fd) {
     response *res = _initialize_response();
     if (res == NULL)
         return NULL;
 
-    res->conn_fd = dup(conn_fd);
+    res->conn_fd = conn_fd;
     return res;
 }
 
 response *create_response_from_request(const request *req) {
-    response *res = create_response(req->conn_fd);
+    if (req == NULL)
+        return create_response(-1);
+
+    // A request that owns its arena may be freed first, so the response needs its own.
+    response *res = _initialize_response_from_arena(req->owns_arena ? NULL : req->arena);
     if (res == NULL)
         return NULL;
 
-    res->http_ver = strdup(req->http_ver);
+    res->conn_fd = req->conn_fd;
+    res->http_ver = arena_strdup(res->arena, req->http_ver);
     return res;
 }
 
@@ -51,69 +93,135 @@ const char *get_response_header(const response *res, const char *header_key, cha
     if (res == NULL || header_key == NULL)
         return NULL;
 
-    const char *_header_val = NULL;
-    if ((_header_val = g_hash_table_lookup(res->header_htab, header_key)) != NULL) {
-        if (header_val != NULL)
-            strcpy(header_val, _header_val);
-        return _header_val;
+    for (unsigned int i = 0; i < res->n_headers; i++) {
+        if (strcasecmp(res->headers[i].key, header_key) == 0) {
+            if (header_val != NULL)
+                strcpy(header_val, res->headers[i].value);
+            return res->headers[i].value;
+        }
     }
 
     return NULL;
 }
 
-const char *set_response_header(const response *res, const char *header_key,
-                                const char *header_val) {
+const char *set_response_header(response *res, const char *header_key, const char *header_val) {
     if (res == NULL || header_key == NULL || header_val == NULL)
         return NULL;
 
-    if (g_hash_table_lookup(res->header_htab, header_key) == NULL) {
-        char *key = strdup(header_key);
-        char *val = strdup(header_val);
+    if (res->n_headers == RES_MAX_HEADERS || get_response_header(res, header_key, NULL) != NULL)
+        return NULL;
 
-        g_hash_table_insert(res->header_htab, key, val);
-        return g_hash_table_lookup(res->header_htab, key);
-    }
+    response_header *header = &res->headers[res->n_headers];
+    if ((header->key = arena_strdup(res->arena, header_key)) == NULL ||
+        (header->value = arena_strdup(res->arena, header_val)) == NULL)
+        return NULL;
 
-    return NULL;
+    res->n_headers++;
+    return header->value;
 }
 
-// TODO: Only 1 send() call
 ssize_t send_response_head(const response *res) {
-    char buf[RES_HEADER_BUF_SIZE];
-    ssize_t buf_size = 0, total_buf_size = 0;
-
-    // HTTP Version and Status Code needs to be set.
-    if (res->http_ver == NULL || res->status_code == NULL)
+    GString *head = NULL;
+    if ((head = _serialize_response_head(res)) == NULL)
         return 0;
 
-    // Sending first line of response head
-    sprintf(buf, "%s %s\r\n", res->http_ver, res->status_code);
-    buf_size = strlen(buf);
-    if (send(res->conn_fd, buf, buf_size, 0) != buf_size)
-        return total_buf_size;
-    total_buf_size += buf_size;
+    struct iovec iov[1] = {{.iov_base = head->str, .iov_len = head->len}};
+    ssize_t total_buf_size = _send_iov(res->conn_fd, iov, 1, 0);
+
+    g_string_free(head, TRUE);
+    return total_buf_size;
+}
 
-    // TODO: Send response headers
-    GHashTableIter iter;
-    gpointer header_key, header_value;
-    g_hash_table_iter_init(&iter, res->header_htab);
+size_t serialize_response_headers(const response *res, GString *buf) {
+    size_t buf_len = buf->len;
 
-    while (g_hash_table_iter_next(&iter, &header_key, &header_value)) {
-        sprintf(buf, "%s: %s\r\n", (char *)header_key, (char *)header_value);
-        buf_size = strlen(buf);
-        if (send(res->conn_fd, buf, buf_size, 0) != buf_size)
-            return total_buf_size;
-        total_buf_size += buf_size;
+    for (unsigned int i = 0; i < res->n_headers; i++) {
+        g_string_append(buf, res->headers[i].key);
+        g_string_append_len(buf, ": ", 2);
+        g_string_append(buf, res->headers[i].value);
+        g_string_append_len(buf, "\r\n", 2);
     }
 
-    // Sending last line of response head
-    strcpy(buf, "\r\n");
-    buf_size = strlen(buf);
-    if (send(res->conn_fd, buf, buf_size, 0) != buf_size)
-        return total_buf_size;
-    total_buf_size += buf_size;
+    return buf->len - buf_len;
+}
 
-    return total_buf_size;
+ssize_t send_response_with_body(const response *res, const char *buf, size_t buf_size) {
+    long long send_start = start_metrics_send();
+    ssize_t sent_size = _send_response_with_body(res, buf, buf_size);
+    end_metrics_send(send_start);
+    return sent_size;
+}
+
+ssize_t send_response_with_fd(const response *res, const int file_fd, off_t offset, size_t count) {
+    long long send_start = start_metrics_send();
+    ssize_t sent_size = _send_response_with_fd(res, file_fd, offset, count);
+    end_metrics_send(send_start);
+    return sent_size;
+}
+
+ssize_t send_response_with_ranges(const response *res, const int file_fd,
+                                  const byte_range *ranges, const int n_ranges,
+                                  const off_t file_size, const char *content_type,
+                                  const char *boundary) {
+    long long send_start = start_metrics_send();
+    ssize_t sent_size = _send_response_with_ranges(res, file_fd, ranges, n_ranges, file_size,
+                                                   content_type, boundary);
+    end_metrics_send(send_start);
+    return sent_size;
+}
+
+size_t get_multipart_ranges_length(const byte_range *ranges, const int n_ranges,
+                                   const off_t file_size, const char *content_type,
+                                   const char *boundary) {
+    char part_head[RES_HEADER_BUF_SIZE];
+    size_t body_len = 0;
+
+    for (int range_no = 0; range_no < n_ranges; range_no++) {
+        body_len += _format_range_part_head(part_head, &ranges[range_no], file_size, content_type,
+                                            boundary);
+        body_len += ranges[range_no].last - ranges[range_no].first + 1;
+    }
+
+    // Closing delimiter, "\r\n--<boundary>--\r\n".
+    return body_len + strlen(boundary) + 8;
+}
+
+const error_response *get_error_response(const int status) {
+    size_t n_responses = sizeof(_error_responses) / sizeof(_error_responses[0]);
+    for (size_t res_no = 0; res_no < n_responses - 1; res_no++)
+        if (_error_responses[res_no].status == status)
+            return &_error_responses[res_no];
+
+    return &_error_responses[n_responses - 1];
+}
+
+ssize_t send_error_response(response *res, const int status, const bool head_only) {
+    char content_length[32];
+    const error_response *error = get_error_response(status);
+
+    res->status_code = error->status_code;
+    set_response_header(res, "content-type", "text/html");
+    sprintf(content_length, "%zu", error->body_len);
+    set_response_header(res, "content-length", content_length);
+
+    return send_response_with_body(res, error->body, head_only ? 0 : error->body_len);
+}
+
+ssize_t send_raw_error_response(const int conn_fd, const int status) {
+    char head[RES_HEADER_BUF_SIZE];
+    const error_response *error = get_error_response(status);
+
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 %s\r\ncontent-type: text/html\r\ncontent-length: %zu\r\n"
+                            "connection: close\r\n\r\n",
+                            error->status_code, error->body_len);
+    struct iovec iov[2] = {{.iov_base = head, .iov_len = head_len},
+                           {.iov_base = (void *)error->body, .iov_len = error->body_len}};
+
+    long long send_start = start_metrics_send();
+    ssize_t total_buf_size = _send_iov(conn_fd, iov, 2, MSG_DONTWAIT);
+    end_metrics_send(send_start);
+    return total_buf_size < head_len ? -1 : total_buf_size - head_len;
 }
 
 ssize_t send_response_file(const response *res, FILE *file) {
@@ -122,7 +230,8 @@ ssize_t send_response_file(const response *res, FILE *file) {
     char buf[RES_BUF_SIZE];
 
     while ((buf_size = fread(buf, 1, RES_BUF_SIZE, file)) > 0) {
-        send_size = send(res->conn_fd, buf, buf_size, 0);
+        struct iovec iov[1] = {{.iov_base = buf, .iov_len = buf_size}};
+        send_size = _send_iov(res->conn_fd, iov, 1, 0);
         if (send_size != buf_size)
             return total_buf_size;
         total_buf_size += send_size;
@@ -131,63 +240,272 @@ ssize_t send_response_file(const response *res, FILE *file) {
     return total_buf_size;
 }
 
+ssize_t send_response_fd(const response *res, const int file_fd, off_t offset, size_t count) {
+    ssize_t total_buf_size = 0, send_size = 0;
+
+    // The range is queued on the connection for whatever the socket doesn't take.
+    connection *conn = get_active_connection(res->conn_fd);
+    if (conn != NULL)
+        return write_connection_file(conn, file_fd, offset, count);
+
+    // HTTP/2 frames the range as the flow control windows allow, the rest is parked on the stream.
+    if (has_http2_stream(res->conn_fd)) {
+        if ((send_size = send_http2_file(res->conn_fd, file_fd, offset, count)) > 0)
+            add_metrics_counter(METRICS_BYTES_SENT, send_size);
+        return send_size < 0 ? 0 : send_size;
+    }
+
+    // Records encrypted by OpenSSL are built in user space, so the file is read into a buffer.
+    if (!can_send_plaintext(res->conn_fd))
+        return _send_response_fd_fallback(res, file_fd, offset, count);
+
+    while (count > 0) {
+        if ((send_size = sendfile(res->conn_fd, file_fd, &offset, count)) <= 0) {
+            if (send_size < 0 && errno == EINTR)
+                continue;
+            if (send_size < 0 && (errno == EINVAL || errno == ENOSYS))
+                return total_buf_size + _send_response_fd_fallback(res, file_fd, offset, count);
+            return total_buf_size;
+        }
+
+        count -= send_size;
+        total_buf_size += send_size;
+        add_metrics_counter(METRICS_BYTES_SENT, send_size);
+    }
+
+    return total_buf_size;
+}
+
 ssize_t send_response(const response *res, const char *buf, ssize_t buf_size) {
     if (buf_size == -1)
         buf_size = strlen(buf);
-    return send(res->conn_fd, buf, buf_size, 0);
+
+    struct iovec iov[1] = {{.iov_base = (void *)buf, .iov_len = buf_size}};
+    ssize_t send_size = _send_iov(res->conn_fd, iov, 1, 0);
+    return send_size == buf_size ? send_size : -1;
 }
 
 void close_response(response *res) {
-    if (res->conn_fd != -1) {
-        close(res->conn_fd);
-        res->conn_fd = -1;
-    }
+    // Connection socket is not owned by the response.
+    res->conn_fd = -1;
     _free_response(res);
 }
 
 response *_initialize_response() {
-    response *res = malloc(sizeof(response));
-    if (res == NULL)
+    return _initialize_response_from_arena(NULL);
+}
+
+response *_initialize_response_from_arena(arena *a) {
+    bool owns_arena = (a == NULL);
+    if (owns_arena && (a = create_arena(sizeof(response) + RES_HEADER_BUF_SIZE)) == NULL)
+        return NULL;
+
+    response *res = arena_alloc(a, sizeof(response));
+    if (res == NULL) {
+        if (owns_arena)
+            destroy_arena(a);
         return NULL;
+    }
 
+    res->arena = a;
+    res->owns_arena = owns_arena;
     res->conn_fd = -1;
     res->http_ver = NULL;
     res->status_code = NULL;
-    if ((res->header_htab =
-             g_hash_table_new_full(g_str_hash, g_str_equal, _res_header_htab_key_destroy,
-                                   _res_header_htab_value_destroy)) == NULL)
-        return NULL;
+    res->n_headers = 0;
 
     return res;
 }
 
-void _free_response(response *res) {
-    if (res == NULL)
-        return;
+GString *_serialize_response_head(const response *res) {
+    // HTTP Version and Status Code needs to be set.
+    if (res->http_ver == NULL || res->status_code == NULL)
+        return NULL;
+
+    GString *head = g_string_sized_new(RES_HEADER_BUF_SIZE);
+    g_string_append_printf(head, "%s %s\r\n", res->http_ver, res->status_code);
+    serialize_response_headers(res, head);
+    g_string_append_len(head, "\r\n", 2);
+    return head;
+}
+
+ssize_t _send_response_with_body(const response *res, const char *buf, size_t buf_size) {
+    GString *head = NULL;
+    if ((head = _serialize_response_head(res)) == NULL)
+        return -1;
+
+    ssize_t head_size = head->len;
+    struct iovec iov[2] = {{.iov_base = head->str, .iov_len = head->len},
+                           {.iov_base = (void *)buf, .iov_len = buf_size}};
+    ssize_t total_buf_size = _send_iov(res->conn_fd, iov, buf_size > 0 ? 2 : 1, 0);
+
+    g_string_free(head, TRUE);
+    return total_buf_size < head_size ? -1 : total_buf_size - head_size;
+}
+
+ssize_t _send_response_with_fd(const response *res, const int file_fd, off_t offset,
+                               size_t count) {
+    if (count <= RES_SMALL_BODY_SIZE) {
+        char buf[RES_SMALL_BODY_SIZE];
+        size_t buf_size = 0;
+        ssize_t read_size = 0;
+
+        while (buf_size < count) {
+            if ((read_size = pread(file_fd, buf + buf_size, count - buf_size, offset + buf_size)) <= 0)
+                return -1;
+            buf_size += read_size;
+        }
+
+        return _send_response_with_body(res, buf, buf_size);
+    }
+
+    GString *head = NULL;
+    if ((head = _serialize_response_head(res)) == NULL)
+        return -1;
+
+    ssize_t head_size = head->len;
+    struct iovec iov[1] = {{.iov_base = head->str, .iov_len = head->len}};
+    ssize_t send_size = _send_iov(res->conn_fd, iov, 1, MSG_MORE);
+
+    g_string_free(head, TRUE);
+    if (send_size < head_size)
+        return -1;
+
+    return send_response_fd(res, file_fd, offset, count);
+}
+
+ssize_t _send_response_with_ranges(const response *res, const int file_fd,
+                                   const byte_range *ranges, const int n_ranges,
+                                   const off_t file_size, const char *content_type,
+                                   const char *boundary) {
+    GString *head = NULL;
+    if ((head = _serialize_response_head(res)) == NULL)
+        return -1;
+
+    ssize_t head_size = head->len;
+    struct iovec iov[1] = {{.iov_base = head->str, .iov_len = head->len}};
+    ssize_t send_size = _send_iov(res->conn_fd, iov, 1, MSG_MORE);
+
+    g_string_free(head, TRUE);
+    if (send_size < head_size)
+        return -1;
+
+    char part_head[RES_HEADER_BUF_SIZE];
+    ssize_t total_buf_size = 0;
+    for (int range_no = 0; range_no < n_ranges; range_no++) {
+        const byte_range *range = &ranges[range_no];
+        size_t part_head_size =
+            _format_range_part_head(part_head, range, file_size, content_type, boundary);
+        size_t part_size = range->last - range->first + 1;
+
+        iov[0] = (struct iovec){.iov_base = part_head, .iov_len = part_head_size};
+        if ((send_size = _send_iov(res->conn_fd, iov, 1, MSG_MORE)) != (ssize_t)part_head_size)
+            return total_buf_size + send_size;
+        total_buf_size += send_size;
 
-    if (res->header_htab != NULL) {
-        g_hash_table_destroy(res->header_htab);
-        res->header_htab = NULL;
+        if ((send_size = send_response_fd(res, file_fd, range->first, part_size)) !=
+            (ssize_t)part_size)
+            return total_buf_size + send_size;
+        total_buf_size += send_size;
     }
-    if (res->status_code != NULL) {
-        free(res->status_code);
-        res->status_code = NULL;
+
+    size_t tail_size = snprintf(part_head, sizeof(part_head), "\r\n--%s--\r\n", boundary);
+    iov[0] = (struct iovec){.iov_base = part_head, .iov_len = tail_size};
+    return total_buf_size + _send_iov(res->conn_fd, iov, 1, 0);
+}
+
+ssize_t _send_iov(const int conn_fd, struct iovec *iov, int iov_len, const int flags) {
+    ssize_t total_buf_size = 0, send_size = 0;
+    struct msghdr msg = {0};
+
+    // A connection's worker never blocks on the socket, what it doesn't take is queued.
+    connection *conn = get_active_connection(conn_fd);
+    if (conn != NULL)
+        return write_connection(conn, iov, iov_len, flags);
+
+    // Without kTLS, OpenSSL encrypts the buffers one at a time, so do HTTP/2 streams frame them.
+    if (!can_send_plaintext(conn_fd) || has_http2_stream(conn_fd)) {
+        for (; iov_len > 0; iov++, iov_len--) {
+            if ((send_size = _send_conn(conn_fd, iov->iov_base, iov->iov_len, flags)) > 0) {
+                total_buf_size += send_size;
+                add_metrics_counter(METRICS_BYTES_SENT, send_size);
+            }
+            if (send_size != (ssize_t)iov->iov_len)
+                return total_buf_size;
+        }
+        return total_buf_size;
     }
-    if (res->http_ver != NULL) {
-        free(res->http_ver);
-        res->http_ver = NULL;
+
+    while (iov_len > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_len;
+        if ((send_size = sendmsg(conn_fd, &msg, flags | MSG_NOSIGNAL)) <= 0) {
+            if (send_size < 0 && errno == EINTR)
+                continue;
+            return total_buf_size;
+        }
+        total_buf_size += send_size;
+        add_metrics_counter(METRICS_BYTES_SENT, send_size);
+
+        // Skip the buffers that were sent completely and adjust the partially sent one.
+        while (iov_len > 0 && (size_t)send_size >= iov->iov_len) {
+            send_size -= iov->iov_len;
+            iov++;
+            iov_len--;
+        }
+        if (iov_len > 0) {
+            iov->iov_base = (char *)iov->iov_base + send_size;
+            iov->iov_len -= send_size;
+        }
     }
 
-    free(res);
-    res = NULL;
+    return total_buf_size;
 }
 
-void _res_header_htab_key_destroy(gpointer data) {
-    free(data);
-    data = NULL;
+ssize_t _send_response_fd_fallback(const response *res, const int file_fd, off_t offset,
+                                   size_t count) {
+    ssize_t total_buf_size = 0, buf_size = 0, send_size = 0;
+    char buf[RES_BUF_SIZE];
+
+    while (count > 0) {
+        if ((buf_size = pread(file_fd, buf, count < RES_BUF_SIZE ? count : RES_BUF_SIZE, offset)) <= 0)
+            return total_buf_size;
+
+        send_size = _send_conn(res->conn_fd, buf, buf_size, 0);
+        if (send_size != buf_size)
+            return total_buf_size;
+
+        offset += send_size;
+        count -= send_size;
+        total_buf_size += send_size;
+        add_metrics_counter(METRICS_BYTES_SENT, send_size);
+    }
+
+    return total_buf_size;
+}
+
+ssize_t _send_conn(const int conn_fd, const void *buf, const size_t len, const int flags) {
+    if (has_http2_stream(conn_fd))
+        return send_http2(conn_fd, buf, len);
+    return send_tls(conn_fd, buf, len, flags);
 }
 
-void _res_header_htab_value_destroy(gpointer data) {
-    free(data);
-    data = NULL;
+size_t _format_range_part_head(char *buf, const byte_range *range, const off_t file_size,
+                               const char *content_type, const char *boundary) {
+    int len = snprintf(buf, RES_HEADER_BUF_SIZE,
+                       "\r\n--%s\r\ncontent-type: %s\r\n"
+                       "content-range: bytes %lld-%lld/%lld\r\n\r\n",
+                       boundary, content_type, (long long)range->first, (long long)range->last,
+                       (long long)file_size);
+    return len < RES_HEADER_BUF_SIZE ? (size_t)len : RES_HEADER_BUF_SIZE - 1;
+}
+
+void _free_response(response *res) {
+    if (res == NULL)
+        return;
+
+    // The response struct and its headers are allocated from the arena.
+    if (res->owns_arena)
+        destroy_arena(res->arena);
+    res = NULL;
 }
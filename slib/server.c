@@ -11,152 +11,553 @@
  * @bug No known bugs.
  */
 
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <arpa/inet.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <netinet/in.h>
-#include <pthread.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "server.h"
 
 /**
  * @private
- * @brief File descriptor for the server socket used to listen for incoming connections.
+ * @brief File descriptors of the server sockets used to listen for incoming connections.
+ *
+ * Initially set to `NULL`. Once the server is started, holds a socket per listen address, or a
+ * socket per listen address for every worker if `SO_REUSEPORT` is enabled. Sockets inherited from
+ * a previous server process are used as they are.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int *listen_fds = NULL;
+
+/**
+ * @private
+ * @brief Number of file descriptors in `listen_fds`.
  *
- * Initially set to -1. Once the server is started and a socket is created, this file descriptor
- * is set to the socket's file descriptor.
+ * This is a private object and should not be accessed directly.
+ */
+int n_listen_fds = 0;
+
+/**
+ * @private
+ * @brief Number of listening sockets each worker accepts connections from (the number of listen
+ * addresses).
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int listen_fds_per_worker = 0;
+
+/**
+ * @private
+ * @brief Whether every worker accepts connections from its own group of `listen_fds_per_worker`
+ * sockets in `listen_fds`, instead of all the workers sharing them.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+bool per_worker_listen_fds = false;
+
+/**
+ * @private
+ * @brief Website root directory the file cache was created for, `NULL` if the file cache is
+ * disabled.
+ *
+ * The file cache only watches this directory, so it is bypassed if `site_root_dir` is changed by a
+ * config reload.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+char *file_cache_root = NULL;
+
+/**
+ * @private
+ * @brief Idle timeout (in seconds) the worker threads were started with, announced in the
+ * `keep-alive` response header.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+
+/**
+ * @private
+ * @brief Arguments the server was started with, passed on to the server processes started by
+ * `_spawn_new_server()`.
  *
  * This is a private object and should not be accessed directly.
  */
-int tcp_socket = -1;
+char **server_argv = NULL;
+
+void start_server(char *argv[]) {
+    server_argv = argv;
+
+    // Every thread inherits the signal mask, so the signals are only received by this thread.
+    sigset_t signal_set;
+    sigemptyset(&signal_set);
+    sigaddset(&signal_set, SIGHUP);
+    sigaddset(&signal_set, SIGINT);
+    sigaddset(&signal_set, SIGTERM);
+    sigaddset(&signal_set, SIGTSTP);
+    sigaddset(&signal_set, SIGUSR2);
+    sigaddset(&signal_set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
 
-void start_server() {
-    int conn_fd = -1;
-    pthread_t tid;
+    // Writes to a client that went away fail with `EPIPE` instead, `splice()` and OpenSSL can't be
+    // told not to raise `SIGPIPE` like `send()` can.
+    signal(SIGPIPE, SIG_IGN);
 
     // Setup
-    load_config();
-    create_mime_table();
-    setup_socket();
+    if (load_config() == 0) {
+        printf("Unable to load config file %s\n", CONF_FILE);
+        exit(-1);
+    }
 
-    printf("Server Started...\nListening on http://%s:%d\nPress Ctrl+C to exit.\n\n",
-           get_config_str(HOST_CONF_KEY), get_config_int(PORT_CONF_KEY));
+    const server_config *cfg = get_server_config();
+    int n_workers = get_worker_count(cfg->worker_threads);
+    if (cfg->tls_port > 0 && create_tls(cfg->tls_certificate, cfg->tls_private_key,
+                                        cfg->tls_session_cache, cfg->tls_ktls,
+                                        cfg->http2) == 0) {
+        printf("Unable to load TLS certificate %s with private key %s\n", cfg->tls_certificate,
+               cfg->tls_private_key);
+        exit(-1);
+    }
+    setup_socket(n_workers);
+    if (cfg->mime_types_file[0] != '\0' && create_mime_table_from_file(cfg->mime_types_file) == 0)
+        printf("Unable to load MIME types file %s, using builtin MIME types\n",
+               cfg->mime_types_file);
+    if (cfg->file_cache_size > 0) {
+        unsigned int map_flags = (cfg->file_cache_mmap ? FILE_CACHE_MAP_FILES : 0) |
+                                 (cfg->file_cache_huge_pages ? FILE_CACHE_MAP_HUGE_PAGES : 0);
+        if (create_file_cache(cfg->site_root_dir, cfg->file_cache_size,
+                              cfg->file_cache_max_file_size, cfg->file_cache_max_entries,
+                              map_flags) != 0)
+            file_cache_root = strdup(cfg->site_root_dir);
+        else
+            printf("Unable to create file cache, serving files from disk\n");
+    }
+    if (create_fd_cache(cfg->site_root_dir, cfg->fd_cache_entries, cfg->fd_cache_ttl) == 0)
+        printf("Unable to open website root directory %s\n", cfg->site_root_dir);
 
-    while (true) {
-        if ((conn_fd = accept(tcp_socket, NULL, NULL)) < 0) {
-            perror("Unable to accept new connection");
-            continue;
-        }
+    if (cfg->access_log[0] != '\0' &&
+        create_access_log(cfg->access_log, parse_access_log_format(cfg->access_log_format),
+                          cfg->access_log_sample, n_workers, cfg->access_log_buffer) == 0)
+        printf("Unable to open access log %s, requests are not logged\n", cfg->access_log);
+    if (cfg->metrics_path[0] != '\0' && create_metrics(n_workers) == 0)
+        printf("Unable to create metrics, %s is not served\n", cfg->metrics_path);
 
-        int *new_conn_fd = (int *)malloc(sizeof(int));
-        *new_conn_fd = conn_fd;
-        if (pthread_create(&tid, NULL, handle_request, (void *)new_conn_fd) < 0) {
-            perror("Unable to create new thread");
-            close(conn_fd);
-            free(new_conn_fd);
-            continue;
-        }
+    if (create_admission_control(cfg->max_connections, cfg->max_connections_per_ip) == 0)
+        printf("Unable to create admission control, connections are not limited\n");
+    if (cfg->proxy_routes[0] != '\0' &&
+        create_proxy(cfg->proxy_routes, cfg->proxy_balance, cfg->proxy_pool_size,
+                     cfg->proxy_health_interval, cfg->proxy_timeout) == 0) {
+        printf("Unable to set up proxy routes %s\n", cfg->proxy_routes);
+        exit(-1);
+    }
 
-        if (pthread_detach(tid) != 0) {
-            perror("Unable to detach new thread");
-            continue;
-        }
+    keepalive_timeout = cfg->keepalive_timeout;
+    bool use_uring = strcmp(cfg->event_backend, "io_uring") == 0;
+    if (start_workers(listen_fds, listen_fds_per_worker, per_worker_listen_fds, n_workers,
+                      cfg->pin_workers, use_uring, keepalive_timeout, handle_request) == 0) {
+        perror("Unable to start worker threads");
+        exit(-1);
     }
+
+    printf("Server Started...\nListening on http://%s:%d\n", cfg->host, cfg->port);
+    if (cfg->tls_port > 0)
+        printf("Listening on https://%s:%d\n", cfg->host, cfg->tls_port);
+    printf("Press Ctrl+C to exit.\n\n");
+    _take_over_from_parent();
+
+    int sig = _wait_for_signals(&signal_set);
+    int timeout = get_server_config()->shutdown_timeout;
+    printf("\nReceived %s, finishing requests in flight for up to %d seconds\n", strsignal(sig),
+           timeout);
+    if (drain_workers(timeout) == 0)
+        printf("Requests still in flight after %d seconds are closed\n", timeout);
 }
 
 void stop_server() {
     printf("\nShutting down server.....\n");
-    if (tcp_socket != -1)
-        close(tcp_socket);
-    tcp_socket = -1;
+    stop_workers();
+    destroy_tls();
+    destroy_admission_control();
+    destroy_proxy();
+    destroy_access_log();
+    destroy_metrics();
+    destroy_file_cache();
+    destroy_fd_cache();
+    free(file_cache_root);
+    file_cache_root = NULL;
+    for (int fd_no = 0; fd_no < n_listen_fds; fd_no++)
+        close(listen_fds[fd_no]);
+    free(listen_fds);
+    listen_fds = NULL;
+    n_listen_fds = 0;
     destroy_mime_table();
     unload_config();
 }
 
-void setup_socket() {
-    if ((tcp_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-        perror("Unable to get IPv4 TCP Socket using socket()");
+void setup_socket(const int n_workers) {
+    if (_inherit_listen_fds(n_workers))
+        return;
+
+    const server_config *cfg = get_server_config();
+    struct addrinfo *addrs = NULL, *tls_addrs = NULL;
+    if ((addrs = resolve_listen_addresses(cfg->host, cfg->port)) == NULL ||
+        (cfg->tls_port > 0 &&
+         (tls_addrs = resolve_listen_addresses(cfg->host, cfg->tls_port)) == NULL))
         exit(-1);
-    }
 
-    int on = 1;
-    setsockopt(tcp_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    listen_options opts = {.backlog = cfg->listen_backlog,
+                           .reuse_port = cfg->reuse_port,
+                           .v6_only = has_mixed_address_families(addrs),
+                           .defer_accept = cfg->tcp_defer_accept,
+                           .fastopen = cfg->tcp_fastopen};
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(get_config_int(PORT_CONF_KEY));
-    inet_pton(AF_INET, get_config_str(HOST_CONF_KEY), &(server_addr.sin_addr));
-    socklen_t server_addr_len = sizeof(server_addr);
+    // Every group has the HTTP sockets first, then the HTTPS ones.
+    struct addrinfo *addr_lists[] = {addrs, tls_addrs};
+    int n_addrs = 0;
+    for (int list_no = 0; list_no < 2; list_no++)
+        for (struct addrinfo *addr = addr_lists[list_no]; addr != NULL; addr = addr->ai_next)
+            n_addrs++;
 
-    if (bind(tcp_socket, (struct sockaddr *)&server_addr, server_addr_len) < 0) {
-        perror("Unable to bind socket to server address");
+    // With SO_REUSEPORT every worker gets a socket per address, otherwise the sockets are shared.
+    int n_groups = cfg->reuse_port ? n_workers : 1;
+    if ((listen_fds = calloc(n_groups * n_addrs, sizeof(int))) == NULL) {
+        perror("Unable to allocate listening sockets");
         exit(-1);
     }
 
-    if (listen(tcp_socket, BACKLOG) < 0) {
-        perror("Unable to listen to socket");
-        exit(-1);
+    // Sockets are bound in worker order, so the n-th socket of a SO_REUSEPORT group is worker n's.
+    for (int group = 0; group < n_groups; group++) {
+        for (int list_no = 0; list_no < 2; list_no++) {
+            for (struct addrinfo *addr = addr_lists[list_no]; addr != NULL; addr = addr->ai_next) {
+                int listen_fd = -1;
+                if ((listen_fd = create_listen_socket(addr, &opts)) < 0) {
+                    perror("Unable to listen on server address");
+                    exit(-1);
+                }
+                listen_fds[n_listen_fds++] = listen_fd;
+                if (list_no == 1)
+                    add_tls_listen_fd(listen_fd);
+
+                if (cfg->reuse_port && cfg->pin_workers)
+                    set_incoming_cpu(listen_fd, get_worker_cpu(group));
+            }
+        }
+    }
+    listen_fds_per_worker = n_addrs;
+    per_worker_listen_fds = cfg->reuse_port;
+    freeaddrinfo(addrs);
+    if (tls_addrs != NULL)
+        freeaddrinfo(tls_addrs);
+
+    if (cfg->reuse_port && cfg->pin_workers) {
+        for (int fd_no = 0; fd_no < n_addrs; fd_no++)
+            if (attach_reuseport_cpu_steering(listen_fds[fd_no], n_workers) == 0)
+                perror("Unable to attach CPU steering program, using SO_INCOMING_CPU");
     }
 }
 
-void *handle_request(void *new_conn_fd) {
+conn_state handle_request(connection *conn) {
+    char rel_path[FILE_PATH_BUF_SIZE];
     char file_path[FILE_PATH_BUF_SIZE];
-    int conn_fd = *((int *)new_conn_fd);
-    free(new_conn_fd);
+    char sibling_path[FILE_PATH_BUF_SIZE];
+    char header_buf[RES_HEADER_BUF_SIZE];
 
-    FILE *file = NULL;
+    const server_config *cfg = get_server_config();
+    fd_cache_entry *file = NULL, *sibling = NULL;
     request *req = NULL;
     response *res = NULL;
+    conn_state next_state = CONN_CLOSING;
 
-    req = get_request(conn_fd);
-    if (strcmp(req->url, "/") == 0) {
-        free(req->url);
-        req->url = get_config_str(PAGE_CONF_KEY);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // A proxied request goes on where it waited for its backend or the client.
+    if (conn->proxy != NULL) {
+        req = conn->proxy->req;
+        next_state = _continue_proxy_request(conn);
+        if (next_state != CONN_PROXYING)
+            clean_request(file, req, res);
+        return next_state;
     }
-    printf("> (%s) (%s) (%s)\n", req->http_method, req->url, req->http_ver);
-    sprintf(file_path, "%s%s", get_config_str(SITE_DIR_CONF_KEY), req->url);
 
-    file = NULL;
-    if ((file = fopen(file_path, "rb")) == NULL) {
+    // Request heads that couldn't be parsed are answered without a request, the stream is lost.
+    if (conn->error_status != 0)
+        return _send_error(conn, NULL, conn->error_status, CONN_CLOSING, &start);
+
+    // The request head was already parsed by the worker, the request points into the receive buffer.
+    req = parse_request_in_place(conn->recv_buf, &conn->parser, conn->fd, conn->arena);
+    if (req == NULL)
+        return _send_error(conn, NULL, 500, CONN_CLOSING, &start);
+
+    if (_keep_connection_alive(conn, req))
+        next_state = CONN_READING;
+
+    // Proxied requests keep their body, it is streamed to the backend.
+    proxy_route *route = req->url[0] == '/' ? find_proxy_route(req->url) : NULL;
+    if (route != NULL) {
+        next_state = _proxy_request(conn, req, route, next_state, &start);
+        if (next_state != CONN_PROXYING)
+            clean_request(file, req, res);
+        return next_state;
+    }
+
+    // No response uses the request body, it is dropped so the next request can be found.
+    int body_discarded = discard_connection_body(conn, cfg->max_request_body_size);
+
+    bool is_head = strcmp(req->http_method, "HEAD") == 0;
+    if (!is_head && strcmp(req->http_method, "GET") != 0) {
+        next_state =
+            _send_error(conn, req, 405, body_discarded ? next_state : CONN_CLOSING, &start);
         clean_request(file, req, res);
-        return 1;
+        return next_state;
+    }
+
+    if (!body_discarded) {
+        _send_error(conn, req, 413, CONN_CLOSING, &start);
+        clean_request(file, req, res);
+        return CONN_CLOSING;
+    }
+
+    if (req->url[0] != '/') {
+        next_state = _send_error(conn, req, 400, next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
     }
 
-    res = create_response_from_request(req);
-    res->status_code = strdup("200 OK");
-    set_response_header(res, "content-type", get_mimetype_for_url(req->url, NULL));
+    if (cfg->metrics_path[0] != '\0' && is_metrics_enabled() &&
+        strcmp(req->url, cfg->metrics_path) == 0) {
+        next_state = _send_metrics(conn, req, next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
+    }
+
+    const char *url =
+        strcmp(req->url, "/") == 0 && cfg->default_page[0] != '\0' ? cfg->default_page : req->url;
+    if (strlen(url) < sizeof(rel_path) && !resolve_site_path(url, rel_path, sizeof(rel_path))) {
+        next_state = _send_error(conn, req, 400, next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
+    }
+
+    // Resolved paths are canonical, so a file is cached under a single key.
+    if (strlen(url) >= sizeof(rel_path) ||
+        snprintf(file_path, sizeof(file_path), "%s/%s", cfg->site_root_dir, rel_path) >=
+            (int)sizeof(file_path)) {
+        next_state = _send_error(conn, req, 404, next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
+    }
+
+    bool use_cache = file_cache_root != NULL && strcmp(file_cache_root, cfg->site_root_dir) == 0;
+
+    // URLs of directories are served as their index file, or as a listing of the directory.
+    char index_url[FILE_PATH_BUF_SIZE];
+    if (url[strlen(url) - 1] == '/') {
+        // Listings are cached under the directory path followed by `/`, the key `inotify` removes.
+        char listing_path[FILE_PATH_BUF_SIZE + 1];
+        snprintf(listing_path, sizeof(listing_path), rel_path[0] != '\0' ? "%s/" : "%s",
+                 file_path);
+
+        file_cache_entry *listing = NULL;
+        if (cfg->autoindex && use_cache && (listing = get_file_cache_entry(listing_path)) != NULL) {
+            next_state = _serve_directory_listing(conn, req, listing, next_state, &start);
+            release_file_cache_entry(listing);
+            clean_request(file, req, res);
+            return next_state;
+        }
+
+        if (!_resolve_directory_index(cfg, url, rel_path, file_path, index_url)) {
+            next_state = _send_directory_listing(conn, req, rel_path, listing_path, use_cache,
+                                                 next_state, &start);
+            clean_request(file, req, res);
+            return next_state;
+        }
+        url = index_url;
+    }
+
+    // Cache entries of precompressed files are only sent as a coding of the uncompressed file.
+    use_cache = use_cache && !(cfg->precompressed_files &&
+                               get_precompressed_file_encoding(url) != CONTENT_ENCODING_IDENTITY);
+
+    // Range requests are served from disk, so the ranges are sent with sendfile().
+    bool has_range = strcmp(req->http_method, "GET") == 0 &&
+                     get_known_request_header(req, HTTP_HEADER_RANGE) != NULL;
+
+    const char *mimetype = get_mimetype_for_url(url, NULL);
+    const char *cache_control = get_cache_control(cfg, url, mimetype);
+
+    // Responses for compressible files depend on Accept-Encoding, ranges are never compressed.
+    bool vary = (cfg->precompressed_files || cfg->gzip_level > 0) &&
+                is_mimetype_compressible(mimetype);
+    unsigned int accepted = 0;
+    if (vary && !has_range)
+        accepted =
+            parse_accept_encoding(get_known_request_header(req, HTTP_HEADER_ACCEPT_ENCODING));
+
+    // Cache hits are served from memory without touching the filesystem.
+    file_cache_entry *entry = NULL, *variant = NULL;
+    content_encoding encoding = CONTENT_ENCODING_IDENTITY;
+    bool is_cached = false;
+    if (use_cache && !has_range && (entry = get_file_cache_entry(file_path)) != NULL) {
+        encoding = select_content_encoding(accepted, get_file_cache_entry_encodings(entry));
+        variant = get_file_cache_entry_variant(entry, encoding);
+        release_file_cache_entry(entry);
+
+        if (variant != NULL) {
+            next_state =
+                _serve_cached_file(conn, req, variant, cache_control, vary, next_state, &start);
+            release_file_cache_entry(variant);
+            clean_request(file, req, res);
+            return next_state;
+        }
+
+        // The precompressed sibling isn't cached yet, it is read from disk below.
+        is_cached = true;
+    }
+
+    if ((file = open_fd_cache_entry(cfg->site_root_dir, rel_path)) == NULL) {
+        // Relative links of a directory's page only work from a URL ending with `/`.
+        if (errno == EISDIR)
+            next_state = _send_directory_redirect(conn, req, rel_path, next_state, &start);
+        else
+            next_state = _send_error(conn, req, _get_open_error_status(errno), next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
+    }
+
+    char etag[ETAG_BUF_SIZE], last_modified[HTTP_DATE_BUF_SIZE];
+    format_etag(&file->file_stat, etag);
+    format_http_date(file->file_stat.st_mtime, last_modified);
+
+    byte_range ranges[REQ_MAX_RANGES];
+    int n_ranges = 0;
+    if (has_range && !is_request_not_modified(req, etag, file->file_stat.st_mtime) &&
+        is_request_range_fresh(req, etag, file->file_stat.st_mtime))
+        n_ranges = parse_request_ranges(req, file->file_stat.st_size, ranges, REQ_MAX_RANGES);
+
+    if ((res = create_response_from_request(req)) == NULL) {
+        next_state = _send_error(conn, req, 500, next_state, &start);
+        clean_request(file, req, res);
+        return next_state;
+    }
     set_response_header(res, "server", SERVER_NAME);
+    set_response_header(res, "accept-ranges", "bytes");
+    if (cache_control != NULL)
+        set_response_header(res, "cache-control", cache_control);
+    if (vary)
+        set_response_header(res, "vary", "accept-encoding");
 
-    if (send_response_head(res) == 0) {
+    if (n_ranges != 0) {
+        set_response_header(res, "etag", etag);
+        set_response_header(res, "last-modified", last_modified);
+
+        ssize_t sent_size = _send_file_ranges(conn, res, file->fd, file->file_stat.st_size,
+                                              mimetype, ranges, n_ranges, next_state);
+        _log_request(conn, req, n_ranges > 0 ? 206 : 416, sent_size > 0 ? sent_size : 0, &start);
         clean_request(file, req, res);
-        return 2;
-    };
+        return sent_size < 0 ? CONN_CLOSING : next_state;
+    }
+
+    res->status_code = "200 OK";
+    set_response_header(res, "content-type", mimetype);
+
+    bool use_cache_entry = use_cache && !has_range;
+    unsigned int siblings = 0;
+    if (!is_cached && vary && cfg->precompressed_files)
+        siblings = find_precompressed_files(file_path);
+    if (!is_cached)
+        encoding = select_content_encoding(accepted, siblings);
+
+    // The entry of the uncompressed file records the siblings and holds the gzip compressed copy.
+    if (!is_cached && use_cache_entry && is_file_cacheable(file->file_stat.st_size) &&
+        (entry = add_file_cache_entry(file_path, file->fd, &file->file_stat, res, siblings,
+                                      vary ? cfg->gzip_level : 0)) != NULL) {
+        encoding = select_content_encoding(accepted, get_file_cache_entry_encodings(entry));
+        variant = get_file_cache_entry_variant(entry, encoding);
+        release_file_cache_entry(entry);
+
+        if (variant != NULL) {
+            next_state =
+                _serve_cached_file(conn, req, variant, cache_control, vary, next_state, &start);
+            release_file_cache_entry(variant);
+            clean_request(file, req, res);
+            return next_state;
+        }
+    }
+
+    if (encoding != CONTENT_ENCODING_IDENTITY &&
+        (sibling = _open_precompressed_file(cfg->site_root_dir, rel_path, encoding,
+                                            sibling_path)) != NULL) {
+        release_fd_cache_entry(file);
+        file = sibling;
+        set_response_header(res, "content-encoding", get_content_encoding_name(encoding));
+        format_etag(&file->file_stat, etag);
+        format_http_date(file->file_stat.st_mtime, last_modified);
 
-    if (send_response_file(res, file) == 0) {
-        printf("Error Sending File: %s for URL: %s. %s\n", file_path, req->url, strerror(errno));
+        if (use_cache_entry && is_file_cacheable(file->file_stat.st_size) &&
+            (entry = add_file_cache_entry(sibling_path, file->fd, &file->file_stat, res, 0, 0)) !=
+                NULL) {
+            next_state =
+                _serve_cached_file(conn, req, entry, cache_control, vary, next_state, &start);
+            release_file_cache_entry(entry);
+            clean_request(file, req, res);
+            return next_state;
+        }
+    }
+
+    if (is_request_not_modified(req, etag, file->file_stat.st_mtime)) {
+        next_state =
+            _send_not_modified(conn, req, etag, last_modified, cache_control, vary, next_state);
+        _log_request(conn, req, 304, 0, &start);
         clean_request(file, req, res);
-        return 3;
+        return next_state;
+    }
+
+    sprintf(header_buf, "%lld", (long long)file->file_stat.st_size);
+    set_response_header(res, "content-length", header_buf);
+    set_response_header(res, "etag", etag);
+    set_response_header(res, "last-modified", last_modified);
+    _set_connection_headers(conn, res, next_state);
+
+    // Responses to HEAD requests have the headers of a GET response, without the body.
+    ssize_t sent_size = is_head ? send_response_with_body(res, NULL, 0)
+                                : send_response_with_fd(res, file->fd, 0, file->file_stat.st_size);
+    _log_request(conn, req, 200, sent_size > 0 ? sent_size : 0, &start);
+    if (sent_size != (is_head ? 0 : file->file_stat.st_size)) {
+        printf("Error Sending File: %s for URL: %s. %s\n", file_path, url, strerror(errno));
+        clean_request(file, req, res);
+        return CONN_CLOSING;
     }
 
     clean_request(file, req, res);
-    return 0;
+    return next_state;
 }
 
-void clean_request(FILE *file, request *req, response *res) {
+void clean_request(fd_cache_entry *file, request *req, response *res) {
     if (file != NULL) {
-        fclose(file);
+        release_fd_cache_entry(file);
         file = NULL;
     }
 
+    // Connection socket is owned and closed by the worker event loop.
     if (req != NULL) {
+        req->conn_fd = -1;
         close_request(req);
         req = NULL;
     }
@@ -166,3 +567,676 @@ void clean_request(FILE *file, request *req, response *res) {
         res = NULL;
     }
 }
+
+int _keep_connection_alive(const connection *conn, const request *req) {
+    if (is_worker_draining())
+        return 0;
+
+    if ((int)conn->n_requests + 1 >= get_server_config()->keepalive_requests)
+        return 0;
+
+    const char *connection = get_known_request_header(req, HTTP_HEADER_CONNECTION);
+    if (strcmp(req->http_ver, "HTTP/1.1") == 0)
+        return connection == NULL || strcasestr(connection, "close") == NULL;
+
+    return connection != NULL && strcasestr(connection, "keep-alive") != NULL;
+}
+
+conn_state _send_cached_file(const connection *conn, const request *req,
+                             const file_cache_entry *entry, conn_state next_state) {
+    char status_line[RES_HEADER_BUF_SIZE];
+    char headers[RES_HEADER_BUF_SIZE];
+    char keep_alive[RES_HEADER_BUF_SIZE];
+
+    snprintf(status_line, sizeof(status_line), "%s 200 OK\r\n", req->http_ver);
+    if (next_state == CONN_READING)
+        snprintf(headers, sizeof(headers), "connection: keep-alive\r\nkeep-alive: %s\r\n\r\n",
+                 _format_keep_alive(conn, keep_alive));
+    else
+        strcpy(headers, "connection: close\r\n\r\n");
+
+    bool with_body = strcmp(req->http_method, "HEAD") != 0;
+    if (send_file_cache_entry(conn->fd, entry, status_line, headers, with_body) !=
+        (with_body ? (ssize_t)entry->body_len : 0))
+        return CONN_CLOSING;
+
+    return next_state;
+}
+
+conn_state _serve_cached_file(const connection *conn, const request *req,
+                              const file_cache_entry *entry, const char *cache_control,
+                              const bool vary, conn_state next_state,
+                              const struct timespec *start) {
+    if (is_request_not_modified(req, entry->etag, entry->file_stat.st_mtime)) {
+        next_state = _send_not_modified(conn, req, entry->etag, entry->last_modified,
+                                        cache_control, vary, next_state);
+        _log_request(conn, req, 304, 0, start);
+        return next_state;
+    }
+
+    next_state = _send_cached_file(conn, req, entry, next_state);
+    bool with_body = next_state != CONN_CLOSING && strcmp(req->http_method, "HEAD") != 0;
+    _log_request(conn, req, 200, with_body ? entry->body_len : 0, start);
+    return next_state;
+}
+
+conn_state _send_not_modified(const connection *conn, const request *req, const char *etag,
+                              const char *last_modified, const char *cache_control,
+                              const bool vary, conn_state next_state) {
+    response *res = NULL;
+    if ((res = create_response_from_request(req)) == NULL)
+        return CONN_CLOSING;
+
+    res->status_code = "304 Not Modified";
+    set_response_header(res, "server", SERVER_NAME);
+    set_response_header(res, "etag", etag);
+    set_response_header(res, "last-modified", last_modified);
+    if (cache_control != NULL)
+        set_response_header(res, "cache-control", cache_control);
+    if (vary)
+        set_response_header(res, "vary", "accept-encoding");
+    _set_connection_headers(conn, res, next_state);
+
+    if (send_response_with_body(res, NULL, 0) < 0)
+        next_state = CONN_CLOSING;
+
+    close_response(res);
+    return next_state;
+}
+
+conn_state _send_error(const connection *conn, const request *req, const int status,
+                       conn_state next_state, const struct timespec *start) {
+    // Without memory for a response, the error is sent from the stack and the connection closed.
+    response *res = req != NULL ? create_response_from_request(req) : create_response(conn->fd);
+    if (res == NULL) {
+        send_raw_error_response(conn->fd, status);
+        _log_request(conn, req, status, 0, start);
+        return CONN_CLOSING;
+    }
+
+    if (res->http_ver == NULL)
+        res->http_ver = "HTTP/1.1";
+    set_response_header(res, "server", SERVER_NAME);
+    if (status == 405)
+        set_response_header(res, "allow", "GET, HEAD");
+    _set_connection_headers(conn, res, next_state);
+
+    ssize_t sent_size =
+        send_error_response(res, status, req != NULL && strcmp(req->http_method, "HEAD") == 0);
+    _log_request(conn, req, status, sent_size > 0 ? sent_size : 0, start);
+
+    close_response(res);
+    return sent_size < 0 ? CONN_CLOSING : next_state;
+}
+
+conn_state _send_metrics(const connection *conn, const request *req, conn_state next_state,
+                         const struct timespec *start) {
+    char content_length[32];
+    GString *body = NULL;
+    response *res = NULL;
+
+    if ((body = format_metrics()) == NULL || (res = create_response_from_request(req)) == NULL) {
+        if (body != NULL)
+            g_string_free(body, TRUE);
+        return _send_error(conn, req, 500, next_state, start);
+    }
+
+    res->status_code = "200 OK";
+    set_response_header(res, "server", SERVER_NAME);
+    set_response_header(res, "content-type", METRICS_CONTENT_TYPE);
+    set_response_header(res, "cache-control", "no-store");
+    sprintf(content_length, "%zu", body->len);
+    set_response_header(res, "content-length", content_length);
+    _set_connection_headers(conn, res, next_state);
+
+    ssize_t body_size = strcmp(req->http_method, "HEAD") != 0 ? (ssize_t)body->len : 0;
+    ssize_t sent_size = send_response_with_body(res, body->str, body_size);
+    _log_request(conn, req, 200, sent_size > 0 ? sent_size : 0, start);
+
+    close_response(res);
+    g_string_free(body, TRUE);
+    return sent_size != body_size ? CONN_CLOSING : next_state;
+}
+
+conn_state _proxy_request(connection *conn, request *req, proxy_route *route,
+                          conn_state next_state, const struct timespec *start) {
+    const server_config *cfg = get_server_config();
+    int status = 502;
+    proxy_conn *upstream =
+        open_proxy_request(route, conn, req, cfg->max_request_body_size, &status);
+    if (upstream == NULL)
+        return _fail_proxy_request(conn, req, status, next_state, start);
+
+    // The worker calls the handler again whenever the proxied request can go on.
+    upstream->next_state = next_state;
+    upstream->start = *start;
+    conn->proxy = upstream;
+    return _continue_proxy_request(conn);
+}
+
+conn_state _continue_proxy_request(connection *conn) {
+    proxy_conn *upstream = conn->proxy;
+    const request *req = upstream->req;
+    int status = 502;
+    int result = forward_proxy_request(upstream, &status);
+    if (result == 2)
+        return CONN_PROXYING;
+    if (result == 0)
+        return _fail_proxy_request(conn, req, status, upstream->next_state, &upstream->start);
+
+    if (upstream->res == NULL) {
+        response *res = create_response_from_request(req);
+        if (res == NULL)
+            return _send_error(conn, req, 500, CONN_CLOSING, &upstream->start);
+        upstream->res = res;
+
+        // The status code and reason phrase of the backend follow its version (`HTTP/1.x `).
+        const http_parser *parser = &upstream->parser;
+        size_t status_off = parser->version.off + parser->version.len + 1;
+        res->status_code = arena_strndup(res->arena, upstream->buf + status_off,
+                                         parser->reason.off + parser->reason.len - status_off);
+        if (res->status_code == NULL) {
+            _log_request(conn, req, parser->status, 0, &upstream->start);
+            return CONN_CLOSING;
+        }
+        if (res->http_ver == NULL)
+            res->http_ver = "HTTP/1.1";
+        if (upstream->until_close || upstream->dechunk)
+            upstream->next_state = CONN_CLOSING;
+        _set_connection_headers(conn, res, upstream->next_state);
+    }
+
+    if ((result = relay_proxy_response(upstream)) == 2)
+        return CONN_PROXYING;
+    _log_request(conn, req, upstream->parser.status, upstream->n_sent, &upstream->start);
+    return result == 0 ? CONN_CLOSING : upstream->next_state;
+}
+
+conn_state _fail_proxy_request(connection *conn, const request *req, const int status,
+                               const conn_state next_state, const struct timespec *start) {
+    // A body the backend didn't answer is dropped, so the next request can be found.
+    const server_config *cfg = get_server_config();
+    int body_discarded = (status == 502 || status == 504) &&
+                         discard_connection_body(conn, cfg->max_request_body_size);
+    return _send_error(conn, req, status, body_discarded ? next_state : CONN_CLOSING, start);
+}
+
+ssize_t _send_file_ranges(const connection *conn, response *res, const int file_fd,
+                          const off_t file_size, const char *mimetype, const byte_range *ranges,
+                          const int n_ranges, const conn_state next_state) {
+    char header_buf[RES_HEADER_BUF_SIZE];
+
+    if (n_ranges == REQ_RANGE_NOT_SATISFIABLE) {
+        res->status_code = "416 Range Not Satisfiable";
+        sprintf(header_buf, "bytes */%lld", (long long)file_size);
+        set_response_header(res, "content-range", header_buf);
+        set_response_header(res, "content-length", "0");
+        _set_connection_headers(conn, res, next_state);
+        return send_response_with_body(res, NULL, 0);
+    }
+
+    res->status_code = "206 Partial Content";
+    if (n_ranges == 1) {
+        size_t range_size = ranges[0].last - ranges[0].first + 1;
+        set_response_header(res, "content-type", mimetype);
+        sprintf(header_buf, "bytes %lld-%lld/%lld", (long long)ranges[0].first,
+                (long long)ranges[0].last, (long long)file_size);
+        set_response_header(res, "content-range", header_buf);
+        sprintf(header_buf, "%zu", range_size);
+        set_response_header(res, "content-length", header_buf);
+        _set_connection_headers(conn, res, next_state);
+
+        ssize_t sent_size = send_response_with_fd(res, file_fd, ranges[0].first, range_size);
+        return sent_size == (ssize_t)range_size ? sent_size : -1;
+    }
+
+    // The boundary only has to be absent from the parts, a timestamp is unlikely to be in them.
+    char boundary[64];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(boundary, sizeof(boundary), "nanows-%llx%09lx", (unsigned long long)now.tv_sec,
+             (unsigned long)now.tv_nsec);
+
+    size_t body_len =
+        get_multipart_ranges_length(ranges, n_ranges, file_size, mimetype, boundary);
+    snprintf(header_buf, sizeof(header_buf), "multipart/byteranges; boundary=%s", boundary);
+    set_response_header(res, "content-type", header_buf);
+    sprintf(header_buf, "%zu", body_len);
+    set_response_header(res, "content-length", header_buf);
+    _set_connection_headers(conn, res, next_state);
+
+    ssize_t sent_size =
+        send_response_with_ranges(res, file_fd, ranges, n_ranges, file_size, mimetype, boundary);
+    return sent_size == (ssize_t)body_len ? sent_size : -1;
+}
+
+conn_state _serve_directory_listing(const connection *conn, const request *req,
+                                    file_cache_entry *listing, conn_state next_state,
+                                    const struct timespec *start) {
+    const server_config *cfg = get_server_config();
+    const char *mimetype =
+        get_autoindex_content_type(parse_autoindex_format(cfg->autoindex_format));
+
+    // Listings are text, so they are compressed whenever gzip is enabled.
+    bool vary = cfg->gzip_level > 0;
+    unsigned int accepted =
+        vary ? parse_accept_encoding(get_known_request_header(req, HTTP_HEADER_ACCEPT_ENCODING))
+             : 0;
+    file_cache_entry *variant = get_file_cache_entry_variant(
+        listing, select_content_encoding(accepted, get_file_cache_entry_encodings(listing)));
+
+    next_state = _serve_cached_file(conn, req, variant, get_cache_control(cfg, req->url, mimetype),
+                                    vary, next_state, start);
+    release_file_cache_entry(variant);
+    return next_state;
+}
+
+conn_state _send_directory_listing(const connection *conn, const request *req,
+                                   const char *rel_path, const char *listing_path,
+                                   const bool use_cache, conn_state next_state,
+                                   const struct timespec *start) {
+    char url_path[FILE_PATH_BUF_SIZE + 2], content_length[32];
+    char last_modified[HTTP_DATE_BUF_SIZE];
+    const server_config *cfg = get_server_config();
+
+    struct stat dir_stat;
+    int dir_fd = open_site_directory(cfg->site_root_dir, rel_path, &dir_stat);
+    if (dir_fd < 0)
+        return _send_error(conn, req, _get_open_error_status(errno), next_state, start);
+
+    // Without autoindex, an existing directory without an index file is forbidden.
+    if (!cfg->autoindex) {
+        close(dir_fd);
+        return _send_error(conn, req, 403, next_state, start);
+    }
+
+    // Listings are generated for the canonical URL, so every URL of a directory shares one.
+    autoindex_format format = parse_autoindex_format(cfg->autoindex_format);
+    snprintf(url_path, sizeof(url_path), "/%s%s", rel_path, rel_path[0] != '\0' ? "/" : "");
+    GString *body = format_directory_listing(dir_fd, url_path, format);
+    int saved_errno = errno;
+    close(dir_fd);
+    if (body == NULL)
+        return _send_error(conn, req, _get_open_error_status(saved_errno), next_state, start);
+
+    response *res = NULL;
+    if ((res = create_response_from_request(req)) == NULL) {
+        g_string_free(body, TRUE);
+        return _send_error(conn, req, 500, next_state, start);
+    }
+
+    const char *mimetype = get_autoindex_content_type(format);
+    const char *cache_control = get_cache_control(cfg, req->url, mimetype);
+    set_response_header(res, "server", SERVER_NAME);
+    if (cache_control != NULL)
+        set_response_header(res, "cache-control", cache_control);
+
+    file_cache_entry *listing = NULL;
+    if (use_cache) {
+        if (cfg->gzip_level > 0)
+            set_response_header(res, "vary", "accept-encoding");
+        set_response_header(res, "content-type", mimetype);
+        listing = add_file_cache_buffer(listing_path, body->str, body->len, &dir_stat, res,
+                                        cfg->gzip_level);
+    }
+
+    if (listing != NULL) {
+        next_state = _serve_directory_listing(conn, req, listing, next_state, start);
+        release_file_cache_entry(listing);
+        close_response(res);
+        g_string_free(body, TRUE);
+        return next_state;
+    }
+
+    // Listings that can't be cached are sent as they are, without validators.
+    res->status_code = "200 OK";
+    set_response_header(res, "content-type", mimetype);
+    set_response_header(res, "last-modified", format_http_date(dir_stat.st_mtime, last_modified));
+    sprintf(content_length, "%zu", body->len);
+    set_response_header(res, "content-length", content_length);
+    _set_connection_headers(conn, res, next_state);
+
+    ssize_t body_size = strcmp(req->http_method, "HEAD") != 0 ? (ssize_t)body->len : 0;
+    ssize_t sent_size = send_response_with_body(res, body->str, body_size);
+    _log_request(conn, req, 200, sent_size > 0 ? sent_size : 0, start);
+
+    close_response(res);
+    g_string_free(body, TRUE);
+    return sent_size != body_size ? CONN_CLOSING : next_state;
+}
+
+conn_state _send_directory_redirect(const connection *conn, const request *req,
+                                    const char *rel_path, conn_state next_state,
+                                    const struct timespec *start) {
+    char location[FILE_PATH_BUF_SIZE + 2];
+    response *res = NULL;
+    if ((res = create_response_from_request(req)) == NULL)
+        return _send_error(conn, req, 500, next_state, start);
+
+    snprintf(location, sizeof(location), "/%s/", rel_path);
+    res->status_code = "301 Moved Permanently";
+    set_response_header(res, "server", SERVER_NAME);
+    set_response_header(res, "location", location);
+    set_response_header(res, "content-length", "0");
+    _set_connection_headers(conn, res, next_state);
+
+    ssize_t sent_size = send_response_with_body(res, NULL, 0);
+    _log_request(conn, req, 301, 0, start);
+
+    close_response(res);
+    return sent_size < 0 ? CONN_CLOSING : next_state;
+}
+
+int _resolve_directory_index(const server_config *cfg, const char *url, char *rel_path,
+                             char *file_path, char *index_url) {
+    char index_rel_path[FILE_PATH_BUF_SIZE], index_file_path[FILE_PATH_BUF_SIZE];
+    bool use_cache = file_cache_root != NULL && strcmp(file_cache_root, cfg->site_root_dir) == 0;
+
+    for (unsigned int i_no = 0; i_no < cfg->n_index_files; i_no++) {
+        const char *name = cfg->index_files[i_no];
+        if (snprintf(index_rel_path, sizeof(index_rel_path), "%s%s%s", rel_path,
+                     rel_path[0] != '\0' ? "/" : "", name) >= (int)sizeof(index_rel_path) ||
+            snprintf(index_file_path, sizeof(index_file_path), "%s/%s", cfg->site_root_dir,
+                     index_rel_path) >= (int)sizeof(index_file_path) ||
+            snprintf(index_url, FILE_PATH_BUF_SIZE, "%s%s", url, name) >= FILE_PATH_BUF_SIZE)
+            continue;
+
+        // Cached index files are found without touching the filesystem.
+        file_cache_entry *entry = use_cache ? get_file_cache_entry(index_file_path) : NULL;
+        fd_cache_entry *file = entry == NULL
+                                   ? open_fd_cache_entry(cfg->site_root_dir, index_rel_path)
+                                   : NULL;
+        if (entry == NULL && file == NULL)
+            continue;
+        release_file_cache_entry(entry);
+        release_fd_cache_entry(file);
+
+        strcpy(rel_path, index_rel_path);
+        strcpy(file_path, index_file_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+int _get_open_error_status(const int err) {
+    if (err == EACCES)
+        return 403;
+    if (err == ENOENT || err == ENOTDIR || err == ENAMETOOLONG || err == EXDEV || err == ELOOP)
+        return 404;
+    return 500;
+}
+
+fd_cache_entry *_open_precompressed_file(const char *root_dir, const char *rel_path,
+                                         const content_encoding encoding, char *sibling_path) {
+    char sibling_rel_path[FILE_PATH_BUF_SIZE];
+    const char *suffix = get_content_encoding_suffix(encoding);
+
+    if (snprintf(sibling_rel_path, sizeof(sibling_rel_path), "%s%s", rel_path, suffix) >=
+            (int)sizeof(sibling_rel_path) ||
+        snprintf(sibling_path, FILE_PATH_BUF_SIZE, "%s/%s", root_dir, sibling_rel_path) >=
+            FILE_PATH_BUF_SIZE)
+        return NULL;
+
+    return open_fd_cache_entry(root_dir, sibling_rel_path);
+}
+
+void _set_connection_headers(const connection *conn, response *res, const conn_state next_state) {
+    char keep_alive[RES_HEADER_BUF_SIZE];
+
+    if (next_state == CONN_READING) {
+        set_response_header(res, "connection", "keep-alive");
+        set_response_header(res, "keep-alive", _format_keep_alive(conn, keep_alive));
+    } else {
+        set_response_header(res, "connection", "close");
+    }
+}
+
+void _log_request(const connection *conn, const request *req, const int status,
+                  const size_t bytes, const struct timespec *start) {
+    count_metrics_status(status);
+    if (!is_access_log_enabled())
+        return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Requests whose head couldn't be parsed are logged without the request line and headers.
+    access_log_entry entry = {
+        .peer_addr = &conn->peer_addr,
+        .method = req != NULL ? req->http_method : NULL,
+        .url = req != NULL ? req->url : NULL,
+        .http_ver = req != NULL ? req->http_ver : NULL,
+        .referer = req != NULL ? get_known_request_header(req, HTTP_HEADER_REFERER) : NULL,
+        .user_agent = req != NULL ? get_known_request_header(req, HTTP_HEADER_USER_AGENT) : NULL,
+        .status = status,
+        .bytes = bytes,
+        .latency_us =
+            (end.tv_sec - start->tv_sec) * 1000000L + (end.tv_nsec - start->tv_nsec) / 1000,
+    };
+    log_access(&entry);
+}
+
+char *_format_keep_alive(const connection *conn, char *buf) {
+    sprintf(buf, "timeout=%d, max=%d", keepalive_timeout,
+            get_server_config()->keepalive_requests - (int)conn->n_requests - 1);
+    return buf;
+}
+
+int _wait_for_signals(const sigset_t *signal_set) {
+    int sig = 0;
+    while (sigwait(signal_set, &sig) == 0) {
+        if (sig == SIGHUP) {
+            _reload_server();
+        } else if (sig == SIGUSR2) {
+            pid_t pid = _spawn_new_server();
+            if (pid > 0)
+                printf("Started new server process %d\n", pid);
+            else
+                perror("Unable to start new server process");
+        } else if (sig == SIGCHLD) {
+            int status = 0;
+            pid_t pid = 0;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+                printf("New server process %d exited with status %d, keeping this process\n", pid,
+                       WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        } else {
+            return sig;
+        }
+    }
+
+    return SIGTERM;
+}
+
+void _reload_server() {
+    if (reload_config() == 0) {
+        printf("Unable to reload configuration, keeping the current configuration\n");
+        return;
+    }
+    printf("Configuration reloaded from %s\n", CONF_FILE);
+
+    // Cached headers and listings depend on the configuration (e.g. cache_control, autoindex).
+    clear_file_cache();
+
+    const server_config *cfg = get_server_config();
+    const char *mime_types_file = cfg->mime_types_file[0] != '\0' ? cfg->mime_types_file : NULL;
+    if (reload_mime_table_from_file(mime_types_file) == 0)
+        printf("Unable to reload MIME types file %s, keeping the current MIME types\n",
+               mime_types_file);
+}
+
+int _inherit_listen_fds(const int n_workers) {
+    const char *listen_pid = getenv("LISTEN_PID"), *listen_fds_env = getenv("LISTEN_FDS");
+    const char *fd_names_env = getenv("LISTEN_FDNAMES");
+    bool is_inherited = listen_pid != NULL && atol(listen_pid) == getpid();
+    int n_fds = is_inherited && listen_fds_env != NULL ? atoi(listen_fds_env) : 0;
+    char *fd_names = n_fds > 0 && fd_names_env != NULL ? strdup(fd_names_env) : NULL;
+
+    // The variables are only meant for this process, not for the ones it starts.
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if (n_fds < 1)
+        return 0;
+
+    if ((listen_fds = calloc(n_fds, sizeof(int))) == NULL) {
+        perror("Unable to allocate listening sockets");
+        exit(-1);
+    }
+
+    // Sockets named "https" (e.g. `FileDescriptorName=https` of a systemd socket) serve HTTPS.
+    char *fd_name = NULL, *names_pos = fd_names;
+    for (int fd_no = 0; fd_no < n_fds; fd_no++) {
+        int listen_fd = LISTEN_FDS_START + fd_no;
+        if (fcntl(listen_fd, F_SETFD, FD_CLOEXEC) < 0 ||
+            fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK) < 0) {
+            perror("Unable to use inherited listening socket");
+            exit(-1);
+        }
+        listen_fds[n_listen_fds++] = listen_fd;
+
+        if ((fd_name = strsep(&names_pos, ":")) != NULL && strcmp(fd_name, "https") == 0) {
+            add_tls_listen_fd(listen_fd);
+            if (!is_tls_enabled())
+                printf("Inherited HTTPS socket %d without tls_port, its connections are closed\n",
+                       listen_fd);
+        }
+    }
+    free(fd_names);
+
+    // SO_REUSEPORT groups are only kept if there is one for every worker, otherwise all the
+    // workers share all the sockets.
+    per_worker_listen_fds = get_server_config()->reuse_port && n_fds % n_workers == 0;
+    listen_fds_per_worker = per_worker_listen_fds ? n_fds / n_workers : n_fds;
+    printf("Using %d inherited listening sockets\n", n_fds);
+    return 1;
+}
+
+pid_t _spawn_new_server() {
+    char listen_fds_env[32], listen_pid_env[32], parent_pid_env[64];
+    char *default_argv[] = {program_invocation_name, NULL};
+    char **argv = server_argv != NULL && server_argv[0] != NULL ? server_argv : default_argv;
+    int n_env = 0;
+    while (environ[n_env] != NULL)
+        n_env++;
+
+    // Everything is prepared before forking, this process has other threads and the child may
+    // only use async-signal-safe functions until it execs.
+    char *path = _find_server_binary(argv[0]);
+    char **envp = calloc(n_env + 5, sizeof(char *));
+    int *moved_fds = calloc(n_listen_fds > 0 ? n_listen_fds : 1, sizeof(int));
+    char *fd_names_env = malloc(sizeof("LISTEN_FDNAMES=") + n_listen_fds * sizeof("https:"));
+    if (path == NULL || envp == NULL || moved_fds == NULL || fd_names_env == NULL) {
+        free(path);
+        free(envp);
+        free(moved_fds);
+        free(fd_names_env);
+        return -1;
+    }
+
+    // The new process tells the HTTPS sockets apart by their names.
+    char *names_end = stpcpy(fd_names_env, "LISTEN_FDNAMES=");
+    for (int fd_no = 0; fd_no < n_listen_fds; fd_no++)
+        names_end = stpcpy(stpcpy(names_end, fd_no > 0 ? ":" : ""),
+                           is_tls_listen_fd(listen_fds[fd_no]) ? "https" : "http");
+
+    int env_len = 0;
+    for (int env_no = 0; env_no < n_env; env_no++)
+        if (strncmp(environ[env_no], "LISTEN_", 7) != 0 &&
+            strncmp(environ[env_no], PARENT_PID_ENV "=", sizeof(PARENT_PID_ENV)) != 0)
+            envp[env_len++] = environ[env_no];
+    snprintf(listen_fds_env, sizeof(listen_fds_env), "LISTEN_FDS=%d", n_listen_fds);
+    snprintf(parent_pid_env, sizeof(parent_pid_env), PARENT_PID_ENV "=%d", getpid());
+    envp[env_len++] = listen_fds_env;
+    envp[env_len++] = fd_names_env;
+    envp[env_len++] = parent_pid_env;
+    envp[env_len++] = listen_pid_env;
+
+    // The sockets are copied above their target range, so the child's dup2() calls don't
+    // overwrite a socket that isn't moved yet. The copies are closed by exec and after forking.
+    int n_moved = 0;
+    for (; n_moved < n_listen_fds; n_moved++)
+        if ((moved_fds[n_moved] = fcntl(listen_fds[n_moved], F_DUPFD_CLOEXEC,
+                                        LISTEN_FDS_START + n_listen_fds)) < 0)
+            break;
+
+    pid_t pid = n_moved == n_listen_fds ? fork() : -1;
+    if (pid == 0) {
+        // The child's pid is the only part of the environment that can't be prepared.
+        _format_listen_pid(listen_pid_env, getpid());
+
+        // dup2() clears FD_CLOEXEC, so the sockets are inherited by the new process.
+        for (int fd_no = 0; fd_no < n_listen_fds; fd_no++)
+            if (dup2(moved_fds[fd_no], LISTEN_FDS_START + fd_no) < 0)
+                _exit(127);
+
+        sigset_t empty_set;
+        sigemptyset(&empty_set);
+        sigprocmask(SIG_SETMASK, &empty_set, NULL);
+
+        execve(path, argv, envp);
+        _exit(127);
+    }
+
+    for (int fd_no = 0; fd_no < n_moved; fd_no++)
+        close(moved_fds[fd_no]);
+    free(path);
+    free(envp);
+    free(moved_fds);
+    free(fd_names_env);
+    return pid;
+}
+
+char *_find_server_binary(const char *name) {
+    if (strchr(name, '/') != NULL)
+        return strdup(name);
+
+    // Like execvp(), a name without a slash is looked up in `PATH`.
+    const char *search_path = getenv("PATH");
+    char *dirs = strdup(search_path != NULL ? search_path : "/usr/local/bin:/usr/bin:/bin");
+    char *dir = NULL, *dirs_pos = dirs, *path = NULL;
+    while (dirs != NULL && path == NULL && (dir = strsep(&dirs_pos, ":")) != NULL) {
+        path = malloc(strlen(dir) + strlen(name) + 3);
+        if (path == NULL)
+            break;
+
+        sprintf(path, "%s/%s", dir[0] != '\0' ? dir : ".", name);
+        if (access(path, X_OK) != 0) {
+            free(path);
+            path = NULL;
+        }
+    }
+
+    free(dirs);
+    return path;
+}
+
+void _format_listen_pid(char *buf, pid_t pid) {
+    char digits[16];
+    int n_digits = 0;
+
+    // snprintf() isn't async-signal-safe, this runs in the forked child.
+    do {
+        digits[n_digits++] = '0' + pid % 10;
+        pid /= 10;
+    } while (pid > 0 && n_digits < (int)sizeof(digits));
+
+    memcpy(buf, "LISTEN_PID=", sizeof("LISTEN_PID=") - 1);
+    buf += sizeof("LISTEN_PID=") - 1;
+    while (n_digits > 0)
+        *buf++ = digits[--n_digits];
+    *buf = '\0';
+}
+
+void _take_over_from_parent() {
+    const char *parent_pid_env = getenv(PARENT_PID_ENV);
+    pid_t parent_pid = parent_pid_env != NULL ? atoi(parent_pid_env) : 0;
+    unsetenv(PARENT_PID_ENV);
+
+    // Only the process that started this one and handed over its sockets is asked to shut down.
+    if (parent_pid <= 0 || parent_pid != getppid())
+        return;
+
+    if (kill(parent_pid, SIGTERM) == 0)
+        printf("Took over listening sockets from server process %d\n", parent_pid);
+}
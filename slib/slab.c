@@ -0,0 +1,235 @@
+/**
+ * @file slib/slab.c
+ * @brief Functions for the per-worker slab allocator.
+ *
+ * Implements functions defined in `include/slab.h`. Used by the workers to allocate connections,
+ * receive buffers and connection arenas from pools on their own NUMA node.
+ *
+ * The NUMA node of a slab is set with the `mbind` system call directly, so the server doesn't
+ * depend on libnuma.
+ *
+ * @see typedef struct slab_cache
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "slab.h"
+
+/**
+ * @brief Slab cache of the thread, set by `set_thread_slab_cache()`.
+ */
+static _Thread_local slab_cache *_thread_slab_cache = NULL;
+
+slab_cache *create_slab_cache(const size_t *sizes, const int n_sizes, const int numa_node) {
+    slab_cache *cache = calloc(1, sizeof(slab_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->numa_node = numa_node;
+    for (int i = 0; i < n_sizes && cache->n_pools < SLAB_CACHE_MAX_POOLS; i++) {
+        if (sizes[i] == 0 || sizes[i] > SLAB_SIZE)
+            continue;
+
+        // Slots are multiples of the header size, so every object stays 16 bytes aligned.
+        size_t obj_size = (sizes[i] + sizeof(slab_header) - 1) & ~(sizeof(slab_header) - 1);
+
+        // Insertion sort, so `slab_alloc()` can stop at the first pool that fits.
+        int pos = cache->n_pools;
+        while (pos > 0 && cache->pools[pos - 1].obj_size > obj_size)
+            pos--;
+        if (pos > 0 && cache->pools[pos - 1].obj_size == obj_size)
+            continue;
+
+        memmove(&cache->pools[pos + 1], &cache->pools[pos],
+                (cache->n_pools - pos) * sizeof(slab_pool));
+        cache->pools[pos] = (slab_pool){.obj_size = obj_size,
+                                        .slot_size = obj_size + sizeof(slab_header),
+                                        .numa_node = numa_node};
+        cache->n_pools++;
+    }
+
+    return cache;
+}
+
+void destroy_slab_cache(slab_cache *cache) {
+    if (cache == NULL)
+        return;
+
+    if (_thread_slab_cache == cache)
+        _thread_slab_cache = NULL;
+
+    for (int i = 0; i < cache->n_pools; i++) {
+        slab *s = cache->pools[i].slabs, *next = NULL;
+        while (s != NULL) {
+            next = s->next;
+            munmap(s, s->size);
+            s = next;
+        }
+    }
+
+    free(cache);
+    cache = NULL;
+}
+
+void set_thread_slab_cache(slab_cache *cache) {
+    _thread_slab_cache = cache;
+}
+
+void *slab_alloc(const size_t size) {
+    slab_cache *cache = _thread_slab_cache;
+
+    if (cache != NULL) {
+        for (int i = 0; i < cache->n_pools; i++) {
+            slab_pool *pool = &cache->pools[i];
+            if (pool->obj_size < size)
+                continue;
+
+            if (pool->free_list == NULL && !_add_slab(pool))
+                break;
+
+            slab_header *header = pool->free_list;
+            pool->free_list = header->next;
+            pool->n_free--;
+
+            header->size = pool->obj_size;
+            return header + 1;
+        }
+    }
+
+    if (size > SIZE_MAX - sizeof(slab_header))
+        return NULL;
+
+    slab_header *header = malloc(sizeof(slab_header) + size);
+    if (header == NULL)
+        return NULL;
+
+    header->pool = NULL;
+    header->size = size;
+    return header + 1;
+}
+
+void *slab_realloc(void *ptr, const size_t size) {
+    if (ptr == NULL)
+        return slab_alloc(size);
+
+    slab_header *header = (slab_header *)ptr - 1;
+    if (header->size >= size)
+        return ptr;
+
+    void *new_ptr = slab_alloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+
+    memcpy(new_ptr, ptr, header->size);
+    slab_free(ptr);
+    return new_ptr;
+}
+
+void slab_free(void *ptr) {
+    if (ptr == NULL)
+        return;
+
+    slab_header *header = (slab_header *)ptr - 1;
+    slab_pool *pool = header->pool;
+    if (pool == NULL) {
+        free(header);
+        return;
+    }
+
+    header->next = pool->free_list;
+    pool->free_list = header;
+    pool->n_free++;
+}
+
+int get_cpu_numa_node(const int cpu) {
+    char path[PATH_MAX];
+
+    if (cpu < 0)
+        return -1;
+
+    // The directory of the CPU has a `nodeN` link to its node.
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+
+    int node = -1;
+    struct dirent *dirent = NULL;
+    while ((dirent = readdir(dir)) != NULL) {
+        char *end = NULL;
+        if (strncmp(dirent->d_name, "node", 4) != 0 || dirent->d_name[4] < '0' ||
+            dirent->d_name[4] > '9')
+            continue;
+
+        long value = strtol(dirent->d_name + 4, &end, 10);
+        if (*end == '\0' && value < INT_MAX) {
+            node = (int)value;
+            break;
+        }
+    }
+    closedir(dir);
+
+    return node;
+}
+
+int _add_slab(slab_pool *pool) {
+    size_t size = SLAB_SIZE;
+    if (size < sizeof(slab) + pool->slot_size)
+        size = sizeof(slab) + pool->slot_size;
+
+    slab *s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (s == MAP_FAILED)
+        return 0;
+
+    // The policy only applies to pages faulted in after it is set, so it is set before the slab
+    // is touched. If it isn't set, the pages are placed on the node of the owning thread.
+    if (pool->numa_node >= 0)
+        _bind_numa_node(s, size, pool->numa_node);
+
+    s->next = pool->slabs;
+    s->size = size;
+    pool->slabs = s;
+
+    size_t n_objects = (size - sizeof(slab)) / pool->slot_size;
+    char *slot = (char *)(s + 1);
+    for (size_t i = 0; i < n_objects; i++, slot += pool->slot_size) {
+        slab_header *header = (slab_header *)slot;
+        header->pool = pool;
+        header->next = pool->free_list;
+        pool->free_list = header;
+    }
+
+    pool->n_objects += n_objects;
+    pool->n_free += n_objects;
+    return 1;
+}
+
+int _bind_numa_node(void *addr, const size_t len, const int numa_node) {
+    unsigned long node_mask[SLAB_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+
+    if (numa_node < 0 || numa_node >= SLAB_MAX_NUMA_NODES)
+        return 0;
+
+    node_mask[numa_node / (8 * sizeof(unsigned long))] |=
+        1UL << (numa_node % (8 * sizeof(unsigned long)));
+
+    // `MPOL_PREFERRED` falls back to the other nodes instead of failing when the node is full.
+    return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, node_mask, SLAB_MAX_NUMA_NODES + 1, 0) ==
+           0;
+}
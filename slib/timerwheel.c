@@ -0,0 +1,109 @@
+/**
+ * @file slib/timerwheel.c
+ * @brief Functions for the timer wheel of the connection timeouts.
+ *
+ * Implements functions defined in `include/timerwheel.h`. Used by the workers to close
+ * connections that are idle or too slow to send their request, without looking at every
+ * connection every second.
+ *
+ * @see typedef struct timer_wheel
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <stdlib.h>
+
+#include "timerwheel.h"
+
+timer_wheel *create_timer_wheel(const unsigned int n_slots, const long now) {
+    unsigned int size = 1;
+    while (size < n_slots)
+        size <<= 1;
+
+    timer_wheel *wheel = malloc(sizeof(timer_wheel));
+    if (wheel == NULL)
+        return NULL;
+
+    if ((wheel->slots = calloc(size, sizeof(timer_wheel_timer *))) == NULL) {
+        free(wheel);
+        return NULL;
+    }
+
+    wheel->mask = size - 1;
+    wheel->now = now;
+    wheel->n_timers = 0;
+    return wheel;
+}
+
+void destroy_timer_wheel(timer_wheel *wheel) {
+    if (wheel == NULL)
+        return;
+
+    free(wheel->slots);
+    free(wheel);
+}
+
+void schedule_timer(timer_wheel *wheel, timer_wheel_timer *timer, const long expires_at) {
+    if (timer->is_scheduled)
+        _unlink_timer(wheel, timer);
+
+    // Slots before `now` were already expired, so earlier timers go in the slot of `now`.
+    timer->expires_at = expires_at > wheel->now ? expires_at : wheel->now;
+    timer_wheel_timer **slot = &wheel->slots[timer->expires_at & wheel->mask];
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL)
+        (*slot)->prev = timer;
+    *slot = timer;
+    timer->is_scheduled = true;
+    wheel->n_timers++;
+}
+
+void cancel_timer(timer_wheel *wheel, timer_wheel_timer *timer) {
+    if (timer->is_scheduled)
+        _unlink_timer(wheel, timer);
+}
+
+timer_wheel_timer *expire_timer(timer_wheel *wheel, const long now) {
+    if (wheel->n_timers == 0) {
+        if (now > wheel->now)
+            wheel->now = now;
+        return NULL;
+    }
+
+    // Every slot is looked at once at most, however long ago the wheel was last expired.
+    if (now - wheel->now > (long)wheel->mask)
+        wheel->now = now - wheel->mask;
+
+    while (wheel->now <= now) {
+        for (timer_wheel_timer *timer = wheel->slots[wheel->now & wheel->mask]; timer != NULL;
+             timer = timer->next) {
+            if (timer->expires_at <= now) {
+                _unlink_timer(wheel, timer);
+                return timer;
+            }
+        }
+
+        // The slot of `now` gets new timers until the next second, so it is looked at again.
+        if (wheel->now == now)
+            break;
+        wheel->now++;
+    }
+
+    return NULL;
+}
+
+void _unlink_timer(timer_wheel *wheel, timer_wheel_timer *timer) {
+    if (timer->prev != NULL)
+        timer->prev->next = timer->next;
+    else
+        wheel->slots[timer->expires_at & wheel->mask] = timer->next;
+    if (timer->next != NULL)
+        timer->next->prev = timer->prev;
+
+    timer->prev = timer->next = NULL;
+    timer->is_scheduled = false;
+    wheel->n_timers--;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file slib/tls.c
+ * @brief Functions for the TLS sessions of HTTPS connections.
+ *
+ * Implements functions defined in `include/tls.h`. Used by the workers to run the TLS handshakes
+ * of new connections, and by connections and responses to receive and send through their session.
+ *
+ * Handshakes run on the non-blocking sockets, a step that would block returns to the worker event
+ * loop, which calls `continue_tls_handshake()` again once the socket is ready. Therefore, a slow
+ * client never holds up the other connections of its worker.
+ *
+ * The session table has a slot per file descriptor. A slot is only written by the worker owning
+ * the connection, between accepting and closing its socket, so it doesn't need a lock.
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+
+#include "tls.h"
+
+/**
+ * @private
+ * @brief Protocols the server selects with ALPN, in the wire format.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+const unsigned char _tls_alpn_protos[] = "\x02h2\x08http/1.1";
+
+/**
+ * @private
+ * @brief Whether ALPN selects `h2`, otherwise only the `http/1.1` part of `_tls_alpn_protos` is
+ * offered.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+bool _tls_http2 = false;
+
+/**
+ * @private
+ * @brief TLS context the sessions are created from, `NULL` if TLS is not set up.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+SSL_CTX *_tls_ctx = NULL;
+
+/**
+ * @private
+ * @brief TLS sessions indexed by file descriptor, `NULL` for sockets without a session.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+SSL **_tls_sessions = NULL;
+
+/**
+ * @private
+ * @brief Number of slots in `_tls_sessions`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int _tls_sessions_len = 0;
+
+/**
+ * @private
+ * @brief Listening sockets registered by `add_tls_listen_fd()`.
+ *
+ * These are private objects and should not be accessed directly.
+ */
+int _tls_listen_fds[TLS_MAX_LISTEN_FDS];
+int _n_tls_listen_fds = 0;
+
+int create_tls(const char *cert_file, const char *key_file, const int session_cache,
+               const bool ktls, const bool http2) {
+    if (_tls_ctx != NULL)
+        return 2;
+
+    struct rlimit fd_limit;
+    int n_fds = TLS_MAX_FDS;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < (rlim_t)n_fds)
+        n_fds = fd_limit.rlim_cur;
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == NULL)
+        return 0;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1 ||
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION) != 1 ||
+        (_tls_sessions = calloc(n_fds, sizeof(SSL *))) == NULL) {
+        ERR_clear_error();
+        SSL_CTX_free(ctx);
+        return 0;
+    }
+
+    // A client closing the socket without a close notification is treated as a clean close.
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_IGNORE_UNEXPECTED_EOF |
+                                 (ktls ? SSL_OP_ENABLE_KTLS : 0));
+    // Idle keep-alive connections don't hold on to their record buffers. Writes that would block
+    // return what was sent, the rest is retried from the connection's output queue, which may
+    // have moved it.
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS | SSL_MODE_ENABLE_PARTIAL_WRITE |
+                              SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // Tickets resume sessions without any state on the server, the cache serves older clients.
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"nanows", 6);
+    SSL_CTX_set_session_cache_mode(ctx, session_cache > 0 ? SSL_SESS_CACHE_SERVER
+                                                         : SSL_SESS_CACHE_OFF);
+    if (session_cache > 0)
+        SSL_CTX_sess_set_cache_size(ctx, session_cache);
+    SSL_CTX_set_num_tickets(ctx, 1);
+    SSL_CTX_set_alpn_select_cb(ctx, _select_tls_alpn, NULL);
+
+    _tls_sessions_len = n_fds;
+    _tls_http2 = http2;
+    _tls_ctx = ctx;
+    return 1;
+}
+
+void destroy_tls() {
+    _n_tls_listen_fds = 0;
+    if (_tls_ctx == NULL)
+        return;
+
+    SSL_CTX_free(_tls_ctx);
+    _tls_ctx = NULL;
+    free(_tls_sessions);
+    _tls_sessions = NULL;
+    _tls_sessions_len = 0;
+}
+
+bool is_tls_enabled() {
+    return _tls_ctx != NULL;
+}
+
+int add_tls_listen_fd(const int listen_fd) {
+    if (_n_tls_listen_fds == TLS_MAX_LISTEN_FDS)
+        return 0;
+
+    _tls_listen_fds[_n_tls_listen_fds++] = listen_fd;
+    return 1;
+}
+
+bool is_tls_listen_fd(const int listen_fd) {
+    for (int fd_no = 0; fd_no < _n_tls_listen_fds; fd_no++)
+        if (_tls_listen_fds[fd_no] == listen_fd)
+            return true;
+
+    return false;
+}
+
+int start_tls_session(const int fd) {
+    if (_tls_ctx == NULL || fd < 0 || fd >= _tls_sessions_len || _tls_sessions[fd] != NULL)
+        return 0;
+
+    SSL *ssl = SSL_new(_tls_ctx);
+    if (ssl == NULL || SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        ERR_clear_error();
+        return 0;
+    }
+
+    SSL_set_accept_state(ssl);
+    _tls_sessions[fd] = ssl;
+    return 1;
+}
+
+tls_handshake_result continue_tls_handshake(const int fd) {
+    SSL *ssl = _get_tls_session(fd);
+    if (ssl == NULL)
+        return TLS_HANDSHAKE_ERROR;
+
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl);
+    if (ret == 1)
+        return TLS_HANDSHAKE_DONE;
+
+    switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+        return TLS_HANDSHAKE_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TLS_HANDSHAKE_WANT_WRITE;
+    default:
+        ERR_clear_error();
+        return TLS_HANDSHAKE_ERROR;
+    }
+}
+
+bool has_tls_session(const int fd) {
+    return _get_tls_session(fd) != NULL;
+}
+
+bool can_send_plaintext(const int fd) {
+    SSL *ssl = _get_tls_session(fd);
+    return ssl == NULL || BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+bool has_tls_alpn(const int fd, const char *protocol) {
+    SSL *ssl = _get_tls_session(fd);
+    const unsigned char *alpn = NULL;
+    unsigned int alpn_len = 0;
+    if (ssl != NULL)
+        SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+    return alpn_len > 0 && alpn_len == strlen(protocol) && memcmp(alpn, protocol, alpn_len) == 0;
+}
+
+ssize_t recv_tls(const int fd, void *buf, const size_t len) {
+    SSL *ssl = _get_tls_session(fd);
+    if (ssl == NULL)
+        return recv(fd, buf, len, 0);
+
+    size_t recv_size = 0;
+    ERR_clear_error();
+    int ret = SSL_read_ex(ssl, buf, len, &recv_size);
+    return ret == 1 ? (ssize_t)recv_size : _get_tls_io_error(ssl, ret);
+}
+
+ssize_t send_tls(const int fd, const void *buf, const size_t len, const int flags) {
+    if (can_send_plaintext(fd))
+        return send(fd, buf, len, flags);
+
+    SSL *ssl = _get_tls_session(fd);
+    size_t send_size = 0;
+    ERR_clear_error();
+    int ret = SSL_write_ex(ssl, buf, len, &send_size);
+    if (ret == 1)
+        return send_size;
+
+    // A session the client closed can't be sent to anymore.
+    if (_get_tls_io_error(ssl, ret) == 0)
+        errno = EPIPE;
+    return -1;
+}
+
+void end_tls_session(const int fd) {
+    SSL *ssl = _get_tls_session(fd);
+    if (ssl == NULL)
+        return;
+
+    // Only the close notification is sent, the client's one isn't waited for.
+    ERR_clear_error();
+    if (SSL_is_init_finished(ssl))
+        SSL_shutdown(ssl);
+    SSL_free(ssl);
+    ERR_clear_error();
+    _tls_sessions[fd] = NULL;
+}
+
+SSL *_get_tls_session(const int fd) {
+    if (_tls_sessions == NULL || fd < 0 || fd >= _tls_sessions_len)
+        return NULL;
+    return _tls_sessions[fd];
+}
+
+int _select_tls_alpn(SSL *ssl, const unsigned char **out, unsigned char *out_len,
+                     const unsigned char *in, unsigned int in_len, void *arg) {
+    (void)ssl;
+    (void)arg;
+
+    // The server's order wins, `h2` is preferred when it is offered.
+    size_t skip = _tls_http2 ? 0 : 3;
+    if (SSL_select_next_proto((unsigned char **)out, out_len, _tls_alpn_protos + skip,
+                              sizeof(_tls_alpn_protos) - 1 - skip, in,
+                              in_len) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+ssize_t _get_tls_io_error(SSL *ssl, const int ret) {
+    int err = SSL_get_error(ssl, ret);
+    ERR_clear_error();
+
+    switch (err) {
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        // A timeout of a blocking socket is reported the same as a non-blocking socket.
+        if (errno != EINTR)
+            errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0)
+            errno = ECONNRESET;
+        return -1;
+    default:
+        errno = EPROTO;
+        return -1;
+    }
+}
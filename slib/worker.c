@@ -0,0 +1,1029 @@
+/**
+ * @file slib/worker.c
+ * @brief Functions for the worker thread pool and per-worker event loops.
+ *
+ * Implements functions defined in `include/worker.h`. Used to start, wait for and stop worker
+ * threads.
+ *
+ * The server runs a fixed number of worker threads instead of a thread per connection. Every worker
+ * owns an epoll instance with the shared listening sockets registered as `EPOLLEXCLUSIVE` (or with
+ * `SO_REUSEPORT` sockets of its own), accepts connections itself and keeps them for their whole
+ * lifetime. Therefore, connections are never shared between threads and memory use grows with open
+ * sockets, not with threads.
+ *
+ * Connection timeouts are kept in a timer wheel per worker, which is rescheduled whenever a
+ * connection is read from, so closing idle and slow connections costs nothing per second for the
+ * connections that haven't timed out.
+ *
+ * With the io_uring backend, a worker owns an io_uring ring instead: accepts, receives and polls
+ * are queued on the ring and a single `io_uring_enter()` call submits them and waits for the next
+ * completions, which drive the same connection state machine as the epoll events.
+ *
+ * Responses are written without blocking. Whatever the socket doesn't take stays queued on the
+ * connection, which then waits for the socket to be writable (`EPOLLOUT`, or a `POLLOUT` poll on
+ * the ring) and moves on to its next request once the queue is sent. Request bodies aren't waited
+ * for either: the part that wasn't received when the handler returned is dropped as it arrives,
+ * within the request body timeout kept in the timer wheel.
+ *
+ * HTTP/2 connections stay with their worker as well. Their frames are read by the event loop, and
+ * every complete stream is handed to the same handler as an HTTP/1.1 request, one after the other.
+ *
+ * Proxied requests don't block the worker either. The handler returns `CONN_PROXYING` whenever the
+ * request waits for its backend or the client. The backend socket is registered with the worker's
+ * epoll instance (or polled on its ring) meanwhile, and the handler is called again once it is
+ * ready or once the backend timed out.
+ *
+ * @see typedef struct worker
+ * @see typedef struct connection
+ *
+ * @author Sai Hemanth Bheemreddy (@SaiHemanthBR)
+ * @copyright MIT License; Copyright (c) 2021 Sai Hemanth Bheemreddy
+ * @bug No known bugs.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "worker.h"
+
+/**
+ * @private
+ * @brief Array of workers in the worker pool.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+worker *_workers = NULL;
+
+/**
+ * @private
+ * @brief Number of workers in `_workers`.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+int _workers_len = 0;
+
+/**
+ * @private
+ * @brief Set to `false` to make the worker event loops exit.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_bool _workers_running = false;
+
+/**
+ * @private
+ * @brief Set to `true` by `drain_workers()` to make the workers stop accepting connections.
+ *
+ * This is a private object and should not be accessed directly.
+ */
+atomic_bool _workers_draining = false;
+
+int get_worker_count(int n_workers) {
+    if (n_workers < 1)
+        n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    return n_workers < 1 ? 1 : n_workers;
+}
+
+int get_worker_cpu(const int id) {
+    const server_config *cfg = get_server_config();
+    if (cfg != NULL && cfg->n_worker_cpus > 0)
+        return cfg->worker_cpus[id % cfg->n_worker_cpus];
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return n_cpus > 1 ? id % n_cpus : 0;
+}
+
+int start_workers(const int *listen_fds, const int n_listen_fds, const bool per_worker,
+                  int n_workers, const bool pin_cpus, const bool use_uring, const int idle_timeout,
+                  conn_handler handler) {
+    if (_workers != NULL)
+        return 2;
+
+    n_workers = get_worker_count(n_workers);
+
+    if ((_workers = calloc(n_workers, sizeof(worker))) == NULL)
+        return 0;
+
+    atomic_store(&_workers_running, true);
+    for (_workers_len = 0; _workers_len < n_workers; _workers_len++) {
+        worker *w = &_workers[_workers_len];
+        w->id = _workers_len;
+        w->listen_fds = per_worker ? listen_fds + w->id * n_listen_fds : listen_fds;
+        w->n_listen_fds = n_listen_fds;
+        w->cpu = pin_cpus ? get_worker_cpu(w->id) : -1;
+        w->handler = handler;
+        w->idle_timeout = idle_timeout;
+        w->conns = NULL;
+        w->closing = NULL;
+        w->ring = NULL;
+        w->epoll_fd = -1;
+        w->draining = false;
+        w->joined = false;
+        w->slabs = NULL;
+
+        if ((w->timers = create_timer_wheel(TIMER_WHEEL_SLOTS, _connection_now())) == NULL) {
+            perror("Unable to create timer wheel");
+            return 0;
+        }
+
+        if ((w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            perror("Unable to create eventfd");
+            return 0;
+        }
+
+        if (use_uring && ((w->ring = create_uring(URING_ENTRIES)) == NULL ||
+                          !register_uring_buffers(w->ring, URING_BUFS, URING_BUF_SIZE))) {
+            if (w->id == 0)
+                printf("Unable to set up io_uring, the workers use epoll\n");
+            destroy_uring(w->ring);
+            w->ring = NULL;
+        }
+
+        if (w->ring == NULL && !_register_epoll_fds(w, per_worker))
+            return 0;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (w->cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(w->cpu, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+
+        int err =
+            pthread_create(&w->tid, &attr, w->ring != NULL ? _uring_worker_loop : _worker_loop, w);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            perror("Unable to create worker thread");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void wait_workers() {
+    for (int w_no = 0; w_no < _workers_len; w_no++)
+        pthread_join(_workers[w_no].tid, NULL);
+}
+
+int drain_workers(const int timeout) {
+    if (_workers == NULL)
+        return 1;
+
+    atomic_store(&_workers_draining, true);
+    for (int w_no = 0; w_no < _workers_len; w_no++) {
+        uint64_t one = 1;
+        write(_workers[w_no].wake_fd, &one, sizeof(one));
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout;
+
+    int drained = 1;
+    for (int w_no = 0; w_no < _workers_len; w_no++) {
+        worker *w = &_workers[w_no];
+        if (!w->joined && pthread_timedjoin_np(w->tid, NULL, &deadline) == 0)
+            w->joined = true;
+        drained = drained && w->joined;
+    }
+
+    return drained;
+}
+
+bool is_worker_draining() {
+    return atomic_load_explicit(&_workers_draining, memory_order_relaxed);
+}
+
+void stop_workers() {
+    if (_workers == NULL)
+        return;
+
+    atomic_store(&_workers_running, false);
+    for (int w_no = 0; w_no < _workers_len; w_no++) {
+        uint64_t one = 1;
+        write(_workers[w_no].wake_fd, &one, sizeof(one));
+    }
+
+    for (int w_no = 0; w_no < _workers_len; w_no++) {
+        worker *w = &_workers[w_no];
+        if (!w->joined)
+            pthread_join(w->tid, NULL);
+
+        while (w->conns != NULL)
+            _remove_connection(w, w->conns);
+
+        // The operations of the connections still closing never complete once the ring is gone.
+        destroy_uring(w->ring);
+        while (w->closing != NULL) {
+            connection *conn = w->closing;
+            _unlink_connection(&w->closing, conn);
+            close_connection(conn);
+        }
+        if (w->epoll_fd >= 0)
+            close(w->epoll_fd);
+        close(w->wake_fd);
+        destroy_timer_wheel(w->timers);
+
+        // The connections closed above went back to the worker's pools, so they are all free now.
+        destroy_slab_cache(w->slabs);
+        w->slabs = NULL;
+    }
+
+    free(_workers);
+    _workers = NULL;
+    _workers_len = 0;
+    atomic_store(&_workers_draining, false);
+}
+
+void *_worker_loop(void *arg) {
+    worker *w = (worker *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    _create_worker_slab_cache(w);
+
+    while (atomic_load(&_workers_running)) {
+        if (!w->draining && atomic_load(&_workers_draining))
+            _start_draining(w);
+        if (w->draining && w->conns == NULL)
+            break;
+
+        // Wake up every second to expire the connection timers, if there are any.
+        int n_events =
+            epoll_wait(w->epoll_fd, events, MAX_EVENTS, w->timers->n_timers > 0 ? 1000 : -1);
+        if (n_events < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Unable to wait for events");
+            break;
+        }
+
+        for (int e_no = 0; e_no < n_events; e_no++) {
+            void *ptr = events[e_no].data.ptr;
+            const int *listen_fd = NULL;
+            uint64_t value = 0;
+            if ((listen_fd = _find_listen_fd(w, ptr)) != NULL)
+                _accept_connections(w, *listen_fd);
+            else if (ptr == &w->wake_fd)
+                read(w->wake_fd, &value, sizeof(value));
+            else if ((uintptr_t)ptr & WORKER_OP_UPSTREAM)
+                _handle_upstream_event(w, (connection *)((uintptr_t)ptr & ~WORKER_OP_UPSTREAM));
+            else
+                _handle_connection_event(w, (connection *)ptr, events[e_no].events);
+        }
+
+        _expire_connections(w);
+    }
+
+    set_thread_slab_cache(NULL);
+    return NULL;
+}
+
+void *_uring_worker_loop(void *arg) {
+    worker *w = (worker *)arg;
+    struct io_uring_cqe *cqe = NULL;
+
+    _create_worker_slab_cache(w);
+
+    for (int fd_no = 0; fd_no < w->n_listen_fds; fd_no++)
+        _queue_uring_accept(w, &w->listen_fds[fd_no]);
+    queue_uring_poll(w->ring, w->wake_fd, POLLIN, (uintptr_t)&w->wake_fd | WORKER_OP_WAKE);
+
+    while (atomic_load(&_workers_running)) {
+        if (!w->draining && atomic_load(&_workers_draining))
+            _start_draining(w);
+        if (w->draining && w->conns == NULL && w->closing == NULL)
+            break;
+
+        // Wake up every second to expire the connection timers, if there are any.
+        if (submit_uring(w->ring, 1, w->timers->n_timers > 0 ? 1000 : -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Unable to wait for completions");
+            break;
+        }
+
+        // Handling a completion queues operations, but never reaps completions itself.
+        while ((cqe = peek_uring_cqe(w->ring)) != NULL) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            advance_uring_cq(w->ring);
+            _handle_uring_completion(w, user_data, res, flags);
+        }
+
+        _expire_connections(w);
+    }
+
+    set_thread_slab_cache(NULL);
+    return NULL;
+}
+
+void _create_worker_slab_cache(worker *w) {
+    // The size classes of the hot allocations of a connection's lifetime.
+    const size_t sizes[] = {sizeof(connection), REQ_BUF_SIZE + 1, get_arena_size(ARENA_CHUNK_SIZE)};
+    int numa_node = w->cpu >= 0 ? get_cpu_numa_node(w->cpu) : -1;
+
+    w->slabs = create_slab_cache(sizes, sizeof(sizes) / sizeof(sizes[0]), numa_node);
+    set_thread_slab_cache(w->slabs);
+}
+
+int _register_epoll_fds(worker *w, const bool per_worker) {
+    if ((w->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("Unable to create epoll instance");
+        return 0;
+    }
+
+    // Sockets of a worker's own are never shared, so they don't need EPOLLEXCLUSIVE.
+    struct epoll_event ev = {0};
+    for (int fd_no = 0; fd_no < w->n_listen_fds; fd_no++) {
+        ev.events = per_worker ? EPOLLIN : EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = (void *)&w->listen_fds[fd_no];
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fds[fd_no], &ev) < 0) {
+            perror("Unable to add listening socket to epoll");
+            return 0;
+        }
+    }
+
+    ev = (struct epoll_event){.events = EPOLLIN, .data.ptr = &w->wake_fd};
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->wake_fd, &ev) < 0) {
+        perror("Unable to add eventfd to epoll");
+        return 0;
+    }
+
+    return 1;
+}
+
+void _accept_connections(worker *w, const int listen_fd) {
+    int conn_fd = -1;
+    struct sockaddr_storage peer_addr;
+    socklen_t peer_addr_len = sizeof(peer_addr);
+
+    bool is_tls = is_tls_listen_fd(listen_fd);
+    while ((conn_fd = accept4(listen_fd, (struct sockaddr *)&peer_addr, &peer_addr_len,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        peer_addr_len = sizeof(peer_addr);
+        _add_connection(w, conn_fd, &peer_addr, is_tls);
+    }
+
+    // Another worker may have accepted the connection first.
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        perror("Unable to accept new connection");
+}
+
+void _add_connection(worker *w, const int conn_fd, const struct sockaddr_storage *peer_addr,
+                     const bool is_tls) {
+    add_metrics_counter(METRICS_CONNECTIONS_ACCEPTED, 1);
+    bool is_admitted = admit_connection(peer_addr);
+    bool has_session = is_admitted && (!is_tls || start_tls_session(conn_fd));
+    connection *conn = has_session ? create_connection(conn_fd) : NULL;
+    if (conn == NULL) {
+        // The client is told to retry later instead of seeing the connection reset. A TLS
+        // client can't read a response before the handshake, so it only sees the close.
+        if (is_admitted)
+            release_admitted_connection(peer_addr);
+        add_metrics_counter(METRICS_CONNECTIONS_REJECTED, 1);
+        count_metrics_status(503);
+        end_tls_session(conn_fd);
+        if (!is_tls)
+            send_raw_error_response(conn_fd, 503);
+        close(conn_fd);
+        return;
+    }
+    conn->peer_addr = *peer_addr;
+    if (is_tls)
+        conn->state = CONN_HANDSHAKING;
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+    if (w->ring == NULL && epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, conn_fd, &ev) < 0) {
+        perror("Unable to add connection to epoll");
+        release_admitted_connection(&conn->peer_addr);
+        close_connection(conn);
+        return;
+    }
+
+    conn->events = ev.events;
+    _link_connection(&w->conns, conn);
+    _wait_connection(w, conn, false);
+}
+
+int _queue_uring_accept(worker *w, const int *listen_fd) {
+    return queue_uring_accept(w->ring, *listen_fd, SOCK_NONBLOCK | SOCK_CLOEXEC,
+                              (uintptr_t)listen_fd | WORKER_OP_ACCEPT);
+}
+
+void _handle_uring_completion(worker *w, const uint64_t user_data, const int res,
+                              const unsigned int flags) {
+    void *ptr = (void *)(uintptr_t)(user_data & ~(uint64_t)WORKER_OP_MASK);
+    worker_op op = user_data & WORKER_OP_MASK;
+    if (ptr == NULL)
+        return;
+
+    if (op == WORKER_OP_ACCEPT) {
+        // A multishot accept doesn't return the address of the client.
+        struct sockaddr_storage peer_addr = {.ss_family = AF_UNSPEC};
+        socklen_t peer_addr_len = sizeof(peer_addr);
+        const int *listen_fd = ptr;
+        if (res >= 0) {
+            getpeername(res, (struct sockaddr *)&peer_addr, &peer_addr_len);
+            _add_connection(w, res, &peer_addr, is_tls_listen_fd(*listen_fd));
+        } else if (res != -EAGAIN && res != -EINTR && res != -ECANCELED) {
+            errno = -res;
+            perror("Unable to accept new connection");
+        }
+        if (!(flags & IORING_CQE_F_MORE) && !w->draining)
+            _queue_uring_accept(w, listen_fd);
+        return;
+    }
+
+    if (op == WORKER_OP_WAKE) {
+        uint64_t value = 0;
+        read(w->wake_fd, &value, sizeof(value));
+        queue_uring_poll(w->ring, w->wake_fd, POLLIN, user_data);
+        return;
+    }
+
+    connection *conn = (connection *)((uintptr_t)ptr & ~WORKER_OP_UPSTREAM);
+    unsigned int bid = 0;
+    char *buf = get_uring_buffer(w->ring, flags, &bid);
+    conn->uring_op = 0;
+    if (conn->state == CONN_CLOSING) {
+        if (buf != NULL)
+            recycle_uring_buffer(w->ring, bid);
+        _unlink_connection(&w->closing, conn);
+        close_connection(conn);
+        return;
+    }
+
+    // The proxied request finds out what happened to its backend socket itself, a cancelled poll
+    // is one whose backend timed out.
+    if ((uintptr_t)ptr & WORKER_OP_UPSTREAM) {
+        _handle_upstream_event(w, conn);
+        return;
+    }
+
+    // Poll events have the same values as the epoll events.
+    if (op == WORKER_OP_POLL) {
+        _handle_connection_event(w, conn, res < 0 ? EPOLLERR : (unsigned int)res);
+        return;
+    }
+
+    // Without a free buffer the receive is queued again, the buffers are handed back meanwhile.
+    if (res == -ENOBUFS || res == -EAGAIN || res == -EINTR) {
+        _wait_connection(w, conn, false);
+        return;
+    }
+
+    conn_state state = res < 0 ? CONN_CLOSING : receive_connection_data(conn, buf, res);
+    if (buf != NULL)
+        recycle_uring_buffer(w->ring, bid);
+    if (state == CONN_READING)
+        _wait_connection(w, conn, false);
+    else if (state == CONN_HANDLING)
+        _handle_connection_request(w, conn);
+    else
+        _remove_connection(w, conn);
+}
+
+void _start_draining(worker *w) {
+    for (int fd_no = 0; fd_no < w->n_listen_fds; fd_no++)
+        if (w->ring != NULL)
+            queue_uring_cancel(w->ring, (uintptr_t)&w->listen_fds[fd_no] | WORKER_OP_ACCEPT);
+        else
+            epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, w->listen_fds[fd_no], NULL);
+
+    // Connections waiting for their next request have nothing in flight. HTTP/2 clients are told
+    // not to start streams, the ones in flight are still answered.
+    connection *conn = w->conns, *next = NULL;
+    w->draining = true;
+    while (conn != NULL) {
+        next = conn->next;
+        if (conn->http2 != NULL)
+            _serve_http2_streams(w, conn);
+        else if (conn->state == CONN_HANDSHAKING ||
+            (conn->state == CONN_READING && conn->recv_buf == NULL))
+            _remove_connection(w, conn);
+        conn = next;
+    }
+}
+
+const int *_find_listen_fd(const worker *w, const void *ptr) {
+    for (int fd_no = 0; fd_no < w->n_listen_fds; fd_no++)
+        if (ptr == &w->listen_fds[fd_no])
+            return &w->listen_fds[fd_no];
+
+    return NULL;
+}
+
+void _handle_connection_event(worker *w, connection *conn, const unsigned int events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        _remove_connection(w, conn);
+        return;
+    }
+
+    // The request that may have arrived with the end of the handshake is read right away.
+    if (conn->state == CONN_HANDSHAKING && !_handshake_connection(w, conn))
+        return;
+    if (conn->state == CONN_WRITING) {
+        _finish_connection_request(w, conn);
+        return;
+    }
+    if (conn->state == CONN_PROXYING) {
+        _continue_proxy(w, conn);
+        return;
+    }
+    if (conn->http2 != NULL) {
+        _handle_http2_event(w, conn);
+        return;
+    }
+
+    if (read_connection(conn) == CONN_READING) {
+        _wait_connection(w, conn, false);
+        return;
+    }
+
+    _handle_connection_request(w, conn);
+}
+
+void _handle_connection_request(worker *w, connection *conn) {
+    while (conn->state == CONN_HANDLING) {
+        if (conn->proxy == NULL && _upgrade_http2_connection(w, conn))
+            break;
+        long long send_before = conn->n_requests == 0 ? get_metrics_send_start() : 0;
+        set_active_connection(conn);
+        conn_state next_state = w->handler(conn);
+        set_active_connection(NULL);
+
+        // Only a send started by this call counts, a proxied request may call the handler again.
+        long long send_start = 0;
+        if (conn->n_requests == 0 && (send_start = get_metrics_send_start()) != send_before &&
+            send_start >= conn->accepted_ns)
+            observe_metrics_stage(METRICS_ACCEPT_TO_FIRST_BYTE, send_start - conn->accepted_ns);
+
+        // A proxied request waits for its backend or the client, and goes on from there.
+        if (next_state == CONN_PROXYING) {
+            conn->state = CONN_PROXYING;
+            break;
+        }
+        _release_proxy(w, conn);
+
+        // The rest of the response is sent and the rest of the body dropped as the socket allows,
+        // the next request waits.
+        conn->next_state = next_state;
+        if (conn->output != NULL || _is_body_pending(conn)) {
+            conn->state = CONN_WRITING;
+        } else if (next_state == CONN_CLOSING) {
+            conn->state = CONN_CLOSING;
+        } else {
+            next_connection_request(conn);
+        }
+    }
+
+    if (conn->http2 != NULL && conn->state != CONN_CLOSING) {
+        _serve_http2_streams(w, conn);
+        return;
+    }
+
+    if (conn->state == CONN_CLOSING)
+        _remove_connection(w, conn);
+    else
+        _wait_connection(w, conn, false);
+}
+
+void _finish_connection_request(worker *w, connection *conn) {
+    int result = conn->output != NULL ? flush_connection(conn) : 1;
+    if (result != 0 && _is_body_pending(conn) && !discard_connection_body(conn, conn->body_max))
+        result = 0;
+    if (result == 0) {
+        _remove_connection(w, conn);
+        return;
+    }
+    if (conn->output != NULL || _is_body_pending(conn)) {
+        _wait_connection(w, conn, false);
+        return;
+    }
+    if (conn->next_state == CONN_CLOSING) {
+        _remove_connection(w, conn);
+        return;
+    }
+
+    // A pipelined request may already be buffered.
+    next_connection_request(conn);
+    _handle_connection_request(w, conn);
+}
+
+void _handle_upstream_event(worker *w, connection *conn) {
+    if (conn->proxy != NULL)
+        _continue_proxy(w, conn);
+    else if (conn->http2 != NULL)
+        _serve_http2_streams(w, conn);
+    else
+        _wait_connection(w, conn, false);
+}
+
+void _continue_proxy(worker *w, connection *conn) {
+    if (conn->http2 != NULL) {
+        _serve_http2_streams(w, conn);
+        return;
+    }
+
+    // The response the client didn't take yet is sent before the handler relays more of it.
+    int result = conn->output != NULL ? flush_connection(conn) : 1;
+    if (result == 0) {
+        _remove_connection(w, conn);
+        return;
+    }
+    if (result == 2) {
+        _wait_connection(w, conn, true);
+        return;
+    }
+
+    conn->state = CONN_HANDLING;
+    _handle_connection_request(w, conn);
+}
+
+void _release_proxy(worker *w, connection *conn) {
+    proxy_conn *upstream = conn->proxy;
+    if (upstream == NULL)
+        return;
+
+    // A poll in flight on the backend socket still refers to it, the socket isn't pooled then. If
+    // the cancellation can't be queued, shutting the socket down completes the poll as well.
+    if (conn->uring_op & WORKER_OP_UPSTREAM) {
+        upstream->keep_alive = false;
+        if (!queue_uring_cancel(w->ring, conn->uring_op))
+            shutdown(upstream->fd, SHUT_RDWR);
+    }
+    if (w->ring == NULL)
+        _watch_upstream(w, conn, -1, 0);
+
+    close_proxy_conn(upstream);
+    conn->proxy = NULL;
+}
+
+int _watch_upstream(worker *w, connection *conn, const int fd, const unsigned int events) {
+    // The socket registered before may be closed already, which removed it.
+    if (conn->upstream_fd >= 0 && fd != conn->upstream_fd)
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, conn->upstream_fd, NULL);
+    conn->upstream_fd = -1;
+    if (fd < 0)
+        return 1;
+
+    // The registration is modified even if the number didn't change, a new socket may reuse the
+    // number of a closed one (after a retry), it is added again then.
+    struct epoll_event ev = {.events = events,
+                             .data.ptr = (void *)((uintptr_t)conn | WORKER_OP_UPSTREAM)};
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+        (errno != ENOENT || epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0))
+        return 0;
+
+    conn->upstream_fd = fd;
+    return 1;
+}
+
+int _handshake_connection(worker *w, connection *conn) {
+    tls_handshake_result result = continue_tls_handshake(conn->fd);
+    if (result == TLS_HANDSHAKE_ERROR) {
+        _remove_connection(w, conn);
+        return 0;
+    }
+
+    // The handshake waits for whichever direction OpenSSL is blocked on. `connection::last_active`
+    // isn't moved, the handshake must be done within the idle timeout.
+    if (result != TLS_HANDSHAKE_DONE) {
+        _wait_connection(w, conn, result == TLS_HANDSHAKE_WANT_WRITE);
+        return 0;
+    }
+
+    // A client that negotiated `h2` starts with the connection preface instead of a request.
+    conn->state = CONN_READING;
+    if (has_tls_alpn(conn->fd, "h2") &&
+        ((conn->http2 = _create_http2_session(conn)) == NULL ||
+         !start_http2_session(conn->http2, NULL))) {
+        _remove_connection(w, conn);
+        return 0;
+    }
+    return 1;
+}
+
+void _handle_http2_event(worker *w, connection *conn) {
+    // While some of a response waits for the client, only what it reads keeps the connection open.
+    bool is_sending = has_http2_output(conn->http2);
+    if (read_http2_session(conn->http2) && !is_sending)
+        conn->last_active = _connection_now();
+    _serve_http2_streams(w, conn);
+}
+
+void _serve_http2_streams(worker *w, connection *conn) {
+    http2_session *session = conn->http2;
+    http2_stream *stream = NULL;
+    uint64_t n_data = session->n_data;
+    int flushed = 1;
+
+    // Every stream is a request of its own, the handler's keep-alive decision doesn't apply. A
+    // stream whose request can't be loaded ends without a response, which resets it. A paused
+    // stream goes on first, the streams after it wait until it ends.
+    do {
+        if (conn->proxy != NULL)
+            _handle_http2_stream(w, conn, session->active, true);
+        while (conn->proxy == NULL && (stream = next_http2_stream(session)) != NULL) {
+            bool is_loaded = load_connection_request(conn, stream->request->str,
+                                                     stream->request->len) == CONN_HANDLING;
+            if (is_loaded && stream->error_status != 0)
+                conn->error_status = stream->error_status;
+
+            begin_http2_stream(session, stream);
+            _handle_http2_stream(w, conn, stream, is_loaded);
+        }
+
+        if (w->draining && !session->is_goaway)
+            shutdown_http2_session(session);
+
+        // The parked bodies go on as far as the client's windows and the socket allow. A paused
+        // stream that waits for room for its body goes on once there is.
+        flushed = flush_http2_session(session);
+    } while (flushed == 1 && conn->proxy != NULL && conn->proxy->waits_client &&
+             can_send_http2(session));
+
+    // Only the progress of the bodies counts as activity while they wait, answering a `PING` flood
+    // doesn't.
+    if (session->n_data != n_data)
+        conn->last_active = _connection_now();
+
+    conn->state = CONN_READING;
+    if (flushed == 0 || (is_http2_session_done(session) && (flushed == 1 || session->is_broken)))
+        _remove_connection(w, conn);
+    else
+        _wait_connection(w, conn, flushed == 2);
+}
+
+void _handle_http2_stream(worker *w, connection *conn, http2_stream *stream,
+                          const bool is_loaded) {
+    http2_session *session = conn->http2;
+    conn_state next_state = CONN_READING;
+    if (is_loaded && (conn->proxy == NULL || !stream->is_reset)) {
+        continue_http2_stream(session);
+        next_state = w->handler(conn);
+    }
+    if (next_state == CONN_PROXYING) {
+        pause_http2_stream(session);
+        return;
+    }
+
+    _release_proxy(w, conn);
+    finish_http2_stream(session, stream);
+    if (is_loaded) {
+        discard_connection_body(conn, UINT64_MAX);
+        next_connection_request(conn);
+    }
+}
+
+int _upgrade_http2_connection(worker *w, connection *conn) {
+    const server_config *cfg = get_server_config();
+    if (conn->error_status != 0 || has_tls_session(conn->fd) || cfg == NULL || !cfg->http2)
+        return 0;
+
+    // The preface of a client with prior knowledge parses as a request without headers.
+    const char *buf = conn->recv_buf;
+    const http_parser *parser = &conn->parser;
+    if (conn->n_requests == 0 && conn->recv_len >= 18 &&
+        memcmp(buf, "PRI * HTTP/2.0\r\n\r\n", 18) == 0) {
+        if ((conn->http2 = _create_http2_session(conn)) == NULL ||
+            !start_http2_session(conn->http2, NULL)) {
+            conn->state = CONN_CLOSING;
+            return 1;
+        }
+        receive_http2_data(conn->http2, buf, conn->recv_len);
+        conn->body_pos = conn->recv_len;
+        next_connection_request(conn);
+        return 1;
+    }
+
+    // Only requests without a body are upgraded, `Upgrade: h2c` on others is ignored.
+    int upgrade_no = find_known_http_header(parser, HTTP_HEADER_UPGRADE);
+    int settings_no = find_http_header(parser, buf, "HTTP2-Settings", 0);
+    if (upgrade_no < 0 || settings_no < 0 || conn->body.state != HTTP_BODY_DONE ||
+        parser->version.len != 8 || memcmp(buf + parser->version.off, "HTTP/1.1", 8) != 0)
+        return 0;
+
+    http_view upgrade = parser->headers[upgrade_no].value;
+    http_view settings = parser->headers[settings_no].value;
+    char upgrade_settings[256];
+    if (upgrade.len != 3 || strncasecmp(buf + upgrade.off, "h2c", 3) != 0 ||
+        settings.len >= sizeof(upgrade_settings))
+        return 0;
+    memcpy(upgrade_settings, buf + settings.off, settings.len);
+    upgrade_settings[settings.len] = '\0';
+
+    http2_session *session = _create_http2_session(conn);
+    if (session == NULL || !start_http2_session(session, upgrade_settings)) {
+        destroy_http2_session(session);
+        return 0;
+    }
+
+    // The request is answered on stream 1 like the other streams, once the client's `SETTINGS`
+    // arrived. The `101` response is sent with the server's `SETTINGS`, the preface may have been
+    // sent right after the request.
+    conn->http2 = session;
+    bool is_head = parser->method.len == 4 && memcmp(buf + parser->method.off, "HEAD", 4) == 0;
+    if (open_http2_upgrade_stream(session, buf, conn->head_len, is_head) == NULL) {
+        conn->state = CONN_CLOSING;
+        return 1;
+    }
+    receive_http2_data(session, conn->recv_buf + conn->body_pos, conn->recv_len - conn->body_pos);
+    conn->body_pos = conn->recv_len;
+    next_connection_request(conn);
+    return 1;
+}
+
+http2_session *_create_http2_session(const connection *conn) {
+    const server_config *cfg = get_server_config();
+    unsigned int max_streams = cfg != NULL ? cfg->http2_max_streams : DEFAULT_HTTP2_MAX_STREAMS;
+    size_t max_body_size = cfg != NULL ? cfg->max_request_body_size : DEFAULT_MAX_REQUEST_BODY_SIZE;
+
+    // Frames are coalesced before they are sent, Nagle's algorithm would only delay the ends of
+    // the responses (and the window updates they wait for). Fails on Unix sockets, that's fine.
+    int nodelay = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return create_http2_session(conn->fd, max_streams, conn->recv_max, max_body_size);
+}
+
+bool _is_body_pending(const connection *conn) {
+    return conn->next_state != CONN_CLOSING && conn->body.state != HTTP_BODY_DONE;
+}
+
+void _schedule_connection_timer(worker *w, connection *conn) {
+    const server_config *cfg = get_server_config();
+    int body_timeout = cfg != NULL ? cfg->request_body_timeout : DEFAULT_REQUEST_BODY_TIMEOUT;
+
+    // A proxied request gives its backend `proxy_timeout` seconds to make progress. While it waits
+    // for the client, the rest of its body or the room for its response must come in time.
+    const proxy_conn *upstream = conn->proxy;
+    if (upstream != NULL && !upstream->waits_client) {
+        schedule_timer(w->timers, &conn->timer, upstream->expires_at);
+        return;
+    }
+    if (conn->state == CONN_PROXYING) {
+        schedule_timer(w->timers, &conn->timer,
+                       upstream->events == POLLIN ? conn->body_started + body_timeout
+                                                  : conn->last_active + SEND_TIMEOUT);
+        return;
+    }
+
+    // Queued output times out once the client stops reading it, however long the response is. A
+    // body being dropped must be complete in time, however often some of it arrives.
+    if (conn->state == CONN_WRITING) {
+        time_t expires_at = conn->last_active + SEND_TIMEOUT;
+        if (_is_body_pending(conn) &&
+            (conn->output == NULL || conn->body_started + body_timeout < expires_at))
+            expires_at = conn->body_started + body_timeout;
+        schedule_timer(w->timers, &conn->timer, expires_at);
+        return;
+    }
+
+    // So does an HTTP/2 response whose client stops reading it or opening the windows for it.
+    if (conn->http2 != NULL && has_http2_output(conn->http2)) {
+        schedule_timer(w->timers, &conn->timer, conn->last_active + SEND_TIMEOUT);
+        return;
+    }
+
+    time_t expires_at = conn->last_active + w->idle_timeout;
+
+    // A partial request head must be complete in time, however often some of it arrives.
+    int head_timeout = cfg != NULL ? cfg->request_head_timeout : DEFAULT_REQUEST_HEAD_TIMEOUT;
+    if (conn->recv_buf != NULL && conn->head_started + head_timeout < expires_at)
+        expires_at = conn->head_started + head_timeout;
+
+    schedule_timer(w->timers, &conn->timer, expires_at);
+}
+
+void _wait_connection(worker *w, connection *conn, const bool wants_write) {
+    _schedule_connection_timer(w, conn);
+
+    // A client that half-closed its side still reads the queued response. A connection that
+    // finishes its request waits for whichever of the output and the body is pending.
+    unsigned int events = (wants_write ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+    if (conn->state == CONN_WRITING)
+        events = (conn->output != NULL ? EPOLLOUT : 0) | (_is_body_pending(conn) ? EPOLLIN : 0);
+
+    // A proxied request waits for one socket at a time, an HTTP/2 connection whose stream waits
+    // for the client waits for it like the other streams.
+    const proxy_conn *upstream = conn->proxy;
+    bool waits_upstream = upstream != NULL && !upstream->waits_client;
+    if (waits_upstream)
+        events = 0;
+    else if (conn->state == CONN_PROXYING)
+        events = upstream->events;
+    if (w->ring == NULL) {
+        if (!_watch_upstream(w, conn, waits_upstream ? upstream->fd : -1,
+                             waits_upstream ? upstream->events : 0)) {
+            _remove_connection(w, conn);
+            return;
+        }
+        struct epoll_event ev = {.events = events, .data.ptr = conn};
+        if (events != conn->events && epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+            _remove_connection(w, conn);
+            return;
+        }
+        conn->events = events;
+        return;
+    }
+    if (conn->uring_op != 0)
+        return;
+
+    // Plain HTTP/1.x connections receive right away, the others are read through their session.
+    uint64_t op = (uintptr_t)conn;
+    int is_queued = 0;
+    if (waits_upstream)
+        is_queued = queue_uring_poll(w->ring, upstream->fd, upstream->events,
+                                     op |= WORKER_OP_UPSTREAM | WORKER_OP_POLL);
+    else if (conn->http2 == NULL && !has_tls_session(conn->fd) && events == (EPOLLIN | EPOLLRDHUP))
+        is_queued = queue_uring_recv(w->ring, conn->fd, op |= WORKER_OP_RECV);
+    else
+        is_queued = queue_uring_poll(w->ring, conn->fd, events, op |= WORKER_OP_POLL);
+    if (!is_queued) {
+        _remove_connection(w, conn);
+        return;
+    }
+    conn->uring_op = op;
+}
+
+void _expire_connections(worker *w) {
+    time_t now = _connection_now();
+    timer_wheel_timer *timer = NULL;
+
+    while ((timer = expire_timer(w->timers, now)) != NULL) {
+        connection *conn = (connection *)((char *)timer - offsetof(connection, timer));
+
+        // A backend that timed out is given up on by the proxied request, the client may still
+        // get a `504`. A poll in flight on the ring is cancelled, its completion continues it.
+        proxy_conn *upstream = conn->proxy;
+        if (upstream == NULL || upstream->waits_client || upstream->is_timed_out) {
+            _remove_connection(w, conn);
+            continue;
+        }
+        upstream->is_timed_out = true;
+        if (conn->uring_op == 0)
+            _handle_upstream_event(w, conn);
+        else if (!queue_uring_cancel(w->ring, conn->uring_op))
+            shutdown(upstream->fd, SHUT_RDWR);
+    }
+}
+
+void _remove_connection(worker *w, connection *conn) {
+    _unlink_connection(&w->conns, conn);
+    cancel_timer(w->timers, &conn->timer);
+    release_admitted_connection(&conn->peer_addr);
+    _release_proxy(w, conn);
+
+    // The completion of the operation still refers to the connection. If the cancellation can't be
+    // queued, shutting the socket down completes the operation as well. A poll of the backend
+    // socket was cancelled with the proxied request.
+    if (conn->uring_op != 0) {
+        if (!(conn->uring_op & WORKER_OP_UPSTREAM) && !queue_uring_cancel(w->ring, conn->uring_op))
+            shutdown(conn->fd, SHUT_RDWR);
+        conn->state = CONN_CLOSING;
+        _link_connection(&w->closing, conn);
+        return;
+    }
+    close_connection(conn);
+}
+
+void _link_connection(connection **list, connection *conn) {
+    conn->prev = NULL;
+    conn->next = *list;
+    if (*list != NULL)
+        (*list)->prev = conn;
+    *list = conn;
+}
+
+void _unlink_connection(connection **list, connection *conn) {
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        *list = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    conn->prev = conn->next = NULL;
+}
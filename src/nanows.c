@@ -3,8 +3,8 @@
  * @brief Web Server main source file and entry point.
  *
  * Implements the main function of ***Nano Web Server.*** It is a simple, multi-threaded, web server
- * written using POSIX Sockets. Uses a process-driven approach and creates a new thread for each
- * request. This web server can only host simple static webpages with no server-size processing. As
+ * written using POSIX Sockets. Uses a fixed pool of worker threads, each running its own epoll
+ * event loop. This web server can only host simple static webpages with no server-size processing. As
  * of v2, it does not conform to any HTTP protocol. This is a learning project and is not intended
  * to be used in a production environment.
  *
@@ -14,8 +14,6 @@
  */
 
 #include <stdlib.h>
-#include <pthread.h>
-#include <signal.h>
 
 #include "server.h"
 
@@ -25,11 +23,9 @@
 int main(int argc, char *argv[]) {
     // Managing Process Lifecycle
     atexit(stop_server);
-    signal(SIGINT, exit);
-    signal(SIGTSTP, exit);
 
-    // Start Server
-    start_server();
+    // Start Server, returns once the requests in flight are finished after SIGINT or SIGTERM
+    start_server(argv);
 
     return 0;
 }
@@ -0,0 +1,149 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "accesslog.h"
+
+// Reads the log file into `buf` and removes it.
+static void read_log(const char *path, char *buf, size_t buf_size) {
+    FILE *file = fopen(path, "r");
+    ck_assert_ptr_ne(file, NULL);
+    size_t len = fread(buf, 1, buf_size - 1, file);
+    buf[len] = '\0';
+    fclose(file);
+    unlink(path);
+}
+
+START_TEST(test_log_access_combined) {
+    // Log an entry in the combined format and check the line written by the flusher.
+    char path[] = "/tmp/check_accesslog_XXXXXX";
+    close(mkstemp(path));
+    ck_assert_int_eq(create_access_log(path, ACCESS_LOG_COMBINED, 1, 1, 0), 1);
+    ck_assert_int_eq(create_access_log(path, ACCESS_LOG_COMBINED, 1, 1, 0), 2);
+    ck_assert_int_eq(is_access_log_enabled(), true);
+
+    struct sockaddr_storage peer = {0};
+    struct sockaddr_in *peer_in = (struct sockaddr_in *)&peer;
+    peer_in->sin_family = AF_INET;
+    inet_pton(AF_INET, "10.0.0.1", &peer_in->sin_addr);
+
+    access_log_entry entry = {.peer_addr = &peer,
+                              .method = "GET",
+                              .url = "/index.html",
+                              .http_ver = "HTTP/1.1",
+                              .user_agent = "curl/7.68.0",
+                              .status = 200,
+                              .bytes = 611,
+                              .latency_us = 42};
+    ck_assert_int_eq(log_access(&entry), 1);
+    destroy_access_log();
+    ck_assert_int_eq(is_access_log_enabled(), false);
+
+    char buf[4096];
+    read_log(path, buf, sizeof(buf));
+    ck_assert_ptr_ne(strstr(buf, "10.0.0.1 - - ["), NULL);
+    ck_assert_ptr_ne(
+        strstr(buf, "] \"GET /index.html HTTP/1.1\" 200 611 \"-\" \"curl/7.68.0\" 42\n"), NULL);
+}
+END_TEST
+
+START_TEST(test_log_access_json) {
+    // Log an entry in the JSON format and check if the strings are escaped.
+    char path[] = "/tmp/check_accesslog_XXXXXX";
+    close(mkstemp(path));
+    ck_assert_int_eq(create_access_log(path, parse_access_log_format("json"), 1, 1, 0), 1);
+
+    access_log_entry entry = {.method = "GET",
+                              .url = "/a\"b\\c\x01",
+                              .http_ver = "HTTP/1.0",
+                              .status = 404,
+                              .bytes = 0,
+                              .latency_us = 7};
+    ck_assert_int_eq(log_access(&entry), 1);
+    destroy_access_log();
+
+    char buf[4096];
+    read_log(path, buf, sizeof(buf));
+    ck_assert_ptr_ne(
+        strstr(buf, "\"remote_addr\":\"-\",\"method\":\"GET\",\"url\":\"/a\\\"b\\\\c\\u0001\""),
+        NULL);
+    ck_assert_ptr_ne(strstr(buf, "\"status\":404,\"bytes\":0,\"latency_us\":7,\"referer\":\"\""),
+                     NULL);
+    ck_assert_int_eq(buf[strlen(buf) - 1], '\n');
+}
+END_TEST
+
+START_TEST(test_log_access_sample) {
+    // Log with 1 in 3 sampling and check if only every third entry is logged.
+    char path[] = "/tmp/check_accesslog_XXXXXX";
+    close(mkstemp(path));
+    ck_assert_int_eq(create_access_log(path, ACCESS_LOG_COMBINED, 3, 1, 0), 1);
+
+    access_log_entry entry = {.method = "GET", .url = "/", .http_ver = "HTTP/1.1", .status = 200};
+    int logged = 0;
+    for (int i = 0; i < 6; i++)
+        logged += log_access(&entry) == 1;
+    ck_assert_int_eq(logged, 2);
+    destroy_access_log();
+
+    char buf[4096];
+    read_log(path, buf, sizeof(buf));
+    char *second = strchr(buf, '\n');
+    ck_assert_ptr_ne(second, NULL);
+    ck_assert_ptr_ne(strchr(second + 1, '\n'), NULL);
+    ck_assert_ptr_eq(strchr(strchr(second + 1, '\n') + 1, '\n'), NULL);
+}
+END_TEST
+
+START_TEST(test_log_access_full) {
+    // Fill a ring buffer faster than it is flushed and check if entries are dropped, not blocked.
+    char path[] = "/tmp/check_accesslog_XXXXXX";
+    close(mkstemp(path));
+    ck_assert_int_eq(create_access_log(path, ACCESS_LOG_COMBINED, 1, 1, 1), 1);
+
+    access_log_entry entry = {.method = "GET", .url = "/", .http_ver = "HTTP/1.1", .status = 200};
+    int logged = 0;
+    for (int i = 0; i < 100; i++)
+        logged += log_access(&entry);
+    ck_assert_int_lt(logged, 100);
+    ck_assert_int_eq(get_access_log_dropped(), 100 - logged);
+    destroy_access_log();
+    unlink(path);
+
+    // Without an open access log, entries are dropped as well.
+    ck_assert_int_eq(log_access(&entry), 0);
+    ck_assert_int_eq(create_access_log("/nonexistent/access.log", ACCESS_LOG_COMBINED, 1, 1, 0), 0);
+}
+END_TEST
+
+Suite *accesslog_suite() {
+    const TTest *tests[] = {test_log_access_combined, test_log_access_json, test_log_access_sample,
+                            test_log_access_full};
+
+    Suite *suite = suite_create("Access Log");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = accesslog_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
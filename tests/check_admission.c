@@ -0,0 +1,110 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "admission.h"
+
+/**
+ * Stores the IPv4 address `ip` in `addr`.
+ */
+void _set_ipv4_addr(struct sockaddr_storage *addr, const char *ip) {
+    memset(addr, 0, sizeof(*addr));
+    struct sockaddr_in *addr_in = (struct sockaddr_in *)addr;
+    addr_in->sin_family = AF_INET;
+    inet_pton(AF_INET, ip, &addr_in->sin_addr);
+}
+
+START_TEST(test_admit_connection_without_limits) {
+    // Check if every connection is admitted before the admission control is created.
+    struct sockaddr_storage addr;
+    _set_ipv4_addr(&addr, "192.0.2.1");
+    ck_assert(admit_connection(&addr));
+    release_admitted_connection(&addr);
+    ck_assert_int_eq(get_admitted_connections(), 0);
+
+    ck_assert_int_eq(create_admission_control(0, 0), 1);
+    ck_assert_int_eq(create_admission_control(0, 0), 2);
+    for (int c_no = 0; c_no < 100; c_no++)
+        ck_assert(admit_connection(&addr));
+    ck_assert_int_eq(get_admitted_connections(), 100);
+
+    destroy_admission_control();
+    destroy_admission_control();
+}
+END_TEST
+
+START_TEST(test_admit_connection_max_connections) {
+    // Fill up the connection limit and check if connections are admitted again after a release.
+    struct sockaddr_storage addr;
+    _set_ipv4_addr(&addr, "192.0.2.1");
+    ck_assert_int_eq(create_admission_control(2, 0), 1);
+
+    ck_assert(admit_connection(&addr));
+    ck_assert(admit_connection(&addr));
+    ck_assert(!admit_connection(&addr));
+    ck_assert_int_eq(get_admitted_connections(), 2);
+
+    release_admitted_connection(&addr);
+    ck_assert(admit_connection(&addr));
+
+    destroy_admission_control();
+}
+END_TEST
+
+START_TEST(test_admit_connection_per_ip) {
+    // Check if the per address limit only refuses the address over it, IPv4-mapped or not.
+    struct sockaddr_storage a, b, mapped;
+    _set_ipv4_addr(&a, "192.0.2.1");
+    _set_ipv4_addr(&b, "192.0.2.2");
+    memset(&mapped, 0, sizeof(mapped));
+    struct sockaddr_in6 *mapped_in6 = (struct sockaddr_in6 *)&mapped;
+    mapped_in6->sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::ffff:192.0.2.1", &mapped_in6->sin6_addr);
+    ck_assert_int_eq(create_admission_control(0, 2), 1);
+
+    ck_assert(admit_connection(&a));
+    ck_assert(admit_connection(&mapped));
+    ck_assert(!admit_connection(&a));
+    ck_assert(admit_connection(&b));
+    ck_assert_int_eq(get_admitted_connections(), 3);
+
+    release_admitted_connection(&mapped);
+    ck_assert(admit_connection(&a));
+    release_admitted_connection(&a);
+    release_admitted_connection(&a);
+    release_admitted_connection(&b);
+    ck_assert_int_eq(get_admitted_connections(), 0);
+
+    destroy_admission_control();
+}
+END_TEST
+
+Suite *admission_suite() {
+    const TTest *tests[] = {test_admit_connection_without_limits,
+                            test_admit_connection_max_connections, test_admit_connection_per_ip};
+
+    Suite *suite = suite_create("Admission");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = admission_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
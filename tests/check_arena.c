@@ -0,0 +1,113 @@
+#include <check.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "response.h"
+
+START_TEST(test_arena_alloc) {
+    // Allocate from a new arena and check if the allocations are aligned and don't overlap.
+    arena *a = create_arena(256);
+    ck_assert_ptr_ne(a, NULL);
+
+    char *first = arena_alloc(a, 3);
+    char *second = arena_alloc(a, 8);
+    ck_assert_ptr_ne(first, NULL);
+    ck_assert_ptr_ne(second, NULL);
+    ck_assert_int_eq((uintptr_t)first % alignof(max_align_t), 0);
+    ck_assert_int_eq((uintptr_t)second % alignof(max_align_t), 0);
+    ck_assert(second >= first + 3);
+    ck_assert_ptr_eq(a->chunk, a->first);
+
+    destroy_arena(a);
+}
+END_TEST
+
+START_TEST(test_arena_alloc_new_chunk) {
+    // Allocate more than a chunk and check if new chunks are added and freed on reset.
+    arena *a = create_arena(64);
+
+    memset(arena_alloc(a, 48), 1, 48);
+    memset(arena_alloc(a, 48), 2, 48);
+    ck_assert_ptr_ne(a->chunk, a->first);
+
+    char *large = arena_alloc(a, 1000);
+    ck_assert_ptr_ne(large, NULL);
+    ck_assert_int_ge(a->chunk->size, 1000);
+    memset(large, 3, 1000);
+
+    reset_arena(a);
+    ck_assert_ptr_eq(a->chunk, a->first);
+    ck_assert_int_eq(a->first->used, 0);
+
+    destroy_arena(a);
+}
+END_TEST
+
+START_TEST(test_arena_strdup) {
+    // Duplicate strings into the arena and check if they are copied and terminated.
+    arena *a = create_arena(0);
+
+    char *str = arena_strdup(a, "Hello, World!");
+    ck_assert_str_eq(str, "Hello, World!");
+    ck_assert_str_eq(arena_strndup(a, "Hello, World!", 5), "Hello");
+    ck_assert_ptr_eq(arena_strdup(a, NULL), NULL);
+
+    destroy_arena(a);
+}
+END_TEST
+
+START_TEST(test_response_from_arena_request) {
+    // Create a response from a request allocated from an arena and check if both share the arena.
+    char buf[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    http_parser parser;
+    init_http_parser(&parser);
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+
+    arena *a = create_arena(0);
+    request *req = parse_request_in_place(buf, &parser, 5, a);
+    ck_assert_ptr_ne(req, NULL);
+    ck_assert_ptr_eq(req->arena, a);
+
+    response *res = create_response_from_request(req);
+    ck_assert_ptr_eq(res->arena, a);
+    ck_assert_int_eq(res->owns_arena, false);
+    ck_assert_int_eq(res->conn_fd, 5);
+    ck_assert_str_eq(set_response_header(res, "server", "test"), "test");
+
+    // Releasing the request and response doesn't free anything, the arena is reset instead.
+    req->conn_fd = -1;
+    close_request(req);
+    close_response(res);
+    reset_arena(a);
+    destroy_arena(a);
+}
+END_TEST
+
+Suite *arena_suite() {
+    const TTest *tests[] = {test_arena_alloc, test_arena_alloc_new_chunk, test_arena_strdup,
+                            test_response_from_arena_request};
+
+    Suite *suite = suite_create("Arena");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = arena_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
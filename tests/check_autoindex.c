@@ -0,0 +1,129 @@
+#include <check.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autoindex.h"
+
+/**
+ * Creates a file with the given contents in `dir`, the full path is stored in `path`.
+ */
+void _create_test_file(const char *dir, const char *name, const char *contents, char *path) {
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    fputs(contents, file);
+    fclose(file);
+}
+
+START_TEST(test_parse_autoindex_format) {
+    // Parse format names and check the content types.
+    ck_assert_int_eq(parse_autoindex_format("json"), AUTOINDEX_JSON);
+    ck_assert_int_eq(parse_autoindex_format("JSON"), AUTOINDEX_JSON);
+    ck_assert_int_eq(parse_autoindex_format("html"), AUTOINDEX_HTML);
+    ck_assert_int_eq(parse_autoindex_format("xml"), AUTOINDEX_HTML);
+    ck_assert_int_eq(parse_autoindex_format(NULL), AUTOINDEX_HTML);
+
+    ck_assert_str_eq(get_autoindex_content_type(AUTOINDEX_HTML), "text/html");
+    ck_assert_str_eq(get_autoindex_content_type(AUTOINDEX_JSON), "application/json");
+}
+END_TEST
+
+START_TEST(test_format_directory_listing) {
+    // List a directory and check the order, escaping and hidden entries of both formats.
+    char dir[] = "/tmp/check_autoindex_XXXXXX", path[PATH_MAX], hidden_path[PATH_MAX];
+    char special_path[PATH_MAX], sub_dir[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    _create_test_file(dir, "b.txt", "Hello, World!", path);
+    _create_test_file(dir, ".hidden", "secret", hidden_path);
+    _create_test_file(dir, "a&b \"c\".txt", "", special_path);
+    sprintf(sub_dir, "%s/z", dir);
+    ck_assert_int_eq(mkdir(sub_dir, 0700), 0);
+
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    ck_assert_int_ge(dir_fd, 0);
+
+    GString *html = format_directory_listing(dir_fd, "/docs/", AUTOINDEX_HTML);
+    ck_assert_ptr_ne(html, NULL);
+    ck_assert_ptr_ne(strstr(html->str, "<title>Index of /docs/</title>"), NULL);
+    ck_assert_ptr_ne(strstr(html->str, "<a href=\"../\">"), NULL);
+    ck_assert_ptr_ne(strstr(html->str, "<a href=\"a%26b%20%22c%22.txt\">a&amp;b &quot;c&quot;.txt"),
+                     NULL);
+    ck_assert_ptr_ne(strstr(html->str, "<a href=\"z/\">z/</a>"), NULL);
+    ck_assert_ptr_eq(strstr(html->str, ".hidden"), NULL);
+
+    // Directories are listed first, files by name.
+    char *dir_pos = strstr(html->str, "z/</a>"), *a_pos = strstr(html->str, "a&amp;b");
+    char *b_pos = strstr(html->str, "b.txt</a>");
+    ck_assert(dir_pos < a_pos && a_pos < b_pos);
+    g_string_free(html, TRUE);
+
+    // The listing of the root directory has no parent link.
+    html = format_directory_listing(dir_fd, "/", AUTOINDEX_HTML);
+    ck_assert_ptr_eq(strstr(html->str, "../"), NULL);
+    g_string_free(html, TRUE);
+
+    GString *json = format_directory_listing(dir_fd, "/docs/", AUTOINDEX_JSON);
+    ck_assert_ptr_ne(json, NULL);
+    ck_assert_ptr_ne(strstr(json->str, "{\"name\":\"z\",\"type\":\"directory\",\"mtime\":"),
+                     NULL);
+    ck_assert_ptr_ne(strstr(json->str, "{\"name\":\"a&b \\\"c\\\".txt\",\"type\":\"file\""), NULL);
+    ck_assert_ptr_ne(strstr(json->str, ",\"size\":13}"), NULL);
+    ck_assert_ptr_eq(strstr(json->str, ".hidden"), NULL);
+    ck_assert_int_eq(json->str[0], '[');
+    g_string_free(json, TRUE);
+
+    close(dir_fd);
+    unlink(path);
+    unlink(hidden_path);
+    unlink(special_path);
+    rmdir(sub_dir);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_format_empty_directory_listing) {
+    // List an empty directory and check if the listings are still valid.
+    char dir[] = "/tmp/check_autoindex_XXXXXX";
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+    GString *json = format_directory_listing(dir_fd, "/", AUTOINDEX_JSON);
+    ck_assert_str_eq(json->str, "[]\n");
+    g_string_free(json, TRUE);
+
+    ck_assert_ptr_eq(format_directory_listing(-1, "/", AUTOINDEX_HTML), NULL);
+
+    close(dir_fd);
+    rmdir(dir);
+}
+END_TEST
+
+Suite *autoindex_suite() {
+    const TTest *tests[] = {test_parse_autoindex_format, test_format_directory_listing,
+                            test_format_empty_directory_listing};
+
+    Suite *suite = suite_create("Autoindex");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = autoindex_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
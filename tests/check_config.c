@@ -97,6 +97,99 @@ START_TEST(test_get_config_int_invalid_key) {
 }
 END_TEST
 
+START_TEST(test_get_server_config) {
+    // call get_server_config() before and after load_config() and check the typed values
+    ck_assert_ptr_eq(get_server_config(), NULL);
+
+    load_config();
+    const server_config *cfg = get_server_config();
+    ck_assert_ptr_ne(cfg, NULL);
+    ck_assert_str_eq(cfg->host, "127.0.0.1");
+    ck_assert_int_eq(cfg->port, 8080);
+    ck_assert_str_eq(cfg->default_page, "/index.html");
+    ck_assert_int_eq(cfg->keepalive_requests, 100);
+    ck_assert_int_eq(cfg->shutdown_timeout, 10);
+    ck_assert_int_eq(cfg->max_connections, 10000);
+    ck_assert_int_eq(cfg->max_connections_per_ip, 0);
+    ck_assert_int_eq(cfg->request_head_timeout, 10);
+    ck_assert_int_eq(cfg->request_body_timeout, 30);
+    ck_assert_uint_eq(cfg->max_request_head_size, 32768);
+    ck_assert_uint_eq(cfg->max_request_body_size, 1048576);
+    ck_assert(!cfg->file_cache_mmap);
+    ck_assert(!cfg->file_cache_huge_pages);
+    ck_assert_uint_eq(cfg->fd_cache_entries, 256);
+    ck_assert_int_eq(cfg->fd_cache_ttl, 1);
+    ck_assert_str_eq(cfg->metrics_path, "");
+    ck_assert_str_eq(cfg->proxy_routes, "");
+    ck_assert_str_eq(cfg->proxy_balance, "round_robin");
+    ck_assert_str_eq(cfg->event_backend, "epoll");
+    ck_assert_int_eq(cfg->proxy_pool_size, 32);
+    ck_assert_int_eq(cfg->proxy_health_interval, 5);
+    ck_assert_int_eq(cfg->proxy_timeout, 30);
+    ck_assert_int_eq(cfg->tls_port, 0);
+    ck_assert_str_eq(cfg->tls_certificate, "");
+    ck_assert_str_eq(cfg->tls_private_key, "");
+    ck_assert_int_eq(cfg->tls_session_cache, 20480);
+    ck_assert(cfg->tls_ktls);
+    ck_assert(cfg->http2);
+    ck_assert_uint_eq(cfg->http2_max_streams, 100);
+    ck_assert_uint_eq(cfg->n_index_files, 2);
+    ck_assert_str_eq(cfg->index_files[0], "index.html");
+    ck_assert_str_eq(cfg->index_files[1], "index.htm");
+    ck_assert(!cfg->autoindex);
+    ck_assert_str_eq(cfg->autoindex_format, "html");
+    ck_assert_uint_eq(cfg->n_worker_cpus, 0);
+    ck_assert_ptr_eq(cfg->worker_cpus, NULL);
+
+    unload_config();
+    ck_assert_ptr_eq(get_server_config(), NULL);
+}
+END_TEST
+
+START_TEST(test_reload_config) {
+    // call reload_config() and check if the snapshot is replaced and the old one stays valid
+    ck_assert_int_eq(reload_config(), 0);
+
+    load_config();
+    const server_config *old_cfg = get_server_config();
+    ck_assert_int_eq(reload_config(), 1);
+
+    const server_config *cfg = get_server_config();
+    ck_assert_ptr_ne(cfg, old_cfg);
+    ck_assert_ptr_eq(cfg->retired, old_cfg);
+    ck_assert_str_eq(old_cfg->host, cfg->host);
+
+    unload_config();
+}
+END_TEST
+
+START_TEST(test_get_cache_control) {
+    // call load_config() and check if the cache-control rules match by MIME type and URL
+    load_config();
+    const server_config *cfg = get_server_config();
+    ck_assert_uint_gt(cfg->n_cache_control, 0);
+
+    ck_assert_str_eq(get_cache_control(cfg, "/index.html", "text/html"), "no-cache");
+    ck_assert_str_eq(get_cache_control(cfg, "/images/a.jpg", "image/jpeg"), "public, max-age=86400");
+    ck_assert_str_eq(get_cache_control(cfg, "/style.css", "text/css"), "public, max-age=3600");
+
+    unload_config();
+}
+END_TEST
+
+START_TEST(test_parse_worker_cpus) {
+    // Parse a list of CPUs and CPU ranges and check if invalid entries are skipped.
+    server_config cfg = {0};
+    ck_assert_int_eq(_parse_worker_cpus(&cfg, "0-2, 8,x,5-4,-1 10-11"), 1);
+    ck_assert_uint_eq(cfg.n_worker_cpus, 6);
+
+    const int cpus[] = {0, 1, 2, 8, 10, 11};
+    for (unsigned int c_no = 0; c_no < cfg.n_worker_cpus; c_no++)
+        ck_assert_int_eq(cfg.worker_cpus[c_no], cpus[c_no]);
+    free(cfg.worker_cpus);
+}
+END_TEST
+
 Suite *config_suite() {
     const TTest *tests[] = {test_check_config,
                             test_get_config_without_load,
@@ -107,7 +200,11 @@ Suite *config_suite() {
                             test_get_config_str_valid_key,
                             test_get_config_str_invalid_key,
                             test_get_config_int_valid_key,
-                            test_get_config_int_invalid_key};
+                            test_get_config_int_invalid_key,
+                            test_get_server_config,
+                            test_reload_config,
+                            test_get_cache_control,
+                            test_parse_worker_cpus};
 
     Suite *suite = suite_create("Config");
     TCase *tc_core = tcase_create("Core");
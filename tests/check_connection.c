@@ -0,0 +1,392 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+START_TEST(test_create_connection) {
+    // call create_connection() and check if the connection is initialized with default values.
+    connection *conn = create_connection(-1);
+
+    ck_assert_ptr_ne(conn, NULL);
+    ck_assert_int_eq(conn->fd, -1);
+    ck_assert_int_eq(conn->state, CONN_READING);
+    ck_assert_int_eq(conn->recv_len, 0);
+    ck_assert_ptr_eq(conn->prev, NULL);
+    ck_assert_ptr_eq(conn->next, NULL);
+
+    close_connection(conn);
+}
+END_TEST
+
+START_TEST(test_read_connection_complete_head) {
+    // Send a complete request head and check if the connection is ready to be handled.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    const char *req_buf = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    write(fds[1], req_buf, strlen(req_buf));
+
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->recv_len, strlen(req_buf));
+    ck_assert_str_eq(conn->recv_buf, req_buf);
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_read_connection_split_head) {
+    // Send the request head in two parts and check if the connection waits for the second part.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    write(fds[1], "GET / HTTP/1.1\r\nHo", 18);
+    ck_assert_int_eq(read_connection(conn), CONN_READING);
+
+    write(fds[1], "st: localhost\r\n\r\n", 17);
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_str_eq(conn->recv_buf, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_read_connection_peer_closed) {
+    // Close the peer before the request head is complete and check if the connection is closing.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    write(fds[1], "GET / HTTP/1.1\r\n", 16);
+    close(fds[1]);
+    ck_assert_int_eq(read_connection(conn), CONN_CLOSING);
+
+    close_connection(conn);
+}
+END_TEST
+
+START_TEST(test_read_connection_malformed_head) {
+    // Send a malformed request line and check if a 400 response is due without waiting.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    write(fds[1], "GET /\r\nHost: localhost", 23);
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 400);
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_read_connection_head_too_large) {
+    // Send request heads larger than the initial buffer and the max head size and check if the
+    // buffer grows for the first and a 431 response is due for the second.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    char req_buf[DEFAULT_MAX_REQUEST_HEAD_SIZE];
+    memset(req_buf, 'a', sizeof(req_buf));
+    memcpy(req_buf, "GET / HTTP/1.1\r\nX-Pad: ", 23);
+    write(fds[1], req_buf, REQ_BUF_SIZE + 1);
+    ck_assert_int_eq(read_connection(conn), CONN_READING);
+    ck_assert_uint_eq(conn->recv_size, 2 * REQ_BUF_SIZE);
+
+    write(fds[1], "\r\n\r\n", 4);
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 0);
+    ck_assert_uint_eq(conn->head_len, REQ_BUF_SIZE + 5);
+    close_connection(conn);
+    close(fds[1]);
+
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    conn = create_connection(fds[0]);
+    write(fds[1], req_buf, sizeof(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 431);
+    ck_assert_uint_eq(conn->recv_size, DEFAULT_MAX_REQUEST_HEAD_SIZE);
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_receive_connection_data) {
+    // Hand the data over in pieces like a receive of an io_uring ring, with a pipelined request.
+    connection *conn = create_connection(-1);
+    ck_assert_int_eq(receive_connection_data(conn, "GET /a HTTP/1.1\r\nHo", 19), CONN_READING);
+    ck_assert_int_eq(receive_connection_data(conn, "st: a\r\n\r\nGET /b", 15), CONN_HANDLING);
+    ck_assert_uint_eq(conn->head_len, 28);
+    ck_assert_int_eq(next_connection_request(conn), CONN_READING);
+    ck_assert_str_eq(conn->recv_buf, "GET /b");
+    ck_assert_int_eq(receive_connection_data(conn, NULL, 0), CONN_CLOSING);
+    close_connection(conn);
+
+    // Data that doesn't fit is kept, a head that is still incomplete at the max size gets 431.
+    char req_buf[DEFAULT_MAX_REQUEST_HEAD_SIZE];
+    memset(req_buf, 'a', sizeof(req_buf));
+    memcpy(req_buf, "GET / HTTP/1.1\r\n\r\n", 18);
+    conn = create_connection(-1);
+    ck_assert_int_eq(receive_connection_data(conn, req_buf, sizeof(req_buf)), CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 0);
+    ck_assert_uint_eq(conn->recv_len, sizeof(req_buf));
+    close_connection(conn);
+
+    conn = create_connection(-1);
+    ck_assert_int_eq(receive_connection_data(conn, req_buf + 18, REQ_BUF_SIZE), CONN_READING);
+    ck_assert_int_eq(receive_connection_data(conn, req_buf + 18, sizeof(req_buf) - REQ_BUF_SIZE),
+                     CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 431);
+    close_connection(conn);
+
+    // The blocking mode of the socket is only switched if it changes.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    conn = create_connection(fds[0]);
+    ck_assert(conn->is_blocking);
+    ck_assert_int_eq(set_connection_blocking(conn, 1), 2);
+    ck_assert_int_eq(set_connection_blocking(conn, 0), 1);
+    ck_assert(!conn->is_blocking);
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_next_connection_request_pipelined) {
+    // Send two pipelined requests at once and check if both are handled from the same buffer.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    const char *req_buf = "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\nGET /c";
+    write(fds[1], req_buf, strlen(req_buf));
+
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->head_len, 19);
+
+    ck_assert_int_eq(next_connection_request(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->n_requests, 1);
+    ck_assert_int_eq(conn->head_len, 19);
+    ck_assert_int_eq(strncmp(conn->recv_buf, "GET /b", 6), 0);
+
+    // Third request is incomplete, so the connection waits for more data.
+    ck_assert_int_eq(next_connection_request(conn), CONN_READING);
+    ck_assert_int_eq(conn->n_requests, 2);
+    ck_assert_str_eq(conn->recv_buf, "GET /c");
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_read_connection_body) {
+    // Send a request with a body split across writes, followed by a pipelined request, and check
+    // if the body is read in place and the next request is found after it.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+    set_connection_blocking(conn, 0);
+
+    const char *req_buf = "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello";
+    write(fds[1], req_buf, strlen(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    set_connection_blocking(conn, 1);
+
+    const char *data = NULL;
+    ck_assert_int_eq(read_connection_body(conn, &data), 5);
+    ck_assert_int_eq(strncmp(data, "hello", 5), 0);
+
+    write(fds[1], " worldGET /b HTTP/1.1\r\n\r\n", 25);
+    ck_assert_int_eq(read_connection_body(conn, &data), 6);
+    ck_assert_int_eq(strncmp(data, " world", 6), 0);
+    ck_assert_int_eq(read_connection_body(conn, &data), 0);
+    ck_assert_int_eq(discard_connection_body(conn, 0), 2);
+
+    // The head stays in place while the body is read, the request points into it.
+    ck_assert_int_eq(strncmp(conn->recv_buf, "POST / HTTP/1.1", 15), 0);
+
+    ck_assert_int_eq(next_connection_request(conn), CONN_HANDLING);
+    ck_assert_str_eq(conn->recv_buf, "GET /b HTTP/1.1\r\n\r\n");
+
+    // Without buffered data the buffer is freed until the next request arrives.
+    ck_assert_int_eq(next_connection_request(conn), CONN_READING);
+    ck_assert_ptr_eq(conn->recv_buf, NULL);
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_read_connection_body_chunked) {
+    // Send a chunked body and check if it is dropped and a too long one is refused.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    const char *req_buf = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\nGET /b";
+    write(fds[1], req_buf, strlen(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert(conn->body.chunked);
+    ck_assert_int_eq(discard_connection_body(conn, 11), 1);
+    ck_assert_int_eq(next_connection_request(conn), CONN_READING);
+    ck_assert_str_eq(conn->recv_buf, "GET /b");
+    close_connection(conn);
+    close(fds[1]);
+
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    conn = create_connection(fds[0]);
+    write(fds[1], req_buf, strlen(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(discard_connection_body(conn, 10), 0);
+
+    // The rest of the body is unknown, so the connection can't be reused.
+    ck_assert_int_eq(next_connection_request(conn), CONN_CLOSING);
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_discard_connection_body_pending) {
+    // Send part of a body and check if the rest is left to the event loop instead of waited for.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    const char *req_buf = "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello";
+    write(fds[1], req_buf, strlen(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(discard_connection_body(conn, 11), 1);
+    ck_assert_int_ne(conn->body.state, HTTP_BODY_DONE);
+    ck_assert_uint_eq(conn->body_max, 11);
+
+    const char *data = NULL;
+    ck_assert_int_eq(read_connection_body(conn, &data), -1);
+    ck_assert_int_eq(errno, EAGAIN);
+
+    write(fds[1], " worldGET /b HTTP/1.1\r\n\r\n", 25);
+    ck_assert_int_eq(discard_connection_body(conn, conn->body_max), 1);
+    ck_assert_int_eq(conn->body.state, HTTP_BODY_DONE);
+    ck_assert_int_eq(next_connection_request(conn), CONN_HANDLING);
+    ck_assert_uint_eq(conn->body_max, 0);
+    ck_assert_str_eq(conn->recv_buf, "GET /b HTTP/1.1\r\n\r\n");
+
+    // A peer that closes before the body is complete fails the read.
+    req_buf = "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello";
+    write(fds[1], req_buf, strlen(req_buf));
+    next_connection_request(conn);
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    close(fds[1]);
+    ck_assert_int_eq(discard_connection_body(conn, 11), 0);
+    ck_assert_int_eq(errno, ECONNRESET);
+
+    close_connection(conn);
+}
+END_TEST
+
+START_TEST(test_read_connection_body_framing) {
+    // Send a request with both Content-Length and Transfer-Encoding and check if it is rejected.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    connection *conn = create_connection(fds[0]);
+
+    const char *req_buf =
+        "POST / HTTP/1.1\r\nContent-Length: 4\r\nTransfer-Encoding: chunked\r\n\r\n";
+    write(fds[1], req_buf, strlen(req_buf));
+    ck_assert_int_eq(read_connection(conn), CONN_HANDLING);
+    ck_assert_int_eq(conn->error_status, 400);
+
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_write_connection) {
+    // Write more than the socket takes and check if the rest is queued, in order, and sent once
+    // the peer reads.
+    int fds[2], sndbuf = 4096;
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    connection *conn = create_connection(fds[0]);
+
+    size_t body_len = 256 * 1024;
+    char *body = malloc(body_len), *head = "HTTP/1.1 200 OK\r\n\r\n";
+    for (size_t pos = 0; pos < body_len; pos++)
+        body[pos] = 'a' + pos % 26;
+    FILE *file = tmpfile();
+    fwrite(body, 1, body_len, file);
+    fflush(file);
+
+    struct iovec iov[2] = {{.iov_base = head, .iov_len = strlen(head)},
+                           {.iov_base = body, .iov_len = body_len}};
+    ck_assert_int_eq(write_connection(conn, iov, 1, MSG_MORE), strlen(head));
+    ck_assert_int_eq(write_connection_held(conn, iov + 1, 1, 0, free, body),
+                     body_len);
+    ck_assert_ptr_ne(conn->output, NULL);
+    ck_assert_int_eq(write_connection_file(conn, fileno(file), 10, body_len - 10), body_len - 10);
+    fclose(file);
+    ck_assert_int_eq(flush_connection(conn), 2);
+
+    // The held body is released once it is sent, the file range is sent from its duplicate.
+    size_t total_len = strlen(head) + body_len * 2 - 10, recv_len = 0;
+    char *buf = malloc(total_len);
+    while (recv_len < total_len) {
+        ssize_t recv_size = read(fds[1], buf + recv_len, total_len - recv_len);
+        if (recv_size > 0)
+            recv_len += recv_size;
+        ck_assert_int_ne(flush_connection(conn), 0);
+    }
+    ck_assert_int_eq(flush_connection(conn), 1);
+    ck_assert_ptr_eq(conn->output, NULL);
+    ck_assert_int_eq(memcmp(buf, head, strlen(head)), 0);
+    ck_assert_int_eq(buf[strlen(head)], 'a');
+    ck_assert_int_eq(buf[strlen(head) + body_len], 'k');
+    ck_assert_int_eq(buf[total_len - 1], 'a' + (body_len - 1) % 26);
+
+    free(buf);
+    close_connection(conn);
+    close(fds[1]);
+}
+END_TEST
+
+Suite *connection_suite() {
+    const TTest *tests[] = {test_create_connection, test_read_connection_complete_head,
+                            test_read_connection_split_head, test_read_connection_peer_closed,
+                            test_read_connection_malformed_head,
+                            test_read_connection_head_too_large, test_receive_connection_data,
+                            test_next_connection_request_pipelined, test_read_connection_body,
+                            test_read_connection_body_chunked, test_discard_connection_body_pending,
+                            test_read_connection_body_framing, test_write_connection};
+
+    Suite *suite = suite_create("Connection");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = connection_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
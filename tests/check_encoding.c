@@ -0,0 +1,123 @@
+#include <check.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "encoding.h"
+
+START_TEST(test_parse_accept_encoding) {
+    // Parse Accept-Encoding headers and check the accepted codings.
+    ck_assert_int_eq(parse_accept_encoding("gzip, deflate, br"),
+                     CONTENT_ENCODING_GZIP | CONTENT_ENCODING_BR);
+    ck_assert_int_eq(parse_accept_encoding("br;q=0, GZIP;q=0.5"), CONTENT_ENCODING_GZIP);
+    ck_assert_int_eq(parse_accept_encoding("*, zstd; q=0"),
+                     CONTENT_ENCODING_GZIP | CONTENT_ENCODING_BR);
+    ck_assert_int_eq(parse_accept_encoding("identity"), CONTENT_ENCODING_IDENTITY);
+    ck_assert_int_eq(parse_accept_encoding(""), CONTENT_ENCODING_IDENTITY);
+    ck_assert_int_eq(parse_accept_encoding(NULL), CONTENT_ENCODING_IDENTITY);
+}
+END_TEST
+
+START_TEST(test_select_content_encoding) {
+    // Select the coding of a response and check the preference order and names.
+    unsigned int all = CONTENT_ENCODING_GZIP | CONTENT_ENCODING_BR | CONTENT_ENCODING_ZSTD;
+    ck_assert_int_eq(select_content_encoding(all, all), CONTENT_ENCODING_BR);
+    ck_assert_int_eq(select_content_encoding(all, CONTENT_ENCODING_GZIP | CONTENT_ENCODING_ZSTD),
+                     CONTENT_ENCODING_ZSTD);
+    ck_assert_int_eq(select_content_encoding(CONTENT_ENCODING_GZIP, CONTENT_ENCODING_BR),
+                     CONTENT_ENCODING_IDENTITY);
+
+    ck_assert_str_eq(get_content_encoding_name(CONTENT_ENCODING_BR), "br");
+    ck_assert_str_eq(get_content_encoding_suffix(CONTENT_ENCODING_GZIP), ".gz");
+    ck_assert_ptr_eq(get_content_encoding_name(CONTENT_ENCODING_IDENTITY), NULL);
+    ck_assert_int_eq(get_precompressed_file_encoding("site/style.css.zst"), CONTENT_ENCODING_ZSTD);
+    ck_assert_int_eq(get_precompressed_file_encoding("site/style.css"), CONTENT_ENCODING_IDENTITY);
+    ck_assert_int_eq(get_precompressed_file_encoding(".br"), CONTENT_ENCODING_IDENTITY);
+}
+END_TEST
+
+START_TEST(test_find_precompressed_files) {
+    // Create precompressed siblings of a file and check if they are found.
+    char dir[] = "/tmp/check_encoding_XXXXXX", path[PATH_MAX], sibling_path[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    sprintf(path, "%s/style.css", dir);
+    ck_assert_int_eq(find_precompressed_files(path), 0);
+
+    sprintf(sibling_path, "%s.br", path);
+    fclose(fopen(sibling_path, "w"));
+    ck_assert_int_eq(find_precompressed_files(path), CONTENT_ENCODING_BR);
+
+    unlink(sibling_path);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_is_mimetype_compressible) {
+    // Check if text types are compressible and already compressed types are not.
+    ck_assert_int_eq(is_mimetype_compressible("text/html"), true);
+    ck_assert_int_eq(is_mimetype_compressible("application/javascript"), true);
+    ck_assert_int_eq(is_mimetype_compressible("image/svg+xml"), true);
+    ck_assert_int_eq(is_mimetype_compressible("application/ld+json"), true);
+    ck_assert_int_eq(is_mimetype_compressible("image/jpeg"), false);
+    ck_assert_int_eq(is_mimetype_compressible("application/octet-stream"), false);
+    ck_assert_int_eq(is_mimetype_compressible(NULL), false);
+}
+END_TEST
+
+START_TEST(test_compress_gzip) {
+    // Compress a buffer and check if it decompresses to the original buffer.
+    char buf[1024], decompressed[1024];
+    for (int i = 0; i < sizeof(buf); i++)
+        buf[i] = "Hello, World! "[i % 14];
+
+    size_t compressed_size = 0;
+    char *compressed = compress_gzip(buf, sizeof(buf), 0, &compressed_size);
+    ck_assert_ptr_ne(compressed, NULL);
+    ck_assert_int_lt(compressed_size, sizeof(buf));
+
+    z_stream stream = {0};
+    ck_assert_int_eq(inflateInit2(&stream, 16 + MAX_WBITS), Z_OK);
+    stream.next_in = (Bytef *)compressed;
+    stream.avail_in = compressed_size;
+    stream.next_out = (Bytef *)decompressed;
+    stream.avail_out = sizeof(decompressed);
+    ck_assert_int_eq(inflate(&stream, Z_FINISH), Z_STREAM_END);
+    ck_assert_int_eq(stream.total_out, sizeof(buf));
+    ck_assert_int_eq(memcmp(buf, decompressed, sizeof(buf)), 0);
+
+    inflateEnd(&stream);
+    free(compressed);
+}
+END_TEST
+
+Suite *encoding_suite() {
+    const TTest *tests[] = {test_parse_accept_encoding, test_select_content_encoding,
+                            test_find_precompressed_files, test_is_mimetype_compressible,
+                            test_compress_gzip};
+
+    Suite *suite = suite_create("Encoding");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = encoding_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,219 @@
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+
+/**
+ * Creates a file with the given contents in `dir`, the full path is stored in `path`.
+ */
+void _create_test_file(const char *dir, const char *name, const char *contents, char *path) {
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    fputs(contents, file);
+    fclose(file);
+}
+
+START_TEST(test_resolve_site_path) {
+    // Resolve URL paths and check if the ones leading out of the root directory are rejected.
+    char rel_path[64];
+
+    ck_assert_int_eq(resolve_site_path("/index.html", rel_path, sizeof(rel_path)), 1);
+    ck_assert_str_eq(rel_path, "index.html");
+    ck_assert_int_eq(resolve_site_path("/a//b/./../c", rel_path, sizeof(rel_path)), 1);
+    ck_assert_str_eq(rel_path, "a/c");
+    ck_assert_int_eq(resolve_site_path("/images/", rel_path, sizeof(rel_path)), 1);
+    ck_assert_str_eq(rel_path, "images");
+    ck_assert_int_eq(resolve_site_path("/a/..", rel_path, sizeof(rel_path)), 1);
+    ck_assert_str_eq(rel_path, "");
+    ck_assert_int_eq(resolve_site_path("/.hidden/..a", rel_path, sizeof(rel_path)), 1);
+    ck_assert_str_eq(rel_path, ".hidden/..a");
+
+    ck_assert_int_eq(resolve_site_path("/../etc/passwd", rel_path, sizeof(rel_path)), 0);
+    ck_assert_int_eq(resolve_site_path("/a/../../etc/passwd", rel_path, sizeof(rel_path)), 0);
+    ck_assert_int_eq(resolve_site_path("/..", rel_path, sizeof(rel_path)), 0);
+    ck_assert_int_eq(resolve_site_path("/0123456789/0123456789", rel_path, 21), 0);
+    ck_assert_int_eq(resolve_site_path("/0123456789/0123456789", rel_path, 22), 1);
+}
+END_TEST
+
+START_TEST(test_open_fd_cache_entry) {
+    // Open a file twice and check if the second open is served from the cache.
+    char dir[] = "/tmp/check_fdcache_XXXXXX", path[PATH_MAX], sub_dir[PATH_MAX], fifo[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    _create_test_file(dir, "a.txt", "Hello, World!", path);
+    sprintf(sub_dir, "%s/sub", dir);
+    ck_assert_int_eq(mkdir(sub_dir, 0700), 0);
+    sprintf(fifo, "%s/fifo", dir);
+    ck_assert_int_eq(mkfifo(fifo, 0600), 0);
+
+    ck_assert_int_eq(create_fd_cache(dir, 8, 60), 1);
+    ck_assert_int_eq(create_fd_cache(dir, 8, 60), 2);
+
+    fd_cache_entry *entry = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_str_eq(entry->path, "a.txt");
+    ck_assert_int_eq(entry->file_stat.st_size, 13);
+    char buf[16];
+    ck_assert_int_eq(pread(entry->fd, buf, sizeof(buf), 0), 13);
+    ck_assert_int_eq(fcntl(entry->fd, F_GETFL) & O_NONBLOCK, 0);
+
+    fd_cache_entry *hit = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_ptr_eq(hit, entry);
+    release_fd_cache_entry(hit);
+    release_fd_cache_entry(entry);
+
+    // Entries stay valid after they are removed from the cache, until they are released.
+    entry = open_fd_cache_entry(dir, "a.txt");
+    clear_fd_cache();
+    ck_assert_int_eq(pread(entry->fd, buf, sizeof(buf), 0), 13);
+    hit = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_ptr_ne(hit, entry);
+    release_fd_cache_entry(hit);
+    release_fd_cache_entry(entry);
+
+    // Only regular files are opened, directories are told apart from missing files.
+    errno = 0;
+    ck_assert_ptr_eq(open_fd_cache_entry(dir, "sub"), NULL);
+    ck_assert_int_eq(errno, EISDIR);
+    ck_assert_ptr_eq(open_fd_cache_entry(dir, "b.txt"), NULL);
+    ck_assert_int_eq(errno, ENOENT);
+
+    // A FIFO is refused without waiting for a writer.
+    ck_assert_ptr_eq(open_fd_cache_entry(dir, "fifo"), NULL);
+    ck_assert_int_eq(errno, ENOENT);
+
+    destroy_fd_cache();
+    unlink(fifo);
+    unlink(path);
+    rmdir(sub_dir);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_open_fd_cache_entry_beneath) {
+    // Check if symbolic links leading out of the root directory are not followed.
+    char dir[] = "/tmp/check_fdcache_XXXXXX", path[PATH_MAX], link_path[PATH_MAX];
+    char outside[] = "/tmp/check_fdcache_XXXXXX", outside_path[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_ptr_ne(mkdtemp(outside), NULL);
+    _create_test_file(dir, "a.txt", "inside", path);
+    _create_test_file(outside, "b.txt", "outside", outside_path);
+    sprintf(link_path, "%s/link.txt", dir);
+    ck_assert_int_eq(symlink(outside_path, link_path), 0);
+
+    ck_assert_int_eq(create_fd_cache(dir, 8, 60), 1);
+    ck_assert_ptr_eq(open_fd_cache_entry(dir, "link.txt"), NULL);
+    ck_assert_ptr_eq(open_fd_cache_entry(dir, outside_path), NULL);
+
+    // Directories other than the cached one are opened for every file.
+    fd_cache_entry *entry = open_fd_cache_entry(outside, "b.txt");
+    ck_assert_ptr_ne(entry, NULL);
+    fd_cache_entry *other = open_fd_cache_entry(outside, "b.txt");
+    ck_assert_ptr_ne(other, entry);
+    release_fd_cache_entry(other);
+    release_fd_cache_entry(entry);
+
+    destroy_fd_cache();
+    unlink(link_path);
+    unlink(path);
+    unlink(outside_path);
+    rmdir(dir);
+    rmdir(outside);
+}
+END_TEST
+
+START_TEST(test_open_site_directory) {
+    // Open the root directory and a subdirectory, and check if files are not opened as directories.
+    char dir[] = "/tmp/check_fdcache_XXXXXX", path[PATH_MAX], sub_dir[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    _create_test_file(dir, "a.txt", "Hello, World!", path);
+    sprintf(sub_dir, "%s/sub", dir);
+    ck_assert_int_eq(mkdir(sub_dir, 0700), 0);
+    ck_assert_int_eq(create_fd_cache(dir, 8, 60), 1);
+
+    struct stat dir_stat;
+    int dir_fd = open_site_directory(dir, "", &dir_stat);
+    ck_assert_int_ge(dir_fd, 0);
+    ck_assert(S_ISDIR(dir_stat.st_mode));
+    ck_assert_int_eq(faccessat(dir_fd, "a.txt", R_OK, 0), 0);
+    close(dir_fd);
+
+    dir_fd = open_site_directory(dir, "sub", &dir_stat);
+    ck_assert_int_ge(dir_fd, 0);
+    close(dir_fd);
+
+    errno = 0;
+    ck_assert_int_eq(open_site_directory(dir, "a.txt", &dir_stat), -1);
+    ck_assert_int_eq(errno, ENOTDIR);
+    ck_assert_int_eq(open_site_directory(dir, "missing", &dir_stat), -1);
+    ck_assert_int_eq(errno, ENOENT);
+
+    destroy_fd_cache();
+    unlink(path);
+    rmdir(sub_dir);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_fd_cache_ttl) {
+    // Replace a cached file and check if it is only opened again once its entry has expired.
+    char dir[] = "/tmp/check_fdcache_XXXXXX", path[PATH_MAX], new_path[PATH_MAX];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    _create_test_file(dir, "a.txt", "old", path);
+    ck_assert_int_eq(create_fd_cache(dir, 1, 1), 1);
+
+    fd_cache_entry *entry = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_int_eq(entry->file_stat.st_size, 3);
+    release_fd_cache_entry(entry);
+
+    _create_test_file(dir, "a.txt.new", "new file", new_path);
+    ck_assert_int_eq(rename(new_path, path), 0);
+    entry = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_int_eq(entry->file_stat.st_size, 3);
+    release_fd_cache_entry(entry);
+
+    usleep(1100000);
+    entry = open_fd_cache_entry(dir, "a.txt");
+    ck_assert_int_eq(entry->file_stat.st_size, 8);
+    release_fd_cache_entry(entry);
+
+    destroy_fd_cache();
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+Suite *fdcache_suite() {
+    const TTest *tests[] = {test_resolve_site_path, test_open_fd_cache_entry,
+                            test_open_fd_cache_entry_beneath, test_open_site_directory,
+                            test_fd_cache_ttl};
+
+    Suite *suite = suite_create("FdCache");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = fdcache_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,305 @@
+#include <check.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "filecache.h"
+
+/**
+ * Creates a file with the given contents in `dir` and returns a read only file descriptor for it.
+ */
+int _create_test_file(const char *dir, const char *name, const char *contents, char *path,
+                      struct stat *file_stat) {
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    fputs(contents, file);
+    fclose(file);
+
+    int file_fd = open(path, O_RDONLY);
+    fstat(file_fd, file_stat);
+    return file_fd;
+}
+
+START_TEST(test_add_file_cache_entry) {
+    // Add a file to the cache and check if it is returned on lookup with its headers.
+    char dir[] = "/tmp/check_filecache_XXXXXX", path[PATH_MAX];
+    struct stat file_stat;
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8, 0), 1);
+
+    int file_fd = _create_test_file(dir, "a.txt", "Hello, World!", path, &file_stat);
+    response *res = create_response(-1);
+    set_response_header(res, "content-type", "text/plain");
+
+    ck_assert_ptr_eq(get_file_cache_entry(path), NULL);
+    file_cache_entry *entry = add_file_cache_entry(path, file_fd, &file_stat, res, 0, 0);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_int_eq(entry->body_len, 13);
+    ck_assert_int_eq(memcmp(entry->body, "Hello, World!", 13), 0);
+    ck_assert_ptr_ne(strstr(entry->headers, "content-type: text/plain\r\n"), NULL);
+    ck_assert_ptr_ne(strstr(entry->headers, "content-length: 13\r\n"), NULL);
+    ck_assert_ptr_ne(strstr(entry->headers, "etag: "), NULL);
+    ck_assert_ptr_ne(strstr(entry->headers, "last-modified: "), NULL);
+    ck_assert_ptr_eq(entry->gzip, NULL);
+    release_file_cache_entry(entry);
+
+    entry = get_file_cache_entry(path);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_str_eq(entry->path, path);
+    release_file_cache_entry(entry);
+
+    invalidate_file_cache_entry(path);
+    ck_assert_ptr_eq(get_file_cache_entry(path), NULL);
+
+    close(file_fd);
+    close_response(res);
+    destroy_file_cache();
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_is_file_cacheable) {
+    // Check if files larger than the max file size are not cached.
+    char dir[] = "/tmp/check_filecache_XXXXXX";
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+
+    ck_assert_int_eq(is_file_cacheable(1), 0);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8, 0), 1);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8, 0), 2);
+    ck_assert_int_eq(is_file_cacheable(64), 1);
+    ck_assert_int_eq(is_file_cacheable(65), 0);
+
+    destroy_file_cache();
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_evict_file_cache_entries) {
+    // Fill the cache beyond max entries and check if the entry that wasn't hit is evicted.
+    char dir[] = "/tmp/check_filecache_XXXXXX", paths[3][PATH_MAX];
+    const char *names[] = {"a.txt", "b.txt", "c.txt"};
+    struct stat file_stat;
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 2, 0), 1);
+
+    response *res = create_response(-1);
+    for (int i = 0; i < 3; i++) {
+        int file_fd = _create_test_file(dir, names[i], names[i], paths[i], &file_stat);
+        release_file_cache_entry(add_file_cache_entry(paths[i], file_fd, &file_stat, res, 0, 0));
+        close(file_fd);
+
+        // Mark the first entry as recently used.
+        if (i == 1)
+            release_file_cache_entry(get_file_cache_entry(paths[0]));
+    }
+
+    file_cache_entry *entry = get_file_cache_entry(paths[0]);
+    ck_assert_ptr_ne(entry, NULL);
+    release_file_cache_entry(entry);
+    ck_assert_ptr_eq(get_file_cache_entry(paths[1]), NULL);
+    entry = get_file_cache_entry(paths[2]);
+    ck_assert_ptr_ne(entry, NULL);
+    release_file_cache_entry(entry);
+
+    close_response(res);
+    destroy_file_cache();
+    for (int i = 0; i < 3; i++)
+        unlink(paths[i]);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_send_file_cache_entry) {
+    // Send a cached entry and check if the complete response is received.
+    char dir[] = "/tmp/check_filecache_XXXXXX", path[PATH_MAX], buf[256];
+    struct stat file_stat;
+    int fds[2];
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8, 0), 1);
+
+    int file_fd = _create_test_file(dir, "a.txt", "body", path, &file_stat);
+    response *res = create_response(-1);
+    file_cache_entry *entry = add_file_cache_entry(path, file_fd, &file_stat, res, 0, 0);
+    ck_assert_ptr_ne(entry, NULL);
+
+    ck_assert_int_eq(send_file_cache_entry(fds[0], entry, "HTTP/1.1 200 OK\r\n",
+                                           "connection: close\r\n\r\n", true),
+                     4);
+    ssize_t len = recv(fds[1], buf, sizeof(buf) - 1, 0);
+    buf[len] = '\0';
+    ck_assert_int_eq(strncmp(buf, "HTTP/1.1 200 OK\r\n", 17), 0);
+    ck_assert_ptr_ne(strstr(buf, "content-length: 4\r\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf, "connection: close\r\n\r\nbody"), NULL);
+
+    // Responses to HEAD requests have the same head but no body.
+    ck_assert_int_eq(send_file_cache_entry(fds[0], entry, "HTTP/1.1 200 OK\r\n",
+                                           "connection: close\r\n\r\n", false),
+                     0);
+    len = recv(fds[1], buf, sizeof(buf) - 1, 0);
+    buf[len] = '\0';
+    ck_assert_ptr_ne(strstr(buf, "content-length: 4\r\n"), NULL);
+    ck_assert_int_eq(strcmp(buf + len - 4, "\r\n\r\n"), 0);
+
+    release_file_cache_entry(entry);
+    close(file_fd);
+    close(fds[0]);
+    close(fds[1]);
+    close_response(res);
+    destroy_file_cache();
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_add_compressed_file_cache_entry) {
+    // Add a compressible file to the cache and check if a smaller gzip copy is stored with it.
+    char dir[] = "/tmp/check_filecache_XXXXXX", path[PATH_MAX], contents[513];
+    struct stat file_stat;
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(create_file_cache(dir, 4096, 1024, 8, 0), 1);
+
+    memset(contents, 'a', 512);
+    contents[512] = '\0';
+    int file_fd = _create_test_file(dir, "a.css", contents, path, &file_stat);
+    response *res = create_response(-1);
+    set_response_header(res, "content-type", "text/css");
+
+    file_cache_entry *entry = add_file_cache_entry(path, file_fd, &file_stat, res, 0, 6);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_ptr_ne(entry->gzip, NULL);
+    ck_assert_int_lt(entry->gzip->body_len, 512);
+    ck_assert_int_eq((unsigned char)entry->gzip->body[0], 0x1f);
+    ck_assert_int_eq((unsigned char)entry->gzip->body[1], 0x8b);
+    ck_assert_ptr_ne(strstr(entry->gzip->headers, "content-type: text/css\r\n"), NULL);
+    ck_assert_ptr_ne(strstr(entry->gzip->headers, "content-encoding: gzip\r\n"), NULL);
+    ck_assert_ptr_eq(strstr(entry->headers, "content-encoding"), NULL);
+    ck_assert_str_ne(entry->gzip->etag, entry->etag);
+    ck_assert_ptr_ne(strstr(entry->gzip->etag, "-gz\""), NULL);
+    release_file_cache_entry(entry);
+
+    // Files with a gzip sibling are not compressed again.
+    entry = add_file_cache_entry(path, file_fd, &file_stat, res, CONTENT_ENCODING_GZIP, 6);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_ptr_eq(entry->gzip, NULL);
+    ck_assert_int_eq(entry->encodings, CONTENT_ENCODING_GZIP);
+    release_file_cache_entry(entry);
+
+    close(file_fd);
+    close_response(res);
+    destroy_file_cache();
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_add_mapped_file_cache_entry) {
+    // Add files to a cache that maps them and check if the bodies are mapped, except empty files.
+    char dir[] = "/tmp/check_filecache_XXXXXX", path[PATH_MAX], empty_path[PATH_MAX];
+    struct stat file_stat, empty_stat;
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8,
+                                       FILE_CACHE_MAP_FILES | FILE_CACHE_MAP_HUGE_PAGES), 1);
+
+    int file_fd = _create_test_file(dir, "a.json", "{\"a\": 1}", path, &file_stat);
+    int empty_fd = _create_test_file(dir, "b.json", "", empty_path, &empty_stat);
+    response *res = create_response(-1);
+
+    file_cache_entry *entry = add_file_cache_entry(path, file_fd, &file_stat, res, 0, 0);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert(entry->is_mapped);
+    ck_assert_int_eq(entry->body_len, 8);
+    ck_assert_int_eq(memcmp(entry->body, "{\"a\": 1}", 8), 0);
+
+    // Mapped bodies stay valid after the file is closed and the entry is evicted.
+    close(file_fd);
+    clear_file_cache();
+    ck_assert_int_eq(memcmp(entry->body, "{\"a\": 1}", 8), 0);
+    release_file_cache_entry(entry);
+
+    entry = add_file_cache_entry(empty_path, empty_fd, &empty_stat, res, 0, 0);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert(!entry->is_mapped);
+    ck_assert_int_eq(entry->body_len, 0);
+    release_file_cache_entry(entry);
+
+    close(empty_fd);
+    close_response(res);
+    destroy_file_cache();
+    unlink(path);
+    unlink(empty_path);
+    rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_add_file_cache_buffer) {
+    // Cache a generated listing of a directory and check if a change in the directory removes it.
+    char dir[] = "/tmp/check_filecache_XXXXXX", listing_path[PATH_MAX], path[PATH_MAX];
+    struct stat dir_stat, file_stat;
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(create_file_cache(dir, 1024, 64, 8, 0), 1);
+    ck_assert_int_eq(stat(dir, &dir_stat), 0);
+    sprintf(listing_path, "%s/", dir);
+
+    response *res = create_response(-1);
+    set_response_header(res, "content-type", "application/json");
+    file_cache_entry *entry = add_file_cache_buffer(listing_path, "[]\n", 3, &dir_stat, res, 0);
+    ck_assert_ptr_ne(entry, NULL);
+    ck_assert_int_eq(memcmp(entry->body, "[]\n", 3), 0);
+    ck_assert_ptr_ne(strstr(entry->headers, "content-length: 3\r\n"), NULL);
+
+    // The entity tag depends on the body, not on the directory.
+    file_cache_entry *other = add_file_cache_buffer(listing_path, "[ ]\n", 4, &dir_stat, res, 0);
+    ck_assert_str_ne(other->etag, entry->etag);
+    release_file_cache_entry(other);
+    release_file_cache_entry(entry);
+
+    entry = get_file_cache_entry(listing_path);
+    ck_assert_ptr_ne(entry, NULL);
+    release_file_cache_entry(entry);
+
+    int file_fd = _create_test_file(dir, "a.txt", "Hello, World!", path, &file_stat);
+    usleep(100000);
+    ck_assert_ptr_eq(get_file_cache_entry(listing_path), NULL);
+
+    close(file_fd);
+    close_response(res);
+    destroy_file_cache();
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+Suite *filecache_suite() {
+    const TTest *tests[] = {test_add_file_cache_entry, test_is_file_cacheable,
+                            test_evict_file_cache_entries, test_send_file_cache_entry,
+                            test_add_compressed_file_cache_entry, test_add_mapped_file_cache_entry,
+                            test_add_file_cache_buffer};
+
+    Suite *suite = suite_create("FileCache");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = filecache_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
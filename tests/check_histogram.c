@@ -0,0 +1,94 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "histogram.h"
+
+START_TEST(test_get_histogram_bucket) {
+    // Check if small values get a bucket each and every value is within its bucket's precision.
+    ck_assert_int_eq(_get_histogram_bucket(0), 0);
+    ck_assert_int_eq(_get_histogram_bucket(127), 127);
+    ck_assert_int_eq(_get_histogram_bucket(128), 128);
+    ck_assert_int_eq(_get_histogram_bucket(UINT64_MAX), HISTOGRAM_N_BUCKETS - 1);
+
+    const uint64_t values[] = {1, 200, 1000, 123456, 987654321, UINT64_MAX >> 3};
+    for (int v_no = 0; v_no < sizeof(values) / sizeof(values[0]); v_no++) {
+        uint64_t value = _get_histogram_bucket_value(_get_histogram_bucket(values[v_no]));
+        ck_assert_uint_ge(value, values[v_no]);
+        ck_assert_uint_le(value - values[v_no], values[v_no] / 64);
+    }
+}
+END_TEST
+
+START_TEST(test_get_histogram_percentile) {
+    // Record 1 to 1000 and check the percentiles, the mean and the extremes.
+    histogram *h = create_histogram();
+    ck_assert_ptr_ne(h, NULL);
+    ck_assert_uint_eq(get_histogram_percentile(h, 50), 0);
+
+    for (uint64_t value = 1; value <= 1000; value++)
+        record_histogram_value(h, value);
+
+    ck_assert_uint_eq(h->count, 1000);
+    ck_assert_uint_eq(h->min, 1);
+    ck_assert_uint_eq(h->max, 1000);
+    ck_assert(get_histogram_mean(h) == 500.5);
+    ck_assert_uint_eq(get_histogram_percentile(h, 0), 1);
+    ck_assert_uint_eq(get_histogram_percentile(h, 10), 100);
+    ck_assert_uint_ge(get_histogram_percentile(h, 50), 500);
+    ck_assert_uint_le(get_histogram_percentile(h, 50), 507);
+    ck_assert_uint_ge(get_histogram_percentile(h, 99), 990);
+    ck_assert_uint_eq(get_histogram_percentile(h, 100), 1000);
+
+    destroy_histogram(h);
+}
+END_TEST
+
+START_TEST(test_merge_histogram) {
+    // Merge two histograms and check if the result holds the values of both.
+    histogram *a = create_histogram(), *b = create_histogram();
+    record_histogram_value(a, 10);
+    record_histogram_value(b, 5);
+    record_histogram_value(b, 20000);
+
+    merge_histogram(a, b);
+    ck_assert_uint_eq(a->count, 3);
+    ck_assert_uint_eq(a->min, 5);
+    ck_assert_uint_eq(a->max, 20000);
+    ck_assert_uint_eq(get_histogram_percentile(a, 50), 10);
+
+    reset_histogram(a);
+    ck_assert_uint_eq(a->count, 0);
+    ck_assert_uint_eq(get_histogram_percentile(a, 99), 0);
+
+    destroy_histogram(a);
+    destroy_histogram(b);
+}
+END_TEST
+
+Suite *histogram_suite() {
+    const TTest *tests[] = {test_get_histogram_bucket, test_get_histogram_percentile,
+                            test_merge_histogram};
+
+    Suite *suite = suite_create("Histogram");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = histogram_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
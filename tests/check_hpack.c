@@ -0,0 +1,183 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+/**
+ * Appends a decoded header to the `GString` `arg` as a "<name>: <value>\n" line.
+ */
+void _append_header(void *arg, const char *name, const size_t name_len, const char *value,
+                    const size_t value_len) {
+    g_string_append_len((GString *)arg, name, name_len);
+    g_string_append(arg, ": ");
+    g_string_append_len((GString *)arg, value, value_len);
+    g_string_append_c(arg, '\n');
+}
+
+/**
+ * Decodes the blocks of RFC 7541, appendix C.3 or C.4, in order into the same table.
+ */
+void _decode_request_examples(const char *blocks[3], const size_t lens[3]) {
+    const char *expected[] = {
+        ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n",
+        ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n"
+        "cache-control: no-cache\n",
+        ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\n"
+        "custom-key: custom-value\n"};
+    const size_t expected_sizes[] = {57, 110, 164};
+    hpack_table table;
+    init_hpack_table(&table, HPACK_DEFAULT_TABLE_SIZE);
+
+    for (int block_no = 0; block_no < 3; block_no++) {
+        GString *headers = g_string_new(NULL);
+        ck_assert_int_eq(decode_hpack_block(&table, (const unsigned char *)blocks[block_no],
+                                            lens[block_no], _append_header, headers),
+                         1);
+        ck_assert_str_eq(headers->str, expected[block_no]);
+        ck_assert_uint_eq(table.size, expected_sizes[block_no]);
+        g_string_free(headers, TRUE);
+    }
+
+    ck_assert_uint_eq(table.len, 3);
+    ck_assert_str_eq(get_hpack_entry(&table, 62)->name, "custom-key");
+    ck_assert_str_eq(get_hpack_entry(&table, 64)->value, "www.example.com");
+    ck_assert_ptr_eq(get_hpack_entry(&table, 65), NULL);
+    free_hpack_table(&table);
+}
+
+START_TEST(test_decode_hpack_block) {
+    // Decode the request examples without Huffman coding (RFC 7541, appendix C.3).
+    const char *blocks[] = {
+        "\x82\x86\x84\x41\x0f" "www.example.com",
+        "\x82\x86\x84\xbe\x58\x08" "no-cache",
+        "\x82\x87\x85\xbf\x40\x0a" "custom-key" "\x0c" "custom-value"};
+    const size_t lens[] = {20, 14, 29};
+    _decode_request_examples(blocks, lens);
+
+    // Invalid indexes, truncated strings and late size updates are compression errors.
+    hpack_table table;
+    init_hpack_table(&table, HPACK_DEFAULT_TABLE_SIZE);
+    GString *headers = g_string_new(NULL);
+    const char *invalid[] = {"\x80", "\xbe", "\x41\x0f" "www", "\x82\x3f\xe1\x1f", "\x3f\xe2\x1f"};
+    const size_t invalid_lens[] = {1, 1, 5, 4, 3};
+    for (int block_no = 0; block_no < 5; block_no++)
+        ck_assert_int_eq(decode_hpack_block(&table, (const unsigned char *)invalid[block_no],
+                                            invalid_lens[block_no], _append_header, headers),
+                         0);
+
+    // A size update within the limit evicts the entries that don't fit.
+    ck_assert_int_eq(add_hpack_entry(&table, "custom-key", 10, "custom-value", 12), 1);
+    ck_assert_int_eq(decode_hpack_block(&table, (const unsigned char *)"\x3f\x11", 2,
+                                        _append_header, headers),
+                     1);
+    ck_assert_uint_eq(table.max_size, 48);
+    ck_assert_uint_eq(table.len, 0);
+    g_string_free(headers, TRUE);
+    free_hpack_table(&table);
+}
+END_TEST
+
+START_TEST(test_decode_hpack_huffman) {
+    // Decode the request examples with Huffman coding (RFC 7541, appendix C.4).
+    const char *blocks[] = {
+        "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff",
+        "\x82\x86\x84\xbe\x58\x86\xa8\xeb\x10\x64\x9c\xbf",
+        "\x82\x87\x85\xbf\x40\x88\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f\x89\x25\xa8\x49\xe9\x5b\xb8\xe8"
+        "\xb4\xbf"};
+    const size_t lens[] = {17, 12, 24};
+    _decode_request_examples(blocks, lens);
+
+    // Codes are padded with the start of the end of string code, within a byte.
+    GString *str = g_string_new(NULL);
+    encode_hpack_huffman(str, "www.example.com", 15);
+    ck_assert_uint_eq(str->len, 12);
+    ck_assert_int_eq(memcmp(str->str, "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff", 12), 0);
+    ck_assert_uint_eq(get_hpack_huffman_len("www.example.com", 15), 12);
+
+    g_string_truncate(str, 0);
+    ck_assert_int_eq(decode_hpack_huffman(str, (const unsigned char *)"\xa8\xeb\x10\x64\x9c\xbf",
+                                          6),
+                     1);
+    ck_assert_str_eq(str->str, "no-cache");
+    ck_assert_int_eq(decode_hpack_huffman(str, (const unsigned char *)"\xa8\xeb\x10\x64\x9c\xbe",
+                                          6),
+                     0);
+    ck_assert_int_eq(decode_hpack_huffman(str, (const unsigned char *)"\xff\xff\xff\xff", 4), 0);
+    g_string_free(str, TRUE);
+}
+END_TEST
+
+START_TEST(test_encode_hpack_header) {
+    // Encode headers and decode them with a table of the peer, indexed headers take a byte after.
+    hpack_table encoder, decoder;
+    init_hpack_table(&encoder, HPACK_DEFAULT_TABLE_SIZE);
+    init_hpack_table(&decoder, HPACK_DEFAULT_TABLE_SIZE);
+    GString *block = g_string_new(NULL), *headers = g_string_new(NULL);
+
+    encode_hpack_header(&encoder, block, ":status", 7, "200", 3, HPACK_NO_INDEX);
+    ck_assert_uint_eq(block->len, 1);
+    ck_assert_int_eq((unsigned char)block->str[0], 0x88);
+    encode_hpack_header(&encoder, block, "server", 6, "ElServe/2.0", 11, HPACK_INDEX);
+    encode_hpack_header(&encoder, block, "x-request", 9, "1", 1, HPACK_NO_INDEX);
+    encode_hpack_header(&encoder, block, "set-cookie", 10, "id=1", 4, HPACK_NEVER_INDEX);
+    ck_assert_int_eq(decode_hpack_block(&decoder, (const unsigned char *)block->str, block->len,
+                                        _append_header, headers),
+                     1);
+    ck_assert_str_eq(headers->str,
+                     ":status: 200\nserver: ElServe/2.0\nx-request: 1\nset-cookie: id=1\n");
+    ck_assert_uint_eq(encoder.len, 1);
+    ck_assert_uint_eq(decoder.size, encoder.size);
+
+    g_string_truncate(block, 0);
+    encode_hpack_header(&encoder, block, "server", 6, "ElServe/2.0", 11, HPACK_INDEX);
+    ck_assert_uint_eq(block->len, 1);
+    ck_assert_int_eq((unsigned char)block->str[0], 0x80 | 62);
+
+    // A lower limit of the peer is sent at the start of the next block.
+    set_hpack_table_limit(&encoder, 0);
+    ck_assert_uint_eq(encoder.len, 0);
+    g_string_truncate(block, 0);
+    g_string_truncate(headers, 0);
+    begin_hpack_block(&encoder, block);
+    encode_hpack_header(&encoder, block, "server", 6, "ElServe/2.0", 11, HPACK_INDEX);
+    ck_assert_int_eq((unsigned char)block->str[0], 0x20);
+    ck_assert_int_eq(decode_hpack_block(&decoder, (const unsigned char *)block->str, block->len,
+                                        _append_header, headers),
+                     1);
+    ck_assert_str_eq(headers->str, "server: ElServe/2.0\n");
+    ck_assert_uint_eq(decoder.len, 0);
+
+    g_string_free(block, TRUE);
+    g_string_free(headers, TRUE);
+    free_hpack_table(&encoder);
+    free_hpack_table(&decoder);
+}
+END_TEST
+
+Suite *hpack_suite() {
+    const TTest *tests[] = {test_decode_hpack_block, test_decode_hpack_huffman,
+                            test_encode_hpack_header};
+
+    Suite *suite = suite_create("HPACK");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = hpack_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
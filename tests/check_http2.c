@@ -0,0 +1,277 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http2.h"
+
+/**
+ * Appends a frame of `type` with `payload` to `out`.
+ */
+void _append_frame(GString *out, const uint8_t type, const uint8_t flags, const uint32_t id,
+                   const char *payload, const size_t len) {
+    const char head[] = {len >> 16, len >> 8, len, type, flags, id >> 24, id >> 16, id >> 8, id};
+    g_string_append_len(out, head, sizeof(head));
+    g_string_append_len(out, payload, len);
+}
+
+/**
+ * Appends a decoded header to the `GString` `arg` as a "<name>: <value>\n" line.
+ */
+void _append_header(void *arg, const char *name, const size_t name_len, const char *value,
+                    const size_t value_len) {
+    g_string_append_len((GString *)arg, name, name_len);
+    g_string_append(arg, ": ");
+    g_string_append_len((GString *)arg, value, value_len);
+    g_string_append_c(arg, '\n');
+}
+
+/**
+ * Reads the next frame the server sent on `fd` into `payload`, returns its type.
+ */
+int _read_frame(const int fd, uint8_t *flags, uint32_t *id, GString *payload) {
+    unsigned char head[HTTP2_FRAME_HEAD_LEN];
+    ck_assert_int_eq(recv(fd, head, sizeof(head), MSG_WAITALL), sizeof(head));
+    size_t len = (head[0] << 16) | (head[1] << 8) | head[2];
+    g_string_set_size(payload, len);
+    if (len > 0)
+        ck_assert_int_eq(recv(fd, payload->str, len, MSG_WAITALL), len);
+
+    *flags = head[4];
+    *id = ((uint32_t)head[5] << 24) | (head[6] << 16) | (head[7] << 8) | head[8];
+    return head[3];
+}
+
+START_TEST(test_read_http2_session) {
+    // Receive the preface, the client's settings and a request split across two frames.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    http2_session *session = create_http2_session(fds[1], 100, 8192, 16);
+    ck_assert_int_eq(start_http2_session(session, NULL), 1);
+
+    hpack_table encoder;
+    init_hpack_table(&encoder, HPACK_DEFAULT_TABLE_SIZE);
+    GString *block = g_string_new(NULL), *frames = g_string_new(HTTP2_PREFACE);
+    const char *headers[][2] = {{":method", "POST"},      {":scheme", "https"},
+                                {":path", "/form"},       {":authority", "example.com"},
+                                {"cookie", "a=1"},        {"priority", "u=1, i"},
+                                {"content-length", "999"}, {"cookie", "b=2"}};
+    for (int h_no = 0; h_no < 8; h_no++)
+        encode_hpack_header(&encoder, block, headers[h_no][0], strlen(headers[h_no][0]),
+                            headers[h_no][1], strlen(headers[h_no][1]), HPACK_NO_INDEX);
+    _append_frame(frames, HTTP2_SETTINGS, 0, 0, NULL, 0);
+    _append_frame(frames, HTTP2_HEADERS, 0, 1, block->str, 10);
+    _append_frame(frames, HTTP2_CONTINUATION, HTTP2_FLAG_END_HEADERS, 1, block->str + 10,
+                  block->len - 10);
+    _append_frame(frames, HTTP2_DATA, 0, 1, "name=", 5);
+
+    // The preface arrives in pieces, the request is ready once its body is complete.
+    ck_assert_int_eq(receive_http2_data(session, frames->str, 7), 1);
+    ck_assert_int_eq(receive_http2_data(session, frames->str + 7, frames->len - 7), 1);
+    ck_assert_ptr_eq(next_http2_stream(session), NULL);
+    g_string_truncate(frames, 0);
+    _append_frame(frames, HTTP2_DATA, HTTP2_FLAG_END_STREAM, 1, "nanows", 6);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+
+    http2_stream *stream = next_http2_stream(session);
+    ck_assert_ptr_ne(stream, NULL);
+    ck_assert_uint_eq(stream->id, 1);
+    ck_assert_int_eq(stream->urgency, 1);
+    ck_assert_str_eq(stream->request->str, "POST /form HTTP/2.0\r\nhost: example.com\r\n"
+                                           "priority: u=1, i\r\ncookie: a=1; b=2\r\n"
+                                           "content-length: 11\r\n\r\nname=nanows");
+
+    // The server's settings are followed by the acknowledgement, the body is charged to the
+    // windows without a window update for every frame.
+    uint8_t flags = 0;
+    uint32_t id = 0;
+    GString *payload = g_string_new(NULL);
+    ck_assert_int_eq(flush_http2_session(session), 1);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_SETTINGS);
+    ck_assert_uint_eq(payload->len, 12);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_SETTINGS);
+    ck_assert_uint_eq(flags, HTTP2_FLAG_ACK);
+    ck_assert_int_eq(session->recv_window, HTTP2_DEFAULT_WINDOW - 11);
+
+    // A body over the limit is answered right away, a stream with an even ID breaks the session.
+    g_string_truncate(frames, 0);
+    g_string_truncate(block, 0);
+    encode_hpack_header(&encoder, block, ":method", 7, "PUT", 3, HPACK_INDEX);
+    encode_hpack_header(&encoder, block, ":scheme", 7, "http", 4, HPACK_INDEX);
+    encode_hpack_header(&encoder, block, ":path", 5, "/", 1, HPACK_INDEX);
+    _append_frame(frames, HTTP2_HEADERS, HTTP2_FLAG_END_HEADERS, 3, block->str, block->len);
+    _append_frame(frames, HTTP2_DATA, 0, 3, "0123456789abcdefg", 17);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+    ck_assert_ptr_eq(next_http2_stream(session), stream);
+    ck_assert_int_eq(_find_http2_stream(session, 3)->error_status, 413);
+    ck_assert(_find_http2_stream(session, 3)->is_ready);
+
+    g_string_truncate(frames, 0);
+    _append_frame(frames, HTTP2_HEADERS, HTTP2_FLAG_END_HEADERS, 4, block->str, block->len);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 0);
+    ck_assert(is_http2_session_done(session));
+    ck_assert_ptr_eq(next_http2_stream(session), NULL);
+
+    free_hpack_table(&encoder);
+    g_string_free(block, TRUE);
+    g_string_free(frames, TRUE);
+    g_string_free(payload, TRUE);
+    destroy_http2_session(session);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_send_http2) {
+    // Translate an HTTP/1.1 response into frames of stream 1, in pieces.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    http2_session *session = create_http2_session(fds[1], 100, 8192, 1024);
+    ck_assert_int_eq(start_http2_session(session, NULL), 1);
+    http2_stream *stream = open_http2_upgrade_stream(session, "GET / HTTP/1.1\r\n\r\n", 18, false);
+    ck_assert_ptr_ne(stream, NULL);
+    ck_assert(!has_http2_stream(fds[1]));
+    ck_assert_int_eq(send_http2(fds[1], "x", 1), -1);
+    ck_assert_int_eq(fcntl(fds[1], F_SETFL, O_NONBLOCK), 0);
+
+    // The upgrade stream is ready once the client's settings arrived.
+    GString *frames = g_string_new(HTTP2_PREFACE);
+    ck_assert_ptr_eq(next_http2_stream(session), NULL);
+    _append_frame(frames, HTTP2_SETTINGS, 0, 0, "\x00\x04\x00\x00\x00\x03", 6);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+    ck_assert_ptr_eq(next_http2_stream(session), stream);
+
+    const char head[] = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: keep-alive\r\n"
+                        "Server: nanows\r\n\r\nhello";
+    // The client allows 3 bytes, the rest of the body is parked until its window update.
+    begin_http2_stream(session, stream);
+    ck_assert(has_http2_stream(fds[1]));
+    ck_assert_int_eq(send_http2(fds[1], head, 20), 20);
+    ck_assert_int_eq(send_http2(fds[1], head + 20, sizeof(head) - 21), sizeof(head) - 21);
+    ck_assert_int_eq(finish_http2_stream(session, stream), 1);
+    ck_assert(!has_http2_stream(fds[1]));
+    ck_assert_uint_eq(stream->pending_len, 2);
+    ck_assert_int_eq(flush_http2_session(session), 1);
+    ck_assert(has_http2_output(session));
+    ck_assert_uint_eq(session->n_streams, 1);
+
+    g_string_truncate(frames, 0);
+    _append_frame(frames, HTTP2_WINDOW_UPDATE, 0, 1, "\x00\x00\x00\x10", 4);
+    ck_assert_int_eq(send(fds[0], frames->str, frames->len, 0), frames->len);
+    ck_assert_int_eq(read_http2_session(session), 1);
+    ck_assert_int_eq(flush_http2_session(session), 1);
+    ck_assert(!has_http2_output(session));
+    ck_assert_uint_eq(session->n_streams, 0);
+
+    uint8_t flags = 0;
+    uint32_t id = 0;
+    GString *payload = g_string_new(NULL), *headers = g_string_new(NULL);
+    hpack_table decoder;
+    init_hpack_table(&decoder, HPACK_DEFAULT_TABLE_SIZE);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_SETTINGS);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_SETTINGS);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_HEADERS);
+    ck_assert_uint_eq(flags, HTTP2_FLAG_END_HEADERS);
+    ck_assert_uint_eq(id, 1);
+    ck_assert_int_eq(decode_hpack_block(&decoder, (const unsigned char *)payload->str,
+                                        payload->len, _append_header, headers),
+                     1);
+    ck_assert_str_eq(headers->str, ":status: 200\ncontent-length: 5\nserver: nanows\n");
+
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_DATA);
+    ck_assert_str_eq(payload->str, "hel");
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_DATA);
+    ck_assert_str_eq(payload->str, "lo");
+    ck_assert_uint_eq(flags, HTTP2_FLAG_END_STREAM);
+
+    // A response without a body ends the stream with its head.
+    stream = _add_http2_stream(session, 3);
+    stream->is_remote_closed = stream->is_head = true;
+    begin_http2_stream(session, stream);
+    ck_assert_int_eq(send_http2(fds[1], head, sizeof(head) - 1), sizeof(head) - 1);
+    ck_assert_int_eq(finish_http2_stream(session, stream), 1);
+    ck_assert_int_eq(flush_http2_session(session), 1);
+    ck_assert_int_eq(_read_frame(fds[0], &flags, &id, payload), HTTP2_HEADERS);
+    ck_assert_uint_eq(flags, HTTP2_FLAG_END_HEADERS | HTTP2_FLAG_END_STREAM);
+    ck_assert_uint_eq(id, 3);
+
+    free_hpack_table(&decoder);
+    g_string_free(frames, TRUE);
+    g_string_free(payload, TRUE);
+    g_string_free(headers, TRUE);
+    destroy_http2_session(session);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_http2_receive_window) {
+    // Send more body than the stream window on a stream whose body isn't needed anymore, and check
+    // if the stream is reset while the session goes on.
+    http2_session *session = create_http2_session(-1, 100, 8192, 16);
+    ck_assert_int_eq(start_http2_session(session, NULL), 1);
+
+    hpack_table encoder;
+    init_hpack_table(&encoder, HPACK_DEFAULT_TABLE_SIZE);
+    GString *block = g_string_new(NULL), *frames = g_string_new(HTTP2_PREFACE);
+    encode_hpack_header(&encoder, block, ":method", 7, "PUT", 3, HPACK_INDEX);
+    encode_hpack_header(&encoder, block, ":scheme", 7, "http", 4, HPACK_INDEX);
+    encode_hpack_header(&encoder, block, ":path", 5, "/", 1, HPACK_INDEX);
+    _append_frame(frames, HTTP2_SETTINGS, 0, 0, NULL, 0);
+    _append_frame(frames, HTTP2_HEADERS, HTTP2_FLAG_END_HEADERS, 1, block->str, block->len);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+
+    // The body is over the limit with the first frame, so the stream window isn't credited.
+    char data[HTTP2_MAX_FRAME_SIZE] = {0};
+    for (int f_no = 0; f_no < 4; f_no++) {
+        g_string_truncate(frames, 0);
+        _append_frame(frames, HTTP2_DATA, 0, 1, data, sizeof(data) - (f_no == 0));
+        ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+        ck_assert_ptr_ne(_find_http2_stream(session, 1), NULL);
+        ck_assert_int_eq(_find_http2_stream(session, 1)->error_status, 413);
+    }
+
+    // The connection window is credited back, the stream one is exhausted.
+    ck_assert_int_gt(session->recv_window, HTTP2_DEFAULT_WINDOW / 2);
+    g_string_truncate(frames, 0);
+    _append_frame(frames, HTTP2_DATA, 0, 1, data, 1);
+    ck_assert_int_eq(receive_http2_data(session, frames->str, frames->len), 1);
+    ck_assert_ptr_eq(_find_http2_stream(session, 1), NULL);
+    ck_assert(!is_http2_session_done(session));
+
+    free_hpack_table(&encoder);
+    g_string_free(block, TRUE);
+    g_string_free(frames, TRUE);
+    destroy_http2_session(session);
+}
+END_TEST
+
+Suite *http2_suite() {
+    const TTest *tests[] = {test_read_http2_session, test_send_http2, test_http2_receive_window};
+
+    Suite *suite = suite_create("HTTP/2");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = http2_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,276 @@
+#include <check.h>
+#include <string.h>
+
+#include "http_parser.h"
+
+START_TEST(test_parse_http_request) {
+    // Parse a complete request head and check if the views point to the right strings.
+    const char *buf = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nAccept:text/html \r\n\r\n";
+    http_parser parser;
+    init_http_parser(&parser);
+
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+    ck_assert_int_eq(parser.head_len, strlen(buf));
+    ck_assert_int_eq(strncmp(buf + parser.method.off, "GET", parser.method.len), 0);
+    ck_assert_int_eq(parser.url.len, 11);
+    ck_assert_int_eq(strncmp(buf + parser.url.off, "/index.html", parser.url.len), 0);
+    ck_assert_int_eq(strncmp(buf + parser.version.off, "HTTP/1.1", parser.version.len), 0);
+
+    ck_assert_int_eq(parser.n_headers, 2);
+    ck_assert_int_eq(parser.headers[1].key.len, 6);
+    ck_assert_int_eq(strncmp(buf + parser.headers[1].key.off, "Accept", 6), 0);
+    ck_assert_int_eq(parser.headers[1].value.len, 9);
+    ck_assert_int_eq(strncmp(buf + parser.headers[1].value.off, "text/html", 9), 0);
+}
+END_TEST
+
+START_TEST(test_parse_http_request_split) {
+    // Feed the request head one byte at a time and check if it is only complete at the end.
+    const char *buf = "\r\nGET / HTTP/1.0\nConnection: keep-alive\r\n\r\nGET /next";
+    size_t head_len = strlen(buf) - strlen("GET /next");
+    http_parser parser;
+    init_http_parser(&parser);
+
+    for (size_t len = 0; len < head_len; len++)
+        ck_assert_int_eq(parse_http_request(&parser, buf, len), HTTP_PARSE_INCOMPLETE);
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+    ck_assert_int_eq(parser.head_len, head_len);
+    ck_assert_int_eq(parser.url.off, 6);
+    ck_assert_int_eq(parser.n_headers, 1);
+}
+END_TEST
+
+START_TEST(test_parse_http_request_malformed) {
+    // Parse malformed request heads and check if all of them are rejected.
+    const char *bufs[] = {"GET\r\n\r\n",
+                          "GET  / HTTP/1.1\r\n\r\n",
+                          "GET / HTTP/1.1 \r\n\r\n",
+                          "GET / HTTP/11\r\n\r\n",
+                          "G(T / HTTP/1.1\r\n\r\n",
+                          "GET / HTTP/1.1\r\nHost localhost\r\n\r\n",
+                          "GET / HTTP/1.1\r\nHost : localhost\r\n\r\n",
+                          "GET / HTTP/1.1\r\nHost: a\r\n folded\r\n\r\n",
+                          "GET / HTTP/1.1\r\n: empty\r\n\r\n",
+                          "GET / HTTP/1.1\r\nHost: a\x01b\r\n\r\n"};
+    http_parser parser;
+
+    for (int i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        init_http_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[i], strlen(bufs[i])), HTTP_PARSE_ERROR);
+        ck_assert_int_eq(parser.state, HTTP_PARSER_FAILED);
+    }
+}
+END_TEST
+
+START_TEST(test_parse_http_request_malformed_incomplete) {
+    // A malformed line is reported as soon as it is complete, even if the head is not.
+    const char *buf = "GET / HTTP/1.1\r\nHost localhost\r\nAcc";
+    http_parser parser;
+    init_http_parser(&parser);
+
+    ck_assert_int_eq(parse_http_request(&parser, buf, 16), HTTP_PARSE_INCOMPLETE);
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_ERROR);
+}
+END_TEST
+
+START_TEST(test_parse_http_request_too_many_headers) {
+    // Send more than HTTP_MAX_HEADERS headers and check if the request head is rejected.
+    char buf[32 * (HTTP_MAX_HEADERS + 2)] = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i <= HTTP_MAX_HEADERS; i++)
+        strcat(buf, "X-Header: value\r\n");
+    strcat(buf, "\r\n");
+    http_parser parser;
+    init_http_parser(&parser);
+
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_ERROR);
+    ck_assert_int_eq(parser.n_headers, HTTP_MAX_HEADERS);
+}
+END_TEST
+
+START_TEST(test_find_known_http_header) {
+    // Parse a request head and check if known headers are found in any case, first one wins.
+    const char *buf =
+        "GET / HTTP/1.1\r\nhost: a\r\nX-Other: b\r\nRANGE: bytes=0-1\r\nHost: c\r\n\r\n";
+    http_parser parser;
+    init_http_parser(&parser);
+
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+    ck_assert_int_eq(find_known_http_header(&parser, HTTP_HEADER_HOST), 0);
+    ck_assert_int_eq(find_known_http_header(&parser, HTTP_HEADER_RANGE), 2);
+    ck_assert_int_eq(find_known_http_header(&parser, HTTP_HEADER_CONNECTION), -1);
+    ck_assert_int_eq(get_http_known_header("accept-encoding", 15), HTTP_HEADER_ACCEPT_ENCODING);
+    ck_assert_int_eq(get_http_known_header("X-Other", 7), HTTP_KNOWN_HEADERS);
+
+    // Headers of a previous request must not be found after the parser is reset.
+    init_http_parser(&parser);
+    ck_assert_int_eq(find_known_http_header(&parser, HTTP_HEADER_HOST), -1);
+}
+END_TEST
+
+START_TEST(test_find_http_delimiter) {
+    // Scan the same bytes with every implementation the CPU supports and compare the offsets.
+    char buf[200];
+    http_scan_isa default_isa = get_http_scan_isa();
+    http_scan_isa isas[] = {HTTP_SCAN_SSE42, HTTP_SCAN_AVX2, HTTP_SCAN_NEON};
+
+    for (int b_no = 0; b_no < 256; b_no++) {
+        for (size_t pos = 0; pos < sizeof(buf); pos += 13) {
+            // Bytes above 0x7f are allowed, they must not be mistaken for control characters.
+            memset(buf, 0x80 | 'a', sizeof(buf));
+            buf[pos] = (char)b_no;
+
+            for (int stop_at_space = 0; stop_at_space < 2; stop_at_space++) {
+                size_t expected = _find_http_delimiter_scalar(buf, sizeof(buf), stop_at_space);
+                bool is_delimiter = b_no == 0x7f || (b_no < ' ' && b_no != '\t') ||
+                                    (stop_at_space && (b_no == ' ' || b_no == '\t'));
+                ck_assert_uint_eq(expected, is_delimiter ? pos : sizeof(buf));
+
+                for (int isa_no = 0; isa_no < sizeof(isas) / sizeof(isas[0]); isa_no++) {
+                    if (!set_http_scan_isa(isas[isa_no]))
+                        continue;
+                    ck_assert_uint_eq(find_http_delimiter(buf, sizeof(buf), stop_at_space),
+                                      expected);
+                    ck_assert_uint_eq(find_http_delimiter(buf, pos, stop_at_space), pos);
+                }
+            }
+        }
+    }
+
+    ck_assert_int_eq(set_http_scan_isa(default_isa), 1);
+}
+END_TEST
+
+START_TEST(test_parse_http_response) {
+    // Parse response heads and check the status line, with and without a reason phrase.
+    const char *buf = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    http_parser parser;
+    init_http_response_parser(&parser);
+
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+    ck_assert_int_eq(parser.status, 404);
+    ck_assert_int_eq(strncmp(buf + parser.version.off, "HTTP/1.1", parser.version.len), 0);
+    ck_assert_int_eq(parser.reason.len, 9);
+    ck_assert_int_eq(strncmp(buf + parser.reason.off, "Not Found", 9), 0);
+    ck_assert_int_eq(find_http_header(&parser, buf, "content-length", 0), 0);
+    ck_assert_int_eq(find_http_header(&parser, buf, "content-length", 1), -1);
+
+    buf = "HTTP/1.0 204\r\n\r\n";
+    init_http_response_parser(&parser);
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+    ck_assert_int_eq(parser.status, 204);
+    ck_assert_int_eq(parser.reason.len, 0);
+
+    const char *bufs[] = {"GET / HTTP/1.1\r\n\r\n", "HTTP/1.1 20 OK\r\n\r\n",
+                          "HTTP/1.1 2000 OK\r\n\r\n", "HTTP/1.1 099 Low\r\n\r\n",
+                          "\r\nHTTP/1.1 200 OK\r\n\r\n"};
+    for (int i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        init_http_response_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[i], strlen(bufs[i])), HTTP_PARSE_ERROR);
+    }
+}
+END_TEST
+
+START_TEST(test_init_http_body_parser) {
+    // Check if the framing headers select the body framing and ambiguous framings are rejected.
+    const char *bufs[] = {
+        "GET / HTTP/1.1\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 12\r\ncontent-length: 12\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 12\r\nContent-Length: 13\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 12\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+    };
+    const int valid[] = {1, 1, 1, 0, 0, 0, 0};
+    const http_body_state states[] = {HTTP_BODY_DONE, HTTP_BODY_DATA, HTTP_BODY_CHUNK_SIZE};
+    http_parser parser;
+    http_body_parser body;
+
+    for (int b_no = 0; b_no < sizeof(bufs) / sizeof(bufs[0]); b_no++) {
+        init_http_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[b_no], strlen(bufs[b_no])),
+                         HTTP_PARSE_OK);
+        ck_assert_int_eq(init_http_body_parser(&body, &parser, bufs[b_no]), valid[b_no]);
+        ck_assert_int_eq(body.state, valid[b_no] ? states[b_no] : HTTP_BODY_FAILED);
+    }
+
+    init_http_parser(&parser);
+    parse_http_request(&parser, bufs[1], strlen(bufs[1]));
+    init_http_body_parser(&body, &parser, bufs[1]);
+    ck_assert_uint_eq(body.remaining, 12);
+    ck_assert(!body.chunked);
+}
+END_TEST
+
+START_TEST(test_parse_http_body_chunked) {
+    // Parse a chunked body one byte at a time and check if only the chunk data is returned.
+    const char *buf = "4;ext=1\r\nWiki\r\n5\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\n"
+                      "Trailer: x\r\n\r\nGET /next";
+    size_t body_end = strlen(buf) - strlen("GET /next");
+    http_body_parser body = {.state = HTTP_BODY_CHUNK_SIZE, .chunked = true};
+    char data_buf[64] = "";
+    size_t consumed = 0;
+    http_view data;
+
+    for (size_t pos = 0; pos < body_end; pos++) {
+        http_parse_result result = parse_http_body(&body, buf + pos, 1, &consumed, &data);
+        ck_assert_int_eq(result, pos + 1 < body_end ? HTTP_PARSE_INCOMPLETE : HTTP_PARSE_OK);
+        ck_assert_int_eq(consumed, 1);
+        strncat(data_buf, buf + pos + data.off, data.len);
+    }
+    ck_assert_str_eq(data_buf, "Wikipedia in\r\n\r\nchunks.");
+    ck_assert_uint_eq(body.body_len, 23);
+
+    // The parser stops at the end of the body, the next request is left alone.
+    ck_assert_int_eq(parse_http_body(&body, buf + body_end, 9, &consumed, &data), HTTP_PARSE_OK);
+    ck_assert_int_eq(consumed, 0);
+
+    // Content-Length bodies are returned in as few views as the buffer allows.
+    body = (http_body_parser){.state = HTTP_BODY_DATA, .remaining = 5};
+    ck_assert_int_eq(parse_http_body(&body, "helloGET", 8, &consumed, &data), HTTP_PARSE_OK);
+    ck_assert_int_eq(consumed, 5);
+    ck_assert_int_eq(data.len, 5);
+
+    const char *malformed[] = {"x\r\n", "4\r\nWikiX", "\r\n", "fffffffffffffffff\r\n"};
+    for (int m_no = 0; m_no < sizeof(malformed) / sizeof(malformed[0]); m_no++) {
+        body = (http_body_parser){.state = HTTP_BODY_CHUNK_SIZE, .chunked = true};
+        http_parse_result result = HTTP_PARSE_INCOMPLETE;
+        for (size_t pos = 0; result == HTTP_PARSE_INCOMPLETE && pos < strlen(malformed[m_no]);
+             pos += consumed)
+            result = parse_http_body(&body, malformed[m_no] + pos, strlen(malformed[m_no]) - pos,
+                                     &consumed, &data);
+        ck_assert_int_eq(result, HTTP_PARSE_ERROR);
+    }
+}
+END_TEST
+
+Suite *http_parser_suite() {
+    const TTest *tests[] = {test_parse_http_request, test_parse_http_request_split,
+                            test_parse_http_request_malformed,
+                            test_parse_http_request_malformed_incomplete,
+                            test_parse_http_request_too_many_headers, test_find_known_http_header,
+                            test_find_http_delimiter, test_parse_http_response,
+                            test_init_http_body_parser, test_parse_http_body_chunked};
+
+    Suite *suite = suite_create("HTTP Parser");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = http_parser_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+#include <check.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "listener.h"
+
+START_TEST(test_resolve_listen_addresses) {
+    // Resolve numeric and wildcard hosts and check the returned address families.
+    struct addrinfo *addrs = resolve_listen_addresses("127.0.0.1", 8080);
+    ck_assert_ptr_ne(addrs, NULL);
+    ck_assert_int_eq(addrs->ai_family, AF_INET);
+    ck_assert_int_eq(ntohs(((struct sockaddr_in *)addrs->ai_addr)->sin_port), 8080);
+    ck_assert_int_eq(has_mixed_address_families(addrs), false);
+    freeaddrinfo(addrs);
+
+    addrs = resolve_listen_addresses("::1", 8080);
+    ck_assert_ptr_ne(addrs, NULL);
+    ck_assert_int_eq(addrs->ai_family, AF_INET6);
+    freeaddrinfo(addrs);
+
+    ck_assert_ptr_eq(resolve_listen_addresses("not an address", 8080), NULL);
+}
+END_TEST
+
+START_TEST(test_create_listen_socket) {
+    // Listen on an ephemeral port and check if connections to it are accepted.
+    struct addrinfo *addrs = resolve_listen_addresses("127.0.0.1", 0);
+    listen_options opts = {.backlog = 16, .defer_accept = 0, .fastopen = 16};
+    int listen_fd = create_listen_socket(addrs, &opts);
+    ck_assert_int_ge(listen_fd, 0);
+
+    int port = get_listen_port(listen_fd);
+    ck_assert_int_gt(port, 0);
+
+    int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = *(struct sockaddr_in *)addrs->ai_addr;
+    addr.sin_port = htons(port);
+    ck_assert_int_eq(connect(client_fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+    int conn_fd = -1;
+    for (int tries = 0; tries < 100 && (conn_fd = accept(listen_fd, NULL, NULL)) < 0; tries++)
+        usleep(1000);
+    ck_assert_int_ge(conn_fd, 0);
+
+    close(conn_fd);
+    close(client_fd);
+    close(listen_fd);
+    freeaddrinfo(addrs);
+}
+END_TEST
+
+START_TEST(test_create_listen_socket_reuse_port) {
+    // Bind two SO_REUSEPORT sockets to the same port, which fails without SO_REUSEPORT.
+    struct addrinfo *addrs = resolve_listen_addresses("127.0.0.1", 0);
+    listen_options opts = {.backlog = 16, .reuse_port = true};
+    int first_fd = create_listen_socket(addrs, &opts);
+    ck_assert_int_ge(first_fd, 0);
+    freeaddrinfo(addrs);
+
+    addrs = resolve_listen_addresses("127.0.0.1", get_listen_port(first_fd));
+    int second_fd = create_listen_socket(addrs, &opts);
+    ck_assert_int_ge(second_fd, 0);
+    ck_assert_int_eq(get_listen_port(first_fd), get_listen_port(second_fd));
+    ck_assert_int_eq(attach_reuseport_cpu_steering(first_fd, 2), 1);
+    ck_assert_int_eq(set_incoming_cpu(second_fd, 0), 1);
+
+    opts.reuse_port = false;
+    ck_assert_int_eq(create_listen_socket(addrs, &opts), -1);
+
+    close(first_fd);
+    close(second_fd);
+    freeaddrinfo(addrs);
+}
+END_TEST
+
+Suite *listener_suite() {
+    const TTest *tests[] = {test_resolve_listen_addresses, test_create_listen_socket,
+                            test_create_listen_socket_reuse_port};
+
+    Suite *suite = suite_create("Listener");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = listener_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
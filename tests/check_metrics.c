@@ -0,0 +1,122 @@
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+START_TEST(test_create_metrics) {
+    // Check if recording metrics before they are created is ignored, and creating them twice isn't.
+    ck_assert(!is_metrics_enabled());
+    ck_assert_ptr_eq(format_metrics(), NULL);
+    add_metrics_counter(METRICS_BYTES_SENT, 10);
+    ck_assert_int_eq(start_metrics_send(), 0);
+
+    ck_assert_int_eq(create_metrics(0), 0);
+    ck_assert_int_eq(create_metrics(2), 1);
+    ck_assert_int_eq(create_metrics(2), 2);
+    ck_assert(is_metrics_enabled());
+    ck_assert_int_eq(get_metrics_send_start(), 0);
+
+    long long start = start_metrics_send();
+    ck_assert_int_ne(start, 0);
+    ck_assert_int_eq(get_metrics_send_start(), start);
+
+    destroy_metrics();
+    ck_assert(!is_metrics_enabled());
+    destroy_metrics();
+}
+END_TEST
+
+START_TEST(test_format_metrics) {
+    // Record every kind of metric and check the formatted values.
+    ck_assert_int_eq(create_metrics(1), 1);
+    add_metrics_counter(METRICS_CONNECTIONS_ACCEPTED, 3);
+    add_metrics_counter(METRICS_CONNECTIONS_CLOSED, 1);
+    add_metrics_counter(METRICS_BYTES_SENT, 1234);
+    count_metrics_status(200);
+    count_metrics_status(200);
+    count_metrics_status(404);
+    count_metrics_status(418);
+    observe_metrics_stage(METRICS_PARSE, 3000);
+    observe_metrics_stage(METRICS_PARSE, 20000);
+    observe_metrics_stage(METRICS_SEND, 20000000000LL);
+
+    GString *buf = format_metrics();
+    ck_assert_ptr_ne(buf, NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_connections_accepted_total 3\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_connections_active 2\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_sent_bytes_total 1234\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_requests_total{status=\"200\"} 2\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_requests_total{status=\"404\"} 1\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_requests_total{status=\"other\"} 1\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "# TYPE nanows_request_parse_seconds histogram\n"), NULL);
+
+    // Buckets are cumulative, values above the largest bound are only in +Inf.
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_request_parse_seconds_bucket{le=\"5e-06\"} 1\n"),
+                     NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_request_parse_seconds_bucket{le=\"2.5e-05\"} 2\n"),
+                     NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_request_parse_seconds_sum 0.000023000\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_request_parse_seconds_count 2\n"), NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_response_send_seconds_bucket{le=\"10\"} 0\n"),
+                     NULL);
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_response_send_seconds_bucket{le=\"+Inf\"} 1\n"),
+                     NULL);
+
+    g_string_free(buf, TRUE);
+    destroy_metrics();
+}
+END_TEST
+
+void *record_metrics(void *arg) {
+    for (int i = 0; i < 1000; i++)
+        add_metrics_counter(METRICS_BYTES_SENT, 1);
+    return arg;
+}
+
+START_TEST(test_metrics_shared_shard) {
+    // Check if threads beyond the number of shards share the overflow shard without losing counts.
+    ck_assert_int_eq(create_metrics(1), 1);
+    // The test thread claims the only shard, so the other threads get the overflow shard.
+    add_metrics_counter(METRICS_BYTES_SENT, 1);
+
+    pthread_t threads[4];
+    for (int t_no = 0; t_no < 4; t_no++)
+        ck_assert_int_eq(pthread_create(&threads[t_no], NULL, record_metrics, NULL), 0);
+    for (int t_no = 0; t_no < 4; t_no++)
+        pthread_join(threads[t_no], NULL);
+
+    GString *buf = format_metrics();
+    ck_assert_ptr_ne(strstr(buf->str, "\nnanows_sent_bytes_total 4001\n"), NULL);
+
+    g_string_free(buf, TRUE);
+    destroy_metrics();
+}
+END_TEST
+
+Suite *metrics_suite() {
+    const TTest *tests[] = {test_create_metrics, test_format_metrics, test_metrics_shared_shard};
+
+    Suite *suite = suite_create("Metrics");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = metrics_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,4 +1,7 @@
 #include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "mimetypes.h"
 
@@ -16,9 +19,79 @@ START_TEST(test_create_mime_table) {
 END_TEST
 
 START_TEST(test_get_mimetype_for_ext_without_table) {
-    // call get_mimetype_for_ext() without calling create_mime_table() and check if it returns NULL
-    const char *mimetype = get_mimetype_for_ext(".html", NULL);
-    ck_assert_ptr_eq(mimetype, NULL);
+    // call get_mimetype_for_ext() without calling create_mime_table() and check if it returns the
+    // builtin mimetype
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "text/html");
+    ck_assert_str_eq(get_mimetype_for_ext(".JPG", NULL), "image/jpeg");
+    ck_assert_str_eq(get_mimetype_for_ext(".xyz", NULL), "application/octet-stream");
+    ck_assert_str_eq(get_mimetype_for_ext(NULL, NULL), "application/octet-stream");
+
+    char mimetype[MIME_BUF_SIZE];
+    ck_assert_str_eq(get_mimetype_for_url("/images/favicon.ico", mimetype),
+                     "image/vnd.microsoft.icon");
+    ck_assert_str_eq(mimetype, "image/vnd.microsoft.icon");
+}
+END_TEST
+
+START_TEST(test_get_mimetype_header_for_url) {
+    // call get_mimetype_header_for_url() and check if it returns the precomputed header line
+    ck_assert_str_eq(get_mimetype_header_for_url("/style.css"), "content-type: text/css\r\n");
+    ck_assert_str_eq(get_mimetype_header_for_url("/README"),
+                     "content-type: application/octet-stream\r\n");
+}
+END_TEST
+
+START_TEST(test_create_mime_table_from_file) {
+    // load an override file and check if it takes precedence over the builtin mimetypes
+    char path[] = "/tmp/check_mimetypes_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    FILE *file = fdopen(fd, "w");
+    fputs("# override\n.HTML=text/plain\n.custom=application/x-custom\ninvalid\n", file);
+    fclose(file);
+
+    ck_assert_int_eq(create_mime_table_from_file(path), 1);
+    unlink(path);
+
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "text/plain");
+    ck_assert_str_eq(get_mimetype_for_ext(".Custom", NULL), "application/x-custom");
+    ck_assert_str_eq(get_mimetype_header_for_url("/index.html"), "content-type: text/plain\r\n");
+    ck_assert_str_eq(get_mimetype_for_ext(".css", NULL), "text/css");
+    ck_assert_str_eq(get_mimetype_for_ext(".xyz", NULL), "application/octet-stream");
+
+    // after destroying the override, the builtin mimetypes are used again
+    destroy_mime_table();
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "text/html");
+    ck_assert_int_eq(create_mime_table_from_file("/nonexistent/mimetypes.conf"), 0);
+}
+END_TEST
+
+START_TEST(test_reload_mime_table_from_file) {
+    // reload an override file and check if the old table is kept when reloading fails
+    char path[] = "/tmp/check_mimetypes_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    FILE *file = fdopen(fd, "w");
+    fputs(".html=text/plain\n", file);
+    fclose(file);
+
+    ck_assert_int_eq(create_mime_table_from_file(path), 1);
+    ck_assert_int_eq(reload_mime_table_from_file("/nonexistent/mimetypes.conf"), 0);
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "text/plain");
+
+    file = fopen(path, "w");
+    fputs(".html=application/xhtml+xml\n", file);
+    fclose(file);
+    ck_assert_int_eq(reload_mime_table_from_file(path), 1);
+    unlink(path);
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "application/xhtml+xml");
+    ck_assert_str_eq(get_mimetype_header_for_url("/index.html"),
+                     "content-type: application/xhtml+xml\r\n");
+
+    // reloading without a file goes back to the builtin mimetypes
+    ck_assert_int_eq(reload_mime_table_from_file(NULL), 1);
+    ck_assert_str_eq(get_mimetype_for_ext(".html", NULL), "text/html");
+    destroy_mime_table();
 }
 END_TEST
 
@@ -50,8 +123,10 @@ START_TEST(test_get_mimetype_for_url) {
 END_TEST
 
 Suite *mimetypes_suite() {
-    const TTest *tests[] = {test_create_mime_table, test_get_mimetype_for_ext_without_table,
-                            test_get_mimetype_for_ext, test_get_mimetype_for_ext_default};
+    const TTest *tests[] = {test_create_mime_table,           test_get_mimetype_for_ext_without_table,
+                            test_get_mimetype_for_ext,        test_get_mimetype_for_ext_default,
+                            test_get_mimetype_header_for_url, test_create_mime_table_from_file,
+                            test_reload_mime_table_from_file};
 
     Suite *suite = suite_create("Mimetypes");
     TCase *tc_core = tcase_create("Core");
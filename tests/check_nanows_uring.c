@@ -0,0 +1,161 @@
+#include <check.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "nanows_uring.h"
+
+/**
+ * Submits the queued entries and waits for the next completion, returns a copy of it.
+ */
+struct io_uring_cqe _wait_cqe(uring *ring) {
+    struct io_uring_cqe *cqe = peek_uring_cqe(ring);
+    if (cqe == NULL) {
+        ck_assert_int_ge(submit_uring(ring, 1, 1000), 0);
+        cqe = peek_uring_cqe(ring);
+    }
+    ck_assert_ptr_ne(cqe, NULL);
+
+    struct io_uring_cqe copy = *cqe;
+    advance_uring_cq(ring);
+    return copy;
+}
+
+START_TEST(test_poll_uring) {
+    // A poll completes once the socket is readable, a wait without completions times out.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    uring *ring = create_uring(8);
+    ck_assert_ptr_ne(ring, NULL);
+
+    ck_assert_int_eq(queue_uring_poll(ring, fds[0], POLLIN, 42), 1);
+    ck_assert_int_eq(submit_uring(ring, 1, 10), 1);
+    ck_assert_ptr_eq(peek_uring_cqe(ring), NULL);
+
+    write(fds[1], "x", 1);
+    struct io_uring_cqe cqe = _wait_cqe(ring);
+    ck_assert_uint_eq(cqe.user_data, 42);
+    ck_assert(cqe.res & POLLIN);
+
+    // A cancelled poll completes with -ECANCELED, the cancellation with a `user_data` of 0.
+    ck_assert_int_eq(queue_uring_poll(ring, fds[0], POLLOUT | POLLPRI, 43), 1);
+    ck_assert_int_eq(submit_uring(ring, 0, 0), 1);
+    cqe = _wait_cqe(ring);
+    ck_assert_uint_eq(cqe.user_data, 43);
+    ck_assert_int_eq(queue_uring_poll(ring, fds[0], POLLPRI, 44), 1);
+    ck_assert_int_eq(queue_uring_cancel(ring, 44), 1);
+    for (int c_no = 0; c_no < 2; c_no++) {
+        cqe = _wait_cqe(ring);
+        if (cqe.user_data == 44)
+            ck_assert_int_eq(cqe.res, -ECANCELED);
+        else
+            ck_assert_uint_eq(cqe.user_data, 0);
+    }
+
+    destroy_uring(ring);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_recv_uring_buffers) {
+    // A receive picks a provided buffer, and fails with -ENOBUFS until the buffer is handed back.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    uring *ring = create_uring(8);
+    ck_assert_ptr_ne(ring, NULL);
+    ck_assert_int_eq(register_uring_buffers(ring, 3, 16), 0);
+    ck_assert_int_eq(register_uring_buffers(ring, 1, 16), 1);
+    ck_assert_int_eq(register_uring_buffers(ring, 1, 16), 2);
+
+    unsigned int bid = 0;
+    ck_assert_int_eq(queue_uring_recv(ring, fds[0], 1), 1);
+    write(fds[1], "hello", 5);
+    struct io_uring_cqe cqe = _wait_cqe(ring);
+    char *buf = get_uring_buffer(ring, cqe.flags, &bid);
+    ck_assert_int_eq(cqe.res, 5);
+    ck_assert_ptr_ne(buf, NULL);
+    ck_assert_int_eq(memcmp(buf, "hello", 5), 0);
+
+    ck_assert_int_eq(queue_uring_recv(ring, fds[0], 2), 1);
+    write(fds[1], "world", 5);
+    cqe = _wait_cqe(ring);
+    ck_assert_int_eq(cqe.res, -ENOBUFS);
+    ck_assert_ptr_eq(get_uring_buffer(ring, cqe.flags, &bid), NULL);
+
+    recycle_uring_buffer(ring, bid);
+    ck_assert_int_eq(queue_uring_recv(ring, fds[0], 3), 1);
+    cqe = _wait_cqe(ring);
+    ck_assert_int_eq(cqe.res, 5);
+    ck_assert_int_eq(memcmp(get_uring_buffer(ring, cqe.flags, &bid), "world", 5), 0);
+
+    destroy_uring(ring);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_accept_uring) {
+    // A multishot accept completes for every connection and stays queued.
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/check_uring_%d.sock", getpid());
+    unlink(addr.sun_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ck_assert_int_eq(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    ck_assert_int_eq(listen(listen_fd, 8), 0);
+
+    uring *ring = create_uring(8);
+    ck_assert_ptr_ne(ring, NULL);
+    ck_assert_int_eq(queue_uring_accept(ring, listen_fd, SOCK_CLOEXEC, 7), 1);
+
+    int client_fds[2];
+    for (int c_no = 0; c_no < 2; c_no++) {
+        client_fds[c_no] = socket(AF_UNIX, SOCK_STREAM, 0);
+        ck_assert_int_eq(connect(client_fds[c_no], (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+        struct io_uring_cqe cqe = _wait_cqe(ring);
+        ck_assert_uint_eq(cqe.user_data, 7);
+        ck_assert_int_ge(cqe.res, 0);
+        ck_assert(cqe.flags & IORING_CQE_F_MORE);
+        close(cqe.res);
+    }
+
+    destroy_uring(ring);
+    close(client_fds[0]);
+    close(client_fds[1]);
+    close(listen_fd);
+    unlink(addr.sun_path);
+}
+END_TEST
+
+Suite *uring_suite() {
+    const TTest *tests[] = {test_poll_uring, test_recv_uring_buffers, test_accept_uring};
+
+    Suite *suite = suite_create("io_uring");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = uring_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
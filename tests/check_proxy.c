@@ -0,0 +1,316 @@
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http2.h"
+#include "listener.h"
+#include "proxy.h"
+
+/**
+ * Listens on an ephemeral port of 127.0.0.1, the route of `prefix` to it is stored in `route`.
+ */
+int _listen_backend(const char *prefix, char *route) {
+    struct addrinfo *addrs = resolve_listen_addresses("127.0.0.1", 0);
+    listen_options opts = {.backlog = 16, .defer_accept = 0, .fastopen = 0};
+    int listen_fd = create_listen_socket(addrs, &opts);
+    freeaddrinfo(addrs);
+
+    sprintf(route, "%s=127.0.0.1:%d", prefix, get_listen_port(listen_fd));
+    return listen_fd;
+}
+
+START_TEST(test_find_proxy_route) {
+    // Set up routes and check if URLs get the route with the longest matching prefix.
+    ck_assert_ptr_eq(find_proxy_route("/api/users"), NULL);
+    ck_assert_int_eq(create_proxy("/api=127.0.0.1:9000", "round_robin", 4, 0, 1), 1);
+    ck_assert_int_eq(create_proxy("/api=127.0.0.1:9000", "round_robin", 4, 0, 1), 2);
+    destroy_proxy();
+
+    ck_assert_int_eq(create_proxy("/api/=127.0.0.1:9000, 127.0.0.1:9001;/api/v2/=127.0.0.1:9000;"
+                                  "/v6/=[::1]:9002",
+                                  "round_robin", 4, 0, 1),
+                     1);
+    proxy_route *route = find_proxy_route("/api/users");
+    ck_assert_ptr_ne(route, NULL);
+    ck_assert_str_eq(route->prefix, "/api/");
+    ck_assert_uint_eq(route->n_backends, 2);
+    ck_assert_str_eq(route->backends[1]->name, "127.0.0.1:9001");
+
+    proxy_route *v2_route = find_proxy_route("/api/v2/users");
+    ck_assert_str_eq(v2_route->prefix, "/api/v2/");
+    ck_assert_ptr_eq(v2_route->backends[0], route->backends[0]);
+    ck_assert_str_eq(find_proxy_route("/v6/")->backends[0]->name, "[::1]:9002");
+    ck_assert_ptr_eq(find_proxy_route("/index.html"), NULL);
+    ck_assert_ptr_eq(find_proxy_route("/api"), NULL);
+    destroy_proxy();
+    ck_assert_ptr_eq(find_proxy_route("/api/users"), NULL);
+
+    // Routes without a prefix, backends or a port are rejected.
+    const char *invalid[] = {"api/=127.0.0.1:9000", "/api/", "/api/=", "/api/=127.0.0.1",
+                             "/api/=127.0.0.1:", "/api/=[::1:9000"};
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        ck_assert_int_eq(create_proxy(invalid[i], "round_robin", 4, 0, 1), 0);
+}
+END_TEST
+
+START_TEST(test_pick_proxy_backend) {
+    // Pick backends in turn and by the requests in flight, skipping unhealthy ones.
+    ck_assert_int_eq(
+        create_proxy("/=127.0.0.1:9000,127.0.0.1:9001,127.0.0.1:9002", "round_robin", 4, 0, 1), 1);
+    proxy_route *route = find_proxy_route("/");
+    proxy_backend **backends = route->backends;
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[0]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[1]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[2]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[0]);
+
+    atomic_store(&backends[1]->is_healthy, false);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[2]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[2]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[0]);
+    destroy_proxy();
+
+    ck_assert_int_eq(
+        create_proxy("/=127.0.0.1:9000,127.0.0.1:9001,127.0.0.1:9002", "least_conn", 4, 0, 1), 1);
+    route = find_proxy_route("/");
+    backends = route->backends;
+    atomic_store(&backends[0]->n_active, 2);
+    atomic_store(&backends[1]->n_active, 1);
+    atomic_store(&backends[2]->n_active, 3);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[1]);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[1]);
+    atomic_store(&backends[1]->is_healthy, false);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), backends[0]);
+
+    for (int b_no = 0; b_no < 3; b_no++)
+        atomic_store(&backends[b_no]->is_healthy, false);
+    ck_assert_ptr_eq(_pick_proxy_backend(route), NULL);
+    destroy_proxy();
+}
+END_TEST
+
+START_TEST(test_proxy_conn_pool) {
+    // Return a connection to the pool and check if it is reused until the backend closes it.
+    char route_str[64];
+    int listen_fd = _listen_backend("/", route_str);
+    ck_assert_int_eq(create_proxy(route_str, "round_robin", 1, 0, 1), 1);
+    proxy_backend *backend = find_proxy_route("/")->backends[0];
+
+    proxy_conn *upstream = calloc(1, sizeof(proxy_conn));
+    upstream->backend = backend;
+    ck_assert_int_ge(upstream->fd = _connect_proxy_backend(backend), 0);
+    int backend_fd = accept(listen_fd, NULL, NULL);
+    ck_assert_int_ge(backend_fd, 0);
+    ck_assert_int_eq(_check_proxy_connect(backend, upstream->fd), 1);
+
+    int fd = upstream->fd;
+    atomic_fetch_add(&backend->n_active, 1);
+    upstream->keep_alive = upstream->is_complete = true;
+    close_proxy_conn(upstream);
+    ck_assert_int_eq(atomic_load(&backend->n_active), 0);
+    ck_assert_int_eq(backend->n_idle, 1);
+    ck_assert_int_eq(_take_proxy_conn(backend), fd);
+    ck_assert_int_eq(_take_proxy_conn(backend), -1);
+
+    // Connections of incomplete responses are not pooled, neither are the ones over the limit.
+    upstream->fd = fd;
+    atomic_fetch_add(&backend->n_active, 1);
+    upstream->is_complete = false;
+    close_proxy_conn(upstream);
+    ck_assert_int_eq(backend->n_idle, 0);
+
+    ck_assert_int_ge(upstream->fd = _connect_proxy_backend(backend), 0);
+    close(accept(listen_fd, NULL, NULL));
+    usleep(10000);
+    upstream->is_complete = true;
+    atomic_fetch_add(&backend->n_active, 1);
+    close_proxy_conn(upstream);
+    ck_assert_int_eq(backend->n_idle, 1);
+    ck_assert_int_eq(_take_proxy_conn(backend), -1);
+    ck_assert_int_eq(backend->n_idle, 0);
+
+    free(upstream);
+    close(backend_fd);
+    close(listen_fd);
+    destroy_proxy();
+}
+END_TEST
+
+START_TEST(test_relay_proxy_response) {
+    // Forward a request and relay the response, dropping the hop-by-hop headers and the ones the
+    // client's and the backend's Connection headers name.
+    char route_str[64];
+    int listen_fd = _listen_backend("/", route_str);
+    ck_assert_int_eq(create_proxy(route_str, "round_robin", 4, 0, 1), 1);
+    int client_fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds), 0);
+    connection *conn = create_connection(client_fds[0]);
+    set_active_connection(conn);
+
+    request req = {.http_method = "GET", .url = "/users", .http_ver = "HTTP/1.1", .n_headers = 3};
+    req.headers[0] = (request_header){"Connection", "X-Secret"};
+    req.headers[1] = (request_header){"X-Secret", "1"};
+    req.headers[2] = (request_header){"Accept", "*/*"};
+    int status = 0;
+    proxy_conn *upstream = open_proxy_request(find_proxy_route("/"), conn, &req, 1024, &status);
+    ck_assert_ptr_ne(upstream, NULL);
+
+    // The request is sent without blocking, the response is waited for.
+    int backend_fd = accept(listen_fd, NULL, NULL);
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 2);
+    ck_assert_int_eq(upstream->state, PROXY_RECEIVING);
+    ck_assert(!upstream->waits_client);
+    ck_assert_uint_eq(upstream->events, POLLIN);
+
+    char buf[512] = "";
+    ck_assert_int_gt(recv(backend_fd, buf, sizeof(buf) - 1, 0), 0);
+    ck_assert_str_eq(buf, "GET /users HTTP/1.1\r\nAccept: */*\r\nx-forwarded-for: \r\n"
+                          "x-forwarded-proto: http\r\nconnection: keep-alive\r\n\r\n");
+
+    const char *head = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 10\r\n"
+                       "Keep-Alive: timeout=5\r\nConnection: X-Drop\r\nX-Drop: 1\r\n"
+                       "X-Backend: 1\r\n\r\nhello";
+    ck_assert_int_eq(send(backend_fd, head, strlen(head), 0), strlen(head));
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 1);
+    ck_assert_int_eq(upstream->parser.status, 200);
+    ck_assert(upstream->keep_alive);
+    ck_assert(upstream->has_body);
+    ck_assert(!upstream->until_close);
+
+    // The rest of the body is waited for as well.
+    response *res = upstream->res = create_response(client_fds[0]);
+    res->http_ver = "HTTP/1.1";
+    res->status_code = "200 OK";
+    set_response_header(res, "connection", "close");
+    ck_assert_int_eq(relay_proxy_response(upstream), 2);
+    ck_assert(!upstream->waits_client);
+    ck_assert_int_eq(send(backend_fd, "world", 5, 0), 5);
+    ck_assert_int_eq(relay_proxy_response(upstream), 1);
+    ck_assert(upstream->is_complete);
+
+    const char *expected =
+        "HTTP/1.1 200 OK\r\nContent-Length: 10\r\nX-Backend: 1\r\nconnection: close\r\n\r\n"
+        "helloworld";
+    ck_assert_uint_eq(upstream->n_sent, strlen(expected));
+    memset(buf, 0, sizeof(buf));
+    ck_assert_int_eq(recv(client_fds[1], buf, sizeof(buf) - 1, 0), strlen(expected));
+    ck_assert_str_eq(buf, expected);
+
+    close_proxy_conn(upstream);
+    ck_assert_int_eq(find_proxy_route("/")->backends[0]->n_idle, 1);
+    set_active_connection(NULL);
+    close_connection(conn);
+    close(client_fds[1]);
+    close(backend_fd);
+    close(listen_fd);
+    destroy_proxy();
+}
+END_TEST
+
+START_TEST(test_relay_proxy_chunks_http2) {
+    // Remove the chunk framing for an upgraded HTTP/2 stream, whose request line is HTTP/1.1.
+    char route_str[64];
+    int listen_fd = _listen_backend("/", route_str);
+    ck_assert_int_eq(create_proxy(route_str, "round_robin", 4, 0, 1), 1);
+    int client_fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds), 0);
+    connection *conn = create_connection(client_fds[0]);
+    conn->http2 = create_http2_session(client_fds[0], 100, 8192, 1024);
+    ck_assert_int_eq(start_http2_session(conn->http2, NULL), 1);
+    http2_stream *stream =
+        open_http2_upgrade_stream(conn->http2, "GET / HTTP/1.1\r\n\r\n", 18, false);
+    begin_http2_stream(conn->http2, stream);
+
+    request req = {.http_method = "GET", .url = "/", .http_ver = "HTTP/1.1"};
+    int status = 0;
+    proxy_conn *upstream = open_proxy_request(find_proxy_route("/"), conn, &req, 1024, &status);
+    ck_assert_ptr_ne(upstream, NULL);
+    int backend_fd = accept(listen_fd, NULL, NULL);
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 2);
+
+    const char *answer = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "5\r\nhello\r\n5\r\nworld\r\n0\r\n\r\n";
+    ck_assert_int_eq(send(backend_fd, answer, strlen(answer), 0), strlen(answer));
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 1);
+    ck_assert(upstream->body.chunked);
+    ck_assert(upstream->dechunk);
+
+    // Only the data of the chunks is sent after the head.
+    response *res = upstream->res = create_response(client_fds[0]);
+    res->http_ver = "HTTP/1.1";
+    res->status_code = "200 OK";
+    ck_assert_int_eq(relay_proxy_response(upstream), 1);
+    ck_assert(upstream->is_complete);
+    ck_assert_uint_eq(upstream->n_sent, strlen("HTTP/1.1 200 OK\r\n\r\n") + 10);
+    ck_assert_uint_eq(stream->pending_len, 0);
+
+    close_proxy_conn(upstream);
+    finish_http2_stream(conn->http2, stream);
+    close_connection(conn);
+    close(client_fds[1]);
+    close(backend_fd);
+    close(listen_fd);
+    destroy_proxy();
+}
+END_TEST
+
+START_TEST(test_proxy_timeout) {
+    // Give up on a backend that doesn't answer in time with 504.
+    char route_str[64];
+    int listen_fd = _listen_backend("/", route_str);
+    ck_assert_int_eq(create_proxy(route_str, "round_robin", 4, 0, 1), 1);
+    connection *conn = create_connection(-1);
+
+    request req = {.http_method = "GET", .url = "/", .http_ver = "HTTP/1.1"};
+    int status = 0;
+    proxy_conn *upstream = open_proxy_request(find_proxy_route("/"), conn, &req, 1024, &status);
+    ck_assert_ptr_ne(upstream, NULL);
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 2);
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 2);
+
+    upstream->is_timed_out = true;
+    ck_assert_int_eq(forward_proxy_request(upstream, &status), 0);
+    ck_assert_int_eq(status, 504);
+    ck_assert_int_eq(upstream->fd, -1);
+    ck_assert_int_eq(atomic_load(&find_proxy_route("/")->backends[0]->n_active), 0);
+
+    close_proxy_conn(upstream);
+    close_connection(conn);
+    close(listen_fd);
+    destroy_proxy();
+}
+END_TEST
+
+Suite *proxy_suite() {
+    const TTest *tests[] = {test_find_proxy_route, test_pick_proxy_backend, test_proxy_conn_pool,
+                            test_relay_proxy_response, test_relay_proxy_chunks_http2,
+                            test_proxy_timeout};
+
+    Suite *suite = suite_create("Proxy");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = proxy_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,5 +1,7 @@
 #include <check.h>
+#include <string.h>
 
+#include "helpers.h"
 #include "request.h"
 
 char req_buf[REQ_BUF_SIZE] =
@@ -30,7 +32,7 @@ START_TEST(test__initialize_request) {
     ck_assert_ptr_eq(req->http_method, NULL);
     ck_assert_ptr_eq(req->url, NULL);
     ck_assert_ptr_eq(req->http_ver, NULL);
-    ck_assert_int_eq(g_hash_table_size(req->header_htab), 0);
+    ck_assert_int_eq(req->n_headers, 0);
 
     _free_request(req);
 }
@@ -46,7 +48,7 @@ START_TEST(test__parse_request) {
     ck_assert_str_eq(req->http_method, "GET");
     ck_assert_str_eq(req->url, "/");
     ck_assert_str_eq(req->http_ver, "HTTP/1.1");
-    ck_assert_int_eq(g_hash_table_size(req->header_htab), 12);
+    ck_assert_int_eq(req->n_headers, 12);
 
     _free_request(req);
 }
@@ -69,6 +71,39 @@ START_TEST(test__parse_request_null_req) {
 }
 END_TEST
 
+START_TEST(test__parse_request_incomplete) {
+    // Call _parse_request() with an incomplete request head and check if it returns 0.
+    request *req = _initialize_request();
+    int ret_val = _parse_request("GET / HTTP/1.1\r\nHost: localhost\r\n", req);
+    ck_assert_int_eq(ret_val, 0);
+
+    _free_request(req);
+}
+END_TEST
+
+START_TEST(test_parse_request_in_place) {
+    // Parse a request head in place and check if the request points into the same buffer.
+    char buf[] = "GET /a.html HTTP/1.0\r\nhost:  localhost \r\n\r\nGET /b";
+    http_parser parser;
+    init_http_parser(&parser);
+    ck_assert_int_eq(parse_http_request(&parser, buf, strlen(buf)), HTTP_PARSE_OK);
+
+    request *req = parse_request_in_place(buf, &parser, -1, NULL);
+    ck_assert_ptr_ne(req, NULL);
+    ck_assert_ptr_eq(req->buf, NULL);
+    ck_assert_ptr_eq(req->url, buf + 4);
+    ck_assert_str_eq(req->url, "/a.html");
+    ck_assert_str_eq(req->http_ver, "HTTP/1.0");
+
+    // Header names are case-insensitive and values don't include the surrounding whitespace.
+    ck_assert_str_eq(get_request_header(req, "Host", NULL), "localhost");
+
+    // The pipelined request after the head is not modified.
+    ck_assert_str_eq(buf + parser.head_len, "GET /b");
+    _free_request(req);
+}
+END_TEST
+
 START_TEST(test__free_request) {
     // Call _initialize_request() to initialize a request with default values.
     request *req = _initialize_request();
@@ -86,7 +121,7 @@ START_TEST(test_get_request_header) {
     ck_assert_int_eq(ret_val, 1);
 
     // Check if all the request header fields are parsed correctly.
-    ck_assert_int_eq(g_hash_table_size(req->header_htab), 12);
+    ck_assert_int_eq(req->n_headers, 12);
 
     // Check if the request header field Host is parsed correctly.
     const char *val = get_request_header(req, "Host", NULL);
@@ -106,6 +141,24 @@ START_TEST(test_get_request_header) {
 }
 END_TEST
 
+START_TEST(test_get_known_request_header) {
+    // Create a sample request and check if known headers are found without their names.
+    request *req = _initialize_request();
+    int ret_val = _parse_request(req_buf, req);
+    ck_assert_int_eq(ret_val, 1);
+
+    ck_assert_str_eq(get_known_request_header(req, HTTP_HEADER_CONNECTION), "keep-alive");
+    ck_assert_str_eq(get_known_request_header(req, HTTP_HEADER_ACCEPT_ENCODING),
+                     "gzip, deflate, br");
+    ck_assert_ptr_eq(get_known_request_header(req, HTTP_HEADER_RANGE), NULL);
+
+    // Known headers are still found by name, in any case.
+    ck_assert_str_eq(get_request_header(req, "HOST", NULL), "localhost:8080");
+    ck_assert_ptr_eq(get_request_header(req, "If-None-Match", NULL), NULL);
+    _free_request(req);
+}
+END_TEST
+
 START_TEST(test_get_request_header_undefined_field) {
     // Create a sample request to test get_request_header() function.
     request *req = _initialize_request();
@@ -146,16 +199,107 @@ START_TEST(test_get_request_header_null_req) {
 }
 END_TEST
 
+START_TEST(test_is_request_not_modified) {
+    // Evaluate conditional headers against a file's validators and check the 304 decisions.
+    char bufs[][256] = {
+        "GET / HTTP/1.1\r\nIf-None-Match: \"a\", W/\"abc\"\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-None-Match: *\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-None-Match: \"ab\"\r\n"
+        "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-Modified-Since: Sunday, 06-Nov-94 08:49:36 GMT\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-Modified-Since: Sun Nov  6 08:49:37 1994\r\n\r\n",
+        "GET / HTTP/1.1\r\nIf-Modified-Since: yesterday\r\n\r\n",
+        "GET / HTTP/1.1\r\n\r\n"};
+    int expected[] = {1, 1, 0, 1, 0, 1, 0, 0};
+    time_t mtime = 784111777; // Sun, 06 Nov 1994 08:49:37 GMT
+
+    for (int i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        http_parser parser;
+        init_http_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[i], strlen(bufs[i])), HTTP_PARSE_OK);
+
+        request *req = parse_request_in_place(bufs[i], &parser, -1, NULL);
+        ck_assert_int_eq(is_request_not_modified(req, "\"abc\"", mtime), expected[i]);
+        _free_request(req);
+    }
+
+    char date[HTTP_DATE_BUF_SIZE];
+    ck_assert_str_eq(format_http_date(mtime, date), "Sun, 06 Nov 1994 08:49:37 GMT");
+    ck_assert_int_eq(parse_http_date(date), mtime);
+}
+END_TEST
+
+START_TEST(test_parse_request_ranges) {
+    // Parse Range headers for a 1000 byte file and check the truncated and merged ranges.
+    char bufs[][256] = {"GET / HTTP/1.1\r\nRange: bytes=0-499\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: bytes=900-, -50\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: bytes=500-599, 0-9, 590-1999, 10-19\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: bytes=1000-, 2000-2999\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: bytes=5-1\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: lines=0-1\r\n\r\n",
+                        "GET / HTTP/1.1\r\nRange: bytes=-0\r\n\r\n",
+                        "GET / HTTP/1.1\r\n\r\n"};
+    int expected[] = {1, 1, 2, REQ_RANGE_NOT_SATISFIABLE, 0, 0, REQ_RANGE_NOT_SATISFIABLE, 0};
+    byte_range expected_ranges[][2] = {
+        {{0, 499}}, {{900, 999}}, {{0, 19}, {500, 999}}, {{0}}, {{0}}, {{0}}, {{0}}, {{0}}};
+
+    for (int i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        http_parser parser;
+        init_http_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[i], strlen(bufs[i])), HTTP_PARSE_OK);
+
+        byte_range ranges[REQ_MAX_RANGES];
+        request *req = parse_request_in_place(bufs[i], &parser, -1, NULL);
+        ck_assert_int_eq(parse_request_ranges(req, 1000, ranges, REQ_MAX_RANGES), expected[i]);
+        for (int range_no = 0; range_no < expected[i]; range_no++) {
+            ck_assert_int_eq(ranges[range_no].first, expected_ranges[i][range_no].first);
+            ck_assert_int_eq(ranges[range_no].last, expected_ranges[i][range_no].last);
+        }
+        _free_request(req);
+    }
+}
+END_TEST
+
+START_TEST(test_is_request_range_fresh) {
+    // Evaluate If-Range headers against a file's validators and check if the range is honoured.
+    char bufs[][256] = {"GET / HTTP/1.1\r\nIf-Range: \"abc\"\r\n\r\n",
+                        "GET / HTTP/1.1\r\nIf-Range: W/\"abc\"\r\n\r\n",
+                        "GET / HTTP/1.1\r\nIf-Range: \"ab\"\r\n\r\n",
+                        "GET / HTTP/1.1\r\nIf-Range: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n",
+                        "GET / HTTP/1.1\r\nIf-Range: Sun, 06 Nov 1994 08:49:38 GMT\r\n\r\n",
+                        "GET / HTTP/1.1\r\n\r\n"};
+    int expected[] = {1, 0, 0, 1, 0, 1};
+    time_t mtime = 784111777; // Sun, 06 Nov 1994 08:49:37 GMT
+
+    for (int i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        http_parser parser;
+        init_http_parser(&parser);
+        ck_assert_int_eq(parse_http_request(&parser, bufs[i], strlen(bufs[i])), HTTP_PARSE_OK);
+
+        request *req = parse_request_in_place(bufs[i], &parser, -1, NULL);
+        ck_assert_int_eq(is_request_range_fresh(req, "\"abc\"", mtime), expected[i]);
+        _free_request(req);
+    }
+}
+END_TEST
+
 Suite *request_suite() {
     const TTest *tests[] = {test__initialize_request,
                             test__parse_request,
                             test__parse_request_null_req_buf,
                             test__parse_request_null_req,
+                            test__parse_request_incomplete,
+                            test_parse_request_in_place,
                             test__free_request,
                             test_get_request_header,
+                            test_get_known_request_header,
                             test_get_request_header_undefined_field,
                             test_get_request_header_null_field,
-                            test_get_request_header_null_req};
+                            test_get_request_header_null_req,
+                            test_is_request_not_modified,
+                            test_parse_request_ranges,
+                            test_is_request_range_fresh};
 
     Suite *suite = suite_create("Request");
     TCase *tc_core = tcase_create("Core");
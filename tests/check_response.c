@@ -1,5 +1,8 @@
 #include <check.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "request.h"
 #include "response.h"
@@ -12,7 +15,7 @@ START_TEST(test__initialize_response) {
     ck_assert_int_eq(res->conn_fd, -1);
     ck_assert_ptr_eq(res->http_ver, NULL);
     ck_assert_ptr_eq(res->status_code, NULL);
-    ck_assert_int_eq(g_hash_table_size(res->header_htab), 0);
+    ck_assert_int_eq(res->n_headers, 0);
 
     _free_response(res);
 }
@@ -42,10 +45,10 @@ START_TEST(test_create_response_from_request) {
 
     ck_assert_ptr_ne(res, NULL);
     ck_assert_int_ne(res->conn_fd, -1);
-    ck_assert_int_ne(res->conn_fd, req->conn_fd);
+    ck_assert_int_eq(res->conn_fd, req->conn_fd);
     ck_assert_str_eq(res->http_ver, req->http_ver);
     ck_assert_ptr_eq(res->status_code, NULL);
-    ck_assert_int_eq(g_hash_table_size(res->header_htab), 0);
+    ck_assert_int_eq(res->n_headers, 0);
 
     _free_request(req);
     close_response(res);
@@ -63,7 +66,7 @@ START_TEST(test_create_response_from_default_request) {
     ck_assert_int_eq(res->conn_fd, -1);
     ck_assert_ptr_eq(res->http_ver, NULL);
     ck_assert_ptr_eq(res->status_code, NULL);
-    ck_assert_int_eq(g_hash_table_size(res->header_htab), 0);
+    ck_assert_int_eq(res->n_headers, 0);
 
     _free_request(req);
     _free_response(res);
@@ -86,7 +89,7 @@ START_TEST(test_set_response_header) {
     set_response_header(res, "Content-Type", "text/html");
     set_response_header(res, "Content-Length", "100");
     set_response_header(res, "Connection", "close");
-    ck_assert_int_eq(g_hash_table_size(res->header_htab), 3);
+    ck_assert_int_eq(res->n_headers, 3);
 
     _free_response(res);
 }
@@ -115,6 +118,198 @@ START_TEST(test_get_response_header) {
 }
 END_TEST
 
+START_TEST(test_send_response_fd) {
+    // Create a sample file and a connected socket pair to test send_response_fd() function.
+    FILE *file = tmpfile();
+    fputs("Hello, World!", file);
+    fflush(file);
+
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    response *res = _initialize_response();
+    res->conn_fd = fds[0];
+
+    // call send_response_fd() with an offset and check if only the requested range is sent.
+    ssize_t sent = send_response_fd(res, fileno(file), 7, 5);
+    ck_assert_int_eq(sent, 5);
+
+    char buf[16] = {0};
+    ck_assert_int_eq(recv(fds[1], buf, sizeof(buf) - 1, 0), 5);
+    ck_assert_str_eq(buf, "World");
+
+    close_response(res);
+    close(fds[0]);
+    close(fds[1]);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_send_response_file) {
+    // Create a sample file stream and a connected socket pair to test send_response_file().
+    FILE *file = tmpfile();
+    fputs("Hello, World!", file);
+    fflush(file);
+    fseek(file, 7, SEEK_SET);
+
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    response *res = _initialize_response();
+    res->conn_fd = fds[0];
+
+    // call send_response_file() and check if the file is sent from the stream position to the end.
+    ck_assert_int_eq(send_response_file(res, file), 6);
+    ck_assert_int_eq(ftell(file), 13);
+    ck_assert_int_eq(send_response_file(res, file), 0);
+
+    char buf[16] = {0};
+    ck_assert_int_eq(recv(fds[1], buf, sizeof(buf) - 1, 0), 6);
+    ck_assert_str_eq(buf, "World!");
+
+    close_response(res);
+    close(fds[0]);
+    close(fds[1]);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test__serialize_response_head) {
+    // Create a sample response to test _serialize_response_head() function.
+    response *res = _initialize_response();
+    res->http_ver = "HTTP/1.1";
+    res->status_code = "200 OK";
+    set_response_header(res, "Content-Length", "5");
+
+    // call _serialize_response_head() and check if the head is serialized into one buffer.
+    GString *head = _serialize_response_head(res);
+    ck_assert_ptr_ne(head, NULL);
+    ck_assert_str_eq(head->str, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n");
+
+    g_string_free(head, TRUE);
+    _free_response(res);
+}
+END_TEST
+
+START_TEST(test__serialize_response_head_without_status) {
+    // call _serialize_response_head() without status code and check if it returns NULL.
+    response *res = _initialize_response();
+    res->http_ver = "HTTP/1.1";
+
+    ck_assert_ptr_eq(_serialize_response_head(res), NULL);
+    _free_response(res);
+}
+END_TEST
+
+START_TEST(test_send_response_with_fd) {
+    // Create a sample file and a connected socket pair to test send_response_with_fd() function.
+    FILE *file = tmpfile();
+    fputs("Hello", file);
+    fflush(file);
+
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    response *res = _initialize_response();
+    res->conn_fd = fds[0];
+    res->http_ver = "HTTP/1.1";
+    res->status_code = "200 OK";
+
+    // call send_response_with_fd() and check if head and body are received in one read.
+    ck_assert_int_eq(send_response_with_fd(res, fileno(file), 0, 5), 5);
+
+    char buf[64] = {0};
+    ck_assert_int_eq(recv(fds[1], buf, sizeof(buf) - 1, 0), 24);
+    ck_assert_str_eq(buf, "HTTP/1.1 200 OK\r\n\r\nHello");
+
+    close_response(res);
+    close(fds[0]);
+    close(fds[1]);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_send_response_with_ranges) {
+    // Create a sample file and a connected socket pair to test send_response_with_ranges().
+    FILE *file = tmpfile();
+    fputs("Hello, World!", file);
+    fflush(file);
+
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    response *res = _initialize_response();
+    res->conn_fd = fds[0];
+    res->http_ver = "HTTP/1.1";
+    res->status_code = "206 Partial Content";
+
+    // call send_response_with_ranges() and check if every range is sent as a part.
+    const char *body = "\r\n--B\r\ncontent-type: text/plain\r\ncontent-range: bytes 0-4/13\r\n\r\n"
+                       "Hello"
+                       "\r\n--B\r\ncontent-type: text/plain\r\ncontent-range: bytes 7-11/13\r\n\r\n"
+                       "World"
+                       "\r\n--B--\r\n";
+    byte_range ranges[] = {{0, 4}, {7, 11}};
+    ck_assert_int_eq(get_multipart_ranges_length(ranges, 2, 13, "text/plain", "B"), strlen(body));
+    ck_assert_int_eq(send_response_with_ranges(res, fileno(file), ranges, 2, 13, "text/plain", "B"),
+                     strlen(body));
+
+    char buf[512] = {0};
+    size_t expected_size = strlen("HTTP/1.1 206 Partial Content\r\n\r\n") + strlen(body);
+    ssize_t recv_size = 0, total_recv_size = 0;
+    while (total_recv_size < expected_size &&
+           (recv_size = recv(fds[1], buf + total_recv_size, sizeof(buf) - 1 - total_recv_size,
+                             0)) > 0)
+        total_recv_size += recv_size;
+    ck_assert_int_eq(total_recv_size, expected_size);
+    ck_assert_str_eq(buf + strlen("HTTP/1.1 206 Partial Content\r\n\r\n"), body);
+
+    close_response(res);
+    close(fds[0]);
+    close(fds[1]);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_get_error_response) {
+    // Look up error responses and check if unknown status codes fall back to 500.
+    const error_response *error = get_error_response(404);
+    ck_assert_int_eq(error->status, 404);
+    ck_assert_str_eq(error->status_code, "404 Not Found");
+    ck_assert_int_eq(error->body_len, strlen(error->body));
+    ck_assert_ptr_ne(strstr(error->body, "<h1>404 Not Found</h1>"), NULL);
+
+    ck_assert_str_eq(get_error_response(405)->status_code, "405 Method Not Allowed");
+    ck_assert_int_eq(get_error_response(200)->status, 500);
+}
+END_TEST
+
+START_TEST(test_send_error_response) {
+    // Send an error response and check if the head and the body are received.
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    response *res = _initialize_response();
+    res->conn_fd = fds[0];
+    res->http_ver = "HTTP/1.1";
+
+    const error_response *error = get_error_response(400);
+    ck_assert_int_eq(send_error_response(res, 400, false), error->body_len);
+
+    char buf[512] = {0};
+    ssize_t recv_size = recv(fds[1], buf, sizeof(buf) - 1, 0);
+    ck_assert_int_eq(strncmp(buf, "HTTP/1.1 400 Bad Request\r\n", 26), 0);
+    ck_assert_ptr_ne(strstr(buf, "content-type: text/html\r\n"), NULL);
+    ck_assert_str_eq(buf + recv_size - error->body_len, error->body);
+
+    // call send_raw_error_response() and check if the connection is closed after the response.
+    ck_assert_int_eq(send_raw_error_response(fds[0], 503), get_error_response(503)->body_len);
+    memset(buf, 0, sizeof(buf));
+    recv(fds[1], buf, sizeof(buf) - 1, 0);
+    ck_assert_int_eq(strncmp(buf, "HTTP/1.1 503 Service Unavailable\r\n", 34), 0);
+    ck_assert_ptr_ne(strstr(buf, "connection: close\r\n\r\n"), NULL);
+
+    close_response(res);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
 Suite *response_suite() {
     const TTest *tests[] = {test__initialize_response,
                             test__free_response,
@@ -122,7 +317,15 @@ Suite *response_suite() {
                             test_create_response_from_default_request,
                             test_create_response_from_null_request,
                             test_set_response_header,
-                            test_get_response_header};
+                            test_get_response_header,
+                            test_send_response_fd,
+                            test_send_response_file,
+                            test__serialize_response_head,
+                            test__serialize_response_head_without_status,
+                            test_send_response_with_fd,
+                            test_send_response_with_ranges,
+                            test_get_error_response,
+                            test_send_error_response};
 
     Suite *suite = suite_create("Response");
     TCase *tc_core = tcase_create("Core");
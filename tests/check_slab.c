@@ -0,0 +1,119 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+START_TEST(test_slab_alloc) {
+    // Allocate from a slab cache and check if freed objects are reused by the matching pool.
+    const size_t sizes[] = {1000, 64, 64};
+    slab_cache *cache = create_slab_cache(sizes, 3, -1);
+    ck_assert_ptr_ne(cache, NULL);
+    ck_assert_int_eq(cache->n_pools, 2);
+    ck_assert_uint_eq(cache->pools[0].obj_size, 64);
+    ck_assert_uint_eq(cache->pools[1].obj_size, 1008);
+    set_thread_slab_cache(cache);
+
+    char *small = slab_alloc(10), *large = slab_alloc(1000);
+    ck_assert_ptr_ne(small, NULL);
+    ck_assert_ptr_ne(large, NULL);
+    ck_assert_uint_eq((uintptr_t)small % 16, 0);
+    ck_assert_uint_eq((uintptr_t)large % 16, 0);
+    ck_assert_uint_eq(cache->pools[0].n_free, cache->pools[0].n_objects - 1);
+    ck_assert_uint_eq(cache->pools[1].n_free, cache->pools[1].n_objects - 1);
+    memset(large, 'a', 1000);
+
+    slab_free(small);
+    ck_assert_ptr_eq(slab_alloc(64), small);
+    slab_free(small);
+    slab_free(large);
+    ck_assert_uint_eq(cache->pools[0].n_free, cache->pools[0].n_objects);
+    ck_assert_uint_eq(cache->pools[1].n_free, cache->pools[1].n_objects);
+
+    // Sizes larger than every size class are allocated with malloc().
+    char *huge = slab_alloc(4096);
+    ck_assert_ptr_ne(huge, NULL);
+    ck_assert_uint_eq(cache->pools[1].n_free, cache->pools[1].n_objects);
+    slab_free(huge);
+    slab_free(NULL);
+
+    destroy_slab_cache(cache);
+}
+END_TEST
+
+START_TEST(test_slab_realloc) {
+    // Grow an object past its size class and check if the contents are kept.
+    const size_t sizes[] = {32, 256};
+    slab_cache *cache = create_slab_cache(sizes, 2, -1);
+    set_thread_slab_cache(cache);
+
+    char *ptr = slab_realloc(NULL, 20);
+    strcpy(ptr, "Hello, World!");
+    ck_assert_ptr_eq(slab_realloc(ptr, 32), ptr);
+
+    ptr = slab_realloc(ptr, 200);
+    ck_assert_str_eq(ptr, "Hello, World!");
+    ck_assert_uint_eq(cache->pools[0].n_free, cache->pools[0].n_objects);
+
+    ptr = slab_realloc(ptr, 1000);
+    ck_assert_str_eq(ptr, "Hello, World!");
+    ck_assert_uint_eq(cache->pools[1].n_free, cache->pools[1].n_objects);
+    slab_free(ptr);
+
+    // Destroying the cache of the thread makes it allocate with malloc().
+    destroy_slab_cache(cache);
+    ptr = slab_alloc(32);
+    ck_assert_ptr_ne(ptr, NULL);
+    slab_free(ptr);
+}
+END_TEST
+
+START_TEST(test_slab_numa_node) {
+    // Create a cache bound to the node of CPU 0 and check if its slabs are still usable.
+    int numa_node = get_cpu_numa_node(0);
+    ck_assert_int_ge(numa_node, -1);
+    ck_assert_int_eq(get_cpu_numa_node(-1), -1);
+
+    const size_t sizes[] = {SLAB_SIZE / 2};
+    slab_cache *cache = create_slab_cache(sizes, 1, numa_node);
+    set_thread_slab_cache(cache);
+
+    char *a = slab_alloc(SLAB_SIZE / 2), *b = slab_alloc(SLAB_SIZE / 2);
+    ck_assert_ptr_ne(a, NULL);
+    ck_assert_ptr_ne(b, NULL);
+    memset(a, 0, SLAB_SIZE / 2);
+    memset(b, 0, SLAB_SIZE / 2);
+    ck_assert_uint_eq(cache->pools[0].n_objects, 2);
+    slab_free(a);
+    slab_free(b);
+
+    destroy_slab_cache(cache);
+}
+END_TEST
+
+Suite *slab_suite() {
+    const TTest *tests[] = {test_slab_alloc, test_slab_realloc, test_slab_numa_node};
+
+    Suite *suite = suite_create("Slab");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = slab_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
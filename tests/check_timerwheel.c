@@ -0,0 +1,91 @@
+#include <check.h>
+#include <stdlib.h>
+
+#include "timerwheel.h"
+
+START_TEST(test_create_timer_wheel) {
+    // Create a timer wheel and check if the number of slots is rounded up to a power of two.
+    timer_wheel *wheel = create_timer_wheel(50, 100);
+    ck_assert_ptr_ne(wheel, NULL);
+    ck_assert_uint_eq(wheel->mask, 63);
+    ck_assert_int_eq(wheel->now, 100);
+    ck_assert_uint_eq(wheel->n_timers, 0);
+    ck_assert_ptr_eq(expire_timer(wheel, 200), NULL);
+    ck_assert_int_eq(wheel->now, 200);
+
+    destroy_timer_wheel(wheel);
+    destroy_timer_wheel(NULL);
+}
+END_TEST
+
+START_TEST(test_expire_timer) {
+    // Schedule timers and check if they only expire once their second has come.
+    timer_wheel *wheel = create_timer_wheel(8, 0);
+    timer_wheel_timer a = {0}, b = {0}, c = {0}, past = {0};
+    schedule_timer(wheel, &a, 3);
+    schedule_timer(wheel, &b, 3);
+    schedule_timer(wheel, &past, -5);
+    // c shares the slot of a and b, but is a whole round of the wheel later.
+    schedule_timer(wheel, &c, 11);
+    ck_assert_uint_eq(wheel->n_timers, 4);
+
+    ck_assert_ptr_eq(expire_timer(wheel, 0), &past);
+    ck_assert(!past.is_scheduled);
+    ck_assert_ptr_eq(expire_timer(wheel, 2), NULL);
+
+    timer_wheel_timer *first = expire_timer(wheel, 3), *second = expire_timer(wheel, 3);
+    ck_assert((first == &a && second == &b) || (first == &b && second == &a));
+    ck_assert_ptr_eq(expire_timer(wheel, 10), NULL);
+    ck_assert_ptr_eq(expire_timer(wheel, 11), &c);
+    ck_assert_uint_eq(wheel->n_timers, 0);
+
+    destroy_timer_wheel(wheel);
+}
+END_TEST
+
+START_TEST(test_schedule_timer) {
+    // Reschedule and cancel timers and check if only the last schedule counts.
+    timer_wheel *wheel = create_timer_wheel(8, 0);
+    timer_wheel_timer a = {0}, b = {0};
+    schedule_timer(wheel, &a, 2);
+    schedule_timer(wheel, &b, 2);
+    schedule_timer(wheel, &a, 5);
+    cancel_timer(wheel, &b);
+    cancel_timer(wheel, &b);
+    ck_assert_uint_eq(wheel->n_timers, 1);
+    ck_assert_ptr_eq(expire_timer(wheel, 4), NULL);
+
+    // Timers far behind the wheel are still found, every slot is looked at.
+    ck_assert_ptr_eq(expire_timer(wheel, 1000), &a);
+    ck_assert_ptr_eq(expire_timer(wheel, 1000), NULL);
+    ck_assert_int_eq(wheel->now, 1000);
+
+    destroy_timer_wheel(wheel);
+}
+END_TEST
+
+Suite *timerwheel_suite() {
+    const TTest *tests[] = {test_create_timer_wheel, test_expire_timer, test_schedule_timer};
+
+    Suite *suite = suite_create("Timer Wheel");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = timerwheel_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,207 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "tls.h"
+
+#define CERT_FILE "/tmp/check_tls_cert.pem"
+#define KEY_FILE "/tmp/check_tls_key.pem"
+
+/**
+ * Writes a self-signed certificate for localhost and its key to `CERT_FILE` and `KEY_FILE`.
+ */
+void _write_self_signed_cert() {
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1,
+                               -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    FILE *cert_file = fopen(CERT_FILE, "w"), *key_file = fopen(KEY_FILE, "w");
+    PEM_write_X509(cert_file, cert);
+    PEM_write_PrivateKey(key_file, key, NULL, NULL, 0, NULL, NULL);
+    fclose(cert_file);
+    fclose(key_file);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+}
+
+/**
+ * Runs the handshake of a client session on `client_fd` against the server session of `server_fd`,
+ * both non-blocking, until both are done.
+ */
+SSL *_tls_handshake(SSL_CTX *client_ctx, const int client_fd, const int server_fd,
+                    SSL_SESSION *session) {
+    SSL *client = SSL_new(client_ctx);
+    SSL_set_fd(client, client_fd);
+    SSL_set_connect_state(client);
+    SSL_set_alpn_protos(client, (const unsigned char *)"\x02h2\x08http/1.1", 12);
+    if (session != NULL)
+        SSL_set_session(client, session);
+
+    ck_assert_int_eq(start_tls_session(server_fd), 1);
+    tls_handshake_result result = TLS_HANDSHAKE_WANT_READ;
+    int client_done = 0;
+    for (int step = 0; step < 32 && (result != TLS_HANDSHAKE_DONE || !client_done); step++) {
+        client_done = client_done || SSL_do_handshake(client) == 1;
+        if (result != TLS_HANDSHAKE_DONE)
+            ck_assert_int_ne(result = continue_tls_handshake(server_fd), TLS_HANDSHAKE_ERROR);
+    }
+    ck_assert_int_eq(result, TLS_HANDSHAKE_DONE);
+    ck_assert(client_done);
+    return client;
+}
+
+START_TEST(test_create_tls) {
+    // Load a certificate and key, missing or mismatching files are rejected.
+    _write_self_signed_cert();
+    ck_assert(!is_tls_enabled());
+    ck_assert_int_eq(create_tls("/tmp/check_tls_missing.pem", KEY_FILE, 16, true, false), 0);
+    ck_assert_int_eq(create_tls(CERT_FILE, CERT_FILE, 16, true, false), 0);
+    ck_assert(!is_tls_enabled());
+    ck_assert_int_eq(create_tls(CERT_FILE, KEY_FILE, 16, true, false), 1);
+    ck_assert_int_eq(create_tls(CERT_FILE, KEY_FILE, 16, true, false), 2);
+    ck_assert(is_tls_enabled());
+
+    // Only the registered listening sockets serve TLS.
+    ck_assert_int_eq(add_tls_listen_fd(7), 1);
+    ck_assert(is_tls_listen_fd(7));
+    ck_assert(!is_tls_listen_fd(8));
+    destroy_tls();
+    ck_assert(!is_tls_enabled());
+    ck_assert(!is_tls_listen_fd(7));
+    ck_assert_int_eq(start_tls_session(0), 0);
+}
+END_TEST
+
+START_TEST(test_tls_session) {
+    // Run a handshake over a socket pair, then send both ways through the session.
+    _write_self_signed_cert();
+    ck_assert_int_eq(create_tls(CERT_FILE, KEY_FILE, 16, true, false), 1);
+    SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+    int fds[2];
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    ck_assert(!has_tls_session(fds[1]));
+    ck_assert(can_send_plaintext(fds[1]));
+    SSL *client = _tls_handshake(client_ctx, fds[0], fds[1], NULL);
+    ck_assert(has_tls_session(fds[1]));
+    ck_assert(!can_send_plaintext(fds[1]));
+
+    const unsigned char *alpn = NULL;
+    unsigned int alpn_len = 0;
+    SSL_get0_alpn_selected(client, &alpn, &alpn_len);
+    ck_assert_int_eq(alpn_len, 8);
+    ck_assert_int_eq(memcmp(alpn, "http/1.1", 8), 0);
+    ck_assert(has_tls_alpn(fds[1], "http/1.1"));
+    ck_assert(!has_tls_alpn(fds[1], "h2"));
+
+    char buf[64] = "";
+    ck_assert_int_eq(recv_tls(fds[1], buf, sizeof(buf)), -1);
+    ck_assert_int_eq(errno, EAGAIN);
+    ck_assert_int_eq(SSL_write(client, "GET / HTTP/1.1\r\n", 16), 16);
+    ck_assert_int_eq(recv_tls(fds[1], buf, sizeof(buf)), 16);
+    ck_assert_int_eq(memcmp(buf, "GET / HTTP/1.1\r\n", 16), 0);
+    ck_assert_int_eq(send_tls(fds[1], "HTTP/1.1 200 OK\r\n", 17, MSG_MORE), 17);
+    memset(buf, 0, sizeof(buf));
+    ck_assert_int_eq(SSL_read(client, buf, sizeof(buf)), 17);
+    ck_assert_str_eq(buf, "HTTP/1.1 200 OK\r\n");
+
+    // A closed session reads as the end of the connection, then the socket is plain again.
+    SSL_shutdown(client);
+    ck_assert_int_eq(recv_tls(fds[1], buf, sizeof(buf)), 0);
+    end_tls_session(fds[1]);
+    ck_assert(!has_tls_session(fds[1]));
+    ck_assert_int_eq(SSL_read(client, buf, sizeof(buf)), 0);
+    ck_assert_int_eq(send_tls(fds[1], "plain", 5, 0), 5);
+    ck_assert_int_eq(recv_tls(fds[0], buf, sizeof(buf)), 5);
+
+    SSL_free(client);
+    SSL_CTX_free(client_ctx);
+    close(fds[0]);
+    close(fds[1]);
+    destroy_tls();
+}
+END_TEST
+
+START_TEST(test_tls_session_resumption) {
+    // Resume a session from its ticket, then from the session cache without tickets, and with HTTP/2
+    // enabled ALPN selects `h2` every time.
+    _write_self_signed_cert();
+    ck_assert_int_eq(create_tls(CERT_FILE, KEY_FILE, 16, true, true), 1);
+    const long options[] = {0, SSL_OP_NO_TICKET};
+    const int versions[] = {TLS1_3_VERSION, TLS1_2_VERSION};
+
+    for (int opt_no = 0; opt_no < 2; opt_no++) {
+        SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_options(client_ctx, options[opt_no]);
+        SSL_CTX_set_max_proto_version(client_ctx, versions[opt_no]);
+        SSL_SESSION *session = NULL;
+
+        for (int conn_no = 0; conn_no < 2; conn_no++) {
+            int fds[2];
+            char buf[8] = "";
+            ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+            SSL *client = _tls_handshake(client_ctx, fds[0], fds[1], session);
+            ck_assert_int_eq(SSL_session_reused(client), conn_no);
+            ck_assert(has_tls_alpn(fds[1], "h2"));
+
+            // TLS 1.3 tickets arrive after the handshake, with the first response.
+            ck_assert_int_eq(send_tls(fds[1], "ok", 2, 0), 2);
+            ck_assert_int_eq(SSL_read(client, buf, sizeof(buf)), 2);
+            if (session == NULL)
+                ck_assert_ptr_ne(session = SSL_get1_session(client), NULL);
+
+            // A session that wasn't shut down is never resumed.
+            SSL_shutdown(client);
+            end_tls_session(fds[1]);
+            SSL_free(client);
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        SSL_SESSION_free(session);
+        SSL_CTX_free(client_ctx);
+    }
+    destroy_tls();
+}
+END_TEST
+
+Suite *tls_suite() {
+    const TTest *tests[] = {test_create_tls, test_tls_session, test_tls_session_resumption};
+
+    Suite *suite = suite_create("TLS");
+    TCase *tc_core = tcase_create("Core");
+
+    for (int t_no = 0; t_no < sizeof(tests) / sizeof(tests[0]); t_no++)
+        tcase_add_test(tc_core, tests[t_no]);
+    suite_add_tcase(suite, tc_core);
+
+    return suite;
+}
+
+int main() {
+    int no_failed;
+
+    Suite *suite = tls_suite();
+    SRunner *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}